@@ -5,6 +5,10 @@
         [Parameter(Mandatory)]
         [string]
     $SourceRepoDir,
+        ### Previously published remote repository, used to generate delta patches of the package index.
+        ### Defaults to the current content of `RemoteRepoDir`.
+        [string]
+    $PreviousRepoDir = $RemoteRepoDir,
         [switch]
     $Validate
 )
@@ -24,6 +28,24 @@ if ($Validate) {
     }
 }
 
+# number of delta patches kept in the repository; clients with an older index download the full index
+$MaxPatchCount = 100
+
+# read the previous index and its patches before the output directory is wiped
+$PreviousIndex = $null
+$PreviousSequence = 0
+$Patches = @{}
+if (Test-Path "$PreviousRepoDir\v2\index.html") {
+    $PreviousIndex = Get-Content -Raw "$PreviousRepoDir\v2\index.html" | ConvertFrom-Json -AsHashtable
+    if (Test-Path "$PreviousRepoDir\v2\patches\sequence.txt") {
+        $PreviousSequence, $FirstPatch = (Get-Content -Raw "$PreviousRepoDir\v2\patches\sequence.txt").Trim() -split " " `
+            | % {[uint64]$_}
+        for ($s = $FirstPatch; $s -le $PreviousSequence; $s++) {
+            $Patches[$s] = Get-Content -Raw "$PreviousRepoDir\v2\patches\$s.txt"
+        }
+    }
+}
+
 $OutDir = mkdir -Force $RemoteRepoDir
 rm -Recurse $OutDir\*
 $OutV1, $OutV2 = mkdir $OutDir\v1, $OutDir\v2
@@ -37,6 +59,48 @@ $Packages | % {
 # not really html, but GitHub Pages will not accept `index.json`
 $VersionMap | ConvertTo-Json -Depth 100 -Compress | Set-Content "$OutV1\index.html", "$OutV2\index.html"
 
+# delta patches of the v2 index (see `Pog.Native/src/repository/DeltaUpdate.hpp`): `patches/<n>.txt` lists the packages
+#  changed between sequence `n - 1` and `n`, as `+<name>` and its versions separated by tabs, or `-<name>` if removed;
+#  `patches/sequence.txt` contains the current sequence number and the oldest available patch
+if ($PreviousSequence -eq 0) {
+    # no previous patches, restart the sequence numbers past all previous ones; clients download the full index once
+    $Sequence = [uint64][DateTimeOffset]::UtcNow.ToUnixTimeSeconds()
+} else {
+    # package names are case-insensitive, the hashtable from `ConvertFrom-Json` is as well
+    $PreviousNames = @{}
+    $PreviousIndex.Keys | % {$PreviousNames[$_] = $_}
+    $NewNames = [System.Collections.Generic.HashSet[string]]::new([string[]]$VersionMap.Keys, [StringComparer]::OrdinalIgnoreCase)
+
+    $Changes = @(
+        foreach ($Name in $VersionMap.Keys) {
+            $Line = (@("+$Name") + $VersionMap[$Name]) -join "`t"
+            $PreviousLine = if ($PreviousNames.ContainsKey($Name)) {
+                (@("+$($PreviousNames[$Name])") + $PreviousIndex[$Name]) -join "`t"
+            }
+            if ($Line -cne $PreviousLine) {$Line}
+        }
+        foreach ($Name in $PreviousIndex.Keys) {
+            if (-not $NewNames.Contains($Name)) {"-$Name"}
+        }
+    )
+
+    $Sequence = $PreviousSequence
+    if ($Changes) {
+        $Sequence++
+        $Patches[$Sequence] = ($Changes -join "`n") + "`n"
+    }
+}
+
+$OutPatches = mkdir $OutV2\patches
+$FirstPatch = $Sequence + 1
+foreach ($s in $Patches.Keys) {
+    if ($s -gt $Sequence - $MaxPatchCount) {
+        Set-Content "$OutPatches\$s.txt" $Patches[$s] -NoNewline
+        $FirstPatch = [Math]::Min($FirstPatch, $s)
+    }
+}
+Set-Content "$OutPatches\sequence.txt" "$Sequence $FirstPatch" -NoNewline
+
 $TmpPackage = New-PogPackage _remote_repo_zip_export
 try {
     # TODO: run in parallel
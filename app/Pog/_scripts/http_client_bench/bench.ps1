@@ -12,6 +12,27 @@ $ErrorActionPreference = "Stop"
 $ProgressPreference = "Ignore"
 
 $Path = "$env:TEMP\PogHttpBench-$Package-$(New-Guid).zip"
+
+# ranged downloader from `lib_compiled\Pog.Native` (`pog_download_file`), called directly to skip the size threshold
+#  `InvokeFileDownload` uses to pick it
+$NativeDll = Resolve-Path "$PSScriptRoot\..\..\lib_compiled\pog_native.dll"
+Add-Type -TypeDefinition @"
+using System;
+using System.Runtime.InteropServices;
+public static class PogNativeDownload {
+    [DllImport(@"$NativeDll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern int pog_download_file([MarshalAs(UnmanagedType.LPUTF8Str)] string url, string targetPath,
+            [MarshalAs(UnmanagedType.LPUTF8Str)] string userAgent, uint connections, IntPtr progress,
+            IntPtr progressContext, byte[] errorMessage, UIntPtr errorMessageSize);
+
+    public static void Download(string url, string targetPath, uint connections) {
+        var error = new byte[512];
+        var result = pog_download_file(url, targetPath, "Pog", connections, IntPtr.Zero, IntPtr.Zero, error,
+                (UIntPtr) error.Length);
+        if (result != 0) throw new Exception(System.Text.Encoding.UTF8.GetString(error).TrimEnd('\0'));
+    }
+}
+"@
 $Url = (Find-Pog $Package).Manifest.EvaluateInstallUrls().Url
 $Sbs = @{
     "Invoke-RestMethod" = {Invoke-RestMethod -Uri $Url -OutFile $Path}
@@ -19,6 +40,8 @@ $Sbs = @{
     "aria2c" = {aria2c.exe --quiet --dir (Split-Path $Path) --out (Split-Path -Leaf $Path) $Url}
     "aria2c -x 4" = {aria2c.exe --quiet -x 4 --dir (Split-Path $Path) --out (Split-Path -Leaf $Path) $Url}
     "curl" = {curl.exe -s -L $Url --output $Path}
+    "Pog native" = {[PogNativeDownload]::Download($Url, $Path, 1)}
+    "Pog native -x 4" = {[PogNativeDownload]::Download($Url, $Path, 4)}
     "Test-FileDownload" = {
         # custom naive function wrapping HttpClient.GetAsync(...), res.Content.CopyToAsync(fs)
         $client = [System.Net.Http.HttpClient]::new();
@@ -0,0 +1,133 @@
+### Compares the startup time and memory usage of shim template variants, e.g. UPX-packed vs. unpacked
+### (see `POG_SHIM_UPX` in `lib_compiled/Pog.Shim/CMakeLists.txt`).
+###
+### For each template, the script configures shims targeting `cmd.exe` and measures:
+###  - cold start: first launch of a freshly written shim (the image is not mapped yet; for a truly cold start,
+###    the standby list must be flushed, which requires admin rights and is not done here)
+###  - warm start: repeated launches of the same shim
+###  - parallel: `-Parallel` concurrent launches of the same shim, with the wall time of the whole batch and
+###    the private working set of each shim process (sampled while the children are running)
+### The same measurements are done for `cmd.exe` launched directly, to estimate the overhead of the shim itself.
+###
+### Example (in `lib_compiled/Pog.Shim`; both builds output the templates to `lib_compiled`):
+###  cmake -B build-upx -S . -DCMAKE_BUILD_TYPE=Release; cmake --build build-upx
+###  cp ..\PogShimTemplate.exe $env:TEMP\PogShimTemplate-upx.exe
+###  cmake -B build-noupx -S . -DCMAKE_BUILD_TYPE=Release -DPOG_SHIM_UPX=OFF; cmake --build build-noupx
+###  ..\..\_scripts\shim_launch_bench\bench.ps1 @{upx = "$env:TEMP\PogShimTemplate-upx.exe"; unpacked = "..\PogShimTemplate.exe"}
+param(
+    ### Shim templates to compare, `name => path`.
+    [Parameter(Mandatory)]
+    [hashtable]
+    $Templates,
+
+    [int]
+    $Iterations = 50,
+
+    ### Number of concurrent launches in the parallel benchmark.
+    [int]
+    $Parallel = 16,
+
+    ### Path to Pog.dll, used to configure the shims; not needed if Pog is already imported.
+    $PogDllPath = "$PSScriptRoot\..\..\lib_compiled\Pog.dll"
+)
+
+Set-StrictMode -Version 3
+$ErrorActionPreference = "Stop"
+
+$Target = "$env:SystemRoot\System32\cmd.exe"
+$ExitArgs = "/c exit 0"
+# keep the children running for a few seconds, so that the memory usage of the shims can be sampled
+$BlockArgs = "/c ping -n 4 127.0.0.1 >nul"
+
+$PogAsm = [AppDomain]::CurrentDomain.GetAssemblies() | ? {$_.GetName().Name -eq "Pog"} | select -First 1
+if (-not $PogAsm) {
+    $PogAsm = [System.Reflection.Assembly]::LoadFrom((Resolve-Path $PogDllPath))
+}
+# `ShimExecutable` is internal, use reflection
+$ShimType = $PogAsm.GetType("Pog.Shim.ShimExecutable", $true)
+
+function New-Shim($TemplatePath, $ShimPath) {
+    Copy-Item $TemplatePath $ShimPath
+    # the shim only forwards its own arguments, so that the same shim can be used for all benchmarks
+    $Shim = [Activator]::CreateInstance($ShimType, @($Target, $null, $null, $null, $null, $false))
+    $null = $ShimType.GetMethod("WriteNewShim").Invoke($Shim, @($ShimPath))
+}
+
+function Start-Exe($Path, $Arguments) {
+    $Psi = [System.Diagnostics.ProcessStartInfo]::new($Path, $Arguments)
+    $Psi.UseShellExecute = $false
+    return [System.Diagnostics.Process]::Start($Psi)
+}
+
+function Measure-Launch($Path, $Arguments = $ExitArgs) {
+    $Sw = [System.Diagnostics.Stopwatch]::StartNew()
+    $p = Start-Exe $Path $Arguments
+    $p.WaitForExit()
+    $Sw.Stop()
+    $p.Dispose()
+    return $Sw.Elapsed.TotalMilliseconds
+}
+
+function Median([array]$Arr) {
+    $Arr = @($Arr | sort)
+    $Half = [math]::DivRem($Arr.Count, 2)[0]
+    if ($Arr.Count % 2) {
+        $Arr[$Half]
+    } else {
+        ($Arr[$Half - 1] + $Arr[$Half]) / 2
+    }
+}
+
+function Measure-Variant($Name, $TemplatePath, $TmpDir) {
+    if ($TemplatePath) {
+        $ExeName = "shim-bench-$Name"
+        $WarmPath = "$TmpDir\$ExeName.exe"
+        New-Shim $TemplatePath $WarmPath
+        $Cold = 1..$Iterations | % {
+            $ColdPath = "$TmpDir\$ExeName-cold-$_.exe"
+            New-Shim $TemplatePath $ColdPath
+            Measure-Launch $ColdPath
+        }
+    } else {
+        # baseline without a shim
+        $WarmPath = $Target
+        $Cold = $null
+    }
+
+    # warm up the image and the file cache
+    $null = Measure-Launch $WarmPath
+    $Warm = 1..$Iterations | % {Measure-Launch $WarmPath}
+
+    $Sw = [System.Diagnostics.Stopwatch]::StartNew()
+    $Processes = 1..$Parallel | % {Start-Exe $WarmPath $BlockArgs}
+    sleep 1
+    $Counters = @()
+    if ($TemplatePath) {
+        # private working set is only available through the performance counters; process instances of the same
+        #  executable are named `name`, `name#1`,...
+        $Counters = @(Get-CimInstance Win32_PerfRawData_PerfProc_Process -Filter "Name LIKE '$ExeName%'")
+    }
+    $Processes | % {$_.WaitForExit(); $_.Dispose()}
+    $Sw.Stop()
+
+    [pscustomobject]@{
+        Variant = $Name
+        Size = if ($TemplatePath) {(Get-Item $TemplatePath).Length} else {$null}
+        ColdMs = if ($Cold) {[math]::Round((Median $Cold), 2)} else {$null}
+        WarmMs = [math]::Round((Median $Warm), 2)
+        ParallelMs = [math]::Round($Sw.Elapsed.TotalMilliseconds, 1)
+        PrivateWsKB = if ($Counters) {[math]::Round(($Counters.WorkingSetPrivate | measure -Average).Average / 1KB, 1)} else {$null}
+        WsKB = if ($Counters) {[math]::Round(($Counters.WorkingSet | measure -Average).Average / 1KB, 1)} else {$null}
+        SampledProcesses = $Counters.Count
+    }
+}
+
+$TmpDir = mkdir "$env:TEMP\PogShimBench-$(New-Guid)"
+try {
+    Measure-Variant "(no shim)" $null $TmpDir
+    $Templates.GetEnumerator() | sort Key | % {
+        Measure-Variant $_.Key (Resolve-Path $_.Value) $TmpDir
+    }
+} finally {
+    rm -Recurse -Force $TmpDir
+}
@@ -0,0 +1,529 @@
+// Microbenchmarks of the native shim update, which runs for every exported command when a package is enabled,
+//  of SHA-256 hashing, which runs for every downloaded file, both standalone and while downloading, of archive
+//  extraction, which runs for every installed package, of large downloads split between several connections,
+//  of the content-defined chunking of deduplicated download cache entries, of the download cache index with
+//  a large number of entries, of the binary remote repository index and its delta patches, of the compiled manifest
+//  cache, and of sorting package versions by their binary sort keys.
+//
+// Run `PogNativeBench --csv` to get machine-readable output.
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "DownloadSink.hpp"
+#include "FileHash.hpp"
+#include "Sha256.hpp"
+#include "ShimUpdate.hpp"
+#include "archive/Archive.hpp"
+#include "archive/Inflate.hpp"
+#include "cache/CacheIndex.hpp"
+#include "dedup/ChunkStore.hpp"
+#include "download/RangedDownload.hpp"
+#include "manifest/ManifestCache.hpp"
+#include "pe/PeWriter.hpp"
+#include "repository/DeltaUpdate.hpp"
+#include "repository/RepositoryIndex.hpp"
+#include "version/VersionKey.hpp"
+#include "ArchiveTestData.hpp"
+#include "PeTestImage.hpp"
+#include "VersionReference.hpp"
+#ifndef _WIN32
+#include "TestHttpServer.hpp"
+#endif
+#include "bench.hpp"
+
+using namespace pe;
+
+int main(int argc, char** argv) {
+    bench::Runner runner{bench::Options::parse(argc, argv)};
+
+    auto target = test_pe::build_with_resources(test_pe::sample_resources(), {.subsystem = test_pe::SUBSYSTEM_GUI});
+    auto target_resources = read_resources(PeImage{target});
+    std::vector<uint8_t> shim_data(600, 0);
+    shim_data[0] = CURRENT_SHIM_DATA_VERSION;
+    ShimUpdate update{.shim_data = shim_data, .features = 3, .metadata_source = &target_resources,
+                      .subsystem = test_pe::SUBSYSTEM_GUI, .new_shim = true};
+    auto shim = update_shim_image(PeImage{test_pe::build({})}, update)->image;
+    update.new_shim = false;
+
+    runner.run("read_resources/target", [&] {
+        bench::do_not_optimize(read_resources(PeImage{target}).entries().size());
+    });
+
+    // the common case when re-enabling a package, nothing changed
+    runner.run("shim_update/unchanged", [&] {
+        auto target_table = read_resources(PeImage{target});
+        ShimUpdate u = update;
+        u.metadata_source = &target_table;
+        bench::do_not_optimize(update_shim_image(PeImage{shim}, u).has_value());
+    });
+
+    auto changed_data = shim_data;
+    changed_data[100] = 1;
+    runner.run("shim_update/changed_shim_data", [&] {
+        auto target_table = read_resources(PeImage{target});
+        ShimUpdate u = update;
+        u.metadata_source = &target_table;
+        u.shim_data = changed_data;
+        bench::do_not_optimize(update_shim_image(PeImage{shim}, u)->image.size());
+    });
+
+    // checking a package with many exported commands, each with different shim data; the manifest check only needs
+    //  a stat of the target (not measured here), while the full comparison reads the resources of both binaries
+    constexpr size_t SHIM_COUNT = 1000;
+    SourceStamp stamp{shim_path_hash("C:\\Pog\\App\\app\\target.exe"), target.size(), 133'000'000'000'000'000};
+    std::vector<std::vector<uint8_t>> shim_datas, shims;
+    for (size_t i = 0; i < SHIM_COUNT; i++) {
+        auto data = shim_data;
+        data[100] = (uint8_t) i;
+        data[101] = (uint8_t) (i >> 8);
+        ShimUpdate u = update;
+        u.shim_data = data;
+        u.metadata_source_stamp = stamp;
+        u.new_shim = true;
+        shims.push_back(update_shim_image(PeImage{test_pe::build({})}, u)->image);
+        shim_datas.push_back(std::move(data));
+    }
+    std::string suffix = "/";
+    suffix += std::to_string(SHIM_COUNT);
+
+    size_t i = 0;
+    runner.run("shim_check/manifest" + suffix, [&] {
+        auto n = i++ % SHIM_COUNT;
+        ShimUpdate u = update;
+        u.metadata_source = nullptr;
+        u.metadata_source_stamp = stamp;
+        u.shim_data = shim_datas[n];
+        bench::do_not_optimize(is_shim_up_to_date(PeImage{shims[n]}, u));
+    });
+
+    runner.run("shim_check/full_compare" + suffix, [&] {
+        auto n = i++ % SHIM_COUNT;
+        auto target_table = read_resources(PeImage{target});
+        ShimUpdate u = update;
+        u.metadata_source = &target_table;
+        u.metadata_source_stamp = stamp;
+        u.shim_data = shim_datas[n];
+        bench::do_not_optimize(update_shim_image(PeImage{shims[n]}, u).has_value());
+    });
+
+    // hashing throughput; for comparison, `7z h -scrcSHA256` runs at roughly the speed of the scalar implementation
+    //  and adds the process startup and output parsing on top
+    std::vector<uint8_t> buffer(1 << 20);
+    for (size_t j = 0; j < buffer.size(); j++) buffer[j] = (uint8_t) (j * 31 + (j >> 8));
+    for (auto implementation : {Sha256::Implementation::SCALAR, Sha256::Implementation::SHA_NI}) {
+        if (!Sha256::is_supported(implementation)) continue;
+        auto name = std::string("sha256/") + (implementation == Sha256::Implementation::SCALAR ? "scalar" : "sha_ni");
+        runner.run_throughput(name + "/1M", [&] {
+            Sha256 sha{implementation};
+            sha.update(buffer);
+            bench::do_not_optimize(sha.finish());
+        }, buffer.size());
+    }
+
+    // a file in the page cache, the common case right after a download
+    auto file_path = std::filesystem::temp_directory_path() / "pog-native-bench.bin";
+    std::vector<uint8_t> file_data(64 << 20);
+    for (size_t j = 0; j < file_data.size(); j++) file_data[j] = buffer[j % buffer.size()];
+    write_file(file_path.c_str(), file_data);
+    runner.run_throughput("sha256_file/64M", [&] {
+        bench::do_not_optimize(sha256_file(file_path.c_str()));
+    }, file_data.size());
+
+    // end-to-end download of the file into a new file with a hash, with the file-backed source standing in for
+    //  the network; read in 80 KiB pieces, the buffer size of `Stream.CopyTo` in `InvokeFileDownload`
+    auto target_path = std::filesystem::temp_directory_path() / "pog-native-bench-target.bin";
+    auto download = [&](auto&& write_piece) {
+        InputFile source{file_path.c_str()};
+        std::vector<uint8_t> piece(80 << 10);
+        while (auto n = source.read(piece)) write_piece(std::span<const uint8_t>{piece.data(), n});
+    };
+    // store first, then hash the stored file in a second pass
+    runner.run_throughput("download/then_hash/64M", [&] {
+        {
+            OutputFile target{target_path.c_str()};
+            download([&](auto piece) { target.write(piece); });
+        }
+        bench::do_not_optimize(sha256_file(target_path.c_str()));
+    }, file_data.size());
+    // write and hash each piece on the downloading thread (`CryptoStream` in `InvokeFileDownload`)
+    runner.run_throughput("download/inline_hash/64M", [&] {
+        OutputFile target{target_path.c_str()};
+        Sha256 sha;
+        download([&](auto piece) {
+            target.write(piece);
+            sha.update(piece);
+        });
+        bench::do_not_optimize(sha.finish());
+    }, file_data.size());
+    runner.run_throughput("download/sink/64M", [&] {
+        DownloadSink sink{target_path.c_str()};
+        download([&](auto piece) { sink.write(piece); });
+        bench::do_not_optimize(sink.finish());
+    }, file_data.size());
+
+    std::filesystem::remove(file_path);
+    std::filesystem::remove(target_path);
+
+    // inflate throughput (measured on the decompressed size), compared with zlib
+    auto text = test_archive::pseudo_random_text(4 << 20);
+    auto deflated = test_archive::deflate_raw(text);
+    runner.run_throughput("inflate/4M", [&] {
+        auto input = std::span<const uint8_t>{deflated};
+        archive::BitReader reader{[&] { return std::exchange(input, {}); }};
+        archive::Inflater inflater;
+        bench::do_not_optimize(inflater.inflate(reader, [](auto piece) { bench::do_not_optimize(piece.data()); }));
+    }, text.size());
+#ifdef POG_TEST_HAS_ZLIB
+    runner.run_throughput("inflate/zlib/4M", [&] {
+        std::vector<uint8_t> out(256 << 10);
+        z_stream stream{};
+        inflateInit2(&stream, -15);
+        stream.next_in = deflated.data();
+        stream.avail_in = (uInt) deflated.size();
+        do {
+            stream.next_out = out.data();
+            stream.avail_out = (uInt) out.size();
+        } while (inflate(&stream, Z_NO_FLUSH) == Z_OK);
+        bench::do_not_optimize(stream.total_out);
+        inflateEnd(&stream);
+    }, text.size());
+#endif
+
+    // extraction of a package-like archive with many small files and a few large ones; `7z x` needs a process
+    //  start and extracts zip entries on a single thread
+    constexpr size_t ARCHIVE_FILE_COUNT = 5000;
+    std::vector<test_archive::ZipEntrySpec> entries;
+    std::vector<uint8_t> tar;
+    size_t archive_size = 0;
+    for (size_t j = 0; j < ARCHIVE_FILE_COUNT; j++) {
+        auto size = j % 1000 == 0 ? (size_t) 2 << 20 : 2000 + j % 7 * 1000;
+        std::string name = "app/dir";
+        name += std::to_string(j % 50);
+        name += "/file";
+        name += std::to_string(j);
+        name += ".txt";
+        auto data = test_archive::pseudo_random_text(size);
+        test_archive::add_tar_entry(tar, name, '0', data);
+        entries.push_back({name, std::move(data)});
+        archive_size += size;
+    }
+    tar.resize(tar.size() + 1024);
+    auto archive_dir = std::filesystem::temp_directory_path() / "pog-native-bench-archive";
+    auto archive_out = archive_dir / "out";
+    std::filesystem::create_directories(archive_dir);
+    write_file((archive_dir / "archive.zip").c_str(), test_archive::build_zip(entries));
+    write_file((archive_dir / "archive.tar.gz").c_str(), test_archive::gzip(tar));
+
+    auto extract = [&](const char* archive_name, unsigned threads) {
+        archive::extract_archive((archive_dir / archive_name).c_str(), archive_out.c_str(), {.threads = threads});
+    };
+    suffix = "/";
+    suffix += std::to_string(ARCHIVE_FILE_COUNT);
+    runner.run_throughput("extract/zip/1_thread" + suffix, [&] { extract("archive.zip", 1); }, archive_size);
+    runner.run_throughput("extract/zip/all_threads" + suffix, [&] { extract("archive.zip", 0); }, archive_size);
+    runner.run_throughput("extract/tar_gz" + suffix, [&] { extract("archive.tar.gz", 0); }, archive_size);
+
+    // chunking throughput, on incompressible data like most downloaded archives
+    std::vector<uint8_t> random_data(64 << 20);
+    uint64_t seed = 1;
+    for (auto& b : random_data) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        b = (uint8_t) seed;
+    }
+    std::vector<size_t> cuts;
+    for (auto implementation : {dedup::Implementation::SCALAR, dedup::Implementation::AVX2}) {
+        if (!dedup::is_supported(implementation)) continue;
+        auto name = std::string("dedup/chunker/") +
+                    (implementation == dedup::Implementation::SCALAR ? "scalar" : "avx2") + "/64M";
+        runner.run_throughput(name, [&] {
+            cuts.clear();
+            bench::do_not_optimize(dedup::find_chunks(random_data, true, {}, cuts, implementation));
+        }, random_data.size());
+    }
+
+    // successive versions of a package archive, each changing a few files; the contents are incompressible, like
+    //  the already compressed entries of real archives, and stored as is to keep the setup fast; the ratio of the total
+    //  size of the archives to the size of the stored chunks is printed to stderr, to keep the CSV output parseable
+    constexpr size_t VERSION_COUNT = 5;
+    constexpr size_t VERSION_FILE_COUNT = 1000;
+    std::vector<test_archive::ZipEntrySpec> version_entries;
+    for (size_t j = 0; j < VERSION_FILE_COUNT; j++) {
+        auto size = j % 250 == 0 ? (size_t) 1 << 20 : 1000 + j % 31 * 1000;
+        auto offset = (j * 7919) % (random_data.size() - size);
+        version_entries.push_back({"app/file" + std::to_string(j) + ".bin",
+                                   {random_data.begin() + (ptrdiff_t) offset,
+                                    random_data.begin() + (ptrdiff_t) (offset + size)}, 0});
+    }
+    for (size_t v = 0; v < VERSION_COUNT; v++) {
+        for (size_t j = v; j < VERSION_FILE_COUNT; j += 100) {
+            auto& data = version_entries[j].data;
+            std::fill_n(data.begin() + (ptrdiff_t) (data.size() / 2), 100, (uint8_t) v);
+        }
+        write_file((archive_dir / ("v" + std::to_string(v) + ".zip")).c_str(),
+                   test_archive::build_zip(version_entries));
+    }
+    auto store_dir = archive_dir / "chunks";
+    auto store_versions = [&] {
+        std::filesystem::remove_all(store_dir);
+        dedup::ChunkStore store{store_dir.c_str()};
+        dedup::StoreStats total{};
+        for (size_t v = 0; v < VERSION_COUNT; v++) {
+            auto path = archive_dir / ("v" + std::to_string(v) + ".zip");
+            auto list_path = path;
+            list_path += ".pogchunks";
+            auto stats = store.add_file(path.c_str(), list_path.c_str());
+            total.size += stats.size;
+            total.new_chunk_bytes += stats.new_chunk_bytes;
+        }
+        return total;
+    };
+    auto versions_stats = store_versions();
+    fprintf(stderr, "dedup: %zu archive versions, %.1f MiB stored in %.1f MiB of chunks (ratio %.2f)\n",
+            VERSION_COUNT, (double) versions_stats.size / (1 << 20), (double) versions_stats.new_chunk_bytes / (1 << 20),
+            (double) versions_stats.size / (double) versions_stats.new_chunk_bytes);
+    runner.run_throughput("dedup/store/" + std::to_string(VERSION_COUNT) + "_versions", [&] {
+        bench::do_not_optimize(store_versions().new_chunk_bytes);
+    }, versions_stats.size);
+
+    std::filesystem::remove_all(archive_dir);
+
+#ifndef _WIN32
+    // a large download from a server limiting the bandwidth of each connection (like most CDNs do for a single
+    //  client), over a single connection and split between several
+    auto download_content = test_archive::pseudo_random_text(16 << 20);
+    test_http::TestHttpServer server{{download_content.begin(), download_content.end()}, {.rate_limit = 64 << 20}};
+    auto download_target = std::filesystem::temp_directory_path() / "pog-native-bench-download.bin";
+    auto connect = download::default_connection_factory("Pog-bench");
+    for (unsigned connections : {1u, 4u}) {
+        runner.run_throughput("download/ranged/" + std::to_string(connections) + "_conn/16M", [&] {
+            download::download_file(server.url(), download_target.c_str(), connect,
+                                    {.connections = connections, .min_segment_size = 1 << 20});
+        }, download_content.size());
+    }
+    std::filesystem::remove(download_target);
+#endif
+
+    // a download cache with 100k entries, accessed through the index, and (with fewer entries, it's much slower) by
+    //  listing the entry directories and reading their metadata files, which is what `SharedFileCache` does for
+    //  the entries that are not indexed
+    constexpr unsigned CACHE_ENTRIES = 100'000;
+    constexpr unsigned CACHE_DIR_ENTRIES = 2'000;
+    auto cache_dir = std::filesystem::temp_directory_path() / "pog-native-bench-cache";
+    std::filesystem::remove_all(cache_dir);
+    std::filesystem::create_directories(cache_dir);
+    std::string package_json = R"({"PackageName":"7zip","ManifestName":"7zip","ManifestVersion":"24.08"})";
+    std::vector<std::string> cache_keys;
+    for (unsigned k = 0; k < CACHE_ENTRIES; k++) {
+        auto digest = Sha256::hash({(const uint8_t*) &k, sizeof(k)});
+        std::string key;
+        for (auto b : digest) {
+            key += "0123456789ABCDEF"[b >> 4];
+            key += "0123456789ABCDEF"[b & 15];
+        }
+        cache_keys.push_back(std::move(key));
+    }
+    {
+        cache::CacheIndex index{cache_dir.c_str()};
+        for (auto& key : cache_keys) {
+            index.add({.key = key, .file_name = "file.zip", .size = 1 << 20, .packages = {package_json}});
+        }
+
+        size_t k = 0;
+        runner.run("cache_index/acquire_release/100k", [&] {
+            auto& key = cache_keys[k++ % CACHE_ENTRIES];
+            bench::do_not_optimize(index.acquire(key, package_json));
+            index.release(key);
+        });
+        runner.run("cache_index/miss/100k", [&] {
+            bench::do_not_optimize(index.acquire("0000000000000000000000000000000000000000000000000000000000000000",
+                                                 package_json));
+        });
+        runner.run_batch("cache_index/enumerate/100k", [&] {
+            size_t total = 0;
+            index.for_each([&](const cache::CacheEntry& entry) { total += entry.size; });
+            bench::do_not_optimize(total);
+        }, CACHE_ENTRIES);
+    }
+
+    for (unsigned k = 0; k < CACHE_DIR_ENTRIES; k++) {
+        auto entry_dir = cache_dir / cache_keys[k];
+        std::filesystem::create_directories(entry_dir);
+        write_file((entry_dir / "referencingPackages.json-list").c_str(),
+                   {(const uint8_t*) package_json.data(), package_json.size()});
+        write_file((entry_dir / "file.zip").c_str(), {});
+    }
+    auto read_entry_dir = [&](const std::filesystem::path& entry_dir) {
+        size_t total = 0;
+        for (auto& file : std::filesystem::directory_iterator(entry_dir)) {
+            if (file.path().filename() == "referencingPackages.json-list") {
+                total += MappedFile{file.path().c_str()}.data().size();
+            } else {
+                total += file.file_size();
+            }
+        }
+        return total;
+    };
+    size_t k = 0;
+    runner.run("cache_dirs/lookup/2k", [&] {
+        bench::do_not_optimize(read_entry_dir(cache_dir / cache_keys[k++ % CACHE_DIR_ENTRIES]));
+    });
+    runner.run_batch("cache_dirs/enumerate/2k", [&] {
+        size_t total = 0;
+        for (auto& entry : std::filesystem::directory_iterator(cache_dir)) {
+            if (entry.is_directory()) total += read_entry_dir(entry.path());
+        }
+        bench::do_not_optimize(total);
+    }, CACHE_DIR_ENTRIES);
+    std::filesystem::remove_all(cache_dir);
+
+    // a remote repository with 50k packages (about 10x the size of the main repository); opening the index maps and
+    //  validates the file, while the old `RemotePackageDictionary` parsed the JSON index into a dictionary on every
+    //  refresh, approximated here by building a hash map from the same list without the JSON parsing
+    constexpr unsigned REPO_PACKAGES = 50'000;
+    repository::IndexData repo_data{.etag = "\"5f3e1a\""};
+    for (unsigned i = 0; i < REPO_PACKAGES; i++) {
+        auto& p = repo_data.packages.emplace_back(repository::PackageEntry{"package-" + std::to_string(i)});
+        for (unsigned v = 1 + i % 8; v > 0; v--) p.versions.push_back(std::to_string(v) + "." + std::to_string(i % 100));
+    }
+    auto repo_dir = std::filesystem::temp_directory_path() / "pog-native-bench-repository";
+    std::filesystem::remove_all(repo_dir);
+    std::filesystem::create_directories(repo_dir);
+    auto repo_path = repository::write_index(repo_dir.c_str(), repo_data);
+    auto repo_size = std::filesystem::file_size(repo_path);
+
+    runner.run_throughput("repo_index/build/50k", [&] {
+        bench::do_not_optimize(repository::build_index(repo_data).size());
+    }, repo_size);
+    runner.run_throughput("repo_index/open/50k", [&] {
+        bench::do_not_optimize(repository::RepositoryIndex{repo_path.c_str()}.package_count());
+    }, repo_size);
+    runner.run_throughput("repo_dict/build/50k", [&] {
+        std::unordered_map<std::string, std::vector<std::string>> packages;
+        for (auto& p : repo_data.packages) packages.emplace(p.name, p.versions);
+        bench::do_not_optimize(packages.size());
+    }, repo_size);
+
+    {
+        repository::RepositoryIndex index{repo_path.c_str()};
+        std::vector<std::string> names;
+        for (auto& p : repo_data.packages) names.push_back(p.name);
+        // lookups in a random order, so that the table is not walked sequentially
+        for (size_t i = names.size() - 1; i > 0; i--) std::swap(names[i], names[(i * 7919) % (i + 1)]);
+        size_t k = 0;
+        runner.run("repo_index/find/50k", [&] {
+            bench::do_not_optimize(index.find(names[k++ % REPO_PACKAGES]));
+        });
+        runner.run("repo_index/find_versions/50k", [&] {
+            auto package = *index.find(names[k++ % REPO_PACKAGES]);
+            size_t total = 0;
+            for (uint32_t v = 0; v < index.version_count(package); v++) total += index.version(package, v).size();
+            bench::do_not_optimize(total);
+        });
+        runner.run("repo_index/miss/50k", [&] {
+            bench::do_not_optimize(index.find("no-such-package"));
+        });
+    }
+
+    {
+        // a typical week of delta updates: 32 patches, each updating 20 packages, replayed on each open
+        repository::RepositoryIndex index{repo_path.c_str()};
+        for (uint64_t s = 1; s <= repository::MAX_PATCH_COUNT; s++) {
+            repository::IndexPatch patch{repo_data.sequence + s};
+            for (uint64_t i = 0; i < 20; i++) {
+                auto& p = repo_data.packages[(s * 7919 + i * 104729) % REPO_PACKAGES];
+                patch.packages.push_back({p.name, {{std::to_string(s) + ".0.0", "1.0.0"}}});
+            }
+            index.append_patch(patch);
+        }
+        runner.run_throughput("repo_index/open_patched/50k", [&] {
+            bench::do_not_optimize(repository::RepositoryIndex{repo_path.c_str()}.package_count());
+        }, repo_size);
+    }
+    std::filesystem::remove_all(repo_dir);
+
+    // 5k compiled manifests of about 1.5 kB (all versions of a few hundred templated packages); a hit replaces
+    //  the template substitution and its two PowerShell parses, which take milliseconds per manifest
+    constexpr unsigned CACHED_MANIFESTS = 5'000;
+    std::vector<manifest::CacheEntry> manifests;
+    for (unsigned i = 0; i < CACHED_MANIFESTS; i++) {
+        auto key_str = "template|" + std::to_string(i);
+        auto text = "@{\n    Name = 'package-" + std::to_string(i / 20) + "'\n";
+        text += "    Version = '" + std::to_string(i) + "'\n";
+        text.resize(1500, ' ');
+        manifests.push_back({Sha256::hash({(const uint8_t*) key_str.data(), key_str.size()}), text + "}\n"});
+    }
+    auto manifest_dir = std::filesystem::temp_directory_path() / "pog-native-bench-manifest-cache";
+    std::filesystem::remove_all(manifest_dir);
+    std::filesystem::create_directories(manifest_dir);
+    auto manifest_path = manifest::write_cache(manifest_dir.c_str(), manifests);
+    auto manifest_cache_size = std::filesystem::file_size(manifest_path);
+
+    runner.run_throughput("manifest_cache/open/5k", [&] {
+        bench::do_not_optimize(manifest::ManifestCache{manifest_path.c_str()}.entry_count());
+    }, manifest_cache_size);
+    {
+        manifest::ManifestCache cache{manifest_path.c_str()};
+        size_t k = 0;
+        runner.run("manifest_cache/find/5k", [&] {
+            bench::do_not_optimize(cache.find(manifests[(k++ * 7919) % CACHED_MANIFESTS].key)->size());
+        });
+        runner.run("manifest_cache/miss/5k", [&] {
+            bench::do_not_optimize(cache.find(manifest::CacheKey{}).has_value());
+        });
+    }
+    std::filesystem::remove_all(manifest_dir);
+
+    // 1M versions in the common formats (`Find-Pog` and `Get-PogRepository` sort the versions of every package in
+    //  the repository); the baseline parses each version into tokens and compares them, like `PackageVersion`
+    constexpr size_t SORTED_VERSIONS = 1'000'000;
+    std::vector<std::string> versions;
+    versions.reserve(SORTED_VERSIONS);
+    for (size_t i = 0; i < SORTED_VERSIONS; i++) {
+        auto n = i * 2654435761u % 1'000'003;
+        auto main = std::to_string(n % 30) + "." + std::to_string(n / 30 % 20) + "." + std::to_string(n / 600 % 50);
+        switch (n % 8) {
+            case 0: versions.push_back(main + "-rc" + std::to_string(n % 5)); break;
+            case 1: versions.push_back(main + "b" + std::to_string(n % 9)); break;
+            case 2: versions.push_back("20" + std::to_string(10 + n % 15) + "." + std::to_string(n % 4)); break;
+            case 3: versions.push_back(main + "+" + std::to_string(n)); break;
+            default: versions.push_back(main); break;
+        }
+    }
+
+    size_t arena_size = 0;
+    for (auto& v : versions) arena_size += version::max_key_size(v.size());
+    std::vector<uint8_t> key_arena(arena_size);
+    std::vector<std::span<const uint8_t>> keys(SORTED_VERSIONS);
+    auto encode_all = [&] {
+        size_t offset = 0;
+        for (size_t i = 0; i < SORTED_VERSIONS; i++) {
+            auto key = std::span{key_arena}.subspan(offset, version::max_key_size(versions[i].size()));
+            auto size = version::encode_key(versions[i], key)->size;
+            keys[i] = key.first(size);
+            offset += size;
+        }
+    };
+    runner.run_batch("version/encode_key/1M", [&] {
+        encode_all();
+        bench::do_not_optimize(keys.back().size());
+    }, SORTED_VERSIONS);
+    runner.run_batch("version/sort_keys/1M", [&] {
+        encode_all();
+        std::sort(keys.begin(), keys.end(), [](auto a, auto b) { return version::compare_keys(a, b) < 0; });
+        bench::do_not_optimize(keys.front().data());
+    }, SORTED_VERSIONS);
+    runner.run_batch("version/sort_parsed/1M", [&] {
+        std::vector<test_version::ReferenceVersion> parsed;
+        parsed.reserve(SORTED_VERSIONS);
+        for (auto& v : versions) parsed.emplace_back(v);
+        std::sort(parsed.begin(), parsed.end(), [](auto& a, auto& b) { return a.compare(b) < 0; });
+        bench::do_not_optimize(parsed.front().main.size());
+    }, SORTED_VERSIONS);
+
+    return 0;
+}
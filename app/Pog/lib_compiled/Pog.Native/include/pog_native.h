@@ -0,0 +1,352 @@
+#pragma once
+
+// C ABI of the Pog native library (`pog_native.dll`), called from Pog.dll through P/Invoke.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define POG_API __declspec(dllexport)
+typedef wchar_t pog_path_char;
+#else
+#define POG_API __attribute__((visibility("default")))
+typedef char pog_path_char;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Return codes; non-negative values indicate success.
+enum {
+    POG_OK = 0,
+    POG_SHIM_UNCHANGED = 0,
+    POG_SHIM_UPDATED = 1,
+    /// A file could not be read or written.
+    POG_E_IO = -1,
+    /// The shim, or the module resources are copied from, is not a valid PE image, or has an unsupported layout.
+    POG_E_INVALID_PE = -2,
+    /// The shim must be replaced with a fresh copy of the shim template (`ShimExecutable.OutdatedShimException`).
+    POG_E_OUTDATED_SHIM = -3,
+    /// The shim is currently running and cannot be overwritten.
+    POG_E_SHIM_IN_USE = -4,
+    POG_E_INTERNAL = -5,
+    /// The progress callback requested cancellation.
+    POG_E_CANCELLED = -6,
+    /// The archive format (or a feature used by the archive) is not supported, extract it with 7zip instead.
+    POG_E_UNSUPPORTED_ARCHIVE = -7,
+    /// The archive is corrupted, or contains an entry that would be extracted outside the target directory.
+    POG_E_INVALID_ARCHIVE = -8,
+    /// The server returned an error, or the connection failed repeatedly.
+    POG_E_HTTP = -9,
+    /// The string is not a valid package version.
+    POG_E_INVALID_VERSION = -10,
+};
+
+/// Called periodically by long-running operations with the number of bytes processed so far and the total
+/// (0 if unknown); `context` is passed through unchanged. Return non-zero to cancel the operation.
+typedef int32_t (*pog_progress_callback)(void* context, uint64_t processed, uint64_t total);
+
+/// `flags` of `pog_update_shim`
+enum {
+    /// The shim is a fresh copy of a shim template, write the template features instead of checking them.
+    POG_SHIM_NEW = 1,
+    /// Copy the subsystem from `metadata_source_path` (the target binary) instead of using `subsystem`. The metadata
+    /// source is only read if the shim manifest does not match it, in which case its subsystem may have changed.
+    POG_SHIM_SUBSYSTEM_FROM_SOURCE = 2,
+};
+
+/// Updates the resources of the shim executable at `shim_path` in a single pass: sets the shim data (RCDATA #1),
+/// copies icons and version info from `metadata_source_path` (or removes them, if it's NULL), sets the subsystem
+/// (unless `subsystem` is negative, see also `POG_SHIM_SUBSYSTEM_FROM_SOURCE`), and checks (or with `POG_SHIM_NEW`, writes) the template features. The shim
+/// is only rewritten if anything changed. If the shim manifest (RCDATA #3) matches the shim data and the size, last
+/// write time and path of `metadata_source_path`, the metadata source is not read at all. A shim where only
+/// the manifest is outdated is updated if possible, and reported as `POG_SHIM_UNCHANGED`.
+///
+/// Returns `POG_SHIM_UNCHANGED`, `POG_SHIM_UPDATED`, or a negative error code; on error, a null-terminated message
+/// is written to `error_message` (truncated to `error_message_size`).
+POG_API int32_t pog_update_shim(const pog_path_char* shim_path, const pog_path_char* metadata_source_path,
+                                const uint8_t* shim_data, size_t shim_data_size, uint16_t features,
+                                int32_t subsystem, uint32_t flags, char* error_message, size_t error_message_size);
+
+/// Computes the SHA-256 hash of the file at `path` into `digest`, reading it in large chunks and hashing with
+/// the SHA CPU extensions if available. `progress` may be NULL.
+///
+/// Returns `POG_OK`, or a negative error code (`POG_E_IO`, `POG_E_CANCELLED`); on error, a null-terminated message
+/// is written to `error_message` (truncated to `error_message_size`).
+POG_API int32_t pog_sha256_file(const pog_path_char* path, uint8_t digest[32], pog_progress_callback progress,
+                                void* progress_context, char* error_message, size_t error_message_size);
+
+/// Computes the SHA-256 hash of `size` bytes at `data` into `digest`.
+POG_API void pog_sha256(const uint8_t* data, size_t size, uint8_t digest[32]);
+
+/// Download destination that writes the data to a file and computes its SHA-256 hash on background threads, so that
+/// the downloading thread only copies the received data. Created by `pog_download_sink_create`, must be freed with
+/// `pog_download_sink_close`.
+typedef struct pog_download_sink pog_download_sink;
+
+/// Creates (or truncates) the file at `path` and returns a sink writing to it in `sink`.
+/// Returns `POG_OK`, or `POG_E_IO` with a message in `error_message`.
+POG_API int32_t pog_download_sink_create(const pog_path_char* path, pog_download_sink** sink,
+                                         char* error_message, size_t error_message_size);
+
+/// Appends `size` bytes at `data` to the file. Errors of the background writes are reported by a later call,
+/// at the latest by `pog_download_sink_finish`. Returns `POG_OK`, or a negative error code.
+POG_API int32_t pog_download_sink_write(pog_download_sink* sink, const uint8_t* data, size_t size,
+                                        char* error_message, size_t error_message_size);
+
+/// Writes all remaining data and stores the SHA-256 hash of the whole file in `digest`. The sink must not be written
+/// to afterwards. Returns `POG_OK`, or a negative error code.
+POG_API int32_t pog_download_sink_finish(pog_download_sink* sink, uint8_t digest[32],
+                                         char* error_message, size_t error_message_size);
+
+/// Closes the file and frees the sink. If `pog_download_sink_finish` did not succeed, the file is incomplete and
+/// should be deleted by the caller.
+POG_API void pog_download_sink_close(pog_download_sink* sink);
+
+/// Extracts the zip, tar or gzip-compressed tar archive at `archive_path` into `target_dir` (created if it does not
+/// exist), overwriting existing files. Zip entries are extracted in parallel. If `filter_count` is non-zero, only
+/// the entries under one of the `filter` paths (UTF-8, relative to the archive root, may contain `*` and `?`) are
+/// extracted. `progress` may be NULL.
+///
+/// Returns `POG_OK`, or a negative error code; for `POG_E_UNSUPPORTED_ARCHIVE`, `target_dir` may already contain some
+/// of the entries and should be cleaned before falling back to 7zip. On error, a null-terminated message is written
+/// to `error_message` (truncated to `error_message_size`).
+POG_API int32_t pog_extract_archive(const pog_path_char* archive_path, const pog_path_char* target_dir,
+                                    const char* const* filter, size_t filter_count, pog_progress_callback progress,
+                                    void* progress_context, char* error_message, size_t error_message_size);
+
+/// Downloads `url` (UTF-8) to `target_path` over up to `connections` parallel connections, if the server supports
+/// range requests and the file is large enough to be split; otherwise, the file is downloaded in a single stream.
+/// Requests go through WinHTTP, with the system proxy settings. The remaining parts of an interrupted download are
+/// stored in `<target_path>.pogdl`, and the next download of the same URL to the same path continues from there, as
+/// long as the file did not change on the server. If `resume_key` (UTF-8) is not NULL, it identifies the download
+/// instead of the URL, for URLs that change between attempts (e.g. signed redirect targets). `progress` may be NULL.
+///
+/// Returns `POG_OK`, or a negative error code (`POG_E_HTTP`, `POG_E_IO`, `POG_E_CANCELLED`); on error, the partial
+/// file is kept for resuming and a null-terminated message is written to `error_message` (truncated to
+/// `error_message_size`).
+POG_API int32_t pog_download_file(const char* url, const char* resume_key, const pog_path_char* target_path,
+                                  const char* user_agent, uint32_t connections, pog_progress_callback progress,
+                                  void* progress_context, char* error_message, size_t error_message_size);
+
+/// Index of the download cache entries, shared by all processes through a memory-mapped file in the cache directory
+/// (see `src/cache/CacheIndex.hpp`). Opened by `pog_cache_index_open`, must be freed with `pog_cache_index_close`.
+/// All functions may be called from multiple threads at once.
+typedef struct pog_cache_index pog_cache_index;
+
+/// Return values of `pog_cache_index_acquire`.
+enum {
+    POG_CACHE_MISS = 0,
+    POG_CACHE_HIT = 1,
+    /// The entry was found, and the package was not recorded for it yet.
+    POG_CACHE_HIT_NEW_PACKAGE = 2,
+};
+
+typedef struct pog_cache_entry {
+    /// Entry key (UTF-8), at most 64 bytes; longer keys are not indexed.
+    const char* key;
+    /// Name of the entry file (UTF-8); empty if it was too long to be indexed.
+    const char* file_name;
+    uint64_t size;
+    /// FILETIME of the last use.
+    uint64_t last_access;
+    /// Number of acquisitions without a matching release, over all processes; only informational.
+    uint32_t readers;
+    /// JSON metadata of the packages that used the entry, oldest first, each terminated by '\n'.
+    const char* packages;
+} pog_cache_entry;
+
+typedef void (*pog_cache_entry_callback)(void* context, const pog_cache_entry* entry);
+
+/// Opens (or creates) the index of the cache at `cache_dir`. Returns `POG_OK`, or `POG_E_IO` with a message.
+POG_API int32_t pog_cache_index_open(const pog_path_char* cache_dir, pog_cache_index** index,
+                                     char* error_message, size_t error_message_size);
+
+POG_API void pog_cache_index_close(pog_cache_index* index);
+
+/// Looks up the entry `key`, increments its reader count, updates its last use time and records `package` (the JSON
+/// metadata of the package using the entry, may be NULL). The entry file name is written to `file_name` (truncated
+/// to `file_name_size`). Returns one of `POG_CACHE_MISS`, `POG_CACHE_HIT`, `POG_CACHE_HIT_NEW_PACKAGE`,
+/// or a negative error code.
+POG_API int32_t pog_cache_index_acquire(pog_cache_index* index, const char* key, const char* package, char* file_name,
+                                        size_t file_name_size, char* error_message, size_t error_message_size);
+
+/// Decrements the reader count of the entry `key`. Returns `POG_OK`, or a negative error code.
+POG_API int32_t pog_cache_index_release(pog_cache_index* index, const char* key,
+                                        char* error_message, size_t error_message_size);
+
+/// Adds an entry (`entry->readers` is ignored, `entry->packages` may be NULL). Returns 1 if it was added, 0 if an entry
+/// with the same key is already indexed or the key is too long, or a negative error code.
+POG_API int32_t pog_cache_index_add(pog_cache_index* index, const pog_cache_entry* entry,
+                                    char* error_message, size_t error_message_size);
+
+/// Removes the entry `key`. Returns 1 if it was removed, 0 if it was not indexed, or a negative error code.
+POG_API int32_t pog_cache_index_remove(pog_cache_index* index, const char* key,
+                                       char* error_message, size_t error_message_size);
+
+/// Calls `callback` with each indexed entry; the entry is only valid during the call. Returns `POG_OK`,
+/// or a negative error code.
+POG_API int32_t pog_cache_index_enumerate(pog_cache_index* index, pog_cache_entry_callback callback, void* context,
+                                          char* error_message, size_t error_message_size);
+
+/// Deduplicated storage of download cache entries (see `src/dedup/ChunkStore.hpp`): a file is split into
+/// content-defined chunks, which are stored once in the chunk store directory, and the file is replaced by a chunk
+/// list file. All functions may be called concurrently, also from multiple processes sharing the store.
+typedef struct pog_chunk_store_stats {
+    /// Size of the stored file.
+    uint64_t size;
+    uint64_t chunk_count;
+    /// Chunks that were not in the store before, and their total size.
+    uint64_t new_chunk_count;
+    uint64_t new_chunk_bytes;
+} pog_chunk_store_stats;
+
+/// Splits the file at `file_path` into chunks, adds the missing ones to the store at `store_dir` (created if it does not
+/// exist), and writes the chunk list to `chunk_list_path`. The file itself is not modified. `stats` and `progress` may
+/// be NULL. Returns `POG_OK`, or a negative error code (`POG_E_IO`, `POG_E_CANCELLED`) with a message.
+POG_API int32_t pog_chunk_store_add(const pog_path_char* store_dir, const pog_path_char* file_path,
+                                    const pog_path_char* chunk_list_path, pog_chunk_store_stats* stats,
+                                    pog_progress_callback progress, void* progress_context,
+                                    char* error_message, size_t error_message_size);
+
+/// Reassembles the file described by the chunk list at `chunk_list_path` into `target_path`. `progress` may be NULL.
+/// Returns `POG_OK`, or a negative error code with a message.
+POG_API int32_t pog_chunk_store_restore(const pog_path_char* store_dir, const pog_path_char* chunk_list_path,
+                                        const pog_path_char* target_path, pog_progress_callback progress,
+                                        void* progress_context, char* error_message, size_t error_message_size);
+
+/// Same as `pog_extract_archive`, but the archive is read directly from its chunks, without reassembling it first.
+POG_API int32_t pog_chunk_store_extract_archive(const pog_path_char* store_dir, const pog_path_char* chunk_list_path,
+                                                const pog_path_char* target_dir, const char* const* filter,
+                                                size_t filter_count, pog_progress_callback progress,
+                                                void* progress_context, char* error_message,
+                                                size_t error_message_size);
+
+/// Deletes the chunks not referenced by any of the `chunk_list_count` chunk lists at `chunk_list_paths` (all chunk
+/// lists of the store), unless they were last used less than `min_age_seconds` ago; recently used chunks may belong
+/// to a file that is being added. The number of freed bytes is stored to `freed_bytes` (may be NULL).
+/// Returns `POG_OK`, or a negative error code with a message.
+POG_API int32_t pog_chunk_store_collect(const pog_path_char* store_dir, const pog_path_char* const* chunk_list_paths,
+                                        size_t chunk_list_count, uint32_t min_age_seconds, uint64_t* freed_bytes,
+                                        char* error_message, size_t error_message_size);
+
+/// Local copy of the package index of a remote repository, in a binary format that's memory-mapped instead of parsed
+/// (see `src/repository/RepositoryIndex.hpp`). Each full refresh writes a new generation of the index file into the index
+/// directory, and delta patches are appended to it; the view of an open index never changes, so it may be used from
+/// multiple threads at once without locking.
+/// Opened by `pog_repo_index_open`, must be freed with `pog_repo_index_close`. Returned strings are UTF-8, not
+/// null-terminated, and point into the mapped file, so they're valid until the index is closed.
+typedef struct pog_repo_index pog_repo_index;
+
+typedef struct pog_repo_index_info {
+    uint32_t package_count;
+    uint32_t version_count;
+    /// Sequence number of the remote index (see `src/repository/DeltaUpdate.hpp`), 0 if unknown.
+    uint64_t sequence;
+    /// FILETIME of the last refresh of the index (`pog_repo_index_write` or `pog_repo_index_touch`).
+    uint64_t last_write_time;
+    /// HTTP validators of the remote index, empty if the server did not send them, or if patches were applied.
+    const char* etag;
+    size_t etag_size;
+    const char* last_modified;
+    size_t last_modified_size;
+} pog_repo_index_info;
+
+/// Writes a new generation of the index into `index_dir` (which must exist). `packages` is the content of the remote
+/// index, `packages_size` bytes of lines separated by `\n`, each with a package name and its versions (newest first)
+/// separated by `\t`, in the order of the remote index. `etag` and `last_modified` may be NULL, `sequence` is the one
+/// returned by `pog_repo_index_update`. Returns `POG_OK`, or a negative error code (`POG_E_IO`, `POG_E_INTERNAL`
+/// for duplicate package names) with a message.
+POG_API int32_t pog_repo_index_write(const pog_path_char* index_dir, const char* packages, size_t packages_size,
+                                     const char* etag, const char* last_modified, uint64_t sequence,
+                                     char* error_message, size_t error_message_size);
+
+/// Opens the newest generation of the index in `index_dir`, deleting the older ones. Returns 1 if an index was opened,
+/// 0 if there's none (`*index` is set to NULL), or a negative error code with a message.
+POG_API int32_t pog_repo_index_open(const pog_path_char* index_dir, pog_repo_index** index,
+                                    char* error_message, size_t error_message_size);
+
+POG_API void pog_repo_index_close(pog_repo_index* index);
+
+POG_API void pog_repo_index_get_info(const pog_repo_index* index, pog_repo_index_info* info);
+
+/// Marks the index as up to date with the remote index, by updating its last write time. Returns `POG_OK`,
+/// or a negative error code with a message.
+POG_API int32_t pog_repo_index_touch(pog_repo_index* index, char* error_message, size_t error_message_size);
+
+/// Return values of `pog_repo_index_update`.
+enum {
+    /// The repository does not publish patches, or the index is missing or too old; the full index must be downloaded
+    /// and written with `pog_repo_index_write`.
+    POG_REPO_FULL_DOWNLOAD = 0,
+    /// The index is up to date, its last write time was updated.
+    POG_REPO_UP_TO_DATE = 1,
+    /// Patches were appended to the index; it must be reopened to see them.
+    POG_REPO_PATCHED = 2,
+};
+
+/// Brings `index` (may be NULL) up to date with the remote repository at `repository_url` by downloading and applying
+/// delta patches, sending `user_agent` with each request. The sequence number of the remote index is stored
+/// to `sequence` (0 if the repository does not publish patches). Returns one of `POG_REPO_FULL_DOWNLOAD`,
+/// `POG_REPO_UP_TO_DATE`, `POG_REPO_PATCHED`, or a negative error code (`POG_E_HTTP`, `POG_E_IO`) with a message.
+POG_API int32_t pog_repo_index_update(pog_repo_index* index, const char* repository_url, const char* user_agent,
+                                      uint64_t* sequence, char* error_message, size_t error_message_size);
+
+/// Returns the index of the package called `name` (ignoring ASCII case), or -1 if there's no such package.
+POG_API int32_t pog_repo_index_find(const pog_repo_index* index, const char* name, size_t name_size);
+
+/// Stores the name of the package at `package` (less than `package_count`) to `name`, and returns its size.
+POG_API size_t pog_repo_index_get_name(const pog_repo_index* index, uint32_t package, const char** name);
+
+POG_API uint32_t pog_repo_index_get_version_count(const pog_repo_index* index, uint32_t package);
+
+/// Stores the version at `version` (less than the version count of the package, newest first) to `str`, and returns
+/// its size.
+POG_API size_t pog_repo_index_get_version(const pog_repo_index* index, uint32_t package, uint32_t version,
+                                          const char** str);
+
+/// Cache of compiled templated package manifests (see `src/manifest/ManifestCache.hpp`), mapping 32-byte keys computed
+/// by the caller from the content hashes of the template and of the data file to the compiled manifest text. Opened
+/// by `pog_manifest_cache_open`, must be freed with `pog_manifest_cache_close`; may be used from multiple threads
+/// at once. Returned manifests are UTF-8, not null-terminated, and valid until the cache is closed.
+typedef struct pog_manifest_cache pog_manifest_cache;
+
+/// Opens the newest generation of the cache in `cache_dir` (which must exist), deleting the older ones, or creates
+/// an empty cache. Returns `POG_OK`, or a negative error code with a message.
+POG_API int32_t pog_manifest_cache_open(const pog_path_char* cache_dir, pog_manifest_cache** cache,
+                                        char* error_message, size_t error_message_size);
+
+POG_API void pog_manifest_cache_close(pog_manifest_cache* cache);
+
+/// Looks up the manifest stored under `key`. Returns 1 and stores the manifest to `manifest` and `manifest_size`
+/// if it's found, otherwise returns 0.
+POG_API int32_t pog_manifest_cache_find(const pog_manifest_cache* cache, const uint8_t key[32], const char** manifest,
+                                        size_t* manifest_size);
+
+/// Stores `manifest_size` bytes of the compiled manifest at `manifest` under `key`, unless there's already an entry
+/// for it. Returns `POG_OK`, or a negative error code with a message.
+POG_API int32_t pog_manifest_cache_add(pog_manifest_cache* cache, const uint8_t key[32], const char* manifest,
+                                       size_t manifest_size, char* error_message, size_t error_message_size);
+
+/// Upper bound of the size of the sort key of a version string with `version_size` bytes.
+#define POG_VERSION_KEY_MAX_SIZE(version_size) (5 * (size_t) (version_size) + 2)
+
+/// Return values of `pog_version_key`.
+enum {
+    /// The version has a text token, which is compared with the current culture by `PackageVersion`; the key must
+    /// not be compared with other keys.
+    POG_VERSION_KEY_INEXACT = 0,
+    /// Keys compare with `memcmp` (the shorter one first if one is a prefix) like `PackageVersion.CompareTo`.
+    POG_VERSION_KEY_EXACT = 1,
+};
+
+/// Encodes the package version `version` (UTF-8) into an order-preserving binary sort key (see
+/// `src/version/VersionKey.hpp`), stored to `key`, which must have at least `POG_VERSION_KEY_MAX_SIZE(version_size)`
+/// bytes; the size of the key is stored to `key_size`. Does not allocate. Returns `POG_VERSION_KEY_EXACT`,
+/// `POG_VERSION_KEY_INEXACT`, or `POG_E_INVALID_VERSION`.
+POG_API int32_t pog_version_key(const char* version, size_t version_size, uint8_t* key, size_t* key_size);
+
+#ifdef __cplusplus
+}
+#endif
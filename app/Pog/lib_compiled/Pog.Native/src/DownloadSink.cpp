@@ -0,0 +1,100 @@
+#include "DownloadSink.hpp"
+#include <algorithm>
+#include <cstring>
+
+DownloadSink::DownloadSink(const path_char* path, size_t chunk_size) : file_{path}, chunk_size_{chunk_size} {
+    for (auto& chunk : chunks_) chunk.data = std::make_unique<uint8_t[]>(chunk_size);
+
+    writer_ = std::thread([this] {
+        run_worker([this](const Chunk& chunk) { file_.write({chunk.data.get(), chunk.size}); });
+    });
+    try {
+        hasher_ = std::thread([this] {
+            run_worker([this](const Chunk& chunk) { sha_.update({chunk.data.get(), chunk.size}); });
+        });
+    } catch (...) {
+        stop_workers();
+        throw;
+    }
+}
+
+DownloadSink::~DownloadSink() {
+    stop_workers();
+}
+
+void DownloadSink::write(std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        auto& chunk = chunks_[filling_ % 2];
+        auto n = std::min(data.size(), chunk_size_ - chunk.size);
+        memcpy(chunk.data.get() + chunk.size, data.data(), n);
+        chunk.size += n;
+        total_size_ += n;
+        data = data.subspan(n);
+        if (chunk.size == chunk_size_) submit();
+    }
+}
+
+Sha256::Digest DownloadSink::finish() {
+    if (chunks_[filling_ % 2].size > 0) submit();
+    stop_workers();
+    if (error_) std::rethrow_exception(error_);
+    return sha_.finish();
+}
+
+void DownloadSink::submit() {
+    {
+        std::lock_guard lock{mutex_};
+        chunks_[filling_ % 2].pending = 2;
+        submitted_++;
+    }
+    cv_.notify_all();
+
+    // wait until both workers are done with the other buffer, so that it can be refilled
+    filling_++;
+    auto& next = chunks_[filling_ % 2];
+    std::unique_lock lock{mutex_};
+    cv_.wait(lock, [&] { return next.pending == 0; });
+    if (error_) std::rethrow_exception(error_);
+    next.size = 0;
+}
+
+void DownloadSink::stop_workers() {
+    {
+        std::lock_guard lock{mutex_};
+        closing_ = true;
+    }
+    cv_.notify_all();
+    if (writer_.joinable()) writer_.join();
+    if (hasher_.joinable()) hasher_.join();
+}
+
+void DownloadSink::run_worker(auto&& process_chunk) {
+    for (uint64_t next = 0;; next++) {
+        Chunk* chunk;
+        bool failed;
+        {
+            std::unique_lock lock{mutex_};
+            cv_.wait(lock, [&] { return next < submitted_ || closing_; });
+            // when closing, the remaining submitted chunks are still processed
+            if (next >= submitted_) return;
+            chunk = &chunks_[next % 2];
+            failed = error_ != nullptr;
+        }
+
+        // the chunk is not modified until `pending` drops to 0, no lock needed
+        if (!failed) {
+            try {
+                process_chunk(*chunk);
+            } catch (...) {
+                std::lock_guard lock{mutex_};
+                if (!error_) error_ = std::current_exception();
+            }
+        }
+
+        {
+            std::lock_guard lock{mutex_};
+            chunk->pending--;
+        }
+        cv_.notify_all();
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include "MappedFile.hpp"
+#include "Sha256.hpp"
+
+/// Destination of a download that writes the received data to a file and computes its SHA-256 hash in a single pass.
+///
+/// The downloading thread only copies the received data into one of two chunk buffers. Each full chunk is written
+/// to the file by a writer thread and hashed by a hasher thread in parallel, while the downloading thread fills
+/// the other buffer. The download is only slowed down if the disk or the hash is slower than the network.
+class DownloadSink {
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+
+private:
+    struct Chunk {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size = 0;
+        /// Number of workers (writer, hasher) that did not process the chunk yet.
+        int pending = 0;
+    };
+
+    OutputFile file_;
+    Sha256 sha_;
+    size_t chunk_size_;
+    Chunk chunks_[2];
+    /// Chunk filled by `write`, the next to be submitted.
+    uint64_t filling_ = 0;
+    uint64_t total_size_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    /// Number of submitted chunks; chunk `i` is stored in `chunks_[i % 2]`.
+    uint64_t submitted_ = 0;
+    bool closing_ = false;
+    std::exception_ptr error_;
+
+    std::thread writer_;
+    std::thread hasher_;
+
+public:
+    /// Creates (or truncates) the file at `path`.
+    explicit DownloadSink(const path_char* path, size_t chunk_size = DEFAULT_CHUNK_SIZE);
+    /// Stops the workers; if `finish` was not called, the file is left incomplete and should be deleted.
+    ~DownloadSink();
+
+    DownloadSink(const DownloadSink&) = delete;
+    DownloadSink& operator=(const DownloadSink&) = delete;
+
+    /// Appends `data` to the file. Throws `IoError` if a previous write failed. Must not be called after `finish`.
+    void write(std::span<const uint8_t> data);
+    /// Writes the remaining data, waits for the workers and returns the hash of all written data.
+    /// The file is fully written when this returns, but stays open until the sink is destroyed.
+    Sha256::Digest finish();
+
+    [[nodiscard]] uint64_t size() const {
+        return total_size_;
+    }
+
+private:
+    void submit();
+    void stop_workers();
+    /// Processes the submitted chunks in order, until the sink is closed.
+    void run_worker(auto&& process_chunk);
+};
@@ -0,0 +1,32 @@
+#include "FileHash.hpp"
+#include <future>
+#include <memory>
+
+Sha256::Digest sha256_file(const path_char* path, const ProgressCallback& progress) {
+    InputFile file{path};
+    Sha256 sha;
+
+    // double buffering: hashing with SHA-NI is about as fast as reading a cached file, so overlapping the two
+    //  nearly halves the time compared to alternating between them
+    auto buffers = std::make_unique<uint8_t[]>(2 * FILE_HASH_CHUNK_SIZE);
+    std::span<uint8_t> current{buffers.get(), FILE_HASH_CHUNK_SIZE};
+    std::span<uint8_t> next{buffers.get() + FILE_HASH_CHUNK_SIZE, FILE_HASH_CHUNK_SIZE};
+
+    uint64_t processed = 0;
+    auto size = file.read(current);
+    while (size > 0) {
+        auto next_read = std::async(std::launch::async, [&file, next] { return file.read(next); });
+        try {
+            sha.update(current.first(size));
+            processed += size;
+            if (progress && !progress(processed, file.size())) throw OperationCancelled();
+        } catch (...) {
+            // the read must finish before the buffers are freed
+            next_read.wait();
+            throw;
+        }
+        size = next_read.get();
+        std::swap(current, next);
+    }
+    return sha.finish();
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "MappedFile.hpp"
+#include "Progress.hpp"
+#include "Sha256.hpp"
+
+/// Size of the chunks `sha256_file` reads; the next chunk is read while the current one is hashed.
+constexpr size_t FILE_HASH_CHUNK_SIZE = 4 << 20;
+
+/// Computes the SHA-256 hash of the file at `path`. `progress` (if set) is called after each chunk.
+/// Throws `IoError` if the file cannot be read, `OperationCancelled` if `progress` returns `false`.
+Sha256::Digest sha256_file(const path_char* path, const ProgressCallback& progress = {});
@@ -0,0 +1,403 @@
+#include "MappedFile.hpp"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <winioctl.h>
+
+MappedFile::MappedFile(const path_char* path) {
+    auto file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) throw IoError("Could not open file.", (int) GetLastError());
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        auto error = GetLastError();
+        CloseHandle(file);
+        throw IoError("Could not read file size.", (int) error);
+    }
+    size_ = (size_t) size.QuadPart;
+    if (size_ == 0) {
+        // empty files cannot be mapped
+        CloseHandle(file);
+        return;
+    }
+
+    auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    auto error = GetLastError();
+    CloseHandle(file);
+    if (!mapping) throw IoError("Could not map file.", (int) error);
+
+    data_ = (const uint8_t*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    error = GetLastError();
+    // the view keeps the mapping alive
+    CloseHandle(mapping);
+    if (!data_) throw IoError("Could not map file.", (int) error);
+}
+
+MappedFile::~MappedFile() {
+    if (data_) UnmapViewOfFile(data_);
+}
+
+InputFile::InputFile(const path_char* path) {
+    handle_ = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                          FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle_ == INVALID_HANDLE_VALUE) throw IoError("Could not open file.", (int) GetLastError());
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle_, &size)) {
+        auto error = GetLastError();
+        CloseHandle(handle_);
+        throw IoError("Could not read file size.", (int) error);
+    }
+    size_ = (uint64_t) size.QuadPart;
+}
+
+InputFile::~InputFile() {
+    CloseHandle(handle_);
+}
+
+size_t InputFile::read(std::span<uint8_t> buffer) {
+    size_t total = 0;
+    // ReadFile is limited to 4 GiB per call
+    while (total < buffer.size()) {
+        auto chunk = (DWORD) std::min<size_t>(buffer.size() - total, 1u << 30);
+        DWORD n;
+        if (!ReadFile(handle_, buffer.data() + total, chunk, &n, nullptr)) {
+            throw IoError("Could not read file.", (int) GetLastError());
+        }
+        if (n == 0) break;
+        total += n;
+    }
+    return total;
+}
+
+OutputFile::OutputFile(const path_char* path) {
+    handle_ = CreateFileW(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                          FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle_ == INVALID_HANDLE_VALUE) {
+        auto error = GetLastError();
+        throw IoError("Could not open file for writing.", (int) error,
+                      error == ERROR_SHARING_VIOLATION || error == ERROR_ACCESS_DENIED);
+    }
+}
+
+OutputFile::~OutputFile() {
+    CloseHandle(handle_);
+}
+
+void OutputFile::write(std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        auto chunk = (DWORD) std::min<size_t>(data.size(), 1u << 30);
+        DWORD written;
+        if (!WriteFile(handle_, data.data(), chunk, &written, nullptr)) {
+            throw IoError("Could not write file.", (int) GetLastError());
+        }
+        data = data.subspan(written);
+    }
+}
+
+void OutputFile::set_last_write_time(uint64_t filetime) {
+    FILETIME ft{(DWORD) filetime, (DWORD) (filetime >> 32)};
+    if (!SetFileTime(handle_, nullptr, nullptr, &ft)) {
+        throw IoError("Could not set the file last write time.", (int) GetLastError());
+    }
+}
+
+RandomAccessFile::RandomAccessFile(const path_char* path) {
+    handle_ = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                          FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle_ == INVALID_HANDLE_VALUE) {
+        auto error = GetLastError();
+        throw IoError("Could not open file for writing.", (int) error,
+                      error == ERROR_SHARING_VIOLATION || error == ERROR_ACCESS_DENIED);
+    }
+}
+
+RandomAccessFile::~RandomAccessFile() {
+    CloseHandle(handle_);
+}
+
+uint64_t RandomAccessFile::size() const {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle_, &size)) throw IoError("Could not read file size.", (int) GetLastError());
+    return (uint64_t) size.QuadPart;
+}
+
+void RandomAccessFile::set_size(uint64_t size) {
+    // not all file systems support sparse files, the file is just slower to write without it
+    DWORD returned;
+    DeviceIoControl(handle_, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr);
+    FILE_END_OF_FILE_INFO info{};
+    info.EndOfFile.QuadPart = (LONGLONG) size;
+    if (!SetFileInformationByHandle(handle_, FileEndOfFileInfo, &info, sizeof(info))) {
+        throw IoError("Could not set file size.", (int) GetLastError());
+    }
+}
+
+void RandomAccessFile::write_at(uint64_t offset, std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        auto chunk = (DWORD) std::min<size_t>(data.size(), 1u << 30);
+        OVERLAPPED overlapped{};
+        overlapped.Offset = (DWORD) offset;
+        overlapped.OffsetHigh = (DWORD) (offset >> 32);
+        DWORD written;
+        if (!WriteFile(handle_, data.data(), chunk, &written, &overlapped)) {
+            throw IoError("Could not write file.", (int) GetLastError());
+        }
+        data = data.subspan(written);
+        offset += written;
+    }
+}
+
+SharedMapping::SharedMapping(const path_char* path) {
+    // other processes may rename and delete the file while it's mapped
+    auto file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) throw IoError("Could not open file.", (int) GetLastError());
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        auto error = GetLastError();
+        CloseHandle(file);
+        throw IoError("Could not read file size.", (int) error);
+    }
+    size_ = (size_t) size.QuadPart;
+    if (size_ == 0) {
+        CloseHandle(file);
+        return;
+    }
+
+    auto mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    auto error = GetLastError();
+    CloseHandle(file);
+    if (!mapping) throw IoError("Could not map file.", (int) error);
+
+    data_ = (uint8_t*) MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+    error = GetLastError();
+    CloseHandle(mapping);
+    if (!data_) throw IoError("Could not map file.", (int) error);
+}
+
+SharedMapping::~SharedMapping() {
+    if (data_) UnmapViewOfFile(data_);
+}
+
+void SharedMapping::flush() {
+    if (data_ && !FlushViewOfFile(data_, 0)) throw IoError("Could not write file.", (int) GetLastError());
+}
+
+void write_file(const path_char* path, std::span<const uint8_t> data) {
+    auto file = CreateFileW(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        auto error = GetLastError();
+        // running executables cannot be opened for writing
+        throw IoError("Could not open file for writing.", (int) error,
+                      error == ERROR_SHARING_VIOLATION || error == ERROR_ACCESS_DENIED);
+    }
+    DWORD written;
+    auto ok = WriteFile(file, data.data(), (DWORD) data.size(), &written, nullptr) && written == data.size();
+    auto error = GetLastError();
+    CloseHandle(file);
+    if (!ok) throw IoError("Could not write file.", (int) error);
+}
+
+FileInfo stat_file(const path_char* path) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &attributes)) {
+        throw IoError("Could not read file attributes.", (int) GetLastError());
+    }
+    return {
+        (uint64_t) attributes.nFileSizeHigh << 32 | attributes.nFileSizeLow,
+        (uint64_t) attributes.ftLastWriteTime.dwHighDateTime << 32 | attributes.ftLastWriteTime.dwLowDateTime,
+    };
+}
+
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const path_char* path) {
+    auto fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw IoError("Could not open file.", errno);
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        auto error = errno;
+        close(fd);
+        throw IoError("Could not read file size.", error);
+    }
+    size_ = (size_t) st.st_size;
+    if (size_ == 0) {
+        close(fd);
+        return;
+    }
+
+    auto ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    auto error = errno;
+    close(fd);
+    if (ptr == MAP_FAILED) throw IoError("Could not map file.", error);
+    data_ = (const uint8_t*) ptr;
+}
+
+MappedFile::~MappedFile() {
+    if (data_) munmap((void*) data_, size_);
+}
+
+InputFile::InputFile(const path_char* path) {
+    fd_ = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) throw IoError("Could not open file.", errno);
+    struct stat st{};
+    if (fstat(fd_, &st) != 0) {
+        auto error = errno;
+        close(fd_);
+        throw IoError("Could not read file size.", error);
+    }
+    size_ = (uint64_t) st.st_size;
+#ifdef POSIX_FADV_SEQUENTIAL
+    // only a hint, errors are ignored
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+InputFile::~InputFile() {
+    close(fd_);
+}
+
+size_t InputFile::read(std::span<uint8_t> buffer) {
+    size_t total = 0;
+    while (total < buffer.size()) {
+        auto n = ::read(fd_, buffer.data() + total, buffer.size() - total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw IoError("Could not read file.", errno);
+        }
+        if (n == 0) break;
+        total += (size_t) n;
+    }
+    return total;
+}
+
+OutputFile::OutputFile(const path_char* path) {
+    fd_ = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) throw IoError("Could not open file for writing.", errno, errno == ETXTBSY);
+}
+
+OutputFile::~OutputFile() {
+    close(fd_);
+}
+
+void OutputFile::write(std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        auto n = ::write(fd_, data.data(), data.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw IoError("Could not write file.", errno);
+        }
+        data = data.subspan((size_t) n);
+    }
+}
+
+void OutputFile::set_last_write_time(uint64_t filetime) {
+    // seconds between 1601-01-01 (FILETIME epoch) and 1970-01-01 (Unix epoch)
+    constexpr int64_t EPOCH_DIFFERENCE = 11644473600;
+    timespec times[2]{};
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = (time_t) ((int64_t) (filetime / 10'000'000) - EPOCH_DIFFERENCE);
+    times[1].tv_nsec = (long) (filetime % 10'000'000 * 100);
+    if (futimens(fd_, times) != 0) throw IoError("Could not set the file last write time.", errno);
+}
+
+RandomAccessFile::RandomAccessFile(const path_char* path) {
+    fd_ = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) throw IoError("Could not open file for writing.", errno, errno == ETXTBSY);
+}
+
+RandomAccessFile::~RandomAccessFile() {
+    close(fd_);
+}
+
+uint64_t RandomAccessFile::size() const {
+    struct stat st{};
+    if (fstat(fd_, &st) != 0) throw IoError("Could not read file size.", errno);
+    return (uint64_t) st.st_size;
+}
+
+void RandomAccessFile::set_size(uint64_t size) {
+    if (ftruncate(fd_, (off_t) size) != 0) throw IoError("Could not set file size.", errno);
+}
+
+void RandomAccessFile::write_at(uint64_t offset, std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        auto n = pwrite(fd_, data.data(), data.size(), (off_t) offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw IoError("Could not write file.", errno);
+        }
+        data = data.subspan((size_t) n);
+        offset += (uint64_t) n;
+    }
+}
+
+SharedMapping::SharedMapping(const path_char* path) {
+    auto fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) throw IoError("Could not open file.", errno);
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        auto error = errno;
+        close(fd);
+        throw IoError("Could not read file size.", error);
+    }
+    size_ = (size_t) st.st_size;
+    if (size_ == 0) {
+        close(fd);
+        return;
+    }
+
+    auto ptr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    auto error = errno;
+    close(fd);
+    if (ptr == MAP_FAILED) throw IoError("Could not map file.", error);
+    data_ = (uint8_t*) ptr;
+}
+
+SharedMapping::~SharedMapping() {
+    if (data_) munmap(data_, size_);
+}
+
+void SharedMapping::flush() {
+    if (data_ && msync(data_, size_, MS_SYNC) != 0) throw IoError("Could not write file.", errno);
+}
+
+void write_file(const path_char* path, std::span<const uint8_t> data) {
+    auto fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) throw IoError("Could not open file for writing.", errno, errno == ETXTBSY);
+
+    size_t written = 0;
+    while (written < data.size()) {
+        auto n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            auto error = errno;
+            close(fd);
+            throw IoError("Could not write file.", error);
+        }
+        written += (size_t) n;
+    }
+    if (close(fd) != 0) throw IoError("Could not write file.", errno);
+}
+
+FileInfo stat_file(const path_char* path) {
+    struct stat st{};
+    if (stat(path, &st) != 0) throw IoError("Could not read file attributes.", errno);
+    // seconds between 1601-01-01 (FILETIME epoch) and 1970-01-01 (Unix epoch)
+    constexpr uint64_t EPOCH_DIFFERENCE = 11644473600;
+    return {
+        (uint64_t) st.st_size,
+        ((uint64_t) st.st_mtim.tv_sec + EPOCH_DIFFERENCE) * 10'000'000 + (uint64_t) st.st_mtim.tv_nsec / 100,
+    };
+}
+#endif
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+// Minimal file I/O used by the native libraries: read-only memory-mapped files, sequential reads and writes,
+//  whole-file writes and file metadata. Paths are native, UTF-16 on Windows and UTF-8 elsewhere.
+#ifdef _WIN32
+using path_char = wchar_t;
+#else
+using path_char = char;
+#endif
+
+/// Thrown when a file operation fails. `error_code` is `GetLastError()` on Windows and `errno` elsewhere.
+class IoError : public std::runtime_error {
+public:
+    const int error_code;
+    /// The file could not be opened, because it's used by another process (typically, a running executable).
+    const bool in_use;
+
+    IoError(const std::string& message, int error_code, bool in_use = false)
+            : std::runtime_error(message), error_code{error_code}, in_use{in_use} {}
+};
+
+/// Read-only memory mapping of a whole file. Empty files are supported, but have no mapping.
+class MappedFile {
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    explicit MappedFile(const path_char* path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    [[nodiscard]] std::span<const uint8_t> data() const {
+        return {data_, size_};
+    }
+};
+
+/// File opened for a single sequential pass, e.g. for hashing. Unlike `MappedFile`, a concurrent truncation
+/// of the file results in a short read instead of a crash, and the OS is told to read ahead aggressively.
+class InputFile {
+private:
+#ifdef _WIN32
+    void* handle_;
+#else
+    int fd_;
+#endif
+    uint64_t size_ = 0;
+
+public:
+    explicit InputFile(const path_char* path);
+    ~InputFile();
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    /// Size of the file when it was opened.
+    [[nodiscard]] uint64_t size() const {
+        return size_;
+    }
+
+    /// Reads up to `buffer.size()` bytes from the current position, returns the number of bytes read, 0 at the end.
+    size_t read(std::span<uint8_t> buffer);
+};
+
+/// File opened for writing, truncated if it exists. Data are written sequentially.
+class OutputFile {
+private:
+#ifdef _WIN32
+    void* handle_;
+#else
+    int fd_;
+#endif
+
+public:
+    explicit OutputFile(const path_char* path);
+    ~OutputFile();
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    void write(std::span<const uint8_t> data);
+    /// Sets the last write time of the file, as a FILETIME (see `FileInfo`).
+    void set_last_write_time(uint64_t filetime);
+};
+
+/// File opened for writing at arbitrary offsets, e.g. by several download connections at once. Unlike `OutputFile`,
+/// an existing file is not truncated, so that a partial download can be resumed.
+class RandomAccessFile {
+private:
+#ifdef _WIN32
+    void* handle_;
+#else
+    int fd_;
+#endif
+
+public:
+    explicit RandomAccessFile(const path_char* path);
+    ~RandomAccessFile();
+
+    RandomAccessFile(const RandomAccessFile&) = delete;
+    RandomAccessFile& operator=(const RandomAccessFile&) = delete;
+
+    [[nodiscard]] uint64_t size() const;
+    /// Sets the size of the file. On Windows, the file is made sparse first, otherwise a write far past the end
+    /// of the written data would wait for NTFS to zero-fill the whole gap.
+    void set_size(uint64_t size);
+    /// Writes `data` at `offset`; may be called from multiple threads concurrently.
+    void write_at(uint64_t offset, std::span<const uint8_t> data);
+};
+
+/// Read-write shared memory mapping of a whole existing file, for data structures shared between processes
+/// (e.g. the download cache index). Changes are visible to all processes mapping the same file; the file must not
+/// be resized while it's mapped.
+class SharedMapping {
+private:
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    explicit SharedMapping(const path_char* path);
+    ~SharedMapping();
+
+    SharedMapping(const SharedMapping&) = delete;
+    SharedMapping& operator=(const SharedMapping&) = delete;
+
+    [[nodiscard]] std::span<uint8_t> data() const {
+        return {data_, size_};
+    }
+
+    /// Writes the changed pages back to the file.
+    void flush();
+};
+
+/// Overwrites the file at `path` with `data`, creating it if it does not exist.
+void write_file(const path_char* path, std::span<const uint8_t> data);
+
+struct FileInfo {
+    uint64_t size;
+    /// FILETIME (100 ns intervals since 1601-01-01 UTC), the same value as `File.GetLastWriteTimeUtc().ToFileTimeUtc()`.
+    uint64_t last_write_time;
+};
+
+FileInfo stat_file(const path_char* path);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+
+/// Called periodically by long-running operations with the number of bytes processed so far and the total (0 if
+/// unknown). Returning `false` cancels the operation, which then throws `OperationCancelled`.
+using ProgressCallback = std::function<bool(uint64_t processed, uint64_t total)>;
+
+class OperationCancelled : public std::runtime_error {
+public:
+    OperationCancelled() : std::runtime_error("The operation was cancelled.") {}
+};
@@ -0,0 +1,200 @@
+#include "Sha256.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define POG_SHA256_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC allows intrinsics of any instruction set without a target attribute
+#define POG_TARGET_SHA
+#else
+#include <cpuid.h>
+#define POG_TARGET_SHA __attribute__((target("sha,sse4.1,ssse3")))
+#endif
+#endif
+
+namespace {
+    alignas(16) constexpr uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    constexpr uint32_t INITIAL_STATE[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    constexpr uint32_t rotr(uint32_t x, int n) {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    uint32_t load_be32(const uint8_t* p) {
+        return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+    }
+
+    void compress_scalar(uint32_t state[8], const uint8_t* blocks, size_t block_count) {
+        for (; block_count > 0; block_count--, blocks += Sha256::BLOCK_SIZE) {
+            uint32_t w[64];
+            for (int t = 0; t < 16; t++) w[t] = load_be32(blocks + 4 * t);
+            for (int t = 16; t < 64; t++) {
+                auto s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+                auto s1 = rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+                w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+            }
+
+            auto a = state[0], b = state[1], c = state[2], d = state[3];
+            auto e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int t = 0; t < 64; t++) {
+                auto t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[t] + w[t];
+                auto t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+            state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        }
+    }
+
+#ifdef POG_SHA256_X86
+    /// SHA-NI keeps the state in two registers as ABEF and CDGH, and does 2 rounds per `sha256rnds2`.
+    POG_TARGET_SHA void compress_sha_ni(uint32_t state[8], const uint8_t* blocks, size_t block_count) {
+        const auto byte_swap = _mm_set_epi64x(0x0c0d0e0f'08090a0b, 0x04050607'00010203);
+
+        auto dcba = _mm_loadu_si128((const __m128i*) &state[0]);
+        auto hgfe = _mm_loadu_si128((const __m128i*) &state[4]);
+        auto cdab = _mm_shuffle_epi32(dcba, 0xb1);
+        auto efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+        auto abef = _mm_alignr_epi8(cdab, efgh, 8);
+        auto cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+
+        for (; block_count > 0; block_count--, blocks += Sha256::BLOCK_SIZE) {
+            auto abef_saved = abef;
+            auto cdgh_saved = cdgh;
+            // message schedule, 4 words per register; only the last 4 registers are needed for the next one
+            __m128i w[4];
+            for (int i = 0; i < 16; i++) {
+                if (i < 4) {
+                    w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (blocks + 16 * i)), byte_swap);
+                } else {
+                    auto& w4 = w[i % 4]; // w[i - 4], replaced by w[i]
+                    auto w3 = w[(i - 3) % 4], w2 = w[(i - 2) % 4], w1 = w[(i - 1) % 4];
+                    w4 = _mm_sha256msg1_epu32(w4, w3);
+                    w4 = _mm_add_epi32(w4, _mm_alignr_epi8(w1, w2, 4));
+                    w4 = _mm_sha256msg2_epu32(w4, w1);
+                }
+                auto msg = _mm_add_epi32(w[i % 4], _mm_load_si128((const __m128i*) &K[4 * i]));
+                cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+                abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(msg, 0x0e));
+            }
+            abef = _mm_add_epi32(abef, abef_saved);
+            cdgh = _mm_add_epi32(cdgh, cdgh_saved);
+        }
+
+        auto feba = _mm_shuffle_epi32(abef, 0x1b);
+        auto dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+        _mm_storeu_si128((__m128i*) &state[0], _mm_blend_epi16(feba, dchg, 0xf0));
+        _mm_storeu_si128((__m128i*) &state[4], _mm_alignr_epi8(dchg, feba, 8));
+    }
+
+    bool cpu_has_sha_ni() {
+#ifdef _MSC_VER
+        int regs[4];
+        __cpuidex(regs, 0, 0);
+        if (regs[0] < 7) return false;
+        __cpuidex(regs, 1, 0);
+        auto ecx1 = (unsigned) regs[2];
+        __cpuidex(regs, 7, 0);
+        auto ebx7 = (unsigned) regs[1];
+#else
+        unsigned eax, ebx, ecx, edx, ecx1, ebx7;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx1, &edx)) return false;
+        if (!__get_cpuid_count(7, 0, &eax, &ebx7, &ecx, &edx)) return false;
+#endif
+        constexpr unsigned SSSE3 = 1u << 9, SSE41 = 1u << 19, SHA = 1u << 29;
+        return (ecx1 & SSSE3) && (ecx1 & SSE41) && (ebx7 & SHA);
+    }
+#endif
+
+    Sha256::Implementation detect_implementation() {
+#ifdef POG_SHA256_X86
+        if (cpu_has_sha_ni()) return Sha256::Implementation::SHA_NI;
+#endif
+        return Sha256::Implementation::SCALAR;
+    }
+}
+
+Sha256::Sha256() : Sha256(best_implementation()) {}
+
+Sha256::Sha256(Implementation implementation) : compress_{compress_scalar} {
+    memcpy(state_, INITIAL_STATE, sizeof(state_));
+#ifdef POG_SHA256_X86
+    if (implementation == Implementation::SHA_NI) compress_ = compress_sha_ni;
+#else
+    (void) implementation;
+#endif
+}
+
+void Sha256::update(std::span<const uint8_t> data) {
+    if (data.empty()) return;
+    length_ += data.size();
+    auto p = data.data();
+    auto size = data.size();
+    if (buffered_ > 0) {
+        auto n = std::min(size, BLOCK_SIZE - buffered_);
+        memcpy(buffer_ + buffered_, p, n);
+        buffered_ += n;
+        p += n;
+        size -= n;
+        if (buffered_ < BLOCK_SIZE) return;
+        compress_(state_, buffer_, 1);
+        buffered_ = 0;
+    }
+    // full blocks are hashed directly from the input, without copying
+    if (size >= BLOCK_SIZE) {
+        compress_(state_, p, size / BLOCK_SIZE);
+        p += size / BLOCK_SIZE * BLOCK_SIZE;
+        size %= BLOCK_SIZE;
+    }
+    if (size > 0) memcpy(buffer_, p, size);
+    buffered_ = size;
+}
+
+Sha256::Digest Sha256::finish() {
+    // padding: 0x80, zeros up to 56 bytes mod 64, then the message length in bits as a big-endian uint64
+    auto bit_length = length_ * 8;
+    uint8_t padding[2 * BLOCK_SIZE]{0x80};
+    auto padding_size = (buffered_ < 56 ? 56 : 120) - buffered_;
+    for (int i = 0; i < 8; i++) padding[padding_size + i] = (uint8_t) (bit_length >> (56 - 8 * i));
+    update({padding, padding_size + 8});
+
+    Digest digest;
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (uint8_t) (state_[i] >> 24);
+        digest[4 * i + 1] = (uint8_t) (state_[i] >> 16);
+        digest[4 * i + 2] = (uint8_t) (state_[i] >> 8);
+        digest[4 * i + 3] = (uint8_t) state_[i];
+    }
+    return digest;
+}
+
+Sha256::Implementation Sha256::best_implementation() {
+    static const auto implementation = detect_implementation();
+    return implementation;
+}
+
+bool Sha256::is_supported(Implementation implementation) {
+    return implementation == Implementation::SCALAR || best_implementation() == implementation;
+}
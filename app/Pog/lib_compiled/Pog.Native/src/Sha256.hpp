@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// SHA-256 (FIPS 180-4), used to verify downloaded files without spawning 7z.exe. The compression function uses
+//  the x86 SHA extensions (SHA-NI) when the CPU supports them, otherwise a portable scalar implementation.
+
+class Sha256 {
+public:
+    using Digest = std::array<uint8_t, 32>;
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    enum class Implementation {
+        SCALAR,
+        SHA_NI,
+    };
+
+private:
+    using CompressFn = void (*)(uint32_t state[8], const uint8_t* blocks, size_t block_count);
+
+    uint32_t state_[8];
+    uint8_t buffer_[BLOCK_SIZE];
+    size_t buffered_ = 0;
+    uint64_t length_ = 0;
+    CompressFn compress_;
+
+public:
+    /// Uses the fastest implementation supported by the CPU.
+    Sha256();
+    /// Uses the given implementation, mostly for tests and benchmarks; check `is_supported` first.
+    explicit Sha256(Implementation implementation);
+
+    void update(std::span<const uint8_t> data);
+    /// Returns the digest of all data passed to `update`. The instance must not be used afterwards.
+    Digest finish();
+
+    static Digest hash(std::span<const uint8_t> data) {
+        Sha256 sha;
+        sha.update(data);
+        return sha.finish();
+    }
+
+    /// The implementation selected by the default constructor.
+    static Implementation best_implementation();
+    static bool is_supported(Implementation implementation);
+};
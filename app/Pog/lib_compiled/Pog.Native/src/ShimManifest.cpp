@@ -0,0 +1,94 @@
+#include "ShimManifest.hpp"
+
+using namespace pe;
+
+namespace {
+    constexpr size_t HEADER_SIZE = 40;
+    constexpr size_t ENTRY_SIZE = 16;
+
+    uint64_t read_u64(bytes data, size_t offset) {
+        return (uint64_t) read_u32(data, offset) | (uint64_t) read_u32(data, offset + 4) << 32;
+    }
+
+    void write_u64(std::span<uint8_t> data, size_t offset, uint64_t n) {
+        write_u32(data, offset, (uint32_t) n);
+        write_u32(data, offset + 4, (uint32_t) (n >> 32));
+    }
+
+    uint64_t hash_u16(uint64_t hash, uint16_t n) {
+        uint8_t buffer[2];
+        write_u16(buffer, 0, n);
+        return content_hash(buffer, hash);
+    }
+}
+
+ResourceTypeHash resource_type_hash(const ResourceTable& table, ResourceType type) {
+    ResourceTypeHash result{.type = (uint16_t) type, .hash = FNV1A_64_OFFSET};
+    const ResourceName* previous_name = nullptr;
+    for (auto& [key, resource] : table.entries()) {
+        if (!(key.type == type)) continue;
+        if (previous_name && *previous_name == key.name) continue; // other language of the same name
+        previous_name = &key.name;
+
+        if (key.name.is_string()) {
+            result.hash = hash_u16(result.hash, (uint16_t) key.name.str.size());
+            for (auto c : key.name.str) result.hash = hash_u16(result.hash, c);
+        } else {
+            result.hash = hash_u16(result.hash, 0xffff);
+            result.hash = hash_u16(result.hash, key.name.id);
+        }
+        uint8_t size[4];
+        write_u32(size, 0, (uint32_t) resource.data.size());
+        result.hash = content_hash(size, result.hash);
+        result.hash = content_hash(resource.data, result.hash);
+
+        result.name_count++;
+        result.data_size += (uint32_t) resource.data.size();
+    }
+    return result;
+}
+
+std::vector<uint8_t> encode_shim_manifest(const ShimManifest& manifest) {
+    std::vector<uint8_t> out(HEADER_SIZE + manifest.resources.size() * ENTRY_SIZE, 0);
+    auto source = manifest.metadata_source.value_or(SourceStamp{});
+    write_u16(out, 0, SHIM_MANIFEST_VERSION);
+    write_u16(out, 2, manifest.metadata_source ? SHIM_MANIFEST_HAS_SOURCE : 0);
+    write_u32(out, 4, (uint32_t) manifest.resources.size());
+    write_u64(out, 8, manifest.shim_data_hash);
+    write_u64(out, 16, source.path_hash);
+    write_u64(out, 24, source.size);
+    write_u64(out, 32, source.last_write_time);
+
+    auto offset = HEADER_SIZE;
+    for (auto& r : manifest.resources) {
+        write_u16(out, offset, r.type);
+        write_u16(out, offset + 2, r.name_count);
+        write_u32(out, offset + 4, r.data_size);
+        write_u64(out, offset + 8, r.hash);
+        offset += ENTRY_SIZE;
+    }
+    return out;
+}
+
+std::optional<ShimManifest> parse_shim_manifest(std::span<const uint8_t> data) {
+    if (data.size() < HEADER_SIZE || read_u16(data, 0) != SHIM_MANIFEST_VERSION) {
+        return std::nullopt;
+    }
+    auto flags = read_u16(data, 2);
+    auto count = read_u32(data, 4);
+    if ((data.size() - HEADER_SIZE) / ENTRY_SIZE != count || (data.size() - HEADER_SIZE) % ENTRY_SIZE != 0) {
+        return std::nullopt;
+    }
+
+    ShimManifest manifest{.shim_data_hash = read_u64(data, 8)};
+    if (flags & SHIM_MANIFEST_HAS_SOURCE) {
+        manifest.metadata_source = SourceStamp{read_u64(data, 16), read_u64(data, 24), read_u64(data, 32)};
+    }
+    manifest.resources.resize(count);
+    auto offset = HEADER_SIZE;
+    for (auto& r : manifest.resources) {
+        r = {read_u16(data, offset), read_u16(data, offset + 2), read_u32(data, offset + 4), read_u64(data, offset + 8)};
+        offset += ENTRY_SIZE;
+    }
+    return manifest;
+}
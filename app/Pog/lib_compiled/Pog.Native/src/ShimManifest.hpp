@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+#include "pe/ResourceTable.hpp"
+
+// Shim manifest, a compact record of what a shim was generated from, stored as RCDATA #3 next to the shim data.
+//  With the manifest, checking that a shim is up to date only needs the manifest, the stored shim data and a `stat`
+//  of the module the resources were copied from, instead of reading and comparing all resources of the shim and
+//  of the metadata source. Only used by `pog_update_shim`; the managed fallback in `ShimExecutable.cs` removes
+//  the manifest when it changes a shim.
+//
+// All values are little-endian:
+//  - uint16 version (`SHIM_MANIFEST_VERSION`)
+//  - uint16 flags (`SHIM_MANIFEST_HAS_SOURCE` if resources were copied from a metadata source)
+//  - uint32 number of resource type entries
+//  - uint64 hash of the shim data (RCDATA #1)
+//  - uint64 hash of the full path of the metadata source (`shim_path_hash`)
+//  - uint64 size of the metadata source
+//  - uint64 last write time of the metadata source (FILETIME, 100 ns intervals since 1601-01-01 UTC)
+//  - resource type entries, one for each copied resource type:
+//    - uint16 resource type
+//    - uint16 number of resource names of the type
+//    - uint32 total size of the resource data
+//    - uint64 hash of the resources (`resource_type_hash`)
+//
+// All hashes are 64-bit FNV-1a. The manifest only detects changes made by Pog, it is not a security measure.
+
+constexpr uint16_t SHIM_MANIFEST_VERSION = 1;
+constexpr uint16_t SHIM_MANIFEST_HAS_SOURCE = 1;
+
+/// Identity of the module the resources of a shim are copied from. If it did not change, neither did its resources.
+struct SourceStamp {
+    uint64_t path_hash = 0;
+    uint64_t size = 0;
+    /// FILETIME (100 ns intervals since 1601-01-01 UTC).
+    uint64_t last_write_time = 0;
+
+    friend bool operator==(const SourceStamp&, const SourceStamp&) = default;
+};
+
+struct ResourceTypeHash {
+    uint16_t type = 0;
+    uint16_t name_count = 0;
+    uint32_t data_size = 0;
+    uint64_t hash = 0;
+
+    friend bool operator==(const ResourceTypeHash&, const ResourceTypeHash&) = default;
+};
+
+struct ShimManifest {
+    uint64_t shim_data_hash = 0;
+    /// The module the resources were copied from, or `nullopt` if the shim has no copied resources.
+    std::optional<SourceStamp> metadata_source = std::nullopt;
+    std::vector<ResourceTypeHash> resources = {};
+
+    friend bool operator==(const ShimManifest&, const ShimManifest&) = default;
+};
+
+constexpr uint64_t FNV1A_64_OFFSET = 14695981039346656037ull;
+constexpr uint64_t FNV1A_64_PRIME = 1099511628211ull;
+
+inline uint64_t content_hash(std::span<const uint8_t> data, uint64_t hash = FNV1A_64_OFFSET) {
+    for (auto b : data) hash = (hash ^ b) * FNV1A_64_PRIME;
+    return hash;
+}
+
+/// Hash of a path, over its code units with ASCII letters folded to uppercase (file paths are case-insensitive);
+/// UTF-16 code units are hashed as 2 little-endian bytes.
+template<typename Char>
+uint64_t shim_path_hash(const Char* path) {
+    auto hash = FNV1A_64_OFFSET;
+    for (; *path; path++) {
+        auto c = (uint16_t) *path;
+        if (c >= 'a' && c <= 'z') c = (uint16_t) (c - ('a' - 'A'));
+        hash = (hash ^ (c & 0xff)) * FNV1A_64_PRIME;
+        hash = (hash ^ (c >> 8)) * FNV1A_64_PRIME;
+    }
+    return hash;
+}
+
+/// Hashes all resources of the given type in `table`. Only the first language of each name is included, since
+/// `ShimExecutable.cs` only sees a single language. For each name, in the directory order, the hash covers the name
+/// (0xffff and the ID for numeric names, the length and UTF-16 code units for string names), the uint32 data size
+/// and the data.
+ResourceTypeHash resource_type_hash(const pe::ResourceTable& table, pe::ResourceType type);
+
+std::vector<uint8_t> encode_shim_manifest(const ShimManifest& manifest);
+/// Returns `nullopt` if the manifest is malformed or has a different version.
+std::optional<ShimManifest> parse_shim_manifest(std::span<const uint8_t> data);
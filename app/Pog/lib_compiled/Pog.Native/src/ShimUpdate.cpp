@@ -0,0 +1,190 @@
+#include "ShimUpdate.hpp"
+#include <algorithm>
+#include <array>
+#include "pe/PeWriter.hpp"
+
+using namespace pe;
+
+namespace {
+    const ResourceName SHIM_DATA_ID = 1;
+    const ResourceName SHIM_FEATURES_ID = 2;
+    const ResourceName SHIM_MANIFEST_ID = 3;
+    /// Resource types copied from the target, must match `ShimExecutable.CopiedResourceTypes`.
+    constexpr ResourceType COPIED_RESOURCE_TYPES[] = {ResourceType::ICON, ResourceType::GROUP_ICON, ResourceType::VERSION};
+    /// Features of shims created before the templates were split, see `ShimExecutable.GetTemplateFeatures`.
+    constexpr uint16_t ALL_FEATURES = 3;
+
+    uint16_t template_features(std::optional<bytes> features) {
+        if (!features || features->size() != sizeof(uint16_t)) return ALL_FEATURES;
+        return read_u16(*features, 0);
+    }
+
+    uint16_t template_features(const ResourceTable& resources) {
+        auto features = resources.find(ResourceType::RCDATA, SHIM_FEATURES_ID);
+        return template_features(features ? std::optional<bytes>{features->data} : std::nullopt);
+    }
+
+    /// "ShimData", must match `SHIM_DATA_LOCATOR_MAGIC` in `Pog.Shim/src/ShimDataLocator.hpp`.
+    constexpr uint64_t SHIM_DATA_LOCATOR_MAGIC = 0x6174'6144'6d69'6853;
+    constexpr size_t SHIM_DATA_LOCATOR_SIZE = 16;
+
+    struct ShimDataLocator {
+        size_t offset;
+        std::array<uint8_t, SHIM_DATA_LOCATOR_SIZE> data;
+    };
+
+    /// Returns the locator that `image` should have, or `nullopt` if it cannot have one.
+    std::optional<ShimDataLocator> desired_shim_data_locator(const PeImage& image) {
+        // right after the section table, aligned to 8 bytes; the headers must have space for it before the data
+        //  of the first section
+        auto offset = (size_t) align_up((uint32_t) (image.section_table_offset()
+                                                    + image.sections().size() * sizeof(SectionHeader)), 8);
+        auto end = offset + SHIM_DATA_LOCATOR_SIZE;
+        if (end > image.size_of_headers() || end > image.data().size()) return std::nullopt;
+        for (auto& s : image.sections()) {
+            if (s.size_of_raw_data != 0 && s.pointer_to_raw_data < end) return std::nullopt;
+        }
+
+        // the space is normally zero padding; if it's something else than an old locator (e.g. bound imports,
+        //  which are also stored after the section table), leave it alone
+        auto current = image.data().subspan(offset, SHIM_DATA_LOCATOR_SIZE);
+        auto current_magic = (uint64_t) read_u32(current, 0) | (uint64_t) read_u32(current, 4) << 32;
+        if (current_magic != SHIM_DATA_LOCATOR_MAGIC && !std::ranges::all_of(current, [](auto b) { return b == 0; })) {
+            return std::nullopt;
+        }
+
+        ShimDataLocator locator{offset, {}};
+        auto shim_data = find_resource(image, ResourceType::RCDATA, SHIM_DATA_ID);
+        if (!shim_data || shim_data->empty()) return locator;
+        // `find_resource` returns a view into the image, translate its file offset back to the RVA
+        auto data_offset = (size_t) (shim_data->data() - image.data().data());
+        for (auto& s : image.sections()) {
+            if (data_offset >= s.pointer_to_raw_data && data_offset - s.pointer_to_raw_data < s.size_of_raw_data) {
+                auto rva = (uint32_t) (data_offset - s.pointer_to_raw_data + s.virtual_address);
+                write_u32(locator.data, 0, (uint32_t) SHIM_DATA_LOCATOR_MAGIC);
+                write_u32(locator.data, 4, (uint32_t) (SHIM_DATA_LOCATOR_MAGIC >> 32));
+                write_u32(locator.data, 8, rva);
+                write_u32(locator.data, 12, (uint32_t) shim_data->size());
+                break;
+            }
+        }
+        return locator;
+    }
+
+    bool is_shim_data_locator_current(const PeImage& image) {
+        auto locator = desired_shim_data_locator(image);
+        return !locator || std::ranges::equal(image.data().subspan(locator->offset, SHIM_DATA_LOCATOR_SIZE),
+                                              locator->data);
+    }
+
+    Resource build_manifest(const ResourceTable& desired, const ShimUpdate& update) {
+        ShimManifest manifest{
+            .shim_data_hash = content_hash(update.shim_data),
+            .metadata_source = update.metadata_source ? update.metadata_source_stamp : std::nullopt,
+        };
+        for (auto type : COPIED_RESOURCE_TYPES) {
+            manifest.resources.push_back(resource_type_hash(desired, type));
+        }
+        return {encode_shim_manifest(manifest)};
+    }
+}
+
+bool is_shim_up_to_date(const PeImage& shim, const ShimUpdate& update) {
+    if (update.subsystem && *update.subsystem != shim.subsystem()) {
+        return false;
+    }
+
+    auto manifest_data = find_resource(shim, ResourceType::RCDATA, SHIM_MANIFEST_ID);
+    auto manifest = manifest_data ? parse_shim_manifest(*manifest_data) : std::nullopt;
+    if (!manifest || manifest->metadata_source != update.metadata_source_stamp) {
+        return false;
+    }
+
+    // the stored shim data must match the manifest, otherwise the manifest is stale (the shim was updated
+    //  by an older version of Pog, which does not know about it)
+    auto shim_data = find_resource(shim, ResourceType::RCDATA, SHIM_DATA_ID);
+    if (!shim_data || content_hash(*shim_data) != manifest->shim_data_hash
+        || !std::ranges::equal(*shim_data, update.shim_data)) {
+        return false;
+    }
+    return template_features(find_resource(shim, ResourceType::RCDATA, SHIM_FEATURES_ID)) == update.features
+           && is_shim_data_locator_current(shim);
+}
+
+bool write_shim_data_locator(std::vector<uint8_t>& image_data) {
+    PeImage image{image_data};
+    auto locator = desired_shim_data_locator(image);
+    if (!locator) return false;
+    auto current = std::span{image_data}.subspan(locator->offset, SHIM_DATA_LOCATOR_SIZE);
+    if (std::ranges::equal(current, locator->data)) return false;
+
+    std::ranges::copy(locator->data, current.begin());
+    // only update the checksum if the image has one, like `write_image`
+    if (image.checksum() != 0) {
+        write_u32(image_data, image.checksum_offset(), compute_checksum(image_data, image.checksum_offset()));
+    }
+    return true;
+}
+
+std::optional<UpdatedShimImage> update_shim_image(const PeImage& shim, const ShimUpdate& update) {
+    auto current = read_resources(shim);
+    auto desired = current;
+
+    if (update.new_shim) {
+        // record which template the shim was created from
+        desired.remove(ResourceType::RCDATA, SHIM_FEATURES_ID);
+        desired.set({ResourceType::RCDATA, SHIM_FEATURES_ID}, {{(uint8_t) update.features, (uint8_t) (update.features >> 8)}});
+    } else {
+        // ensure the shim was created from the right template
+        if (template_features(current) != update.features) {
+            throw OutdatedShimError("Shim executable was created from a different shim template, "
+                                    "replace it with the template matching the shim configuration.");
+        }
+        auto shim_data = current.find(ResourceType::RCDATA, SHIM_DATA_ID);
+        if (shim_data && shim_data->data.size() >= sizeof(uint16_t)
+            && (shim_data->data[0] | shim_data->data[1] << 8) != CURRENT_SHIM_DATA_VERSION) {
+            throw OutdatedShimError("Shim executable expects an older version of shim data, "
+                                    "replace it with an up-to-date version of the shim executable.");
+        }
+    }
+
+    desired.remove(ResourceType::RCDATA, SHIM_DATA_ID);
+    desired.set({ResourceType::RCDATA, SHIM_DATA_ID}, {{update.shim_data.begin(), update.shim_data.end()}});
+
+    for (auto type : COPIED_RESOURCE_TYPES) {
+        desired.remove_type(type);
+        if (update.metadata_source) {
+            desired.copy_type(*update.metadata_source, type);
+        }
+    }
+
+    desired.remove(ResourceType::RCDATA, SHIM_MANIFEST_ID);
+    if (!update.metadata_source || update.metadata_source_stamp) {
+        desired.set({ResourceType::RCDATA, SHIM_MANIFEST_ID}, build_manifest(desired, update));
+    }
+
+    auto resources_changed = desired != current;
+    auto subsystem_changed = update.subsystem && *update.subsystem != shim.subsystem();
+    if (!resources_changed && !subsystem_changed) {
+        // shims written by an older Pog or by `BeginUpdateResource` may have a missing or stale locator
+        std::vector<uint8_t> image(shim.data().begin(), shim.data().end());
+        if (!write_shim_data_locator(image)) {
+            return std::nullopt;
+        }
+        return UpdatedShimImage{std::move(image), true};
+    }
+
+    auto manifest_only = false;
+    if (resources_changed && !subsystem_changed) {
+        auto with_new_manifest = current;
+        with_new_manifest.remove(ResourceType::RCDATA, SHIM_MANIFEST_ID);
+        if (auto manifest = desired.find(ResourceType::RCDATA, SHIM_MANIFEST_ID)) {
+            with_new_manifest.set({ResourceType::RCDATA, SHIM_MANIFEST_ID}, *manifest);
+        }
+        manifest_only = with_new_manifest == desired;
+    }
+    auto image = write_image(shim, {.resources = resources_changed ? &desired : nullptr, .subsystem = update.subsystem});
+    // if the resource section was rewritten, the shim data may have moved
+    write_shim_data_locator(image);
+    return UpdatedShimImage{std::move(image), manifest_only};
+}
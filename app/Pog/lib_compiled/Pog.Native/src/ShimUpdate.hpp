@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include "pe/PeImage.hpp"
+#include "pe/ResourceTable.hpp"
+#include "ShimManifest.hpp"
+
+// Native implementation of the resource handling in `ShimExecutable.cs`: computes the desired resources of a shim
+//  executable and rewrites the shim in a single pass, only if anything changed. Each written shim carries a manifest
+//  (see `ShimManifest.hpp`), which lets `is_shim_up_to_date` skip the full comparison in the common case.
+
+/// Version of the shim data written by Pog, must match `ShimDataEncoder.CurrentShimDataVersion`.
+constexpr uint16_t CURRENT_SHIM_DATA_VERSION = 5;
+
+/// The shim must be replaced with a fresh copy of the matching shim template, see `ShimExecutable.OutdatedShimException`.
+class OutdatedShimError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+struct ShimUpdate {
+    /// Encoded shim data (`ShimDataEncoder.EncodeShim`), stored as RCDATA #1.
+    std::span<const uint8_t> shim_data;
+    /// `ShimExecutable.ShimFeatures` required by the shim, stored as RCDATA #2 in new shims.
+    uint16_t features;
+    /// Resources of the module to copy icons and version info from, or nullptr to remove them from the shim.
+    const pe::ResourceTable* metadata_source = nullptr;
+    /// Identity of the metadata source, recorded in the shim manifest. If `metadata_source` is set without a stamp,
+    /// no manifest is written and the shim is always fully compared.
+    std::optional<SourceStamp> metadata_source_stamp = std::nullopt;
+    /// New subsystem of the shim, if it should be changed.
+    std::optional<uint16_t> subsystem = std::nullopt;
+    /// The shim is a fresh copy of a shim template, which is not checked for an outdated template or shim data.
+    bool new_shim = false;
+};
+
+struct UpdatedShimImage {
+    std::vector<uint8_t> image;
+    /// Only the shim manifest or the shim data locator changed (e.g. the metadata source was touched without changing
+    /// its resources), the shim still behaves the same, and writing the new image is optional.
+    bool manifest_only;
+};
+
+/// Checks the shim manifest, the stored shim data, the template features, the subsystem and the shim data locator
+/// of `shim` against `update`, without reading the other resources of the shim (`update.metadata_source` is not
+/// used). Returns false if the shim has no valid manifest or anything differs, in which case the full
+/// `update_shim_image` must run.
+bool is_shim_up_to_date(const pe::PeImage& shim, const ShimUpdate& update);
+
+/// Writes the shim data locator into the unused space after the section table of `image`, recording the RVA and size
+/// of the shim data (RCDATA #1), so that the shim can find them without walking the resource directory. The layout
+/// must match `Pog.Shim/src/ShimDataLocator.hpp`. If the image has no shim data, an existing locator is cleared.
+/// Nothing is written if there is no space for the locator, or if the space is used by something else. Updates
+/// the image checksum, if the image has one. Returns true if `image` changed.
+bool write_shim_data_locator(std::vector<uint8_t>& image);
+
+/// Returns the updated image of `shim`, or `nullopt` if the shim is already up to date.
+/// Throws `OutdatedShimError` if the shim was created from a different template, or has outdated shim data.
+std::optional<UpdatedShimImage> update_shim_image(const pe::PeImage& shim, const ShimUpdate& update);
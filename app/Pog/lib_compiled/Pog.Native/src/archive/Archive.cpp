@@ -0,0 +1,169 @@
+#include "Archive.hpp"
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include "Formats.hpp"
+
+namespace archive {
+    namespace {
+        std::vector<std::string_view> split_path(std::string_view path) {
+            std::vector<std::string_view> components;
+            size_t start = 0;
+            for (size_t i = 0; i <= path.size(); i++) {
+                if (i == path.size() || path[i] == '/' || path[i] == '\\') {
+                    auto component = path.substr(start, i - start);
+                    if (!component.empty() && component != ".") components.push_back(component);
+                    start = i + 1;
+                }
+            }
+            return components;
+        }
+
+        char ascii_lower(char c) {
+            return c >= 'A' && c <= 'Z' ? (char) (c - 'A' + 'a') : c;
+        }
+
+        bool wildcard_match(std::string_view pattern, std::string_view str) {
+            // iterative matching with backtracking to the last `*`
+            size_t p = 0, s = 0, star = std::string_view::npos, star_s = 0;
+            while (s < str.size()) {
+                if (p < pattern.size() && (pattern[p] == '?' || ascii_lower(pattern[p]) == ascii_lower(str[s]))) {
+                    p++;
+                    s++;
+                } else if (p < pattern.size() && pattern[p] == '*') {
+                    star = p++;
+                    star_s = s;
+                } else if (star != std::string_view::npos) {
+                    p = star + 1;
+                    s = ++star_s;
+                } else {
+                    return false;
+                }
+            }
+            while (p < pattern.size() && pattern[p] == '*') p++;
+            return p == pattern.size();
+        }
+
+        std::filesystem::path create_target_dir(const path_char* target_dir) {
+            std::filesystem::path target{target_dir};
+            std::error_code ec;
+            std::filesystem::create_directories(target, ec);
+            if (ec) throw IoError("Could not create the target directory.", ec.value());
+            return target;
+        }
+    }
+
+    PathFilter::PathFilter(const std::vector<std::string>& patterns) {
+        for (auto& pattern : patterns) {
+            std::vector<std::string> components;
+            for (auto c : split_path(pattern)) components.emplace_back(c);
+            // an empty pattern (or ".") selects the whole archive
+            if (components.empty()) {
+                patterns_.clear();
+                return;
+            }
+            patterns_.push_back(std::move(components));
+        }
+    }
+
+    bool PathFilter::matches(std::string_view path) const {
+        if (patterns_.empty()) return true;
+        auto components = split_path(path);
+        for (auto& pattern : patterns_) {
+            if (pattern.size() > components.size()) continue;
+            auto matched = true;
+            for (size_t i = 0; i < pattern.size() && matched; i++) {
+                matched = wildcard_match(pattern[i], components[i]);
+            }
+            if (matched) return true;
+        }
+        return false;
+    }
+
+    std::string normalize_entry_path(std::string_view path) {
+        std::string out;
+        for (auto component : split_path(path)) {
+            if (component == "..") {
+                throw ArchiveError("Archive entry '" + std::string(path) + "' points outside the target directory.");
+            }
+            if (!out.empty()) out += '/';
+            for (auto c : component) {
+                auto invalid = (unsigned char) c < 0x20 || c == '<' || c == '>' || c == ':' || c == '"' || c == '|'
+                               || c == '?' || c == '*';
+                out += invalid ? '_' : c;
+            }
+        }
+        return out;
+    }
+
+    Format detect_format(std::span<const uint8_t> header) {
+        auto starts_with = [&](std::initializer_list<uint8_t> magic, size_t offset = 0) {
+            return header.size() >= offset + magic.size() && std::equal(magic.begin(), magic.end(),
+                                                                         header.begin() + (ptrdiff_t) offset);
+        };
+        // local file header, or the end of central directory of an empty archive
+        if (starts_with({'P', 'K', 3, 4}) || starts_with({'P', 'K', 5, 6})) return Format::ZIP;
+        if (starts_with({0x1f, 0x8b, 8})) return Format::GZIP_TAR;
+        // "ustar\0" (POSIX) or "ustar " (GNU)
+        if (starts_with({'u', 's', 't', 'a', 'r'}, 257)) return Format::TAR;
+        throw UnsupportedArchiveError("Unsupported archive format.");
+    }
+
+    void MappedArchiveInput::read_at(uint64_t offset, std::span<uint8_t> buffer) const {
+        auto data = file_.data();
+        if (offset > data.size() || data.size() - offset < buffer.size()) {
+            throw ArchiveError("Read past the end of the archive.");
+        }
+        if (!buffer.empty()) memcpy(buffer.data(), data.data() + offset, buffer.size());
+    }
+
+    void extract_archive(const path_char* archive_path, const path_char* target_dir, const ExtractOptions& options) {
+        uint8_t header[512]{};
+        size_t header_size;
+        {
+            InputFile file{archive_path};
+            header_size = file.read(header);
+        }
+        auto format = detect_format({header, header_size});
+        auto target = create_target_dir(target_dir);
+
+        switch (format) {
+            case Format::ZIP:
+                extract_zip(MappedArchiveInput{archive_path}, target, options);
+                break;
+            case Format::TAR:
+            case Format::GZIP_TAR: {
+                InputFile file{archive_path};
+                extract_tar([&](std::span<uint8_t> buffer) { return file.read(buffer); }, file.size(),
+                            format == Format::GZIP_TAR, target, options);
+                break;
+            }
+        }
+    }
+
+    void extract_archive(const ArchiveInput& input, const path_char* target_dir, const ExtractOptions& options) {
+        uint8_t header[512]{};
+        auto header_size = (size_t) std::min<uint64_t>(sizeof(header), input.size());
+        input.read_at(0, {header, header_size});
+        auto format = detect_format({header, header_size});
+        auto target = create_target_dir(target_dir);
+
+        switch (format) {
+            case Format::ZIP:
+                extract_zip(input, target, options);
+                break;
+            case Format::TAR:
+            case Format::GZIP_TAR: {
+                uint64_t offset = 0;
+                auto read = [&](std::span<uint8_t> buffer) {
+                    auto size = (size_t) std::min<uint64_t>(buffer.size(), input.size() - offset);
+                    input.read_at(offset, buffer.first(size));
+                    offset += size;
+                    return size;
+                };
+                extract_tar(read, input.size(), format == Format::GZIP_TAR, target, options);
+                break;
+            }
+        }
+    }
+}
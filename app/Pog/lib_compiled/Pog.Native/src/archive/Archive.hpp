@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MappedFile.hpp"
+#include "Progress.hpp"
+
+// In-process archive extraction, replacing `7z.exe` for the common package archive formats: zip (stored and
+//  deflate entries, including zip64), tar, and gzip-compressed tar. Other formats (7z, xz, zstd, installers,...)
+//  are reported as unsupported, and `ExpandArchive7Zip.cs` falls back to `7z.exe`.
+//
+// The behavior follows `7z x -aoa`: entries are extracted with their full paths, existing files are overwritten,
+//  and the last write times of files are preserved.
+namespace archive {
+    /// Thrown for malformed archives, and for archive entries that would be written outside the target directory.
+    class ArchiveError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /// The archive is in a format (or uses a feature) we do not support; it may be fine for `7z.exe`.
+    class UnsupportedArchiveError : public ArchiveError {
+    public:
+        using ArchiveError::ArchiveError;
+    };
+
+    /// Selects the extracted entries, with the semantics of the path filters `ExpandArchive7Zip.cs` passes to 7zip.
+    /// Each pattern is a path relative to the archive root, separated by `/` or `\`, where each component may contain
+    /// `*` and `?` wildcards. An entry is selected if a pattern matches the entry path or any of its parent directories
+    /// (ASCII case-insensitively, like on Windows). An empty filter selects all entries.
+    class PathFilter {
+    private:
+        std::vector<std::vector<std::string>> patterns_;
+
+    public:
+        explicit PathFilter(const std::vector<std::string>& patterns = {});
+
+        /// `path` is a normalized entry path (see `normalize_entry_path`).
+        [[nodiscard]] bool matches(std::string_view path) const;
+    };
+
+    /// Converts a path stored in an archive (UTF-8, separated by `/` or `\`) to a relative path separated by `/`,
+    /// without empty and `.` components. Characters invalid in Windows file names are replaced with `_`, like 7zip
+    /// does. Throws `ArchiveError` for paths with `..` components, which could escape the target directory.
+    /// Returns an empty string for the archive root.
+    std::string normalize_entry_path(std::string_view path);
+
+    struct ExtractOptions {
+        PathFilter filter = PathFilter{};
+        /// Called with the number of processed bytes of the archive (uncompressed bytes for zip, read bytes for tar).
+        ProgressCallback progress = {};
+        /// Number of threads extracting zip entries, 0 to use all cores.
+        unsigned threads = 0;
+    };
+
+    /// Contents of an archive that are not (necessarily) a single file, e.g. a deduplicated download cache entry
+    /// reassembled from its chunks (`dedup/ChunkStore.hpp`). Must be safe to read from multiple threads at once.
+    class ArchiveInput {
+    public:
+        virtual ~ArchiveInput() = default;
+
+        [[nodiscard]] virtual uint64_t size() const = 0;
+        /// Fills `buffer` with the data at `offset`; the range must be inside the input.
+        virtual void read_at(uint64_t offset, std::span<uint8_t> buffer) const = 0;
+        /// The whole input if it's in memory (e.g. memory-mapped), so that it can be read without copying;
+        /// otherwise an empty span.
+        [[nodiscard]] virtual std::span<const uint8_t> contiguous() const {
+            return {};
+        }
+    };
+
+    /// `ArchiveInput` of a memory-mapped file.
+    class MappedArchiveInput : public ArchiveInput {
+    private:
+        MappedFile file_;
+
+    public:
+        explicit MappedArchiveInput(const path_char* path) : file_{path} {}
+
+        [[nodiscard]] uint64_t size() const override {
+            return file_.data().size();
+        }
+
+        void read_at(uint64_t offset, std::span<uint8_t> buffer) const override;
+
+        [[nodiscard]] std::span<const uint8_t> contiguous() const override {
+            return file_.data();
+        }
+    };
+
+    enum class Format { ZIP, TAR, GZIP_TAR };
+
+    /// Detects the archive format from the first bytes of the file. Throws `UnsupportedArchiveError` for other formats.
+    Format detect_format(std::span<const uint8_t> header);
+
+    /// Extracts the archive at `archive_path` into `target_dir` (created if it does not exist).
+    /// Throws `UnsupportedArchiveError` (the caller should clean `target_dir` and retry with 7zip), `ArchiveError`,
+    /// `IoError` or `OperationCancelled`; on error, `target_dir` may contain partially extracted files.
+    void extract_archive(const path_char* archive_path, const path_char* target_dir, const ExtractOptions& options);
+    /// Extracts the archive read from `input`, same as `extract_archive` for a file. Zip entries are read from
+    /// `input` in parallel, tar archives in a single sequential pass.
+    void extract_archive(const ArchiveInput& input, const path_char* target_dir, const ExtractOptions& options);
+}
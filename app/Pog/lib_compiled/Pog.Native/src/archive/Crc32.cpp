@@ -0,0 +1,35 @@
+#include "Crc32.hpp"
+#include <array>
+
+namespace archive {
+    namespace {
+        // slicing-by-8: table[k][b] is the CRC of byte `b` followed by `k` zero bytes
+        constexpr auto TABLES = [] {
+            std::array<std::array<uint32_t, 256>, 8> tables{};
+            for (uint32_t b = 0; b < 256; b++) {
+                auto crc = b;
+                for (int i = 0; i < 8; i++) crc = crc & 1 ? (crc >> 1) ^ 0xedb8'8320 : crc >> 1;
+                tables[0][b] = crc;
+            }
+            for (uint32_t b = 0; b < 256; b++) {
+                for (size_t k = 1; k < 8; k++) {
+                    tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xff];
+                }
+            }
+            return tables;
+        }();
+    }
+
+    uint32_t crc32(std::span<const uint8_t> data, uint32_t crc) {
+        crc = ~crc;
+        auto p = data.data();
+        auto size = data.size();
+        for (; size >= 8; size -= 8, p += 8) {
+            auto lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24);
+            crc = TABLES[7][lo & 0xff] ^ TABLES[6][(lo >> 8) & 0xff] ^ TABLES[5][(lo >> 16) & 0xff]
+                  ^ TABLES[4][lo >> 24] ^ TABLES[3][p[4]] ^ TABLES[2][p[5]] ^ TABLES[1][p[6]] ^ TABLES[0][p[7]];
+        }
+        for (; size > 0; size--, p++) crc = (crc >> 8) ^ TABLES[0][(crc ^ *p) & 0xff];
+        return ~crc;
+    }
+}
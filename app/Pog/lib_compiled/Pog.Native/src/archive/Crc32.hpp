@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+namespace archive {
+    /// CRC-32 (ISO-HDLC, the checksum of zip and gzip). Pass the previous result as `crc` to continue a checksum.
+    uint32_t crc32(std::span<const uint8_t> data, uint32_t crc = 0);
+}
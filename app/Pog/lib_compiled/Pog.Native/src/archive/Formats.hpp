@@ -0,0 +1,29 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include "Archive.hpp"
+
+// Internal interface between `Archive.cpp` and the format-specific extractors.
+namespace archive {
+    /// Seconds between 1601-01-01 (FILETIME epoch) and 1970-01-01 (Unix epoch).
+    constexpr int64_t FILETIME_UNIX_EPOCH = 11644473600;
+
+    inline uint64_t unix_time_to_filetime(int64_t seconds) {
+        return (uint64_t) (seconds + FILETIME_UNIX_EPOCH) * 10'000'000;
+    }
+
+    /// Output path of an entry, `path` is a normalized entry path.
+    inline std::filesystem::path entry_output_path(const std::filesystem::path& target_dir, const std::string& path) {
+        return target_dir / std::filesystem::path(std::u8string{path.begin(), path.end()});
+    }
+
+    /// Reads the next part of the archive into `buffer`, returns the number of bytes read, 0 at the end.
+    using ReadFn = std::function<size_t(std::span<uint8_t> buffer)>;
+
+    void extract_zip(const ArchiveInput& archive, const std::filesystem::path& target_dir,
+                     const ExtractOptions& options);
+    /// `total_size` is the size of the (compressed) archive, for progress reporting.
+    void extract_tar(const ReadFn& read, uint64_t total_size, bool gzip, const std::filesystem::path& target_dir,
+                     const ExtractOptions& options);
+}
@@ -0,0 +1,275 @@
+#include "Inflate.hpp"
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include "Archive.hpp"
+
+namespace archive {
+    bool BitReader::next_chunk() {
+        consumed_ += chunk_.size();
+        chunk_pos_ = 0;
+        chunk_ = source_();
+        return !chunk_.empty();
+    }
+
+    void BitReader::read_bytes(uint8_t* out, size_t size) {
+        // drain the bit buffer first, then copy directly from the input chunks
+        while (size > 0 && bit_count_ >= 8) {
+            *out++ = (uint8_t) bits(8);
+            size--;
+        }
+        check_overrun();
+        while (size > 0) {
+            if (chunk_pos_ == chunk_.size() && !next_chunk()) {
+                throw ArchiveError("Unexpected end of compressed data.");
+            }
+            auto n = std::min(size, chunk_.size() - chunk_pos_);
+            memcpy(out, chunk_.data() + chunk_pos_, n);
+            chunk_pos_ += n;
+            out += n;
+            size -= n;
+        }
+    }
+
+    bool BitReader::at_end() {
+        if (bit_count_ / 8 > overrun_) return false;
+        return chunk_pos_ == chunk_.size() && !next_chunk();
+    }
+
+    void BitReader::check_overrun() const {
+        if (bit_count_ < overrun_ * 8) throw ArchiveError("Unexpected end of compressed data.");
+    }
+
+    namespace {
+        constexpr int FAST_BITS = 10;
+        constexpr uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                                              67, 83, 99, 115, 131, 163, 195, 227, 258};
+        constexpr uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                              4, 4, 4, 4, 5, 5, 5, 5, 0};
+        constexpr uint16_t DIST_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+                                            769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        constexpr uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
+                                            9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+        constexpr uint8_t CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+        uint32_t reverse_bits(uint32_t n, int count) {
+            uint32_t out = 0;
+            for (int i = 0; i < count; i++, n >>= 1) out = out << 1 | (n & 1);
+            return out;
+        }
+
+        /// Canonical Huffman decoding table. Codes of up to `FAST_BITS` bits are decoded with a single lookup,
+        /// longer codes by comparing against the first code of each length.
+        class Huffman {
+        private:
+            /// (code length << 9) | symbol, 0 if the code is longer than `FAST_BITS`
+            uint16_t fast_[1 << FAST_BITS];
+            /// first code of each length, left-aligned to 16 bits, for comparison with the reversed input bits
+            uint32_t max_code_[17];
+            uint16_t first_code_[16];
+            uint16_t first_symbol_[16];
+            uint8_t lengths_[288];
+            uint16_t symbols_[288];
+
+        public:
+            Huffman(const uint8_t* lengths, int count) {
+                int length_counts[16]{};
+                for (int i = 0; i < count; i++) length_counts[lengths[i]]++;
+                length_counts[0] = 0;
+
+                int next_code[16];
+                int code = 0, symbol_index = 0;
+                for (int len = 1; len < 16; len++) {
+                    if (length_counts[len] > (1 << len)) throw ArchiveError("Invalid Huffman code lengths.");
+                    next_code[len] = code;
+                    first_code_[len] = (uint16_t) code;
+                    first_symbol_[len] = (uint16_t) symbol_index;
+                    code += length_counts[len];
+                    if (length_counts[len] && code - 1 >= (1 << len)) {
+                        throw ArchiveError("Invalid Huffman code lengths.");
+                    }
+                    max_code_[len] = (uint32_t) code << (16 - len);
+                    code <<= 1;
+                    symbol_index += length_counts[len];
+                }
+                max_code_[16] = 0x10000;
+
+                memset(fast_, 0, sizeof(fast_));
+                for (int symbol = 0; symbol < count; symbol++) {
+                    int len = lengths[symbol];
+                    if (len == 0) continue;
+                    auto index = next_code[len] - first_code_[len] + first_symbol_[len];
+                    lengths_[index] = (uint8_t) len;
+                    symbols_[index] = (uint16_t) symbol;
+                    if (len <= FAST_BITS) {
+                        // codes are stored most significant bit first, the table is indexed by the input bits
+                        for (auto j = reverse_bits(next_code[len], len); j < (1u << FAST_BITS); j += 1u << len) {
+                            fast_[j] = (uint16_t) (len << 9 | symbol);
+                        }
+                    }
+                    next_code[len]++;
+                }
+            }
+
+            int decode(BitReader& reader) const {
+                reader.refill();
+                auto entry = fast_[reader.peek(FAST_BITS)];
+                if (entry) {
+                    reader.consume(entry >> 9);
+                    return entry & 511;
+                }
+                auto code = reverse_bits(reader.peek(16), 16);
+                int len = FAST_BITS + 1;
+                while (code >= max_code_[len]) len++;
+                if (len >= 16) throw ArchiveError("Invalid Huffman code.");
+                auto index = (code >> (16 - len)) - first_code_[len] + first_symbol_[len];
+                if (index >= 288 || lengths_[index] != len) throw ArchiveError("Invalid Huffman code.");
+                reader.consume(len);
+                return symbols_[index];
+            }
+        };
+
+        const Huffman& fixed_literals() {
+            static const Huffman table = [] {
+                uint8_t lengths[288];
+                memset(lengths, 8, 144);
+                memset(lengths + 144, 9, 112);
+                memset(lengths + 256, 7, 24);
+                memset(lengths + 280, 8, 8);
+                return Huffman{lengths, 288};
+            }();
+            return table;
+        }
+
+        const Huffman& fixed_distances() {
+            static const Huffman table = [] {
+                uint8_t lengths[30];
+                memset(lengths, 5, 30);
+                return Huffman{lengths, 30};
+            }();
+            return table;
+        }
+
+        std::pair<Huffman, Huffman> read_dynamic_tables(BitReader& reader) {
+            auto literal_count = (int) reader.bits(5) + 257;
+            auto distance_count = (int) reader.bits(5) + 1;
+            auto code_length_count = (int) reader.bits(4) + 4;
+            if (literal_count > 286 || distance_count > 30) throw ArchiveError("Invalid dynamic Huffman block.");
+
+            uint8_t code_length_lengths[19]{};
+            for (int i = 0; i < code_length_count; i++) {
+                code_length_lengths[CODE_LENGTH_ORDER[i]] = (uint8_t) reader.bits(3);
+            }
+            Huffman code_lengths{code_length_lengths, 19};
+
+            uint8_t lengths[286 + 30];
+            int n = 0;
+            while (n < literal_count + distance_count) {
+                auto symbol = code_lengths.decode(reader);
+                int repeat;
+                uint8_t value;
+                if (symbol < 16) {
+                    lengths[n++] = (uint8_t) symbol;
+                    continue;
+                } else if (symbol == 16) {
+                    if (n == 0) throw ArchiveError("Invalid dynamic Huffman block.");
+                    repeat = 3 + (int) reader.bits(2);
+                    value = lengths[n - 1];
+                } else if (symbol == 17) {
+                    repeat = 3 + (int) reader.bits(3);
+                    value = 0;
+                } else {
+                    repeat = 11 + (int) reader.bits(7);
+                    value = 0;
+                }
+                if (n + repeat > literal_count + distance_count) throw ArchiveError("Invalid dynamic Huffman block.");
+                memset(lengths + n, value, repeat);
+                n += repeat;
+            }
+            if (lengths[256] == 0) throw ArchiveError("Invalid dynamic Huffman block, missing end of block code.");
+            return {Huffman{lengths, literal_count}, Huffman{lengths + literal_count, distance_count}};
+        }
+    }
+
+    Inflater::Inflater() : buffer_{std::make_unique<uint8_t[]>(WINDOW_SIZE + CHUNK_SIZE)} {}
+
+    uint64_t Inflater::inflate(BitReader& reader, const Sink& sink) {
+        auto out = buffer_.get();
+        // `pos` is the end of the output in the buffer, [0, `flushed`) was already passed to the sink
+        size_t pos = 0, flushed = 0;
+        uint64_t total = 0;
+        constexpr size_t MAX_MATCH = 258;
+
+        auto flush = [&] {
+            // a truncated stream decodes as an endless run of zero bits, stop at the latest after each chunk
+            reader.check_overrun();
+            sink({out + flushed, pos - flushed});
+            total += pos - flushed;
+            if (pos > WINDOW_SIZE) {
+                memmove(out, out + pos - WINDOW_SIZE, WINDOW_SIZE);
+                pos = WINDOW_SIZE;
+            }
+            flushed = pos;
+        };
+
+        bool final_block;
+        do {
+            final_block = reader.bits(1);
+            auto type = reader.bits(2);
+            if (type == 0) {
+                reader.align_to_byte();
+                auto len = reader.bits(16);
+                if ((reader.bits(16) ^ 0xffff) != len) throw ArchiveError("Invalid stored block length.");
+                while (len > 0) {
+                    if (pos == WINDOW_SIZE + CHUNK_SIZE) flush();
+                    auto n = std::min<size_t>(len, WINDOW_SIZE + CHUNK_SIZE - pos);
+                    reader.read_bytes(out + pos, n);
+                    pos += n;
+                    len -= (uint32_t) n;
+                }
+                continue;
+            } else if (type == 3) {
+                throw ArchiveError("Invalid deflate block type.");
+            }
+
+            std::optional<std::pair<Huffman, Huffman>> dynamic;
+            if (type == 2) dynamic = read_dynamic_tables(reader);
+            auto& literals = dynamic ? dynamic->first : fixed_literals();
+            auto& distances = dynamic ? dynamic->second : fixed_distances();
+
+            while (true) {
+                if (pos + MAX_MATCH > WINDOW_SIZE + CHUNK_SIZE) flush();
+                auto symbol = literals.decode(reader);
+                if (symbol < 256) {
+                    out[pos++] = (uint8_t) symbol;
+                    continue;
+                }
+                if (symbol == 256) break;
+
+                symbol -= 257;
+                if (symbol >= 29) throw ArchiveError("Invalid deflate length code.");
+                auto len = LENGTH_BASE[symbol] + reader.bits(LENGTH_EXTRA[symbol]);
+                auto dist_symbol = distances.decode(reader);
+                if (dist_symbol >= 30) throw ArchiveError("Invalid deflate distance code.");
+                auto dist = DIST_BASE[dist_symbol] + reader.bits(DIST_EXTRA[dist_symbol]);
+                if (dist > pos) throw ArchiveError("Invalid deflate distance, too far back.");
+
+                auto src = out + pos - dist;
+                auto dst = out + pos;
+                if (dist >= len) {
+                    memcpy(dst, src, len);
+                } else {
+                    // overlapping copy, repeats the last `dist` bytes
+                    for (uint32_t i = 0; i < len; i++) dst[i] = src[i];
+                }
+                pos += len;
+            }
+            reader.check_overrun();
+        } while (!final_block);
+
+        reader.check_overrun();
+        reader.align_to_byte();
+        flush();
+        return total;
+    }
+}
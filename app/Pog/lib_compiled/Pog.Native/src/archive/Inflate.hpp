@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+
+// Decoder of raw DEFLATE streams (RFC 1951), used for zip entries and gzip members.
+namespace archive {
+    /// Reads the compressed input as a bit stream. The input is pulled in chunks from `source`, which returns an empty
+    /// span at the end of the input; the chunks must stay valid until the next call.
+    class BitReader {
+    public:
+        using Source = std::function<std::span<const uint8_t>()>;
+
+    private:
+        Source source_;
+        std::span<const uint8_t> chunk_{};
+        size_t chunk_pos_ = 0;
+        uint64_t bits_ = 0;
+        int bit_count_ = 0;
+        /// Number of zero bytes appended after the end of the input, to allow reading ahead.
+        int overrun_ = 0;
+        uint64_t consumed_ = 0;
+
+    public:
+        explicit BitReader(Source source) : source_{std::move(source)} {}
+
+        /// Ensures that at least 57 bits are buffered (zeros past the end of the input).
+        void refill() {
+            while (bit_count_ <= 56) {
+                if (chunk_pos_ == chunk_.size() && !next_chunk()) {
+                    overrun_++;
+                    bit_count_ += 8;
+                    continue;
+                }
+                bits_ |= (uint64_t) chunk_[chunk_pos_++] << bit_count_;
+                bit_count_ += 8;
+            }
+        }
+
+        [[nodiscard]] uint32_t peek(int count) const {
+            return (uint32_t) (bits_ & ((1ull << count) - 1));
+        }
+
+        void consume(int count) {
+            bits_ >>= count;
+            bit_count_ -= count;
+        }
+
+        uint32_t bits(int count) {
+            if (bit_count_ < count) refill();
+            auto value = peek(count);
+            consume(count);
+            return value;
+        }
+
+        /// Discards the bits up to the next byte boundary.
+        void align_to_byte() {
+            consume(bit_count_ % 8);
+        }
+
+        /// Reads `size` bytes from a byte boundary, throws `ArchiveError` at the end of the input.
+        void read_bytes(uint8_t* out, size_t size);
+
+        /// Returns true if all input was consumed (at a byte boundary).
+        bool at_end();
+
+        /// Throws `ArchiveError` if the decoder read past the end of the input.
+        void check_overrun() const;
+
+        /// Number of input bytes consumed so far.
+        [[nodiscard]] uint64_t consumed() const {
+            auto buffered = bit_count_ / 8 - overrun_;
+            return consumed_ + chunk_pos_ - (buffered > 0 ? buffered : 0);
+        }
+
+    private:
+        bool next_chunk();
+    };
+
+    /// Decodes one DEFLATE stream from `reader`, passing the output to `sink` in pieces of up to 256 KiB.
+    /// After the end of the stream, `reader` is positioned at the next byte boundary. Throws `ArchiveError`
+    /// for invalid streams.
+    class Inflater {
+    public:
+        using Sink = std::function<void(std::span<const uint8_t>)>;
+        static constexpr size_t WINDOW_SIZE = 32 << 10;
+        static constexpr size_t CHUNK_SIZE = 256 << 10;
+
+    private:
+        // output buffer: the last `WINDOW_SIZE` bytes of the output are kept before the new output for back-references
+        std::unique_ptr<uint8_t[]> buffer_;
+
+    public:
+        Inflater();
+
+        /// Returns the number of decoded bytes.
+        uint64_t inflate(BitReader& reader, const Sink& sink);
+    };
+}
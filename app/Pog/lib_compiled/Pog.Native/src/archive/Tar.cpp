@@ -0,0 +1,356 @@
+// Tar extraction (POSIX ustar and pax, GNU long names), optionally gzip-compressed (RFC 1952). The archive is read
+//  in a single sequential pass; the tar stream is pushed into `TarExtractor` as it's read or decompressed.
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "Crc32.hpp"
+#include "Formats.hpp"
+#include "Inflate.hpp"
+
+namespace archive {
+    namespace {
+        using bytes = std::span<const uint8_t>;
+
+        constexpr size_t BLOCK_SIZE = 512;
+        constexpr size_t READ_CHUNK_SIZE = 1 << 20;
+        /// Limit for GNU long names and pax headers, which are buffered in memory.
+        constexpr uint64_t MAX_METADATA_SIZE = 1 << 20;
+
+        std::string read_string(const uint8_t* field, size_t size) {
+            auto end = (const uint8_t*) memchr(field, 0, size);
+            return {field, end ? end : field + size};
+        }
+
+        /// Numeric header fields are octal, terminated by a space or NUL; GNU tar stores large values in base-256,
+        /// marked by the highest bit of the first byte.
+        uint64_t read_number(const uint8_t* field, size_t size) {
+            uint64_t n = 0;
+            if (field[0] & 0x80) {
+                if (field[0] & 0x40) throw ArchiveError("Invalid tar header, negative number.");
+                n = field[0] & 0x3f;
+                for (size_t i = 1; i < size; i++) {
+                    if (n >> 56) throw ArchiveError("Invalid tar header, number out of range.");
+                    n = n << 8 | field[i];
+                }
+                return n;
+            }
+            size_t i = 0;
+            while (i < size && field[i] == ' ') i++;
+            for (; i < size && field[i] >= '0' && field[i] <= '7'; i++) {
+                if (n >> 60) throw ArchiveError("Invalid tar header, number out of range.");
+                n = n << 3 | (field[i] - '0');
+            }
+            return n;
+        }
+
+        bool is_valid_checksum(const uint8_t* header) {
+            // the checksum field itself is counted as spaces; some old tars use signed bytes
+            uint64_t sum = 0;
+            int64_t signed_sum = 0;
+            for (size_t i = 0; i < BLOCK_SIZE; i++) {
+                auto c = i >= 148 && i < 156 ? (uint8_t) ' ' : header[i];
+                sum += c;
+                signed_sum += (int8_t) c;
+            }
+            auto expected = read_number(header + 148, 8);
+            return expected == sum || (int64_t) expected == signed_sum;
+        }
+
+        /// Parses the pax time format, decimal seconds with an optional fraction, to a FILETIME.
+        uint64_t parse_pax_time(const std::string& value) {
+            int64_t seconds = 0;
+            size_t i = 0;
+            auto negative = !value.empty() && value[0] == '-';
+            if (negative) i++;
+            for (; i < value.size() && isdigit((unsigned char) value[i]); i++) seconds = seconds * 10 + (value[i] - '0');
+            uint64_t fraction = 0;
+            if (i < value.size() && value[i] == '.') {
+                // 100 ns precision, the remaining digits are truncated
+                i++;
+                for (int digits = 0; digits < 7; digits++, i++) {
+                    auto digit = i < value.size() && isdigit((unsigned char) value[i]) ? value[i] - '0' : 0;
+                    fraction = fraction * 10 + digit;
+                }
+            }
+            if (negative) return 0;
+            return unix_time_to_filetime(seconds) + fraction;
+        }
+
+        class TarExtractor {
+        private:
+            enum class State { HEADER, DATA, END };
+            enum class EntryKind { FILE, SKIP, LONG_NAME, PAX };
+
+            const std::filesystem::path& target_dir_;
+            const PathFilter& filter_;
+
+            State state_ = State::HEADER;
+            uint8_t header_[BLOCK_SIZE]{};
+            size_t header_size_ = 0;
+            bool seen_header_ = false;
+
+            EntryKind kind_ = EntryKind::SKIP;
+            uint64_t remaining_ = 0;
+            uint64_t padding_ = 0;
+            std::unique_ptr<OutputFile> file_{};
+            uint64_t file_mtime_ = 0;
+            std::string metadata_{};
+            /// The last directory we created, consecutive entries are typically in the same directory.
+            std::filesystem::path created_dir_{};
+
+            // overrides for the next entry, from GNU long name (`L`) and pax extended (`x`) headers
+            std::optional<std::string> long_name_{};
+            std::optional<std::string> pax_path_{};
+            std::optional<uint64_t> pax_size_{};
+            std::optional<uint64_t> pax_mtime_{};
+
+        public:
+            TarExtractor(const std::filesystem::path& target_dir, const PathFilter& filter)
+                    : target_dir_{target_dir}, filter_{filter} {}
+
+            void feed(bytes data) {
+                while (!data.empty()) {
+                    if (state_ == State::END) {
+                        // the rest of the archive is zero padding
+                        return;
+                    } else if (state_ == State::HEADER) {
+                        auto n = std::min(data.size(), BLOCK_SIZE - header_size_);
+                        memcpy(header_ + header_size_, data.data(), n);
+                        header_size_ += n;
+                        data = data.subspan(n);
+                        if (header_size_ == BLOCK_SIZE) {
+                            header_size_ = 0;
+                            read_header();
+                        }
+                    } else if (remaining_ > 0) {
+                        auto n = (size_t) std::min<uint64_t>(data.size(), remaining_);
+                        write_entry_data(data.first(n));
+                        remaining_ -= n;
+                        data = data.subspan(n);
+                        if (remaining_ + padding_ == 0) finish_entry();
+                    } else {
+                        auto n = (size_t) std::min<uint64_t>(data.size(), padding_);
+                        padding_ -= n;
+                        data = data.subspan(n);
+                        if (padding_ == 0) finish_entry();
+                    }
+                }
+            }
+
+            void finish() {
+                if (!seen_header_) throw UnsupportedArchiveError("Unsupported archive format, not a tar archive.");
+                // the end-of-archive blocks are optional in practice, but an entry must not be cut off
+                if (state_ == State::DATA || header_size_ != 0) throw ArchiveError("Truncated tar archive.");
+            }
+
+        private:
+            void read_header() {
+                if (std::all_of(header_, header_ + BLOCK_SIZE, [](auto b) { return b == 0; })) {
+                    // end of the archive, possibly an empty one
+                    seen_header_ = true;
+                    state_ = State::END;
+                    return;
+                }
+                if (!is_valid_checksum(header_)) {
+                    // a gzip stream that does not contain a tar archive, e.g. a single compressed file
+                    if (!seen_header_) throw UnsupportedArchiveError("Unsupported archive format, not a tar archive.");
+                    throw ArchiveError("Invalid tar header checksum.");
+                }
+                seen_header_ = true;
+
+                auto type = (char) header_[156];
+                auto size = read_number(header_ + 124, 12);
+                remaining_ = size;
+                padding_ = (BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE;
+                state_ = State::DATA;
+                kind_ = EntryKind::SKIP;
+
+                if (type == 'L' || type == 'x') {
+                    if (size > MAX_METADATA_SIZE) throw ArchiveError("Tar extended header is too large.");
+                    kind_ = type == 'L' ? EntryKind::LONG_NAME : EntryKind::PAX;
+                    metadata_.clear();
+                } else if (type == 'K' || type == 'g') {
+                    // link target of the next entry, global pax header; neither matters for us
+                } else {
+                    read_entry_header(type);
+                    // the size of the data in the archive, even for skipped entries
+                    remaining_ = size = pax_size_.value_or(size);
+                    padding_ = (BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE;
+                    long_name_ = pax_path_ = std::nullopt;
+                    pax_size_ = pax_mtime_ = std::nullopt;
+                }
+                if (remaining_ + padding_ == 0) finish_entry();
+            }
+
+            void read_entry_header(char type) {
+                std::string name;
+                if (pax_path_) {
+                    name = *pax_path_;
+                } else if (long_name_) {
+                    name = *long_name_;
+                } else {
+                    name = read_string(header_, 100);
+                    auto prefix = memcmp(header_ + 257, "ustar\0", 6) == 0 ? read_string(header_ + 345, 155) : "";
+                    if (!prefix.empty()) name = prefix + "/" + name;
+                }
+
+                auto path = normalize_entry_path(name);
+                if (path.empty() || !filter_.matches(path)) return;
+
+                if (type == '0' || type == '\0' || type == '7') {
+                    auto output_path = entry_output_path(target_dir_, path);
+                    create_directory(output_path.parent_path());
+                    file_ = std::make_unique<OutputFile>(output_path.c_str());
+                    file_mtime_ = pax_mtime_.value_or(unix_time_to_filetime((int64_t) read_number(header_ + 136, 12)));
+                    kind_ = EntryKind::FILE;
+                } else if (type == '5') {
+                    create_directory(entry_output_path(target_dir_, path));
+                } else if (type == '1' || type == '2' || type == 'S') {
+                    throw UnsupportedArchiveError("Tar links and sparse files are not supported ('" + path + "').");
+                }
+                // other types (devices, FIFOs,...) cannot be extracted on Windows, skip them like 7zip
+            }
+
+            void create_directory(const std::filesystem::path& dir) {
+                if (dir == created_dir_) return;
+                std::error_code ec;
+                std::filesystem::create_directories(dir, ec);
+                if (ec) throw IoError("Could not create directory '" + std::string((const char*) dir.u8string().c_str())
+                                      + "'.", ec.value());
+                created_dir_ = dir;
+            }
+
+            void write_entry_data(bytes data) {
+                if (kind_ == EntryKind::FILE) {
+                    file_->write(data);
+                } else if (kind_ != EntryKind::SKIP) {
+                    metadata_.append(data.begin(), data.end());
+                }
+            }
+
+            void finish_entry() {
+                if (kind_ == EntryKind::FILE) {
+                    file_->set_last_write_time(file_mtime_);
+                    file_.reset();
+                } else if (kind_ == EntryKind::LONG_NAME) {
+                    long_name_ = metadata_.substr(0, metadata_.find('\0'));
+                } else if (kind_ == EntryKind::PAX) {
+                    read_pax_records();
+                }
+                state_ = State::HEADER;
+            }
+
+            /// Pax records are "<length> <key>=<value>\n", where length counts the whole record.
+            void read_pax_records() {
+                for (size_t pos = 0; pos < metadata_.size();) {
+                    auto space = metadata_.find(' ', pos);
+                    if (space == std::string::npos) break;
+                    size_t length = 0;
+                    for (auto i = pos; i < space && isdigit((unsigned char) metadata_[i]); i++) {
+                        length = length * 10 + (metadata_[i] - '0');
+                    }
+                    if (length <= space - pos || pos + length > metadata_.size()) {
+                        throw ArchiveError("Invalid tar pax header.");
+                    }
+                    auto record = std::string_view{metadata_}.substr(space + 1, pos + length - space - 2);
+                    pos += length;
+
+                    auto equals = record.find('=');
+                    if (equals == std::string_view::npos) continue;
+                    auto key = record.substr(0, equals);
+                    auto value = std::string{record.substr(equals + 1)};
+                    if (key == "path") {
+                        pax_path_ = value;
+                    } else if (key == "size") {
+                        pax_size_ = std::stoull(value);
+                    } else if (key == "mtime") {
+                        pax_mtime_ = parse_pax_time(value);
+                    }
+                }
+            }
+        };
+
+        uint32_t read_u32_le(const uint8_t* p) {
+            return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+        }
+
+        void skip_gzip_string(BitReader& reader) {
+            uint8_t c;
+            do {
+                reader.read_bytes(&c, 1);
+            } while (c != 0);
+        }
+
+        /// Decompresses all gzip members in `reader` (concatenated gzip files are a single stream) into `sink`.
+        void gunzip(BitReader& reader, const Inflater::Sink& sink) {
+            constexpr uint8_t FHCRC = 2, FEXTRA = 4, FNAME = 8, FCOMMENT = 16;
+            Inflater inflater;
+            do {
+                uint8_t header[10];
+                reader.read_bytes(header, sizeof(header));
+                if (header[0] != 0x1f || header[1] != 0x8b) {
+                    // tolerate trailing garbage (typically zero padding) after the first member, like gzip does
+                    if (reader.consumed() > sizeof(header)) break;
+                    throw ArchiveError("Invalid gzip header.");
+                }
+                if (header[2] != 8) throw UnsupportedArchiveError("Unsupported gzip compression method.");
+
+                auto flags = header[3];
+                if (flags & FEXTRA) {
+                    uint8_t size[2];
+                    reader.read_bytes(size, 2);
+                    std::vector<uint8_t> extra(size[0] | size[1] << 8);
+                    reader.read_bytes(extra.data(), extra.size());
+                }
+                if (flags & FNAME) skip_gzip_string(reader);
+                if (flags & FCOMMENT) skip_gzip_string(reader);
+                if (flags & FHCRC) {
+                    uint8_t header_crc[2];
+                    reader.read_bytes(header_crc, 2);
+                }
+
+                uint32_t crc = 0;
+                auto size = inflater.inflate(reader, [&](bytes piece) {
+                    crc = crc32(piece, crc);
+                    sink(piece);
+                });
+
+                uint8_t trailer[8];
+                reader.read_bytes(trailer, sizeof(trailer));
+                if (read_u32_le(trailer) != crc || read_u32_le(trailer + 4) != (uint32_t) size) {
+                    throw ArchiveError("Corrupted gzip stream, the checksum does not match.");
+                }
+            } while (!reader.at_end());
+        }
+    }
+
+    void extract_tar(const ReadFn& read, uint64_t total_size, bool gzip, const std::filesystem::path& target_dir,
+                     const ExtractOptions& options) {
+        uint64_t read_size = 0;
+        std::vector<uint8_t> buffer(READ_CHUNK_SIZE);
+        auto read_chunk = [&]() -> bytes {
+            if (options.progress && !options.progress(read_size, total_size)) throw OperationCancelled();
+            auto n = read(buffer);
+            read_size += n;
+            return {buffer.data(), n};
+        };
+
+        TarExtractor extractor{target_dir, options.filter};
+        if (gzip) {
+            BitReader reader{read_chunk};
+            gunzip(reader, [&](bytes piece) { extractor.feed(piece); });
+        } else {
+            while (true) {
+                auto chunk = read_chunk();
+                if (chunk.empty()) break;
+                extractor.feed(chunk);
+            }
+        }
+        extractor.finish();
+        if (options.progress) options.progress(total_size, total_size);
+    }
+}
@@ -0,0 +1,391 @@
+// Zip extraction (https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT). The archive is memory-mapped (or read
+//  from a deduplicated cache entry through `ArchiveInput`), the entries are read from the central directory and
+//  extracted in parallel, since each entry is compressed independently.
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <ctime>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include "Crc32.hpp"
+#include "Formats.hpp"
+#include "Inflate.hpp"
+
+namespace archive {
+    namespace {
+        using bytes = std::span<const uint8_t>;
+
+        constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x0403'4b50;
+        constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x0201'4b50;
+        constexpr uint32_t EOCD_SIGNATURE = 0x0605'4b50;
+        constexpr uint32_t ZIP64_EOCD_SIGNATURE = 0x0606'4b50;
+        constexpr uint32_t ZIP64_LOCATOR_SIGNATURE = 0x0706'4b50;
+        constexpr size_t EOCD_SIZE = 22;
+        constexpr size_t CENTRAL_HEADER_SIZE = 46;
+        constexpr size_t LOCAL_HEADER_SIZE = 30;
+
+        constexpr uint16_t METHOD_STORED = 0;
+        constexpr uint16_t METHOD_DEFLATE = 8;
+        constexpr uint16_t FLAG_ENCRYPTED = 1;
+        constexpr uint16_t FLAG_UTF8 = 1 << 11;
+
+        /// Entry data are read in pieces of this size; pieces of stored entries are written as they're read, to report
+        /// progress and check for cancellation.
+        constexpr size_t READ_PIECE_SIZE = 1 << 20;
+
+        uint64_t read_le(bytes data, size_t offset, size_t size) {
+            if (offset > data.size() || data.size() - offset < size) throw ArchiveError("Truncated zip archive.");
+            uint64_t n = 0;
+            for (size_t i = 0; i < size; i++) n |= (uint64_t) data[offset + i] << (8 * i);
+            return n;
+        }
+
+        uint16_t read_u16(bytes data, size_t offset) {
+            return (uint16_t) read_le(data, offset, 2);
+        }
+
+        uint32_t read_u32(bytes data, size_t offset) {
+            return (uint32_t) read_le(data, offset, 4);
+        }
+
+        uint64_t read_u64(bytes data, size_t offset) {
+            return read_le(data, offset, 8);
+        }
+
+        bytes subspan(bytes data, uint64_t offset, uint64_t size) {
+            if (offset > data.size() || data.size() - offset < size) throw ArchiveError("Truncated zip archive.");
+            return data.subspan((size_t) offset, (size_t) size);
+        }
+
+        // high half of code page 437, the default encoding of zip entry names
+        constexpr uint16_t CP437_HIGH[128] = {
+            0x00c7, 0x00fc, 0x00e9, 0x00e2, 0x00e4, 0x00e0, 0x00e5, 0x00e7, 0x00ea, 0x00eb, 0x00e8, 0x00ef, 0x00ee,
+            0x00ec, 0x00c4, 0x00c5, 0x00c9, 0x00e6, 0x00c6, 0x00f4, 0x00f6, 0x00f2, 0x00fb, 0x00f9, 0x00ff, 0x00d6,
+            0x00dc, 0x00a2, 0x00a3, 0x00a5, 0x20a7, 0x0192, 0x00e1, 0x00ed, 0x00f3, 0x00fa, 0x00f1, 0x00d1, 0x00aa,
+            0x00ba, 0x00bf, 0x2310, 0x00ac, 0x00bd, 0x00bc, 0x00a1, 0x00ab, 0x00bb, 0x2591, 0x2592, 0x2593, 0x2502,
+            0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255d, 0x255c, 0x255b, 0x2510, 0x2514,
+            0x2534, 0x252c, 0x251c, 0x2500, 0x253c, 0x255e, 0x255f, 0x255a, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550,
+            0x256c, 0x2567, 0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256b, 0x256a, 0x2518, 0x250c,
+            0x2588, 0x2584, 0x258c, 0x2590, 0x2580, 0x03b1, 0x00df, 0x0393, 0x03c0, 0x03a3, 0x03c3, 0x00b5, 0x03c4,
+            0x03a6, 0x0398, 0x03a9, 0x03b4, 0x221e, 0x03c6, 0x03b5, 0x2229, 0x2261, 0x00b1, 0x2265, 0x2264, 0x2320,
+            0x2321, 0x00f7, 0x2248, 0x00b0, 0x2219, 0x00b7, 0x221a, 0x207f, 0x00b2, 0x25a0, 0x00a0,
+        };
+
+        bool is_valid_utf8(bytes str) {
+            for (size_t i = 0; i < str.size();) {
+                auto c = str[i];
+                size_t len = c < 0x80 ? 1 : (c & 0xe0) == 0xc0 ? 2 : (c & 0xf0) == 0xe0 ? 3 : (c & 0xf8) == 0xf0 ? 4 : 0;
+                if (len == 0 || i + len > str.size()) return false;
+                for (size_t j = 1; j < len; j++) {
+                    if ((str[i + j] & 0xc0) != 0x80) return false;
+                }
+                i += len;
+            }
+            return true;
+        }
+
+        /// Names without the UTF-8 flag are officially CP437, but many tools write UTF-8 without setting the flag,
+        /// so valid UTF-8 is kept as-is.
+        std::string decode_name(bytes raw, bool utf8) {
+            if (utf8 || is_valid_utf8(raw)) return {raw.begin(), raw.end()};
+            std::string out;
+            for (auto c : raw) {
+                if (c < 0x80) {
+                    out += (char) c;
+                    continue;
+                }
+                uint16_t cp = CP437_HIGH[c - 0x80];
+                if (cp < 0x800) {
+                    out += (char) (0xc0 | cp >> 6);
+                } else {
+                    out += (char) (0xe0 | cp >> 12);
+                    out += (char) (0x80 | (cp >> 6 & 0x3f));
+                }
+                out += (char) (0x80 | (cp & 0x3f));
+            }
+            return out;
+        }
+
+        /// DOS date and time are in local time, like 7zip, we convert them using the current time zone.
+        uint64_t dos_time_to_filetime(uint16_t time, uint16_t date) {
+            std::tm tm{};
+            tm.tm_sec = (time & 0x1f) * 2;
+            tm.tm_min = time >> 5 & 0x3f;
+            tm.tm_hour = time >> 11;
+            tm.tm_mday = date & 0x1f;
+            tm.tm_mon = (date >> 5 & 0x0f) - 1;
+            tm.tm_year = (date >> 9) + 80;
+            tm.tm_isdst = -1;
+            auto t = std::mktime(&tm);
+            return t == -1 ? 0 : unix_time_to_filetime(t);
+        }
+
+        struct ZipEntry {
+            std::string path;
+            bool directory = false;
+            uint16_t method = 0;
+            uint32_t crc = 0;
+            uint64_t compressed_size = 0;
+            uint64_t size = 0;
+            uint64_t local_header_offset = 0;
+            /// FILETIME, 0 if unknown
+            uint64_t last_write_time = 0;
+        };
+
+        /// Parses the extra fields of a central directory header into `entry`.
+        void read_extra_fields(bytes extra, bytes raw_name, uint32_t size32, uint32_t compressed_size32,
+                               uint32_t offset32, ZipEntry& entry) {
+            for (size_t pos = 0; pos + 4 <= extra.size();) {
+                auto id = read_u16(extra, pos);
+                auto field = subspan(extra, pos + 4, read_u16(extra, pos + 2));
+                pos += 4 + field.size();
+
+                if (id == 0x0001) {
+                    // zip64: 64-bit values of the fields set to 0xffffffff, in this order
+                    size_t offset = 0;
+                    if (size32 == 0xffff'ffff) entry.size = read_u64(field, (offset += 8) - 8);
+                    if (compressed_size32 == 0xffff'ffff) entry.compressed_size = read_u64(field, (offset += 8) - 8);
+                    if (offset32 == 0xffff'ffff) entry.local_header_offset = read_u64(field, offset);
+                } else if (id == 0x000a && field.size() >= 32 && read_u16(field, 4) == 1 && read_u16(field, 6) >= 24) {
+                    // NTFS times, the most precise
+                    entry.last_write_time = read_u64(field, 8);
+                } else if (id == 0x5455 && field.size() >= 5 && (field[0] & 1) && entry.last_write_time == 0) {
+                    // extended timestamp, Unix time in UTC
+                    entry.last_write_time = unix_time_to_filetime((int32_t) read_u32(field, 1));
+                } else if (id == 0x7075 && field.size() >= 5 && field[0] == 1
+                           && read_u32(field, 1) == crc32(raw_name)) {
+                    // Info-ZIP Unicode path, only valid if the name was not changed since it was written
+                    entry.path = std::string{field.begin() + 5, field.end()};
+                }
+            }
+        }
+
+        /// Returns `size` bytes of the input at `offset`, either pointing into the input if it's in memory,
+        /// or read into `buffer`.
+        bytes read_input(const ArchiveInput& input, uint64_t offset, uint64_t size, std::vector<uint8_t>& buffer) {
+            if (offset > input.size() || input.size() - offset < size) throw ArchiveError("Truncated zip archive.");
+            if (auto all = input.contiguous(); all.size() == input.size()) {
+                return all.subspan((size_t) offset, (size_t) size);
+            }
+            buffer.resize((size_t) size);
+            input.read_at(offset, buffer);
+            return buffer;
+        }
+
+        std::vector<ZipEntry> read_central_directory(const ArchiveInput& input) {
+            // the end of central directory record is followed by a comment of up to 64 KiB
+            if (input.size() < EOCD_SIZE) throw ArchiveError("Truncated zip archive.");
+            auto tail_offset = input.size() > EOCD_SIZE + 0xffff ? input.size() - EOCD_SIZE - 0xffff : 0;
+            std::vector<uint8_t> tail_buffer;
+            auto tail = read_input(input, tail_offset, input.size() - tail_offset, tail_buffer);
+            std::optional<size_t> eocd;
+            for (auto offset = tail.size() - EOCD_SIZE + 1; offset-- > 0;) {
+                if (read_u32(tail, offset) == EOCD_SIGNATURE
+                    && offset + EOCD_SIZE + read_u16(tail, offset + 20) == tail.size()) {
+                    eocd = offset;
+                    break;
+                }
+            }
+            if (!eocd) throw ArchiveError("Invalid zip archive, missing the end of central directory record.");
+
+            uint64_t entry_count = read_u16(tail, *eocd + 10);
+            uint64_t cd_size = read_u32(tail, *eocd + 12);
+            uint64_t cd_offset = read_u32(tail, *eocd + 16);
+            auto eocd_offset = tail_offset + *eocd;
+            if (eocd_offset >= 20) {
+                std::vector<uint8_t> record_buffer;
+                auto locator = read_input(input, eocd_offset - 20, 20, record_buffer);
+                if (read_u32(locator, 0) == ZIP64_LOCATOR_SIGNATURE) {
+                    auto zip64_eocd_offset = read_u64(locator, 8);
+                    auto zip64_eocd = read_input(input, zip64_eocd_offset, 56, record_buffer);
+                    if (read_u32(zip64_eocd, 0) != ZIP64_EOCD_SIGNATURE) {
+                        throw ArchiveError("Invalid zip64 end of central directory record.");
+                    }
+                    entry_count = read_u64(zip64_eocd, 32);
+                    cd_size = read_u64(zip64_eocd, 40);
+                    cd_offset = read_u64(zip64_eocd, 48);
+                }
+            }
+
+            std::vector<uint8_t> cd_buffer;
+            auto cd = read_input(input, cd_offset, cd_size, cd_buffer);
+            std::vector<ZipEntry> entries;
+            entries.reserve((size_t) std::min<uint64_t>(entry_count, cd_size / CENTRAL_HEADER_SIZE));
+            size_t pos = 0;
+            for (uint64_t i = 0; i < entry_count; i++) {
+                if (read_u32(cd, pos) != CENTRAL_HEADER_SIGNATURE) {
+                    throw ArchiveError("Invalid zip central directory header.");
+                }
+                auto host = cd[pos + 5];
+                auto flags = read_u16(cd, pos + 8);
+                auto name_size = read_u16(cd, pos + 28);
+                auto extra_size = read_u16(cd, pos + 30);
+                auto comment_size = read_u16(cd, pos + 32);
+                auto external_attributes = read_u32(cd, pos + 38);
+                auto raw_name = subspan(cd, pos + CENTRAL_HEADER_SIZE, name_size);
+
+                ZipEntry entry{
+                    .path = decode_name(raw_name, flags & FLAG_UTF8),
+                    .method = read_u16(cd, pos + 10),
+                    .crc = read_u32(cd, pos + 16),
+                    .compressed_size = read_u32(cd, pos + 20),
+                    .size = read_u32(cd, pos + 24),
+                    .local_header_offset = read_u32(cd, pos + 42),
+                };
+                read_extra_fields(subspan(cd, pos + CENTRAL_HEADER_SIZE + name_size, extra_size), raw_name,
+                                  (uint32_t) entry.size, (uint32_t) entry.compressed_size,
+                                  (uint32_t) entry.local_header_offset, entry);
+                if (entry.last_write_time == 0) {
+                    entry.last_write_time = dos_time_to_filetime(read_u16(cd, pos + 12), read_u16(cd, pos + 14));
+                }
+                auto dos_directory = (host == 0 || host == 10 || host == 14) && (external_attributes & 0x10);
+                entry.directory = entry.path.ends_with('/') || entry.path.ends_with('\\') || dos_directory;
+                if (flags & FLAG_ENCRYPTED) {
+                    throw UnsupportedArchiveError("Encrypted zip archives are not supported.");
+                }
+
+                entries.push_back(std::move(entry));
+                pos += CENTRAL_HEADER_SIZE + name_size + extra_size + comment_size;
+            }
+            return entries;
+        }
+
+        void extract_entry(const ArchiveInput& archive, const ZipEntry& entry, const std::filesystem::path& path,
+                           Inflater& inflater, std::atomic<uint64_t>& processed, const std::atomic<bool>& stop) {
+            std::vector<uint8_t> buffer;
+            auto local = entry.local_header_offset;
+            auto header = read_input(archive, local, LOCAL_HEADER_SIZE, buffer);
+            if (read_u32(header, 0) != LOCAL_HEADER_SIGNATURE) {
+                throw ArchiveError("Invalid zip local header of '" + entry.path + "'.");
+            }
+            auto data_offset = local + LOCAL_HEADER_SIZE + read_u16(header, 26) + read_u16(header, 28);
+            if (data_offset > archive.size() || archive.size() - data_offset < entry.compressed_size) {
+                throw ArchiveError("Truncated zip archive.");
+            }
+            // the compressed data are read in pieces, without copying if the archive is memory-mapped
+            auto data_pos = data_offset;
+            auto data_end = data_offset + entry.compressed_size;
+            auto next_piece = [&]() -> bytes {
+                auto size = std::min<uint64_t>(READ_PIECE_SIZE, data_end - data_pos);
+                auto piece = read_input(archive, data_pos, size, buffer);
+                data_pos += size;
+                return piece;
+            };
+
+            OutputFile file{path.c_str()};
+            uint32_t crc = 0;
+            uint64_t size = 0;
+            auto write = [&](bytes piece) {
+                if (stop) throw OperationCancelled();
+                file.write(piece);
+                crc = crc32(piece, crc);
+                size += piece.size();
+                processed += piece.size();
+            };
+
+            if (entry.method == METHOD_STORED) {
+                while (data_pos < data_end) write(next_piece());
+            } else {
+                BitReader reader{next_piece};
+                inflater.inflate(reader, write);
+            }
+
+            if (size != entry.size || crc != entry.crc) {
+                throw ArchiveError("Corrupted zip entry '" + entry.path + "', the checksum does not match.");
+            }
+            if (entry.last_write_time) file.set_last_write_time(entry.last_write_time);
+        }
+    }
+
+    void extract_zip(const ArchiveInput& archive, const std::filesystem::path& target_dir,
+                     const ExtractOptions& options) {
+        auto entries = read_central_directory(archive);
+
+        // select the entries; for duplicate paths, the last entry wins (like `7z -aoa`)
+        std::unordered_map<std::string, size_t> selected_by_path;
+        for (size_t i = 0; i < entries.size(); i++) {
+            entries[i].path = normalize_entry_path(entries[i].path);
+            if (entries[i].path.empty() || !options.filter.matches(entries[i].path)) continue;
+            auto key = entries[i].path;
+            for (auto& c : key) c = (char) tolower((unsigned char) c);
+            selected_by_path[key] = i;
+        }
+
+        std::set<std::string> directories;
+        std::vector<const ZipEntry*> files;
+        uint64_t total_size = 0;
+        for (auto& [_, i] : selected_by_path) {
+            auto& entry = entries[i];
+            if (entry.directory) {
+                directories.insert(entry.path);
+                continue;
+            }
+            if (entry.method != METHOD_STORED && entry.method != METHOD_DEFLATE) {
+                throw UnsupportedArchiveError("Unsupported zip compression method " + std::to_string(entry.method)
+                                              + " of '" + entry.path + "'.");
+            }
+            if (auto slash = entry.path.rfind('/'); slash != std::string::npos) {
+                directories.insert(entry.path.substr(0, slash));
+            }
+            files.push_back(&entry);
+            total_size += entry.size;
+        }
+
+        // create all directories upfront, so that the workers do not race on them
+        for (auto& dir : directories) {
+            std::error_code ec;
+            std::filesystem::create_directories(entry_output_path(target_dir, dir), ec);
+            if (ec) throw IoError("Could not create directory '" + dir + "'.", ec.value());
+        }
+
+        // start with the largest entries, so that a single large entry does not run alone at the end
+        std::sort(files.begin(), files.end(), [](auto a, auto b) { return a->size > b->size; });
+
+        std::atomic<size_t> next_file{0};
+        std::atomic<uint64_t> processed{0};
+        std::atomic<bool> stop{false};
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        auto worker = [&] {
+            Inflater inflater;
+            while (!stop) {
+                auto i = next_file++;
+                if (i >= files.size()) break;
+                try {
+                    extract_entry(archive, *files[i], entry_output_path(target_dir, files[i]->path), inflater,
+                                  processed, stop);
+                } catch (...) {
+                    std::lock_guard lock{error_mutex};
+                    if (!error) error = std::current_exception();
+                    stop = true;
+                }
+            }
+        };
+
+        auto thread_count = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+        thread_count = (unsigned) std::min<size_t>({thread_count, 16, std::max<size_t>(files.size(), 1)});
+        std::vector<std::future<void>> workers;
+        for (unsigned i = 0; i < thread_count; i++) workers.push_back(std::async(std::launch::async, worker));
+
+        // progress is reported from the calling thread, the callback may not be thread-safe
+        auto cancelled = false;
+        for (auto& w : workers) {
+            do {
+                if (options.progress && !cancelled && !options.progress(processed, total_size)) {
+                    cancelled = true;
+                    stop = true;
+                }
+            } while (w.wait_for(std::chrono::milliseconds(100)) == std::future_status::timeout);
+        }
+        if (cancelled) throw OperationCancelled();
+        if (error) std::rethrow_exception(error);
+        if (options.progress) options.progress(total_size, total_size);
+    }
+}
@@ -0,0 +1,545 @@
+#include "CacheIndex.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace cache {
+    namespace {
+        constexpr char MAGIC[8] = {'P', 'O', 'G', 'C', 'I', 'D', 'X', '1'};
+        constexpr std::string_view FILE_PREFIX = "cache-index.";
+        constexpr std::string_view TMP_INFIX = ".tmp-";
+        constexpr size_t HEADER_SIZE = 4096;
+        constexpr uint32_t MIN_SLOT_COUNT = 64;
+
+        /// A compaction that did not finish in this time is assumed to be abandoned by a crashed process.
+        constexpr uint64_t STALE_COMPACTION_MS = 2000;
+        /// Compaction waits at most this long for the writers that started before the file was sealed; a crashed
+        /// writer never finishes.
+        constexpr auto WRITER_DRAIN_TIMEOUT = std::chrono::seconds(1);
+        /// Temporary files of crashed compactions are deleted after this time.
+        constexpr auto STALE_TMP_FILE = std::chrono::minutes(1);
+
+        enum : uint32_t {
+            FILE_OPEN = 0,
+            /// A compaction is running, writers must wait for the next generation.
+            FILE_SEALED = 1,
+            /// The next generation exists, all processes should switch to it.
+            FILE_SUPERSEDED = 2,
+        };
+
+        enum : uint32_t {
+            /// Reserved by a writer that did not finish adding it (possibly because it crashed).
+            RECORD_UNUSED = 0,
+            RECORD_LIVE = 1,
+            RECORD_DELETED = 2,
+        };
+
+        struct Header {
+            char magic[8];
+            uint64_t generation;
+            uint32_t record_capacity;
+            /// Power of two, at least 2x `record_capacity`, so that probing always finds an empty slot.
+            uint32_t slot_count;
+            uint32_t package_capacity;
+            // the fields below are only accessed atomically
+            uint32_t state;
+            uint32_t record_count;
+            uint32_t package_count;
+            uint32_t live_count;
+            uint32_t active_writers;
+            /// Unix time in milliseconds.
+            uint64_t sealed_at;
+        };
+        static_assert(sizeof(Header) <= HEADER_SIZE);
+
+        struct Record {
+            uint32_t state;
+            uint32_t readers;
+            /// Head of the list of referencing packages, index + 1, 0 if empty.
+            uint32_t packages;
+            uint8_t key_size;
+            uint8_t file_name_size;
+            uint16_t padding;
+            uint64_t key_hash;
+            uint64_t size;
+            uint64_t last_access;
+            char key[MAX_KEY_SIZE];
+            char file_name[MAX_FILE_NAME_SIZE];
+        };
+        static_assert(sizeof(Record) == 256);
+
+        struct PackageRecord {
+            /// Next (older) package of the same entry, index + 1, 0 at the end.
+            uint32_t next;
+            uint16_t size;
+            uint16_t padding;
+            char data[MAX_PACKAGE_SIZE];
+        };
+        static_assert(sizeof(PackageRecord) == 128);
+
+        template<typename T>
+        std::atomic_ref<T> atomic(T& value) {
+            return std::atomic_ref<T>(value);
+        }
+
+        struct Layout {
+            size_t slots, records, packages, size;
+
+            Layout(uint32_t record_capacity, uint32_t slot_count, uint32_t package_capacity)
+                    : slots{HEADER_SIZE}, records{slots + (size_t) slot_count * sizeof(uint32_t)},
+                      packages{records + (size_t) record_capacity * sizeof(Record)},
+                      size{packages + (size_t) package_capacity * sizeof(PackageRecord)} {}
+        };
+
+        uint64_t hash_key(std::string_view key) {
+            // FNV-1a; the keys are already hashes, this only has to spread shorter non-hash keys
+            uint64_t hash = 0xcbf29ce484222325;
+            for (auto c : key) {
+                hash = (hash ^ (uint8_t) c) * 0x100000001b3;
+            }
+            return hash;
+        }
+
+        uint64_t now_ms() {
+            using namespace std::chrono;
+            return (uint64_t) duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+        }
+
+        uint64_t now_filetime() {
+            // 100 ns intervals between 1601-01-01 (FILETIME epoch) and 1970-01-01 (Unix epoch)
+            constexpr uint64_t EPOCH_DIFFERENCE = 116444736000000000;
+            using namespace std::chrono;
+            auto since_epoch = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+            return EPOCH_DIFFERENCE + (uint64_t) since_epoch / 100;
+        }
+
+        /// Thrown when an index file is not valid, it's deleted and recreated.
+        struct CorruptedIndex {};
+
+        std::optional<uint64_t> parse_generation(const std::string& file_name) {
+            if (!file_name.starts_with(FILE_PREFIX) || file_name.size() == FILE_PREFIX.size()) return std::nullopt;
+            uint64_t generation = 0;
+            for (auto c : std::string_view{file_name}.substr(FILE_PREFIX.size())) {
+                if (c < '0' || c > '9') return std::nullopt;
+                generation = generation * 10 + (uint64_t) (c - '0');
+            }
+            return generation;
+        }
+    }
+
+    struct CacheIndex::Mapping {
+        fs::path path;
+        SharedMapping file;
+        Header* header;
+        uint32_t* slots;
+        Record* records;
+        PackageRecord* packages;
+
+        explicit Mapping(fs::path path_) : path{std::move(path_)}, file{path.c_str()} {
+            auto data = file.data();
+            if (data.size() < HEADER_SIZE) throw CorruptedIndex{};
+            header = (Header*) data.data();
+            if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->record_capacity == 0
+                || header->slot_count < 2 * (uint64_t) header->record_capacity || !std::has_single_bit(header->slot_count)
+                || atomic(header->state).load() > FILE_SUPERSEDED) {
+                throw CorruptedIndex{};
+            }
+            Layout layout{header->record_capacity, header->slot_count, header->package_capacity};
+            if (layout.size != data.size()) throw CorruptedIndex{};
+            slots = (uint32_t*) (data.data() + layout.slots);
+            records = (Record*) (data.data() + layout.records);
+            packages = (PackageRecord*) (data.data() + layout.packages);
+        }
+
+        [[nodiscard]] uint32_t state() const {
+            return atomic(header->state).load();
+        }
+
+        /// Returns the record for slot value `value`, nullptr if the slot is corrupted.
+        [[nodiscard]] Record* record(uint32_t value) const {
+            return value == 0 || value > header->record_capacity ? nullptr : &records[value - 1];
+        }
+
+        [[nodiscard]] Record* find(std::string_view key, uint64_t hash) const {
+            auto mask = header->slot_count - 1;
+            for (uint32_t i = (uint32_t) hash & mask, n = 0; n < header->slot_count; i = (i + 1) & mask, n++) {
+                auto value = atomic(slots[i]).load(std::memory_order_acquire);
+                if (value == 0) return nullptr;
+                auto r = record(value);
+                if (r && matches(*r, key, hash) && atomic(r->state).load(std::memory_order_acquire) == RECORD_LIVE) {
+                    return r;
+                }
+            }
+            return nullptr;
+        }
+
+        static bool matches(const Record& r, std::string_view key, uint64_t hash) {
+            return r.key_hash == hash && r.key_size == key.size() && memcmp(r.key, key.data(), key.size()) == 0;
+        }
+
+        /// Calls `fn` with each package of `r`, newest first, until it returns true.
+        template<typename Fn>
+        bool any_package(const Record& r, Fn&& fn) const {
+            auto next = atomic(const_cast<uint32_t&>(r.packages)).load(std::memory_order_acquire);
+            // the bound protects against cycles in a corrupted file
+            for (uint32_t n = 0; next != 0 && next <= header->package_capacity && n < header->package_capacity; n++) {
+                auto& p = packages[next - 1];
+                if (fn(std::string_view{p.data, std::min<size_t>(p.size, MAX_PACKAGE_SIZE)})) return true;
+                next = p.next;
+            }
+            return false;
+        }
+
+        /// Returns false if the package area is full.
+        bool push_package(Record& r, std::string_view package) {
+            if (package.size() > MAX_PACKAGE_SIZE) return true;
+            auto index = atomic(header->package_count).fetch_add(1);
+            if (index >= header->package_capacity) return false;
+            auto& p = packages[index];
+            memcpy(p.data, package.data(), package.size());
+            p.size = (uint16_t) package.size();
+
+            auto head = atomic(r.packages);
+            auto next = head.load();
+            do {
+                p.next = next;
+            } while (!head.compare_exchange_weak(next, index + 1, std::memory_order_release, std::memory_order_relaxed));
+            return true;
+        }
+
+        enum class InsertResult { ADDED, EXISTS, FULL };
+
+        InsertResult insert(const CacheEntry& entry, uint64_t hash) {
+            if (find(entry.key, hash)) return InsertResult::EXISTS;
+            auto index = atomic(header->record_count).fetch_add(1);
+            if (index >= header->record_capacity) return InsertResult::FULL;
+
+            // the record is not visible to other processes until it's linked from a slot below
+            auto& r = records[index];
+            r.key_hash = hash;
+            r.key_size = (uint8_t) entry.key.size();
+            memcpy(r.key, entry.key.data(), entry.key.size());
+            if (entry.file_name.size() <= MAX_FILE_NAME_SIZE) {
+                r.file_name_size = (uint8_t) entry.file_name.size();
+                memcpy(r.file_name, entry.file_name.data(), entry.file_name.size());
+            }
+            r.size = entry.size;
+            r.last_access = entry.last_access;
+            r.readers = entry.readers;
+            // oldest first, so that the newest package ends up at the head of the list
+            for (auto& package : entry.packages) {
+                if (!push_package(r, package)) return InsertResult::FULL;
+            }
+            atomic(r.state).store(RECORD_LIVE, std::memory_order_release);
+
+            auto mask = header->slot_count - 1;
+            for (uint32_t i = (uint32_t) hash & mask, n = 0; n < header->slot_count; i = (i + 1) & mask, n++) {
+                uint32_t value = 0;
+                if (atomic(slots[i]).compare_exchange_strong(value, index + 1, std::memory_order_acq_rel)) {
+                    atomic(header->live_count).fetch_add(1);
+                    return InsertResult::ADDED;
+                }
+                // another writer may have added the same key since the lookup above
+                auto other = record(value);
+                if (other && matches(*other, entry.key, hash)
+                    && atomic(other->state).load(std::memory_order_acquire) == RECORD_LIVE) {
+                    atomic(r.state).store(RECORD_DELETED);
+                    return InsertResult::EXISTS;
+                }
+            }
+            return InsertResult::FULL;
+        }
+
+        [[nodiscard]] CacheEntry read(const Record& r) const {
+            CacheEntry entry{
+                .key = {r.key, std::min<size_t>(r.key_size, MAX_KEY_SIZE)},
+                .file_name = {r.file_name, std::min<size_t>(r.file_name_size, MAX_FILE_NAME_SIZE)},
+                .size = r.size,
+                .last_access = atomic(const_cast<uint64_t&>(r.last_access)).load(),
+                .readers = atomic(const_cast<uint32_t&>(r.readers)).load(),
+            };
+            any_package(r, [&](std::string_view package) {
+                entry.packages.emplace_back(package);
+                return false;
+            });
+            std::reverse(entry.packages.begin(), entry.packages.end());
+            return entry;
+        }
+
+        /// Calls `fn` with each live record reachable from the hash table. Records that were reserved by a crashed
+        /// writer, but never linked, are skipped.
+        template<typename Fn>
+        void for_each_live(Fn&& fn) const {
+            for (uint32_t i = 0; i < header->slot_count; i++) {
+                auto r = record(atomic(slots[i]).load(std::memory_order_acquire));
+                if (r && atomic(r->state).load(std::memory_order_acquire) == RECORD_LIVE) fn(*r);
+            }
+        }
+    };
+
+    CacheIndex::CacheIndex(const path_char* cache_dir, IndexOptions options)
+            : dir_{cache_dir}, options_{options}, mapping_{open_latest()} {}
+
+    CacheIndex::~CacheIndex() = default;
+
+    std::shared_ptr<CacheIndex::Mapping> CacheIndex::current() {
+        std::lock_guard lock{mutex_};
+        if (mapping_->state() == FILE_SUPERSEDED) {
+            mapping_ = open_latest();
+        }
+        return mapping_;
+    }
+
+    std::shared_ptr<CacheIndex::Mapping> CacheIndex::open_latest() {
+        for (unsigned attempt = 0;; attempt++) {
+            std::optional<uint64_t> latest;
+            std::vector<std::pair<uint64_t, fs::path>> files;
+            auto now = fs::file_time_type::clock::now();
+            std::error_code list_error;
+            fs::directory_iterator listing{dir_, list_error};
+            if (list_error) throw IoError("Could not list the download cache directory.", list_error.value());
+            for (auto& item : listing) {
+                auto name = item.path().filename().string();
+                if (auto generation = parse_generation(name)) {
+                    files.emplace_back(*generation, item.path());
+                    latest = std::max(latest.value_or(0), *generation);
+                } else if (name.starts_with(FILE_PREFIX) && name.find(TMP_INFIX) != std::string::npos) {
+                    std::error_code ec;
+                    auto time = fs::last_write_time(item.path(), ec);
+                    if (!ec && now - time > STALE_TMP_FILE) fs::remove(item.path(), ec);
+                }
+            }
+
+            if (!latest) {
+                create_generation(1, nullptr);
+                continue;
+            }
+
+            auto path = dir_ / (std::string(FILE_PREFIX) + std::to_string(*latest));
+            std::shared_ptr<Mapping> mapping;
+            try {
+                mapping = std::make_shared<Mapping>(path);
+            } catch (const CorruptedIndex&) {
+                // the file is only linked into place once it's complete, so this is a disk corruption or an
+                //  incompatible version; the entries are added back as they're used
+                std::error_code ec;
+                if (!fs::remove(path, ec)) create_generation(*latest + 1, nullptr);
+                continue;
+            } catch (const IoError&) {
+                // deleted by another process in the meantime
+                if (attempt >= 10) throw;
+                continue;
+            }
+
+            if (mapping->state() == FILE_SUPERSEDED) {
+                // the compacting process linked the next generation, but it was deleted since then
+                create_generation(*latest + 1, mapping.get());
+                continue;
+            }
+
+            for (auto& [generation, old_path] : files) {
+                if (generation < *latest) {
+                    // fails on Windows while another process still has the file mapped, it's retried on the next open
+                    std::error_code ec;
+                    fs::remove(old_path, ec);
+                }
+            }
+            return mapping;
+        }
+    }
+
+    void CacheIndex::create_generation(uint64_t generation, const Mapping* source) {
+        std::vector<CacheEntry> entries;
+        size_t package_count = 0;
+        if (source) {
+            source->for_each_live([&](const Record& r) {
+                entries.push_back(source->read(r));
+                package_count += entries.back().packages.size();
+            });
+        }
+
+        // room for as many new entries as there are live ones, most entries are only used by a single package
+        auto record_capacity = std::max(options_.initial_capacity, (uint32_t) entries.size() * 2);
+        auto slot_count = std::max(MIN_SLOT_COUNT, std::bit_ceil(record_capacity * 2));
+        auto package_capacity = std::max(record_capacity, (uint32_t) package_count * 2);
+        Layout layout{record_capacity, slot_count, package_capacity};
+
+        auto name = std::string(FILE_PREFIX) + std::to_string(generation);
+        auto path = dir_ / name;
+        auto tmp_path = dir_ / (name + std::string(TMP_INFIX) + std::to_string(std::random_device{}()));
+        {
+            RandomAccessFile file{tmp_path.c_str()};
+            file.set_size(layout.size);
+        }
+        try {
+            {
+                SharedMapping file{tmp_path.c_str()};
+                auto& header = *(Header*) file.data().data();
+                memcpy(header.magic, MAGIC, sizeof(MAGIC));
+                header.generation = generation;
+                header.record_capacity = record_capacity;
+                header.slot_count = slot_count;
+                header.package_capacity = package_capacity;
+            }
+            Mapping mapping{tmp_path};
+            std::unordered_set<std::string_view> added;
+            for (auto& entry : entries) {
+                // a crashed writer could leave duplicates
+                if (added.insert(entry.key).second) mapping.insert(entry, hash_key(entry.key));
+            }
+            mapping.file.flush();
+        } catch (...) {
+            std::error_code ec;
+            fs::remove(tmp_path, ec);
+            throw;
+        }
+
+        // unlike a rename, a hard link fails if the target already exists, e.g. when another process compacted
+        //  the same generation concurrently
+        std::error_code link_error;
+        fs::create_hard_link(tmp_path, path, link_error);
+        std::error_code ec;
+        fs::remove(tmp_path, ec);
+        if (link_error && !fs::exists(path, ec)) {
+            throw IoError("Could not create the download cache index.", link_error.value());
+        }
+    }
+
+    template<typename Fn>
+    auto CacheIndex::write(Fn&& fn) {
+        while (true) {
+            auto mapping = current();
+            auto writers = atomic(mapping->header->active_writers);
+            writers.fetch_add(1);
+            if (mapping->state() != FILE_OPEN) {
+                writers.fetch_sub(1);
+                wait_for_compaction(mapping);
+                continue;
+            }
+
+            decltype(fn(*mapping)) result;
+            try {
+                result = fn(*mapping);
+            } catch (...) {
+                writers.fetch_sub(1);
+                throw;
+            }
+            writers.fetch_sub(1);
+
+            if (result) return *result;
+            compact(mapping);
+        }
+    }
+
+    void CacheIndex::wait_for_compaction(const std::shared_ptr<Mapping>& mapping) {
+        auto& header = *mapping->header;
+        while (true) {
+            auto state = mapping->state();
+            if (state == FILE_OPEN || state == FILE_SUPERSEDED) return;
+            if (now_ms() - atomic(header.sealed_at).load() > STALE_COMPACTION_MS) {
+                return compact(mapping);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void CacheIndex::compact() {
+        compact(current());
+    }
+
+    void CacheIndex::compact(const std::shared_ptr<Mapping>& mapping) {
+        auto& header = *mapping->header;
+        auto state = atomic(header.state);
+        uint32_t expected = FILE_OPEN;
+        if (!state.compare_exchange_strong(expected, FILE_SEALED)) {
+            // another process is already compacting; if it crashed, take over (if it did not, both link the same
+            //  generation, and only one of them succeeds)
+            if (expected != FILE_SEALED || now_ms() - atomic(header.sealed_at).load() <= STALE_COMPACTION_MS) return;
+        }
+        atomic(header.sealed_at).store(now_ms());
+
+        auto deadline = std::chrono::steady_clock::now() + WRITER_DRAIN_TIMEOUT;
+        while (atomic(header.active_writers).load() != 0 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+
+        create_generation(header.generation + 1, mapping.get());
+        state.store(FILE_SUPERSEDED);
+    }
+
+    uint64_t CacheIndex::generation() {
+        return current()->header->generation;
+    }
+
+    AcquireResult CacheIndex::acquire(std::string_view key, std::string_view package, std::string* file_name) {
+        auto hash = hash_key(key);
+        return write([&](Mapping& m) -> std::optional<AcquireResult> {
+            auto r = m.find(key, hash);
+            if (!r) return AcquireResult::MISS;
+            auto new_package = !package.empty() && !m.any_package(*r, [&](std::string_view p) { return p == package; });
+            // nothing is changed before this point, so that the call can be retried after the compaction
+            if (new_package && !m.push_package(*r, package)) return std::nullopt;
+
+            atomic(r->readers).fetch_add(1);
+            atomic(r->last_access).store(now_filetime());
+            if (file_name) file_name->assign(r->file_name, std::min<size_t>(r->file_name_size, MAX_FILE_NAME_SIZE));
+            return new_package ? AcquireResult::HIT_NEW_PACKAGE : AcquireResult::HIT;
+        });
+    }
+
+    void CacheIndex::release(std::string_view key) {
+        auto hash = hash_key(key);
+        write([&](Mapping& m) -> std::optional<bool> {
+            if (auto r = m.find(key, hash)) {
+                auto readers = atomic(r->readers);
+                auto count = readers.load();
+                // the count may have been reset by a compaction that timed out waiting for the acquiring writer
+                while (count > 0 && !readers.compare_exchange_weak(count, count - 1)) {}
+            }
+            return true;
+        });
+    }
+
+    bool CacheIndex::add(const CacheEntry& entry) {
+        if (entry.key.empty() || entry.key.size() > MAX_KEY_SIZE) return false;
+        auto hash = hash_key(entry.key);
+        return write([&](Mapping& m) -> std::optional<bool> {
+            switch (m.insert(entry, hash)) {
+                case Mapping::InsertResult::ADDED: return true;
+                case Mapping::InsertResult::EXISTS: return false;
+                case Mapping::InsertResult::FULL: return std::nullopt;
+            }
+            return false;
+        });
+    }
+
+    bool CacheIndex::remove(std::string_view key) {
+        auto hash = hash_key(key);
+        return write([&](Mapping& m) -> std::optional<bool> {
+            auto r = m.find(key, hash);
+            uint32_t expected = RECORD_LIVE;
+            if (!r || !atomic(r->state).compare_exchange_strong(expected, RECORD_DELETED)) return false;
+            atomic(m.header->live_count).fetch_sub(1);
+            return true;
+        });
+    }
+
+    std::optional<CacheEntry> CacheIndex::find(std::string_view key) {
+        auto mapping = current();
+        auto r = mapping->find(key, hash_key(key));
+        if (!r) return std::nullopt;
+        return mapping->read(*r);
+    }
+
+    void CacheIndex::for_each(const std::function<void(const CacheEntry&)>& fn) {
+        auto mapping = current();
+        mapping->for_each_live([&](const Record& r) { fn(mapping->read(r)); });
+    }
+}
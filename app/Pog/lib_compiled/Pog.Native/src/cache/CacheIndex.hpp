@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MappedFile.hpp"
+
+// Index of the download cache (`SharedFileCache` in Pog.dll), shared by all Pog processes through a memory-mapped file
+//  in the cache directory. The entry directories stay authoritative; the index lets the common operations (looking up
+//  an entry, recording which package used it, listing all entries) skip opening the entry directories and their
+//  metadata files. An entry missing from the index is looked up the slow way and added back.
+//
+// The index file (`cache-index.<generation>`) is an open-addressing hash table of entry records, keyed by the entry key
+//  (the SHA-256 hash of the entry). Records and the per-entry lists of referencing packages are append-only, and all
+//  updates are atomic operations on the mapped memory, so that lookups never take a lock and concurrent writers do not
+//  block each other. When the record area fills up, the live records are compacted into the next generation of
+//  the file, which is written under a temporary name and hard-linked into place once complete; a crash at any point
+//  leaves either the old or the new generation as a valid index.
+namespace cache {
+    /// Longer keys are not indexed.
+    constexpr size_t MAX_KEY_SIZE = 64;
+    /// Longer entry file names are stored as empty, and must be found by listing the entry directory.
+    constexpr size_t MAX_FILE_NAME_SIZE = 152;
+    /// Longer package metadata is not recorded in the index.
+    constexpr size_t MAX_PACKAGE_SIZE = 120;
+
+    struct CacheEntry {
+        std::string key;
+        /// Name of the entry file in the entry directory; may be empty if it's too long to be indexed.
+        std::string file_name;
+        uint64_t size = 0;
+        /// FILETIME of the last use of the entry.
+        uint64_t last_access = 0;
+        /// Number of `CacheIndex::acquire` calls without a matching `release`, over all processes. Only informational,
+        /// a crashed process never releases its entries.
+        uint32_t readers = 0;
+        /// Serialized metadata of the packages that used the entry (`SourcePackageMetadata` JSON), oldest first.
+        std::vector<std::string> packages{};
+    };
+
+    enum class AcquireResult {
+        MISS,
+        HIT,
+        /// The package was not recorded for this entry yet.
+        HIT_NEW_PACKAGE,
+    };
+
+    struct IndexOptions {
+        /// Number of records in a new index file; the file grows as needed when compacted.
+        uint32_t initial_capacity = 1024;
+    };
+
+    /// The index may be used from multiple threads and processes at once.
+    class CacheIndex {
+    private:
+        struct Mapping;
+
+        const std::filesystem::path dir_;
+        const IndexOptions options_;
+        std::mutex mutex_{};
+        std::shared_ptr<Mapping> mapping_{};
+
+    public:
+        /// Opens the newest index file in `cache_dir`, or creates an empty one. Throws `IoError`.
+        explicit CacheIndex(const path_char* cache_dir, IndexOptions options = {});
+        ~CacheIndex();
+
+        CacheIndex(const CacheIndex&) = delete;
+        CacheIndex& operator=(const CacheIndex&) = delete;
+
+        /// Looks up the entry, increments its reader count, updates its last access time and records `package`
+        /// (unless empty) as one of the packages that used it. The entry file name is stored in `file_name`.
+        AcquireResult acquire(std::string_view key, std::string_view package, std::string* file_name = nullptr);
+        /// Decrements the reader count of the entry, if it's still indexed.
+        void release(std::string_view key);
+        /// Adds a new entry; returns false if an entry with the same key is already indexed, or the key is too long.
+        bool add(const CacheEntry& entry);
+        /// Returns false if the entry was not indexed.
+        bool remove(std::string_view key);
+        /// Looks up the entry without updating it.
+        std::optional<CacheEntry> find(std::string_view key);
+        /// Calls `fn` for each indexed entry, in no particular order.
+        void for_each(const std::function<void(const CacheEntry&)>& fn);
+
+        /// Moves the live entries into a new generation of the index file. Called automatically when the index is full.
+        void compact();
+        /// Generation of the currently open index file.
+        uint64_t generation();
+
+    private:
+        std::shared_ptr<Mapping> current();
+        std::shared_ptr<Mapping> open_latest();
+        void compact(const std::shared_ptr<Mapping>& mapping);
+        void wait_for_compaction(const std::shared_ptr<Mapping>& mapping);
+        void create_generation(uint64_t generation, const Mapping* source);
+        /// Runs `fn(mapping)` as a writer of the current index file, after waiting for a running compaction. If `fn`
+        /// returns nullopt (the index is full), the index is compacted and `fn` is retried.
+        template<typename Fn>
+        auto write(Fn&& fn);
+    };
+}
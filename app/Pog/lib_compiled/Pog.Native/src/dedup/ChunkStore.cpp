@@ -0,0 +1,264 @@
+#include "ChunkStore.hpp"
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace dedup {
+    namespace {
+        // chunk list file: magic, file size (u64), chunk count (u32), reserved (u32), then the hash and size (u32)
+        //  of each chunk; all numbers are little-endian
+        constexpr char MAGIC[8] = {'P', 'O', 'G', 'C', 'H', 'N', 'K', '1'};
+        constexpr size_t HEADER_SIZE = 24;
+        constexpr size_t CHUNK_REF_SIZE = 36;
+
+        constexpr std::string_view TMP_INFIX = ".tmp-";
+        /// Input is read and chunked in pieces of this size, must be larger than `ChunkerParams::max_size`.
+        constexpr size_t READ_BUFFER_SIZE = 8 << 20;
+
+        void put_le(std::vector<uint8_t>& out, uint64_t value, size_t size) {
+            for (size_t i = 0; i < size; i++) out.push_back((uint8_t) (value >> (8 * i)));
+        }
+
+        uint64_t get_le(const uint8_t* p, size_t size) {
+            uint64_t value = 0;
+            for (size_t i = 0; i < size; i++) value |= (uint64_t) p[i] << (8 * i);
+            return value;
+        }
+
+        std::string to_hex(const Sha256::Digest& hash) {
+            constexpr char DIGITS[] = "0123456789abcdef";
+            std::string hex;
+            for (auto b : hash) {
+                hex += DIGITS[b >> 4];
+                hex += DIGITS[b & 0xf];
+            }
+            return hex;
+        }
+
+        fs::path chunk_file_path(const fs::path& store_dir, const Sha256::Digest& hash) {
+            auto hex = to_hex(hash);
+            return store_dir / hex.substr(0, 2) / hex;
+        }
+
+        std::vector<uint8_t> serialize(const ChunkList& list) {
+            std::vector<uint8_t> out(MAGIC, MAGIC + sizeof(MAGIC));
+            put_le(out, list.size, 8);
+            put_le(out, list.chunks.size(), 4);
+            put_le(out, 0, 4);
+            for (auto& chunk : list.chunks) {
+                out.insert(out.end(), chunk.hash.begin(), chunk.hash.end());
+                put_le(out, chunk.size, 4);
+            }
+            return out;
+        }
+
+        /// Maps the chunk and checks its size; chunks are not re-hashed on read, like whole cache entries.
+        std::shared_ptr<const MappedFile> map_chunk(const fs::path& path, uint32_t expected_size) {
+            auto chunk = std::make_shared<const MappedFile>(path.c_str());
+            if (chunk->data().size() != expected_size) {
+                throw IoError("Corrupted chunk in the download cache chunk store, the size does not match.", 0);
+            }
+            return chunk;
+        }
+    }
+
+    ChunkList read_chunk_list(const path_char* path) {
+        InputFile file{path};
+        std::vector<uint8_t> data(file.size());
+        if (file.read(data) != data.size() || data.size() < HEADER_SIZE || memcmp(data.data(), MAGIC, sizeof(MAGIC))) {
+            throw IoError("Invalid chunk list file.", 0);
+        }
+        ChunkList list{.size = get_le(&data[8], 8)};
+        auto count = get_le(&data[16], 4);
+        if (data.size() != HEADER_SIZE + count * CHUNK_REF_SIZE) throw IoError("Invalid chunk list file.", 0);
+
+        uint64_t total = 0;
+        list.chunks.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            auto p = &data[HEADER_SIZE + i * CHUNK_REF_SIZE];
+            memcpy(list.chunks[i].hash.data(), p, 32);
+            list.chunks[i].size = (uint32_t) get_le(p + 32, 4);
+            if (list.chunks[i].size == 0) throw IoError("Invalid chunk list file.", 0);
+            total += list.chunks[i].size;
+        }
+        if (total != list.size) throw IoError("Invalid chunk list file.", 0);
+        return list;
+    }
+
+    ChunkStore::ChunkStore(const path_char* store_dir, ChunkerParams params) : dir_{store_dir}, params_{params} {
+        std::error_code ec;
+        fs::create_directories(dir_, ec);
+        if (ec) throw IoError("Could not create the chunk store directory.", ec.value());
+    }
+
+    fs::path ChunkStore::chunk_path(const Sha256::Digest& hash) const {
+        return chunk_file_path(dir_, hash);
+    }
+
+    bool ChunkStore::store_chunk(const Sha256::Digest& hash, std::span<const uint8_t> data) {
+        auto path = chunk_path(hash);
+        std::error_code ec;
+        if (fs::exists(path, ec)) {
+            // mark the chunk as used, so that a concurrent garbage collection does not delete it before the chunk
+            //  list is written; best effort, the chunk may be open by a reader
+            fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+            return false;
+        }
+
+        fs::create_directories(path.parent_path(), ec);
+        if (ec) throw IoError("Could not create the chunk store directory.", ec.value());
+        auto tmp_path = path;
+        tmp_path += std::string(TMP_INFIX) + std::to_string(std::random_device{}());
+        write_file(tmp_path.c_str(), data);
+        // the chunk may have been added concurrently, in which case either copy is fine
+        fs::rename(tmp_path, path, ec);
+        if (ec) {
+            std::error_code remove_error;
+            fs::remove(tmp_path, remove_error);
+            if (!fs::exists(path, remove_error)) throw IoError("Could not add a chunk to the chunk store.", ec.value());
+            return false;
+        }
+        return true;
+    }
+
+    StoreStats ChunkStore::add_file(const path_char* file_path, const path_char* chunk_list_path,
+                                    const ProgressCallback& progress) {
+        InputFile file{file_path};
+        StoreStats stats{};
+        ChunkList list{};
+        std::vector<uint8_t> buffer(READ_BUFFER_SIZE);
+        std::vector<size_t> cuts;
+        size_t buffered = 0;
+        auto eof = false;
+        while (!eof || buffered > 0) {
+            if (progress && !progress(stats.size, file.size())) throw OperationCancelled();
+            if (!eof) {
+                auto n = file.read({buffer.data() + buffered, buffer.size() - buffered});
+                eof = buffered + n < buffer.size();
+                buffered += n;
+                stats.size += n;
+            }
+
+            cuts.clear();
+            auto consumed = find_chunks({buffer.data(), buffered}, eof, params_, cuts);
+            size_t start = 0;
+            for (auto cut : cuts) {
+                auto chunk = std::span<const uint8_t>{buffer.data() + start, cut - start};
+                auto hash = Sha256::hash(chunk);
+                if (store_chunk(hash, chunk)) {
+                    stats.new_chunk_count++;
+                    stats.new_chunk_bytes += chunk.size();
+                }
+                list.chunks.push_back({hash, (uint32_t) chunk.size()});
+                start = cut;
+            }
+            // the unfinished chunk is continued by the next read
+            std::copy(buffer.begin() + (ptrdiff_t) consumed, buffer.begin() + (ptrdiff_t) buffered, buffer.begin());
+            buffered -= consumed;
+        }
+
+        list.size = stats.size;
+        stats.chunk_count = list.chunks.size();
+        write_file(chunk_list_path, serialize(list));
+        if (progress) progress(stats.size, stats.size);
+        return stats;
+    }
+
+    void ChunkStore::restore_file(const path_char* chunk_list_path, const path_char* target_path,
+                                  const ProgressCallback& progress) {
+        auto list = read_chunk_list(chunk_list_path);
+        OutputFile out{target_path};
+        uint64_t written = 0;
+        for (auto& ref : list.chunks) {
+            if (progress && !progress(written, list.size)) throw OperationCancelled();
+            auto chunk = map_chunk(chunk_path(ref.hash), ref.size);
+            out.write(chunk->data());
+            written += ref.size;
+        }
+        if (progress) progress(list.size, list.size);
+    }
+
+    CollectStats ChunkStore::collect_garbage(const std::vector<fs::path>& chunk_list_paths,
+                                             std::chrono::seconds min_age) {
+        // listed first, so that chunks written afterwards are too recent to be deleted
+        auto cutoff = fs::file_time_type::clock::now() - min_age;
+
+        std::unordered_set<std::string> referenced;
+        for (auto& path : chunk_list_paths) {
+            std::error_code ec;
+            try {
+                for (auto& ref : read_chunk_list(path.c_str()).chunks) referenced.insert(to_hex(ref.hash));
+            } catch (const IoError&) {
+                // the entry was deleted in the meantime
+                if (fs::exists(path, ec)) throw;
+            }
+        }
+
+        CollectStats stats{};
+        std::error_code ec;
+        for (auto& dir : fs::directory_iterator(dir_, ec)) {
+            std::error_code dir_ec;
+            if (!dir.is_directory(dir_ec)) continue;
+            for (auto& item : fs::directory_iterator(dir.path(), dir_ec)) {
+                auto name = item.path().filename().string();
+                auto is_tmp = name.find(TMP_INFIX) != std::string::npos;
+                if (!is_tmp && referenced.contains(name)) continue;
+
+                std::error_code item_ec;
+                auto time = item.last_write_time(item_ec);
+                if (item_ec || time > cutoff) continue;
+                auto size = item.file_size(item_ec);
+                if (item_ec) continue;
+                if (fs::remove(item.path(), item_ec)) {
+                    stats.deleted_chunk_count += is_tmp ? 0 : 1;
+                    stats.deleted_bytes += size;
+                }
+            }
+        }
+        if (ec) throw IoError("Could not list the chunk store directory.", ec.value());
+        return stats;
+    }
+
+    ChunkedFileReader::ChunkedFileReader(const path_char* store_dir, const path_char* chunk_list_path)
+            : store_dir_{store_dir}, list_{read_chunk_list(chunk_list_path)} {
+        offsets_.reserve(list_.chunks.size() + 1);
+        uint64_t offset = 0;
+        for (auto& ref : list_.chunks) {
+            offsets_.push_back(offset);
+            offset += ref.size;
+        }
+        offsets_.push_back(offset);
+    }
+
+    std::shared_ptr<const MappedFile> ChunkedFileReader::open_chunk(size_t index) const {
+        {
+            std::lock_guard lock{mutex_};
+            if (cached_index_ == index) return cached_chunk_;
+        }
+        auto chunk = map_chunk(chunk_file_path(store_dir_, list_.chunks[index].hash), list_.chunks[index].size);
+        std::lock_guard lock{mutex_};
+        cached_index_ = index;
+        cached_chunk_ = chunk;
+        return chunk;
+    }
+
+    void ChunkedFileReader::read_at(uint64_t offset, std::span<uint8_t> buffer) const {
+        if (offset > list_.size || list_.size - offset < buffer.size()) {
+            throw IoError("Read past the end of a deduplicated file.", 0);
+        }
+        if (buffer.empty()) return;
+        auto index = (size_t) (std::upper_bound(offsets_.begin(), offsets_.end(), offset) - offsets_.begin() - 1);
+        for (size_t done = 0; done < buffer.size(); index++) {
+            auto chunk = open_chunk(index)->data();
+            auto chunk_offset = (size_t) (offset + done - offsets_[index]);
+            auto n = std::min(buffer.size() - done, chunk.size() - chunk_offset);
+            memcpy(buffer.data() + done, chunk.data() + chunk_offset, n);
+            done += n;
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Chunker.hpp"
+#include "MappedFile.hpp"
+#include "Progress.hpp"
+#include "Sha256.hpp"
+#include "archive/Archive.hpp"
+
+// Deduplicated storage of download cache entries. Successive versions of the same package often share most of their
+//  content, so instead of storing each file in full, files are split into content-defined chunks (`Chunker.hpp`),
+//  which are stored once in a content-addressed directory (`<store>/<first 2 hex digits>/<SHA-256 of the chunk>`).
+//  The file itself is replaced by a chunk list (`<file name>.pogchunks`), from which it's reassembled on read.
+//
+// Chunks are written under a temporary name and renamed into place, so that concurrent writers of the same chunk do
+//  not conflict, and a chunk is never observed half-written. Chunks are not reference-counted; `collect_garbage`
+//  deletes the chunks that no chunk list references, except for recently written ones, which may belong to a file that
+//  is still being added.
+namespace dedup {
+    struct ChunkRef {
+        Sha256::Digest hash;
+        uint32_t size;
+    };
+
+    /// Contents of a chunk list file: the size of the stored file, and its chunks in order.
+    struct ChunkList {
+        uint64_t size = 0;
+        std::vector<ChunkRef> chunks{};
+    };
+
+    /// Reads a chunk list file. Throws `IoError` if it cannot be read or is invalid.
+    ChunkList read_chunk_list(const path_char* path);
+
+    struct StoreStats {
+        /// Size of the stored file.
+        uint64_t size = 0;
+        uint64_t chunk_count = 0;
+        /// Chunks that were not in the store before.
+        uint64_t new_chunk_count = 0;
+        uint64_t new_chunk_bytes = 0;
+    };
+
+    struct CollectStats {
+        uint64_t deleted_chunk_count = 0;
+        uint64_t deleted_bytes = 0;
+    };
+
+    class ChunkStore {
+    private:
+        const std::filesystem::path dir_;
+        const ChunkerParams params_;
+
+    public:
+        /// Opens the store at `store_dir`, creating the directory if it does not exist. Throws `IoError`.
+        explicit ChunkStore(const path_char* store_dir, ChunkerParams params = {});
+
+        /// Splits the file at `file_path` into chunks, adds the missing chunks to the store and writes the chunk list
+        /// to `chunk_list_path`. Throws `IoError` or `OperationCancelled`.
+        StoreStats add_file(const path_char* file_path, const path_char* chunk_list_path,
+                            const ProgressCallback& progress = {});
+        /// Reassembles the file described by the chunk list at `chunk_list_path` into `target_path`.
+        void restore_file(const path_char* chunk_list_path, const path_char* target_path,
+                          const ProgressCallback& progress = {});
+        /// Deletes the chunks that are not referenced by any of the chunk lists at `chunk_list_paths` and were
+        /// last written (or reused) more than `min_age` ago; missing chunk lists are skipped.
+        CollectStats collect_garbage(const std::vector<std::filesystem::path>& chunk_list_paths,
+                                     std::chrono::seconds min_age);
+
+        [[nodiscard]] std::filesystem::path chunk_path(const Sha256::Digest& hash) const;
+
+    private:
+        /// Returns true if the chunk was added, false if it was already stored.
+        bool store_chunk(const Sha256::Digest& hash, std::span<const uint8_t> data);
+    };
+
+    /// Reads a file stored in a `ChunkStore`, without reassembling it on disk. Sequential reads keep the current
+    /// chunk mapped; may be used from multiple threads at once.
+    class ChunkedFileReader : public archive::ArchiveInput {
+    private:
+        const std::filesystem::path store_dir_;
+        const ChunkList list_;
+        /// Start offset of each chunk, and the file size at the end.
+        std::vector<uint64_t> offsets_{};
+
+        mutable std::mutex mutex_{};
+        mutable size_t cached_index_ = SIZE_MAX;
+        mutable std::shared_ptr<const MappedFile> cached_chunk_{};
+
+    public:
+        ChunkedFileReader(const path_char* store_dir, const path_char* chunk_list_path);
+
+        [[nodiscard]] uint64_t size() const override {
+            return list_.size;
+        }
+
+        /// Throws `IoError` if a chunk is missing or has an unexpected size.
+        void read_at(uint64_t offset, std::span<uint8_t> buffer) const override;
+
+    private:
+        std::shared_ptr<const MappedFile> open_chunk(size_t index) const;
+    };
+}
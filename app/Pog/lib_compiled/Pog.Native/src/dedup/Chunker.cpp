@@ -0,0 +1,279 @@
+#include "Chunker.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define POG_CHUNKER_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define POG_TARGET_AVX2
+#define POG_TARGET_XSAVE
+#else
+#include <cpuid.h>
+#define POG_TARGET_AVX2 __attribute__((target("avx2")))
+#define POG_TARGET_XSAVE __attribute__((target("xsave")))
+#endif
+#endif
+
+namespace dedup {
+    namespace {
+        /// Random values for each byte value, generated by splitmix64 from a fixed seed.
+        constexpr std::array<uint32_t, 256> make_gear_table() {
+            std::array<uint32_t, 256> table{};
+            uint64_t x = 0x706f'672d'6364'6331; // "pog-cdc1"
+            for (auto& value : table) {
+                x += 0x9e37'79b9'7f4a'7c15;
+                auto z = x;
+                z = (z ^ (z >> 30)) * 0xbf58'476d'1ce4'e5b9;
+                z = (z ^ (z >> 27)) * 0x94d0'49bb'1331'11eb;
+                value = (uint32_t) ((z ^ (z >> 31)) >> 32);
+            }
+            return table;
+        }
+
+        alignas(64) constexpr auto GEAR = make_gear_table();
+
+        /// Bit `k` of the gear hash depends on the last `k + 1` bytes, so the masks use the highest bits. Normalized
+        /// chunking: before `avg_size`, a boundary needs 2 more matching bits than the average, and 2 fewer after it,
+        /// which narrows the distribution of chunk sizes. The easy mask is a subset of the hard one.
+        struct Masks {
+            uint32_t hard;
+            uint32_t easy;
+        };
+
+        Masks get_masks(const ChunkerParams& params) {
+            if (params.min_size < 64 || !std::has_single_bit(params.avg_size) || params.avg_size < params.min_size
+                || params.max_size < params.avg_size) {
+                throw std::invalid_argument("Invalid chunker parameters.");
+            }
+            auto bits = std::countr_zero(params.avg_size);
+            return {~0u << (32 - std::min(bits + 2, 32)), ~0u << (32 - std::max(bits - 2, 1))};
+        }
+
+        constexpr size_t NO_CUT = 0;
+
+        /// Returns the end of the chunk starting at `start`, or `NO_CUT` if more data are needed to find it.
+        /// The hash checked at boundary `i` covers the 32 bytes before `i`.
+        size_t next_cut_scalar(const uint8_t* data, size_t size, size_t start, bool last, const ChunkerParams& params,
+                               Masks masks) {
+            auto min_end = start + params.min_size;
+            if (min_end >= size) return last ? size : NO_CUT;
+
+            uint32_t h = 0;
+            for (auto i = min_end - 32; i < min_end; i++) h = (h << 1) + GEAR[data[i]];
+
+            auto i = min_end;
+            auto hard_end = std::min<size_t>(start + params.avg_size, size);
+            for (; i < hard_end; i++) {
+                if ((h & masks.hard) == 0) return i;
+                h = (h << 1) + GEAR[data[i]];
+            }
+            if (i == start + params.avg_size) {
+                auto easy_end = std::min<size_t>(start + params.max_size, size);
+                for (; i < easy_end; i++) {
+                    if ((h & masks.easy) == 0) return i;
+                    h = (h << 1) + GEAR[data[i]];
+                }
+                if (i == start + params.max_size) return i;
+            }
+            return last ? size : NO_CUT;
+        }
+
+        size_t find_chunks_scalar(std::span<const uint8_t> data, bool last, const ChunkerParams& params,
+                                  std::vector<size_t>& cuts) {
+            auto masks = get_masks(params);
+            size_t start = 0;
+            while (start < data.size()) {
+                auto cut = next_cut_scalar(data.data(), data.size(), start, last, params, masks);
+                if (cut == NO_CUT) break;
+                cuts.push_back(cut);
+                start = cut;
+            }
+            return start;
+        }
+
+        /// Bitmaps of the mask matches: bit `j` is set if the hash of the 32 bytes ending with byte `j` (the hash
+        /// checked at boundary `j + 1`) matches the mask.
+        struct MatchBitmaps {
+            std::vector<uint32_t> hard;
+            std::vector<uint32_t> easy;
+        };
+
+        void find_matches_scalar(const uint8_t* data, size_t from, size_t to, Masks masks, MatchBitmaps& bitmaps) {
+            uint32_t h = 0;
+            for (auto j = from >= 32 ? from - 32 : 0; j < from; j++) h = (h << 1) + GEAR[data[j]];
+            for (auto j = from; j < to; j++) {
+                h = (h << 1) + GEAR[data[j]];
+                if ((h & masks.hard) == 0) bitmaps.hard[j / 32] |= 1u << (j % 32);
+                if ((h & masks.easy) == 0) bitmaps.easy[j / 32] |= 1u << (j % 32);
+            }
+        }
+
+        /// Returns the first set bit in `[from, to)`, or `to`.
+        size_t find_bit(const std::vector<uint32_t>& bitmap, size_t from, size_t to) {
+            if (from >= to) return to;
+            auto word = from / 32;
+            auto bits = bitmap[word] & (~0u << (from % 32));
+            auto last_word = (to - 1) / 32;
+            while (bits == 0) {
+                if (word == last_word) return to;
+                bits = bitmap[++word];
+            }
+            return std::min(word * 32 + std::countr_zero(bits), to);
+        }
+
+        /// Same boundaries as `next_cut_scalar`, looked up in the precomputed match bitmaps.
+        size_t next_cut_bitmap(const MatchBitmaps& bitmaps, size_t size, size_t start, bool last,
+                               const ChunkerParams& params) {
+            auto min_end = start + params.min_size;
+            if (min_end >= size) return last ? size : NO_CUT;
+
+            // boundary `i` corresponds to bit `i - 1`
+            auto hard_end = std::min<size_t>(start + params.avg_size, size);
+            auto i = find_bit(bitmaps.hard, min_end - 1, hard_end - 1) + 1;
+            if (i < hard_end) return i;
+            if (hard_end == start + params.avg_size) {
+                auto easy_end = std::min<size_t>(start + params.max_size, size);
+                i = find_bit(bitmaps.easy, hard_end - 1, easy_end - 1) + 1;
+                if (i < easy_end) return i;
+                if (easy_end == start + params.max_size) return easy_end;
+            }
+            return last ? size : NO_CUT;
+        }
+
+#ifdef POG_CHUNKER_X86
+        /// Hashes bytes `[from, to)` in 8 lanes, each over a contiguous region of the range (so that the lanes
+        /// are independent), and fills the match bitmaps. The bytes are loaded 4 at a time per lane by a gather,
+        /// and the gear values by a second gather. The match bits are shifted into a 32-bit accumulator per lane,
+        /// which is stored after 32 bytes. The remainder is hashed by the scalar loop.
+        POG_TARGET_AVX2 void find_matches_avx2(const uint8_t* data, size_t from, size_t to, Masks masks,
+                                               MatchBitmaps& bitmaps) {
+            // lane regions are multiples of 32 bytes, so that each accumulator fills a whole bitmap word
+            auto region = (to - from) / 8 / 32 * 32;
+            if (region < 64) {
+                find_matches_scalar(data, from, to, masks, bitmaps);
+                return;
+            }
+
+            alignas(32) uint32_t initial[8];
+            for (size_t lane = 0; lane < 8; lane++) {
+                auto start = from + lane * region;
+                uint32_t h = 0;
+                for (auto j = start >= 32 ? start - 32 : 0; j < start; j++) h = (h << 1) + GEAR[data[j]];
+                initial[lane] = h;
+            }
+
+            auto base = (const int*) (data + from);
+            auto gear = (const int*) GEAR.data();
+            auto h = _mm256_load_si256((const __m256i*) initial);
+            auto offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                              _mm256_set1_epi32((int) region));
+            auto hard = _mm256_set1_epi32((int) masks.hard);
+            auto easy = _mm256_set1_epi32((int) masks.easy);
+            auto byte_mask = _mm256_set1_epi32(0xff);
+            auto top_bit = _mm256_set1_epi32((int) 0x8000'0000);
+            auto zero = _mm256_setzero_si256();
+
+            alignas(32) uint32_t hard_words[8];
+            alignas(32) uint32_t easy_words[8];
+            for (size_t block = 0; block < region; block += 32) {
+                auto hard_acc = zero;
+                auto easy_acc = zero;
+                for (size_t k = 0; k < 32; k += 4) {
+                    auto words = _mm256_i32gather_epi32(base, offsets, 1);
+                    offsets = _mm256_add_epi32(offsets, _mm256_set1_epi32(4));
+                    for (int t = 0; t < 4; t++) {
+                        auto bytes = _mm256_and_si256(_mm256_srli_epi32(words, 8 * t), byte_mask);
+                        h = _mm256_add_epi32(_mm256_slli_epi32(h, 1), _mm256_i32gather_epi32(gear, bytes, 4));
+                        auto hard_hit = _mm256_cmpeq_epi32(_mm256_and_si256(h, hard), zero);
+                        auto easy_hit = _mm256_cmpeq_epi32(_mm256_and_si256(h, easy), zero);
+                        hard_acc = _mm256_or_si256(_mm256_srli_epi32(hard_acc, 1), _mm256_and_si256(hard_hit, top_bit));
+                        easy_acc = _mm256_or_si256(_mm256_srli_epi32(easy_acc, 1), _mm256_and_si256(easy_hit, top_bit));
+                    }
+                }
+                _mm256_store_si256((__m256i*) hard_words, hard_acc);
+                _mm256_store_si256((__m256i*) easy_words, easy_acc);
+                for (size_t lane = 0; lane < 8; lane++) {
+                    auto word = (from + lane * region + block) / 32;
+                    bitmaps.hard[word] = hard_words[lane];
+                    bitmaps.easy[word] = easy_words[lane];
+                }
+            }
+            find_matches_scalar(data, from + 8 * region, to, masks, bitmaps);
+        }
+
+        size_t find_chunks_avx2(std::span<const uint8_t> data, bool last, const ChunkerParams& params,
+                                std::vector<size_t>& cuts) {
+            auto masks = get_masks(params);
+            auto size = data.size();
+            MatchBitmaps bitmaps{std::vector<uint32_t>(size / 32 + 1), std::vector<uint32_t>(size / 32 + 1)};
+            // the gather offsets are 32-bit
+            constexpr size_t MAX_PASS_SIZE = 1 << 30;
+            for (size_t from = 0; from < size; from += MAX_PASS_SIZE) {
+                find_matches_avx2(data.data(), from, std::min(size, from + MAX_PASS_SIZE), masks, bitmaps);
+            }
+
+            size_t start = 0;
+            while (start < size) {
+                auto cut = next_cut_bitmap(bitmaps, size, start, last, params);
+                if (cut == NO_CUT) break;
+                cuts.push_back(cut);
+                start = cut;
+            }
+            return start;
+        }
+
+        POG_TARGET_XSAVE bool os_saves_ymm() {
+            // XCR0 bits 1 and 2, the OS saves the SSE and AVX state on context switches
+            return (_xgetbv(0) & 6) == 6;
+        }
+
+        bool cpu_has_avx2() {
+#ifdef _MSC_VER
+            int regs[4];
+            __cpuidex(regs, 0, 0);
+            if (regs[0] < 7) return false;
+            __cpuidex(regs, 1, 0);
+            auto ecx1 = (unsigned) regs[2];
+            __cpuidex(regs, 7, 0);
+            auto ebx7 = (unsigned) regs[1];
+#else
+            unsigned eax, ebx, ecx, edx, ecx1, ebx7;
+            if (!__get_cpuid(1, &eax, &ebx, &ecx1, &edx)) return false;
+            if (!__get_cpuid_count(7, 0, &eax, &ebx7, &ecx, &edx)) return false;
+#endif
+            constexpr unsigned OSXSAVE = 1u << 27, AVX = 1u << 28, AVX2 = 1u << 5;
+            return (ecx1 & OSXSAVE) && (ecx1 & AVX) && (ebx7 & AVX2) && os_saves_ymm();
+        }
+#endif
+
+        Implementation detect_implementation() {
+#ifdef POG_CHUNKER_X86
+            if (cpu_has_avx2()) return Implementation::AVX2;
+#endif
+            return Implementation::SCALAR;
+        }
+    }
+
+    size_t find_chunks(std::span<const uint8_t> data, bool last, const ChunkerParams& params,
+                       std::vector<size_t>& cuts, Implementation implementation) {
+#ifdef POG_CHUNKER_X86
+        if (implementation == Implementation::AVX2) return find_chunks_avx2(data, last, params, cuts);
+#else
+        (void) implementation;
+#endif
+        return find_chunks_scalar(data, last, params, cuts);
+    }
+
+    Implementation best_implementation() {
+        static const auto implementation = detect_implementation();
+        return implementation;
+    }
+
+    bool is_supported(Implementation implementation) {
+        return implementation == Implementation::SCALAR || best_implementation() == implementation;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Content-defined chunking (FastCDC, https://www.usenix.org/conference/atc16/technical-sessions/presentation/xia),
+//  used to split download cache entries into chunks that are stored once, even if they appear in several entries
+//  (`dedup/ChunkStore.hpp`). A boundary is placed after a byte where the gear hash of the preceding 32 bytes matches
+//  a mask, so an insertion or a deletion only moves the boundaries near it, and unchanged data produce the same chunks.
+//
+// Unlike the original FastCDC, the hash does not restart at the start of each chunk; it only depends on the last 32
+//  bytes, and since the smallest chunk is longer than that, the boundaries are the same as with a restarted hash.
+//  This lets the AVX2 implementation hash the whole buffer in 8 independent lanes, and then pick the boundaries from
+//  the precomputed mask matches.
+namespace dedup {
+    /// Changing the parameters (or the gear table) changes the chunk boundaries, and existing chunks are not reused.
+    struct ChunkerParams {
+        /// Must be at least 64 bytes.
+        uint32_t min_size = 16 << 10;
+        /// Must be a power of two between `min_size` and `max_size`.
+        uint32_t avg_size = 64 << 10;
+        uint32_t max_size = 256 << 10;
+    };
+
+    enum class Implementation {
+        SCALAR,
+        AVX2,
+    };
+
+    /// The implementation used by default, the fastest one supported by the CPU.
+    Implementation best_implementation();
+    bool is_supported(Implementation implementation);
+
+    /// Splits `data` into chunks, appending the end offset of each chunk to `cuts`. If `last` is false, `data`
+    /// continues in the next call, and the trailing data which do not form a complete chunk yet are not emitted;
+    /// the next call should start at the returned offset (the end of the last emitted chunk). With `last`, all data
+    /// are emitted, and the returned offset is `data.size()`.
+    size_t find_chunks(std::span<const uint8_t> data, bool last, const ChunkerParams& params,
+                       std::vector<size_t>& cuts, Implementation implementation);
+
+    inline size_t find_chunks(std::span<const uint8_t> data, bool last, const ChunkerParams& params,
+                              std::vector<size_t>& cuts) {
+        return find_chunks(data, last, params, cuts, best_implementation());
+    }
+}
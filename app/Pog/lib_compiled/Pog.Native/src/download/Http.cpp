@@ -0,0 +1,30 @@
+#include "Http.hpp"
+#include <charconv>
+
+namespace download {
+    bool parse_content_range(std::string_view value, uint64_t& first, std::optional<uint64_t>& total) {
+        // bytes <first>-<last>/<total or *>
+        if (!value.starts_with("bytes ")) return false;
+        value.remove_prefix(6);
+        auto dash = value.find('-');
+        auto slash = value.find('/');
+        if (dash == std::string_view::npos || slash == std::string_view::npos || slash < dash) return false;
+
+        auto parse = [](std::string_view str, uint64_t& out) {
+            auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), out);
+            return ec == std::errc{} && end == str.data() + str.size();
+        };
+        uint64_t last;
+        if (!parse(value.substr(0, dash), first) || !parse(value.substr(dash + 1, slash - dash - 1), last)) return false;
+        if (last < first) return false;
+        auto total_str = value.substr(slash + 1);
+        if (total_str == "*") {
+            total = std::nullopt;
+            return true;
+        }
+        uint64_t t;
+        if (!parse(total_str, t) || t <= last) return false;
+        total = t;
+        return true;
+    }
+}
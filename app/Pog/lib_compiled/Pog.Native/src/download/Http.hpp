@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Minimal blocking HTTP client interface used by the ranged downloader. On Windows, requests go through WinHTTP
+//  (`WinHttp.cpp`, with TLS, proxies and redirects handled by the OS); elsewhere, a plain HTTP/1.1 client over
+//  sockets (`SocketHttp.cpp`) is used to test the downloader against a local server.
+namespace download {
+    /// Thrown for connection failures (`status` is 0) and for unexpected HTTP responses.
+    class HttpError : public std::runtime_error {
+    public:
+        const int status;
+
+        explicit HttpError(const std::string& message, int status = 0) : std::runtime_error(message), status{status} {}
+    };
+
+    /// Inclusive byte range of a request, `last` is empty for a range up to the end of the resource.
+    struct ByteRange {
+        uint64_t first = 0;
+        std::optional<uint64_t> last{};
+    };
+
+    struct HttpResponse {
+        int status = 0;
+        std::optional<uint64_t> content_length{};
+        /// Parsed `Content-Range` of a 206 response: the first byte of the body and the total size of the resource.
+        std::optional<uint64_t> range_first{};
+        std::optional<uint64_t> range_total{};
+        /// `ETag` (or `Last-Modified` if there's no ETag), to check that the resource did not change between requests.
+        std::string validator{};
+    };
+
+    /// A connection to a server, reused for subsequent requests when possible (HTTP keep-alive). Redirects are
+    /// followed transparently. Not thread-safe, each download connection has its own instance.
+    class HttpConnection {
+    public:
+        virtual ~HttpConnection() = default;
+
+        /// Sends a GET request for `url` (optionally for a byte `range`) and reads the response headers. The body
+        /// of the previous response is discarded.
+        virtual HttpResponse get(const std::string& url, std::optional<ByteRange> range) = 0;
+
+        /// Reads the next part of the response body into `buffer`, returns 0 at the end of the body.
+        virtual size_t read(std::span<uint8_t> buffer) = 0;
+    };
+
+    using ConnectionFactory = std::function<std::unique_ptr<HttpConnection>()>;
+
+    /// Connections of the platform HTTP client, sending `user_agent` with each request.
+    ConnectionFactory default_connection_factory(const std::string& user_agent);
+
+    /// Parses an HTTP `Content-Range` header value (`bytes first-last/total`), returns false if it's malformed.
+    bool parse_content_range(std::string_view value, uint64_t& first, std::optional<uint64_t>& total);
+}
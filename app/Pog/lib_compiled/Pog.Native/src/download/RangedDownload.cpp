@@ -0,0 +1,409 @@
+#include "RangedDownload.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace download {
+    namespace {
+        constexpr size_t BUFFER_SIZE = 256 << 10;
+        constexpr auto PROGRESS_INTERVAL = std::chrono::milliseconds(100);
+        constexpr auto SAVE_INTERVAL = std::chrono::seconds(1);
+        constexpr auto RETRY_DELAY = std::chrono::milliseconds(200);
+        constexpr std::string_view STATE_HEADER = "pog-download 1";
+        constexpr size_t NO_SEGMENT = SIZE_MAX;
+
+        struct Segment {
+            /// Next byte to be read by the owning connection; bytes up to `done` are written, `end` is exclusive.
+            uint64_t next = 0;
+            uint64_t done = 0;
+            uint64_t end = 0;
+            /// A connection is currently downloading the segment.
+            bool owned = false;
+        };
+
+        /// Contents of the state file: the download and its remaining segments.
+        struct State {
+            /// The resume key, or the URL.
+            std::string key{};
+            uint64_t size = 0;
+            std::string validator{};
+            std::vector<Segment> segments{};
+        };
+
+        fs::path state_file_path(const path_char* target_path) {
+            fs::path path{target_path};
+            path += ".pogdl";
+            return path;
+        }
+
+        std::optional<uint64_t> parse_u64(std::string_view str) {
+            uint64_t n;
+            auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), n);
+            if (ec != std::errc{} || end != str.data() + str.size()) return std::nullopt;
+            return n;
+        }
+
+        /// Returns nothing if the state file does not exist or is not valid, the download then starts from scratch.
+        std::optional<State> load_state(const fs::path& path) {
+            std::ifstream in{path};
+            State state;
+            std::string header, size;
+            if (!std::getline(in, header) || header != STATE_HEADER || !std::getline(in, state.key)
+                || !std::getline(in, size) || !std::getline(in, state.validator)) {
+                return std::nullopt;
+            }
+            auto parsed_size = parse_u64(size);
+            if (!parsed_size) return std::nullopt;
+            state.size = *parsed_size;
+
+            uint64_t done, end;
+            while (in >> done >> end) {
+                if (done >= end || end > state.size) return std::nullopt;
+                state.segments.push_back({done, done, end});
+            }
+            if (!in.eof() || state.segments.empty()) return std::nullopt;
+            return state;
+        }
+
+        void save_state(const fs::path& path, const State& state) {
+            // write a new file and replace the previous one, so that an interrupted write does not lose the state
+            auto tmp_path = path;
+            tmp_path += ".tmp";
+            {
+                std::ofstream out{tmp_path, std::ios::trunc};
+                out << STATE_HEADER << '\n' << state.key << '\n' << state.size << '\n' << state.validator << '\n';
+                for (auto& s : state.segments) {
+                    if (s.done < s.end) out << s.done << ' ' << s.end << '\n';
+                }
+                out.flush();
+                if (!out) throw IoError("Could not write the download state file.", errno);
+            }
+            std::error_code ec;
+            fs::rename(tmp_path, path, ec);
+            if (ec) throw IoError("Could not write the download state file.", ec.value());
+        }
+
+        void remove_state(const fs::path& path) {
+            std::error_code ec;
+            fs::remove(path, ec);
+        }
+
+        bool is_retriable(const HttpError& e) {
+            // connection errors, overloaded servers and servers limiting the number of connections
+            return e.status == 0 || e.status == 429 || e.status >= 500;
+        }
+
+        /// Downloads the remaining segments of a file with range support.
+        class RangedDownload {
+        private:
+            const std::string& url_;
+            const ConnectionFactory& connect_;
+            const DownloadOptions& options_;
+            const fs::path& state_path_;
+            RandomAccessFile& file_;
+            const std::string key_;
+            const uint64_t size_;
+            const std::string validator_;
+
+            std::mutex mutex_;
+            std::condition_variable finished_cv_;
+            std::vector<Segment> segments_;
+            unsigned running_ = 0;
+            std::atomic<bool> stop_ = false;
+            /// The first fatal error, or the last network error if there was no fatal one.
+            std::exception_ptr error_{};
+            bool fatal_error_ = false;
+
+        public:
+            RangedDownload(const std::string& url, const ConnectionFactory& connect, const DownloadOptions& options,
+                           const fs::path& state_path, RandomAccessFile& file, State state)
+                    : url_{url}, connect_{connect}, options_{options}, state_path_{state_path}, file_{file},
+                      key_{std::move(state.key)}, size_{state.size}, validator_{std::move(state.validator)},
+                      segments_{std::move(state.segments)} {}
+
+            /// `connection` has an open response for the range starting at the first segment.
+            void run(std::unique_ptr<HttpConnection> connection) {
+                save();
+
+                auto connections = std::max(1u, options_.connections);
+                segments_[0].owned = true;
+                running_ = connections;
+                std::vector<std::thread> workers;
+                workers.emplace_back([this, c = std::move(connection)]() mutable { run_worker(std::move(c), 0); });
+                for (unsigned i = 1; i < connections; i++) {
+                    workers.emplace_back([this] { run_worker(nullptr, NO_SEGMENT); });
+                }
+
+                auto cancelled = false;
+                std::exception_ptr progress_error;
+                try {
+                    auto last_save = std::chrono::steady_clock::now();
+                    std::unique_lock lock{mutex_};
+                    do {
+                        finished_cv_.wait_for(lock, PROGRESS_INTERVAL, [&] { return running_ == 0; });
+                        auto remaining = remaining_bytes();
+                        lock.unlock();
+                        if (!cancelled && options_.progress && !options_.progress(size_ - remaining, size_)) {
+                            cancelled = true;
+                            stop_ = true;
+                        }
+                        if (auto now = std::chrono::steady_clock::now(); now - last_save >= SAVE_INTERVAL) {
+                            save();
+                            last_save = now;
+                        }
+                        lock.lock();
+                    } while (running_ > 0);
+                } catch (...) {
+                    progress_error = std::current_exception();
+                    stop_ = true;
+                }
+                for (auto& w : workers) w.join();
+
+                if (remaining_bytes() == 0) {
+                    remove_state(state_path_);
+                    return;
+                }
+                if (progress_error) std::rethrow_exception(progress_error);
+                save();
+                if (cancelled) throw OperationCancelled();
+                if (error_) std::rethrow_exception(error_);
+                throw HttpError("The download did not complete.");
+            }
+
+        private:
+            uint64_t remaining_bytes() const {
+                uint64_t remaining = 0;
+                for (auto& s : segments_) remaining += s.end - s.done;
+                return remaining;
+            }
+
+            void save() {
+                State state{key_, size_, validator_, {}};
+                {
+                    std::lock_guard lock{mutex_};
+                    state.segments = segments_;
+                }
+                save_state(state_path_, state);
+            }
+
+            /// `open_segment` is the segment whose response is already open on `connection`, or `NO_SEGMENT`.
+            void run_worker(std::unique_ptr<HttpConnection> connection, size_t open_segment) {
+                std::vector<uint8_t> buffer(BUFFER_SIZE);
+                unsigned failures = 0;
+                while (!stop_) {
+                    auto requested = open_segment != NO_SEGMENT;
+                    auto segment = requested ? open_segment : acquire_segment();
+                    open_segment = NO_SEGMENT;
+                    if (segment == NO_SEGMENT) break;
+                    try {
+                        if (!requested) {
+                            if (!connection) connection = connect_();
+                            request_segment(*connection, segment);
+                        }
+                        transfer(*connection, segment, buffer);
+                        failures = 0;
+                    } catch (const HttpError& e) {
+                        connection.reset();
+                        release_segment(segment);
+                        auto retriable = is_retriable(e);
+                        record_error(std::current_exception(), !retriable);
+                        if (!retriable || ++failures > options_.max_retries) break;
+                        std::this_thread::sleep_for(RETRY_DELAY * failures);
+                        continue;
+                    } catch (...) {
+                        release_segment(segment);
+                        record_error(std::current_exception(), true);
+                        break;
+                    }
+                    release_segment(segment);
+                }
+                // stopped before the open response was read
+                if (open_segment != NO_SEGMENT) release_segment(open_segment);
+
+                {
+                    std::lock_guard lock{mutex_};
+                    running_--;
+                }
+                finished_cv_.notify_all();
+            }
+
+            /// Takes the largest segment nobody is downloading or, if there's none, splits the largest remaining
+            /// segment in half and takes the second half. Returns `NO_SEGMENT` if there's nothing left to split.
+            size_t acquire_segment() {
+                std::lock_guard lock{mutex_};
+                auto best = NO_SEGMENT;
+                uint64_t best_remaining = 0;
+                for (size_t i = 0; i < segments_.size(); i++) {
+                    auto& s = segments_[i];
+                    if (!s.owned && s.end - s.next > best_remaining) {
+                        best = i;
+                        best_remaining = s.end - s.next;
+                    }
+                }
+                if (best != NO_SEGMENT) {
+                    segments_[best].owned = true;
+                    return best;
+                }
+
+                for (size_t i = 0; i < segments_.size(); i++) {
+                    auto& s = segments_[i];
+                    if (s.end - s.next > best_remaining) {
+                        best = i;
+                        best_remaining = s.end - s.next;
+                    }
+                }
+                if (best == NO_SEGMENT || best_remaining < 2 * options_.min_segment_size) return NO_SEGMENT;
+                // the owner of the split segment stops at the new end, even though it requested more
+                auto& s = segments_[best];
+                auto middle = s.next + best_remaining / 2;
+                Segment half{middle, middle, s.end, true};
+                s.end = middle;
+                segments_.push_back(half);
+                return segments_.size() - 1;
+            }
+
+            void release_segment(size_t index) {
+                std::lock_guard lock{mutex_};
+                auto& s = segments_[index];
+                // a failed connection may have read data that were not written
+                s.next = s.done;
+                s.owned = false;
+            }
+
+            void record_error(std::exception_ptr error, bool fatal) {
+                std::lock_guard lock{mutex_};
+                if (fatal) stop_ = true;
+                if (fatal_error_) return;
+                error_ = std::move(error);
+                fatal_error_ = fatal;
+            }
+
+            void request_segment(HttpConnection& connection, size_t index) {
+                ByteRange range;
+                {
+                    std::lock_guard lock{mutex_};
+                    range = {segments_[index].next, segments_[index].end - 1};
+                }
+                auto response = connection.get(url_, range);
+                if (response.status != 206 || response.range_first != range.first || response.range_total != size_) {
+                    throw HttpError("Unexpected response to a range request (HTTP " + std::to_string(response.status)
+                                    + ").", response.status);
+                }
+                if (response.validator != validator_) {
+                    throw HttpError("The file changed on the server during the download.", response.status);
+                }
+            }
+
+            /// Reads the response into the segment, until the end of the segment (which may move closer when
+            /// the segment is split) or until the download is stopped.
+            void transfer(HttpConnection& connection, size_t index, std::vector<uint8_t>& buffer) {
+                while (!stop_) {
+                    auto n = connection.read(buffer);
+                    uint64_t offset, size;
+                    {
+                        std::lock_guard lock{mutex_};
+                        auto& s = segments_[index];
+                        if (n == 0) throw HttpError("The connection was closed before the whole range was received.");
+                        offset = s.next;
+                        size = std::min<uint64_t>(n, s.end - s.next);
+                        s.next += size;
+                    }
+                    file_.write_at(offset, {buffer.data(), (size_t) size});
+                    {
+                        std::lock_guard lock{mutex_};
+                        auto& s = segments_[index];
+                        s.done += size;
+                        if (s.done == s.end) return;
+                    }
+                }
+            }
+        };
+
+        /// Downloads a response without range support, or with an unknown size, in a single pass.
+        void download_stream(HttpConnection& connection, const HttpResponse& response, const path_char* target_path,
+                             const ProgressCallback& progress) {
+            OutputFile file{target_path};
+            std::vector<uint8_t> buffer(BUFFER_SIZE);
+            auto total = response.content_length.value_or(0);
+            uint64_t processed = 0;
+            while (auto n = connection.read(buffer)) {
+                file.write({buffer.data(), n});
+                processed += n;
+                if (progress && !progress(processed, total)) throw OperationCancelled();
+            }
+            if (response.content_length && processed != *response.content_length) {
+                throw HttpError("The connection was closed before the whole file was received.");
+            }
+        }
+
+        bool file_has_size(const path_char* path, uint64_t size) {
+            try {
+                return stat_file(path).size == size;
+            } catch (const IoError&) {
+                return false;
+            }
+        }
+    }
+
+    void download_file(const std::string& url, const path_char* target_path, const ConnectionFactory& connect,
+                       const DownloadOptions& options) {
+        auto& key = options.resume_key.empty() ? url : options.resume_key;
+        auto state_path = state_file_path(target_path);
+        auto state = load_state(state_path);
+        if (state && (state->key != key || state->validator.empty() || !file_has_size(target_path, state->size))) {
+            state.reset();
+        }
+
+        auto connection = connect();
+        // at most two passes, a resume state that does not match the server restarts the download from scratch
+        while (true) {
+            auto range = state ? ByteRange{state->segments[0].done, state->segments[0].end - 1} : ByteRange{0};
+            auto response = connection->get(url, range);
+            if (response.status == 416 && !state) {
+                // an empty file cannot be requested with a range
+                response = connection->get(url, std::nullopt);
+            }
+
+            if (response.status == 206 && response.range_total) {
+                if (state && (response.range_first != range.first || response.range_total != state->size
+                              || response.validator != state->validator)) {
+                    state.reset();
+                    continue;
+                }
+                if (!state && response.range_first != 0) {
+                    throw HttpError("Unexpected response to a range request (HTTP 206).", 206);
+                }
+
+                RandomAccessFile file{target_path};
+                if (!state) {
+                    state = State{key, *response.range_total, response.validator, {{0, 0, *response.range_total}}};
+                    file.set_size(state->size);
+                }
+                RangedDownload{url, connect, options, state_path, file, std::move(*state)}.run(std::move(connection));
+                return;
+            }
+
+            if (response.status == 200 || (response.status == 206 && !state && response.range_first == 0)) {
+                remove_state(state_path);
+                download_stream(*connection, response, target_path, options.progress);
+                return;
+            }
+            if (state) {
+                state.reset();
+                continue;
+            }
+            throw HttpError("The server returned HTTP " + std::to_string(response.status) + ".", response.status);
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "Http.hpp"
+#include "MappedFile.hpp"
+#include "Progress.hpp"
+
+// Downloads a file over several parallel connections using HTTP range requests, and resumes interrupted downloads.
+//
+// The first request asks for the whole file with an open range (`bytes=0-`). If the server responds with 206,
+//  the file is preallocated and the response is read by the first connection; each additional connection then takes
+//  over the second half of the largest remaining segment (so connections that finish early keep splitting the
+//  remaining work, instead of waiting for the slowest one). Servers without range support get a single stream.
+//
+// While downloading, the remaining segments are periodically saved to `<target>.pogdl`. When the download is
+//  interrupted (cancelled, connection lost), the next download of the same URL (or resume key) to the same path
+//  continues with the missing segments, as long as the server still reports the same size and validator (ETag or
+//  Last-Modified).
+namespace download {
+    struct DownloadOptions {
+        /// Maximum number of parallel connections.
+        unsigned connections = 4;
+        /// Segments are only split if both halves are at least this large, so smaller files use fewer connections.
+        uint64_t min_segment_size = 4 << 20;
+        /// Number of times a connection is re-established after a network error before it gives up.
+        unsigned max_retries = 3;
+        ProgressCallback progress = {};
+        /// Identifies the download in the state file instead of the URL. Set it when the URL changes between attempts
+        ///  (e.g. signed redirect URLs with an expiration); the size and the validator must still match to resume.
+        std::string resume_key{};
+    };
+
+    /// Downloads `url` to `target_path`, continuing a previously interrupted download if possible.
+    /// Throws `HttpError`, `IoError` or `OperationCancelled`; on error, the partial file and its state file are kept,
+    /// so that the download can be resumed later. On success, the state file is deleted.
+    void download_file(const std::string& url, const path_char* target_path, const ConnectionFactory& connect,
+                       const DownloadOptions& options = {});
+}
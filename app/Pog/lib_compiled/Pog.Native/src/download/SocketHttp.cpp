@@ -0,0 +1,281 @@
+// Plain HTTP/1.1 client over POSIX sockets, used on non-Windows hosts to test the downloader against a local server.
+//  HTTPS is not supported; Pog itself always uses WinHTTP (`WinHttp.cpp`).
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+#include "Http.hpp"
+
+namespace download {
+    namespace {
+        constexpr int MAX_REDIRECTS = 10;
+
+        struct Url {
+            std::string host;
+            std::string port;
+            std::string path;
+        };
+
+        Url parse_url(const std::string& url) {
+            std::string_view rest{url};
+            if (!rest.starts_with("http://")) throw HttpError("Unsupported URL (only http:// is supported): " + url);
+            rest.remove_prefix(7);
+            auto slash = rest.find('/');
+            auto authority = rest.substr(0, slash);
+            auto path = slash == std::string_view::npos ? "/" : std::string{rest.substr(slash)};
+            auto colon = authority.rfind(':');
+            if (colon == std::string_view::npos) return {std::string{authority}, "80", path};
+            return {std::string{authority.substr(0, colon)}, std::string{authority.substr(colon + 1)}, path};
+        }
+
+        bool iequals(std::string_view a, std::string_view b) {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+                return tolower((unsigned char) x) == tolower((unsigned char) y);
+            });
+        }
+
+        std::optional<uint64_t> parse_u64(std::string_view str, int base = 10) {
+            uint64_t n;
+            auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), n, base);
+            if (ec != std::errc{} || end != str.data() + str.size()) return std::nullopt;
+            return n;
+        }
+
+        class SocketConnection : public HttpConnection {
+        private:
+            std::string user_agent_;
+            int fd_ = -1;
+            std::string connected_to_{};
+            std::vector<uint8_t> buffer_ = std::vector<uint8_t>(64 << 10);
+            size_t buffer_pos_ = 0, buffer_end_ = 0;
+
+            // state of the current response body
+            enum class BodyKind { LENGTH, CHUNKED, UNTIL_CLOSE } body_kind_ = BodyKind::LENGTH;
+            uint64_t body_remaining_ = 0;
+            bool body_done_ = true;
+            bool keep_alive_ = false;
+
+        public:
+            explicit SocketConnection(std::string user_agent) : user_agent_{std::move(user_agent)} {}
+
+            ~SocketConnection() override {
+                disconnect();
+            }
+
+            HttpResponse get(const std::string& url, std::optional<ByteRange> range) override {
+                auto current_url = url;
+                for (int i = 0; i <= MAX_REDIRECTS; i++) {
+                    std::string location;
+                    auto response = send_request(current_url, range, location);
+                    if (response.status < 300 || response.status >= 400 || location.empty()) return response;
+                    if (location.starts_with("/")) {
+                        auto u = parse_url(current_url);
+                        location = "http://" + u.host + ":" + u.port + location;
+                    }
+                    current_url = location;
+                }
+                throw HttpError("Too many redirects: " + url);
+            }
+
+            size_t read(std::span<uint8_t> buffer) override {
+                while (!body_done_) {
+                    if (body_kind_ == BodyKind::CHUNKED && body_remaining_ == 0) {
+                        // the CRLF after the previous chunk is consumed by `read_line` as an empty line
+                        auto line = read_line();
+                        if (line.empty()) line = read_line();
+                        auto size = parse_u64(line.substr(0, line.find(';')), 16);
+                        if (!size) throw HttpError("Invalid chunked response.");
+                        if (*size == 0) {
+                            // trailers, up to an empty line
+                            while (!read_line().empty()) {}
+                            body_done_ = true;
+                            break;
+                        }
+                        body_remaining_ = *size;
+                    }
+                    if (body_kind_ != BodyKind::UNTIL_CLOSE && body_remaining_ == 0) {
+                        body_done_ = true;
+                        break;
+                    }
+
+                    auto max = body_kind_ == BodyKind::UNTIL_CLOSE
+                               ? buffer.size() : (size_t) std::min<uint64_t>(buffer.size(), body_remaining_);
+                    auto n = read_some(buffer.first(max));
+                    if (n == 0) {
+                        if (body_kind_ != BodyKind::UNTIL_CLOSE) throw HttpError("Connection closed prematurely.");
+                        body_done_ = true;
+                        keep_alive_ = false;
+                        break;
+                    }
+                    if (body_kind_ != BodyKind::UNTIL_CLOSE) body_remaining_ -= n;
+                    return n;
+                }
+                return 0;
+            }
+
+        private:
+            HttpResponse send_request(const std::string& url, std::optional<ByteRange> range, std::string& location) {
+                auto u = parse_url(url);
+                auto target = u.host + ":" + u.port;
+                if (!body_done_ || !keep_alive_ || connected_to_ != target) {
+                    // the rest of the previous body would have to be read first, reconnecting is cheaper
+                    connect_to(u);
+                    connected_to_ = target;
+                }
+
+                std::string request = "GET " + u.path + " HTTP/1.1\r\nHost: " + u.host + "\r\nUser-Agent: " + user_agent_
+                                      + "\r\nAccept-Encoding: identity\r\n";
+                if (range) {
+                    request += "Range: bytes=" + std::to_string(range->first) + "-"
+                               + (range->last ? std::to_string(*range->last) : "") + "\r\n";
+                }
+                request += "\r\n";
+                send_all(request);
+
+                HttpResponse response;
+                auto status_line = read_line();
+                if (!status_line.starts_with("HTTP/1.") || status_line.size() < 12) {
+                    throw HttpError("Invalid HTTP response.");
+                }
+                response.status = (int) parse_u64(std::string_view{status_line}.substr(9, 3)).value_or(0);
+                keep_alive_ = status_line.starts_with("HTTP/1.1");
+
+                std::string etag, last_modified;
+                auto chunked = false;
+                while (true) {
+                    auto line = read_line();
+                    if (line.empty()) break;
+                    auto colon = line.find(':');
+                    if (colon == std::string::npos) continue;
+                    auto name = std::string_view{line}.substr(0, colon);
+                    auto value = std::string_view{line}.substr(colon + 1);
+                    while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+
+                    if (iequals(name, "Content-Length")) {
+                        response.content_length = parse_u64(value);
+                    } else if (iequals(name, "Content-Range")) {
+                        uint64_t first;
+                        std::optional<uint64_t> total;
+                        if (parse_content_range(value, first, total)) {
+                            response.range_first = first;
+                            response.range_total = total;
+                        }
+                    } else if (iequals(name, "Transfer-Encoding")) {
+                        chunked = value.find("chunked") != std::string_view::npos;
+                    } else if (iequals(name, "Connection")) {
+                        if (iequals(value, "close")) keep_alive_ = false;
+                    } else if (iequals(name, "ETag")) {
+                        etag = value;
+                    } else if (iequals(name, "Last-Modified")) {
+                        last_modified = value;
+                    } else if (iequals(name, "Location")) {
+                        location = value;
+                    }
+                }
+                response.validator = etag.empty() ? last_modified : etag;
+
+                body_done_ = false;
+                if (chunked) {
+                    body_kind_ = BodyKind::CHUNKED;
+                    body_remaining_ = 0;
+                } else if (response.content_length) {
+                    body_kind_ = BodyKind::LENGTH;
+                    body_remaining_ = *response.content_length;
+                } else if (response.status == 204 || response.status == 304) {
+                    body_kind_ = BodyKind::LENGTH;
+                    body_remaining_ = 0;
+                } else {
+                    body_kind_ = BodyKind::UNTIL_CLOSE;
+                }
+                return response;
+            }
+
+            void connect_to(const Url& u) {
+                disconnect();
+                addrinfo hints{};
+                hints.ai_family = AF_UNSPEC;
+                hints.ai_socktype = SOCK_STREAM;
+                addrinfo* addresses;
+                if (auto error = getaddrinfo(u.host.c_str(), u.port.c_str(), &hints, &addresses)) {
+                    throw HttpError("Could not resolve '" + u.host + "': " + gai_strerror(error));
+                }
+                for (auto a = addresses; a; a = a->ai_next) {
+                    fd_ = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+                    if (fd_ < 0) continue;
+                    if (connect(fd_, a->ai_addr, a->ai_addrlen) == 0) break;
+                    close(fd_);
+                    fd_ = -1;
+                }
+                freeaddrinfo(addresses);
+                if (fd_ < 0) throw HttpError("Could not connect to '" + u.host + ":" + u.port + "'.");
+                int one = 1;
+                setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                buffer_pos_ = buffer_end_ = 0;
+            }
+
+            void disconnect() {
+                if (fd_ >= 0) close(fd_);
+                fd_ = -1;
+                connected_to_.clear();
+            }
+
+            void send_all(std::string_view data) {
+                while (!data.empty()) {
+                    auto n = send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+                    if (n < 0) {
+                        if (errno == EINTR) continue;
+                        throw HttpError(std::string("Could not send the request: ") + strerror(errno));
+                    }
+                    data.remove_prefix((size_t) n);
+                }
+            }
+
+            size_t read_some(std::span<uint8_t> out) {
+                if (buffer_pos_ == buffer_end_) {
+                    // large reads go directly to the caller's buffer
+                    if (out.size() >= buffer_.size()) return recv_some(out);
+                    buffer_pos_ = 0;
+                    buffer_end_ = recv_some(buffer_);
+                }
+                auto n = std::min(out.size(), buffer_end_ - buffer_pos_);
+                memcpy(out.data(), buffer_.data() + buffer_pos_, n);
+                buffer_pos_ += n;
+                return n;
+            }
+
+            size_t recv_some(std::span<uint8_t> out) {
+                while (true) {
+                    auto n = recv(fd_, out.data(), out.size(), 0);
+                    if (n >= 0) return (size_t) n;
+                    if (errno != EINTR) throw HttpError(std::string("Could not read the response: ") + strerror(errno));
+                }
+            }
+
+            std::string read_line() {
+                std::string line;
+                while (true) {
+                    uint8_t c;
+                    if (read_some({&c, 1}) == 0) throw HttpError("Connection closed prematurely.");
+                    if (c == '\n') break;
+                    if (line.size() > 16 << 10) throw HttpError("Response header line is too long.");
+                    line += (char) c;
+                }
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                return line;
+            }
+        };
+    }
+
+    ConnectionFactory default_connection_factory(const std::string& user_agent) {
+        return [user_agent] { return std::make_unique<SocketConnection>(user_agent); };
+    }
+}
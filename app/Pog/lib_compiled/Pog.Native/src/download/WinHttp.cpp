@@ -0,0 +1,153 @@
+// HTTP client over WinHTTP, used by Pog on Windows. TLS, proxy configuration and redirects are handled by WinHTTP.
+
+#include <Windows.h>
+#include <winhttp.h>
+#include <algorithm>
+#include <vector>
+#include "Http.hpp"
+
+namespace download {
+    namespace {
+        std::wstring widen(const std::string& str) {
+            if (str.empty()) return {};
+            auto size = MultiByteToWideChar(CP_UTF8, 0, str.data(), (int) str.size(), nullptr, 0);
+            std::wstring out(size, L'\0');
+            MultiByteToWideChar(CP_UTF8, 0, str.data(), (int) str.size(), out.data(), size);
+            return out;
+        }
+
+        std::string narrow(const std::wstring& str) {
+            if (str.empty()) return {};
+            auto size = WideCharToMultiByte(CP_UTF8, 0, str.data(), (int) str.size(), nullptr, 0, nullptr, nullptr);
+            std::string out(size, '\0');
+            WideCharToMultiByte(CP_UTF8, 0, str.data(), (int) str.size(), out.data(), size, nullptr, nullptr);
+            return out;
+        }
+
+        [[noreturn]] void throw_last_error(const char* operation) {
+            throw HttpError(std::string(operation) + " failed (WinHTTP error " + std::to_string(GetLastError()) + ").");
+        }
+
+        /// Shared by all connections of a download, WinHTTP keeps its connection pool per session.
+        struct Session {
+            HINTERNET handle;
+
+            explicit Session(const std::string& user_agent) {
+                handle = WinHttpOpen(widen(user_agent).c_str(), WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY,
+                                     WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+                if (!handle) throw_last_error("WinHttpOpen");
+                // each connection of a ranged download must get its own TCP connection
+                DWORD max_connections = 32;
+                WinHttpSetOption(handle, WINHTTP_OPTION_MAX_CONNS_PER_SERVER, &max_connections, sizeof(max_connections));
+            }
+
+            ~Session() {
+                WinHttpCloseHandle(handle);
+            }
+        };
+
+        class WinHttpConnection : public HttpConnection {
+        private:
+            std::shared_ptr<Session> session_;
+            HINTERNET connection_ = nullptr;
+            std::wstring connected_host_{};
+            INTERNET_PORT connected_port_ = 0;
+            HINTERNET request_ = nullptr;
+
+        public:
+            explicit WinHttpConnection(std::shared_ptr<Session> session) : session_{std::move(session)} {}
+
+            ~WinHttpConnection() override {
+                if (request_) WinHttpCloseHandle(request_);
+                if (connection_) WinHttpCloseHandle(connection_);
+            }
+
+            HttpResponse get(const std::string& url, std::optional<ByteRange> range) override {
+                if (request_) WinHttpCloseHandle(request_);
+                request_ = nullptr;
+
+                auto wide_url = widen(url);
+                URL_COMPONENTS parts{};
+                parts.dwStructSize = sizeof(parts);
+                parts.dwSchemeLength = parts.dwHostNameLength = parts.dwUrlPathLength = parts.dwExtraInfoLength = -1;
+                if (!WinHttpCrackUrl(wide_url.c_str(), 0, 0, &parts)) throw HttpError("Invalid URL: " + url);
+                std::wstring host{parts.lpszHostName, parts.dwHostNameLength};
+                std::wstring path{parts.lpszUrlPath, parts.dwUrlPathLength + parts.dwExtraInfoLength};
+
+                if (!connection_ || host != connected_host_ || parts.nPort != connected_port_) {
+                    if (connection_) WinHttpCloseHandle(connection_);
+                    connection_ = WinHttpConnect(session_->handle, host.c_str(), parts.nPort, 0);
+                    if (!connection_) throw_last_error("WinHttpConnect");
+                    connected_host_ = host;
+                    connected_port_ = parts.nPort;
+                }
+
+                request_ = WinHttpOpenRequest(connection_, L"GET", path.c_str(), nullptr, WINHTTP_NO_REFERER,
+                                              WINHTTP_DEFAULT_ACCEPT_TYPES,
+                                              parts.nScheme == INTERNET_SCHEME_HTTPS ? WINHTTP_FLAG_SECURE : 0);
+                if (!request_) throw_last_error("WinHttpOpenRequest");
+
+                std::wstring headers;
+                if (range) {
+                    headers = L"Range: bytes=" + std::to_wstring(range->first) + L"-"
+                              + (range->last ? std::to_wstring(*range->last) : L"");
+                }
+                if (!WinHttpSendRequest(request_, headers.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : headers.c_str(),
+                                        (DWORD) headers.size(), WINHTTP_NO_REQUEST_DATA, 0, 0, 0)) {
+                    throw_last_error("WinHttpSendRequest");
+                }
+                if (!WinHttpReceiveResponse(request_, nullptr)) throw_last_error("WinHttpReceiveResponse");
+
+                HttpResponse response;
+                DWORD status = 0, size = sizeof(status);
+                if (!WinHttpQueryHeaders(request_, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                                         WINHTTP_HEADER_NAME_BY_INDEX, &status, &size, WINHTTP_NO_HEADER_INDEX)) {
+                    throw_last_error("WinHttpQueryHeaders");
+                }
+                response.status = (int) status;
+                if (auto length = query_header(WINHTTP_QUERY_CONTENT_LENGTH)) {
+                    response.content_length = std::stoull(*length);
+                }
+                if (auto content_range = query_header(WINHTTP_QUERY_CONTENT_RANGE)) {
+                    uint64_t first;
+                    std::optional<uint64_t> total;
+                    if (parse_content_range(*content_range, first, total)) {
+                        response.range_first = first;
+                        response.range_total = total;
+                    }
+                }
+                auto etag = query_header(WINHTTP_QUERY_ETAG);
+                response.validator = etag ? *etag : query_header(WINHTTP_QUERY_LAST_MODIFIED).value_or("");
+                return response;
+            }
+
+            size_t read(std::span<uint8_t> buffer) override {
+                DWORD n;
+                if (!WinHttpReadData(request_, buffer.data(), (DWORD) std::min<size_t>(buffer.size(), 1u << 30), &n)) {
+                    throw_last_error("WinHttpReadData");
+                }
+                return n;
+            }
+
+        private:
+            std::optional<std::string> query_header(DWORD info) {
+                DWORD size = 0;
+                WinHttpQueryHeaders(request_, info, WINHTTP_HEADER_NAME_BY_INDEX, WINHTTP_NO_OUTPUT_BUFFER, &size,
+                                    WINHTTP_NO_HEADER_INDEX);
+                if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) return std::nullopt;
+                std::wstring value(size / sizeof(wchar_t), L'\0');
+                if (!WinHttpQueryHeaders(request_, info, WINHTTP_HEADER_NAME_BY_INDEX, value.data(), &size,
+                                         WINHTTP_NO_HEADER_INDEX)) {
+                    return std::nullopt;
+                }
+                value.resize(size / sizeof(wchar_t));
+                return narrow(value);
+            }
+        };
+    }
+
+    ConnectionFactory default_connection_factory(const std::string& user_agent) {
+        auto session = std::make_shared<Session>(user_agent);
+        return [session] { return std::make_unique<WinHttpConnection>(session); };
+    }
+}
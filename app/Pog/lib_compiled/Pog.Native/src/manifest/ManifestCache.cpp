@@ -0,0 +1,409 @@
+#include "ManifestCache.hpp"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include "archive/Crc32.hpp"
+
+namespace fs = std::filesystem;
+
+namespace manifest {
+    namespace {
+        constexpr char MAGIC[8] = {'P', 'O', 'G', 'M', 'F', 'C', 'H', '1'};
+        constexpr char RECORD_MAGIC[4] = {'M', 'F', 'C', 'E'};
+        constexpr std::string_view FILE_PREFIX = "manifest-cache.";
+        constexpr std::string_view TMP_INFIX = ".tmp-";
+        /// Temporary files of crashed writers are deleted after this time.
+        constexpr auto STALE_TMP_FILE = std::chrono::minutes(1);
+
+        // all offsets are from the start of the file, and all sections are 4-byte aligned; the file is little-endian,
+        //  like all platforms Pog runs on
+        struct Header {
+            char magic[8];
+            uint32_t entry_count;
+            /// Power of 2, at least twice the entry count, or 0 if there are no entries.
+            uint32_t bucket_count;
+            uint32_t entries_offset;
+            uint32_t buckets_offset;
+            uint32_t strings_offset;
+            uint32_t strings_size;
+            /// Size of the base cache; appended records are after it.
+            uint32_t base_size;
+            uint32_t reserved;
+        };
+        static_assert(sizeof(Header) == 40);
+
+        struct EntryRecord {
+            uint8_t key[32];
+            uint32_t offset;
+            uint32_t size;
+        };
+        static_assert(sizeof(EntryRecord) == 40);
+
+        // followed by the manifest, padded to 4 bytes; records are always read with `memcpy`
+        struct AppendRecordHeader {
+            char magic[4];
+            /// CRC-32 of the rest of the record.
+            uint32_t checksum;
+            /// Size of the whole record, including the header and padding.
+            uint32_t size;
+            uint32_t manifest_size;
+            uint8_t key[32];
+        };
+        static_assert(sizeof(AppendRecordHeader) == 48);
+        constexpr size_t CHECKSUM_START = offsetof(AppendRecordHeader, size);
+
+        uint64_t key_hash(const uint8_t* key) {
+            uint64_t hash;
+            memcpy(&hash, key, sizeof(hash));
+            return hash;
+        }
+
+        CacheKey to_key(const uint8_t* key) {
+            CacheKey result;
+            memcpy(result.data(), key, result.size());
+            return result;
+        }
+
+        class Writer {
+        public:
+            std::vector<uint8_t> out;
+
+            size_t reserve(size_t size) {
+                auto offset = out.size();
+                out.resize(out.size() + size);
+                return offset;
+            }
+
+            void align() {
+                out.resize((out.size() + 3) & ~(size_t) 3);
+            }
+
+            template<typename T>
+            T& at(size_t offset) {
+                return *(T*) (out.data() + offset);
+            }
+        };
+
+        std::optional<uint64_t> parse_generation(const std::string& file_name) {
+            if (!file_name.starts_with(FILE_PREFIX) || file_name.size() == FILE_PREFIX.size()) return std::nullopt;
+            uint64_t generation = 0;
+            for (auto c : std::string_view{file_name}.substr(FILE_PREFIX.size())) {
+                if (c < '0' || c > '9') return std::nullopt;
+                generation = generation * 10 + (uint64_t) (c - '0');
+            }
+            return generation;
+        }
+
+        struct Generations {
+            std::optional<uint64_t> latest;
+            std::vector<std::pair<uint64_t, fs::path>> files;
+        };
+
+        Generations list_generations(const fs::path& dir) {
+            Generations result;
+            auto now = fs::file_time_type::clock::now();
+            std::error_code list_error;
+            fs::directory_iterator listing{dir, list_error};
+            if (list_error) throw IoError("Could not list the manifest cache directory.", list_error.value());
+            for (auto& item : listing) {
+                auto name = item.path().filename().string();
+                if (auto generation = parse_generation(name)) {
+                    result.files.emplace_back(*generation, item.path());
+                    result.latest = std::max(result.latest.value_or(0), *generation);
+                } else if (name.starts_with(FILE_PREFIX) && name.find(TMP_INFIX) != std::string::npos) {
+                    std::error_code ec;
+                    auto time = fs::last_write_time(item.path(), ec);
+                    if (!ec && now - time > STALE_TMP_FILE) fs::remove(item.path(), ec);
+                }
+            }
+            std::sort(result.files.begin(), result.files.end(), std::greater{});
+            return result;
+        }
+
+        std::vector<uint8_t> serialize_record(const CacheKey& key, std::string_view manifest) {
+            if (manifest.size() > UINT32_MAX - sizeof(AppendRecordHeader) - 3) {
+                throw std::invalid_argument("The manifest is too large to be cached.");
+            }
+            Writer w;
+            w.reserve(sizeof(AppendRecordHeader));
+            w.out.insert(w.out.end(), manifest.begin(), manifest.end());
+            w.align();
+
+            AppendRecordHeader header{};
+            memcpy(header.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC));
+            header.size = (uint32_t) w.out.size();
+            header.manifest_size = (uint32_t) manifest.size();
+            memcpy(header.key, key.data(), key.size());
+            memcpy(w.out.data(), &header, sizeof(header));
+            header.checksum = archive::crc32(std::span{w.out}.subspan(CHECKSUM_START));
+            memcpy(w.out.data(), &header, sizeof(header));
+            return std::move(w.out);
+        }
+
+        struct AppendRecord {
+            CacheKey key;
+            std::string_view manifest;
+            uint32_t size;
+        };
+
+        /// Reads the appended record at the start of `data`, returns nothing if it's incomplete or corrupted.
+        std::optional<AppendRecord> read_record(std::span<const uint8_t> data) {
+            AppendRecordHeader header;
+            if (data.size() < sizeof(header)) return std::nullopt;
+            memcpy(&header, data.data(), sizeof(header));
+            if (memcmp(header.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) || header.size < sizeof(header) ||
+                header.size % 4 != 0 || header.size > data.size() ||
+                header.manifest_size > header.size - sizeof(header)) {
+                return std::nullopt;
+            }
+            if (archive::crc32(data.subspan(CHECKSUM_START, header.size - CHECKSUM_START)) != header.checksum) {
+                return std::nullopt;
+            }
+            return AppendRecord{to_key(header.key),
+                                {(const char*) data.data() + sizeof(header), header.manifest_size}, header.size};
+        }
+    }
+
+    size_t ManifestCache::KeyHash::operator()(const CacheKey& key) const {
+        return (size_t) key_hash(key.data());
+    }
+
+    std::vector<uint8_t> build_cache(const std::vector<CacheEntry>& entries) {
+        // at most half of the buckets are used, so that misses end after a few probes
+        if (entries.size() >= UINT32_MAX / 4) throw std::invalid_argument("Too many entries in the manifest cache.");
+        auto bucket_count = entries.empty() ? 0 : std::bit_ceil((uint32_t) entries.size() * 2);
+
+        Writer w;
+        w.reserve(sizeof(Header));
+        auto entries_offset = w.reserve(entries.size() * sizeof(EntryRecord));
+        auto buckets_offset = w.reserve((size_t) bucket_count * sizeof(uint32_t));
+        auto strings_offset = w.out.size();
+        for (size_t i = 0; i < entries.size(); i++) {
+            auto& e = entries[i];
+            EntryRecord record{};
+            memcpy(record.key, e.key.data(), e.key.size());
+            record.offset = (uint32_t) w.out.size();
+            record.size = (uint32_t) e.manifest.size();
+            w.out.insert(w.out.end(), e.manifest.begin(), e.manifest.end());
+            if (w.out.size() > UINT32_MAX) throw std::invalid_argument("The manifest cache is too large.");
+            w.at<EntryRecord>(entries_offset + i * sizeof(EntryRecord)) = record;
+
+            // linear probing; the table is never full
+            auto mask = bucket_count - 1;
+            for (auto b = (uint32_t) key_hash(e.key.data()) & mask;; b = (b + 1) & mask) {
+                auto& bucket = w.at<uint32_t>(buckets_offset + b * sizeof(uint32_t));
+                if (bucket == 0) {
+                    bucket = (uint32_t) i + 1;
+                    break;
+                }
+                auto& other = w.at<EntryRecord>(entries_offset + (bucket - 1) * sizeof(EntryRecord));
+                if (memcmp(other.key, record.key, sizeof(record.key)) == 0) {
+                    throw std::invalid_argument("Duplicate key in the manifest cache.");
+                }
+            }
+        }
+        auto strings_size = w.out.size() - strings_offset;
+        w.align();
+        if (w.out.size() > UINT32_MAX) throw std::invalid_argument("The manifest cache is too large.");
+
+        auto& header = w.at<Header>(0);
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.entry_count = (uint32_t) entries.size();
+        header.bucket_count = bucket_count;
+        header.entries_offset = (uint32_t) entries_offset;
+        header.buckets_offset = (uint32_t) buckets_offset;
+        header.strings_offset = (uint32_t) strings_offset;
+        header.strings_size = (uint32_t) strings_size;
+        header.base_size = (uint32_t) w.out.size();
+        return std::move(w.out);
+    }
+
+    fs::path write_cache(const path_char* dir, const std::vector<CacheEntry>& entries) {
+        auto contents = build_cache(entries);
+        auto generations = list_generations(dir);
+        for (auto generation = generations.latest.value_or(0) + 1;; generation++) {
+            auto name = std::string(FILE_PREFIX) + std::to_string(generation);
+            auto path = fs::path(dir) / name;
+            auto tmp_path = fs::path(dir) / (name + std::string(TMP_INFIX) + std::to_string(std::random_device{}()));
+            write_file(tmp_path.c_str(), contents);
+
+            // unlike a rename, a hard link fails if the target already exists, e.g. when another process merged
+            //  the cache concurrently; the newer generation wins either way
+            std::error_code link_error;
+            fs::create_hard_link(tmp_path, path, link_error);
+            std::error_code ec;
+            fs::remove(tmp_path, ec);
+            if (!link_error) return path;
+            if (!fs::exists(path, ec)) throw IoError("Could not write the manifest cache.", link_error.value());
+        }
+    }
+
+    struct ManifestCache::Layout {
+        const Header* header;
+        const EntryRecord* entries;
+        const uint32_t* buckets;
+        const char* base;
+
+        /// Entries of the replayed records, in the order they were appended.
+        std::vector<AppendRecord> appended{};
+        /// Key -> index in `appended`.
+        std::unordered_map<CacheKey, uint32_t, KeyHash> appended_keys{};
+        /// End of the last replayed record.
+        uint64_t end = 0;
+
+        [[nodiscard]] std::string_view manifest(const EntryRecord& entry) const {
+            return {base + entry.offset, entry.size};
+        }
+
+        [[nodiscard]] std::optional<std::string_view> find(const CacheKey& key) const {
+            auto mask = header->bucket_count - 1;
+            // the table is never full, but the probe count is bounded anyway, so that a corrupted file cannot hang
+            auto b = (uint32_t) key_hash(key.data()) & mask;
+            for (uint32_t probe = 0; probe < header->bucket_count; probe++, b = (b + 1) & mask) {
+                if (buckets[b] == 0) break;
+                auto& entry = entries[buckets[b] - 1];
+                if (memcmp(entry.key, key.data(), key.size()) == 0) return manifest(entry);
+            }
+            if (auto it = appended_keys.find(key); it != appended_keys.end()) return appended[it->second].manifest;
+            return std::nullopt;
+        }
+    };
+
+    ManifestCache::ManifestCache(const path_char* path, uint64_t size_limit)
+            : path_{path}, file_{path}, size_limit_{size_limit} {
+        auto data = file_.data();
+        auto invalid = [] { return IoError("Invalid manifest cache file.", 0); };
+        if (data.size() < sizeof(Header) || memcmp(data.data(), MAGIC, sizeof(MAGIC))) throw invalid();
+
+        auto& h = *(const Header*) data.data();
+        auto section_ok = [&](uint64_t offset, uint64_t size) {
+            return offset % 4 == 0 && offset <= data.size() && size <= data.size() - offset;
+        };
+        if ((h.entry_count == 0) != (h.bucket_count == 0) || (h.bucket_count && !std::has_single_bit(h.bucket_count)) ||
+            h.bucket_count / 2 < h.entry_count) {
+            throw invalid();
+        }
+        if (!section_ok(h.entries_offset, (uint64_t) h.entry_count * sizeof(EntryRecord)) ||
+            !section_ok(h.buckets_offset, (uint64_t) h.bucket_count * sizeof(uint32_t)) ||
+            h.strings_offset > data.size() || h.strings_size > data.size() - h.strings_offset ||
+            !section_ok(h.base_size, 0) || h.base_size < (uint64_t) h.strings_offset + h.strings_size) {
+            throw invalid();
+        }
+
+        auto base = (const char*) data.data();
+        auto layout = std::make_unique<Layout>(Layout{
+            &h, (const EntryRecord*) (base + h.entries_offset), (const uint32_t*) (base + h.buckets_offset), base});
+        // validated once, so that lookups can trust the offsets; a linear pass over 40 bytes per entry, which is
+        //  negligible compared to parsing a single manifest
+        uint64_t strings_end = (uint64_t) h.strings_offset + h.strings_size;
+        for (uint32_t i = 0; i < h.entry_count; i++) {
+            auto& e = layout->entries[i];
+            if (e.offset < h.strings_offset || e.offset > strings_end || e.size > strings_end - e.offset) {
+                throw invalid();
+            }
+        }
+        for (uint32_t i = 0; i < h.bucket_count; i++) {
+            if (layout->buckets[i] > h.entry_count) throw invalid();
+        }
+
+        // replay the appended records; an entry that's already present was appended by a process with an outdated
+        //  view, and is skipped
+        layout->end = h.base_size;
+        while (auto record = read_record(data.subspan(layout->end))) {
+            layout->end += record->size;
+            if (layout->find(record->key)) continue;
+            layout->appended_keys.emplace(record->key, (uint32_t) layout->appended.size());
+            layout->appended.push_back(*record);
+        }
+
+        append_path_ = path_;
+        append_offset_ = layout->end;
+        append_base_size_ = h.base_size;
+        layout_ = std::move(layout);
+    }
+
+    ManifestCache::~ManifestCache() = default;
+
+    std::unique_ptr<ManifestCache> ManifestCache::open(const path_char* dir, uint64_t size_limit) {
+        // retried if the written empty cache is deleted by a concurrent open of a newer generation before it's opened
+        for (auto attempt = 0;; attempt++) {
+            auto generations = list_generations(dir);
+            std::unique_ptr<ManifestCache> cache;
+            for (auto& [generation, path] : generations.files) {
+                if (!cache) {
+                    try {
+                        cache = std::make_unique<ManifestCache>(path.c_str(), size_limit);
+                        continue;
+                    } catch (const IoError&) {
+                        // deleted by a concurrent open of a newer generation, or invalid (an incompatible version,
+                        //  or a disk corruption); the older generations are still usable
+                    }
+                }
+                // fails on Windows while another process still has the file open, it's retried on the next open
+                std::error_code ec;
+                fs::remove(path, ec);
+            }
+            if (cache) return cache;
+            auto path = write_cache(dir, {});
+            if (attempt > 0) return std::make_unique<ManifestCache>(path.c_str(), size_limit);
+        }
+    }
+
+    std::optional<std::string_view> ManifestCache::find(const CacheKey& key) const {
+        if (auto manifest = layout_->find(key)) return manifest;
+        std::lock_guard lock{append_mutex_};
+        if (auto it = added_.find(key); it != added_.end()) return it->second;
+        return std::nullopt;
+    }
+
+    uint32_t ManifestCache::entry_count() const {
+        return layout_->header->entry_count + (uint32_t) layout_->appended.size();
+    }
+
+    void ManifestCache::add(const CacheKey& key, std::string_view manifest) {
+        if (layout_->find(key)) return;
+        std::lock_guard lock{append_mutex_};
+        if (added_.contains(key)) return;
+
+        auto record = serialize_record(key, manifest);
+        {
+            RandomAccessFile file{append_path_.c_str()};
+            file.write_at(append_offset_, record);
+        }
+        append_offset_ += record.size();
+        added_.emplace(key, manifest);
+
+        // replaying the records on each open costs about as much as validating a quarter of the base cache, merge
+        //  them into a new generation; the current file may contain records appended by other processes
+        auto appended_size = append_offset_ - append_base_size_;
+        if (appended_size <= std::max(append_base_size_ / 4, MIN_MERGE_SIZE)) return;
+
+        ManifestCache current{append_path_.c_str()};
+        auto& l = *current.layout_;
+        std::vector<CacheEntry> entries;
+        entries.reserve(l.header->entry_count + l.appended.size() + added_.size());
+        for (uint32_t i = 0; i < l.header->entry_count; i++) {
+            entries.push_back({to_key(l.entries[i].key), std::string(l.manifest(l.entries[i]))});
+        }
+        for (auto& r : l.appended) entries.push_back({r.key, std::string(r.manifest)});
+        // records of this instance overwritten by a concurrent append are kept as the newest entries
+        for (auto& [k, m] : added_) {
+            if (!l.find(k)) entries.push_back({k, m});
+        }
+
+        // keep the newest entries that fit into the size limit; the dropped ones are mostly from outdated templates
+        uint64_t kept_size = 0;
+        auto first_kept = entries.size();
+        while (first_kept > 0 && kept_size + entries[first_kept - 1].manifest.size() <= size_limit_) {
+            kept_size += entries[--first_kept].manifest.size();
+        }
+        entries.erase(entries.begin(), entries.begin() + (ptrdiff_t) first_kept);
+
+        append_path_ = write_cache(path_.parent_path().c_str(), entries);
+        append_offset_ = append_base_size_ = fs::file_size(append_path_);
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "MappedFile.hpp"
+
+// Cache of compiled package manifests (`TemplatedLocalRepositoryPackage` in Pog.dll). A templated package is compiled
+//  by substituting the values from the per-version data file into the shared template, which costs two full
+//  PowerShell parses per manifest; the cache stores the compiled manifest text under a key derived from the content
+//  hashes of the template and of the data file, so that a changed template or data file gets a new key, and stale
+//  entries are never returned. Keys are computed by the caller, the cache only maps 32-byte keys to manifests.
+//
+// The cache file (`manifest-cache.<generation>`) contains the entries (key, manifest offset and size) in the order
+//  they were added, an open-addressing hash table of the entries, indexed by the first 8 bytes of the key (the keys
+//  are hashes, so they need no further mixing), and the manifest texts. Like the repository index
+//  (`repository/RepositoryIndex.hpp`), the file is memory-mapped by all Pog processes, and new entries are appended
+//  to the end of the current generation as checksummed records, which are replayed into a small overlay when
+//  the cache is opened. Two processes appending at the same time may overwrite each other's records, which only
+//  loses the cache entries. Once the records grow to a quarter of the base cache (and at least `MIN_MERGE_SIZE`),
+//  they're merged into a new generation, dropping the oldest entries if the manifests exceed the size limit.
+namespace manifest {
+    using CacheKey = std::array<uint8_t, 32>;
+
+    struct CacheEntry {
+        CacheKey key;
+        std::string manifest;
+    };
+
+    /// Serializes `entries` into the cache file format. Throws `std::invalid_argument` for duplicate keys.
+    std::vector<uint8_t> build_cache(const std::vector<CacheEntry>& entries);
+
+    /// Writes `entries` (oldest first) as the next generation of the cache in `dir` (which must exist) and returns its
+    /// path. Throws `IoError` or `std::invalid_argument`.
+    std::filesystem::path write_cache(const path_char* dir, const std::vector<CacheEntry>& entries);
+
+    /// View of a cache file; lookups and appends may be used from multiple threads at once.
+    class ManifestCache {
+    public:
+        /// Total size of the manifests kept when the cache is merged into a new generation.
+        static constexpr uint64_t DEFAULT_SIZE_LIMIT = 64 << 20;
+        /// Appended records smaller than this are not merged into a new generation, so that filling an empty cache
+        /// does not rewrite it on each added entry.
+        static constexpr uint64_t MIN_MERGE_SIZE = 64 << 10;
+
+    private:
+        struct Layout;
+        struct KeyHash {
+            size_t operator()(const CacheKey& key) const;
+        };
+
+        const std::filesystem::path path_;
+        const MappedFile file_;
+        const uint64_t size_limit_;
+        std::unique_ptr<const Layout> layout_;
+
+        /// Entries added by this instance, which are not in the mapped view; also guards the append state.
+        mutable std::mutex append_mutex_;
+        std::unordered_map<CacheKey, std::string, KeyHash> added_;
+        std::filesystem::path append_path_;
+        uint64_t append_offset_;
+        uint64_t append_base_size_;
+
+    public:
+        /// Maps and validates the cache file at `path`. Throws `IoError` if it cannot be read or is invalid.
+        explicit ManifestCache(const path_char* path, uint64_t size_limit = DEFAULT_SIZE_LIMIT);
+        ~ManifestCache();
+
+        ManifestCache(const ManifestCache&) = delete;
+        ManifestCache& operator=(const ManifestCache&) = delete;
+
+        /// Opens the newest valid generation of the cache in `dir` (which must exist), and deletes the older ones;
+        /// writes an empty cache first if there's none. Throws `IoError`.
+        static std::unique_ptr<ManifestCache> open(const path_char* dir, uint64_t size_limit = DEFAULT_SIZE_LIMIT);
+
+        /// Returns the manifest stored under `key`; valid until the cache is destroyed.
+        [[nodiscard]] std::optional<std::string_view> find(const CacheKey& key) const;
+
+        /// Number of entries in the mapped view, without the ones added by this instance.
+        [[nodiscard]] uint32_t entry_count() const;
+
+        [[nodiscard]] const std::filesystem::path& path() const {
+            return path_;
+        }
+
+        /// Stores `manifest` under `key`, unless there's already an entry for it. The entry is visible to `find`
+        /// of this instance right away, other instances must reopen the cache. Throws `IoError`.
+        void add(const CacheKey& key, std::string_view manifest);
+    };
+}
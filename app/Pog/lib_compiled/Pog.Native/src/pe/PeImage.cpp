@@ -0,0 +1,107 @@
+#include "PeImage.hpp"
+#include <algorithm>
+
+namespace pe {
+    PeImage::PeImage(bytes data) : data_{data} {
+        if (data.size() < 0x40 || read_u16(data, 0) != 0x5a4d) { // "MZ"
+            throw PeError("Not a PE image, missing the DOS header.");
+        }
+        auto pe_offset = read_u32(data, 0x3c);
+        if (read_u32(data, pe_offset) != 0x0000'4550) { // "PE\0\0"
+            throw PeError("Not a PE image, missing the PE signature.");
+        }
+        coff_header_offset_ = (size_t) pe_offset + 4;
+        optional_header_offset_ = coff_header_offset_ + 20;
+        section_table_offset_ = optional_header_offset_ + size_of_optional_header();
+
+        magic_ = read_u16(data, optional_header_offset_);
+        if (magic_ != PE32_MAGIC && magic_ != PE32_PLUS_MAGIC) {
+            throw PeError("Unknown PE optional header type.");
+        }
+        // the optional header must contain at least the data directory count
+        if (size_of_optional_header() < (is_pe32_plus() ? 112 : 96)) {
+            throw PeError("Truncated PE optional header.");
+        }
+        if (data_directory_offset(DataDirectory{data_directory_count()}) > section_table_offset_) {
+            throw PeError("Invalid PE data directory count.");
+        }
+
+        auto section_alignment = this->section_alignment();
+        auto file_alignment = this->file_alignment();
+        if (section_alignment == 0 || (section_alignment & (section_alignment - 1)) != 0
+            || file_alignment == 0 || (file_alignment & (file_alignment - 1)) != 0) {
+            throw PeError("Invalid PE section or file alignment.");
+        }
+
+        auto section_count = read_u16(data, coff_header_offset_ + 2);
+        if (section_table_offset_ + (size_t) section_count * sizeof(SectionHeader) > data.size()) {
+            throw PeError("Truncated PE section table.");
+        }
+        auto headers_size = size_of_headers();
+        if (headers_size > data.size() || headers_size < section_table_offset_ + section_count * sizeof(SectionHeader)) {
+            throw PeError("Invalid PE header size.");
+        }
+        sections_.resize(section_count);
+        memcpy(sections_.data(), data.data() + section_table_offset_, section_count * sizeof(SectionHeader));
+        for (auto& s : sections_) {
+            if ((uint64_t) s.pointer_to_raw_data + s.size_of_raw_data > data.size()) {
+                throw PeError("PE section extends past the end of the file.");
+            }
+        }
+    }
+
+    uint32_t PeImage::data_directory_count() const {
+        return read_u32(data_, optional_header_offset_ + (is_pe32_plus() ? 108 : 92));
+    }
+
+    size_t PeImage::data_directory_offset(DataDirectory index) const {
+        return optional_header_offset_ + (is_pe32_plus() ? 112 : 96) + (size_t) index * sizeof(DataDirectoryEntry);
+    }
+
+    DataDirectoryEntry PeImage::data_directory(DataDirectory index) const {
+        if ((uint32_t) index >= data_directory_count()) return {0, 0};
+        auto offset = data_directory_offset(index);
+        return {read_u32(data_, offset), read_u32(data_, offset + 4)};
+    }
+
+    ptrdiff_t PeImage::find_section(uint32_t rva) const {
+        for (size_t i = 0; i < sections_.size(); i++) {
+            auto& s = sections_[i];
+            auto size = std::max(s.virtual_size, s.size_of_raw_data);
+            if (rva >= s.virtual_address && rva - s.virtual_address < size) return (ptrdiff_t) i;
+        }
+        return -1;
+    }
+
+    bytes PeImage::read_rva(uint32_t rva, uint32_t size) const {
+        auto index = find_section(rva);
+        if (index < 0) throw PeError("PE data outside of any section.");
+        auto& s = sections_[index];
+        auto section_offset = rva - s.virtual_address;
+        if ((uint64_t) section_offset + size > s.size_of_raw_data) {
+            throw PeError("PE data is not backed by the file.");
+        }
+        return data_.subspan(s.pointer_to_raw_data + section_offset, size);
+    }
+
+    size_t PeImage::end_of_sections() const {
+        size_t end = size_of_headers();
+        for (auto& s : sections_) {
+            if (s.size_of_raw_data != 0) end = std::max(end, (size_t) s.pointer_to_raw_data + s.size_of_raw_data);
+        }
+        return end;
+    }
+
+    uint32_t compute_checksum(bytes data, size_t checksum_offset) {
+        // sum of all 16-bit words with end-around carry, the checksum field is treated as zero, plus the file size
+        uint64_t sum = 0;
+        for (size_t i = 0; i < data.size(); i += 2) {
+            if (i >= checksum_offset && i < checksum_offset + 4) continue;
+            uint32_t word = data[i] | (i + 1 < data.size() ? data[i + 1] << 8 : 0);
+            sum += word;
+            sum = (sum & 0xffff) + (sum >> 16);
+        }
+        sum = (sum & 0xffff) + (sum >> 16);
+        return (uint32_t) sum + (uint32_t) data.size();
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Minimal reader for the headers of PE images (https://learn.microsoft.com/en-us/windows/win32/debug/pe-format),
+//  with just enough support to locate and replace the resource section. Works on an in-memory image (typically
+//  a memory-mapped file), all accesses are bounds-checked, since the parsed files are arbitrary package binaries.
+namespace pe {
+    using bytes = std::span<const uint8_t>;
+
+    /// Thrown for malformed PE images, and for valid images with a layout we cannot modify.
+    class PeError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    enum class DataDirectory : uint32_t {
+        EXPORT = 0, IMPORT = 1, RESOURCE = 2, EXCEPTION = 3, SECURITY = 4, BASE_RELOCATION = 5,
+    };
+
+    constexpr uint32_t SCN_CNT_INITIALIZED_DATA = 0x0000'0040;
+    constexpr uint32_t SCN_MEM_READ = 0x4000'0000;
+
+    struct SectionHeader {
+        char name[8];
+        uint32_t virtual_size;
+        uint32_t virtual_address;
+        uint32_t size_of_raw_data;
+        uint32_t pointer_to_raw_data;
+        uint32_t pointer_to_relocations;
+        uint32_t pointer_to_line_numbers;
+        uint16_t number_of_relocations;
+        uint16_t number_of_line_numbers;
+        uint32_t characteristics;
+
+        [[nodiscard]] std::string_view name_view() const {
+            return {name, strnlen(name, sizeof(name))};
+        }
+    };
+    static_assert(sizeof(SectionHeader) == 40);
+
+    struct DataDirectoryEntry {
+        uint32_t rva;
+        uint32_t size;
+    };
+
+    /// Little-endian unaligned reads and writes, bounds-checked against the buffer.
+    inline uint16_t read_u16(bytes data, size_t offset) {
+        if (offset > data.size() || data.size() - offset < 2) throw PeError("Truncated PE image.");
+        return (uint16_t) (data[offset] | data[offset + 1] << 8);
+    }
+
+    inline uint32_t read_u32(bytes data, size_t offset) {
+        if (offset > data.size() || data.size() - offset < 4) throw PeError("Truncated PE image.");
+        return (uint32_t) data[offset] | (uint32_t) data[offset + 1] << 8 | (uint32_t) data[offset + 2] << 16
+               | (uint32_t) data[offset + 3] << 24;
+    }
+
+    inline void write_u16(std::span<uint8_t> data, size_t offset, uint16_t n) {
+        data[offset] = (uint8_t) n;
+        data[offset + 1] = (uint8_t) (n >> 8);
+    }
+
+    inline void write_u32(std::span<uint8_t> data, size_t offset, uint32_t n) {
+        for (int i = 0; i < 4; i++) data[offset + i] = (uint8_t) (n >> (8 * i));
+    }
+
+    constexpr uint32_t align_up(uint32_t n, uint32_t alignment) {
+        return (n + alignment - 1) & ~(alignment - 1);
+    }
+
+    /// Parsed headers of a PE image. Does not own the image, which must outlive this object.
+    class PeImage {
+    public:
+        static constexpr uint16_t PE32_MAGIC = 0x10b;
+        static constexpr uint16_t PE32_PLUS_MAGIC = 0x20b;
+
+    private:
+        bytes data_;
+        size_t coff_header_offset_;
+        size_t optional_header_offset_;
+        size_t section_table_offset_;
+        uint16_t magic_;
+        std::vector<SectionHeader> sections_;
+
+    public:
+        /// Parses the headers of `data`, throws `PeError` if it's not a valid PE image.
+        explicit PeImage(bytes data);
+
+        [[nodiscard]] bytes data() const { return data_; }
+        [[nodiscard]] bool is_pe32_plus() const { return magic_ == PE32_PLUS_MAGIC; }
+        [[nodiscard]] const std::vector<SectionHeader>& sections() const { return sections_; }
+
+        [[nodiscard]] size_t coff_header_offset() const { return coff_header_offset_; }
+        [[nodiscard]] size_t optional_header_offset() const { return optional_header_offset_; }
+        [[nodiscard]] size_t section_table_offset() const { return section_table_offset_; }
+
+        [[nodiscard]] uint16_t machine() const { return read_u16(data_, coff_header_offset_); }
+        [[nodiscard]] uint16_t size_of_optional_header() const { return read_u16(data_, coff_header_offset_ + 16); }
+
+        [[nodiscard]] uint32_t section_alignment() const { return read_u32(data_, optional_header_offset_ + 32); }
+        [[nodiscard]] uint32_t file_alignment() const { return read_u32(data_, optional_header_offset_ + 36); }
+        [[nodiscard]] uint32_t size_of_headers() const { return read_u32(data_, optional_header_offset_ + 60); }
+        [[nodiscard]] uint32_t checksum() const { return read_u32(data_, optional_header_offset_ + 64); }
+        [[nodiscard]] uint16_t subsystem() const { return read_u16(data_, optional_header_offset_ + 68); }
+
+        // offsets of header fields, used when writing a modified image
+        [[nodiscard]] size_t size_of_initialized_data_offset() const { return optional_header_offset_ + 8; }
+        [[nodiscard]] size_t size_of_image_offset() const { return optional_header_offset_ + 56; }
+        [[nodiscard]] size_t checksum_offset() const { return optional_header_offset_ + 64; }
+        [[nodiscard]] size_t subsystem_offset() const { return optional_header_offset_ + 68; }
+
+        [[nodiscard]] uint32_t data_directory_count() const;
+        /// Returns `{0, 0}` for directories which are not present.
+        [[nodiscard]] DataDirectoryEntry data_directory(DataDirectory index) const;
+        [[nodiscard]] size_t data_directory_offset(DataDirectory index) const;
+
+        /// Returns the index of the section containing `rva`, or -1.
+        [[nodiscard]] ptrdiff_t find_section(uint32_t rva) const;
+        /// Returns `size` bytes of the image mapped at `rva`, throws `PeError` if they are not backed by the file.
+        [[nodiscard]] bytes read_rva(uint32_t rva, uint32_t size) const;
+        /// File offset of the end of the last section, anything after it is overlay data (e.g. a signature).
+        [[nodiscard]] size_t end_of_sections() const;
+    };
+
+    /// Computes the PE image checksum (the same value as `CheckSumMappedFile`), with the checksum field skipped.
+    uint32_t compute_checksum(bytes data, size_t checksum_offset);
+}
@@ -0,0 +1,152 @@
+#include "PeWriter.hpp"
+#include <algorithm>
+#include <numeric>
+
+namespace pe {
+    namespace {
+        bool is_movable(const SectionHeader& section) {
+            // base relocations do not contain their own RVA, so the section can be moved freely
+            return section.name_view() == ".reloc";
+        }
+
+        /// Returns the index of the resource section in `sections`, appending a new section if there is none.
+        size_t find_or_add_resource_section(const PeImage& image, std::vector<SectionHeader>& sections) {
+            auto resource_dir = image.data_directory(DataDirectory::RESOURCE);
+            if (resource_dir.rva != 0) {
+                auto index = image.find_section(resource_dir.rva);
+                if (index < 0) throw PeError("Resource directory outside of any section.");
+                if (sections[index].virtual_address != resource_dir.rva) {
+                    throw PeError("Unsupported PE layout, the resource directory does not start its section.");
+                }
+                return (size_t) index;
+            }
+
+            if ((uint32_t) DataDirectory::RESOURCE >= image.data_directory_count()) {
+                throw PeError("PE image has no resource data directory entry.");
+            }
+            // there must be space for another section header before the first section
+            auto header_end = image.section_table_offset() + (sections.size() + 1) * sizeof(SectionHeader);
+            auto first_raw = (size_t) image.size_of_headers();
+            for (auto& s : sections) {
+                if (s.size_of_raw_data != 0) first_raw = std::min(first_raw, (size_t) s.pointer_to_raw_data);
+            }
+            if (header_end > first_raw) throw PeError("No space for a new section header in the PE image.");
+
+            uint32_t end_rva = 0;
+            for (auto& s : sections) end_rva = std::max(end_rva, s.virtual_address + s.virtual_size);
+            SectionHeader rsrc{};
+            memcpy(rsrc.name, ".rsrc", 5);
+            rsrc.virtual_address = align_up(end_rva, image.section_alignment());
+            rsrc.pointer_to_raw_data = align_up((uint32_t) image.end_of_sections(), image.file_alignment());
+            rsrc.characteristics = SCN_CNT_INITIALIZED_DATA | SCN_MEM_READ;
+            sections.push_back(rsrc);
+            return sections.size() - 1;
+        }
+    }
+
+    std::vector<uint8_t> write_image(const PeImage& image, const ImageChanges& changes) {
+        auto data = image.data();
+        auto section_alignment = image.section_alignment();
+        auto file_alignment = image.file_alignment();
+
+        if (image.data_directory(DataDirectory::SECURITY).rva != 0) {
+            throw PeError("Cannot modify a signed PE image.");
+        }
+        auto overlay = data.subspan(std::min(image.end_of_sections(), data.size()));
+
+        auto sections = image.sections();
+        std::vector<bytes> contents;
+        for (auto& s : sections) contents.push_back(data.subspan(s.pointer_to_raw_data, s.size_of_raw_data));
+
+        std::vector<uint8_t> resource_section;
+        ptrdiff_t rsrc_index = -1;
+        if (changes.resources) {
+            rsrc_index = (ptrdiff_t) find_or_add_resource_section(image, sections);
+            auto& rsrc = sections[rsrc_index];
+            resource_section = write_resource_section(*changes.resources, rsrc.virtual_address);
+            rsrc.virtual_size = (uint32_t) resource_section.size();
+            rsrc.size_of_raw_data = align_up(rsrc.virtual_size, file_alignment);
+            contents.resize(sections.size());
+            contents[rsrc_index] = resource_section;
+        }
+
+        // move the sections after the resource section, so that they follow its new end
+        std::vector<size_t> order(sections.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](auto a, auto b) {
+            return sections[a].virtual_address < sections[b].virtual_address;
+        });
+        std::vector<std::pair<uint32_t, uint32_t>> moved_rvas; // (old RVA, new RVA)
+        uint32_t end_rva = 0, end_raw = image.size_of_headers();
+        auto after_rsrc = false;
+        for (auto i : order) {
+            auto& s = sections[i];
+            if (after_rsrc) {
+                if (!is_movable(s)) {
+                    throw PeError("Unsupported PE layout, the resource section is followed by a non-movable section.");
+                }
+                auto new_rva = align_up(end_rva, section_alignment);
+                moved_rvas.emplace_back(s.virtual_address, new_rva);
+                s.virtual_address = new_rva;
+                if (s.size_of_raw_data != 0) s.pointer_to_raw_data = align_up(end_raw, file_alignment);
+            }
+            after_rsrc |= (ptrdiff_t) i == rsrc_index;
+            end_rva = std::max(end_rva, s.virtual_address + s.virtual_size);
+            if (s.size_of_raw_data != 0) end_raw = std::max(end_raw, s.pointer_to_raw_data + s.size_of_raw_data);
+        }
+
+        // the resource section may have grown into a section that is after it in the file, but not in the address space
+        std::sort(order.begin(), order.end(), [&](auto a, auto b) {
+            return sections[a].pointer_to_raw_data < sections[b].pointer_to_raw_data;
+        });
+        for (size_t i = 1; i < order.size(); i++) {
+            auto& prev = sections[order[i - 1]];
+            if (sections[order[i]].size_of_raw_data != 0
+                && prev.pointer_to_raw_data + prev.size_of_raw_data > sections[order[i]].pointer_to_raw_data) {
+                throw PeError("Unsupported PE layout, sections would overlap in the file.");
+            }
+        }
+
+        // copy the headers, sections and the overlay
+        std::vector<uint8_t> out(end_raw + overlay.size(), 0);
+        std::copy(data.begin(), data.begin() + image.size_of_headers(), out.begin());
+        write_u16(out, image.coff_header_offset() + 2, (uint16_t) sections.size());
+        memcpy(out.data() + image.section_table_offset(), sections.data(), sections.size() * sizeof(SectionHeader));
+        for (size_t i = 0; i < sections.size(); i++) {
+            std::copy(contents[i].begin(), contents[i].end(), out.begin() + sections[i].pointer_to_raw_data);
+        }
+        std::copy(overlay.begin(), overlay.end(), out.begin() + end_raw);
+
+        // update the data directories pointing into moved sections
+        for (uint32_t d = 0; d < std::min(image.data_directory_count(), 16u); d++) {
+            auto dir = image.data_directory(DataDirectory{d});
+            auto index = dir.rva ? image.find_section(dir.rva) : -1;
+            for (auto& [old_rva, new_rva] : moved_rvas) {
+                if (index >= 0 && image.sections()[index].virtual_address == old_rva) {
+                    write_u32(out, image.data_directory_offset(DataDirectory{d}), dir.rva - old_rva + new_rva);
+                }
+            }
+        }
+
+        // update the optional header
+        if (rsrc_index >= 0) {
+            auto offset = image.data_directory_offset(DataDirectory::RESOURCE);
+            write_u32(out, offset, sections[rsrc_index].virtual_address);
+            write_u32(out, offset + 4, sections[rsrc_index].virtual_size);
+        }
+        uint32_t initialized_data = 0;
+        for (auto& s : sections) {
+            if (s.characteristics & SCN_CNT_INITIALIZED_DATA) initialized_data += s.size_of_raw_data;
+        }
+        write_u32(out, image.size_of_initialized_data_offset(), initialized_data);
+        write_u32(out, image.size_of_image_offset(), align_up(end_rva, section_alignment));
+        if (changes.subsystem) {
+            write_u16(out, image.subsystem_offset(), *changes.subsystem);
+        }
+        // only update the checksum if the image has one, most executables do not
+        if (image.checksum() != 0) {
+            write_u32(out, image.checksum_offset(), compute_checksum(out, image.checksum_offset()));
+        }
+        return out;
+    }
+}
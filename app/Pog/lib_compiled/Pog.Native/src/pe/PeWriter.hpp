@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "PeImage.hpp"
+#include "ResourceTable.hpp"
+
+namespace pe {
+    struct ImageChanges {
+        /// New resources of the image; the whole resource section is rewritten.
+        const ResourceTable* resources = nullptr;
+        std::optional<uint16_t> subsystem = std::nullopt;
+    };
+
+    /// Builds a copy of `image` with the given changes applied, in a single pass over the image.
+    ///
+    /// The resource section is replaced in place; it may grow or shrink, in which case the sections following it
+    ///  are moved. Only `.reloc` sections may follow the resource section (this is the layout produced by MSVC),
+    ///  since other sections may be referenced by RVA from code. If the image has no resource section, a new one
+    ///  is appended after the last section. Overlay data after the sections is preserved, except for signed images,
+    ///  which are rejected, since the change would invalidate the signature anyway.
+    std::vector<uint8_t> write_image(const PeImage& image, const ImageChanges& changes);
+}
@@ -0,0 +1,295 @@
+#include "ResourceTable.hpp"
+
+namespace pe {
+    namespace {
+        constexpr size_t DIRECTORY_HEADER_SIZE = 16;
+        constexpr size_t DIRECTORY_ENTRY_SIZE = 8;
+        constexpr size_t DATA_ENTRY_SIZE = 16;
+        constexpr uint32_t HIGH_BIT = 0x8000'0000;
+        /// Limit on the number of visited directory entries, so that a malformed directory with shared subdirectories
+        /// cannot make us enumerate billions of entries.
+        constexpr size_t MAX_VISITED_ENTRIES = 1 << 20;
+
+        char16_t fold_case(char16_t c) {
+            return c >= 'a' && c <= 'z' ? (char16_t) (c - ('a' - 'A')) : c;
+        }
+
+        int compare_case_insensitive(const std::u16string& a, const std::u16string& b) {
+            for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+                auto ca = fold_case(a[i]), cb = fold_case(b[i]);
+                if (ca != cb) return ca < cb ? -1 : 1;
+            }
+            if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+            return 0;
+        }
+
+        class ResourceReader {
+        private:
+            const PeImage& image_;
+            uint32_t base_rva_;
+            ResourceTable& table_;
+            size_t visited_ = 0;
+
+        public:
+            ResourceReader(const PeImage& image, uint32_t base_rva, ResourceTable& table)
+                    : image_{image}, base_rva_{base_rva}, table_{table} {}
+
+            /// `depth` 0 is the type level, 1 the name level, 2 the language level.
+            void read_directory(uint32_t offset, int depth, ResourceKey& key) {
+                auto header = read(offset, DIRECTORY_HEADER_SIZE);
+                auto count = (size_t) read_u16(header, 12) + read_u16(header, 14);
+                auto entries = read(offset + DIRECTORY_HEADER_SIZE, (uint32_t) (count * DIRECTORY_ENTRY_SIZE));
+
+                for (size_t i = 0; i < count; i++) {
+                    if (++visited_ > MAX_VISITED_ENTRIES) throw PeError("Resource directory is too large.");
+                    auto name = read_u32(entries, i * DIRECTORY_ENTRY_SIZE);
+                    auto target = read_u32(entries, i * DIRECTORY_ENTRY_SIZE + 4);
+                    auto is_directory = (target & HIGH_BIT) != 0;
+                    target &= ~HIGH_BIT;
+
+                    if (depth == 2) {
+                        if (is_directory || (name & HIGH_BIT) != 0) throw PeError("Invalid resource language entry.");
+                        key.language = (uint16_t) name;
+                        read_data_entry(target, key);
+                    } else {
+                        if (!is_directory) throw PeError("Invalid resource directory entry.");
+                        (depth == 0 ? key.type : key.name) = read_name(name);
+                        read_directory(target, depth + 1, key);
+                    }
+                }
+            }
+
+            /// Returns the data of the first resource with the given type and name, walking only the matching
+            /// directory entries.
+            std::optional<bytes> find(const ResourceName& type, const ResourceName& name) {
+                auto name_dir = find_entry(0, type);
+                if (!name_dir) return std::nullopt;
+                auto language_dir = find_entry(*name_dir, name);
+                if (!language_dir) return std::nullopt;
+
+                auto header = read(*language_dir, DIRECTORY_HEADER_SIZE);
+                if ((size_t) read_u16(header, 12) + read_u16(header, 14) == 0) return std::nullopt;
+                auto entry = read(*language_dir + DIRECTORY_HEADER_SIZE, DIRECTORY_ENTRY_SIZE);
+                auto target = read_u32(entry, 4);
+                if ((target & HIGH_BIT) != 0) throw PeError("Invalid resource language entry.");
+                return read_data(target);
+            }
+
+        private:
+            /// Returns the offset of the subdirectory for `key` in the directory at `offset`, or nullopt if not found.
+            std::optional<uint32_t> find_entry(uint32_t offset, const ResourceName& key) {
+                auto header = read(offset, DIRECTORY_HEADER_SIZE);
+                auto count = (size_t) read_u16(header, 12) + read_u16(header, 14);
+                auto entries = read(offset + DIRECTORY_HEADER_SIZE, (uint32_t) (count * DIRECTORY_ENTRY_SIZE));
+                for (size_t i = 0; i < count; i++) {
+                    auto name = read_u32(entries, i * DIRECTORY_ENTRY_SIZE);
+                    // skip string names when looking for an ID without reading them
+                    if (key.is_string() != ((name & HIGH_BIT) != 0)) continue;
+                    if (!(read_name(name) == key)) continue;
+
+                    auto target = read_u32(entries, i * DIRECTORY_ENTRY_SIZE + 4);
+                    if ((target & HIGH_BIT) == 0) throw PeError("Invalid resource directory entry.");
+                    return target & ~HIGH_BIT;
+                }
+                return std::nullopt;
+            }
+
+            [[nodiscard]] bytes read(uint32_t offset, uint32_t size) const {
+                if (offset > UINT32_MAX - base_rva_) throw PeError("Invalid resource directory offset.");
+                return image_.read_rva(base_rva_ + offset, size);
+            }
+
+            [[nodiscard]] ResourceName read_name(uint32_t name) const {
+                if ((name & HIGH_BIT) == 0) {
+                    if (name > UINT16_MAX) throw PeError("Invalid resource ID.");
+                    return {(uint16_t) name};
+                }
+                auto offset = name & ~HIGH_BIT;
+                auto length = read_u16(read(offset, 2), 0);
+                if (length == 0) throw PeError("Empty resource name.");
+                auto str = read(offset + 2, length * 2u);
+                std::u16string result(length, u'\0');
+                for (size_t i = 0; i < length; i++) result[i] = read_u16(str, i * 2);
+                return ResourceName{std::move(result)};
+            }
+
+            /// Returns nullopt for resource data outside the image, the loader ignores these as well.
+            std::optional<bytes> read_data(uint32_t offset) const {
+                auto entry = read(offset, DATA_ENTRY_SIZE);
+                try {
+                    return image_.read_rva(read_u32(entry, 0), read_u32(entry, 4));
+                } catch (const PeError&) {
+                    return std::nullopt;
+                }
+            }
+
+            void read_data_entry(uint32_t offset, const ResourceKey& key) {
+                auto data = read_data(offset);
+                if (!data) return;
+                table_.set(key, {{data->begin(), data->end()}, read_u32(read(offset, DATA_ENTRY_SIZE), 8)});
+            }
+        };
+    }
+
+    bool operator<(const ResourceName& a, const ResourceName& b) {
+        if (a.is_string() != b.is_string()) return a.is_string();
+        if (!a.is_string()) return a.id < b.id;
+        auto cmp = compare_case_insensitive(a.str, b.str);
+        // names differing only in case are not equal, order them consistently
+        return cmp != 0 ? cmp < 0 : a.str < b.str;
+    }
+
+    bool operator==(const ResourceName& a, const ResourceName& b) {
+        return a.is_string() == b.is_string() && (a.is_string() ? a.str == b.str : a.id == b.id);
+    }
+
+    bool operator<(const ResourceKey& a, const ResourceKey& b) {
+        if (!(a.type == b.type)) return a.type < b.type;
+        if (!(a.name == b.name)) return a.name < b.name;
+        return a.language < b.language;
+    }
+
+    const Resource* ResourceTable::find(const ResourceName& type, const ResourceName& name) const {
+        auto it = resources_.lower_bound({type, name, 0});
+        if (it == resources_.end() || !(it->first.type == type) || !(it->first.name == name)) return nullptr;
+        return &it->second;
+    }
+
+    size_t ResourceTable::remove(const ResourceName& type, const ResourceName& name) {
+        return std::erase_if(resources_, [&](auto& e) { return e.first.type == type && e.first.name == name; });
+    }
+
+    size_t ResourceTable::remove_type(const ResourceName& type) {
+        return std::erase_if(resources_, [&](auto& e) { return e.first.type == type; });
+    }
+
+    void ResourceTable::copy_type(const ResourceTable& src, const ResourceName& type) {
+        for (auto& [key, resource] : src.resources_) {
+            if (key.type == type) resources_.insert_or_assign(key, resource);
+        }
+    }
+
+    ResourceTable read_resources(const PeImage& image) {
+        ResourceTable table;
+        auto dir = image.data_directory(DataDirectory::RESOURCE);
+        if (dir.rva == 0) return table;
+
+        ResourceKey key{0, 0};
+        ResourceReader{image, dir.rva, table}.read_directory(0, 0, key);
+        return table;
+    }
+
+    std::optional<bytes> find_resource(const PeImage& image, const ResourceName& type, const ResourceName& name) {
+        auto dir = image.data_directory(DataDirectory::RESOURCE);
+        if (dir.rva == 0) return std::nullopt;
+        ResourceTable unused;
+        return ResourceReader{image, dir.rva, unused}.find(type, name);
+    }
+
+    std::vector<uint8_t> write_resource_section(const ResourceTable& table, uint32_t section_rva) {
+        // group the (sorted) resources into the 3-level tree
+        struct NameNode {
+            const ResourceName* name;
+            std::vector<std::pair<uint16_t, const Resource*>> languages;
+        };
+        struct TypeNode {
+            const ResourceName* type;
+            std::vector<NameNode> names;
+        };
+        std::vector<TypeNode> types;
+        for (auto& [key, resource] : table.entries()) {
+            if (types.empty() || !(*types.back().type == key.type)) types.push_back({&key.type, {}});
+            auto& names = types.back().names;
+            if (names.empty() || !(*names.back().name == key.name)) names.push_back({&key.name, {}});
+            names.back().languages.emplace_back(key.language, &resource);
+        }
+
+        // layout: all directory tables (breadth-first), data entries, strings, resource data
+        size_t name_dir_count = 0;
+        for (auto& t : types) name_dir_count += t.names.size();
+        auto type_dirs_offset = DIRECTORY_HEADER_SIZE + types.size() * DIRECTORY_ENTRY_SIZE;
+        auto name_dirs_offset = type_dirs_offset + types.size() * DIRECTORY_HEADER_SIZE
+                                + name_dir_count * DIRECTORY_ENTRY_SIZE;
+        auto data_entries_offset = name_dirs_offset + name_dir_count * DIRECTORY_HEADER_SIZE
+                                   + table.entries().size() * DIRECTORY_ENTRY_SIZE;
+        auto strings_offset = data_entries_offset + table.entries().size() * DATA_ENTRY_SIZE;
+
+        std::map<std::u16string, uint32_t> string_offsets;
+        auto strings_end = strings_offset;
+        auto add_string = [&](const ResourceName& name) {
+            if (name.is_string() && string_offsets.try_emplace(name.str, (uint32_t) strings_end).second) {
+                strings_end += 2 + name.str.size() * 2;
+            }
+        };
+        for (auto& t : types) {
+            add_string(*t.type);
+            for (auto& n : t.names) add_string(*n.name);
+        }
+
+        auto data_offset = align_up((uint32_t) strings_end, 8);
+        auto size = (size_t) data_offset;
+        for (auto& [key, resource] : table.entries()) size = align_up((uint32_t) (size + resource.data.size()), 8);
+
+        std::vector<uint8_t> out(size, 0);
+        auto write_directory_header = [&](size_t offset, auto& entries) {
+            uint16_t named = 0;
+            for (auto& e : entries) named += e.first->is_string();
+            write_u16(out, offset + 12, named);
+            write_u16(out, offset + 14, (uint16_t) (entries.size() - named));
+        };
+        auto name_field = [&](const ResourceName& name) {
+            return name.is_string() ? string_offsets.at(name.str) | HIGH_BIT : (uint32_t) name.id;
+        };
+
+        // root directory
+        std::vector<std::pair<const ResourceName*, int>> root_entries;
+        for (auto& t : types) root_entries.emplace_back(t.type, 0);
+        write_directory_header(0, root_entries);
+
+        auto next_type_dir = type_dirs_offset;
+        auto next_name_dir = name_dirs_offset;
+        auto next_data_entry = data_entries_offset;
+        auto next_data = (size_t) data_offset;
+        for (size_t ti = 0; ti < types.size(); ti++) {
+            auto& t = types[ti];
+            write_u32(out, DIRECTORY_HEADER_SIZE + ti * DIRECTORY_ENTRY_SIZE, name_field(*t.type));
+            write_u32(out, DIRECTORY_HEADER_SIZE + ti * DIRECTORY_ENTRY_SIZE + 4, (uint32_t) next_type_dir | HIGH_BIT);
+
+            std::vector<std::pair<const ResourceName*, int>> type_entries;
+            for (auto& n : t.names) type_entries.emplace_back(n.name, 0);
+            write_directory_header(next_type_dir, type_entries);
+
+            for (size_t ni = 0; ni < t.names.size(); ni++) {
+                auto& n = t.names[ni];
+                auto entry_offset = next_type_dir + DIRECTORY_HEADER_SIZE + ni * DIRECTORY_ENTRY_SIZE;
+                write_u32(out, entry_offset, name_field(*n.name));
+                write_u32(out, entry_offset + 4, (uint32_t) next_name_dir | HIGH_BIT);
+
+                // language directory, all entries are IDs
+                write_u16(out, next_name_dir + 14, (uint16_t) n.languages.size());
+                for (size_t li = 0; li < n.languages.size(); li++) {
+                    auto& [language, resource] = n.languages[li];
+                    auto lang_entry_offset = next_name_dir + DIRECTORY_HEADER_SIZE + li * DIRECTORY_ENTRY_SIZE;
+                    write_u32(out, lang_entry_offset, language);
+                    write_u32(out, lang_entry_offset + 4, (uint32_t) next_data_entry);
+
+                    write_u32(out, next_data_entry, section_rva + (uint32_t) next_data);
+                    write_u32(out, next_data_entry + 4, (uint32_t) resource->data.size());
+                    write_u32(out, next_data_entry + 8, resource->code_page);
+                    next_data_entry += DATA_ENTRY_SIZE;
+
+                    std::copy(resource->data.begin(), resource->data.end(), out.begin() + (ptrdiff_t) next_data);
+                    next_data = align_up((uint32_t) (next_data + resource->data.size()), 8);
+                }
+                next_name_dir += DIRECTORY_HEADER_SIZE + n.languages.size() * DIRECTORY_ENTRY_SIZE;
+            }
+            next_type_dir += DIRECTORY_HEADER_SIZE + t.names.size() * DIRECTORY_ENTRY_SIZE;
+        }
+
+        for (auto& [str, offset] : string_offsets) {
+            write_u16(out, offset, (uint16_t) str.size());
+            for (size_t i = 0; i < str.size(); i++) write_u16(out, offset + 2 + i * 2, str[i]);
+        }
+        return out;
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+#include "PeImage.hpp"
+
+// Reading and writing of the resource directory (`.rsrc` section) of PE images. Instead of patching the directory
+//  in place, resources are read into a flat `ResourceTable`, which can be compared and modified, and then serialized
+//  into a complete new resource section (see `write_resource_section`).
+namespace pe {
+    enum class ResourceType : uint16_t {
+        CURSOR = 1, BITMAP = 2, ICON = 3, MENU = 4, DIALOG = 5, STRING = 6, FONT_DIR = 7, FONT = 8,
+        ACCELERATOR = 9, RCDATA = 10, MESSAGE_TABLE = 11, GROUP_CURSOR = 12, GROUP_ICON = 14, VERSION = 16,
+        MANIFEST = 24,
+    };
+
+    /// Resource type or name, either a 16-bit ID or a string.
+    struct ResourceName {
+        uint16_t id = 0;
+        /// If non-empty, this is a string name and `id` is ignored.
+        std::u16string str = {};
+
+        ResourceName(uint16_t id) : id{id} {} // NOLINT(*-explicit-constructor)
+        ResourceName(ResourceType type) : id{(uint16_t) type} {} // NOLINT(*-explicit-constructor)
+        explicit ResourceName(std::u16string str) : str{std::move(str)} {}
+
+        [[nodiscard]] bool is_string() const { return !str.empty(); }
+
+        /// Order of entries in the resource directory: string names first (compared case-insensitively),
+        /// then IDs in ascending order.
+        friend bool operator<(const ResourceName& a, const ResourceName& b);
+        friend bool operator==(const ResourceName& a, const ResourceName& b);
+    };
+
+    struct ResourceKey {
+        ResourceName type;
+        ResourceName name;
+        uint16_t language = 0;
+
+        friend bool operator<(const ResourceKey& a, const ResourceKey& b);
+        friend bool operator==(const ResourceKey& a, const ResourceKey& b) = default;
+    };
+
+    struct Resource {
+        std::vector<uint8_t> data;
+        uint32_t code_page = 0;
+
+        friend bool operator==(const Resource& a, const Resource& b) = default;
+    };
+
+    /// All resources of an image, ordered in the same way as in the resource directory.
+    class ResourceTable {
+    private:
+        std::map<ResourceKey, Resource> resources_;
+
+    public:
+        [[nodiscard]] const std::map<ResourceKey, Resource>& entries() const { return resources_; }
+        [[nodiscard]] bool empty() const { return resources_.empty(); }
+
+        void set(const ResourceKey& key, Resource resource) {
+            resources_.insert_or_assign(key, std::move(resource));
+        }
+
+        /// Returns the first resource with the given type and name (in any language), or nullptr.
+        [[nodiscard]] const Resource* find(const ResourceName& type, const ResourceName& name) const;
+
+        /// Removes all resources with the given type and name. Returns the number of removed resources.
+        size_t remove(const ResourceName& type, const ResourceName& name);
+        /// Removes all resources of the given type. Returns the number of removed resources.
+        size_t remove_type(const ResourceName& type);
+        /// Copies all resources of the given type from `src`.
+        void copy_type(const ResourceTable& src, const ResourceName& type);
+
+        friend bool operator==(const ResourceTable& a, const ResourceTable& b) = default;
+    };
+
+    /// Reads all resources of `image`. Resources with data outside the file are skipped, the same way the Windows
+    /// loader ignores them; a malformed directory structure results in `PeError`.
+    ResourceTable read_resources(const PeImage& image);
+
+    /// Returns the data of the first resource with the given type and name (in any language), without reading the rest
+    /// of the resource directory, or `nullopt` if there is no such resource.
+    std::optional<bytes> find_resource(const PeImage& image, const ResourceName& type, const ResourceName& name);
+
+    /// Serializes `table` into the contents of a resource section, which will be mapped at `section_rva`.
+    std::vector<uint8_t> write_resource_section(const ResourceTable& table, uint32_t section_rva);
+}
@@ -0,0 +1,464 @@
+#include "pog_native.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include "DownloadSink.hpp"
+#include "FileHash.hpp"
+#include "MappedFile.hpp"
+#include "ShimUpdate.hpp"
+#include "archive/Archive.hpp"
+#include "cache/CacheIndex.hpp"
+#include "dedup/ChunkStore.hpp"
+#include "download/RangedDownload.hpp"
+#include "manifest/ManifestCache.hpp"
+#include "repository/DeltaUpdate.hpp"
+#include "repository/RepositoryIndex.hpp"
+#include "version/VersionKey.hpp"
+
+namespace {
+    /// Copies the null-terminated `str` to `out`, truncated to `out_size`.
+    void copy_string(const char* str, char* out, size_t out_size) {
+        if (out && out_size > 0) {
+            strncpy(out, str, out_size - 1);
+            out[out_size - 1] = '\0';
+        }
+    }
+
+    int32_t report_error(int32_t code, const char* message, char* out, size_t out_size) {
+        copy_string(message, out, out_size);
+        return code;
+    }
+
+    ProgressCallback wrap_progress(pog_progress_callback progress, void* progress_context) {
+        if (!progress) return {};
+        return [=](uint64_t processed, uint64_t total) {
+            return progress(progress_context, processed, total) == 0;
+        };
+    }
+
+    /// Runs `fn` and converts the exceptions thrown by the native libraries to error codes.
+    int32_t translate_errors(char* error_message, size_t error_message_size, auto&& fn) {
+        try {
+            return fn();
+        } catch (const OutdatedShimError& e) {
+            return report_error(POG_E_OUTDATED_SHIM, e.what(), error_message, error_message_size);
+        } catch (const pe::PeError& e) {
+            return report_error(POG_E_INVALID_PE, e.what(), error_message, error_message_size);
+        } catch (const archive::UnsupportedArchiveError& e) {
+            return report_error(POG_E_UNSUPPORTED_ARCHIVE, e.what(), error_message, error_message_size);
+        } catch (const archive::ArchiveError& e) {
+            return report_error(POG_E_INVALID_ARCHIVE, e.what(), error_message, error_message_size);
+        } catch (const IoError& e) {
+            return report_error(e.in_use ? POG_E_SHIM_IN_USE : POG_E_IO, e.what(), error_message, error_message_size);
+        } catch (const OperationCancelled& e) {
+            return report_error(POG_E_CANCELLED, e.what(), error_message, error_message_size);
+        } catch (const download::HttpError& e) {
+            return report_error(POG_E_HTTP, e.what(), error_message, error_message_size);
+        } catch (const std::exception& e) {
+            return report_error(POG_E_INTERNAL, e.what(), error_message, error_message_size);
+        }
+    }
+}
+
+int32_t pog_update_shim(const pog_path_char* shim_path, const pog_path_char* metadata_source_path,
+                        const uint8_t* shim_data, size_t shim_data_size, uint16_t features,
+                        int32_t subsystem, uint32_t flags, char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        ShimUpdate update{
+            .shim_data = {shim_data, shim_data_size},
+            .features = features,
+            .subsystem = subsystem < 0 ? std::nullopt : std::optional<uint16_t>{(uint16_t) subsystem},
+            .new_shim = (flags & POG_SHIM_NEW) != 0,
+        };
+        if (metadata_source_path) {
+            // stat before reading the resources, so that a concurrent change is detected on the next update
+            auto info = stat_file(metadata_source_path);
+            update.metadata_source_stamp = SourceStamp{shim_path_hash(metadata_source_path), info.size,
+                                                       info.last_write_time};
+        }
+
+        std::optional<UpdatedShimImage> updated;
+        {
+            // both mappings must be closed before the shim is written
+            MappedFile shim_file{shim_path};
+            pe::PeImage shim{shim_file.data()};
+            if (!update.new_shim && is_shim_up_to_date(shim, update)) {
+                return POG_SHIM_UNCHANGED;
+            }
+
+            std::unique_ptr<MappedFile> metadata_file;
+            std::optional<pe::ResourceTable> metadata;
+            if (metadata_source_path) {
+                metadata_file = std::make_unique<MappedFile>(metadata_source_path);
+                pe::PeImage metadata_image{metadata_file->data()};
+                metadata = pe::read_resources(metadata_image);
+                update.metadata_source = &*metadata;
+                if (flags & POG_SHIM_SUBSYSTEM_FROM_SOURCE) {
+                    update.subsystem = metadata_image.subsystem();
+                }
+            }
+            updated = update_shim_image(shim, update);
+        }
+
+        if (!updated) {
+            return POG_SHIM_UNCHANGED;
+        }
+        if (updated->manifest_only) {
+            // the shim works without the update, only the next check will be slower if it's running now
+            try {
+                write_file(shim_path, updated->image);
+            } catch (const IoError& e) {
+                if (!e.in_use) throw;
+            }
+            return POG_SHIM_UNCHANGED;
+        }
+        write_file(shim_path, updated->image);
+        return POG_SHIM_UPDATED;
+    });
+}
+
+int32_t pog_sha256_file(const pog_path_char* path, uint8_t digest[32], pog_progress_callback progress,
+                        void* progress_context, char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        auto result = sha256_file(path, wrap_progress(progress, progress_context));
+        std::copy(result.begin(), result.end(), digest);
+        return POG_OK;
+    });
+}
+
+void pog_sha256(const uint8_t* data, size_t size, uint8_t digest[32]) {
+    auto result = Sha256::hash({data, size});
+    std::copy(result.begin(), result.end(), digest);
+}
+
+struct pog_download_sink {
+    DownloadSink sink;
+
+    explicit pog_download_sink(const pog_path_char* path) : sink{path} {}
+};
+
+int32_t pog_download_sink_create(const pog_path_char* path, pog_download_sink** sink,
+                                 char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        *sink = new pog_download_sink{path};
+        return POG_OK;
+    });
+}
+
+int32_t pog_download_sink_write(pog_download_sink* sink, const uint8_t* data, size_t size,
+                                char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        sink->sink.write({data, size});
+        return POG_OK;
+    });
+}
+
+int32_t pog_download_sink_finish(pog_download_sink* sink, uint8_t digest[32],
+                                 char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        auto result = sink->sink.finish();
+        std::copy(result.begin(), result.end(), digest);
+        return POG_OK;
+    });
+}
+
+void pog_download_sink_close(pog_download_sink* sink) {
+    delete sink;
+}
+
+int32_t pog_extract_archive(const pog_path_char* archive_path, const pog_path_char* target_dir,
+                            const char* const* filter, size_t filter_count, pog_progress_callback progress,
+                            void* progress_context, char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        archive::ExtractOptions options{
+            .filter = archive::PathFilter{{filter, filter + filter_count}},
+            .progress = wrap_progress(progress, progress_context),
+        };
+        archive::extract_archive(archive_path, target_dir, options);
+        return POG_OK;
+    });
+}
+
+int32_t pog_download_file(const char* url, const char* resume_key, const pog_path_char* target_path,
+                          const char* user_agent, uint32_t connections, pog_progress_callback progress,
+                          void* progress_context, char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        download::DownloadOptions options{
+            .connections = connections,
+            .progress = wrap_progress(progress, progress_context),
+            .resume_key = resume_key ? resume_key : "",
+        };
+        download::download_file(url, target_path, download::default_connection_factory(user_agent), options);
+        return POG_OK;
+    });
+}
+
+struct pog_cache_index {
+    cache::CacheIndex index;
+
+    explicit pog_cache_index(const pog_path_char* cache_dir) : index{cache_dir} {}
+};
+
+int32_t pog_cache_index_open(const pog_path_char* cache_dir, pog_cache_index** index,
+                             char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        *index = new pog_cache_index{cache_dir};
+        return POG_OK;
+    });
+}
+
+void pog_cache_index_close(pog_cache_index* index) {
+    delete index;
+}
+
+int32_t pog_cache_index_acquire(pog_cache_index* index, const char* key, const char* package, char* file_name,
+                                size_t file_name_size, char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        std::string name;
+        auto result = index->index.acquire(key, package ? package : "", &name);
+        copy_string(name.c_str(), file_name, file_name_size);
+        switch (result) {
+            case cache::AcquireResult::HIT: return POG_CACHE_HIT;
+            case cache::AcquireResult::HIT_NEW_PACKAGE: return POG_CACHE_HIT_NEW_PACKAGE;
+            default: return POG_CACHE_MISS;
+        }
+    });
+}
+
+int32_t pog_cache_index_release(pog_cache_index* index, const char* key,
+                                char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        index->index.release(key);
+        return POG_OK;
+    });
+}
+
+int32_t pog_cache_index_add(pog_cache_index* index, const pog_cache_entry* entry,
+                            char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        cache::CacheEntry e{.key = entry->key, .file_name = entry->file_name, .size = entry->size,
+                            .last_access = entry->last_access};
+        for (std::string_view packages = entry->packages ? entry->packages : ""; !packages.empty();) {
+            auto end = std::min(packages.find('\n'), packages.size());
+            if (end > 0) e.packages.emplace_back(packages.substr(0, end));
+            packages.remove_prefix(std::min(end + 1, packages.size()));
+        }
+        return index->index.add(e) ? 1 : 0;
+    });
+}
+
+int32_t pog_cache_index_remove(pog_cache_index* index, const char* key,
+                               char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        return index->index.remove(key) ? 1 : 0;
+    });
+}
+
+int32_t pog_cache_index_enumerate(pog_cache_index* index, pog_cache_entry_callback callback, void* context,
+                                  char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        std::string packages;
+        index->index.for_each([&](const cache::CacheEntry& entry) {
+            packages.clear();
+            for (auto& p : entry.packages) {
+                packages += p;
+                packages += '\n';
+            }
+            pog_cache_entry e{entry.key.c_str(), entry.file_name.c_str(), entry.size, entry.last_access,
+                              entry.readers, packages.c_str()};
+            callback(context, &e);
+        });
+        return POG_OK;
+    });
+}
+
+int32_t pog_chunk_store_add(const pog_path_char* store_dir, const pog_path_char* file_path,
+                            const pog_path_char* chunk_list_path, pog_chunk_store_stats* stats,
+                            pog_progress_callback progress, void* progress_context,
+                            char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        dedup::ChunkStore store{store_dir};
+        auto result = store.add_file(file_path, chunk_list_path, wrap_progress(progress, progress_context));
+        if (stats) *stats = {result.size, result.chunk_count, result.new_chunk_count, result.new_chunk_bytes};
+        return POG_OK;
+    });
+}
+
+int32_t pog_chunk_store_restore(const pog_path_char* store_dir, const pog_path_char* chunk_list_path,
+                                const pog_path_char* target_path, pog_progress_callback progress,
+                                void* progress_context, char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        dedup::ChunkStore store{store_dir};
+        store.restore_file(chunk_list_path, target_path, wrap_progress(progress, progress_context));
+        return POG_OK;
+    });
+}
+
+int32_t pog_chunk_store_extract_archive(const pog_path_char* store_dir, const pog_path_char* chunk_list_path,
+                                        const pog_path_char* target_dir, const char* const* filter,
+                                        size_t filter_count, pog_progress_callback progress,
+                                        void* progress_context, char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        dedup::ChunkedFileReader reader{store_dir, chunk_list_path};
+        archive::ExtractOptions options{
+            .filter = archive::PathFilter{{filter, filter + filter_count}},
+            .progress = wrap_progress(progress, progress_context),
+        };
+        archive::extract_archive(reader, target_dir, options);
+        return POG_OK;
+    });
+}
+
+int32_t pog_chunk_store_collect(const pog_path_char* store_dir, const pog_path_char* const* chunk_list_paths,
+                                size_t chunk_list_count, uint32_t min_age_seconds, uint64_t* freed_bytes,
+                                char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        dedup::ChunkStore store{store_dir};
+        auto stats = store.collect_garbage({chunk_list_paths, chunk_list_paths + chunk_list_count},
+                                           std::chrono::seconds{min_age_seconds});
+        if (freed_bytes) *freed_bytes = stats.deleted_bytes;
+        return POG_OK;
+    });
+}
+
+struct pog_repo_index {
+    std::unique_ptr<repository::RepositoryIndex> index;
+};
+
+int32_t pog_repo_index_write(const pog_path_char* index_dir, const char* packages, size_t packages_size,
+                             const char* etag, const char* last_modified, uint64_t sequence,
+                             char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        repository::IndexData data{.etag = etag ? etag : "", .last_modified = last_modified ? last_modified : "",
+                                   .sequence = sequence};
+        for (std::string_view lines{packages, packages_size}; !lines.empty();) {
+            auto line_end = std::min(lines.find('\n'), lines.size());
+            auto line = lines.substr(0, line_end);
+            lines.remove_prefix(std::min(line_end + 1, lines.size()));
+            if (line.empty()) continue;
+
+            auto& package = data.packages.emplace_back();
+            for (auto first = true; first || !line.empty(); first = false) {
+                auto end = std::min(line.find('\t'), line.size());
+                if (first) package.name = line.substr(0, end);
+                else package.versions.emplace_back(line.substr(0, end));
+                line.remove_prefix(std::min(end + 1, line.size()));
+            }
+        }
+        repository::write_index(index_dir, data);
+        return POG_OK;
+    });
+}
+
+int32_t pog_repo_index_open(const pog_path_char* index_dir, pog_repo_index** index,
+                            char* error_message, size_t error_message_size) {
+    *index = nullptr;
+    return translate_errors(error_message, error_message_size, [&] {
+        auto opened = repository::RepositoryIndex::open_latest(index_dir);
+        if (!opened) return 0;
+        *index = new pog_repo_index{std::move(opened)};
+        return 1;
+    });
+}
+
+void pog_repo_index_close(pog_repo_index* index) {
+    delete index;
+}
+
+void pog_repo_index_get_info(const pog_repo_index* index, pog_repo_index_info* info) {
+    auto& i = *index->index;
+    *info = {i.package_count(), i.total_version_count(), i.sequence(), i.last_write_time(), i.etag().data(),
+             i.etag().size(), i.last_modified().data(), i.last_modified().size()};
+}
+
+int32_t pog_repo_index_touch(pog_repo_index* index, char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        index->index->touch();
+        return POG_OK;
+    });
+}
+
+int32_t pog_repo_index_update(pog_repo_index* index, const char* repository_url, const char* user_agent,
+                              uint64_t* sequence, char* error_message, size_t error_message_size) {
+    *sequence = 0;
+    return translate_errors(error_message, error_message_size, [&] {
+        auto result = repository::update_index(index ? index->index.get() : nullptr, repository_url,
+                                               download::default_connection_factory(user_agent));
+        *sequence = result.sequence;
+        switch (result.status) {
+            case repository::UpdateStatus::UP_TO_DATE:
+                return POG_REPO_UP_TO_DATE;
+            case repository::UpdateStatus::PATCHED:
+                return POG_REPO_PATCHED;
+            default:
+                return POG_REPO_FULL_DOWNLOAD;
+        }
+    });
+}
+
+int32_t pog_repo_index_find(const pog_repo_index* index, const char* name, size_t name_size) {
+    auto package = index->index->find({name, name_size});
+    return package ? (int32_t) *package : -1;
+}
+
+size_t pog_repo_index_get_name(const pog_repo_index* index, uint32_t package, const char** name) {
+    auto str = index->index->name(package);
+    *name = str.data();
+    return str.size();
+}
+
+uint32_t pog_repo_index_get_version_count(const pog_repo_index* index, uint32_t package) {
+    return index->index->version_count(package);
+}
+
+size_t pog_repo_index_get_version(const pog_repo_index* index, uint32_t package, uint32_t version, const char** str) {
+    auto v = index->index->version(package, version);
+    *str = v.data();
+    return v.size();
+}
+
+struct pog_manifest_cache {
+    std::unique_ptr<manifest::ManifestCache> cache;
+};
+
+int32_t pog_manifest_cache_open(const pog_path_char* cache_dir, pog_manifest_cache** cache,
+                                char* error_message, size_t error_message_size) {
+    *cache = nullptr;
+    return translate_errors(error_message, error_message_size, [&] {
+        *cache = new pog_manifest_cache{manifest::ManifestCache::open(cache_dir)};
+        return POG_OK;
+    });
+}
+
+void pog_manifest_cache_close(pog_manifest_cache* cache) {
+    delete cache;
+}
+
+int32_t pog_manifest_cache_find(const pog_manifest_cache* cache, const uint8_t key[32], const char** manifest,
+                                size_t* manifest_size) {
+    manifest::CacheKey k;
+    memcpy(k.data(), key, k.size());
+    auto found = cache->cache->find(k);
+    if (!found) return 0;
+    *manifest = found->data();
+    *manifest_size = found->size();
+    return 1;
+}
+
+int32_t pog_manifest_cache_add(pog_manifest_cache* cache, const uint8_t key[32], const char* manifest,
+                               size_t manifest_size, char* error_message, size_t error_message_size) {
+    return translate_errors(error_message, error_message_size, [&] {
+        manifest::CacheKey k;
+        memcpy(k.data(), key, k.size());
+        cache->cache->add(k, {manifest, manifest_size});
+        return POG_OK;
+    });
+}
+
+int32_t pog_version_key(const char* version, size_t version_size, uint8_t* key, size_t* key_size) {
+    auto info = version::encode_key({version, version_size}, {key, POG_VERSION_KEY_MAX_SIZE(version_size)});
+    if (!info) return POG_E_INVALID_VERSION;
+    *key_size = info->size;
+    return info->exact ? POG_VERSION_KEY_EXACT : POG_VERSION_KEY_INEXACT;
+}
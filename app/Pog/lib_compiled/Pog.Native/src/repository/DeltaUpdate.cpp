@@ -0,0 +1,81 @@
+#include "DeltaUpdate.hpp"
+#include <charconv>
+#include <optional>
+#include <vector>
+
+using namespace download;
+
+namespace repository {
+    namespace {
+        /// Returns the body of the response, or nothing if the file does not exist.
+        std::optional<std::string> get_text(HttpConnection& connection, const std::string& url) {
+            auto response = connection.get(url, std::nullopt);
+            if (response.status == 404) return std::nullopt;
+            if (response.status != 200) {
+                throw HttpError("Unexpected response for '" + url + "' (HTTP " + std::to_string(response.status)
+                                + ").", response.status);
+            }
+
+            std::string body;
+            std::vector<uint8_t> buffer(16 << 10);
+            while (auto n = connection.read(buffer)) body.append((const char*) buffer.data(), n);
+            if (response.content_length && body.size() != *response.content_length) {
+                throw HttpError("The connection was closed before the whole file was received.");
+            }
+            return body;
+        }
+
+        struct RemoteSequence {
+            uint64_t sequence;
+            uint64_t first_patch;
+        };
+
+        std::optional<RemoteSequence> parse_sequence(std::string_view text) {
+            RemoteSequence result{};
+            auto end = text.data() + text.size();
+            auto [sequence_end, ec1] = std::from_chars(text.data(), end, result.sequence);
+            if (ec1 != std::errc{} || sequence_end == end || *sequence_end != ' ') return std::nullopt;
+            if (std::from_chars(sequence_end + 1, end, result.first_patch).ec != std::errc{} || result.sequence == 0) {
+                return std::nullopt;
+            }
+            return result;
+        }
+    }
+
+    UpdateResult update_index(RepositoryIndex* index, std::string repository_url,
+                              const ConnectionFactory& connections) {
+        if (!repository_url.ends_with('/')) repository_url += '/';
+        auto connection = connections();
+
+        auto sequence_text = get_text(*connection, repository_url + "patches/sequence.txt");
+        auto remote = sequence_text ? parse_sequence(*sequence_text) : std::nullopt;
+        if (!remote) return {UpdateStatus::FULL_DOWNLOAD_NEEDED, 0};
+
+        auto sequence = remote->sequence;
+        // a lower remote sequence number should not happen, but a full download is always correct
+        if (!index || index->sequence() == 0 || index->sequence() > sequence) {
+            return {UpdateStatus::FULL_DOWNLOAD_NEEDED, sequence};
+        }
+        if (index->sequence() == sequence) {
+            index->touch();
+            return {UpdateStatus::UP_TO_DATE, sequence};
+        }
+        if (remote->first_patch > index->sequence() + 1 || sequence - index->sequence() > MAX_PATCH_COUNT) {
+            return {UpdateStatus::FULL_DOWNLOAD_NEEDED, sequence};
+        }
+
+        // each patch is appended as soon as it's downloaded; if a later one is missing, the index is still consistent
+        for (auto s = index->sequence() + 1; s <= sequence; s++) {
+            auto text = get_text(*connection, repository_url + "patches/" + std::to_string(s) + ".txt");
+            if (!text) return {UpdateStatus::FULL_DOWNLOAD_NEEDED, sequence};
+            std::optional<IndexPatch> patch;
+            try {
+                patch = parse_patch(s, *text);
+            } catch (const std::invalid_argument&) {
+                return {UpdateStatus::FULL_DOWNLOAD_NEEDED, sequence};
+            }
+            if (!index->append_patch(*patch)) return {UpdateStatus::FULL_DOWNLOAD_NEEDED, sequence};
+        }
+        return {UpdateStatus::PATCHED, sequence};
+    }
+}
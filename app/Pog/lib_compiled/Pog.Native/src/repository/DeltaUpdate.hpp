@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "download/Http.hpp"
+#include "repository/RepositoryIndex.hpp"
+
+// Delta updates of the local repository index. Besides the full JSON index, a remote repository may publish patches
+//  (generated by `build-remote-repo.ps1`) in the `patches/` directory next to the index:
+//  - `patches/sequence.txt` contains `<sequence> <first>`, the sequence number of the current remote index, and of
+//    the oldest available patch,
+//  - `patches/<n>.txt` contains the changes from sequence `n - 1` to `n`, in the format of `parse_patch`.
+//
+// Sequence numbers only grow; a repository rebuilt without its previous state restarts from the current Unix time,
+//  past all previous sequence numbers, with no patches. Since a patch replaces whole packages, replaying patches that
+//  are already included in the index gives the same result, so the full index may be newer than its sequence number.
+namespace repository {
+    enum class UpdateStatus {
+        /// The repository does not publish patches, the index is too old, or there's no index yet.
+        FULL_DOWNLOAD_NEEDED,
+        /// The index is up to date, its last write time was updated.
+        UP_TO_DATE,
+        /// The patches were appended to the index, it must be reopened to see them.
+        PATCHED,
+    };
+
+    struct UpdateResult {
+        UpdateStatus status;
+        /// Sequence number of the remote index, 0 if the repository does not publish patches.
+        uint64_t sequence;
+    };
+
+    /// With more patches to download, the full index is usually smaller.
+    constexpr uint64_t MAX_PATCH_COUNT = 32;
+
+    /// Brings `index` (may be null) up to date with the repository at `repository_url` (the directory of the JSON
+    /// index), using patches if possible. Throws `download::HttpError` or `IoError`.
+    UpdateResult update_index(RepositoryIndex* index, std::string repository_url,
+                              const download::ConnectionFactory& connections);
+}
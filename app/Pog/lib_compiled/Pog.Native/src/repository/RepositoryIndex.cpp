@@ -0,0 +1,736 @@
+#include "RepositoryIndex.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include "archive/Crc32.hpp"
+
+namespace fs = std::filesystem;
+
+namespace repository {
+    namespace {
+        constexpr char MAGIC[8] = {'P', 'O', 'G', 'R', 'I', 'D', 'X', '2'};
+        constexpr char PATCH_MAGIC[4] = {'P', 'T', 'C', 'H'};
+        constexpr std::string_view FILE_PREFIX = "repository-index.";
+        constexpr std::string_view TMP_INFIX = ".tmp-";
+        /// Temporary files of crashed writers are deleted after this time.
+        constexpr auto STALE_TMP_FILE = std::chrono::minutes(1);
+        /// Average number of names per bucket of the perfect hash table; more is smaller, but slower to build.
+        constexpr uint32_t NAMES_PER_BUCKET = 4;
+        /// `version_count` of a removed package in a patch record.
+        constexpr uint32_t REMOVED_PACKAGE = UINT32_MAX;
+
+        struct StringRef {
+            uint32_t offset;
+            uint32_t size;
+        };
+
+        // all offsets are from the start of the file, and all sections are 4-byte aligned; the file is little-endian,
+        //  like all platforms Pog runs on
+        struct Header {
+            char magic[8];
+            uint32_t package_count;
+            uint32_t version_count;
+            uint32_t bucket_count;
+            uint32_t seed;
+            uint32_t packages_offset;
+            uint32_t versions_offset;
+            uint32_t buckets_offset;
+            uint32_t slots_offset;
+            uint32_t strings_offset;
+            uint32_t strings_size;
+            StringRef etag;
+            StringRef last_modified;
+            uint64_t sequence;
+            /// Size of the base index; patch records are appended after it.
+            uint32_t base_size;
+            uint32_t reserved;
+        };
+        static_assert(sizeof(Header) == 80);
+
+        // followed by the changed packages, each with `uint32_t` name size and version count (`REMOVED_PACKAGE` for
+        //  a removed package), the name, and the versions, each with an `uint32_t` size; padded to 4 bytes; records
+        //  are not aligned to 8 bytes, so they're always read with `memcpy`
+        struct PatchRecordHeader {
+            char magic[4];
+            /// Size of the whole record, including the header and padding.
+            uint32_t size;
+            uint64_t sequence;
+            /// CRC-32 of the rest of the record.
+            uint32_t checksum;
+            uint32_t package_count;
+        };
+        static_assert(sizeof(PatchRecordHeader) == 24);
+
+        struct PackageRecord {
+            StringRef name;
+            uint32_t first_version;
+            uint32_t version_count;
+        };
+
+        char fold_case(char c) {
+            return c >= 'A' && c <= 'Z' ? (char) (c + ('a' - 'A')) : c;
+        }
+
+        bool equal_ignore_case(std::string_view a, std::string_view b) {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+                return fold_case(x) == fold_case(y);
+            });
+        }
+
+        bool less_ignore_case(std::string_view a, std::string_view b) {
+            return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+                return (uint8_t) fold_case(x) < (uint8_t) fold_case(y);
+            });
+        }
+
+        std::string folded(std::string_view name) {
+            std::string result{name};
+            std::transform(result.begin(), result.end(), result.begin(), fold_case);
+            return result;
+        }
+
+        uint64_t hash_name(std::string_view name, uint32_t seed) {
+            // FNV-1a of the case-folded name, finished with the splitmix64 mixer, so that all bits of the result
+            //  depend on the whole name
+            uint64_t hash = 0xcbf29ce484222325 ^ seed;
+            for (auto c : name) {
+                hash = (hash ^ (uint8_t) fold_case(c)) * 0x100000001b3;
+            }
+            hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9;
+            hash = (hash ^ (hash >> 27)) * 0x94d049bb133111eb;
+            return hash ^ (hash >> 31);
+        }
+
+        /// The hash of a name determines its bucket, and a sequence of candidate slots, one of which is selected
+        /// by the displacement stored for the bucket. The candidates are independent of each other (unlike the usual
+        /// `h1 + d * h2`, which moves all names of a bucket in lockstep), so that the last buckets are placed quickly.
+        struct NameHash {
+            uint32_t bucket;
+            uint64_t hash;
+
+            NameHash(std::string_view name, uint32_t seed, uint32_t bucket_count) : hash{hash_name(name, seed)} {
+                bucket = (uint32_t) ((hash >> 32) % bucket_count);
+            }
+
+            [[nodiscard]] uint32_t slot(uint32_t displacement, uint32_t slot_count) const {
+                auto x = hash ^ ((uint64_t) displacement + 1) * 0x9e3779b97f4a7c15;
+                x = (x ^ (x >> 32)) * 0xd6e8feb86659fd93;
+                return (uint32_t) ((x ^ (x >> 32)) % slot_count);
+            }
+        };
+
+        struct PerfectHash {
+            uint32_t seed;
+            std::vector<uint32_t> displacements;
+            /// Package index for each slot.
+            std::vector<uint32_t> slots;
+        };
+
+        std::optional<PerfectHash> try_build_hash(const std::vector<PackageEntry>& packages, uint32_t seed) {
+            auto n = (uint32_t) packages.size();
+            auto bucket_count = std::max<uint32_t>(1, (n + NAMES_PER_BUCKET - 1) / NAMES_PER_BUCKET);
+            std::vector<NameHash> hashes;
+            hashes.reserve(n);
+            std::vector<std::vector<uint32_t>> buckets(bucket_count);
+            for (uint32_t i = 0; i < n; i++) {
+                hashes.emplace_back(packages[i].name, seed, bucket_count);
+                buckets[hashes.back().bucket].push_back(i);
+            }
+
+            // the largest buckets are placed first, while most slots are still free
+            std::vector<uint32_t> order(bucket_count);
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+                return buckets[a].size() > buckets[b].size();
+            });
+
+            PerfectHash result{.seed = seed, .displacements = std::vector<uint32_t>(bucket_count),
+                               .slots = std::vector<uint32_t>(n, UINT32_MAX)};
+            // the last single-name buckets need on the order of `n` attempts to hit one of the few free slots
+            auto max_displacement = std::max<uint32_t>(1024, n * 16);
+            std::vector<uint32_t> candidate;
+            for (auto b : order) {
+                auto& names = buckets[b];
+                if (names.empty()) break;
+                auto placed = false;
+                for (uint32_t d = 0; d < max_displacement && !placed; d++) {
+                    candidate.clear();
+                    placed = true;
+                    for (auto i : names) {
+                        auto slot = hashes[i].slot(d, n);
+                        if (result.slots[slot] != UINT32_MAX ||
+                            std::find(candidate.begin(), candidate.end(), slot) != candidate.end()) {
+                            placed = false;
+                            break;
+                        }
+                        candidate.push_back(slot);
+                    }
+                    if (placed) {
+                        result.displacements[b] = d;
+                        for (size_t k = 0; k < names.size(); k++) result.slots[candidate[k]] = names[k];
+                    }
+                }
+                // two names with the same full hash cannot be separated, retry with another seed
+                if (!placed) return std::nullopt;
+            }
+            return result;
+        }
+
+        class Writer {
+        public:
+            std::vector<uint8_t> out;
+
+            size_t reserve(size_t size) {
+                auto offset = out.size();
+                out.resize(out.size() + size);
+                return offset;
+            }
+
+            void align() {
+                out.resize((out.size() + 3) & ~(size_t) 3);
+            }
+
+            template<typename T>
+            T& at(size_t offset) {
+                return *(T*) (out.data() + offset);
+            }
+        };
+
+        std::optional<uint64_t> parse_generation(const std::string& file_name) {
+            if (!file_name.starts_with(FILE_PREFIX) || file_name.size() == FILE_PREFIX.size()) return std::nullopt;
+            uint64_t generation = 0;
+            for (auto c : std::string_view{file_name}.substr(FILE_PREFIX.size())) {
+                if (c < '0' || c > '9') return std::nullopt;
+                generation = generation * 10 + (uint64_t) (c - '0');
+            }
+            return generation;
+        }
+
+        struct Generations {
+            std::optional<uint64_t> latest;
+            std::vector<std::pair<uint64_t, fs::path>> files;
+        };
+
+        Generations list_generations(const fs::path& dir) {
+            Generations result;
+            auto now = fs::file_time_type::clock::now();
+            std::error_code list_error;
+            fs::directory_iterator listing{dir, list_error};
+            if (list_error) throw IoError("Could not list the repository index directory.", list_error.value());
+            for (auto& item : listing) {
+                auto name = item.path().filename().string();
+                if (auto generation = parse_generation(name)) {
+                    result.files.emplace_back(*generation, item.path());
+                    result.latest = std::max(result.latest.value_or(0), *generation);
+                } else if (name.starts_with(FILE_PREFIX) && name.find(TMP_INFIX) != std::string::npos) {
+                    std::error_code ec;
+                    auto time = fs::last_write_time(item.path(), ec);
+                    if (!ec && now - time > STALE_TMP_FILE) fs::remove(item.path(), ec);
+                }
+            }
+            std::sort(result.files.begin(), result.files.end(), std::greater{});
+            return result;
+        }
+
+        uint64_t now_filetime() {
+            // 100 ns intervals between 1601-01-01 (FILETIME epoch) and 1970-01-01 (Unix epoch)
+            constexpr uint64_t EPOCH_DIFFERENCE = 116444736000000000;
+            using namespace std::chrono;
+            auto since_epoch = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+            return EPOCH_DIFFERENCE + (uint64_t) since_epoch / 100;
+        }
+    }
+
+    namespace {
+        std::vector<uint8_t> serialize_patch(const IndexPatch& patch) {
+            Writer w;
+            w.reserve(sizeof(PatchRecordHeader));
+            auto append = [&](const void* data, size_t size) {
+                w.out.insert(w.out.end(), (const uint8_t*) data, (const uint8_t*) data + size);
+            };
+            auto append_u32 = [&](uint32_t value) { append(&value, sizeof(value)); };
+            for (auto& p : patch.packages) {
+                append_u32((uint32_t) p.name.size());
+                append_u32(p.versions ? (uint32_t) p.versions->size() : REMOVED_PACKAGE);
+                append(p.name.data(), p.name.size());
+                for (auto& v : p.versions.value_or(std::vector<std::string>{})) {
+                    append_u32((uint32_t) v.size());
+                    append(v.data(), v.size());
+                }
+            }
+            w.align();
+
+            PatchRecordHeader header{};
+            memcpy(header.magic, PATCH_MAGIC, sizeof(PATCH_MAGIC));
+            header.size = (uint32_t) w.out.size();
+            header.sequence = patch.sequence;
+            header.checksum = archive::crc32(std::span{w.out}.subspan(sizeof(PatchRecordHeader)));
+            header.package_count = (uint32_t) patch.packages.size();
+            memcpy(w.out.data(), &header, sizeof(header));
+            return std::move(w.out);
+        }
+
+        struct PatchedPackage {
+            std::string_view name;
+            std::optional<std::vector<std::string_view>> versions;
+        };
+
+        struct PatchRecord {
+            uint64_t sequence;
+            uint32_t size;
+            std::vector<PatchedPackage> packages;
+        };
+
+        /// Reads the patch record at the start of `data`, returns nothing if it's incomplete or corrupted.
+        std::optional<PatchRecord> read_patch_record(std::span<const uint8_t> data) {
+            PatchRecordHeader header;
+            if (data.size() < sizeof(header)) return std::nullopt;
+            memcpy(&header, data.data(), sizeof(header));
+            if (memcmp(header.magic, PATCH_MAGIC, sizeof(PATCH_MAGIC)) || header.size < sizeof(header) ||
+                header.size % 4 != 0 || header.size > data.size()) {
+                return std::nullopt;
+            }
+            auto payload = data.subspan(sizeof(header), header.size - sizeof(header));
+            if (archive::crc32(payload) != header.checksum) return std::nullopt;
+
+            PatchRecord record{header.sequence, header.size, {}};
+            auto read_u32 = [&](uint32_t& value) {
+                if (payload.size() < sizeof(value)) return false;
+                memcpy(&value, payload.data(), sizeof(value));
+                payload = payload.subspan(sizeof(value));
+                return true;
+            };
+            auto read_string = [&](uint32_t size, std::string_view& str) {
+                if (payload.size() < size) return false;
+                str = {(const char*) payload.data(), size};
+                payload = payload.subspan(size);
+                return true;
+            };
+            for (uint32_t i = 0; i < header.package_count; i++) {
+                uint32_t name_size, version_count;
+                auto& p = record.packages.emplace_back();
+                if (!read_u32(name_size) || !read_u32(version_count) || !read_string(name_size, p.name)) {
+                    return std::nullopt;
+                }
+                if (version_count == REMOVED_PACKAGE) continue;
+                // each version takes at least 4 bytes, reject counts that cannot fit before allocating
+                if (version_count > payload.size() / 4) return std::nullopt;
+                p.versions.emplace();
+                for (uint32_t v = 0; v < version_count; v++) {
+                    uint32_t size;
+                    if (!read_u32(size) || !read_string(size, p.versions->emplace_back())) return std::nullopt;
+                }
+            }
+            return record;
+        }
+    }
+
+    IndexPatch parse_patch(uint64_t sequence, std::string_view text) {
+        IndexPatch patch{sequence};
+        while (!text.empty()) {
+            auto line_end = std::min(text.find('\n'), text.size());
+            auto line = text.substr(0, line_end);
+            text.remove_prefix(std::min(line_end + 1, text.size()));
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (line.empty()) continue;
+
+            auto op = line[0];
+            line.remove_prefix(1);
+            auto name_end = std::min(line.find('\t'), line.size());
+            auto& p = patch.packages.emplace_back(PackagePatch{std::string(line.substr(0, name_end))});
+            if (p.name.empty() || (op != '+' && op != '-') || (op == '-' && name_end != line.size())) {
+                throw std::invalid_argument("Invalid line in a repository index patch: " + std::string(line));
+            }
+            if (op == '-') continue;
+
+            p.versions.emplace();
+            line.remove_prefix(name_end);
+            while (!line.empty()) {
+                line.remove_prefix(1);
+                auto end = std::min(line.find('\t'), line.size());
+                p.versions->emplace_back(line.substr(0, end));
+                line.remove_prefix(end);
+            }
+        }
+        return patch;
+    }
+
+    std::vector<uint8_t> build_index(const IndexData& data) {
+        if (data.packages.size() >= UINT32_MAX) throw std::invalid_argument("Too many packages in the repository.");
+
+        std::unordered_set<std::string> folded_names;
+        for (auto& p : data.packages) {
+            if (!folded_names.insert(folded(p.name)).second) {
+                throw std::invalid_argument("Duplicate package name in the repository index: " + p.name);
+            }
+        }
+
+        std::optional<PerfectHash> hash;
+        for (uint32_t seed = 0; !hash; seed++) {
+            // with distinct names, a seed almost never fails
+            if (seed == 64) throw std::invalid_argument("Could not build the repository index hash table.");
+            hash = try_build_hash(data.packages, seed);
+        }
+
+        size_t version_count = 0;
+        for (auto& p : data.packages) version_count += p.versions.size();
+
+        Writer w;
+        w.reserve(sizeof(Header));
+        auto packages_offset = w.reserve(data.packages.size() * sizeof(PackageRecord));
+        auto versions_offset = w.reserve(version_count * sizeof(StringRef));
+        auto buckets_offset = w.reserve(hash->displacements.size() * sizeof(uint32_t));
+        memcpy(w.out.data() + buckets_offset, hash->displacements.data(), hash->displacements.size() * sizeof(uint32_t));
+        auto slots_offset = w.reserve(hash->slots.size() * sizeof(uint32_t));
+        memcpy(w.out.data() + slots_offset, hash->slots.data(), hash->slots.size() * sizeof(uint32_t));
+
+        auto strings_offset = w.out.size();
+        auto add_string = [&](std::string_view str) {
+            StringRef ref{(uint32_t) w.out.size(), (uint32_t) str.size()};
+            w.out.insert(w.out.end(), str.begin(), str.end());
+            return ref;
+        };
+
+        uint32_t next_version = 0;
+        for (size_t i = 0; i < data.packages.size(); i++) {
+            auto& p = data.packages[i];
+            PackageRecord record{add_string(p.name), next_version, (uint32_t) p.versions.size()};
+            for (auto& v : p.versions) {
+                auto ref = add_string(v);
+                w.at<StringRef>(versions_offset + next_version++ * sizeof(StringRef)) = ref;
+            }
+            w.at<PackageRecord>(packages_offset + i * sizeof(PackageRecord)) = record;
+        }
+        auto etag = add_string(data.etag);
+        auto last_modified = add_string(data.last_modified);
+        auto strings_size = w.out.size() - strings_offset;
+        w.align();
+        if (w.out.size() > UINT32_MAX) throw std::invalid_argument("The repository index is too large.");
+
+        auto& header = w.at<Header>(0);
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.package_count = (uint32_t) data.packages.size();
+        header.version_count = (uint32_t) version_count;
+        header.bucket_count = (uint32_t) hash->displacements.size();
+        header.seed = hash->seed;
+        header.packages_offset = (uint32_t) packages_offset;
+        header.versions_offset = (uint32_t) versions_offset;
+        header.buckets_offset = (uint32_t) buckets_offset;
+        header.slots_offset = (uint32_t) slots_offset;
+        header.strings_offset = (uint32_t) strings_offset;
+        header.strings_size = (uint32_t) strings_size;
+        header.etag = etag;
+        header.last_modified = last_modified;
+        header.sequence = data.sequence;
+        header.base_size = (uint32_t) w.out.size();
+        return std::move(w.out);
+    }
+
+    fs::path write_index(const path_char* dir, const IndexData& data) {
+        auto contents = build_index(data);
+        auto generations = list_generations(dir);
+        for (auto generation = generations.latest.value_or(0) + 1;; generation++) {
+            auto name = std::string(FILE_PREFIX) + std::to_string(generation);
+            auto path = fs::path(dir) / name;
+            auto tmp_path = fs::path(dir) / (name + std::string(TMP_INFIX) + std::to_string(std::random_device{}()));
+            write_file(tmp_path.c_str(), contents);
+
+            // unlike a rename, a hard link fails if the target already exists, e.g. when another process refreshed
+            //  the index concurrently; the newer generation wins either way
+            std::error_code link_error;
+            fs::create_hard_link(tmp_path, path, link_error);
+            std::error_code ec;
+            fs::remove(tmp_path, ec);
+            if (!link_error) return path;
+            if (!fs::exists(path, ec)) throw IoError("Could not write the repository index.", link_error.value());
+        }
+    }
+
+    struct RepositoryIndex::Layout {
+        const Header* header;
+        const PackageRecord* packages;
+        const StringRef* versions;
+        const uint32_t* buckets;
+        const uint32_t* slots;
+        const char* base;
+
+        struct OverlayPackage {
+            std::string_view name;
+            std::vector<std::string_view> versions{};
+            bool removed = false;
+            /// The replaced package of the base index.
+            std::optional<uint32_t> base_package{};
+        };
+
+        /// Packages changed by the replayed patch records; if there are none, the view is the base index.
+        std::vector<OverlayPackage> overlay{};
+        /// Case-folded name -> index in `overlay`.
+        std::unordered_map<std::string, uint32_t> overlay_names{};
+        /// Packages of the view, in order; base packages (`< header->package_count`) and overlay packages
+        /// (`header->package_count + i`). Only set if there are overlay packages.
+        std::vector<uint32_t> order{};
+        /// Position of each base package (and overlay package) in `order`, `UINT32_MAX` if replaced or removed.
+        std::vector<uint32_t> base_positions{};
+        std::vector<uint32_t> overlay_positions{};
+
+        uint32_t package_count = 0;
+        uint32_t version_count = 0;
+        uint64_t sequence = 0;
+        /// End of the last replayed patch record.
+        uint64_t end = 0;
+
+        [[nodiscard]] std::string_view string(StringRef ref) const {
+            return {base + ref.offset, ref.size};
+        }
+
+        [[nodiscard]] std::optional<uint32_t> find_base(std::string_view name) const {
+            auto n = header->package_count;
+            if (n == 0) return std::nullopt;
+            NameHash hash{name, header->seed, header->bucket_count};
+            auto package = slots[hash.slot(buckets[hash.bucket], n)];
+            if (!equal_ignore_case(string(packages[package].name), name)) return std::nullopt;
+            return package;
+        }
+
+        [[nodiscard]] const OverlayPackage* overlay_package(uint32_t position) const {
+            if (overlay.empty() || order[position] < header->package_count) return nullptr;
+            return &overlay[order[position] - header->package_count];
+        }
+
+        [[nodiscard]] const PackageRecord& base_package(uint32_t position) const {
+            return packages[overlay.empty() ? position : order[position]];
+        }
+
+        void apply(const PatchRecord& record) {
+            for (auto& p : record.packages) {
+                auto [it, inserted] = overlay_names.try_emplace(folded(p.name), (uint32_t) overlay.size());
+                if (inserted) overlay.push_back({.name = p.name, .base_package = find_base(p.name)});
+                auto& o = overlay[it->second];
+                o.name = p.name;
+                o.removed = !p.versions;
+                o.versions = p.versions.value_or(std::vector<std::string_view>{});
+            }
+        }
+
+        /// Merges the overlay into the base order; new packages are placed by their case-folded name.
+        void build_view() {
+            auto base_count = header->package_count;
+            package_count = base_count;
+            version_count = header->version_count;
+            if (overlay.empty()) return;
+
+            std::vector<uint32_t> base_overlay(base_count, UINT32_MAX);
+            std::vector<uint32_t> added;
+            for (uint32_t k = 0; k < overlay.size(); k++) {
+                if (overlay[k].base_package) base_overlay[*overlay[k].base_package] = k;
+                else if (!overlay[k].removed) added.push_back(k);
+            }
+            std::sort(added.begin(), added.end(), [&](uint32_t a, uint32_t b) {
+                return less_ignore_case(overlay[a].name, overlay[b].name);
+            });
+
+            version_count = 0;
+            base_positions.assign(base_count, UINT32_MAX);
+            overlay_positions.assign(overlay.size(), UINT32_MAX);
+            auto emit_overlay = [&](uint32_t k) {
+                overlay_positions[k] = (uint32_t) order.size();
+                order.push_back(base_count + k);
+                version_count += (uint32_t) overlay[k].versions.size();
+            };
+            size_t next_added = 0;
+            for (uint32_t i = 0; i < base_count; i++) {
+                auto name = string(packages[i].name);
+                while (next_added < added.size() && less_ignore_case(overlay[added[next_added]].name, name)) {
+                    emit_overlay(added[next_added++]);
+                }
+                if (auto k = base_overlay[i]; k != UINT32_MAX) {
+                    if (!overlay[k].removed) emit_overlay(k);
+                } else {
+                    base_positions[i] = (uint32_t) order.size();
+                    order.push_back(i);
+                    version_count += packages[i].version_count;
+                }
+            }
+            while (next_added < added.size()) emit_overlay(added[next_added++]);
+            package_count = (uint32_t) order.size();
+        }
+    };
+
+    RepositoryIndex::RepositoryIndex(const path_char* path)
+            : path_{path}, file_{path}, last_write_time_{stat_file(path).last_write_time} {
+        auto data = file_.data();
+        auto invalid = [] { return IoError("Invalid repository index file.", 0); };
+        if (data.size() < sizeof(Header) || memcmp(data.data(), MAGIC, sizeof(MAGIC))) throw invalid();
+
+        auto& h = *(const Header*) data.data();
+        // every section must be inside the file, and 4-byte aligned; sizes are checked in 64 bits to avoid overflows
+        auto section_ok = [&](uint64_t offset, uint64_t size) {
+            return offset % 4 == 0 && offset <= data.size() && size <= data.size() - offset;
+        };
+        if (h.package_count > 0 && h.bucket_count == 0) throw invalid();
+        if (!section_ok(h.packages_offset, (uint64_t) h.package_count * sizeof(PackageRecord)) ||
+            !section_ok(h.versions_offset, (uint64_t) h.version_count * sizeof(StringRef)) ||
+            !section_ok(h.buckets_offset, (uint64_t) h.bucket_count * sizeof(uint32_t)) ||
+            !section_ok(h.slots_offset, (uint64_t) h.package_count * sizeof(uint32_t)) ||
+            h.strings_offset > data.size() || h.strings_size > data.size() - h.strings_offset ||
+            !section_ok(h.base_size, 0) || h.base_size < (uint64_t) h.strings_offset + h.strings_size) {
+            throw invalid();
+        }
+
+        auto base = (const char*) data.data();
+        auto layout = std::make_unique<Layout>(Layout{
+            &h, (const PackageRecord*) (base + h.packages_offset), (const StringRef*) (base + h.versions_offset),
+            (const uint32_t*) (base + h.buckets_offset), (const uint32_t*) (base + h.slots_offset), base});
+        uint64_t strings_end = (uint64_t) h.strings_offset + h.strings_size;
+        auto string_ok = [&](StringRef ref) {
+            return ref.offset >= h.strings_offset && ref.offset <= strings_end && ref.size <= strings_end - ref.offset;
+        };
+
+        // validated once, so that lookups can trust the offsets; it's a linear pass over a few hundred kB for
+        //  the largest repositories, much cheaper than parsing the JSON index
+        if (!string_ok(h.etag) || !string_ok(h.last_modified)) throw invalid();
+        for (uint32_t i = 0; i < h.package_count; i++) {
+            auto& p = layout->packages[i];
+            if (!string_ok(p.name) || layout->slots[i] >= h.package_count || p.first_version > h.version_count ||
+                p.version_count > h.version_count - p.first_version) {
+                throw invalid();
+            }
+        }
+        for (uint32_t i = 0; i < h.version_count; i++) {
+            if (!string_ok(layout->versions[i])) throw invalid();
+        }
+
+        // replay the appended patches; a record for an already replayed sequence was appended by a process with
+        //  an outdated view, and is skipped
+        layout->sequence = h.sequence;
+        layout->end = h.base_size;
+        while (auto record = read_patch_record(data.subspan(layout->end))) {
+            if (record->sequence > layout->sequence + 1) break;
+            if (record->sequence == layout->sequence + 1) {
+                layout->apply(*record);
+                layout->sequence++;
+            }
+            layout->end += record->size;
+        }
+        layout->build_view();
+
+        append_path_ = path_;
+        append_offset_ = layout->end;
+        append_sequence_ = layout->sequence;
+        append_base_size_ = h.base_size;
+        layout_ = std::move(layout);
+    }
+
+    RepositoryIndex::~RepositoryIndex() = default;
+
+    std::unique_ptr<RepositoryIndex> RepositoryIndex::open_latest(const path_char* dir) {
+        auto generations = list_generations(dir);
+        std::unique_ptr<RepositoryIndex> index;
+        for (auto& [generation, path] : generations.files) {
+            if (!index) {
+                try {
+                    index = std::make_unique<RepositoryIndex>(path.c_str());
+                    continue;
+                } catch (const IoError&) {
+                    // deleted by a concurrent open of a newer generation, or invalid (an incompatible version,
+                    //  or a disk corruption); the older generations are still usable
+                }
+            }
+            // fails on Windows while another process still has the file open, it's retried on the next open
+            std::error_code ec;
+            fs::remove(path, ec);
+        }
+        return index;
+    }
+
+    uint32_t RepositoryIndex::package_count() const {
+        return layout_->package_count;
+    }
+
+    uint32_t RepositoryIndex::total_version_count() const {
+        return layout_->version_count;
+    }
+
+    std::optional<uint32_t> RepositoryIndex::find(std::string_view name) const {
+        auto& l = *layout_;
+        if (l.overlay.empty()) return l.find_base(name);
+
+        if (auto it = l.overlay_names.find(folded(name)); it != l.overlay_names.end()) {
+            auto position = l.overlay_positions[it->second];
+            return position == UINT32_MAX ? std::nullopt : std::optional{position};
+        }
+        auto package = l.find_base(name);
+        // base packages replaced by the overlay were found above, so the base package has a position
+        return package ? std::optional{l.base_positions[*package]} : std::nullopt;
+    }
+
+    std::string_view RepositoryIndex::name(uint32_t package) const {
+        if (auto o = layout_->overlay_package(package)) return o->name;
+        return layout_->string(layout_->base_package(package).name);
+    }
+
+    uint32_t RepositoryIndex::version_count(uint32_t package) const {
+        if (auto o = layout_->overlay_package(package)) return (uint32_t) o->versions.size();
+        return layout_->base_package(package).version_count;
+    }
+
+    std::string_view RepositoryIndex::version(uint32_t package, uint32_t version) const {
+        if (auto o = layout_->overlay_package(package)) return o->versions[version];
+        return layout_->string(layout_->versions[layout_->base_package(package).first_version + version]);
+    }
+
+    std::string_view RepositoryIndex::etag() const {
+        return layout_->overlay.empty() ? layout_->string(layout_->header->etag) : std::string_view{};
+    }
+
+    std::string_view RepositoryIndex::last_modified() const {
+        return layout_->overlay.empty() ? layout_->string(layout_->header->last_modified) : std::string_view{};
+    }
+
+    uint64_t RepositoryIndex::sequence() const {
+        return layout_->sequence;
+    }
+
+    void RepositoryIndex::touch() {
+        std::error_code ec;
+        fs::last_write_time(path_, fs::file_time_type::clock::now(), ec);
+        if (ec) throw IoError("Could not update the repository index.", ec.value());
+        last_write_time_ = now_filetime();
+    }
+
+    bool RepositoryIndex::append_patch(const IndexPatch& patch) {
+        std::lock_guard lock{append_mutex_};
+        if (patch.sequence <= append_sequence_) return true;
+        if (patch.sequence != append_sequence_ + 1) return false;
+
+        auto record = serialize_patch(patch);
+        {
+            RandomAccessFile file{append_path_.c_str()};
+            file.write_at(append_offset_, record);
+        }
+        append_offset_ += record.size();
+        append_sequence_ = patch.sequence;
+        last_write_time_ = now_filetime();
+
+        // replaying the patches on each open costs about as much as validating a quarter of the base index, merge
+        //  them into a new generation; the current file may contain patches appended by other processes
+        if (append_offset_ - append_base_size_ > append_base_size_ / 4) {
+            RepositoryIndex current{append_path_.c_str()};
+            IndexData data{.sequence = current.sequence()};
+            data.packages.reserve(current.package_count());
+            for (uint32_t i = 0; i < current.package_count(); i++) {
+                auto& p = data.packages.emplace_back(PackageEntry{std::string(current.name(i))});
+                for (uint32_t v = 0; v < current.version_count(i); v++) p.versions.emplace_back(current.version(i, v));
+            }
+            append_path_ = write_index(path_.parent_path().c_str(), data);
+            append_offset_ = append_base_size_ = fs::file_size(append_path_);
+            append_sequence_ = data.sequence;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MappedFile.hpp"
+
+// Local copy of the package index of a remote repository (`RemoteRepository` in Pog.dll), in a binary format that's
+//  memory-mapped instead of parsed. The remote index is a JSON object mapping each package name to its versions; it's
+//  downloaded and converted once, and afterwards, all Pog processes map the converted file, so that opening it costs
+//  a few page faults regardless of the number of packages.
+//
+// The index file (`repository-index.<generation>`) contains a string table, the package records (in the order of
+//  the remote index, which is sorted by name), the versions of each package (also in the remote order, newest first),
+//  and a minimal perfect hash table of the package names (CHD, "compress, hash and displace"), so that a lookup reads
+//  one displacement, one slot and one name to compare. Names are compared case-insensitively for ASCII letters.
+//
+// A refreshed index is written as a new generation under a temporary name and hard-linked into place once complete;
+//  readers of the old generation are not affected, and pick up the new one the next time they open the index. Older
+//  generations are deleted when a newer one is opened.
+//
+// Small changes of the remote index are applied as delta patches (see `DeltaUpdate.hpp`), which are appended to the end
+//  of the current generation as checksummed records, each with the sequence number of the remote index it produces.
+//  The mapped part of the file never changes, so an appended record is only seen by readers that open the index
+//  afterwards; when opened, the records are replayed over the base index, with the changed packages kept in a small
+//  overlay. Records are serialized deterministically, so that two processes appending the same patch at the same
+//  offset write the same bytes; records with an unexpected sequence number, or a bad checksum (e.g. a write torn
+//  by a crash), end the replay, and are overwritten by the next append. Once the records grow to a quarter
+//  of the base index, they're merged into a new generation.
+namespace repository {
+    struct PackageEntry {
+        std::string name;
+        /// In the order of the remote index (newest first).
+        std::vector<std::string> versions{};
+    };
+
+    struct IndexData {
+        /// In the order of the remote index (sorted by name). Names must be unique (case-insensitively for ASCII).
+        std::vector<PackageEntry> packages{};
+        /// HTTP validators of the downloaded remote index, for conditional requests when refreshing it.
+        std::string etag{};
+        std::string last_modified{};
+        /// Sequence number of the remote index (see `DeltaUpdate.hpp`), 0 if the repository does not publish patches.
+        uint64_t sequence = 0;
+    };
+
+    struct PackagePatch {
+        std::string name;
+        /// New versions of the package (newest first), or empty if the package was removed.
+        std::optional<std::vector<std::string>> versions{};
+    };
+
+    /// Changes between the remote index with `sequence - 1` and the one with `sequence`.
+    struct IndexPatch {
+        uint64_t sequence;
+        std::vector<PackagePatch> packages{};
+    };
+
+    /// Serializes `data` into the index file format. Throws `std::invalid_argument` for duplicate package names.
+    std::vector<uint8_t> build_index(const IndexData& data);
+
+    /// Writes `data` as the next generation of the index in `dir` (which must exist) and returns its path.
+    /// Throws `IoError` or `std::invalid_argument`.
+    std::filesystem::path write_index(const path_char* dir, const IndexData& data);
+
+    /// Read-only view of an index file; may be used from multiple threads at once.
+    class RepositoryIndex {
+    private:
+        struct Layout;
+
+        const std::filesystem::path path_;
+        const MappedFile file_;
+        /// FILETIME of the last write of the file when it was opened, see `touch`.
+        std::atomic<uint64_t> last_write_time_;
+        std::unique_ptr<const Layout> layout_;
+
+        /// Where the next patch is appended; moves on with each `append_patch` of this instance, while the mapped
+        /// view stays the same.
+        std::mutex append_mutex_;
+        std::filesystem::path append_path_;
+        uint64_t append_offset_;
+        uint64_t append_sequence_;
+        uint64_t append_base_size_;
+
+    public:
+        /// Maps and validates the index file at `path`. Throws `IoError` if it cannot be read or is invalid.
+        explicit RepositoryIndex(const path_char* path);
+        ~RepositoryIndex();
+
+        RepositoryIndex(const RepositoryIndex&) = delete;
+        RepositoryIndex& operator=(const RepositoryIndex&) = delete;
+
+        /// Opens the newest valid generation of the index in `dir`, and deletes the older ones. Returns null
+        /// if there's none. Throws `IoError` if `dir` cannot be listed.
+        static std::unique_ptr<RepositoryIndex> open_latest(const path_char* dir);
+
+        [[nodiscard]] uint32_t package_count() const;
+        [[nodiscard]] uint32_t total_version_count() const;
+        /// Returns the index of the package called `name`, ignoring ASCII case.
+        [[nodiscard]] std::optional<uint32_t> find(std::string_view name) const;
+        [[nodiscard]] std::string_view name(uint32_t package) const;
+        [[nodiscard]] uint32_t version_count(uint32_t package) const;
+        [[nodiscard]] std::string_view version(uint32_t package, uint32_t version) const;
+
+        /// Validators of the downloaded remote index; empty once patches are applied, since the index no longer
+        /// matches the downloaded one.
+        [[nodiscard]] std::string_view etag() const;
+        [[nodiscard]] std::string_view last_modified() const;
+        /// Sequence number of the remote index this view corresponds to, 0 if unknown.
+        [[nodiscard]] uint64_t sequence() const;
+
+        [[nodiscard]] const std::filesystem::path& path() const {
+            return path_;
+        }
+
+        /// Time the index was written or last confirmed to be up to date with the remote index.
+        [[nodiscard]] uint64_t last_write_time() const {
+            return last_write_time_.load();
+        }
+
+        /// Marks the index as up to date (the remote index did not change) by updating the last write time of the file.
+        void touch();
+
+        /// Appends `patch` to the index file, if it directly follows the last patch applied to the file by this
+        /// instance (initially, the opened view), and returns false otherwise. The cost is proportional to the size
+        /// of the patch, except when the patches are merged into a new generation. The view of this instance does
+        /// not change, the index must be reopened to see the patch. Throws `IoError`.
+        bool append_patch(const IndexPatch& patch);
+    };
+
+    /// Parses a patch in the text format published by the repository: a line for each changed package, either
+    /// `+<name>` followed by its versions (newest first), all separated by tabs, or `-<name>` for a removed package.
+    /// Throws `std::invalid_argument` if the patch is malformed.
+    IndexPatch parse_patch(uint64_t sequence, std::string_view text);
+}
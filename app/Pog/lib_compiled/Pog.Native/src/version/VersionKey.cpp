@@ -0,0 +1,127 @@
+#include "VersionKey.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace version {
+    namespace {
+        constexpr uint8_t MAIN_END = 0x00;
+        constexpr uint8_t MAIN_COMPONENT = 0x01;
+        constexpr uint8_t TEXT_TOKEN = 0x10;
+        constexpr uint8_t TYPE_TOKEN = 0x20;
+        constexpr uint8_t DEV_END = 0x30;
+        constexpr uint8_t NUMBER_TOKEN = 0x40;
+        constexpr uint8_t NO_DEV = 0x50;
+
+        bool is_digit(char c) {
+            return c >= '0' && c <= '9';
+        }
+
+        bool is_separator(char c) {
+            return c == '.' || c == ',' || c == '-' || c == '_';
+        }
+
+        /// `Path.GetInvalidFileNameChars()` on Windows.
+        bool is_invalid_file_name_char(char c) {
+            return (uint8_t) c < 32 || c == '"' || c == '<' || c == '>' || c == '|' || c == ':' || c == '*' ||
+                   c == '?' || c == '\\' || c == '/';
+        }
+
+        /// Parses a run of ASCII digits (leading zeros are allowed, like in `int.Parse`), returns nothing if it does
+        /// not fit into an `int`.
+        std::optional<uint32_t> parse_number(std::string_view digits) {
+            uint64_t value = 0;
+            for (auto c : digits) {
+                value = value * 10 + (uint64_t) (c - '0');
+                if (value > INT32_MAX) return std::nullopt;
+            }
+            return (uint32_t) value;
+        }
+
+        /// Value of `PackageVersion.DevVersionType` for the token; matched case-sensitively, like the managed map.
+        std::optional<uint8_t> dev_version_type(std::string_view token) {
+            if (token == "nightly") return 0;
+            if (token == "preview") return 1;
+            if (token == "alpha" || token == "a") return 2;
+            if (token == "beta" || token == "b") return 3;
+            if (token == "rc") return 4;
+            return std::nullopt;
+        }
+
+        uint8_t* write_u32(uint8_t* out, uint32_t value) {
+            out[0] = (uint8_t) (value >> 24);
+            out[1] = (uint8_t) (value >> 16);
+            out[2] = (uint8_t) (value >> 8);
+            out[3] = (uint8_t) value;
+            return out + 4;
+        }
+    }
+
+    std::optional<KeyInfo> encode_key(std::string_view version, std::span<uint8_t> key) {
+        if (version.empty() || version == "." || version == "..") return std::nullopt;
+        if (std::any_of(version.begin(), version.end(), is_invalid_file_name_char)) return std::nullopt;
+        if (!is_digit(version[0])) return std::nullopt;
+
+        // everything after the first `+` is build metadata, which is not compared
+        auto str = version.substr(0, version.find('+'));
+        auto out = key.data();
+
+        // main part, `\d+(\.\d+)*`; trailing zero components are dropped, since a shorter version is padded with zeros
+        size_t i = 0;
+        auto main_end = out;
+        while (true) {
+            auto start = i;
+            while (i < str.size() && is_digit(str[i])) i++;
+            auto value = parse_number(str.substr(start, i - start));
+            if (!value) return std::nullopt;
+            *out++ = MAIN_COMPONENT;
+            out = write_u32(out, *value);
+            if (*value != 0) main_end = out;
+
+            if (i + 1 < str.size() && str[i] == '.' && is_digit(str[i + 1])) i++;
+            else break;
+        }
+        out = main_end;
+        *out++ = MAIN_END;
+
+        // dev suffix, split on separators and between digits and other characters
+        auto first_token = out;
+        auto exact = true;
+        while (i < str.size()) {
+            if (is_separator(str[i])) {
+                i++;
+                continue;
+            }
+            auto start = i;
+            auto numeric = is_digit(str[i]);
+            while (i < str.size() && !is_separator(str[i]) && is_digit(str[i]) == numeric) i++;
+            auto token = str.substr(start, i - start);
+
+            if (numeric) {
+                auto value = parse_number(token);
+                if (!value) return std::nullopt;
+                *out++ = NUMBER_TOKEN;
+                out = write_u32(out, *value);
+            } else if (auto type = dev_version_type(token)) {
+                *out++ = TYPE_TOKEN;
+                *out++ = *type;
+            } else {
+                // cannot contain a 0 byte, which is an invalid file name character
+                *out++ = TEXT_TOKEN;
+                memcpy(out, token.data(), token.size());
+                out += token.size();
+                *out++ = 0;
+                exact = false;
+            }
+        }
+        auto has_dev = out != first_token;
+        *out++ = has_dev ? DEV_END : NO_DEV;
+
+        return KeyInfo{(size_t) (out - key.data()), exact};
+    }
+
+    int compare_keys(std::span<const uint8_t> a, std::span<const uint8_t> b) {
+        auto result = memcmp(a.data(), b.data(), std::min(a.size(), b.size()));
+        if (result != 0) return result;
+        return a.size() < b.size() ? -1 : a.size() > b.size() ? 1 : 0;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+
+// Order-preserving binary sort keys of package versions, with the same ordering as `Pog.PackageVersion.CompareTo`,
+//  so that sorting a version list compares keys with `memcmp` instead of walking the parsed tokens.
+//
+// A version is `<main>[<dev>][+<build metadata>]`, where `main` is a sequence of dot-separated numbers, `dev` is split
+//  into tokens on `.,-_` and on each change between digits and other characters, and the build metadata is ignored.
+//  A dev token is a number, a known prerelease type (`nightly` < `preview` < `alpha`/`a` < `beta`/`b` < `rc`), or
+//  other text. Versions with the same main part and no dev suffix are greater than those with one; dev tokens are
+//  compared in order, with text < prerelease type < missing token < number.
+//
+// The key is:
+//  - each main component, after dropping trailing zeros, as `0x01` followed by its value as a big-endian u32, then
+//    `0x00`; a shorter main part is padded with zeros, so the first remaining component decides,
+//  - `0x50` if there are no dev tokens; otherwise, each token as `0x10 <text> 0x00`, `0x20 <type>` or `0x40 <u32>`,
+//    followed by `0x30`, which sorts between a prerelease type and a number, like the missing token.
+//
+// Text tokens are compared with the current culture by the managed implementation, and ordinally (by UTF-8 bytes)
+//  here, so the key of a version with a text token is marked as inexact, and must not be compared with other keys
+//  (equal keys are still equal versions). Only ASCII digits are digits here; the managed parser rejects versions
+//  with other Unicode digits.
+namespace version {
+    /// Upper bound of the size of the key of a version string with `version_size` bytes (each component or token
+    /// takes at most 5 bytes per character, plus the terminators).
+    constexpr size_t max_key_size(size_t version_size) {
+        return 5 * version_size + 2;
+    }
+
+    struct KeyInfo {
+        size_t size;
+        /// False if the version has a text dev token, see above.
+        bool exact;
+    };
+
+    /// Encodes `version` into `key`, which must have at least `max_key_size(version.size())` bytes. Returns nothing
+    /// if `version` is not a valid package version (empty, not a valid file name, not starting with a number,
+    /// or with a number that does not fit into an `int`). Does not allocate.
+    std::optional<KeyInfo> encode_key(std::string_view version, std::span<uint8_t> key);
+
+    /// Compares two exact keys, returns a negative number, zero or a positive number, like `memcmp`.
+    int compare_keys(std::span<const uint8_t> a, std::span<const uint8_t> b);
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+// Minimal writers of zip, tar and gzip archives for the tests and benchmarks of `archive/`. They produce
+//  the corner cases (zip64, pax headers, links,...) without external tools; with zlib available, entries are
+//  compressed by zlib, otherwise only stored deflate blocks are used.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "archive/Crc32.hpp"
+#include "archive/Formats.hpp"
+
+#ifdef POG_TEST_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace test_archive {
+    using archive::crc32;
+    using archive::unix_time_to_filetime;
+
+    using Bytes = std::vector<uint8_t>;
+
+    inline Bytes to_bytes(std::string_view str) {
+        return {str.begin(), str.end()};
+    }
+
+    inline Bytes pseudo_random_text(size_t size) {
+        // compressible, but not trivially
+        static const char* words[] = {"pog ", "package ", "manifest ", "shim ", "archive ", "\n", "7zip ", "42 "};
+        Bytes data;
+        uint32_t x = 0x1234'5678;
+        while (data.size() < size) {
+            x = x * 1664525 + 1013904223;
+            for (auto p = words[x >> 29]; *p && data.size() < size; p++) data.push_back((uint8_t) *p);
+        }
+        return data;
+    }
+
+    inline void put_le(Bytes& out, uint64_t value, size_t size) {
+        for (size_t i = 0; i < size; i++) out.push_back((uint8_t) (value >> (8 * i)));
+    }
+
+    inline void append(Bytes& out, std::span<const uint8_t> data) {
+        out.insert(out.end(), data.begin(), data.end());
+    }
+
+    /// Raw deflate stream of stored blocks.
+    inline Bytes deflate_stored(std::span<const uint8_t> data) {
+        Bytes out;
+        size_t pos = 0;
+        do {
+            auto n = std::min<size_t>(data.size() - pos, 0xffff);
+            out.push_back(pos + n == data.size() ? 1 : 0);
+            put_le(out, n, 2);
+            put_le(out, n ^ 0xffff, 2);
+            append(out, data.subspan(pos, n));
+            pos += n;
+        } while (pos < data.size());
+        return out;
+    }
+
+#ifdef POG_TEST_HAS_ZLIB
+    inline Bytes deflate_zlib(std::span<const uint8_t> data, int level, int strategy = Z_DEFAULT_STRATEGY) {
+        z_stream stream{};
+        deflateInit2(&stream, level, Z_DEFLATED, -15, 9, strategy);
+        Bytes out(deflateBound(&stream, (uLong) data.size()));
+        stream.next_in = (Bytes::value_type*) data.data();
+        stream.avail_in = (uInt) data.size();
+        stream.next_out = out.data();
+        stream.avail_out = (uInt) out.size();
+        deflate(&stream, Z_FINISH);
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return out;
+    }
+#endif
+
+    inline Bytes deflate_raw(std::span<const uint8_t> data) {
+#ifdef POG_TEST_HAS_ZLIB
+        return deflate_zlib(data, 6);
+#else
+        return deflate_stored(data);
+#endif
+    }
+
+    enum class ZipTime { UNIX, NTFS, DOS };
+
+    struct ZipEntrySpec {
+        std::string name;
+        Bytes data = {};
+        uint16_t method = 8;
+        uint16_t flags = 0;
+        ZipTime time = ZipTime::UNIX;
+    };
+
+    constexpr int64_t ENTRY_MTIME = 1'600'000'000;
+
+    inline Bytes build_zip(const std::vector<ZipEntrySpec>& entries, bool zip64 = false) {
+        Bytes out, cd;
+        for (auto& e : entries) {
+            auto compressed = e.method == 8 ? deflate_raw(e.data) : e.data;
+            auto crc = crc32(e.data);
+            auto offset = out.size();
+            auto size32 = zip64 ? 0xffff'ffff : e.data.size();
+            auto compressed_size32 = zip64 ? 0xffff'ffff : compressed.size();
+
+            put_le(out, 0x0403'4b50, 4);
+            put_le(out, zip64 ? 45 : 20, 2);
+            put_le(out, e.flags, 2);
+            put_le(out, e.method, 2);
+            put_le(out, 0, 2);
+            put_le(out, 0x21, 2);
+            put_le(out, crc, 4);
+            put_le(out, compressed_size32, 4);
+            put_le(out, size32, 4);
+            put_le(out, e.name.size(), 2);
+            put_le(out, zip64 ? 20 : 0, 2);
+            append(out, to_bytes(e.name));
+            if (zip64) {
+                put_le(out, 0x0001, 2);
+                put_le(out, 16, 2);
+                put_le(out, e.data.size(), 8);
+                put_le(out, compressed.size(), 8);
+            }
+            append(out, compressed);
+
+            Bytes extra;
+            if (zip64) {
+                put_le(extra, 0x0001, 2);
+                put_le(extra, 24, 2);
+                put_le(extra, e.data.size(), 8);
+                put_le(extra, compressed.size(), 8);
+                put_le(extra, offset, 8);
+            }
+            if (e.time == ZipTime::UNIX) {
+                put_le(extra, 0x5455, 2);
+                put_le(extra, 5, 2);
+                extra.push_back(1);
+                put_le(extra, ENTRY_MTIME, 4);
+            } else if (e.time == ZipTime::NTFS) {
+                put_le(extra, 0x000a, 2);
+                put_le(extra, 32, 2);
+                put_le(extra, 0, 4);
+                put_le(extra, 1, 2);
+                put_le(extra, 24, 2);
+                for (int i = 0; i < 3; i++) put_le(extra, unix_time_to_filetime(ENTRY_MTIME) + 1234567, 8);
+            }
+
+            put_le(cd, 0x0201'4b50, 4);
+            put_le(cd, 0x031e, 2);
+            put_le(cd, zip64 ? 45 : 20, 2);
+            put_le(cd, e.flags, 2);
+            put_le(cd, e.method, 2);
+            put_le(cd, 0, 2);
+            put_le(cd, 0x21, 2);
+            put_le(cd, crc, 4);
+            put_le(cd, compressed_size32, 4);
+            put_le(cd, size32, 4);
+            put_le(cd, e.name.size(), 2);
+            put_le(cd, extra.size(), 2);
+            put_le(cd, 0, 2);
+            put_le(cd, 0, 2);
+            put_le(cd, 0, 2);
+            put_le(cd, e.name.ends_with('/') ? 0x41ed'0010 : 0x81a4'0000, 4);
+            put_le(cd, zip64 ? 0xffff'ffff : offset, 4);
+            append(cd, to_bytes(e.name));
+            append(cd, extra);
+        }
+
+        auto cd_offset = out.size();
+        append(out, cd);
+        if (zip64) {
+            auto zip64_eocd = out.size();
+            put_le(out, 0x0606'4b50, 4);
+            put_le(out, 44, 8);
+            put_le(out, 45, 2);
+            put_le(out, 45, 2);
+            put_le(out, 0, 8);
+            put_le(out, entries.size(), 8);
+            put_le(out, entries.size(), 8);
+            put_le(out, cd.size(), 8);
+            put_le(out, cd_offset, 8);
+            put_le(out, 0x0706'4b50, 4);
+            put_le(out, 0, 4);
+            put_le(out, zip64_eocd, 8);
+            put_le(out, 1, 4);
+        }
+        std::string comment = "archive comment";
+        put_le(out, 0x0605'4b50, 4);
+        put_le(out, 0, 4);
+        put_le(out, zip64 ? 0xffff : entries.size(), 2);
+        put_le(out, zip64 ? 0xffff : entries.size(), 2);
+        put_le(out, zip64 ? 0xffff'ffff : cd.size(), 4);
+        put_le(out, zip64 ? 0xffff'ffff : cd_offset, 4);
+        put_le(out, comment.size(), 2);
+        append(out, to_bytes(comment));
+        return out;
+    }
+
+    inline void put_octal(uint8_t* field, size_t size, uint64_t value) {
+        for (size_t i = size - 1; i-- > 0; value >>= 3) field[i] = (uint8_t) ('0' + (value & 7));
+        field[size - 1] = 0;
+    }
+
+    inline void add_tar_entry(Bytes& out, const std::string& name, char type, std::span<const uint8_t> data,
+                       const std::string& prefix = "") {
+        uint8_t header[512]{};
+        memcpy(header, name.data(), std::min<size_t>(name.size(), 100));
+        put_octal(header + 100, 8, 0644);
+        put_octal(header + 108, 8, 0);
+        put_octal(header + 116, 8, 0);
+        put_octal(header + 124, 12, data.size());
+        put_octal(header + 136, 12, ENTRY_MTIME);
+        header[156] = (uint8_t) type;
+        memcpy(header + 257, "ustar\0" "00", 8);
+        memcpy(header + 345, prefix.data(), prefix.size());
+        memset(header + 148, ' ', 8);
+        uint32_t sum = 0;
+        for (auto b : header) sum += b;
+        put_octal(header + 148, 7, sum);
+        append(out, header);
+        append(out, data);
+        out.resize(out.size() + (512 - data.size() % 512) % 512);
+    }
+
+    /// Pax extended header record, "<length> <key>=<value>\n", where the length includes itself.
+    inline std::string pax_record(const std::string& key, const std::string& value) {
+        auto size = key.size() + value.size() + 3;
+        auto length = std::to_string(size);
+        while (std::to_string(size + length.size()) != length) length = std::to_string(size + length.size());
+        return length + " " + key + "=" + value + "\n";
+    }
+
+    inline Bytes gzip(std::span<const uint8_t> data) {
+        Bytes out{0x1f, 0x8b, 8, 8, 0, 0, 0, 0, 0, 3};
+        append(out, to_bytes(std::string_view{"archive.tar", 12}));
+        append(out, deflate_raw(data));
+        put_le(out, crc32(data), 4);
+        put_le(out, data.size(), 4);
+        return out;
+    }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+// Builder of synthetic PE images for the tests, with the same layout as the executables produced by MSVC
+//  (including the shim templates): PE32+ headers, `.text`, `.rdata`, `.data`, then `.rsrc` and `.reloc`.
+//  The section contents are filled with a pattern derived from the section name, so that the tests can check that
+//  the sections were preserved.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "pe/PeImage.hpp"
+
+namespace test_pe {
+    constexpr uint32_t FILE_ALIGNMENT = 0x200;
+    constexpr uint32_t SECTION_ALIGNMENT = 0x1000;
+    constexpr uint32_t SIZE_OF_HEADERS = 0x400;
+    constexpr uint16_t SUBSYSTEM_CONSOLE = 3;
+    constexpr uint16_t SUBSYSTEM_GUI = 2;
+
+    struct Section {
+        std::string name;
+        std::vector<uint8_t> data;
+        uint32_t characteristics = pe::SCN_CNT_INITIALIZED_DATA | pe::SCN_MEM_READ;
+    };
+
+    /// Deterministic section contents, different for each section name.
+    inline std::vector<uint8_t> pattern(const std::string& name, size_t size) {
+        std::vector<uint8_t> data(size);
+        uint32_t state = 2166136261u;
+        for (auto c : name) state = (state ^ (uint8_t) c) * 16777619u;
+        for (auto& b : data) {
+            state = state * 1664525u + 1013904223u;
+            b = (uint8_t) (state >> 24);
+        }
+        return data;
+    }
+
+    struct ImageSpec {
+        std::vector<Section> sections = {
+            {".text", pattern(".text", 0x1234), 0x6000'0020},
+            {".rdata", pattern(".rdata", 0x456)},
+            {".data", pattern(".data", 0x80), 0xc000'0040},
+            {".reloc", pattern(".reloc", 0x30), 0x4200'0040},
+        };
+        uint16_t subsystem = SUBSYSTEM_CONSOLE;
+        uint32_t checksum = 0;
+        /// Appended after the sections.
+        std::vector<uint8_t> overlay = {};
+    };
+
+    /// Builds the image; a section named `.rsrc` is treated as the resource section, and its data must be written
+    /// by `pe::write_resource_section` with the RVA `section_rva(spec, index)`.
+    inline std::vector<uint8_t> build(const ImageSpec& spec) {
+        std::vector<uint8_t> out(SIZE_OF_HEADERS, 0);
+        auto w16 = [&](size_t o, uint16_t n) { pe::write_u16(out, o, n); };
+        auto w32 = [&](size_t o, uint32_t n) { pe::write_u32(out, o, n); };
+
+        w16(0, 0x5a4d);
+        w32(0x3c, 0x80);
+        w32(0x80, 0x0000'4550);
+        auto coff = 0x84, opt = coff + 20;
+        w16(coff, 0x8664);
+        w16(coff + 2, (uint16_t) spec.sections.size());
+        w16(coff + 16, 240); // size of optional header for PE32+ with 16 data directories
+        w16(coff + 18, 0x22); // executable, large address aware
+        w16(opt, pe::PeImage::PE32_PLUS_MAGIC);
+        w32(opt + 32, SECTION_ALIGNMENT);
+        w32(opt + 36, FILE_ALIGNMENT);
+        w32(opt + 60, SIZE_OF_HEADERS);
+        w32(opt + 64, spec.checksum);
+        w16(opt + 68, spec.subsystem);
+        w32(opt + 108, 16);
+
+        uint32_t rva = SECTION_ALIGNMENT, raw = SIZE_OF_HEADERS, initialized_data = 0;
+        auto section_table = (size_t) opt + 240;
+        for (size_t i = 0; i < spec.sections.size(); i++) {
+            auto& s = spec.sections[i];
+            auto raw_size = pe::align_up((uint32_t) s.data.size(), FILE_ALIGNMENT);
+            pe::SectionHeader h{};
+            memcpy(h.name, s.name.data(), std::min<size_t>(s.name.size(), 8));
+            h.virtual_size = (uint32_t) s.data.size();
+            h.virtual_address = rva;
+            h.size_of_raw_data = raw_size;
+            h.pointer_to_raw_data = raw;
+            h.characteristics = s.characteristics;
+            memcpy(out.data() + section_table + i * sizeof(h), &h, sizeof(h));
+
+            if (s.name == ".rsrc") {
+                w32(opt + 112 + 2 * 8, rva);
+                w32(opt + 112 + 2 * 8 + 4, (uint32_t) s.data.size());
+            } else if (s.name == ".reloc") {
+                w32(opt + 112 + 5 * 8, rva);
+                w32(opt + 112 + 5 * 8 + 4, (uint32_t) s.data.size());
+            }
+            if (s.characteristics & pe::SCN_CNT_INITIALIZED_DATA) initialized_data += raw_size;
+
+            out.resize(raw + raw_size, 0);
+            std::copy(s.data.begin(), s.data.end(), out.begin() + raw);
+            rva += pe::align_up((uint32_t) s.data.size(), SECTION_ALIGNMENT);
+            raw += raw_size;
+        }
+        w32(opt + 8, initialized_data);
+        w32(opt + 56, rva);
+        out.insert(out.end(), spec.overlay.begin(), spec.overlay.end());
+        return out;
+    }
+
+    /// RVA at which the section at `index` will be mapped by `build`.
+    inline uint32_t section_rva(const ImageSpec& spec, size_t index) {
+        uint32_t rva = SECTION_ALIGNMENT;
+        for (size_t i = 0; i < index; i++) rva += pe::align_up((uint32_t) spec.sections[i].data.size(), SECTION_ALIGNMENT);
+        return rva;
+    }
+}
+
+#include "pe/ResourceTable.hpp"
+
+namespace test_pe {
+    /// Builds an image with `resources` in a `.rsrc` section before `.reloc`, like MSVC does.
+    inline std::vector<uint8_t> build_with_resources(const pe::ResourceTable& resources, ImageSpec spec = {}) {
+        size_t index = spec.sections.size();
+        for (size_t i = 0; i < spec.sections.size(); i++) {
+            if (spec.sections[i].name == ".reloc") index = i;
+        }
+        spec.sections.insert(spec.sections.begin() + (ptrdiff_t) index, {".rsrc", {}});
+        spec.sections[index].data = pe::write_resource_section(resources, section_rva(spec, index));
+        return build(spec);
+    }
+
+    inline pe::Resource resource(const std::string& str, uint32_t code_page = 0) {
+        return {{str.begin(), str.end()}, code_page};
+    }
+
+    /// A table with a typical set of resources copied to shims: icons, an icon group, version info and a manifest.
+    inline pe::ResourceTable sample_resources() {
+        pe::ResourceTable t;
+        for (uint16_t i = 1; i <= 6; i++) {
+            t.set({pe::ResourceType::ICON, i, 1033}, {pattern("icon" + std::to_string(i), 300u * i), 0});
+        }
+        t.set({pe::ResourceType::GROUP_ICON, 1, 1033}, resource("group icon"));
+        t.set({pe::ResourceType::VERSION, 1, 1033}, {pattern("version", 0x37c), 1200});
+        t.set({pe::ResourceType::MANIFEST, 1, 1033}, resource("<assembly/>"));
+        return t;
+    }
+}
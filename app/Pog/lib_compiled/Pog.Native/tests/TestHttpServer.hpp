@@ -0,0 +1,243 @@
+#pragma once
+
+// Minimal threaded HTTP/1.1 server on the loopback interface, serving a single file to the downloader tests and
+//  benchmarks (POSIX only). Supports keep-alive, range requests, a redirect, a per-connection rate limit, and
+//  dropping a connection in the middle of a response. Additional static files may be served at other paths.
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace test_http {
+    struct ServerOptions {
+        /// Respond to range requests with 206; otherwise, the whole file is always returned with 200.
+        bool accept_ranges = true;
+        /// Bytes per second sent over each connection, 0 for unlimited.
+        uint64_t rate_limit = 0;
+    };
+
+    class TestHttpServer {
+    public:
+        /// Number of body bytes sent over all connections.
+        std::atomic<uint64_t> served_bytes = 0;
+        std::atomic<unsigned> requests = 0;
+        /// If non-negative, the connection that would send the body byte at this `served_bytes` count is closed
+        /// instead (once).
+        std::atomic<int64_t> drop_at = -1;
+
+    private:
+        static constexpr size_t SEND_CHUNK = 16 << 10;
+
+        ServerOptions options_;
+        int listen_fd_ = -1;
+        uint16_t port_ = 0;
+        std::atomic<bool> stopping_ = false;
+        std::thread accept_thread_{};
+
+        std::mutex mutex_;
+        std::shared_ptr<const std::vector<uint8_t>> content_;
+        std::string etag_{};
+        std::map<std::string, std::shared_ptr<const std::vector<uint8_t>>, std::less<>> files_{};
+        std::set<int> client_fds_{};
+        std::vector<std::thread> client_threads_{};
+
+    public:
+        explicit TestHttpServer(std::vector<uint8_t> content, ServerOptions options = {}, std::string etag = "\"v1\"")
+                : options_{options}, content_{std::make_shared<std::vector<uint8_t>>(std::move(content))},
+                  etag_{std::move(etag)} {
+            listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t address_size = sizeof(address);
+            if (bind(listen_fd_, (sockaddr*) &address, address_size) != 0 || listen(listen_fd_, 64) != 0
+                || getsockname(listen_fd_, (sockaddr*) &address, &address_size) != 0) {
+                throw std::runtime_error(std::string("Could not start the test HTTP server: ") + strerror(errno));
+            }
+            port_ = ntohs(address.sin_port);
+            accept_thread_ = std::thread([this] { accept_loop(); });
+        }
+
+        ~TestHttpServer() {
+            stopping_ = true;
+            shutdown(listen_fd_, SHUT_RDWR);
+            accept_thread_.join();
+            {
+                std::lock_guard lock{mutex_};
+                for (auto fd : client_fds_) shutdown(fd, SHUT_RDWR);
+            }
+            for (auto& t : client_threads_) t.join();
+            close(listen_fd_);
+        }
+
+        TestHttpServer(const TestHttpServer&) = delete;
+        TestHttpServer& operator=(const TestHttpServer&) = delete;
+
+        /// `/file` serves the content, `/redirect` redirects to `/file`.
+        [[nodiscard]] std::string url(const std::string& path = "/file") const {
+            return "http://127.0.0.1:" + std::to_string(port_) + path;
+        }
+
+        /// Replaces the served file, e.g. to simulate a new release between two download attempts.
+        void set_content(std::vector<uint8_t> content, std::string etag) {
+            std::lock_guard lock{mutex_};
+            content_ = std::make_shared<std::vector<uint8_t>>(std::move(content));
+            etag_ = std::move(etag);
+        }
+
+        /// Serves `content` at `path` (e.g. `/dir/file.txt`), with no ETag, or stops serving it if `content` is empty.
+        void set_file(const std::string& path, std::string_view content) {
+            std::lock_guard lock{mutex_};
+            if (content.empty()) files_.erase(path);
+            else files_[path] = std::make_shared<std::vector<uint8_t>>(content.begin(), content.end());
+        }
+
+    private:
+        void accept_loop() {
+            while (true) {
+                auto fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd < 0) {
+                    if (errno == EINTR && !stopping_) continue;
+                    return;
+                }
+                std::lock_guard lock{mutex_};
+                client_fds_.insert(fd);
+                client_threads_.emplace_back([this, fd] { serve(fd); });
+            }
+        }
+
+        void serve(int fd) {
+            std::string received;
+            while (!stopping_) {
+                auto header_end = received.find("\r\n\r\n");
+                while (header_end == std::string::npos) {
+                    char buffer[4096];
+                    auto n = recv(fd, buffer, sizeof(buffer), 0);
+                    if (n <= 0) return disconnect(fd);
+                    received.append(buffer, (size_t) n);
+                    header_end = received.find("\r\n\r\n");
+                }
+                auto request = received.substr(0, header_end + 2);
+                received.erase(0, header_end + 4);
+                requests++;
+                if (!respond(fd, request)) return disconnect(fd);
+            }
+            disconnect(fd);
+        }
+
+        void disconnect(int fd) {
+            {
+                std::lock_guard lock{mutex_};
+                client_fds_.erase(fd);
+            }
+            close(fd);
+        }
+
+        /// Returns false if the connection should be closed.
+        bool respond(int fd, const std::string& request) {
+            auto path_start = request.find(' ') + 1;
+            auto path = request.substr(path_start, request.find(' ', path_start) - path_start);
+            // the query is ignored, like the signature of a signed download URL
+            path = path.substr(0, path.find('?'));
+            if (path == "/redirect") {
+                return send_all(fd, "HTTP/1.1 302 Found\r\nLocation: /file\r\nContent-Length: 0\r\n\r\n");
+            }
+
+            std::shared_ptr<const std::vector<uint8_t>> content;
+            std::string etag;
+            {
+                std::lock_guard lock{mutex_};
+                if (path == "/file") {
+                    content = content_;
+                    etag = etag_;
+                } else if (auto it = files_.find(path); it != files_.end()) {
+                    content = it->second;
+                }
+            }
+            if (!content) {
+                return send_all(fd, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+            }
+            uint64_t size = content->size();
+
+            std::string headers;
+            uint64_t first = 0, last = size - 1;
+            auto range = parse_range(request);
+            if (range && options_.accept_ranges) {
+                if (range->first >= size) {
+                    return send_all(fd, "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */"
+                                        + std::to_string(size) + "\r\nContent-Length: 0\r\n\r\n");
+                }
+                first = range->first;
+                last = std::min(range->last.value_or(size - 1), size - 1);
+                headers = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(first) + "-"
+                          + std::to_string(last) + "/" + std::to_string(size) + "\r\n";
+            } else {
+                headers = "HTTP/1.1 200 OK\r\n";
+            }
+            auto length = size == 0 ? 0 : last - first + 1;
+            headers += "Content-Length: " + std::to_string(length) + "\r\n";
+            if (options_.accept_ranges) headers += "Accept-Ranges: bytes\r\n";
+            if (!etag.empty()) headers += "ETag: " + etag + "\r\n";
+            headers += "\r\n";
+            if (!send_all(fd, headers)) return false;
+
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t sent = 0; sent < length;) {
+                auto chunk = std::min<uint64_t>(SEND_CHUNK, length - sent);
+                auto served_before = served_bytes.fetch_add(chunk);
+                auto drop = drop_at.load();
+                if (drop >= 0 && served_before + chunk > (uint64_t) drop && drop_at.compare_exchange_strong(drop, -1)) {
+                    return false;
+                }
+                if (!send_all(fd, {(const char*) content->data() + first + sent, (size_t) chunk})) return false;
+                sent += chunk;
+                if (options_.rate_limit) {
+                    std::this_thread::sleep_until(start + std::chrono::microseconds(sent * 1'000'000 / options_.rate_limit));
+                }
+            }
+            return true;
+        }
+
+        struct Range {
+            uint64_t first;
+            std::optional<uint64_t> last;
+        };
+
+        static std::optional<Range> parse_range(const std::string& request) {
+            auto pos = request.find("\r\nRange: bytes=");
+            if (pos == std::string::npos) return std::nullopt;
+            pos += 15;
+            auto dash = request.find('-', pos);
+            auto end = request.find("\r\n", pos);
+            Range range{std::stoull(request.substr(pos, dash - pos)), std::nullopt};
+            if (dash + 1 < end) range.last = std::stoull(request.substr(dash + 1, end - dash - 1));
+            return range;
+        }
+
+        static bool send_all(int fd, std::string_view data) {
+            while (!data.empty()) {
+                auto n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                data.remove_prefix((size_t) n);
+            }
+            return true;
+        }
+    };
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+// Direct port of the managed `Pog.PackageVersion` parser and comparator, used by the tests of `version/VersionKey.hpp`
+//  as the reference, and by the benchmarks as the baseline for sorting with parsed versions.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace test_version {
+    /// Port of `PackageVersion` (constructor and `CompareTo`), with text tokens compared ordinally instead of with
+    /// the current culture. Expects a valid version (see `version::encode_key`).
+    struct ReferenceVersion {
+        enum class DevType { NIGHTLY, PREVIEW, ALPHA, BETA, RC };
+        /// Ordered like the managed type order: string < DevVersionType < int.
+        using Token = std::variant<std::string, DevType, int64_t>;
+
+        std::vector<int64_t> main;
+        std::vector<Token> dev;
+
+        explicit ReferenceVersion(std::string_view str) {
+            str = str.substr(0, str.find('+'));
+            size_t i = 0;
+            while (true) {
+                auto start = i;
+                while (i < str.size() && isdigit(str[i])) i++;
+                main.push_back(std::stoll(std::string(str.substr(start, i - start))));
+                if (i + 1 < str.size() && str[i] == '.' && isdigit(str[i + 1])) i++;
+                else break;
+            }
+
+            std::optional<bool> numeric;
+            std::string token;
+            auto flush = [&] {
+                if (token.empty()) return;
+                if (numeric.value_or(false)) dev.emplace_back((int64_t) std::stoll(token));
+                else if (token == "nightly") dev.emplace_back(DevType::NIGHTLY);
+                else if (token == "preview") dev.emplace_back(DevType::PREVIEW);
+                else if (token == "alpha" || token == "a") dev.emplace_back(DevType::ALPHA);
+                else if (token == "beta" || token == "b") dev.emplace_back(DevType::BETA);
+                else if (token == "rc") dev.emplace_back(DevType::RC);
+                else dev.emplace_back(token);
+            };
+            for (auto c : str.substr(i)) {
+                if (c == '.' || c == ',' || c == '-' || c == '_') {
+                    flush();
+                    numeric.reset();
+                    token.clear();
+                } else if (numeric && (bool) isdigit(c) == *numeric) {
+                    token += c;
+                } else {
+                    flush();
+                    numeric = (bool) isdigit(c);
+                    token = c;
+                }
+            }
+            flush();
+        }
+
+        [[nodiscard]] int compare(const ReferenceVersion& v2) const {
+            for (size_t i = 0; i < std::max(main.size(), v2.main.size()); i++) {
+                auto p1 = i < main.size() ? main[i] : 0, p2 = i < v2.main.size() ? v2.main[i] : 0;
+                if (p1 != p2) return p1 < p2 ? -1 : 1;
+            }
+            if (dev.empty() && v2.dev.empty()) return 0;
+            if (dev.empty()) return 1;
+            if (v2.dev.empty()) return -1;
+            for (size_t i = 0; i < std::max(dev.size(), v2.dev.size()); i++) {
+                auto p1 = i < dev.size() ? dev[i] : Token{(int64_t) -1};
+                auto p2 = i < v2.dev.size() ? v2.dev[i] : Token{(int64_t) -1};
+                if (p1 != p2) return p1 < p2 ? -1 : 1;
+            }
+            return 0;
+        }
+    };
+}
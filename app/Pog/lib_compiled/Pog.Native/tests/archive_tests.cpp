@@ -0,0 +1,378 @@
+// Tests of the archive extraction (`archive/`), on archives built in memory by `ArchiveTestData.hpp`.
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "archive/Archive.hpp"
+#include "archive/Inflate.hpp"
+#include "ArchiveTestData.hpp"
+#include "pog_native.h"
+#include "test.hpp"
+
+using namespace archive;
+
+namespace {
+    using namespace test_archive;
+
+    Bytes inflate_all(std::span<const uint8_t> compressed, size_t input_chunk_size = SIZE_MAX) {
+        BitReader reader{[&, pos = size_t{0}]() mutable {
+            auto n = std::min(input_chunk_size, compressed.size() - pos);
+            pos += n;
+            return compressed.subspan(pos - n, n);
+        }};
+        Bytes out;
+        Inflater inflater;
+        auto size = inflater.inflate(reader, [&](auto piece) { append(out, piece); });
+        CHECK(size == out.size());
+        CHECK(reader.at_end());
+        return out;
+    }
+
+    struct TempDir {
+        std::filesystem::path path = std::filesystem::temp_directory_path() / ("pog-native-test-" + std::to_string(rand()));
+
+        TempDir() {
+            std::filesystem::create_directories(path);
+        }
+
+        ~TempDir() {
+            std::filesystem::remove_all(path);
+        }
+    };
+
+    Bytes read_all(const std::filesystem::path& path) {
+        MappedFile file{path.c_str()};
+        return {file.data().begin(), file.data().end()};
+    }
+
+    /// Writes `archive` to a file and extracts it to `out`, returns the thrown error, or an empty string.
+    std::string extract(const TempDir& dir, const Bytes& archive, const std::filesystem::path& out,
+                        const ExtractOptions& options = {}) {
+        auto archive_path = dir.path / "archive.bin";
+        write_file(archive_path.c_str(), archive);
+        try {
+            extract_archive(archive_path.c_str(), out.c_str(), options);
+            return "";
+        } catch (const UnsupportedArchiveError& e) {
+            return std::string("unsupported: ") + e.what();
+        } catch (const std::exception& e) {
+            return e.what();
+        }
+    }
+}
+
+TEST(archive_crc32) {
+    CHECK(crc32(to_bytes("123456789")) == 0xcbf4'3926);
+    CHECK(crc32(to_bytes("6789"), crc32(to_bytes("12345"))) == 0xcbf4'3926);
+    CHECK(crc32({}) == 0);
+}
+
+TEST(archive_paths) {
+    CHECK(normalize_entry_path("dir\\sub/./file.txt") == "dir/sub/file.txt");
+    CHECK(normalize_entry_path("/abs//path/") == "abs/path");
+    CHECK(normalize_entry_path("a:b*c?.txt") == "a_b_c_.txt");
+    CHECK(normalize_entry_path("./").empty());
+    auto threw = false;
+    try {
+        normalize_entry_path("dir/../../evil.txt");
+    } catch (const ArchiveError&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    PathFilter filter{{"App/bin", "*.md", "lib\\?.dll"}};
+    CHECK(filter.matches("app/BIN/tool.exe"));
+    CHECK(filter.matches("App/bin"));
+    CHECK(!filter.matches("App/binaries/x"));
+    CHECK(!filter.matches("App"));
+    CHECK(filter.matches("README.md"));
+    CHECK(filter.matches("README.md/inner"));
+    CHECK(!filter.matches("docs/README.md"));
+    CHECK(filter.matches("lib/a.dll"));
+    CHECK(!filter.matches("lib/ab.dll"));
+    CHECK(PathFilter{}.matches("anything"));
+    CHECK(PathFilter{{"."}}.matches("anything"));
+}
+
+TEST(archive_detect_format) {
+    auto detect = [](const Bytes& header) {
+        try {
+            return (int) detect_format(header);
+        } catch (const UnsupportedArchiveError&) {
+            return -1;
+        }
+    };
+    CHECK(detect(build_zip({})) == (int) Format::ZIP);
+    CHECK(detect(build_zip({{"a", to_bytes("a")}})) == (int) Format::ZIP);
+    CHECK(detect(gzip(to_bytes("x"))) == (int) Format::GZIP_TAR);
+    Bytes tar;
+    add_tar_entry(tar, "a", '0', to_bytes("a"));
+    CHECK(detect(tar) == (int) Format::TAR);
+    CHECK(detect(to_bytes("7z\xbc\xaf\x27\x1c")) == -1);
+    CHECK(detect({}) == -1);
+}
+
+TEST(inflate) {
+    // fixed and dynamic Huffman blocks, compressed by zlib
+    const uint8_t fixed[] = {
+        0xf3, 0x48, 0xcd, 0xc9, 0xc9, 0xd7, 0x51, 0xc8, 0x40, 0xa2, 0x14, 0x15, 0x02, 0xf2, 0xd3, 0x15,
+        0x0a, 0x12, 0x93, 0xb3, 0x13, 0xd3, 0x53, 0x8b, 0x75, 0x50, 0x78, 0x7a, 0x00,
+    };
+    const uint8_t dynamic[] = {
+        0x9d, 0xd2, 0xb7, 0x11, 0x80, 0x40, 0x10, 0x43, 0xd1, 0x56, 0x54, 0x02, 0xde, 0x0c, 0x6d, 0xd0,
+        0x00, 0xe6, 0xf0, 0xb0, 0xc0, 0x71, 0xb8, 0xea, 0x21, 0x22, 0x47, 0xb1, 0xe6, 0x45, 0xfa, 0x69,
+        0xa3, 0xb0, 0x98, 0xb6, 0xe8, 0x91, 0xaf, 0x72, 0x4c, 0xa8, 0xe4, 0x44, 0x67, 0xc6, 0x59, 0x43,
+        0x76, 0xb5, 0x62, 0x7b, 0xe7, 0x21, 0xbb, 0x2f, 0x94, 0x52, 0xc3, 0xc2, 0xd6, 0x8e, 0x4a, 0x27,
+        0x48, 0x7f, 0x20, 0x9b, 0x41, 0x0e, 0x83, 0x5c, 0x06, 0x79, 0x0c, 0xf2, 0x19, 0x14, 0x30, 0x28,
+        0x64, 0x50, 0xc4, 0xa0, 0x98, 0x3a, 0x97, 0x4b, 0xe2, 0x6b, 0xe2, 0x01,
+    };
+    std::string dynamic_text;
+    for (int i = 0; i < 12; i++) {
+        dynamic_text += "The quick brown fox jumps over the lazy dog " + std::to_string(i) + " times; ";
+    }
+    for (size_t chunk_size : {size_t{1}, size_t{7}, SIZE_MAX}) {
+        CHECK(inflate_all(fixed, chunk_size) == to_bytes("Hello, hello, hello! Pog packages, Pog packages."));
+        CHECK(inflate_all(dynamic, chunk_size) == to_bytes(dynamic_text));
+    }
+
+    for (size_t size : {size_t{0}, size_t{1}, size_t{70'000}, size_t{1'000'000}}) {
+        auto data = pseudo_random_text(size);
+        CHECK(inflate_all(deflate_stored(data)) == data);
+        CHECK(inflate_all(deflate_stored(data), 1000) == data);
+#ifdef POG_TEST_HAS_ZLIB
+        for (int level : {1, 6, 9}) CHECK(inflate_all(deflate_zlib(data, level), 4097) == data);
+        for (int strategy : {Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED}) {
+            CHECK(inflate_all(deflate_zlib(data, 9, strategy)) == data);
+        }
+#endif
+    }
+
+    // truncated streams must fail, corrupted ones may decode to garbage, but must not read or write out of bounds
+    auto compressed = deflate_raw(pseudo_random_text(100'000));
+    for (auto corrupt : {0, 1}) {
+        auto input = compressed;
+        if (corrupt) {
+            for (size_t i = 10; i < input.size(); i += 97) input[i] ^= 0x5a;
+        } else {
+            input.resize(input.size() / 2);
+        }
+        auto threw = false;
+        try {
+            inflate_all(input);
+        } catch (const ArchiveError&) {
+            threw = true;
+        }
+        CHECK(threw || corrupt);
+    }
+}
+
+TEST(extract_zip) {
+    TempDir dir;
+    auto big = pseudo_random_text(3'000'000);
+    std::vector<ZipEntrySpec> entries{
+        {"app/"},
+        {"app/tool.exe", big},
+        {"app/stored.txt", to_bytes("stored"), 0},
+        {"app\\backslash.txt", to_bytes("backslash")},
+        {"empty.txt", {}},
+        {"docs/readme.md", to_bytes("readme"), 8, 0, ZipTime::NTFS},
+        {"implicit/dir/file.txt", to_bytes("implicit"), 8, 0, ZipTime::DOS},
+        {"dup.txt", to_bytes("first")},
+        {"DUP.txt", to_bytes("second")},
+    };
+
+    for (auto zip64 : {false, true}) {
+        for (unsigned threads : {1u, 4u}) {
+            auto out = dir.path / ("out-" + std::to_string(zip64) + "-" + std::to_string(threads));
+            uint64_t last_processed = 0, last_total = 0;
+            ExtractOptions options{.progress = [&](uint64_t processed, uint64_t total) {
+                CHECK(processed >= last_processed);
+                last_processed = processed;
+                last_total = total;
+                return true;
+            }, .threads = threads};
+            CHECK(extract(dir, build_zip(entries, zip64), out, options).empty());
+
+            CHECK(read_all(out / "app/tool.exe") == big);
+            CHECK(read_all(out / "app/stored.txt") == to_bytes("stored"));
+            CHECK(read_all(out / "app/backslash.txt") == to_bytes("backslash"));
+            CHECK(read_all(out / "empty.txt").empty());
+            CHECK(read_all(out / "docs/readme.md") == to_bytes("readme"));
+            CHECK(read_all(out / "implicit/dir/file.txt") == to_bytes("implicit"));
+            // the last of the duplicate entries wins, only one of them is extracted even on a case-sensitive FS
+            CHECK(!std::filesystem::exists(out / "dup.txt"));
+            CHECK(read_all(out / "DUP.txt") == to_bytes("second"));
+
+            CHECK(stat_file((out / "app/tool.exe").c_str()).last_write_time == unix_time_to_filetime(ENTRY_MTIME));
+            CHECK(stat_file((out / "docs/readme.md").c_str()).last_write_time
+                  == unix_time_to_filetime(ENTRY_MTIME) + 1234567);
+            CHECK(last_processed == last_total);
+            CHECK(last_total == big.size() + 35);
+        }
+    }
+
+    // filter
+    auto out = dir.path / "filtered";
+    CHECK(extract(dir, build_zip(entries), out, {.filter = PathFilter{{"APP/*.txt", "docs"}}}).empty());
+    CHECK(std::filesystem::exists(out / "app/stored.txt"));
+    CHECK(std::filesystem::exists(out / "app/backslash.txt"));
+    CHECK(std::filesystem::exists(out / "docs/readme.md"));
+    CHECK(!std::filesystem::exists(out / "app/tool.exe"));
+    CHECK(!std::filesystem::exists(out / "empty.txt"));
+
+    // empty archive
+    CHECK(extract(dir, build_zip({}), dir.path / "empty").empty());
+}
+
+TEST(extract_zip_errors) {
+    TempDir dir;
+    auto out = dir.path / "out";
+    auto valid = build_zip({{"a.txt", pseudo_random_text(100'000)}, {"b.txt", to_bytes("b")}});
+
+    CHECK(extract(dir, build_zip({{"../evil.txt", to_bytes("evil")}}), out).find("outside") != std::string::npos);
+    CHECK(!std::filesystem::exists(dir.path / "evil.txt"));
+    CHECK(extract(dir, build_zip({{"a.txt", to_bytes("a"), 8, 1}}), out).starts_with("unsupported"));
+    CHECK(extract(dir, build_zip({{"a.txt", to_bytes("a"), 14}}), out).starts_with("unsupported"));
+    // unsupported entries are fine if they are filtered out
+    CHECK(extract(dir, build_zip({{"a.txt", to_bytes("a"), 14}, {"b.txt", to_bytes("b")}}), out,
+                  {.filter = PathFilter{{"b.txt"}}}).empty());
+
+    auto corrupted = valid;
+    corrupted[100] ^= 0xff;
+    CHECK(!extract(dir, corrupted, out).empty());
+    auto truncated = Bytes{valid.begin() + 1000, valid.end()};
+    CHECK(!extract(dir, truncated, out).empty());
+    truncated = Bytes{valid.begin(), valid.end() - 30};
+    CHECK(!extract(dir, truncated, out).empty());
+
+    auto cancelled = false;
+    try {
+        write_file((dir.path / "archive.bin").c_str(), valid);
+        extract_archive((dir.path / "archive.bin").c_str(), out.c_str(), {.progress = [](auto, auto) {
+            return false;
+        }});
+    } catch (const OperationCancelled&) {
+        cancelled = true;
+    } catch (const std::exception&) {}
+    CHECK(cancelled);
+}
+
+TEST(extract_tar) {
+    TempDir dir;
+    auto big = pseudo_random_text(2'500'000);
+    auto gnu_name = std::string(150, 'g') + "/" + std::string(120, 'h') + ".txt";
+    auto pax_name = std::string(150, 'p') + "/" + std::string(120, 'q') + ".txt";
+    auto pax_records = pax_record("path", pax_name) + pax_record("mtime", "1600000000.1234567");
+
+    Bytes tar;
+    add_tar_entry(tar, "app/", '5', {});
+    add_tar_entry(tar, "app/tool.exe", '0', big);
+    add_tar_entry(tar, "file.txt", '0', to_bytes("prefixed"), "some/prefix");
+    add_tar_entry(tar, "././@LongLink", 'L', to_bytes(gnu_name + '\0'));
+    add_tar_entry(tar, gnu_name.substr(0, 100), '0', to_bytes("gnu long name"));
+    add_tar_entry(tar, "PaxHeaders/x", 'x', to_bytes(pax_records));
+    add_tar_entry(tar, "pax.txt", '0', to_bytes("pax long name"));
+    add_tar_entry(tar, "global", 'g', to_bytes(pax_record("comment", "ignored")));
+    add_tar_entry(tar, "dev/null", '3', {});
+    add_tar_entry(tar, "empty.txt", '0', {});
+    auto tar_without_end = tar;
+    tar.resize(tar.size() + 1024 + 10 * 512);
+
+    auto tar_gz = gzip(tar);
+    // gzip of a tar split into multiple members, like e.g. `pigz` can produce
+    auto multi_member = gzip({tar.data(), 700'000});
+    append(multi_member, gzip({tar.data() + 700'000, tar.size() - 700'000}));
+
+    int i = 0;
+    for (auto& archive : {tar, tar_without_end, tar_gz, multi_member}) {
+        auto out = dir.path / ("out" + std::to_string(i++));
+        uint64_t last_processed = 0, last_total = 0;
+        CHECK(extract(dir, archive, out, {.progress = [&](uint64_t processed, uint64_t total) {
+            last_processed = processed;
+            last_total = total;
+            return true;
+        }}).empty());
+        CHECK(read_all(out / "app/tool.exe") == big);
+        CHECK(read_all(out / "some/prefix/file.txt") == to_bytes("prefixed"));
+        CHECK(read_all(out / gnu_name) == to_bytes("gnu long name"));
+        CHECK(!std::filesystem::exists(out / gnu_name.substr(0, 100)));
+        // the pax header overrides the name and mtime of the following entry
+        CHECK(read_all(out / pax_name) == to_bytes("pax long name"));
+        CHECK(stat_file((out / pax_name).c_str()).last_write_time == unix_time_to_filetime(ENTRY_MTIME) + 1234567);
+        CHECK(read_all(out / "empty.txt").empty());
+        CHECK(!std::filesystem::exists(out / "dev/null"));
+        CHECK(!std::filesystem::exists(out / "pax.txt"));
+        CHECK(stat_file((out / "app/tool.exe").c_str()).last_write_time == unix_time_to_filetime(ENTRY_MTIME));
+        CHECK(last_processed == archive.size() && last_total == archive.size());
+    }
+
+    // filter
+    auto out = dir.path / "filtered";
+    CHECK(extract(dir, tar_gz, out, {.filter = PathFilter{{"some"}}}).empty());
+    CHECK(std::filesystem::exists(out / "some/prefix/file.txt"));
+    CHECK(!std::filesystem::exists(out / "app"));
+}
+
+TEST(extract_tar_errors) {
+    TempDir dir;
+    auto out = dir.path / "out";
+    Bytes tar;
+    add_tar_entry(tar, "a.txt", '0', pseudo_random_text(100'000));
+    add_tar_entry(tar, "b.txt", '0', to_bytes("b"));
+    tar.resize(tar.size() + 1024);
+
+    Bytes link_tar;
+    add_tar_entry(link_tar, "link", '2', {});
+    CHECK(extract(dir, link_tar, out).starts_with("unsupported"));
+    // a single gzip-compressed file, not a tar
+    CHECK(extract(dir, gzip(pseudo_random_text(2000)), out).starts_with("unsupported"));
+
+    auto traversal = Bytes{};
+    add_tar_entry(traversal, "../evil.txt", '0', to_bytes("evil"));
+    CHECK(extract(dir, traversal, out).find("outside") != std::string::npos);
+
+    auto truncated = Bytes{tar.begin(), tar.begin() + 50'000};
+    CHECK(extract(dir, truncated, out) == "Truncated tar archive.");
+    auto bad_checksum = tar;
+    // the name of the second entry
+    bad_checksum[512 + (100'000 + 511) / 512 * 512 + 10] ^= 1;
+    CHECK(!extract(dir, bad_checksum, out).empty());
+
+    auto tar_gz = gzip(tar);
+    auto bad_crc = tar_gz;
+    bad_crc[bad_crc.size() - 6] ^= 1;
+    CHECK(extract(dir, bad_crc, out).find("checksum") != std::string::npos);
+    auto truncated_gz = Bytes{tar_gz.begin(), tar_gz.end() - 100};
+    CHECK(!extract(dir, truncated_gz, out).empty());
+}
+
+TEST(extract_archive_abi) {
+    TempDir dir;
+    auto archive_path = dir.path / "archive.zip";
+    auto out = dir.path / "out";
+    write_file(archive_path.c_str(), build_zip({{"a/1.txt", to_bytes("1")}, {"b/2.txt", to_bytes("2")}}));
+
+    char error[256] = "";
+    const char* filter[] = {"b"};
+    CHECK(pog_extract_archive(archive_path.c_str(), out.c_str(), filter, 1, nullptr, nullptr, error,
+                              sizeof(error)) == POG_OK);
+    CHECK(!std::filesystem::exists(out / "a"));
+    CHECK(read_all(out / "b/2.txt") == to_bytes("2"));
+
+    auto progress_calls = 0;
+    auto progress = [](void* context, uint64_t, uint64_t) -> int32_t {
+        return ++*(int*) context > 0;
+    };
+    CHECK(pog_extract_archive(archive_path.c_str(), out.c_str(), nullptr, 0, progress, &progress_calls, error,
+                              sizeof(error)) == POG_E_CANCELLED);
+    CHECK(progress_calls == 1);
+
+    write_file(archive_path.c_str(), to_bytes("not an archive, definitely not"));
+    CHECK(pog_extract_archive(archive_path.c_str(), out.c_str(), nullptr, 0, nullptr, nullptr, error,
+                              sizeof(error)) == POG_E_UNSUPPORTED_ARCHIVE);
+    write_file(archive_path.c_str(), build_zip({{"../x", to_bytes("x")}}));
+    CHECK(pog_extract_archive(archive_path.c_str(), out.c_str(), nullptr, 0, nullptr, nullptr, error,
+                              sizeof(error)) == POG_E_INVALID_ARCHIVE);
+    CHECK(pog_extract_archive((dir.path / "missing.zip").c_str(), out.c_str(), nullptr, 0, nullptr, nullptr, error,
+                              sizeof(error)) == POG_E_IO);
+}
@@ -0,0 +1,313 @@
+// Tests of the download cache index (`cache/CacheIndex.hpp`), including compaction, recovery from a crashed
+//  compaction, and concurrent use by several processes (Linux only, the processes are forked).
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+#include "cache/CacheIndex.hpp"
+#include "pog_native.h"
+#include "test.hpp"
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace cache;
+namespace fs = std::filesystem;
+
+namespace {
+    struct TempDir {
+        fs::path path = fs::temp_directory_path() / ("pog-native-test-" + std::to_string(rand()));
+
+        TempDir() {
+            fs::create_directories(path);
+        }
+
+        ~TempDir() {
+            std::error_code ec;
+            fs::remove_all(path, ec);
+        }
+    };
+
+    std::string key(unsigned i) {
+        // same shape as the real keys, an uppercase hex SHA-256 hash
+        std::string key = std::to_string(i);
+        return std::string(64 - key.size(), 'A') + key;
+    }
+
+    std::string package(const std::string& name) {
+        return R"({"PackageName":")" + name + R"(","ManifestName":null,"ManifestVersion":null})";
+    }
+
+    /// Package named `<prefix><i>`.
+    std::string package(const char* prefix, unsigned i) {
+        std::string name = prefix;
+        name += std::to_string(i);
+        return package(name);
+    }
+
+    CacheEntry entry(unsigned i) {
+        return {.key = key(i), .file_name = "file" + std::to_string(i) + ".zip", .size = i * 1000ull,
+                .last_access = 1000, .packages = {package("initial")}};
+    }
+
+    std::vector<fs::path> index_files(const fs::path& dir) {
+        std::vector<fs::path> files;
+        for (auto& item : fs::directory_iterator(dir)) files.push_back(item.path().filename());
+        return files;
+    }
+
+    size_t count_entries(CacheIndex& index) {
+        size_t count = 0;
+        index.for_each([&](const CacheEntry&) { count++; });
+        return count;
+    }
+}
+
+TEST(cache_index_basic) {
+    TempDir dir;
+    CacheIndex index{dir.path.c_str()};
+
+    CHECK(index.acquire(key(1), package("a")) == AcquireResult::MISS);
+    CHECK(index.add(entry(1)));
+    CHECK(!index.add(entry(1)));
+    CHECK(!index.add({.key = std::string(MAX_KEY_SIZE + 1, 'A'), .file_name = "file.zip"}));
+
+    std::string file_name;
+    CHECK(index.acquire(key(1), package("a"), &file_name) == AcquireResult::HIT_NEW_PACKAGE);
+    CHECK(file_name == "file1.zip");
+    CHECK(index.acquire(key(1), package("a")) == AcquireResult::HIT);
+    CHECK(index.acquire(key(1), package("initial")) == AcquireResult::HIT);
+    CHECK(index.acquire(key(1), "") == AcquireResult::HIT);
+
+    auto found = index.find(key(1));
+    CHECK(found && found->size == 1000 && found->readers == 4 && found->last_access > 1000);
+    CHECK(found && found->packages == (std::vector{package("initial"), package("a")}));
+
+    for (int i = 0; i < 5; i++) index.release(key(1));
+    CHECK(index.find(key(1))->readers == 0);
+
+    CHECK(index.remove(key(1)));
+    CHECK(!index.remove(key(1)));
+    CHECK(!index.find(key(1)));
+    CHECK(index.acquire(key(1), package("a")) == AcquireResult::MISS);
+
+    // a removed entry can be added again
+    CHECK(index.add(entry(1)));
+    CHECK(index.find(key(1))->packages == std::vector{package("initial")});
+}
+
+TEST(cache_index_shared) {
+    TempDir dir;
+    CacheIndex a{dir.path.c_str()};
+    CacheIndex b{dir.path.c_str()};
+
+    CHECK(a.add(entry(1)));
+    CHECK(b.acquire(key(1), package("b")) == AcquireResult::HIT_NEW_PACKAGE);
+    CHECK(a.find(key(1))->readers == 1);
+    CHECK(a.acquire(key(1), package("b")) == AcquireResult::HIT);
+    CHECK(!b.add(entry(1)));
+    CHECK(b.remove(key(1)));
+    CHECK(!a.find(key(1)));
+
+    // reopening keeps the entries
+    CHECK(b.add(entry(2)));
+    CacheIndex c{dir.path.c_str()};
+    CHECK(c.find(key(2)).has_value());
+}
+
+TEST(cache_index_compaction) {
+    TempDir dir;
+    CacheIndex index{dir.path.c_str(), {.initial_capacity = 8}};
+    CacheIndex other{dir.path.c_str(), {.initial_capacity = 8}};
+    CHECK(index.generation() == 1);
+
+    for (unsigned i = 0; i < 100; i++) {
+        CHECK(index.add(entry(i)));
+        CHECK(index.acquire(key(i), package("p", i % 3)) == AcquireResult::HIT_NEW_PACKAGE);
+        if (i % 2) CHECK(other.remove(key(i)));
+    }
+    CHECK(index.generation() > 1);
+    CHECK(other.generation() == index.generation());
+    CHECK(count_entries(other) == 50);
+    for (unsigned i = 0; i < 100; i += 2) {
+        auto found = other.find(key(i));
+        CHECK(found && found->file_name == entry(i).file_name && found->size == entry(i).size);
+        CHECK(found && found->readers == 1);
+        CHECK(found && found->packages == (std::vector{package("initial"), package("p", i % 3)}));
+    }
+
+    // an explicit compaction keeps the entries, and old generations are deleted
+    auto generation = index.generation();
+    index.compact();
+    CHECK(index.generation() == generation + 1);
+    CHECK(count_entries(index) == 50);
+    CHECK(index_files(dir.path) == std::vector<fs::path>{"cache-index." + std::to_string(generation + 1)});
+}
+
+TEST(cache_index_many_packages) {
+    TempDir dir;
+    CacheIndex index{dir.path.c_str(), {.initial_capacity = 8}};
+    CHECK(index.add(entry(1)));
+    // more packages than the package area of the first generation can hold, the index is compacted in between
+    for (unsigned i = 0; i < 100; i++) {
+        CHECK(index.acquire(key(1), package("p", i)) == AcquireResult::HIT_NEW_PACKAGE);
+    }
+    CHECK(index.generation() > 1);
+    auto packages = index.find(key(1))->packages;
+    CHECK(packages.size() == 101);
+    CHECK(std::set(packages.begin(), packages.end()).size() == 101);
+}
+
+TEST(cache_index_corrupted_file) {
+    TempDir dir;
+    {
+        CacheIndex index{dir.path.c_str()};
+        CHECK(index.add(entry(1)));
+    }
+    auto path = dir.path / "cache-index.1";
+    std::string garbage(10000, 'x');
+    write_file(path.c_str(), {(const uint8_t*) garbage.data(), garbage.size()});
+
+    CacheIndex index{dir.path.c_str()};
+    CHECK(count_entries(index) == 0);
+    CHECK(index.add(entry(1)));
+}
+
+TEST(cache_index_abandoned_compaction) {
+    TempDir dir;
+    CacheIndex index{dir.path.c_str()};
+    CHECK(index.add(entry(1)));
+
+    // simulate a process that crashed in the middle of a compaction: the file is sealed, and the next generation
+    //  was never linked (`Header::state` and `Header::sealed_at`)
+    {
+        SharedMapping file{(dir.path / "cache-index.1").c_str()};
+        uint32_t sealed = 1;
+        uint64_t sealed_at = 0;
+        memcpy(file.data().data() + 28, &sealed, sizeof(sealed));
+        memcpy(file.data().data() + 48, &sealed_at, sizeof(sealed_at));
+    }
+    CHECK(index.find(key(1)).has_value());
+    CHECK(index.add(entry(2)));
+    CHECK(index.generation() == 2);
+    CHECK(index.find(key(1)) && index.find(key(2)));
+}
+
+TEST(cache_index_c_abi) {
+    TempDir dir;
+    char error[256];
+    pog_cache_index* index;
+    CHECK(pog_cache_index_open((dir.path / "missing").c_str(), &index, error, sizeof(error)) == POG_E_IO);
+    CHECK(pog_cache_index_open(dir.path.c_str(), &index, error, sizeof(error)) == POG_OK);
+
+    auto k = key(1);
+    auto packages = package("a") + "\n" + package("b") + "\n";
+    pog_cache_entry e{k.c_str(), "file.zip", 123, 456, 0, packages.c_str()};
+    CHECK(pog_cache_index_add(index, &e, error, sizeof(error)) == 1);
+    CHECK(pog_cache_index_add(index, &e, error, sizeof(error)) == 0);
+
+    char file_name[4];
+    CHECK(pog_cache_index_acquire(index, k.c_str(), package("b").c_str(), file_name, sizeof(file_name),
+                                  error, sizeof(error)) == POG_CACHE_HIT);
+    CHECK(std::string(file_name) == "fil");
+    CHECK(pog_cache_index_acquire(index, k.c_str(), package("c").c_str(), nullptr, 0, error, sizeof(error))
+          == POG_CACHE_HIT_NEW_PACKAGE);
+    CHECK(pog_cache_index_release(index, k.c_str(), error, sizeof(error)) == POG_OK);
+
+    std::vector<std::string> seen;
+    auto callback = [](void* context, const pog_cache_entry* entry) {
+        auto& seen = *(std::vector<std::string>*) context;
+        seen.push_back(std::string(entry->key) + " " + entry->file_name + " " + std::to_string(entry->size) + " "
+                       + std::to_string(entry->readers) + " " + entry->packages);
+    };
+    CHECK(pog_cache_index_enumerate(index, callback, &seen, error, sizeof(error)) == POG_OK);
+    CHECK(seen == std::vector{k + " file.zip 123 1 " + packages + package("c") + "\n"});
+
+    CHECK(pog_cache_index_remove(index, k.c_str(), error, sizeof(error)) == 1);
+    CHECK(pog_cache_index_remove(index, k.c_str(), error, sizeof(error)) == 0);
+    pog_cache_index_close(index);
+}
+
+#ifndef _WIN32
+TEST(cache_index_multi_process) {
+    TempDir dir;
+    constexpr unsigned PROCESSES = 4;
+    constexpr unsigned OWN_KEYS = 300;
+    constexpr unsigned RACED_KEYS = 50;
+    constexpr unsigned SHARED_ACQUIRES = 200;
+
+    {
+        // created upfront, so that all processes see the shared entry
+        CacheIndex index{dir.path.c_str(), {.initial_capacity = 16}};
+        CHECK(index.add(entry(1'000'000)));
+    }
+
+    std::vector<pid_t> children;
+    for (unsigned p = 0; p < PROCESSES; p++) {
+        auto pid = fork();
+        if (pid == 0) {
+            // a small capacity, so that the processes compact the index many times while the others use it
+            CacheIndex index{dir.path.c_str(), {.initial_capacity = 16}};
+            auto name = package("process", p);
+            unsigned added_raced = 0;
+            for (unsigned i = 0; i < OWN_KEYS; i++) {
+                auto k = (p + 1) * 10'000 + i;
+                if (!index.add(entry(k))) _exit(100);
+                if (index.acquire(key(k), name) != AcquireResult::HIT_NEW_PACKAGE) _exit(101);
+                index.release(key(k));
+                // every third entry is deleted again
+                if (i % 3 == 0 && !index.remove(key(k))) _exit(102);
+
+                if (i < RACED_KEYS && index.add(entry(i))) added_raced++;
+                if (i < SHARED_ACQUIRES) {
+                    if (index.acquire(key(1'000'000), name) == AcquireResult::MISS) _exit(103);
+                    index.release(key(1'000'000));
+                }
+            }
+            // the exit code reports how many of the keys added by all processes were added by this one
+            _exit((int) added_raced);
+        }
+        children.push_back(pid);
+    }
+
+    unsigned added_raced = 0;
+    for (auto pid : children) {
+        int status;
+        waitpid(pid, &status, 0);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) <= (int) RACED_KEYS);
+        added_raced += WIFEXITED(status) ? (unsigned) WEXITSTATUS(status) : 0;
+    }
+    // each raced key was added by exactly one process
+    CHECK(added_raced == RACED_KEYS);
+
+    CacheIndex index{dir.path.c_str()};
+    CHECK(index.generation() > 1);
+    std::set<std::string> keys;
+    size_t count = 0;
+    index.for_each([&](const CacheEntry& e) {
+        keys.insert(e.key);
+        count++;
+        CHECK(e.readers == 0);
+    });
+    CHECK(count == keys.size());
+    CHECK(count == 1 + RACED_KEYS + PROCESSES * (OWN_KEYS - OWN_KEYS / 3));
+
+    for (unsigned p = 0; p < PROCESSES; p++) {
+        for (unsigned i = 0; i < OWN_KEYS; i++) {
+            auto found = index.find(key((p + 1) * 10'000 + i));
+            CHECK(found.has_value() == (i % 3 != 0));
+            if (found) {
+                CHECK(found->packages == (std::vector{package("initial"), package("process", p)}));
+            }
+        }
+    }
+
+    // concurrent first uses by the same package may both be recorded, but no package is lost
+    auto shared = index.find(key(1'000'000));
+    CHECK(shared && std::set(shared->packages.begin(), shared->packages.end()).size() == PROCESSES + 1);
+}
+#endif
@@ -0,0 +1,261 @@
+// Tests of the content-defined chunker and the deduplicated chunk store (`dedup/`), including extraction of archives
+//  read directly from their chunks.
+
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+#include "ArchiveTestData.hpp"
+#include "dedup/Chunker.hpp"
+#include "dedup/ChunkStore.hpp"
+#include "pog_native.h"
+#include "test.hpp"
+
+using namespace dedup;
+using namespace test_archive;
+namespace fs = std::filesystem;
+
+namespace {
+    struct TempDir {
+        fs::path path = fs::temp_directory_path() / ("pog-native-test-" + std::to_string(rand()));
+
+        TempDir() {
+            fs::create_directories(path);
+        }
+
+        ~TempDir() {
+            std::error_code ec;
+            fs::remove_all(path, ec);
+        }
+    };
+
+    constexpr ChunkerParams SMALL_CHUNKS{.min_size = 256, .avg_size = 1024, .max_size = 4096};
+
+    Bytes random_bytes(size_t size, uint64_t seed) {
+        Bytes data(size);
+        for (auto& b : data) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            b = (uint8_t) seed;
+        }
+        return data;
+    }
+
+    std::vector<size_t> chunk_all(std::span<const uint8_t> data, const ChunkerParams& params,
+                                  Implementation implementation) {
+        std::vector<size_t> cuts;
+        CHECK(find_chunks(data, true, params, cuts, implementation) == data.size());
+        return cuts;
+    }
+
+    std::vector<Sha256::Digest> chunk_hashes(std::span<const uint8_t> data, const std::vector<size_t>& cuts) {
+        std::vector<Sha256::Digest> hashes;
+        size_t start = 0;
+        for (auto cut : cuts) {
+            hashes.push_back(Sha256::hash(data.subspan(start, cut - start)));
+            start = cut;
+        }
+        return hashes;
+    }
+
+    Bytes read_all(const fs::path& path) {
+        MappedFile file{path.c_str()};
+        return {file.data().begin(), file.data().end()};
+    }
+}
+
+TEST(chunker_boundaries) {
+    // random data, and data with long runs that never match the masks (forced cuts at `max_size`)
+    auto data = random_bytes(3'000'000, 1);
+    auto text = pseudo_random_text(1'000'000);
+    data.insert(data.end(), text.begin(), text.end());
+    data.resize(data.size() + 100'000, 0);
+
+    for (auto& params : {SMALL_CHUNKS, ChunkerParams{}}) {
+        auto cuts = chunk_all(data, params, Implementation::SCALAR);
+        CHECK(cuts.back() == data.size());
+        size_t start = 0;
+        for (auto cut : cuts) {
+            CHECK(cut - start <= params.max_size);
+            CHECK(cut - start >= params.min_size || cut == data.size());
+            start = cut;
+        }
+        auto average = (double) data.size() / (double) cuts.size();
+        CHECK(average > params.avg_size / 2 && average < params.avg_size * 2);
+
+        // the SIMD implementation must find exactly the same boundaries, also for sizes that do not split evenly
+        //  into its lanes
+        if (is_supported(Implementation::AVX2)) {
+            CHECK(chunk_all(data, params, Implementation::AVX2) == cuts);
+            for (size_t size : {size_t{0}, size_t{100}, size_t{5000}, size_t{70'001}, size_t{1'234'567}}) {
+                auto part = std::span<const uint8_t>{data}.first(size);
+                CHECK(chunk_all(part, params, Implementation::AVX2) == chunk_all(part, params, Implementation::SCALAR));
+            }
+        }
+    }
+}
+
+TEST(chunker_streaming) {
+    auto data = random_bytes(1'000'000, 2);
+    for (auto implementation : {Implementation::SCALAR, Implementation::AVX2}) {
+        if (!is_supported(implementation)) continue;
+        auto expected = chunk_all(data, SMALL_CHUNKS, implementation);
+
+        // fed in pieces, restarting from the end of the last complete chunk, like `ChunkStore::add_file`
+        std::vector<size_t> cuts;
+        size_t start = 0;
+        for (size_t end = 10'000; start < data.size(); end = std::min(end + 10'000, data.size())) {
+            std::vector<size_t> piece_cuts;
+            auto piece = std::span<const uint8_t>{data}.subspan(start, end - start);
+            auto consumed = find_chunks(piece, end == data.size(), SMALL_CHUNKS, piece_cuts, implementation);
+            for (auto cut : piece_cuts) cuts.push_back(start + cut);
+            start += consumed;
+        }
+        CHECK(cuts == expected);
+    }
+}
+
+TEST(chunker_shift_resistance) {
+    // an insertion only changes the chunks around it
+    auto data = random_bytes(2'000'000, 3);
+    auto modified = data;
+    modified.insert(modified.begin() + 1'000'000, 100, 'x');
+
+    auto original_chunks = chunk_hashes(data, chunk_all(data, SMALL_CHUNKS, best_implementation()));
+    auto modified_chunks = chunk_hashes(modified, chunk_all(modified, SMALL_CHUNKS, best_implementation()));
+    std::set original_set(original_chunks.begin(), original_chunks.end());
+    size_t shared = 0;
+    for (auto& chunk : modified_chunks) shared += original_set.contains(chunk);
+    CHECK(shared + 3 >= modified_chunks.size());
+}
+
+TEST(chunk_store) {
+    TempDir dir;
+    auto store_dir = dir.path / "chunks";
+    ChunkStore store{store_dir.c_str(), SMALL_CHUNKS};
+
+    // a newer version of the file, with a changed and an inserted part
+    auto v1 = random_bytes(500'000, 4);
+    auto v2 = v1;
+    std::fill(v2.begin() + 100'000, v2.begin() + 101'000, 0);
+    v2.insert(v2.begin() + 300'000, 5000, 'x');
+    write_file((dir.path / "v1").c_str(), v1);
+    write_file((dir.path / "v2").c_str(), v2);
+
+    auto stats1 = store.add_file((dir.path / "v1").c_str(), (dir.path / "v1.pogchunks").c_str());
+    CHECK(stats1.size == v1.size() && stats1.new_chunk_bytes == v1.size());
+    auto stats2 = store.add_file((dir.path / "v2").c_str(), (dir.path / "v2.pogchunks").c_str());
+    CHECK(stats2.size == v2.size());
+    CHECK(stats2.new_chunk_bytes < 20'000);
+    // adding the same file again stores nothing
+    CHECK(store.add_file((dir.path / "v1").c_str(), (dir.path / "v1b.pogchunks").c_str()).new_chunk_count == 0);
+
+    store.restore_file((dir.path / "v2.pogchunks").c_str(), (dir.path / "v2.restored").c_str());
+    CHECK(read_all(dir.path / "v2.restored") == v2);
+
+    // random reads across chunk boundaries
+    ChunkedFileReader reader{store_dir.c_str(), (dir.path / "v1.pogchunks").c_str()};
+    CHECK(reader.size() == v1.size());
+    for (auto [offset, size] : std::vector<std::pair<size_t, size_t>>{{0, 10}, {1000, 50'000}, {499'990, 10},
+                                                                        {0, 500'000}, {123'456, 0}}) {
+        Bytes buffer(size);
+        reader.read_at(offset, buffer);
+        CHECK(std::equal(buffer.begin(), buffer.end(), v1.begin() + (ptrdiff_t) offset));
+    }
+    auto read_past_end = false;
+    try {
+        Bytes buffer(11);
+        reader.read_at(499'990, buffer);
+    } catch (const IoError&) {
+        read_past_end = true;
+    }
+    CHECK(read_past_end);
+
+    // only the chunks unique to v1 are deleted, and only once they're old enough; a missing chunk list is skipped
+    std::vector<fs::path> lists{dir.path / "v2.pogchunks", dir.path / "missing.pogchunks"};
+    CHECK(store.collect_garbage(lists, std::chrono::hours{1}).deleted_chunk_count == 0);
+    auto collected = store.collect_garbage(lists, std::chrono::seconds{0});
+    CHECK(collected.deleted_chunk_count > 0 && collected.deleted_bytes < 20'000);
+    store.restore_file((dir.path / "v2.pogchunks").c_str(), (dir.path / "v2.restored").c_str());
+    CHECK(read_all(dir.path / "v2.restored") == v2);
+    auto missing_chunk = false;
+    try {
+        store.restore_file((dir.path / "v1.pogchunks").c_str(), (dir.path / "v1.restored").c_str());
+    } catch (const IoError&) {
+        missing_chunk = true;
+    }
+    CHECK(missing_chunk);
+}
+
+TEST(chunk_store_invalid_list) {
+    TempDir dir;
+    auto path = dir.path / "invalid.pogchunks";
+    for (auto& contents : {Bytes{}, to_bytes("POGCHNK1"), to_bytes(std::string(100, 'x'))}) {
+        write_file(path.c_str(), contents);
+        auto thrown = false;
+        try {
+            read_chunk_list(path.c_str());
+        } catch (const IoError&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+}
+
+TEST(chunk_store_extract_archive) {
+    TempDir dir;
+    auto store_dir = dir.path / "chunks";
+    auto big = pseudo_random_text(1'000'000);
+
+    Bytes tar;
+    add_tar_entry(tar, "app/tool.exe", '0', big);
+    add_tar_entry(tar, "app/readme.txt", '0', to_bytes("readme"));
+    tar.resize(tar.size() + 1024);
+    auto archives = {
+        build_zip({{"app/tool.exe", big}, {"app/stored.txt", big, 0}, {"app/readme.txt", to_bytes("readme")}}),
+        build_zip({{"app/tool.exe", big}, {"app/readme.txt", to_bytes("readme")}}, true),
+        tar,
+        gzip(tar),
+    };
+
+    char error[256];
+    auto i = 0;
+    for (auto& archive : archives) {
+        auto name = "archive" + std::to_string(i++);
+        auto archive_path = dir.path / name;
+        auto list_path = dir.path / (name + ".pogchunks");
+        write_file(archive_path.c_str(), archive);
+        pog_chunk_store_stats stats{};
+        CHECK(pog_chunk_store_add(store_dir.c_str(), archive_path.c_str(), list_path.c_str(), &stats, nullptr,
+                                  nullptr, error, sizeof(error)) == POG_OK);
+        CHECK(stats.size == archive.size() && stats.chunk_count > 1);
+        if (i == 3) {
+            // the uncompressed tar shares most chunks with the stored copy of `tool.exe` in the first zip
+            CHECK(stats.new_chunk_bytes < archive.size() / 2);
+        }
+
+        auto out = dir.path / (name + "-out");
+        const char* filter[] = {"app"};
+        CHECK(pog_chunk_store_extract_archive(store_dir.c_str(), list_path.c_str(), out.c_str(), filter, 1, nullptr,
+                                              nullptr, error, sizeof(error)) == POG_OK);
+        CHECK(read_all(out / "app/tool.exe") == big);
+        CHECK(read_all(out / "app/readme.txt") == to_bytes("readme"));
+    }
+
+    // unsupported formats are reported like for files
+    write_file((dir.path / "other").c_str(), random_bytes(100'000, 5));
+    CHECK(pog_chunk_store_add(store_dir.c_str(), (dir.path / "other").c_str(), (dir.path / "other.pogchunks").c_str(),
+                              nullptr, nullptr, nullptr, error, sizeof(error)) == POG_OK);
+    CHECK(pog_chunk_store_extract_archive(store_dir.c_str(), (dir.path / "other.pogchunks").c_str(),
+                                          (dir.path / "other-out").c_str(), nullptr, 0, nullptr, nullptr,
+                                          error, sizeof(error)) == POG_E_UNSUPPORTED_ARCHIVE);
+    CHECK(pog_chunk_store_restore(store_dir.c_str(), (dir.path / "missing.pogchunks").c_str(),
+                                  (dir.path / "restored").c_str(), nullptr, nullptr, error, sizeof(error)) == POG_E_IO);
+
+    uint64_t freed = 1;
+    auto list_path = dir.path / "archive0.pogchunks";
+    const pog_path_char* lists[] = {list_path.c_str()};
+    CHECK(pog_chunk_store_collect(store_dir.c_str(), lists, 1, 3600, &freed, error, sizeof(error)) == POG_OK);
+    CHECK(freed == 0);
+}
@@ -0,0 +1,103 @@
+// Tests of the hashing download sink (`DownloadSink.hpp`). The network is simulated by a file-backed source, read
+//  in irregular pieces like the reads of an HTTP response stream.
+
+#include <cerrno>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "DownloadSink.hpp"
+#include "pog_native.h"
+#include "test.hpp"
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    Bytes pseudo_random_bytes(size_t size) {
+        Bytes data(size);
+        uint32_t x = 0x8765'4321;
+        for (auto& b : data) {
+            x = x * 1664525 + 1013904223;
+            b = (uint8_t) (x >> 24);
+        }
+        return data;
+    }
+
+    Bytes read_all(const std::string& path) {
+        MappedFile file{path.c_str()};
+        return {file.data().begin(), file.data().end()};
+    }
+
+    /// Reads `source_path` in pieces of varying size (including empty ones) and passes them to `sink`.
+    void stream_file(const std::string& source_path, auto&& sink) {
+        InputFile source{source_path.c_str()};
+        Bytes buffer(100'000);
+        for (size_t i = 0;; i++) {
+            auto piece_size = (i * 7919) % buffer.size();
+            auto n = source.read({buffer.data(), piece_size});
+            if (n == 0 && piece_size != 0) break;
+            sink(std::span<const uint8_t>{buffer.data(), n});
+        }
+    }
+}
+
+TEST(download_sink) {
+    auto dir = std::filesystem::temp_directory_path() / ("pog-native-test-" + std::to_string(rand()));
+    std::filesystem::create_directories(dir);
+    auto source_path = (dir / "source.bin").string();
+    auto target_path = (dir / "target.bin").string();
+
+    // sizes around the chunk boundaries, with a small chunk size to get many chunks
+    constexpr size_t CHUNK_SIZE = 64 << 10;
+    for (size_t size : {size_t{0}, size_t{1}, CHUNK_SIZE - 1, CHUNK_SIZE, 2 * CHUNK_SIZE, 10 * CHUNK_SIZE + 123}) {
+        auto data = pseudo_random_bytes(size);
+        write_file(source_path.c_str(), data);
+
+        DownloadSink sink{target_path.c_str(), CHUNK_SIZE};
+        stream_file(source_path, [&](auto piece) { sink.write(piece); });
+        CHECK(sink.finish() == Sha256::hash(data));
+        CHECK(sink.size() == size);
+        CHECK(read_all(target_path) == data);
+    }
+
+    // the default chunk size, with the C ABI
+    auto data = pseudo_random_bytes(3 * DownloadSink::DEFAULT_CHUNK_SIZE + 5);
+    write_file(source_path.c_str(), data);
+    pog_download_sink* sink;
+    char error[256] = "";
+    CHECK(pog_download_sink_create(target_path.c_str(), &sink, error, sizeof(error)) == POG_OK);
+    stream_file(source_path, [&](auto piece) {
+        CHECK(pog_download_sink_write(sink, piece.data(), piece.size(), error, sizeof(error)) == POG_OK);
+    });
+    uint8_t digest[32];
+    CHECK(pog_download_sink_finish(sink, digest, error, sizeof(error)) == POG_OK);
+    pog_download_sink_close(sink);
+    auto expected = Sha256::hash(data);
+    CHECK(std::equal(expected.begin(), expected.end(), digest));
+    CHECK(read_all(target_path) == data);
+
+    // an abandoned download
+    pog_download_sink_create(target_path.c_str(), &sink, error, sizeof(error));
+    pog_download_sink_write(sink, data.data(), data.size(), error, sizeof(error));
+    pog_download_sink_close(sink);
+
+    auto missing_dir_path = (dir / "missing" / "target.bin").string();
+    CHECK(pog_download_sink_create(missing_dir_path.c_str(), &sink, error, sizeof(error)) == POG_E_IO);
+
+    std::filesystem::remove_all(dir);
+}
+
+#ifdef __linux__
+TEST(download_sink_write_error) {
+    // all writes to /dev/full fail with ENOSPC; the error of the background writer must reach the caller
+    DownloadSink sink{"/dev/full", 1024};
+    auto data = pseudo_random_bytes(10'000);
+    auto failed = false;
+    try {
+        sink.write(data);
+        sink.finish();
+    } catch (const IoError& e) {
+        failed = e.error_code == ENOSPC;
+    }
+    CHECK(failed);
+}
+#endif
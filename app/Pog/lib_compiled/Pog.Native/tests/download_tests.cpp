@@ -0,0 +1,298 @@
+// Tests of the multi-connection ranged downloader (`download/RangedDownload.hpp`), against a local HTTP server.
+//  The server uses POSIX sockets, so the downloader tests only run on the Linux build.
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "download/RangedDownload.hpp"
+#include "pog_native.h"
+#include "TestHttpServer.hpp"
+#include "test.hpp"
+
+using namespace download;
+using test_http::TestHttpServer;
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    Bytes pseudo_random_bytes(size_t size, uint32_t seed = 0x1234'5678) {
+        Bytes data(size);
+        uint32_t x = seed;
+        for (auto& b : data) {
+            x = x * 1664525 + 1013904223;
+            b = (uint8_t) (x >> 24);
+        }
+        return data;
+    }
+
+    Bytes read_all(const std::filesystem::path& path) {
+        MappedFile file{path.c_str()};
+        return {file.data().begin(), file.data().end()};
+    }
+
+    struct TempDir {
+        std::filesystem::path path = std::filesystem::temp_directory_path() / ("pog-native-test-" + std::to_string(rand()));
+
+        TempDir() {
+            std::filesystem::create_directories(path);
+        }
+
+        ~TempDir() {
+            std::error_code ec;
+            std::filesystem::remove_all(path, ec);
+        }
+    };
+
+    std::filesystem::path state_file(const std::filesystem::path& target) {
+        auto path = target;
+        path += ".pogdl";
+        return path;
+    }
+
+    const auto CONNECT = default_connection_factory("Pog-test");
+
+    /// Small segments, so that the test files are split between all connections.
+    DownloadOptions small_segments(unsigned connections = 4) {
+        return {.connections = connections, .min_segment_size = 64 << 10};
+    }
+
+    /// Downloads until `cancel_at` bytes are downloaded, then cancels the download.
+    void download_cancelled(const std::string& url, const std::filesystem::path& target, uint64_t cancel_at) {
+        auto options = small_segments(2);
+        options.progress = [&](uint64_t processed, uint64_t) { return processed < cancel_at; };
+        auto cancelled = false;
+        try {
+            download_file(url, target.c_str(), CONNECT, options);
+        } catch (const OperationCancelled&) {
+            cancelled = true;
+        }
+        CHECK(cancelled);
+    }
+}
+
+TEST(download_parse_content_range) {
+    uint64_t first;
+    std::optional<uint64_t> total;
+    CHECK(parse_content_range("bytes 0-99/1000", first, total) && first == 0 && total == 1000u);
+    CHECK(parse_content_range("bytes 500-999/1000", first, total) && first == 500 && total == 1000u);
+    CHECK(parse_content_range("bytes 5-9/*", first, total) && first == 5 && !total);
+    CHECK(!parse_content_range("bytes */1000", first, total));
+    CHECK(!parse_content_range("bytes 10-5/1000", first, total));
+    CHECK(!parse_content_range("bytes 0-1000/1000", first, total));
+    CHECK(!parse_content_range("items 0-9/10", first, total));
+    CHECK(!parse_content_range("bytes 0-9/10x", first, total));
+}
+
+TEST(download_ranged) {
+    TempDir dir;
+    auto content = pseudo_random_bytes(3'000'017);
+    // slow enough that the first connection does not finish before the others start
+    TestHttpServer server{content, {.rate_limit = 16 << 20}};
+    auto target = dir.path / "file.bin";
+
+    std::vector<uint64_t> progress;
+    auto options = small_segments();
+    options.progress = [&](uint64_t processed, uint64_t total) {
+        CHECK(total == content.size());
+        progress.push_back(processed);
+        return true;
+    };
+    download_file(server.url(), target.c_str(), CONNECT, options);
+    CHECK(read_all(target) == content);
+    // the first request and at least one additional connection
+    CHECK(server.requests > 1);
+    CHECK(!std::filesystem::exists(state_file(target)));
+    CHECK(!progress.empty() && progress.back() == content.size());
+    CHECK(std::is_sorted(progress.begin(), progress.end()));
+
+    // an existing larger file is truncated
+    auto small_content = pseudo_random_bytes(100'000, 7);
+    server.set_content(small_content, "\"v2\"");
+    download_file(server.url(), target.c_str(), CONNECT, small_segments());
+    CHECK(read_all(target) == small_content);
+}
+
+TEST(download_small_file_single_request) {
+    TempDir dir;
+    auto content = pseudo_random_bytes(100'000);
+    TestHttpServer server{content};
+    auto target = dir.path / "file.bin";
+
+    // with the default segment size, the file is not split
+    download_file(server.url(), target.c_str(), CONNECT);
+    CHECK(read_all(target) == content);
+    CHECK(server.requests == 1u);
+}
+
+TEST(download_empty_file) {
+    TempDir dir;
+    TestHttpServer server{{}};
+    auto target = dir.path / "file.bin";
+
+    // `bytes=0-` is not satisfiable for an empty file, the download is retried without a range
+    download_file(server.url(), target.c_str(), CONNECT);
+    CHECK(std::filesystem::exists(target) && std::filesystem::file_size(target) == 0);
+}
+
+TEST(download_without_range_support) {
+    TempDir dir;
+    auto content = pseudo_random_bytes(1'000'000);
+    TestHttpServer server{content, {.accept_ranges = false}};
+    auto target = dir.path / "file.bin";
+
+    download_file(server.url(), target.c_str(), CONNECT, small_segments());
+    CHECK(read_all(target) == content);
+    CHECK(server.requests == 1u);
+    CHECK(server.served_bytes == content.size());
+}
+
+TEST(download_redirect) {
+    TempDir dir;
+    auto content = pseudo_random_bytes(500'000);
+    TestHttpServer server{content};
+    auto target = dir.path / "file.bin";
+
+    download_file(server.url("/redirect"), target.c_str(), CONNECT, small_segments());
+    CHECK(read_all(target) == content);
+}
+
+TEST(download_not_found) {
+    TempDir dir;
+    TestHttpServer server{pseudo_random_bytes(1000)};
+    auto target = dir.path / "file.bin";
+
+    auto status = 0;
+    try {
+        download_file(server.url("/missing"), target.c_str(), CONNECT);
+    } catch (const HttpError& e) {
+        status = e.status;
+    }
+    CHECK(status == 404);
+}
+
+TEST(download_retry_after_dropped_connection) {
+    TempDir dir;
+    auto content = pseudo_random_bytes(2'000'000);
+    TestHttpServer server{content};
+    server.drop_at = 700'000;
+    auto target = dir.path / "file.bin";
+
+    download_file(server.url(), target.c_str(), CONNECT, small_segments());
+    CHECK(read_all(target) == content);
+    CHECK(server.drop_at == -1);
+    CHECK(!std::filesystem::exists(state_file(target)));
+}
+
+TEST(download_resume) {
+    TempDir dir;
+    auto content = pseudo_random_bytes(4'000'000);
+    // slow enough that the download can be cancelled in the middle
+    TestHttpServer server{content, {.rate_limit = 8 << 20}};
+    auto target = dir.path / "file.bin";
+
+    download_cancelled(server.url(), target, 1'000'000);
+    CHECK(std::filesystem::exists(state_file(target)));
+    CHECK(std::filesystem::file_size(target) == content.size());
+
+    server.served_bytes = 0;
+    download_file(server.url(), target.c_str(), CONNECT, small_segments());
+    CHECK(read_all(target) == content);
+    // only the missing segments were downloaded (and possibly a few unwritten reads of the first attempt)
+    CHECK(server.served_bytes < content.size() - 500'000);
+    CHECK(!std::filesystem::exists(state_file(target)));
+}
+
+TEST(download_resume_key) {
+    TempDir dir;
+    auto content = pseudo_random_bytes(4'000'000);
+    TestHttpServer server{content, {.rate_limit = 8 << 20}};
+    auto target = dir.path / "file.bin";
+
+    // the URL changes between attempts (e.g. a signed redirect target), the resume key stays the same
+    auto options = small_segments(2);
+    options.resume_key = "https://example.com/file.bin";
+    options.progress = [&](uint64_t processed, uint64_t) { return processed < 1'000'000; };
+    auto cancelled = false;
+    try {
+        download_file(server.url("/file?signature=1"), target.c_str(), CONNECT, options);
+    } catch (const OperationCancelled&) {
+        cancelled = true;
+    }
+    CHECK(cancelled);
+
+    server.served_bytes = 0;
+    options = small_segments();
+    options.resume_key = "https://example.com/file.bin";
+    download_file(server.url("/file?signature=2"), target.c_str(), CONNECT, options);
+    CHECK(read_all(target) == content);
+    CHECK(server.served_bytes < content.size() - 500'000);
+}
+
+TEST(download_resume_changed_url) {
+    TempDir dir;
+    auto content = pseudo_random_bytes(4'000'000);
+    TestHttpServer server{content, {.rate_limit = 8 << 20}};
+    auto target = dir.path / "file.bin";
+
+    // without a resume key, the state of a different URL is not used
+    download_cancelled(server.url("/file?signature=1"), target, 1'000'000);
+    server.served_bytes = 0;
+    download_file(server.url("/file?signature=2"), target.c_str(), CONNECT, small_segments());
+    CHECK(read_all(target) == content);
+    CHECK(server.served_bytes >= content.size());
+}
+
+TEST(download_resume_changed_file) {
+    TempDir dir;
+    auto content = pseudo_random_bytes(4'000'000);
+    TestHttpServer server{content, {.rate_limit = 8 << 20}};
+    auto target = dir.path / "file.bin";
+
+    download_cancelled(server.url(), target, 1'000'000);
+    CHECK(std::filesystem::exists(state_file(target)));
+
+    // a new version with a different ETag must not be mixed with the old partial file
+    auto new_content = pseudo_random_bytes(3'000'000, 42);
+    server.set_content(new_content, "\"v2\"");
+    download_file(server.url(), target.c_str(), CONNECT, small_segments());
+    CHECK(read_all(target) == new_content);
+    CHECK(!std::filesystem::exists(state_file(target)));
+}
+
+TEST(download_corrupted_state_file) {
+    TempDir dir;
+    auto content = pseudo_random_bytes(1'000'000);
+    TestHttpServer server{content};
+    auto target = dir.path / "file.bin";
+
+    std::string state = "pog-download 1\n" + server.url() + "\n1000000\n\"v1\"\n0 2000000\n";
+    write_file(state_file(target).c_str(), {(const uint8_t*) state.data(), state.size()});
+    download_file(server.url(), target.c_str(), CONNECT, small_segments());
+    CHECK(read_all(target) == content);
+}
+
+TEST(download_c_abi) {
+    TempDir dir;
+    auto content = pseudo_random_bytes(1'000'000);
+    TestHttpServer server{content};
+    auto target = (dir.path / "file.bin").string();
+
+    char error[256];
+    CHECK(pog_download_file(server.url().c_str(), nullptr, target.c_str(), "Pog-test", 4, nullptr, nullptr,
+                            error, sizeof(error)) == POG_OK);
+    CHECK(read_all(target) == content);
+
+    CHECK(pog_download_file(server.url("/missing").c_str(), nullptr, target.c_str(), "Pog-test", 4, nullptr, nullptr,
+                            error, sizeof(error)) == POG_E_HTTP);
+    CHECK(std::string{error}.find("404") != std::string::npos);
+
+    TestHttpServer slow_server{content, {.rate_limit = 1 << 20}};
+    auto cancel = [](void*, uint64_t, uint64_t) -> int32_t { return 1; };
+    CHECK(pog_download_file(slow_server.url().c_str(), nullptr, target.c_str(), "Pog-test", 4, cancel, nullptr,
+                            error, sizeof(error)) == POG_E_CANCELLED);
+}
+
+#endif
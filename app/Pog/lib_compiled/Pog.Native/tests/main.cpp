@@ -0,0 +1,3 @@
+#include "test.hpp"
+
+TEST_MAIN()
@@ -0,0 +1,228 @@
+// Tests of the compiled manifest cache (`manifest/ManifestCache.hpp`): lookups, appended entries, merging into
+//  a new generation with the size limit, validation of corrupted files, and the C ABI used by
+//  `TemplatedLocalRepositoryPackage`.
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "manifest/ManifestCache.hpp"
+#include "pog_native.h"
+#include "Sha256.hpp"
+#include "test.hpp"
+
+using namespace manifest;
+namespace fs = std::filesystem;
+
+namespace {
+    struct TempDir {
+        fs::path path = fs::temp_directory_path() / ("pog-native-test-" + std::to_string(rand()));
+
+        TempDir() {
+            fs::create_directories(path);
+        }
+
+        ~TempDir() {
+            std::error_code ec;
+            fs::remove_all(path, ec);
+        }
+    };
+
+    CacheKey key(unsigned i) {
+        auto str = "template|" + std::to_string(i);
+        return Sha256::hash({(const uint8_t*) str.data(), str.size()});
+    }
+
+    std::string sample_manifest(unsigned i, size_t size = 0) {
+        auto manifest = "@{\n    Name = 'package-" + std::to_string(i) + "'\n";
+        manifest += "    Version = '" + std::to_string(i) + ".0'\n";
+        manifest.resize(std::max(manifest.size(), size), ' ');
+        return manifest + "}\n";
+    }
+
+    std::vector<CacheEntry> sample_entries(unsigned count) {
+        std::vector<CacheEntry> entries;
+        for (unsigned i = 0; i < count; i++) entries.push_back({key(i), sample_manifest(i)});
+        return entries;
+    }
+
+    std::vector<std::string> cache_files(const fs::path& dir) {
+        std::vector<std::string> files;
+        for (auto& item : fs::directory_iterator(dir)) files.push_back(item.path().filename().string());
+        return files;
+    }
+}
+
+TEST(manifest_cache_lookup) {
+    TempDir dir;
+    for (auto count : {0u, 1u, 2u, 7u, 1000u, 20'000u}) {
+        ManifestCache cache{write_cache(dir.path.c_str(), sample_entries(count)).c_str()};
+        CHECK(cache.entry_count() == count);
+        for (unsigned i = 0; i < count; i++) CHECK(cache.find(key(i)) == sample_manifest(i));
+        CHECK(!cache.find(key(count)));
+        CHECK(!cache.find(CacheKey{}));
+    }
+
+    auto entries = sample_entries(3);
+    entries.push_back({key(1), "@{}"});
+    bool threw = false;
+    try {
+        (void) build_cache(entries);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+TEST(manifest_cache_generations) {
+    TempDir dir;
+    CHECK(cache_files(dir.path).empty());
+    auto cache = ManifestCache::open(dir.path.c_str());
+    CHECK(cache->entry_count() == 0);
+    CHECK(cache_files(dir.path) == std::vector<std::string>{"manifest-cache.1"});
+    cache.reset();
+
+    write_cache(dir.path.c_str(), sample_entries(5));
+    // a leftover of a crashed writer, too recent to be deleted
+    write_file((dir.path / "manifest-cache.3.tmp-123").c_str(), std::vector<uint8_t>(16));
+    cache = ManifestCache::open(dir.path.c_str());
+    CHECK(cache->path().filename() == "manifest-cache.2");
+    CHECK(cache->entry_count() == 5);
+    auto files = cache_files(dir.path);
+    std::sort(files.begin(), files.end());
+    CHECK(files == (std::vector<std::string>{"manifest-cache.2", "manifest-cache.3.tmp-123"}));
+}
+
+TEST(manifest_cache_append) {
+    TempDir dir;
+    write_cache(dir.path.c_str(), sample_entries(10));
+    auto cache = ManifestCache::open(dir.path.c_str());
+    auto other = ManifestCache::open(dir.path.c_str());
+
+    cache->add(key(10), sample_manifest(10));
+    cache->add(key(11), sample_manifest(11));
+    // already present, not appended again
+    cache->add(key(3), "@{}");
+    cache->add(key(10), "@{}");
+    CHECK(cache->find(key(10)) == sample_manifest(10));
+    CHECK(cache->find(key(3)) == sample_manifest(3));
+    CHECK(cache->entry_count() == 10);
+    // the view of other instances does not change
+    CHECK(!other->find(key(10)));
+
+    auto reopened = ManifestCache::open(dir.path.c_str());
+    CHECK(reopened->path() == cache->path());
+    CHECK(reopened->entry_count() == 12);
+    for (unsigned i = 0; i < 12; i++) CHECK(reopened->find(key(i)) == sample_manifest(i));
+
+    // `other` appends at the same offset as `cache` did, overwriting its records; the lost entry is only a miss
+    other->add(key(20), sample_manifest(20));
+    reopened = ManifestCache::open(dir.path.c_str());
+    CHECK(reopened->find(key(20)) == sample_manifest(20));
+    CHECK(!reopened->find(key(10)));
+    CHECK(reopened->find(key(9)) == sample_manifest(9));
+}
+
+TEST(manifest_cache_corrupted_file) {
+    TempDir dir;
+    auto path = write_cache(dir.path.c_str(), sample_entries(10));
+    {
+        ManifestCache cache{path.c_str()};
+        cache.add(key(10), sample_manifest(10));
+        cache.add(key(11), sample_manifest(11));
+    }
+    auto size = fs::file_size(path);
+
+    // a torn write of the last record ends the replay, and the next append overwrites it
+    fs::resize_file(path, size - 4);
+    {
+        ManifestCache cache{path.c_str()};
+        CHECK(cache.find(key(10)));
+        CHECK(!cache.find(key(11)));
+        cache.add(key(12), sample_manifest(12));
+    }
+    {
+        ManifestCache cache{path.c_str()};
+        CHECK(cache.entry_count() == 12);
+        CHECK(cache.find(key(12)) == sample_manifest(12));
+    }
+
+    // a corrupted base is rejected, and the older generation is used instead
+    auto corrupted = write_cache(dir.path.c_str(), sample_entries(3));
+    std::vector<uint8_t> contents(fs::file_size(corrupted));
+    {
+        MappedFile file{corrupted.c_str()};
+        memcpy(contents.data(), file.data().data(), contents.size());
+    }
+    // manifest offset of the first entry, after the header and its key
+    uint32_t offset = UINT32_MAX;
+    memcpy(contents.data() + 40 + 32, &offset, sizeof(offset));
+    fs::remove(corrupted);
+    write_file(corrupted.c_str(), contents);
+    bool threw = false;
+    try {
+        ManifestCache cache{corrupted.c_str()};
+    } catch (const IoError&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    auto cache = ManifestCache::open(dir.path.c_str());
+    CHECK(cache->path() == path);
+    CHECK(cache->entry_count() == 12);
+    CHECK(!fs::exists(corrupted));
+}
+
+TEST(manifest_cache_merge) {
+    TempDir dir;
+    auto cache = ManifestCache::open(dir.path.c_str());
+    auto first_path = cache->path();
+    // enough appended records to reach `MIN_MERGE_SIZE`
+    unsigned count = 2 * ManifestCache::MIN_MERGE_SIZE / 1024;
+    for (unsigned i = 0; i < count; i++) cache->add(key(i), sample_manifest(i, 1024));
+    for (unsigned i = 0; i < count; i++) CHECK(cache->find(key(i)) == sample_manifest(i, 1024));
+
+    auto reopened = ManifestCache::open(dir.path.c_str());
+    CHECK(reopened->path() != first_path);
+    CHECK(reopened->entry_count() == count);
+    for (unsigned i = 0; i < count; i++) CHECK(reopened->find(key(i)) == sample_manifest(i, 1024));
+}
+
+TEST(manifest_cache_size_limit) {
+    TempDir dir;
+    auto manifest_size = sample_manifest(0, 1024).size();
+    // the merge keeps the newest entries which fit into 100 manifests
+    auto cache = ManifestCache::open(dir.path.c_str(), 100 * manifest_size);
+    unsigned count = 4 * ManifestCache::MIN_MERGE_SIZE / 1024;
+    for (unsigned i = 0; i < count; i++) cache->add(key(i), sample_manifest(i, 1024));
+
+    auto reopened = ManifestCache::open(dir.path.c_str());
+    CHECK(reopened->entry_count() < count);
+    CHECK(!reopened->find(key(0)));
+    CHECK(reopened->find(key(count - 1)) == sample_manifest(count - 1, 1024));
+}
+
+TEST(manifest_cache_c_abi) {
+    TempDir dir;
+    char error[256];
+    pog_manifest_cache* cache;
+    CHECK(pog_manifest_cache_open((dir.path / "missing").c_str(), &cache, error, sizeof(error)) == POG_E_IO);
+    CHECK(cache == nullptr);
+    CHECK(pog_manifest_cache_open(dir.path.c_str(), &cache, error, sizeof(error)) == POG_OK);
+
+    auto k = key(1);
+    const char* manifest;
+    size_t manifest_size;
+    CHECK(pog_manifest_cache_find(cache, k.data(), &manifest, &manifest_size) == 0);
+    std::string text = "@{Name = 'Firefox'; Version = '131.0'}";
+    CHECK(pog_manifest_cache_add(cache, k.data(), text.data(), text.size(), error, sizeof(error)) == POG_OK);
+    CHECK(pog_manifest_cache_find(cache, k.data(), &manifest, &manifest_size) == 1);
+    CHECK(std::string(manifest, manifest_size) == text);
+    pog_manifest_cache_close(cache);
+
+    CHECK(pog_manifest_cache_open(dir.path.c_str(), &cache, error, sizeof(error)) == POG_OK);
+    CHECK(pog_manifest_cache_find(cache, k.data(), &manifest, &manifest_size) == 1);
+    CHECK(std::string(manifest, manifest_size) == text);
+    pog_manifest_cache_close(cache);
+}
@@ -0,0 +1,241 @@
+// Tests of the PE image reader and writer against synthetic images with the MSVC layout (see `PeTestImage.hpp`).
+
+#include <string>
+#include <vector>
+#include "pe/PeImage.hpp"
+#include "pe/PeWriter.hpp"
+#include "pe/ResourceTable.hpp"
+#include "PeTestImage.hpp"
+#include "test.hpp"
+
+using namespace pe;
+using test_pe::build;
+using test_pe::build_with_resources;
+using test_pe::resource;
+using test_pe::sample_resources;
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    /// Returns the contents of the section `name` (up to its virtual size), or an empty vector.
+    Bytes section_data(const Bytes& image_data, const std::string& name) {
+        PeImage image{image_data};
+        for (auto& s : image.sections()) {
+            if (s.name_view() == name) {
+                auto data = image.read_rva(s.virtual_address, std::min(s.virtual_size, s.size_of_raw_data));
+                return {data.begin(), data.end()};
+            }
+        }
+        return {};
+    }
+
+    bool throws_pe_error(auto&& fn) {
+        try {
+            fn();
+            return false;
+        } catch (const PeError&) {
+            return true;
+        }
+    }
+}
+
+TEST(pe_parse_headers) {
+    auto data = build({});
+    PeImage image{data};
+    CHECK(image.is_pe32_plus());
+    CHECK(image.machine() == 0x8664);
+    CHECK(image.sections().size() == 4);
+    CHECK(image.sections()[0].name_view() == ".text");
+    CHECK(image.subsystem() == test_pe::SUBSYSTEM_CONSOLE);
+    CHECK(image.data_directory(DataDirectory::RESOURCE).rva == 0);
+    CHECK(image.data_directory(DataDirectory::BASE_RELOCATION).rva == image.sections()[3].virtual_address);
+    CHECK(read_resources(image).empty());
+}
+
+TEST(pe_rejects_invalid_images) {
+    CHECK(throws_pe_error([] { PeImage{Bytes{}}; }));
+    CHECK(throws_pe_error([] { PeImage{Bytes(0x100, 0)}; }));
+
+    auto data = build({});
+    auto bad_signature = data;
+    bad_signature[0x80] = 'X';
+    CHECK(throws_pe_error([&] { PeImage{bad_signature}; }));
+
+    auto bad_alignment = data;
+    write_u32(bad_alignment, 0x84 + 20 + 36, 0x300);
+    CHECK(throws_pe_error([&] { PeImage{bad_alignment}; }));
+
+    // section pointing past the end of the file
+    CHECK(throws_pe_error([&] { PeImage{Bytes(data.begin(), data.end() - 1)}; }));
+}
+
+TEST(pe_read_hand_written_resource_directory) {
+    // root -> {"MYTYPE" -> {1 -> {1033 -> "abc"}}, RCDATA -> {2 -> {0 -> "hello"}}}, written independently
+    //  of `write_resource_section`
+    test_pe::ImageSpec spec;
+    spec.sections.insert(spec.sections.begin() + 3, {".rsrc", Bytes(0x200, 0)});
+    auto rva = test_pe::section_rva(spec, 3);
+    auto& d = spec.sections[3].data;
+    auto w16 = [&](size_t o, uint16_t n) { write_u16(d, o, n); };
+    auto w32 = [&](size_t o, uint32_t n) { write_u32(d, o, n); };
+    // root directory: 1 named, 1 ID entry
+    w16(12, 1), w16(14, 1);
+    w32(16, 0x8000'0100), w32(20, 0x8000'0020); // "MYTYPE" -> 0x20
+    w32(24, 10), w32(28, 0x8000'0038); // RCDATA -> 0x38
+    // type directories
+    w16(0x20 + 14, 1), w32(0x20 + 16, 1), w32(0x20 + 20, 0x8000'0050);
+    w16(0x38 + 14, 1), w32(0x38 + 16, 2), w32(0x38 + 20, 0x8000'0068);
+    // language directories
+    w16(0x50 + 14, 1), w32(0x50 + 16, 1033), w32(0x50 + 20, 0x80);
+    w16(0x68 + 14, 1), w32(0x68 + 16, 0), w32(0x68 + 20, 0x90);
+    // data entries
+    w32(0x80, rva + 0x120), w32(0x84, 3);
+    w32(0x90, rva + 0x128), w32(0x94, 5), w32(0x98, 1200);
+    // strings and data
+    w16(0x100, 6);
+    for (size_t i = 0; i < 6; i++) w16(0x102 + i * 2, (uint16_t) "MYTYPE"[i]);
+    memcpy(d.data() + 0x120, "abc", 3);
+    memcpy(d.data() + 0x128, "hello", 5);
+
+    auto data = build(spec);
+    auto table = read_resources(PeImage{data});
+    CHECK(table.entries().size() == 2);
+    auto my = table.find(ResourceName{u"MYTYPE"}, 1);
+    CHECK(my && *my == resource("abc"));
+    auto rc = table.find(ResourceType::RCDATA, 2);
+    CHECK(rc && *rc == resource("hello", 1200));
+    CHECK(table.find(ResourceType::RCDATA, 1) == nullptr);
+
+    // the writer produces an equivalent directory
+    auto rewritten = build_with_resources(table);
+    CHECK(read_resources(PeImage{rewritten}) == table);
+}
+
+TEST(pe_resource_round_trip) {
+    auto table = sample_resources();
+    table.set({ResourceName{u"custom"}, ResourceName{u"Second"}, 0}, resource("x"));
+    table.set({ResourceName{u"custom"}, ResourceName{u"first"}, 0}, resource("y"));
+    table.set({ResourceName{u"custom"}, 7, 0}, resource("z"));
+    table.set({ResourceType::RCDATA, 1, 0}, resource(""));
+    table.set({ResourceType::VERSION, 1, 1031}, resource("german version"));
+
+    auto data = build_with_resources(table);
+    CHECK(read_resources(PeImage{data}) == table);
+}
+
+TEST(pe_string_names_sorted_case_insensitively) {
+    CHECK(ResourceName{u"abc"} < ResourceName{u"ABD"});
+    CHECK(ResourceName{u"ABC"} < ResourceName{u"abd"});
+    CHECK(ResourceName{u"zzz"} < ResourceName{1});
+    CHECK(!(ResourceName{2} < ResourceName{1}));
+}
+
+TEST(pe_add_resource_section) {
+    // image without resources, the new section is appended after `.reloc`
+    auto original = build({});
+    auto table = sample_resources();
+    auto updated = write_image(PeImage{original}, {.resources = &table});
+
+    PeImage image{updated};
+    CHECK(image.sections().size() == 5);
+    CHECK(image.sections().back().name_view() == ".rsrc");
+    CHECK(read_resources(image) == table);
+    for (auto name : {".text", ".rdata", ".data", ".reloc"}) {
+        CHECK(section_data(updated, name) == section_data(original, name));
+    }
+    auto& last = image.sections().back();
+    CHECK(read_u32(updated, image.size_of_image_offset()) == align_up(last.virtual_address + last.virtual_size, 0x1000));
+}
+
+TEST(pe_grow_and_shrink_resource_section) {
+    ResourceTable small;
+    small.set({ResourceType::RCDATA, 1, 0}, resource("shim data"));
+    auto original = build_with_resources(small);
+    PeImage original_image{original};
+    auto original_reloc_rva = original_image.data_directory(DataDirectory::BASE_RELOCATION).rva;
+
+    // grow: `.reloc` must be moved after the larger `.rsrc`
+    auto large = sample_resources();
+    large.set({ResourceType::RCDATA, 1, 0}, resource("shim data"));
+    auto grown = write_image(original_image, {.resources = &large});
+    PeImage grown_image{grown};
+    CHECK(read_resources(grown_image) == large);
+    CHECK(grown_image.sections().size() == 5);
+    auto& rsrc = grown_image.sections()[3];
+    auto& reloc = grown_image.sections()[4];
+    CHECK(reloc.virtual_address >= rsrc.virtual_address + rsrc.virtual_size);
+    CHECK(reloc.virtual_address > original_reloc_rva);
+    CHECK(grown_image.data_directory(DataDirectory::BASE_RELOCATION).rva == reloc.virtual_address);
+    CHECK(section_data(grown, ".reloc") == section_data(original, ".reloc"));
+    CHECK(section_data(grown, ".text") == section_data(original, ".text"));
+
+    // shrink back to the original layout
+    auto shrunk = write_image(grown_image, {.resources = &small});
+    CHECK(shrunk == original);
+}
+
+TEST(pe_set_subsystem_only) {
+    auto original = build_with_resources(sample_resources());
+    auto updated = write_image(PeImage{original}, {.subsystem = test_pe::SUBSYSTEM_GUI});
+    CHECK(PeImage{updated}.subsystem() == test_pe::SUBSYSTEM_GUI);
+    write_u16(updated, PeImage{updated}.subsystem_offset(), test_pe::SUBSYSTEM_CONSOLE);
+    CHECK(updated == original);
+}
+
+TEST(pe_preserves_overlay_and_checksum) {
+    test_pe::ImageSpec spec;
+    spec.overlay = test_pe::pattern("overlay", 100);
+    spec.checksum = 1;
+    auto original = build(spec);
+    auto table = sample_resources();
+    auto updated = write_image(PeImage{original}, {.resources = &table});
+    CHECK(Bytes(updated.end() - 100, updated.end()) == spec.overlay);
+
+    PeImage image{updated};
+    CHECK(image.checksum() == compute_checksum(updated, image.checksum_offset()));
+    CHECK(image.checksum() != 1);
+}
+
+TEST(pe_rejects_unsupported_layouts) {
+    auto table = sample_resources();
+
+    // `.data` after `.rsrc` may be referenced from code, it cannot be moved
+    test_pe::ImageSpec spec;
+    std::swap(spec.sections[2], spec.sections[3]);
+    auto data = build_with_resources(ResourceTable{}, spec);
+    CHECK(throws_pe_error([&] { write_image(PeImage{data}, {.resources = &table}); }));
+    // ...but other changes are fine
+    CHECK(!throws_pe_error([&] { write_image(PeImage{data}, {.subsystem = 2}); }));
+
+    // signed image
+    auto signed_image = build({});
+    write_u32(signed_image, 0x84 + 20 + 112 + 4 * 8, 0x1234);
+    CHECK(throws_pe_error([&] { write_image(PeImage{signed_image}, {.resources = &table}); }));
+}
+
+TEST(pe_corrupted_images_do_not_crash) {
+    // every truncation and bit flip must either parse or throw `PeError`, never read out of bounds
+    auto data = build_with_resources(sample_resources());
+    auto try_read = [](const Bytes& d) {
+        try {
+            PeImage image{d};
+            auto table = read_resources(image);
+            write_image(image, {.resources = &table});
+        } catch (const PeError&) {}
+    };
+
+    for (size_t size = 0; size < data.size(); size += 7) {
+        try_read({data.begin(), data.begin() + (ptrdiff_t) size});
+    }
+    PeImage image{data};
+    auto rsrc = image.sections()[3];
+    // flip bits in the headers and in the resource directory
+    for (size_t i = 0; i < rsrc.pointer_to_raw_data + 0x200; i++) {
+        if (i == 0x400) i = rsrc.pointer_to_raw_data;
+        for (int bit = 0; bit < 8; bit++) {
+            auto corrupted = data;
+            corrupted[i] ^= (uint8_t) (1 << bit);
+            try_read(corrupted);
+        }
+    }
+}
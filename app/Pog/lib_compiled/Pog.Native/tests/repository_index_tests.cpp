@@ -0,0 +1,404 @@
+// Tests of the binary remote repository index (`repository/RepositoryIndex.hpp`): lookups through the perfect hash
+//  table, generations, validation of corrupted files, delta patches (`repository/DeltaUpdate.hpp`, against a local
+//  HTTP server on Linux), and the C ABI used by `RemoteRepository`.
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "repository/DeltaUpdate.hpp"
+#include "repository/RepositoryIndex.hpp"
+#include "pog_native.h"
+#include "test.hpp"
+#ifndef _WIN32
+#include "TestHttpServer.hpp"
+#endif
+
+using namespace repository;
+namespace fs = std::filesystem;
+
+namespace {
+    struct TempDir {
+        fs::path path = fs::temp_directory_path() / ("pog-native-test-" + std::to_string(rand()));
+
+        TempDir() {
+            fs::create_directories(path);
+        }
+
+        ~TempDir() {
+            std::error_code ec;
+            fs::remove_all(path, ec);
+        }
+    };
+
+    /// `count` packages called `package-<i>`, each with `i % 5` versions.
+    IndexData sample_data(unsigned count) {
+        IndexData data{.etag = "\"abc\"", .last_modified = "Wed, 21 Oct 2015 07:28:00 GMT"};
+        for (unsigned i = 0; i < count; i++) {
+            auto& p = data.packages.emplace_back(PackageEntry{"package-" + std::to_string(i)});
+            for (unsigned v = i % 5; v > 0; v--) p.versions.push_back(std::to_string(v) + ".0." + std::to_string(i));
+        }
+        return data;
+    }
+
+    std::vector<std::string> index_files(const fs::path& dir) {
+        std::vector<std::string> files;
+        for (auto& item : fs::directory_iterator(dir)) files.push_back(item.path().filename().string());
+        return files;
+    }
+
+    void check_contents(const RepositoryIndex& index, const IndexData& data) {
+        CHECK(index.package_count() == data.packages.size());
+        for (uint32_t i = 0; i < data.packages.size(); i++) {
+            auto& p = data.packages[i];
+            CHECK(index.find(p.name) == i);
+            CHECK(index.name(i) == p.name);
+            CHECK(index.version_count(i) == p.versions.size());
+            for (uint32_t v = 0; v < p.versions.size(); v++) CHECK(index.version(i, v) == p.versions[v]);
+        }
+    }
+
+    /// Applies `patch` to `data`; a changed package keeps its position, a new one is placed before the first greater name.
+    void apply(IndexData& data, const IndexPatch& patch) {
+        for (auto& change : patch.packages) {
+            auto it = std::find_if(data.packages.begin(), data.packages.end(),
+                                   [&](auto& p) { return p.name == change.name; });
+            if (it != data.packages.end()) {
+                if (change.versions) it->versions = *change.versions;
+                else data.packages.erase(it);
+                continue;
+            }
+            if (!change.versions) continue;
+            auto position = std::find_if(data.packages.begin(), data.packages.end(),
+                                         [&](auto& p) { return p.name > change.name; });
+            data.packages.insert(position, {change.name, *change.versions});
+        }
+        data.sequence = patch.sequence;
+    }
+
+    std::vector<IndexPatch> sample_patches(uint64_t first_sequence) {
+        return {
+            {first_sequence, {{"package-3", {{"9.9"}}}, {"package-4"}, {"package-10a", {{"1.0", "0.9"}}}}},
+            {first_sequence + 1, {{"aaa", {{"2.0"}}}, {"package-10a"}, {"package-3", {{"10.0", "9.9"}}}}},
+            {first_sequence + 2, {{"package-4", {{"4.0"}}}, {"zzz", {std::vector<std::string>{}}}}},
+        };
+    }
+}
+
+TEST(repository_index_lookup) {
+    TempDir dir;
+    for (auto count : {0u, 1u, 2u, 7u, 1000u, 20'000u}) {
+        auto data = sample_data(count);
+        RepositoryIndex index{write_index(dir.path.c_str(), data).c_str()};
+        check_contents(index, data);
+        CHECK(index.etag() == data.etag);
+        CHECK(index.last_modified() == data.last_modified);
+        CHECK(!index.find("missing"));
+        CHECK(!index.find(""));
+        CHECK(!index.find("package-"));
+        CHECK(!index.find("package-" + std::to_string(count)));
+    }
+}
+
+TEST(repository_index_ignores_case) {
+    TempDir dir;
+    IndexData data{.packages = {{"7zip", {"24.08"}}, {"Firefox", {"131.0", "130.0.1"}}, {"nodejs"}}};
+    RepositoryIndex index{write_index(dir.path.c_str(), data).c_str()};
+    CHECK(index.find("firefox") == 1u);
+    CHECK(index.find("FIREFOX") == 1u);
+    CHECK(index.find("NodeJS") == 2u);
+    CHECK(index.find("7ZIP") == 0u);
+    CHECK(index.version_count(2) == 0);
+
+    data.packages.push_back({"FireFox"});
+    bool threw = false;
+    try {
+        (void) build_index(data);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+TEST(repository_index_generations) {
+    TempDir dir;
+    CHECK(RepositoryIndex::open_latest(dir.path.c_str()) == nullptr);
+
+    auto first = write_index(dir.path.c_str(), sample_data(10));
+    auto second = write_index(dir.path.c_str(), sample_data(20));
+    CHECK(first.filename() == "repository-index.1");
+    CHECK(second.filename() == "repository-index.2");
+
+    // a reader of the old generation is not affected by the new one
+    RepositoryIndex old_index{first.c_str()};
+    auto index = RepositoryIndex::open_latest(dir.path.c_str());
+    CHECK(index && index->package_count() == 20);
+#ifndef _WIN32
+    // on Windows, the old generation cannot be deleted while it's mapped
+    CHECK(index_files(dir.path) == std::vector<std::string>{"repository-index.2"});
+#endif
+    check_contents(old_index, sample_data(10));
+}
+
+TEST(repository_index_touch) {
+    TempDir dir;
+    write_index(dir.path.c_str(), sample_data(3));
+    auto index = RepositoryIndex::open_latest(dir.path.c_str());
+    auto written = index->last_write_time();
+    fs::last_write_time(index->path(), fs::last_write_time(index->path()) - std::chrono::hours(1));
+    CHECK(RepositoryIndex{index->path().c_str()}.last_write_time() < written);
+
+    index->touch();
+    CHECK(index->last_write_time() >= written);
+    CHECK(RepositoryIndex{index->path().c_str()}.last_write_time() >= written);
+}
+
+TEST(repository_index_corrupted_file) {
+    TempDir dir;
+    auto valid = build_index(sample_data(100));
+
+    // a truncated file, and offsets pointing outside the file; a newer corrupted generation is skipped
+    auto truncated = valid;
+    truncated.resize(truncated.size() / 2);
+    auto bad_offset = valid;
+    uint32_t offset = 0xfffffff0;
+    memcpy(bad_offset.data() + 24, &offset, sizeof(offset));
+
+    for (auto& contents : {truncated, bad_offset, std::vector<uint8_t>(100, 'x'), std::vector<uint8_t>{}}) {
+        auto path = dir.path / "repository-index.5";
+        write_file(path.c_str(), contents);
+        bool threw = false;
+        try {
+            RepositoryIndex index{path.c_str()};
+        } catch (const IoError&) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+
+    write_file((dir.path / "repository-index.4").c_str(), valid);
+    auto index = RepositoryIndex::open_latest(dir.path.c_str());
+    CHECK(index && index->path().filename() == "repository-index.4");
+    CHECK(index && index->package_count() == 100);
+}
+
+TEST(repository_index_patches) {
+    TempDir dir;
+    auto data = sample_data(100);
+    data.sequence = 100;
+    write_index(dir.path.c_str(), data);
+
+    auto index = RepositoryIndex::open_latest(dir.path.c_str());
+    CHECK(index->sequence() == 100);
+    auto patches = sample_patches(101);
+    CHECK(!index->append_patch(patches[1]));
+    for (auto& patch : patches) {
+        CHECK(index->append_patch(patch));
+        // the view of the open index does not change
+        CHECK(index->sequence() == 100);
+        check_contents(*index, sample_data(100));
+
+        apply(data, patch);
+        RepositoryIndex reopened{index->path().c_str()};
+        CHECK(reopened.sequence() == patch.sequence);
+        check_contents(reopened, data);
+        CHECK(reopened.etag().empty());
+        CHECK(!reopened.find("package-10a") == (patch.sequence != 101));
+    }
+    // already applied
+    auto size = fs::file_size(index->path());
+    CHECK(index->append_patch(patches[0]));
+    CHECK(fs::file_size(index->path()) == size);
+}
+
+TEST(repository_index_patch_records) {
+    TempDir dir;
+    auto data = sample_data(100);
+    data.sequence = 1;
+    auto path = write_index(dir.path.c_str(), data);
+    auto base_size = fs::file_size(path);
+    auto patches = sample_patches(2);
+
+    // two processes appending the same patch at the same offset write the same bytes
+    RepositoryIndex first{path.c_str()}, second{path.c_str()};
+    CHECK(first.append_patch(patches[0]));
+    auto size = fs::file_size(path);
+    CHECK(second.append_patch(patches[0]));
+    CHECK(fs::file_size(path) == size);
+    CHECK(RepositoryIndex{path.c_str()}.sequence() == 2);
+
+    // a torn record ends the replay, and is overwritten by the next append
+    CHECK(first.append_patch(patches[1]));
+    fs::resize_file(path, fs::file_size(path) - 3);
+    RepositoryIndex torn{path.c_str()};
+    CHECK(torn.sequence() == 2);
+    CHECK(torn.append_patch(patches[1]));
+    CHECK(torn.append_patch(patches[2]));
+    apply(data, patches[0]);
+    apply(data, patches[1]);
+    apply(data, patches[2]);
+    RepositoryIndex repaired{path.c_str()};
+    CHECK(repaired.sequence() == 4);
+    check_contents(repaired, data);
+
+    // a corrupted record is not replayed
+    std::vector<uint8_t> contents;
+    {
+        MappedFile file{path.c_str()};
+        contents.assign(file.data().begin(), file.data().end());
+    }
+    contents[base_size + 40] ^= 1;
+    write_file(path.c_str(), contents);
+    CHECK(RepositoryIndex{path.c_str()}.sequence() == 1);
+}
+
+TEST(repository_index_patch_compaction) {
+    TempDir dir;
+    auto data = sample_data(100);
+    data.sequence = 1;
+    write_index(dir.path.c_str(), data);
+    auto index = RepositoryIndex::open_latest(dir.path.c_str());
+
+    // each patch replaces 10 packages; after a few, the patches are merged into a new generation
+    for (uint64_t s = 2; s < 20; s++) {
+        IndexPatch patch{s};
+        for (unsigned i = 0; i < 10; i++) {
+            patch.packages.push_back({"package-" + std::to_string((s * 10 + i) % 100), {{std::to_string(s) + ".0"}}});
+        }
+        CHECK(index->append_patch(patch));
+        apply(data, patch);
+    }
+    auto latest = RepositoryIndex::open_latest(dir.path.c_str());
+    CHECK(latest->path().filename() != "repository-index.1");
+    CHECK(latest->sequence() == 19);
+    check_contents(*latest, data);
+}
+
+TEST(repository_index_parse_patch) {
+    auto patch = parse_patch(5, "+7zip\t24.08\t24.07\r\n-firefox\n\n+nodejs\n+empty\t");
+    CHECK(patch.sequence == 5);
+    CHECK(patch.packages.size() == 4);
+    CHECK(patch.packages[0].name == "7zip");
+    CHECK((patch.packages[0].versions == std::vector<std::string>{"24.08", "24.07"}));
+    CHECK(patch.packages[1].name == "firefox" && !patch.packages[1].versions);
+    CHECK(patch.packages[2].versions && patch.packages[2].versions->empty());
+    CHECK((patch.packages[3].versions == std::vector<std::string>{""}));
+    CHECK(parse_patch(6, "").packages.empty());
+
+    for (auto invalid : {"7zip\t1.0", "+\t1.0", "-", "-firefox\t1.0", "*x"}) {
+        bool threw = false;
+        try {
+            (void) parse_patch(1, invalid);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+}
+
+#ifndef _WIN32
+TEST(repository_index_delta_update) {
+    TempDir dir;
+    test_http::TestHttpServer server{{}};
+    auto connect = download::default_connection_factory("Pog-test");
+    auto url = server.url("/repo");
+
+    // without patches, or without an index, the full index is needed
+    CHECK(update_index(nullptr, url, connect).status == UpdateStatus::FULL_DOWNLOAD_NEEDED);
+    server.set_file("/repo/patches/sequence.txt", "10 8\n");
+    auto result = update_index(nullptr, url, connect);
+    CHECK(result.status == UpdateStatus::FULL_DOWNLOAD_NEEDED && result.sequence == 10);
+
+    auto data = sample_data(10);
+    data.sequence = 8;
+    write_index(dir.path.c_str(), data);
+    auto index = RepositoryIndex::open_latest(dir.path.c_str());
+    auto patches = sample_patches(9);
+    server.set_file("/repo/patches/9.txt", "+package-3\t9.9\n-package-4\n+package-10a\t1.0\t0.9\n");
+    // a missing patch: the first one is applied, the rest needs a full download
+    auto requests = server.requests.load();
+    CHECK(update_index(index.get(), url + "/", connect).status == UpdateStatus::FULL_DOWNLOAD_NEEDED);
+    CHECK(server.requests - requests == 3);
+    CHECK(RepositoryIndex{index->path().c_str()}.sequence() == 9);
+
+    server.set_file("/repo/patches/10.txt", "+aaa\t2.0\n-package-10a\n+package-3\t10.0\t9.9\n");
+    result = update_index(index.get(), url, connect);
+    CHECK(result.status == UpdateStatus::PATCHED && result.sequence == 10);
+    apply(data, patches[0]);
+    apply(data, patches[1]);
+    index = RepositoryIndex::open_latest(dir.path.c_str());
+    CHECK(index->sequence() == 10);
+    check_contents(*index, data);
+
+    // up to date: only the sequence file is downloaded
+    requests = server.requests.load();
+    CHECK(update_index(index.get(), url, connect).status == UpdateStatus::UP_TO_DATE);
+    CHECK(server.requests - requests == 1);
+
+    // too old for the available patches, a malformed patch, and a restarted sequence
+    server.set_file("/repo/patches/sequence.txt", "12 12\n");
+    CHECK(update_index(index.get(), url, connect).status == UpdateStatus::FULL_DOWNLOAD_NEEDED);
+    server.set_file("/repo/patches/sequence.txt", "11 9\n");
+    server.set_file("/repo/patches/11.txt", "package-3\n");
+    CHECK(update_index(index.get(), url, connect).status == UpdateStatus::FULL_DOWNLOAD_NEEDED);
+    server.set_file("/repo/patches/sequence.txt", "5 6\n");
+    CHECK(update_index(index.get(), url, connect).status == UpdateStatus::FULL_DOWNLOAD_NEEDED);
+    server.set_file("/repo/patches/sequence.txt", "invalid");
+    result = update_index(index.get(), url, connect);
+    CHECK(result.status == UpdateStatus::FULL_DOWNLOAD_NEEDED && result.sequence == 0);
+    CHECK(RepositoryIndex{index->path().c_str()}.sequence() == 10);
+
+    // through the C ABI
+    server.set_file("/repo/patches/sequence.txt", "10 9\n");
+    char error[256];
+    pog_repo_index* c_index;
+    CHECK(pog_repo_index_open(dir.path.c_str(), &c_index, error, sizeof(error)) == 1);
+    uint64_t sequence;
+    CHECK(pog_repo_index_update(c_index, url.c_str(), "Pog-test", &sequence, error, sizeof(error))
+          == POG_REPO_UP_TO_DATE);
+    CHECK(sequence == 10);
+    pog_repo_index_info info;
+    pog_repo_index_get_info(c_index, &info);
+    CHECK(info.sequence == 10);
+    pog_repo_index_close(c_index);
+    CHECK(pog_repo_index_update(nullptr, "http://127.0.0.1:1/repo", "Pog-test", &sequence, error, sizeof(error))
+          == POG_E_HTTP);
+}
+#endif
+
+TEST(repository_index_c_abi) {
+    TempDir dir;
+    char error[256];
+    pog_repo_index* index;
+    CHECK(pog_repo_index_open(dir.path.c_str(), &index, error, sizeof(error)) == 0);
+    CHECK(index == nullptr);
+    CHECK(pog_repo_index_open((dir.path / "missing").c_str(), &index, error, sizeof(error)) == POG_E_IO);
+
+    std::string packages = "7zip\t24.08\t24.07\nfirefox\t131.0\n\nnodejs\n";
+    CHECK(pog_repo_index_write(dir.path.c_str(), packages.data(), packages.size(), "\"etag\"", nullptr, 0,
+                               error, sizeof(error)) == POG_OK);
+    std::string duplicate = "a\nA\n";
+    CHECK(pog_repo_index_write(dir.path.c_str(), duplicate.data(), duplicate.size(), nullptr, nullptr, 0,
+                               error, sizeof(error)) == POG_E_INTERNAL);
+
+    CHECK(pog_repo_index_open(dir.path.c_str(), &index, error, sizeof(error)) == 1);
+    pog_repo_index_info info;
+    pog_repo_index_get_info(index, &info);
+    CHECK(info.package_count == 3);
+    CHECK(info.version_count == 3);
+    CHECK(std::string(info.etag, info.etag_size) == "\"etag\"");
+    CHECK(info.last_modified_size == 0);
+    CHECK(info.sequence == 0);
+    CHECK(info.last_write_time > 0);
+
+    CHECK(pog_repo_index_find(index, "FireFox", 7) == 1);
+    CHECK(pog_repo_index_find(index, "chrome", 6) == -1);
+    const char* str;
+    CHECK(std::string(str, pog_repo_index_get_name(index, 1, &str)) == "firefox");
+    CHECK(pog_repo_index_get_version_count(index, 0) == 2);
+    CHECK(std::string(str, pog_repo_index_get_version(index, 0, 1, &str)) == "24.07");
+    CHECK(pog_repo_index_get_version_count(index, 2) == 0);
+    CHECK(pog_repo_index_touch(index, error, sizeof(error)) == POG_OK);
+    pog_repo_index_close(index);
+}
@@ -0,0 +1,143 @@
+// Tests of the SHA-256 implementations (`Sha256.hpp`) and of file hashing (`FileHash.hpp`).
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "Sha256.hpp"
+#include "FileHash.hpp"
+#include "pog_native.h"
+#include "test.hpp"
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    constexpr Sha256::Implementation IMPLEMENTATIONS[] = {Sha256::Implementation::SCALAR,
+                                                          Sha256::Implementation::SHA_NI};
+
+    std::string hex(std::span<const uint8_t> digest) {
+        std::string out;
+        for (auto b : digest) {
+            out += "0123456789abcdef"[b >> 4];
+            out += "0123456789abcdef"[b & 0xf];
+        }
+        return out;
+    }
+
+    std::span<const uint8_t> as_bytes(const std::string& str) {
+        return {(const uint8_t*) str.data(), str.size()};
+    }
+
+    Bytes pseudo_random_bytes(size_t size) {
+        Bytes data(size);
+        uint32_t x = 0x1234'5678;
+        for (auto& b : data) {
+            x = x * 1664525 + 1013904223;
+            b = (uint8_t) (x >> 24);
+        }
+        return data;
+    }
+}
+
+TEST(sha256_nist_vectors) {
+    // FIPS 180-4 examples (https://csrc.nist.gov/projects/cryptographic-standards-and-guidelines/example-values)
+    struct Vector {
+        std::string message;
+        const char* digest;
+    };
+    const Vector vectors[] = {
+        {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+        {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+         "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+        {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+         "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"},
+        {std::string(1'000'000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+    };
+
+    for (auto implementation : IMPLEMENTATIONS) {
+        if (!Sha256::is_supported(implementation)) continue;
+        for (auto& v : vectors) {
+            Sha256 sha{implementation};
+            sha.update(as_bytes(v.message));
+            CHECK(hex(sha.finish()) == v.digest);
+        }
+    }
+    CHECK(hex(Sha256::hash(as_bytes("abc"))) == vectors[1].digest);
+}
+
+TEST(sha256_chunked_updates) {
+    // every split point around the block boundaries and the padding edge cases (55, 56 and 64 bytes)
+    auto data = pseudo_random_bytes(3 * Sha256::BLOCK_SIZE + 7);
+    for (size_t size : {size_t{0}, size_t{55}, size_t{56}, size_t{63}, size_t{64}, size_t{65}, data.size()}) {
+        std::span<const uint8_t> message{data.data(), size};
+        Sha256 scalar{Sha256::Implementation::SCALAR};
+        scalar.update(message);
+        auto expected = scalar.finish();
+        for (auto implementation : IMPLEMENTATIONS) {
+            if (!Sha256::is_supported(implementation)) continue;
+            for (size_t split = 0; split <= size; split++) {
+                Sha256 sha{implementation};
+                sha.update(message.first(split));
+                sha.update({});
+                sha.update(message.subspan(split));
+                CHECK(sha.finish() == expected);
+            }
+        }
+    }
+
+    // the SHA-NI implementation must match the scalar one on longer multi-block inputs
+    if (Sha256::is_supported(Sha256::Implementation::SHA_NI)) {
+        auto long_data = pseudo_random_bytes(100'003);
+        Sha256 scalar{Sha256::Implementation::SCALAR}, sha_ni{Sha256::Implementation::SHA_NI};
+        scalar.update(long_data);
+        sha_ni.update(long_data);
+        CHECK(scalar.finish() == sha_ni.finish());
+    }
+}
+
+TEST(sha256_file) {
+    auto dir = std::filesystem::temp_directory_path() / ("pog-native-test-" + std::to_string(rand()));
+    std::filesystem::create_directories(dir);
+    auto path = (dir / "file.bin").string();
+
+    // larger than 2 chunks, with a partial last chunk, to exercise the double buffering
+    auto data = pseudo_random_bytes(2 * FILE_HASH_CHUNK_SIZE + 12345);
+    write_file(path.c_str(), data);
+
+    std::vector<uint64_t> reported;
+    auto digest = sha256_file(path.c_str(), [&](uint64_t processed, uint64_t total) {
+        CHECK(total == data.size());
+        reported.push_back(processed);
+        return true;
+    });
+    CHECK(digest == Sha256::hash(data));
+    CHECK((reported == std::vector<uint64_t>{FILE_HASH_CHUNK_SIZE, 2 * FILE_HASH_CHUNK_SIZE, data.size()}));
+
+    auto cancelled = false;
+    try {
+        sha256_file(path.c_str(), [](uint64_t, uint64_t) { return false; });
+    } catch (const OperationCancelled&) {
+        cancelled = true;
+    }
+    CHECK(cancelled);
+
+    write_file(path.c_str(), {});
+    CHECK(hex(sha256_file(path.c_str())) == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+    // C ABI
+    write_file(path.c_str(), as_bytes("abc"));
+    uint8_t out[32];
+    char error[256] = "";
+    CHECK(pog_sha256_file(path.c_str(), out, nullptr, nullptr, error, sizeof(error)) == POG_OK);
+    CHECK(hex(out) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    pog_sha256(nullptr, 0, out);
+    CHECK(hex(out) == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+    auto cancel = [](void*, uint64_t, uint64_t) -> int32_t { return 1; };
+    CHECK(pog_sha256_file(path.c_str(), out, cancel, nullptr, error, sizeof(error)) == POG_E_CANCELLED);
+    auto missing = (dir / "missing.bin").string();
+    CHECK(pog_sha256_file(missing.c_str(), out, nullptr, nullptr, error, sizeof(error)) == POG_E_IO);
+    CHECK(std::string(error) == "Could not open file.");
+
+    std::filesystem::remove_all(dir);
+}
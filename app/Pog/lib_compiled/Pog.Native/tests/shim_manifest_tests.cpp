@@ -0,0 +1,242 @@
+// Tests of the shim manifest (`ShimManifest.hpp`) and of the fast up-to-date check built on it.
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "ShimManifest.hpp"
+#include "ShimUpdate.hpp"
+#include "pe/PeWriter.hpp"
+#include "MappedFile.hpp"
+#include "pog_native.h"
+#include "PeTestImage.hpp"
+#include "test.hpp"
+
+using namespace pe;
+using test_pe::resource;
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    Bytes shim_data(const std::string& target) {
+        Bytes data(2 + target.size(), 0);
+        data[0] = CURRENT_SHIM_DATA_VERSION;
+        std::copy(target.begin(), target.end(), data.begin() + 2);
+        return data;
+    }
+
+    const SourceStamp TARGET_STAMP{shim_path_hash("C:\\x.exe"), 0x4400, 133'000'000'000'000'000};
+}
+
+TEST(shim_manifest_round_trip) {
+    ShimManifest manifest{
+        .shim_data_hash = 0x0123'4567'89ab'cdef,
+        .metadata_source = TARGET_STAMP,
+        .resources = {{3, 6, 6300, 0x1111}, {14, 1, 10, 0x2222}, {16, 1, 0x37c, 0x3333}},
+    };
+    auto encoded = encode_shim_manifest(manifest);
+    CHECK(encoded.size() == 40 + 3 * 16);
+    CHECK(parse_shim_manifest(encoded) == manifest);
+
+    manifest.metadata_source = std::nullopt;
+    manifest.resources.clear();
+    CHECK(parse_shim_manifest(encode_shim_manifest(manifest)) == manifest);
+
+    // malformed manifests are ignored, the shim is then fully compared
+    encoded = encode_shim_manifest(manifest);
+    CHECK(!parse_shim_manifest(Bytes{encoded.begin(), encoded.end() - 1}));
+    encoded.push_back(0);
+    CHECK(!parse_shim_manifest(encoded));
+    encoded.pop_back();
+    encoded[0] = SHIM_MANIFEST_VERSION + 1;
+    CHECK(!parse_shim_manifest(encoded));
+    CHECK(!parse_shim_manifest({}));
+}
+
+TEST(shim_manifest_hashes) {
+    // FNV-1a test vectors
+    CHECK(content_hash({}) == 0xcbf2'9ce4'8422'2325);
+    CHECK(content_hash(Bytes{'a'}) == 0xaf63'dc4c'8601'ec8c);
+
+    CHECK(shim_path_hash("C:\\Pog\\App\\x.exe") == shim_path_hash(u"c:\\pog\\app\\X.EXE"));
+    CHECK(shim_path_hash("C:\\x.exe") != shim_path_hash("C:\\y.exe"));
+
+    auto table = test_pe::sample_resources();
+    auto icons = resource_type_hash(table, ResourceType::ICON);
+    CHECK(icons.type == (uint16_t) ResourceType::ICON);
+    CHECK(icons.name_count == 6);
+    CHECK(icons.data_size == 300 * (1 + 2 + 3 + 4 + 5 + 6));
+
+    auto empty = resource_type_hash(table, ResourceType::BITMAP);
+    CHECK(empty.name_count == 0 && empty.data_size == 0 && empty.hash == FNV1A_64_OFFSET);
+
+    // only the first language of each name is hashed
+    auto other_language = table;
+    other_language.set({ResourceType::ICON, 1, 1034}, resource("translated icon"));
+    CHECK(resource_type_hash(other_language, ResourceType::ICON) == icons);
+
+    auto changed = table;
+    changed.set({ResourceType::ICON, 1, 1033}, resource("new icon"));
+    CHECK(resource_type_hash(changed, ResourceType::ICON).hash != icons.hash);
+
+    // string and numeric names with the same data hash differently
+    ResourceTable by_id, by_name;
+    by_id.set({ResourceType::ICON, 1, 0}, resource("icon"));
+    by_name.set({ResourceType::ICON, ResourceName{u"A"}, 0}, resource("icon"));
+    CHECK(resource_type_hash(by_id, ResourceType::ICON).hash != resource_type_hash(by_name, ResourceType::ICON).hash);
+}
+
+TEST(pe_find_resource) {
+    auto table = test_pe::sample_resources();
+    table.set({ResourceType::RCDATA, ResourceName{u"NAMED"}, 0}, resource("named"));
+    table.set({ResourceType::RCDATA, 7, 0}, resource("numbered"));
+    auto data = test_pe::build_with_resources(table);
+    PeImage image{data};
+
+    for (auto& [key, resource] : table.entries()) {
+        auto found = find_resource(image, key.type, key.name);
+        CHECK(found && Bytes(found->begin(), found->end()) == table.find(key.type, key.name)->data);
+    }
+    CHECK(!find_resource(image, ResourceType::RCDATA, 8));
+    CHECK(!find_resource(image, ResourceType::RCDATA, ResourceName{u"OTHER"}));
+    CHECK(!find_resource(image, ResourceType::BITMAP, 1));
+    CHECK(!find_resource(PeImage{test_pe::build({})}, ResourceType::RCDATA, 1));
+}
+
+TEST(shim_manifest_up_to_date_check) {
+    auto target_resources = read_resources(PeImage{test_pe::build_with_resources(test_pe::sample_resources())});
+    auto data = shim_data("C:\\x.exe");
+    ShimUpdate update{.shim_data = data, .features = 2, .metadata_source = &target_resources,
+                      .metadata_source_stamp = TARGET_STAMP, .subsystem = test_pe::SUBSYSTEM_GUI, .new_shim = true};
+    auto shim = update_shim_image(PeImage{test_pe::build({})}, update)->image;
+    update.new_shim = false;
+
+    auto manifest = parse_shim_manifest(*find_resource(PeImage{shim}, ResourceType::RCDATA, 3));
+    CHECK(manifest && manifest->metadata_source == TARGET_STAMP);
+    CHECK(manifest->shim_data_hash == content_hash(data));
+    CHECK(manifest->resources.size() == 3);
+    CHECK(manifest->resources[0] == resource_type_hash(target_resources, ResourceType::ICON));
+
+    // the check does not use the metadata source, only its stamp
+    auto check = update;
+    check.metadata_source = nullptr;
+    CHECK(is_shim_up_to_date(PeImage{shim}, check));
+    CHECK(!update_shim_image(PeImage{shim}, update));
+
+    auto changed = check;
+    changed.metadata_source_stamp->last_write_time++;
+    CHECK(!is_shim_up_to_date(PeImage{shim}, changed));
+    changed = check;
+    changed.metadata_source_stamp = std::nullopt;
+    CHECK(!is_shim_up_to_date(PeImage{shim}, changed));
+    auto new_data = shim_data("C:\\y.exe");
+    changed = check;
+    changed.shim_data = new_data;
+    CHECK(!is_shim_up_to_date(PeImage{shim}, changed));
+    changed = check;
+    changed.subsystem = test_pe::SUBSYSTEM_CONSOLE;
+    CHECK(!is_shim_up_to_date(PeImage{shim}, changed));
+    changed = check;
+    changed.features = 3;
+    CHECK(!is_shim_up_to_date(PeImage{shim}, changed));
+
+    // touched metadata source with the same resources, only the manifest is updated
+    changed = update;
+    changed.metadata_source_stamp->last_write_time++;
+    auto updated = update_shim_image(PeImage{shim}, changed);
+    CHECK(updated && updated->manifest_only);
+    changed.metadata_source = nullptr;
+    CHECK(is_shim_up_to_date(PeImage{updated->image}, changed));
+
+    // changed resources
+    auto changed_resources = target_resources;
+    changed_resources.set({ResourceType::ICON, 1, 1033}, resource("new icon"));
+    changed = update;
+    changed.metadata_source = &changed_resources;
+    updated = update_shim_image(PeImage{shim}, changed);
+    CHECK(updated && !updated->manifest_only);
+
+    // shim data changed by a version of Pog that does not know about the manifest
+    auto stale_resources = read_resources(PeImage{shim});
+    stale_resources.set({ResourceType::RCDATA, 1, 0}, {new_data, 0});
+    auto stale = write_image(PeImage{shim}, {.resources = &stale_resources});
+    changed = check;
+    changed.shim_data = new_data;
+    CHECK(!is_shim_up_to_date(PeImage{stale}, changed));
+
+    // shims without a metadata source
+    update = {.shim_data = data, .features = 2, .new_shim = true};
+    shim = update_shim_image(PeImage{test_pe::build({})}, update)->image;
+    update.new_shim = false;
+    CHECK(is_shim_up_to_date(PeImage{shim}, update));
+    // without a stamp, there is no manifest
+    update = {.shim_data = data, .features = 2, .metadata_source = &target_resources, .new_shim = true};
+    shim = update_shim_image(PeImage{test_pe::build({})}, update)->image;
+    CHECK(!find_resource(PeImage{shim}, ResourceType::RCDATA, 3));
+}
+
+TEST(shim_manifest_c_api_skips_metadata_source) {
+    auto dir = std::filesystem::temp_directory_path() / ("pog-native-test-" + std::to_string(rand()));
+    std::filesystem::create_directories(dir);
+    auto shim_path = (dir / "shim.exe").string();
+    auto target_path = (dir / "target.exe").string();
+    auto target = test_pe::build_with_resources(test_pe::sample_resources());
+    write_file(shim_path.c_str(), test_pe::build({}));
+    write_file(target_path.c_str(), target);
+
+    auto data = shim_data("C:\\x.exe");
+    char error[256] = "";
+    auto update = [&](uint32_t flags) {
+        return pog_update_shim(shim_path.c_str(), target_path.c_str(), data.data(), data.size(), 0, 3, flags,
+                               error, sizeof(error));
+    };
+    CHECK(update(POG_SHIM_NEW) == POG_SHIM_UPDATED);
+
+    // corrupt the target without changing its size and last write time, the manifest check must not read it
+    auto mtime = std::filesystem::last_write_time(target_path);
+    write_file(target_path.c_str(), Bytes(target.size(), 0));
+    std::filesystem::last_write_time(target_path, mtime);
+    CHECK(update(0) == POG_SHIM_UNCHANGED);
+
+    // touched target with the same content, only the manifest is refreshed
+    write_file(target_path.c_str(), target);
+    CHECK(update(0) == POG_SHIM_UNCHANGED);
+    {
+        MappedFile shim{shim_path.c_str()};
+        auto manifest = parse_shim_manifest(*find_resource(PeImage{shim.data()}, ResourceType::RCDATA, 3));
+        auto info = stat_file(target_path.c_str());
+        CHECK(manifest->metadata_source->last_write_time == info.last_write_time);
+    }
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(shim_manifest_c_api_subsystem_from_source) {
+    auto dir = std::filesystem::temp_directory_path() / ("pog-native-test-" + std::to_string(rand()));
+    std::filesystem::create_directories(dir);
+    auto shim_path = (dir / "shim.exe").string();
+    auto target_path = (dir / "target.exe").string();
+    write_file(shim_path.c_str(), test_pe::build({}));
+    write_file(target_path.c_str(),
+               test_pe::build_with_resources(test_pe::sample_resources(), {.subsystem = test_pe::SUBSYSTEM_GUI}));
+
+    auto data = shim_data("C:\\x.exe");
+    char error[256] = "";
+    auto update = [&](uint32_t flags) {
+        return pog_update_shim(shim_path.c_str(), target_path.c_str(), data.data(), data.size(), 0, -1,
+                               flags | POG_SHIM_SUBSYSTEM_FROM_SOURCE, error, sizeof(error));
+    };
+    auto shim_subsystem = [&] {
+        MappedFile shim{shim_path.c_str()};
+        return PeImage{shim.data()}.subsystem();
+    };
+    CHECK(update(POG_SHIM_NEW) == POG_SHIM_UPDATED);
+    CHECK(shim_subsystem() == test_pe::SUBSYSTEM_GUI);
+    CHECK(update(0) == POG_SHIM_UNCHANGED);
+
+    // a rebuilt target with a different subsystem has a different stamp
+    write_file(target_path.c_str(), test_pe::build_with_resources(test_pe::sample_resources()));
+    CHECK(update(0) == POG_SHIM_UPDATED);
+    CHECK(shim_subsystem() == test_pe::SUBSYSTEM_CONSOLE);
+
+    std::filesystem::remove_all(dir);
+}
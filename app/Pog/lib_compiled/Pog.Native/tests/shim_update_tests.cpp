@@ -0,0 +1,243 @@
+// Tests of the native shim resource update (`ShimUpdate.hpp`) and its C ABI.
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "ShimUpdate.hpp"
+#include "MappedFile.hpp"
+#include "pe/PeWriter.hpp"
+#include "pog_native.h"
+#include "PeTestImage.hpp"
+#include "test.hpp"
+
+using namespace pe;
+using test_pe::resource;
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    Bytes shim_data(const std::string& target) {
+        // only the version is checked by the updater
+        Bytes data(2 + target.size(), 0);
+        data[0] = CURRENT_SHIM_DATA_VERSION;
+        std::copy(target.begin(), target.end(), data.begin() + 2);
+        return data;
+    }
+
+    /// Shim template with the same layout as `PogShimTemplate.exe`, which has no resources.
+    Bytes shim_template() {
+        return test_pe::build({});
+    }
+
+    Bytes target_exe() {
+        return test_pe::build_with_resources(test_pe::sample_resources(), {.subsystem = test_pe::SUBSYSTEM_GUI});
+    }
+
+    bool is_outdated(const Bytes& shim, const ShimUpdate& update) {
+        try {
+            update_shim_image(PeImage{shim}, update);
+            return false;
+        } catch (const OutdatedShimError&) {
+            return true;
+        }
+    }
+}
+
+TEST(shim_update_new_shim) {
+    auto target = target_exe();
+    auto target_resources = read_resources(PeImage{target});
+    auto data = shim_data("C:\\x.exe");
+    auto shim = update_shim_image(PeImage{shim_template()}, {
+        .shim_data = data, .features = 2, .metadata_source = &target_resources,
+        .subsystem = test_pe::SUBSYSTEM_GUI, .new_shim = true,
+    });
+    CHECK(shim.has_value());
+
+    PeImage image{shim->image};
+    CHECK(image.subsystem() == test_pe::SUBSYSTEM_GUI);
+    auto resources = read_resources(image);
+    CHECK(resources.find(ResourceType::RCDATA, 1)->data == data);
+    CHECK(resources.find(ResourceType::RCDATA, 2)->data == Bytes({2, 0}));
+    CHECK(resources.find(ResourceType::ICON, 3)->data == target_resources.find(ResourceType::ICON, 3)->data);
+    CHECK(resources.find(ResourceType::VERSION, 1) != nullptr);
+    // the manifest is not copied
+    CHECK(resources.find(ResourceType::MANIFEST, 1) == nullptr);
+}
+
+TEST(shim_update_existing_shim) {
+    auto target_resources = read_resources(PeImage{target_exe()});
+    auto data = shim_data("C:\\x.exe");
+    ShimUpdate update{.shim_data = data, .features = 2, .metadata_source = &target_resources,
+                      .subsystem = test_pe::SUBSYSTEM_GUI, .new_shim = true};
+    auto shim = update_shim_image(PeImage{shim_template()}, update)->image;
+    update.new_shim = false;
+
+    // up to date, nothing to write
+    CHECK(!update_shim_image(PeImage{shim}, update).has_value());
+
+    // changed shim data
+    auto new_data = shim_data("C:\\y.exe");
+    auto changed = update;
+    changed.shim_data = new_data;
+    auto updated = update_shim_image(PeImage{shim}, changed);
+    CHECK(updated && read_resources(PeImage{updated->image}).find(ResourceType::RCDATA, 1)->data == new_data);
+
+    // changed subsystem only
+    changed = update;
+    changed.subsystem = test_pe::SUBSYSTEM_CONSOLE;
+    updated = update_shim_image(PeImage{shim}, changed);
+    CHECK(updated && PeImage{updated->image}.subsystem() == test_pe::SUBSYSTEM_CONSOLE);
+
+    // removed metadata source, the copied resources are deleted
+    changed = update;
+    changed.metadata_source = nullptr;
+    updated = update_shim_image(PeImage{shim}, changed);
+    CHECK(updated.has_value());
+    auto resources = read_resources(PeImage{updated->image});
+    CHECK(resources.find(ResourceType::ICON, 1) == nullptr);
+    CHECK(resources.find(ResourceType::GROUP_ICON, 1) == nullptr);
+    CHECK(resources.find(ResourceType::RCDATA, 1) != nullptr);
+
+    // changed target icon
+    auto changed_resources = target_resources;
+    changed_resources.set({ResourceType::ICON, 1, 1033}, resource("new icon"));
+    changed = update;
+    changed.metadata_source = &changed_resources;
+    CHECK(update_shim_image(PeImage{shim}, changed).has_value());
+}
+
+TEST(shim_update_outdated_shim) {
+    auto data = shim_data("C:\\x.exe");
+    ShimUpdate update{.shim_data = data, .features = 1, .metadata_source = nullptr, .new_shim = true};
+    auto shim = update_shim_image(PeImage{shim_template()}, update)->image;
+    update.new_shim = false;
+    CHECK(!is_outdated(shim, update));
+
+    // different template
+    auto other_template = update;
+    other_template.features = 3;
+    CHECK(is_outdated(shim, other_template));
+
+    // shims without the features resource were created from the full template
+    auto legacy = test_pe::build_with_resources([&] {
+        ResourceTable t;
+        t.set({ResourceType::RCDATA, 1, 0}, {data, 0});
+        return t;
+    }());
+    CHECK(is_outdated(legacy, update));
+    CHECK(!is_outdated(legacy, other_template));
+
+    // old shim data version
+    auto old_data = data;
+    old_data[0] = 4;
+    auto old_shim = update_shim_image(PeImage{shim_template()}, {.shim_data = old_data, .features = 1,
+                                                                 .metadata_source = nullptr, .new_shim = true})->image;
+    CHECK(is_outdated(old_shim, update));
+}
+
+namespace {
+    /// Returns the shim data the locator of `shim` points to, or an empty vector if it has no locator.
+    Bytes located_shim_data(const Bytes& shim) {
+        PeImage image{shim};
+        auto offset = (image.section_table_offset() + image.sections().size() * sizeof(SectionHeader) + 7) & ~7;
+        if (read_u32(shim, offset) != 0x6d69'6853 || read_u32(shim, offset + 4) != 0x6174'6144) return {};
+        auto data = image.read_rva(read_u32(shim, offset + 8), read_u32(shim, offset + 12));
+        return {data.begin(), data.end()};
+    }
+}
+
+TEST(shim_data_locator) {
+    auto data = shim_data("C:\\x.exe");
+    auto target_resources = read_resources(PeImage{target_exe()});
+    ShimUpdate update{.shim_data = data, .features = 2, .metadata_source = &target_resources, .new_shim = true};
+    auto shim = update_shim_image(PeImage{shim_template()}, update)->image;
+    update.new_shim = false;
+    CHECK(located_shim_data(shim) == data);
+    CHECK(!update_shim_image(PeImage{shim}, update).has_value());
+
+    // the shim data moved
+    auto new_data = shim_data("C:\\some\\longer\\path\\y.exe");
+    auto changed = update;
+    changed.shim_data = new_data;
+    auto updated = update_shim_image(PeImage{shim}, changed)->image;
+    CHECK(located_shim_data(updated) == new_data);
+
+    // resources rewritten without updating the locator (e.g. by `BeginUpdateResource`)
+    auto shim_resources = read_resources(PeImage{shim});
+    auto stale = write_image(PeImage{updated}, {.resources = &shim_resources});
+    CHECK(located_shim_data(stale) != data);
+    auto fixed = update_shim_image(PeImage{stale}, update);
+    CHECK(fixed && fixed->manifest_only);
+    CHECK(located_shim_data(fixed->image) == data);
+    CHECK(!write_shim_data_locator(fixed->image));
+
+    // the locator is cleared if there's no shim data
+    ResourceTable no_resources;
+    auto without_data = write_image(PeImage{updated}, {.resources = &no_resources});
+    CHECK(write_shim_data_locator(without_data));
+    CHECK(located_shim_data(without_data).empty());
+    CHECK(!write_shim_data_locator(without_data));
+}
+
+TEST(shim_data_locator_space) {
+    auto data = shim_data("C:\\x.exe");
+    ResourceTable resources;
+    resources.set({ResourceType::RCDATA, 1, 0}, {data, 0});
+
+    // the checksum is updated together with the locator
+    auto with_checksum = test_pe::build_with_resources(resources, {.checksum = 1});
+    CHECK(write_shim_data_locator(with_checksum));
+    PeImage image{with_checksum};
+    CHECK(image.checksum() == compute_checksum(with_checksum, image.checksum_offset()));
+    CHECK(located_shim_data(with_checksum) == data);
+
+    // something else is stored after the section table
+    auto occupied = test_pe::build_with_resources(resources);
+    PeImage occupied_image{occupied};
+    auto offset = occupied_image.section_table_offset() + occupied_image.sections().size() * sizeof(SectionHeader);
+    occupied[offset + 4] = 1;
+    auto original = occupied;
+    CHECK(!write_shim_data_locator(occupied));
+    CHECK(occupied == original);
+
+    // no space in the headers
+    auto full = test_pe::build_with_resources(resources);
+    write_u32(full, PeImage{full}.optional_header_offset() + 60, (uint32_t) offset + 8);
+    CHECK(!write_shim_data_locator(full));
+}
+
+TEST(shim_update_c_api) {
+    auto dir = std::filesystem::temp_directory_path() / ("pog-native-test-" + std::to_string(rand()));
+    std::filesystem::create_directories(dir);
+    auto shim_path = (dir / "shim.exe").string();
+    auto target_path = (dir / "target.exe").string();
+    write_file(shim_path.c_str(), shim_template());
+    write_file(target_path.c_str(), target_exe());
+
+    auto data = shim_data("C:\\x.exe");
+    char error[256] = "";
+    auto update = [&](uint32_t flags, const char* source) {
+        return pog_update_shim(shim_path.c_str(), source, data.data(), data.size(), 0, 2, flags, error, sizeof(error));
+    };
+    CHECK(update(POG_SHIM_NEW, target_path.c_str()) == POG_SHIM_UPDATED);
+    CHECK(update(0, target_path.c_str()) == POG_SHIM_UNCHANGED);
+    CHECK(update(0, nullptr) == POG_SHIM_UPDATED);
+    CHECK(update(0, nullptr) == POG_SHIM_UNCHANGED);
+    {
+        MappedFile shim{shim_path.c_str()};
+        CHECK(PeImage{shim.data()}.subsystem() == 2);
+        CHECK(located_shim_data({shim.data().begin(), shim.data().end()}) == data);
+    }
+
+    CHECK(pog_update_shim(shim_path.c_str(), nullptr, data.data(), data.size(), 3, 2, 0, error, sizeof(error))
+          == POG_E_OUTDATED_SHIM);
+    CHECK(std::string{error}.starts_with("Shim executable was created from a different shim template"));
+
+    write_file(target_path.c_str(), Bytes{'M', 'Z'});
+    CHECK(update(0, target_path.c_str()) == POG_E_INVALID_PE);
+    CHECK(update(0, (dir / "missing.exe").c_str()) == POG_E_IO);
+
+    std::filesystem::remove_all(dir);
+}
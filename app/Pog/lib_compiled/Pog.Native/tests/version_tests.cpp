@@ -0,0 +1,153 @@
+// Tests of the package version sort keys (`version/VersionKey.hpp`): the comparison cases of `PackageVersion`
+//  from Pog.Tests, and a differential test against a direct port of the managed parser and comparator.
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "version/VersionKey.hpp"
+#include "pog_native.h"
+#include "test.hpp"
+#include "VersionReference.hpp"
+
+using namespace version;
+using test_version::ReferenceVersion;
+
+namespace {
+    struct Key {
+        std::vector<uint8_t> bytes;
+        bool exact;
+    };
+
+    std::optional<Key> key(std::string_view version) {
+        std::vector<uint8_t> bytes(max_key_size(version.size()));
+        auto info = encode_key(version, bytes);
+        if (!info) return std::nullopt;
+        bytes.resize(info->size);
+        return Key{std::move(bytes), info->exact};
+    }
+
+    int sign(int value) {
+        return (value > 0) - (value < 0);
+    }
+
+    int compare(std::string_view v1, std::string_view v2) {
+        return sign(compare_keys(key(v1)->bytes, key(v2)->bytes));
+    }
+
+    /// The comparisons from `Pog.Tests/src/Pog.PackageVersion.cs`, as `{v1, v2, sign of the result}`.
+    const struct {
+        const char* v1;
+        const char* v2;
+        int expected;
+    } MANAGED_CASES[] = {
+            // different lengths
+            {"1.0", "1", 0}, {"1.1.0", "1.1", 0}, {"1.4.1", "1.4", 1}, {"1.4", "1.4.1", -1},
+            {"1.4.1-beta5", "1.4.1", -1}, {"1.4-beta2.1", "1.4-beta2", 1},
+            // JetBrains
+            {"2020.4.1", "2020.2.1", 1}, {"2020.2.1", "2020.4.1", -1}, {"2019.2.1", "2020.4.1", -1},
+            {"2020.2.2", "2020.2.2", 0},
+            // PowerShell
+            {"7.1.1", "7.1.0rc5", 1}, {"7.1.0", "7.1.0rc5", 1}, {"7.1.0rc1", "7.1.0rc5", -1}, {"5.1.0", "7.0.0", -1},
+            {"1.2.0rc2", "7.1.0rc1", -1}, {"7.1.0rc2", "7.1.0rc1", 1},
+            // Firefox
+            {"78.0a2", "78.0a1", 1}, {"78.0b1", "78.0a1", 1}, {"78.0b1", "78.0a2", 1}, {"78.0", "78.0a2", 1},
+            // PyPy
+            {"3.6-v3.7.1", "3.6-v4.0.0", -1}, {"3.6-v3.7.1", "3.6-v3.7.2", -1}, {"3.6-v3.7.1", "3.6-v3.7.1-b1", 1},
+            // 7-Zip
+            {"2107", "1900", 1}, {"2107", "2200", -1}, {"21.07", "19.00", 1}, {"21.07", "22.00", -1},
+            // Wireshark
+            {"3.7.0rc0-1634", "3.7.0rc0-1641", -1}, {"3.7.0rc0-1640", "3.7.0rc0-1636", 1},
+            // build metadata is ignored
+            {"1.2.3+a", "1.2.3+b", 0},
+    };
+}
+
+TEST(version_key_managed_cases) {
+    for (auto& c : MANAGED_CASES) {
+        CHECK(compare(c.v1, c.v2) == c.expected);
+        CHECK(compare(c.v2, c.v1) == -c.expected);
+        CHECK(ReferenceVersion{c.v1}.compare(ReferenceVersion{c.v2}) == c.expected);
+    }
+}
+
+TEST(version_key_tokens) {
+    // type order: text < prerelease type < missing token < number
+    CHECK(compare("1.0-x", "1.0-nightly") < 0);
+    CHECK(compare("1.0-rc", "1.0-rc-x") > 0);
+    CHECK(compare("1.0-rc", "1.0-rc-a") > 0);
+    CHECK(compare("1.0-rc", "1.0-rc-0") < 0);
+    CHECK(compare("1.0-nightly", "1.0-preview") < 0);
+    CHECK(compare("1.0-a1", "1.0-alpha.1") == 0);
+    CHECK(compare("1.0-b", "1.0-beta") == 0);
+    CHECK(compare("1.0-RC", "1.0-rc") < 0);
+    // numbers are compared by value, separators and trailing zeros do not matter
+    CHECK(compare("1.02", "1.2") == 0);
+    CHECK(compare("1.0-rc.010", "1.0-rc_10") == 0);
+    CHECK(compare("1.0.0.0", "1") == 0);
+    CHECK(compare("0", "0.0") == 0);
+    CHECK(compare("0", "0.0.1") < 0);
+    CHECK(compare("1.0.1", "1") > 0);
+    CHECK(compare("2147483647", "2147483646.9") > 0);
+    // a dev suffix without tokens is no dev suffix
+    CHECK(compare("1.0-", "1.0") == 0);
+    CHECK(compare("1.0.", "1.0") == 0);
+    CHECK(compare("1.0.-rc", "1.0rc") == 0);
+
+    CHECK(key("7.1.0-rc5")->exact);
+    CHECK(key("3.7.0-beta.1+a0b1c2d3")->exact);
+    CHECK(!key("3.6-v3.7.1")->exact);
+    CHECK(!key("1.0-RC")->exact);
+}
+
+TEST(version_key_invalid) {
+    for (auto invalid : {"", ".", "..", "a1", "-1", "+1", "v1.0", "1/2", "1\\2", "1:0", "1*", "1?", "1|", "1\"", "1<",
+                         "1\t", "2147483648", "1.99999999999", "1.0-rc99999999999"}) {
+        CHECK(!key(invalid));
+    }
+    // build metadata is not parsed
+    CHECK(key("3.7.0+99999999999999999999"));
+    CHECK(key("1.0+a+b"));
+}
+
+TEST(version_key_differential) {
+    // random versions from the characters that matter for parsing, compared with the reference implementation
+    std::mt19937 rng{42};
+    auto random_version = [&] {
+        static constexpr std::string_view CHARS = "0123456789000.....-_,abrcvx+";
+        std::string version(1, (char) ('0' + rng() % 10));
+        for (auto length = rng() % 12; length > 0; length--) version += CHARS[rng() % CHARS.size()];
+        return version;
+    };
+
+    std::vector<std::string> versions;
+    for (int i = 0; i < 3000; i++) versions.push_back(random_version());
+    // also versions that share a prefix, to get past the main part more often
+    for (int i = 0; i < 2000; i++) versions.push_back("1.2" + random_version().substr(1));
+
+    std::vector<std::pair<ReferenceVersion, Key>> parsed;
+    for (auto& v : versions) {
+        auto k = key(v);
+        // a number with more than 10 digits does not fit into an `int`
+        if (!k) continue;
+        parsed.emplace_back(ReferenceVersion{v}, std::move(*k));
+    }
+    CHECK(parsed.size() > versions.size() * 9 / 10);
+
+    for (size_t i = 0; i < parsed.size(); i++) {
+        for (size_t j = i; j < std::min(parsed.size(), i + 200); j++) {
+            auto expected = parsed[i].first.compare(parsed[j].first);
+            CHECK(sign(compare_keys(parsed[i].second.bytes, parsed[j].second.bytes)) == expected);
+        }
+    }
+}
+
+TEST(version_key_c_abi) {
+    std::string version = "7.1.0-rc5";
+    std::vector<uint8_t> buffer(POG_VERSION_KEY_MAX_SIZE(version.size()));
+    size_t size;
+    CHECK(pog_version_key(version.data(), version.size(), buffer.data(), &size) == POG_VERSION_KEY_EXACT);
+    CHECK(std::vector<uint8_t>(buffer.begin(), buffer.begin() + (ptrdiff_t) size) == key(version)->bytes);
+    CHECK(pog_version_key("3.6-v3", 6, buffer.data(), &size) == POG_VERSION_KEY_INEXACT);
+    CHECK(pog_version_key("v3", 2, buffer.data(), &size) == POG_E_INVALID_VERSION);
+}
@@ -0,0 +1,333 @@
+// Microbenchmarks of the per-launch work done by the shim core (shim data decoding, environment variable interpolation,
+//  command line assembly). Everything here runs on every invocation of an exported command, so it's worth tracking.
+//
+// Run `PogShimBench --csv` to get machine-readable output.
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ShimData.hpp"
+#include "ShimDataValidator.hpp"
+#include "CommandLine.hpp"
+#include "EnvironmentBlock.hpp"
+#include "MulticallIndex.hpp"
+#include "ShimDataLocator.hpp"
+#include "LaunchTrace.hpp"
+#include "os.hpp"
+#include "../host/MulticallIndexBuilder.hpp"
+#include "../host/ShimDataBuilder.hpp"
+#include "../host/ShimImageBuilder.hpp"
+#include "../host/bench.hpp"
+
+using host::EnvVarTemplate;
+using host::ShimSpec;
+
+namespace {
+    const std::u16string PACKAGE_ROOT = u"C:\\Users\\user\\Pog\\data\\..\\..\\Packages\\Visual Studio Code";
+
+    struct Payload {
+        const char* name;
+        ShimSpec spec;
+    };
+
+    std::vector<Payload> realistic_payloads() {
+        std::vector<Payload> payloads;
+
+        // plain `Export-Command` with no extra configuration, by far the most common case
+        payloads.push_back({"minimal", {.target = PACKAGE_ROOT + u"\\app\\bin\\code.exe"}});
+
+        // batch file target, which uses `NULL_TARGET` and `REPLACE_ARGV0`
+        payloads.push_back({"batch", {
+            .target = PACKAGE_ROOT + u"\\app\\bin\\code.cmd",
+            .replace_argv0 = true,
+            .null_target = true,
+        }});
+
+        // typical portable-mode configuration with prefixed arguments
+        payloads.push_back({"args", {
+            .target = PACKAGE_ROOT + u"\\app\\Code.exe",
+            .working_directory = PACKAGE_ROOT + u"\\app",
+            .arguments = u"--user-data-dir \"" + PACKAGE_ROOT + u"\\data\" --extensions-dir \""
+                         + PACKAGE_ROOT + u"\\data\\extensions\"",
+            .replace_argv0 = true,
+        }});
+
+        // several single-segment variables redirecting data directories
+        payloads.push_back({"env", {
+            .target = PACKAGE_ROOT + u"\\app\\Code.exe",
+            .environment = {{
+                {u"VSCODE_APPDATA", EnvVarTemplate::parse({PACKAGE_ROOT + u"\\data"})},
+                {u"VSCODE_EXTENSIONS", EnvVarTemplate::parse({PACKAGE_ROOT + u"\\data\\extensions"})},
+                {u"VSCODE_LOGS", EnvVarTemplate::parse({PACKAGE_ROOT + u"\\logs"})},
+                {u"ELECTRON_NO_UPDATER", EnvVarTemplate::parse({u"1"})},
+            }},
+        }});
+
+        // heavy PATH/PATHEXT composition, as used by language toolchains (JDK, Python, ...)
+        payloads.push_back({"path", {
+            .target = PACKAGE_ROOT + u"\\app\\bin\\java.exe",
+            .environment = {{
+                {u"PATH", EnvVarTemplate::parse({
+                    PACKAGE_ROOT + u"\\app\\bin", PACKAGE_ROOT + u"\\app\\lib", u"%PATH%",
+                    u"%USERPROFILE%\\.local\\bin", u"%APPDATA%\\Python\\Scripts"})},
+                {u"PATHEXT", EnvVarTemplate::parse({u"%PATHEXT%", u".PY", u".PYW"})},
+                {u"JAVA_HOME", EnvVarTemplate::parse({PACKAGE_ROOT + u"\\app"}, true)},
+                {u"CLASSPATH", EnvVarTemplate::parse({u".", u"%JAVA_HOME%\\lib", u"%CLASSPATH%"})},
+            }},
+        }});
+
+        // everything at once
+        auto full = payloads[2].spec;
+        full.environment = payloads[3].spec.environment;
+        for (auto& e : *payloads[4].spec.environment) full.environment->push_back(e);
+        payloads.push_back({"full", full});
+
+        return payloads;
+    }
+
+    void setup_environment() {
+        os::host::clear_environment();
+
+        // realistic PATH with ~30 entries
+        std::u16string path;
+        for (int i = 0; i < 30; i++) {
+            if (i) path += u';';
+            path += u"C:\\Program Files\\Some Vendor\\Tool " + std::u16string(1, (char16_t) (u'A' + i % 26)) + u"\\bin";
+        }
+        os::set_env_var(u"PATH", path.c_str());
+        os::set_env_var(u"PATHEXT", u".COM;.EXE;.BAT;.CMD;.VBS;.VBE;.JS;.JSE;.WSF;.WSH;.MSC;.CPL");
+        os::set_env_var(u"USERPROFILE", u"C:\\Users\\user");
+        os::set_env_var(u"APPDATA", u"C:\\Users\\user\\AppData\\Roaming");
+        os::set_env_var(u"LOCALAPPDATA", u"C:\\Users\\user\\AppData\\Local");
+        os::set_env_var(u"SystemRoot", u"C:\\WINDOWS");
+        os::set_env_var(u"TEMP", u"C:\\Users\\user\\AppData\\Local\\Temp");
+        // a few dozen unrelated variables, so that lookups are not trivially cheap
+        for (int i = 0; i < 40; i++) {
+            auto name = u"UNRELATED_VARIABLE_" + std::u16string(1, (char16_t) (u'A' + i % 26))
+                        + std::u16string(1, (char16_t) (u'0' + i / 26));
+            os::set_env_var(name.c_str(), u"some moderately long value of an unrelated environment variable");
+        }
+    }
+
+    /// Synthetic environment block with `count` variables, sorted like a real Windows environment block.
+    std::u16string synthetic_env_block(size_t count) {
+        std::vector<std::u16string> entries;
+        for (size_t i = 0; i < count; i++) {
+            auto n = std::to_string(i);
+            entries.push_back(u"VARIABLE_" + std::u16string(n.begin(), n.end())
+                              + u"=C:\\Program Files\\Some Vendor\\Some Product\\bin");
+        }
+        std::sort(entries.begin(), entries.end(), [](auto& a, auto& b) {
+            return compare_env_var_names(a.data(), a.find(u'='), b.data(), b.find(u'=')) < 0;
+        });
+        std::u16string block;
+        for (auto& e : entries) {
+            block += e;
+            block.push_back(0);
+        }
+        block.push_back(0);
+        return block;
+    }
+
+    /// Emulates `SetEnvironmentVariable` on a block: the block is scanned for the variable, and the tail of the block
+    /// is moved to make space for the new value, so each call costs O(block size).
+    void set_in_block(std::u16string& block, std::u16string_view name, std::u16string_view value) {
+        size_t pos = 0;
+        while (block[pos] != 0) {
+            auto end = block.find(u'\0', pos);
+            auto eq = block.find(u'=', pos + 1);
+            auto cmp = compare_env_var_names(block.data() + pos, eq - pos, name.data(), name.size());
+            if (cmp == 0) {
+                block.erase(pos, end + 1 - pos);
+                break;
+            }
+            if (cmp > 0) break;
+            pos = end + 1;
+        }
+        std::u16string entry{name};
+        entry += u'=';
+        entry += value;
+        entry.push_back(0);
+        block.insert(pos, entry);
+    }
+
+    size_t interpolate_all(const ShimData& shim_data) {
+        size_t total = 0;
+        shim_data.enumerate_environment_variables([&](auto name, auto value) {
+            total += wstr_size(name) + wstr_size(value);
+        });
+        return total;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    bench::Runner runner{bench::Options::parse(argc, argv)};
+
+    setup_environment();
+    const std::u16string cmd_line = u"\"C:\\Users\\user\\Pog\\data\\package_bin\\code.exe\" --new-window "
+                                    u"\"C:\\Users\\user\\Documents\\Some Project\" --goto src/main.cpp:120";
+    os::host::set_command_line(cmd_line.c_str());
+
+    auto payloads = realistic_payloads();
+    for (auto& payload : payloads) {
+        auto encoded = host::ShimDataBuilder::encode(payload.spec);
+        auto encoded_v4 = host::ShimDataBuilder::encode(payload.spec, 4);
+        ShimDataBuffer buffer{encoded.data(), encoded.size()};
+        ShimDataBuffer buffer_v4{encoded_v4.data(), encoded_v4.size()};
+        std::string suffix = std::string("/") + payload.name;
+
+        runner.run("decode" + suffix, [&] {
+            ShimData shim_data{buffer};
+            bench::do_not_optimize(shim_data.version());
+            bench::do_not_optimize(shim_data.flags());
+            bench::do_not_optimize(shim_data.get_target());
+            bench::do_not_optimize(shim_data.get_working_directory());
+            auto args = shim_data.get_arguments();
+            bench::do_not_optimize(args ? args->size() : 0);
+        });
+
+        runner.run("validate" + suffix, [&] {
+            bench::do_not_optimize(validate_shim_data(buffer));
+        });
+
+        if (payload.spec.environment) {
+            runner.run("env_interpolate" + suffix, [&] {
+                ShimData shim_data{buffer};
+                bench::do_not_optimize(interpolate_all(shim_data));
+            });
+        }
+
+        // v4 shim data, where the command line is assembled from the target and the arguments
+        runner.run("cmdline_assemble_v4" + suffix, [&] {
+            ShimData shim_data{buffer_v4};
+            auto assembled = build_target_command_line(shim_data, os::get_command_line());
+            bench::do_not_optimize(assembled.data());
+        });
+
+        runner.run("cmdline_assemble" + suffix, [&] {
+            ShimData shim_data{buffer};
+            auto assembled = build_target_command_line(shim_data, os::get_command_line());
+            bench::do_not_optimize(assembled.data());
+        });
+
+        runner.run("prepare_launch" + suffix, [&] {
+            // everything the shim does before calling `CreateProcess`, except for applying the environment
+            bench::do_not_optimize(validate_shim_data(buffer));
+            ShimData shim_data{buffer};
+            bench::do_not_optimize(shim_data.get_working_directory());
+            bench::do_not_optimize(interpolate_all(shim_data));
+            auto assembled = build_target_command_line(shim_data, os::get_command_line());
+            bench::do_not_optimize(assembled.data());
+        });
+    }
+
+    // environment setup: per-variable `SetEnvironmentVariable` vs. a single merged block; the crossover point is
+    //  `ShimDataEncoder.EnvironmentBlockMinVariables`
+    for (auto [inherited_count, override_count] : {std::pair{50, 4}, {50, 8}, {50, 16}, {50, 32},
+                                                   {500, 4}, {500, 8}, {500, 16}, {500, 32}}) {
+        auto inherited = synthetic_env_block(inherited_count);
+        std::vector<std::u16string> names, values;
+        for (int i = 0; i < override_count; i++) {
+            // half of the overrides replace inherited variables, the other half are new
+            auto n = std::to_string(i % 2 ? i : i + 100'000);
+            names.push_back(u"VARIABLE_" + std::u16string(n.begin(), n.end()));
+            values.push_back(u"C:\\Users\\user\\Pog\\Packages\\Some Package\\data");
+        }
+        std::string suffix = "/";
+        suffix += std::to_string(inherited_count) + "_vars_" + std::to_string(override_count) + "_set";
+
+        runner.run("env_block_sequential" + suffix, [&] {
+            auto block = inherited;
+            for (int i = 0; i < override_count; i++) set_in_block(block, names[i], values[i]);
+            bench::do_not_optimize(block.data());
+        });
+
+        runner.run("env_block_batched" + suffix, [&] {
+            EnvironmentBlockBuilder builder{inherited.c_str(), (size_t) override_count};
+            for (int i = 0; i < override_count; i++) builder.set(names[i].c_str(), values[i].c_str());
+            auto block = builder.build();
+            bench::do_not_optimize(block.data());
+        });
+    }
+
+    // multicall dispatcher: lookup of the invoked command in an index of all exported commands
+    for (size_t command_count : {100, 10'000}) {
+        std::vector<host::MulticallEntry> entries;
+        std::vector<std::u16string> paths, missing;
+        for (size_t i = 0; i < command_count; i++) {
+            auto n = std::to_string(i);
+            std::u16string name = u"command-" + std::u16string(n.begin(), n.end()) + u".exe";
+            entries.push_back({name, host::ShimDataBuilder::encode({.target = PACKAGE_ROOT + u"\\app\\" + name})});
+            paths.push_back(u"C:\\Users\\user\\Pog\\data\\package_bin\\" + name);
+            missing.push_back(u"missing-" + std::u16string(n.begin(), n.end()) + u".exe");
+        }
+        // look up the commands in a different order than they were inserted in
+        std::reverse(paths.begin(), paths.end());
+        auto index_data = host::MulticallIndexBuilder::encode(entries);
+        MulticallIndex index{index_data.data(), index_data.size()};
+        std::string suffix = "/";
+        suffix += std::to_string(command_count);
+
+        size_t i = 0;
+        runner.run("multicall_lookup" + suffix, [&] {
+            auto name = multicall_command_name(paths[i++ % command_count].c_str());
+            auto shim_data = index.find(name);
+            bench::do_not_optimize(shim_data ? shim_data->data() : nullptr);
+        });
+
+        runner.run("multicall_lookup_miss" + suffix, [&] {
+            auto& name = missing[i++ % command_count];
+            auto shim_data = index.find({name.data(), name.size()});
+            bench::do_not_optimize(shim_data ? shim_data->data() : nullptr);
+        });
+
+        runner.run("multicall_prepare" + suffix, [&] {
+            // everything the dispatcher does before the usual shim launch: index check, lookup, shim data check
+            bench::do_not_optimize(index.validate());
+            auto shim_data = index.find(multicall_command_name(paths[i++ % command_count].c_str()));
+            bench::do_not_optimize(validate_shim_data(*shim_data));
+        });
+    }
+
+    // finding the shim data in the loaded shim image: the locator in the PE headers vs. a walk of the resource
+    //  directory (the lookup part of `FindResource`/`LoadResource`, without the API call overhead), in a shim without
+    //  other resources and in one with the icons copied from a typical application
+    for (size_t icon_count : {0, 8}) {
+        auto image = host::ShimImageBuilder::build({
+            .shim_data = host::ShimDataBuilder::encode(payloads[0].spec), .icon_count = icon_count});
+        auto image_base = image.image.data();
+        std::string suffix = "/" + std::to_string(icon_count) + "_icons";
+
+        runner.run("shim_data_locator" + suffix, [&] {
+            auto shim_data = locate_shim_data(image_base);
+            bench::do_not_optimize(shim_data ? shim_data->data() : nullptr);
+        });
+
+        runner.run("shim_data_resource_walk" + suffix, [&] {
+            uint32_t size;
+            bench::do_not_optimize(host::find_resource_data(image_base, host::ShimImageBuilder::RT_RCDATA, 1, &size));
+        });
+    }
+
+    // cost of the launch trace in a traced shim: reading the clocks at each phase and appending the record to
+    //  the shared ring buffer (in private memory here, without the cost of mapping the trace file)
+    std::vector<uint64_t> trace_file(LAUNCH_TRACE_FILE_SIZE / sizeof(uint64_t), 0);
+    auto trace = *LaunchTraceBuffer::attach((byte*) trace_file.data(), LAUNCH_TRACE_FILE_SIZE,
+                                            os::reference_clock_frequency());
+    const std::u16string trace_name = u"code.exe";
+    runner.run("launch_trace_record", [&] {
+        LaunchTracer<os::read_cycle_counter, os::read_reference_clock> tracer;
+        tracer.start();
+        for (size_t phase = 1; phase < LAUNCH_PHASE_COUNT; phase++) tracer.mark((LaunchPhase) phase);
+        tracer.commit(trace, 1234, {trace_name.data(), trace_name.size()});
+    });
+    bench::do_not_optimize(trace.write_index());
+
+    runner.run("find_argv0_end", [&] {
+        bench::do_not_optimize(find_argv0_end(cmd_line.c_str()));
+    });
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+# Checks that a built shim template only imports DLLs from an allowlist, so that nothing extends the set of DLLs
+#  loaded on each shim launch by accident (e.g. a `MessageBox` call pulling in user32.dll, and gdi32.dll with it).
+# Invoked as a post-build step by `add_shim_template` in `CMakeLists.txt`, and by the host build tests; it only
+#  parses the PE import directory, so it runs on any platform:
+#  cmake -DBINARY=<unpacked exe> -DALLOWED=<dll>[,<dll>...] -P ShimImportCheck.cmake
+
+cmake_minimum_required(VERSION 3.15)
+
+if(NOT DEFINED BINARY OR NOT DEFINED ALLOWED)
+    message(FATAL_ERROR "Usage: cmake -DBINARY=<exe> -DALLOWED=<dll>[,<dll>...] -P ShimImportCheck.cmake")
+endif()
+
+file(READ "${BINARY}" image HEX)
+string(LENGTH "${image}" image_hex_size)
+
+# the message may be split into several arguments, which are concatenated
+function(fail)
+    string(JOIN "" message ${ARGV})
+    message(FATAL_ERROR "${BINARY}: ${message}")
+endfunction()
+
+# reads a little-endian integer with `size` bytes at file offset `offset`
+function(read_le out offset size)
+    math(EXPR end "(${offset} + ${size}) * 2")
+    if(offset LESS 0 OR end GREATER image_hex_size)
+        fail("Truncated PE image.")
+    endif()
+    set(value "")
+    foreach(i RANGE 1 ${size})
+        math(EXPR byte_start "${end} - ${i} * 2")
+        string(SUBSTRING "${image}" ${byte_start} 2 byte)
+        string(APPEND value "${byte}")
+    endforeach()
+    math(EXPR value "0x${value}")
+    set(${out} ${value} PARENT_SCOPE)
+endfunction()
+
+# reads a null-terminated ASCII string at file offset `offset`
+function(read_string out offset)
+    set(str "")
+    math(EXPR pos "${offset} * 2")
+    foreach(i RANGE 255)
+        if(NOT pos LESS image_hex_size)
+            fail("Truncated PE image.")
+        endif()
+        string(SUBSTRING "${image}" ${pos} 2 byte)
+        if(byte STREQUAL "00")
+            set(${out} "${str}" PARENT_SCOPE)
+            return()
+        endif()
+        math(EXPR code "0x${byte}")
+        string(ASCII ${code} char)
+        string(APPEND str "${char}")
+        math(EXPR pos "${pos} + 2")
+    endforeach()
+    fail("Import name is not terminated.")
+endfunction()
+
+# translates an RVA to a file offset using the section table
+function(rva_to_offset out rva)
+    foreach(i RANGE ${section_count})
+        if(i EQUAL section_count)
+            break()
+        endif()
+        math(EXPR header "${section_table} + ${i} * 40")
+        math(EXPR virtual_size_offset "${header} + 8")
+        math(EXPR virtual_address_offset "${header} + 12")
+        math(EXPR raw_size_offset "${header} + 16")
+        math(EXPR raw_pointer_offset "${header} + 20")
+        read_le(virtual_size ${virtual_size_offset} 4)
+        read_le(virtual_address ${virtual_address_offset} 4)
+        read_le(raw_size ${raw_size_offset} 4)
+        read_le(raw_pointer ${raw_pointer_offset} 4)
+        if(raw_size GREATER virtual_size)
+            set(virtual_size ${raw_size})
+        endif()
+        math(EXPR section_end "${virtual_address} + ${virtual_size}")
+        if(NOT rva LESS virtual_address AND rva LESS section_end)
+            math(EXPR offset "${rva} - ${virtual_address} + ${raw_pointer}")
+            set(${out} ${offset} PARENT_SCOPE)
+            return()
+        endif()
+    endforeach()
+    fail("RVA ${rva} is not in any section.")
+endfunction()
+
+read_le(mz 0 2)
+if(NOT mz EQUAL 23117) # "MZ"
+    fail("Not a PE image.")
+endif()
+read_le(pe_offset 60 4)
+read_le(pe_signature ${pe_offset} 4)
+if(NOT pe_signature EQUAL 17744) # "PE\0\0"
+    fail("Not a PE image.")
+endif()
+
+math(EXPR coff "${pe_offset} + 4")
+math(EXPR optional_header "${coff} + 20")
+math(EXPR section_count_offset "${coff} + 2")
+math(EXPR optional_header_size_offset "${coff} + 16")
+read_le(section_count ${section_count_offset} 2)
+read_le(optional_header_size ${optional_header_size_offset} 2)
+math(EXPR section_table "${optional_header} + ${optional_header_size}")
+
+read_le(magic ${optional_header} 2)
+if(magic EQUAL 267) # 0x10b, PE32
+    math(EXPR directory_count_offset "${optional_header} + 92")
+elseif(magic EQUAL 523) # 0x20b, PE32+
+    math(EXPR directory_count_offset "${optional_header} + 108")
+else()
+    fail("Unknown optional header magic ${magic}.")
+endif()
+read_le(directory_count ${directory_count_offset} 4)
+
+# the import directory is the second data directory
+set(imports "")
+if(directory_count GREATER 1)
+    math(EXPR import_directory_offset "${directory_count_offset} + 4 + 8")
+    read_le(import_rva ${import_directory_offset} 4)
+    if(NOT import_rva EQUAL 0)
+        rva_to_offset(descriptor ${import_rva})
+        # the descriptor array is terminated by an empty descriptor; a shim only has a few imports
+        foreach(i RANGE 64)
+            math(EXPR name_rva_offset "${descriptor} + 12")
+            read_le(name_rva ${name_rva_offset} 4)
+            if(name_rva EQUAL 0)
+                break()
+            endif()
+            rva_to_offset(name_offset ${name_rva})
+            read_string(name ${name_offset})
+            string(TOLOWER "${name}" name)
+            list(APPEND imports "${name}")
+            math(EXPR descriptor "${descriptor} + 20")
+        endforeach()
+    endif()
+endif()
+
+string(TOLOWER "${ALLOWED}" allowed)
+string(REPLACE "," ";" allowed "${allowed}")
+set(disallowed "")
+foreach(name IN LISTS imports)
+    if(NOT name IN_LIST allowed)
+        list(APPEND disallowed "${name}")
+    endif()
+endforeach()
+
+string(REPLACE ";" ", " imports_str "${imports}")
+if(disallowed)
+    string(REPLACE ";" ", " disallowed_str "${disallowed}")
+    fail("Imports DLLs which are not allowed for a shim: ${disallowed_str} (all imports: ${imports_str}). Each "
+         "imported DLL is loaded on every shim launch; load it lazily with `LoadLibraryEx` instead, or extend the "
+         "allowlist in `CMakeLists.txt` if it's really needed.")
+endif()
+get_filename_component(binary_name "${BINARY}" NAME)
+message(STATUS "${binary_name} imports: ${imports_str}")
@@ -0,0 +1,23 @@
+# Prints the size and the instruction count of a built shim template, and writes them to a single-row CSV report.
+# Invoked as a post-build step by `add_shim_template` in `CMakeLists.txt`:
+#  cmake -DNAME=<template> -DBINARY=<unpacked exe> -DPACKED=<output exe> -DLINKER=<link.exe> -DREPORT=<csv> -P ShimSizeReport.cmake
+
+file(SIZE "${BINARY}" size)
+file(SIZE "${PACKED}" packed_size)
+
+# count instructions in the disassembly of the unpacked binary; `dumpbin` is next to `link.exe`
+get_filename_component(linker_dir "${LINKER}" DIRECTORY)
+find_program(DUMPBIN dumpbin HINTS "${linker_dir}")
+set(instructions "?")
+if(DUMPBIN)
+    execute_process(COMMAND "${DUMPBIN}" /nologo /disasm:nobytes "${BINARY}" OUTPUT_VARIABLE disasm RESULT_VARIABLE result)
+    if(result EQUAL 0)
+        # each instruction is on a separate line starting with its address, e.g. `  0000000140001000: mov rax,rcx`
+        string(REGEX MATCHALL "\n +[0-9A-F]+: " instruction_lines "${disasm}")
+        list(LENGTH instruction_lines instructions)
+    endif()
+endif()
+
+# without UPX (`POG_SHIM_UPX=OFF`), the output is just a copy of the binary, and the packed size equals the size
+message(STATUS "${NAME}: ${size} B, ${packed_size} B packed, ${instructions} instructions")
+file(WRITE "${REPORT}" "template,size,packed_size,instructions\n${NAME},${size},${packed_size},${instructions}\n")
@@ -0,0 +1,78 @@
+// Fuzz target for the shim data decoder. Any input accepted by `validate_shim_data` must be safe to decode with
+//  `ShimData`, so after validation, the target exercises everything the shim does with the shim data.
+//
+// The first byte of the input selects the mode: if the lowest bit is set, the checksum of the shim data is fixed up
+//  before validation, so that the fuzzer can get past the checksum check and exercise the bounds checks.
+//
+// Built with libFuzzer when configured with `-DPOG_SHIM_LIBFUZZER=ON` (requires Clang), otherwise linked with
+//  the standalone driver in `standalone_main.cpp`.
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "ShimData.hpp"
+#include "ShimDataValidator.hpp"
+#include "CommandLine.hpp"
+#include "EnvironmentBlock.hpp"
+
+namespace {
+    /// Returns the variable name as its value, so that the interpolated values are bounded by the shim data size.
+    struct EchoEnvironment {
+        size_t read_env_var(const wchar* name, wchar* buffer, size_t buffer_size) const {
+            auto size = wstr_size(name);
+            if (size == 0) return os::ENV_VAR_NOT_FOUND;
+            if (size < buffer_size) {
+                copy(name, name + size + 1, buffer);
+            }
+            return size;
+        }
+    };
+
+    constexpr wchar INHERITED_BLOCK[] = u"=C:=C:\\\0HOME=C:\\Users\\user\0PATH=C:\\a;C:\\b\0\0";
+    constexpr wchar CMD_LINE[] = u"\"C:\\shim dir\\shim.exe\" a \"b c\"\td";
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* input, size_t input_size) {
+    if (input_size == 0) return 0;
+    auto fix_checksum = (input[0] & 1) != 0;
+
+    // the shim data resource is always aligned, copy the input to get the same alignment
+    std::vector<uint64_t> storage((input_size - 1 + sizeof(uint64_t) - 1) / sizeof(uint64_t) + 1);
+    auto data = (byte*) storage.data();
+    auto size = input_size - 1;
+    memcpy(data, input + 1, size);
+
+    if (fix_checksum && size >= sizeof(ShimHeader)) {
+        auto checksum_ptr = data + offsetof(ShimHeader, checksum);
+        memset(checksum_ptr, 0, sizeof(uint32_t));
+        auto checksum = shim_data_checksum(data, size);
+        memcpy(checksum_ptr, &checksum, sizeof(checksum));
+    }
+
+    ShimDataBuffer buffer{data, size};
+    if (validate_shim_data(buffer) != nullptr) {
+        return 0;
+    }
+
+    ShimData shim_data{buffer};
+    (void) shim_data.required_features();
+    (void) shim_data.get_target();
+    if (auto wd = shim_data.get_working_directory()) (void) wstr_size(wd);
+    auto cmd_line = build_target_command_line(shim_data, CMD_LINE);
+    (void) wstr_size(cmd_line.data());
+
+    EchoEnvironment environment{};
+    shim_data.enumerate_environment_variables(environment, [](auto name, auto value) {
+        (void) wstr_size(name);
+        (void) wstr_size(value);
+    });
+
+    EnvironmentBlockBuilder builder{INHERITED_BLOCK, shim_data.environment_variable_count()};
+    shim_data.enumerate_environment_variables(builder, [&](auto name, auto value) {
+        builder.set(name, value);
+    });
+    auto block = builder.build();
+    (void) block.data();
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+// Standalone driver for `shim_data_fuzz.cpp`, used when libFuzzer is not available (e.g. with GCC). It runs the
+//  fuzz target on the given corpus files, or on random mutations of payloads generated by `ShimDataBuilder`.
+//
+// Usage:
+//  PogShimFuzz [--iterations N] [--seed N]    run random mutations of the built-in seeds
+//  PogShimFuzz --write-corpus DIR             write the built-in seeds to DIR, to use as a libFuzzer corpus
+//  PogShimFuzz FILE...                        run the fuzz target on each file (e.g. to reproduce a crash)
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "../host/ShimDataBuilder.hpp"
+
+using host::EnvVarTemplate;
+using host::ShimDataBuilder;
+using host::ShimSpec;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* input, size_t input_size);
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    std::vector<Bytes> seeds() {
+        std::vector<ShimSpec> specs{
+            {.target = u"C:\\x.exe"},
+            {.target = u"C:\\x.cmd", .arguments = u"/c x", .replace_argv0 = true, .null_target = true},
+            {
+                .target = u"C:\\pkg\\app\\x.exe",
+                .working_directory = u"C:\\pkg\\app",
+                .arguments = u"--data \"C:\\pkg\\data\"",
+                .environment = {{
+                    {u"PATH", EnvVarTemplate::parse({u"C:\\pkg\\bin", u"%PATH%", u"%HOME%\\bin", u"%path%"})},
+                    {u"HOME", EnvVarTemplate::parse({u"C:\\pkg\\home"}, true)},
+                    {u"X", EnvVarTemplate::parse({u"%HOME%"})},
+                    {u"EMPTY", EnvVarTemplate::parse({})},
+                }},
+                .replace_argv0 = true,
+            },
+        };
+
+        std::vector<Bytes> out;
+        for (auto& spec : specs) {
+            for (uint16_t version : {4, 5}) {
+                for (uint8_t mode : {0, 1}) {
+                    auto encoded = ShimDataBuilder::encode(spec, version);
+                    Bytes input{mode};
+                    input.insert(input.end(), encoded.begin(), encoded.end());
+                    out.push_back(std::move(input));
+                }
+            }
+        }
+        return out;
+    }
+
+    struct Rng {
+        uint64_t state;
+
+        uint64_t next() {
+            // xorshift64
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+
+        size_t below(size_t n) {
+            return n == 0 ? 0 : next() % n;
+        }
+    };
+
+    void mutate(Bytes& input, Rng& rng) {
+        // never mutate the mode byte
+        auto pos = 1 + rng.below(input.size() - 1);
+        switch (rng.below(5)) {
+            case 0: // flip a bit
+                input[pos] ^= (uint8_t) (1 << rng.below(8));
+                break;
+            case 1: // random byte
+                input[pos] = (uint8_t) rng.next();
+                break;
+            case 2: { // interesting uint32 value at an aligned position, most fields are offsets or sizes
+                uint32_t values[]{0, 1, 2, 4, 0x7fff'ffff, 0xffff'ffff, (uint32_t) input.size(), (uint32_t) rng.next()};
+                auto value = values[rng.below(std::size(values))];
+                auto aligned_pos = 1 + ((pos - 1) & ~(size_t) 3);
+                if (aligned_pos + sizeof(value) <= input.size()) {
+                    memcpy(&input[aligned_pos], &value, sizeof(value));
+                }
+                break;
+            }
+            case 3: // truncate
+                input.resize(pos);
+                break;
+            case 4: { // duplicate a chunk at the end
+                Bytes chunk{input.begin() + (ptrdiff_t) pos, input.begin() + (ptrdiff_t) (pos + rng.below(input.size() - pos))};
+                input.insert(input.end(), chunk.begin(), chunk.end());
+                break;
+            }
+        }
+    }
+
+    int run_file(const char* path) {
+        std::ifstream file{path, std::ios::binary};
+        if (!file) {
+            fprintf(stderr, "cannot open '%s'\n", path);
+            return 1;
+        }
+        Bytes input{std::istreambuf_iterator<char>(file), {}};
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+        return 0;
+    }
+
+    int write_corpus(const std::string& dir) {
+        auto inputs = seeds();
+        for (size_t i = 0; i < inputs.size(); i++) {
+            auto path = dir + "/seed_" + std::to_string(i);
+            std::ofstream file{path, std::ios::binary};
+            file.write((const char*) inputs[i].data(), (std::streamsize) inputs[i].size());
+            if (!file) {
+                fprintf(stderr, "cannot write '%s'\n", path.c_str());
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t iterations = 100'000;
+    uint64_t seed = 0x5eed;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+            iterations = strtoull(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--write-corpus") && i + 1 < argc) {
+            return write_corpus(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [--iterations N] [--seed N] [--write-corpus DIR] [FILE...]\n", argv[0]);
+            return 2;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (!files.empty()) {
+        for (auto f : files) {
+            if (auto ret = run_file(f)) return ret;
+        }
+        return 0;
+    }
+
+    auto inputs = seeds();
+    Rng rng{seed ? seed : 1};
+    for (size_t i = 0; i < iterations; i++) {
+        auto input = inputs[rng.below(inputs.size())];
+        for (auto n = 1 + rng.below(4); n > 0 && input.size() > 1; n--) {
+            mutate(input, rng);
+        }
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    printf("%zu inputs OK\n", iterations);
+    return 0;
+}
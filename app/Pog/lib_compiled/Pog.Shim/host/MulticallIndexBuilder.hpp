@@ -0,0 +1,72 @@
+#pragma once
+
+// Host-only C++ port of `MulticallIndexFile.cs`, used to generate multicall indices for benchmarks and tests.
+//  Keep this in sync with the C# writer, the indices should be byte-for-byte identical.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "MulticallIndex.hpp"
+
+namespace host {
+    struct MulticallEntry {
+        /// File name of the exported command, e.g. `code.exe`.
+        std::u16string name;
+        /// Encoded shim data (`ShimDataBuilder::encode`).
+        std::vector<unsigned char> shim_data;
+    };
+
+    class MulticallIndexBuilder {
+    public:
+        static std::vector<unsigned char> encode(const std::vector<MulticallEntry>& entries) {
+            // keep the load factor at most 0.5, so that the probe sequences stay short
+            uint32_t bucket_count = 1;
+            while (bucket_count < entries.size() * 2) bucket_count *= 2;
+
+            std::vector<uint32_t> buckets(bucket_count, 0);
+            std::vector<unsigned char> buf(sizeof(MulticallIndexHeader) + bucket_count * sizeof(uint32_t));
+
+            for (auto& entry : entries) {
+                auto hash = multicall_name_hash(entry.name.data(), entry.name.size());
+                auto offset = (uint32_t) buf.size();
+
+                write_u32(buf, hash);
+                write_u32(buf, entry.name.size());
+                write_u32(buf, entry.shim_data.size());
+                write_bytes(buf, entry.name.data(), entry.name.size() * sizeof(char16_t));
+                buf.resize((buf.size() + 3) & ~(size_t) 3);
+                write_bytes(buf, entry.shim_data.data(), entry.shim_data.size());
+                buf.resize((buf.size() + 3) & ~(size_t) 3);
+
+                auto bucket = hash & (bucket_count - 1);
+                while (buckets[bucket] != 0) bucket = (bucket + 1) & (bucket_count - 1);
+                buckets[bucket] = offset;
+            }
+
+            MulticallIndexHeader header{
+                .magic = MULTICALL_INDEX_MAGIC,
+                .version = MULTICALL_INDEX_VERSION,
+                .reserved = 0,
+                .bucket_count = bucket_count,
+                .entry_count = (uint32_t) entries.size(),
+            };
+            memcpy(buf.data(), &header, sizeof(header));
+            memcpy(buf.data() + sizeof(header), buckets.data(), bucket_count * sizeof(uint32_t));
+            return buf;
+        }
+
+    private:
+        static void write_bytes(std::vector<unsigned char>& buf, const void* data, size_t size) {
+            auto pos = buf.size();
+            buf.resize(pos + size);
+            if (size) memcpy(buf.data() + pos, data, size);
+        }
+
+        static void write_u32(std::vector<unsigned char>& buf, size_t n) {
+            auto n32 = (uint32_t) n;
+            write_bytes(buf, &n32, sizeof(n32));
+        }
+    };
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+// Host-only C++ port of `ShimDataEncoder.cs`, used to generate shim data payloads for benchmarks and tests of the shim
+//  core. Keep this in sync with the C# encoder, the payloads should be byte-for-byte identical.
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace host {
+    struct EnvSegment {
+        bool is_env_var_name;
+        bool new_segment;
+        std::u16string str;
+    };
+
+    struct EnvVarTemplate {
+        bool recessive = false;
+        std::vector<EnvSegment> segments = {};
+
+        /// Parses a list of values in the same way as `ShimExecutable.EnvVarTemplate` (e.g. `%PATH%`, `%APPDATA%\x`).
+        static EnvVarTemplate parse(const std::vector<std::u16string>& raw_values, bool recessive = false) {
+            EnvVarTemplate t{.recessive = recessive};
+            for (auto& value : raw_values) {
+                auto is_env_var_name = true;
+                auto first = true;
+                size_t start = 0;
+                while (true) {
+                    auto end = value.find(u'%', start);
+                    auto part = value.substr(start, end == std::u16string::npos ? std::u16string::npos : end - start);
+                    is_env_var_name = !is_env_var_name;
+                    if (part.empty()) {
+                        if (is_env_var_name) {
+                            // %%, replace with a literal %
+                            t.segments.push_back({false, first, u"%"});
+                            first = false;
+                        }
+                    } else {
+                        t.segments.push_back({is_env_var_name, first, part});
+                        first = false;
+                    }
+                    if (end == std::u16string::npos) break;
+                    start = end + 1;
+                }
+            }
+            if (t.segments.empty()) {
+                t.segments.push_back({false, true, u""});
+            }
+            return t;
+        }
+    };
+
+    struct ShimSpec {
+        std::u16string target;
+        std::optional<std::u16string> working_directory = std::nullopt;
+        /// Already escaped argument string (output of `Win32Args.EscapeArguments`).
+        std::optional<std::u16string> arguments = std::nullopt;
+        std::optional<std::vector<std::pair<std::u16string, EnvVarTemplate>>> environment = std::nullopt;
+        bool replace_argv0 = false;
+        bool null_target = false;
+        bool detached = false;
+    };
+
+    class ShimDataBuilder {
+    public:
+        static constexpr uint16_t VERSION = 5;
+        /// `ShimDataEncoder.EnvironmentBlockMinVariables`
+        static constexpr size_t ENVIRONMENT_BLOCK_MIN_VARIABLES = 8;
+
+        /// `version` may be set to 4 to produce shim data written by older versions of Pog.
+        static std::vector<unsigned char> encode(const ShimSpec& spec, uint16_t version = VERSION) {
+            ShimDataBuilder b;
+            return b.encode_inner(spec, version);
+        }
+
+    private:
+        std::vector<unsigned char> buf_;
+        size_t pos_ = 0;
+
+        std::vector<unsigned char> encode_inner(const ShimSpec& spec, uint16_t version) {
+            seek(version >= 5 ? 2 * 2 + 4 * 6 : 2 * 2 + 4 * 4);
+            auto target_offset = write_null_terminated(spec.target);
+            auto wd_offset = spec.working_directory ? write_null_terminated(*spec.working_directory) : 0;
+            auto args_offset = spec.arguments ? write_length_prefixed(*spec.arguments) : 0;
+            auto env_offset = spec.environment ? write_environment(*spec.environment) : 0;
+            size_t cmd_line_prefix_offset = 0;
+            if (version >= 5) {
+                auto prefix = command_line_prefix(spec);
+                cmd_line_prefix_offset = prefix.empty() ? 0 : write_length_prefixed(prefix);
+            }
+            auto end_offset = pos_;
+
+            uint16_t flags = (spec.replace_argv0 ? 1 : 0) | (spec.null_target ? 2 : 0)
+                             | (spec.environment && spec.environment->size() >= ENVIRONMENT_BLOCK_MIN_VARIABLES ? 4 : 0)
+                             | (spec.detached ? 8 : 0);
+
+            seek(0);
+            write_u16(version);
+            write_u16(flags);
+            write_u32(target_offset);
+            write_u32(wd_offset);
+            write_u32(args_offset);
+            write_u32(env_offset);
+            if (version >= 5) {
+                write_u32(cmd_line_prefix_offset);
+                write_u32(0); // checksum, computed below
+            }
+
+            buf_.resize(end_offset);
+            if (version >= 5) {
+                seek(pos_ - sizeof(uint32_t));
+                write_u32(checksum(buf_));
+            }
+            return std::move(buf_);
+        }
+
+        /// 4-lane word-wise FNV-1a of the whole buffer (with the checksum field set to 0), see `shim_data_checksum`.
+        static uint32_t checksum(const std::vector<unsigned char>& buf) {
+            constexpr uint64_t prime = 1099511628211u;
+            constexpr uint64_t basis = 14695981039346656037u;
+            uint64_t lanes[4] = {basis, basis, basis, basis};
+            for (size_t i = 0; i < buf.size(); i += 4) {
+                uint32_t word = 0;
+                for (size_t j = 0; j < 4 && i + j < buf.size(); j++) word |= (uint32_t) buf[i + j] << (8 * j);
+                lanes[i / 4 % 4] = (lanes[i / 4 % 4] ^ word) * prime;
+            }
+            uint64_t hash = basis;
+            for (auto lane : lanes) hash = (hash ^ lane) * prime;
+            hash = (hash ^ buf.size()) * prime;
+            return (uint32_t) (hash ^ (hash >> 32));
+        }
+
+        static std::u16string command_line_prefix(const ShimSpec& spec) {
+            std::u16string prefix;
+            if (spec.replace_argv0 || spec.null_target) {
+                prefix = u"\"" + spec.target + u"\"";
+            }
+            if (spec.arguments) {
+                prefix += u" " + *spec.arguments;
+            }
+            return prefix;
+        }
+
+        void seek(size_t pos) {
+            pos_ = pos;
+            if (buf_.size() < pos_) buf_.resize(pos_);
+        }
+
+        void align(size_t alignment) {
+            seek((pos_ + alignment - 1) & ~(alignment - 1));
+        }
+
+        void write_bytes(const void* data, size_t size) {
+            if (buf_.size() < pos_ + size) buf_.resize(pos_ + size);
+            memcpy(buf_.data() + pos_, data, size);
+            pos_ += size;
+        }
+
+        void write_u16(uint16_t n) { write_bytes(&n, sizeof(n)); }
+        void write_u32(size_t n) { auto n32 = (uint32_t) n; write_bytes(&n32, sizeof(n32)); }
+
+        size_t write_null_terminated(const std::u16string& str) {
+            align(sizeof(char16_t));
+            auto start = pos_;
+            write_bytes(str.c_str(), (str.size() + 1) * sizeof(char16_t));
+            return start;
+        }
+
+        size_t write_length_prefixed(const std::u16string& str) {
+            align(sizeof(uint32_t));
+            auto start = pos_;
+            write_u32(str.size());
+            write_bytes(str.data(), str.size() * sizeof(char16_t));
+            return start;
+        }
+
+        size_t write_environment(const std::vector<std::pair<std::u16string, EnvVarTemplate>>& env) {
+            align(sizeof(uint32_t));
+            auto start = pos_;
+            write_u32(env.size());
+
+            auto next_header = pos_;
+            auto next_data = next_header + env.size() * 4 * 2;
+            for (auto& [name, value] : env) {
+                seek(next_data);
+                auto name_offset = pos_;
+                write_null_terminated(name);
+                auto value_offset = write_env_value(value);
+                next_data = pos_;
+
+                seek(next_header);
+                write_u32(name_offset);
+                write_u32(value_offset);
+                next_header = pos_;
+            }
+            seek(next_data);
+            return start;
+        }
+
+        size_t write_env_value(const EnvVarTemplate& value) {
+            align(sizeof(uint32_t));
+            auto start = pos_;
+            for (size_t i = 0; i < value.segments.size(); i++) {
+                auto& s = value.segments[i];
+                uint16_t flags = (s.is_env_var_name ? 1 : 0) | (s.new_segment ? 2 : 0)
+                                 | (i == value.segments.size() - 1 ? 4 : 0) | (i == 0 && value.recessive ? 8 : 0);
+                write_u32(s.str.size());
+                write_u16(flags);
+                write_null_terminated(s.str);
+                align(sizeof(uint32_t));
+            }
+            return start;
+        }
+    };
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+// Host-only builder of loaded shim images (the in-memory layout after mapping by the loader, i.e. sections at their
+//  RVAs), used to test and benchmark the shim data lookup (`ShimDataLocator.hpp`) without a Windows machine. The image
+//  has the header layout of the MSVC-built templates, and a `.rsrc` section with the shim data as RCDATA #1, optionally
+//  preceded by copied icons, like in an exported shim. The shim data locator is written the same way as
+//  `write_shim_data_locator` in Pog.Native.
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "ShimDataLocator.hpp"
+
+namespace host {
+    struct ShimImageSpec {
+        std::vector<unsigned char> shim_data;
+        /// Number of `RT_ICON` resources before the shim data in the resource directory.
+        size_t icon_count = 0;
+        bool pe32_plus = true;
+        bool write_locator = true;
+    };
+
+    struct ShimImage {
+        std::vector<unsigned char> image;
+        uint32_t resource_rva;
+        uint32_t resource_size;
+        uint32_t shim_data_rva;
+        /// Offset of the shim data locator in the image.
+        size_t locator_offset;
+    };
+
+    /// Looks up the data of resource `type`/`id` (first language) in a loaded image by walking the resource directory,
+    /// the same way `FindResource` and `LoadResource` do (without their argument checks and locking), as the baseline
+    /// for the locator. Returns nullptr if not found.
+    inline const unsigned char* find_resource_data(const unsigned char* image_base, uint16_t type, uint16_t id,
+                                                   uint32_t* size) {
+        auto read_u16 = [](const unsigned char* p) { return (uint16_t) (p[0] | p[1] << 8); };
+        auto read_u32 = [](const unsigned char* p) {
+            return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+        };
+        auto pe_offset = read_u32(image_base + 0x3c);
+        auto optional_header = image_base + pe_offset + 24;
+        auto directories = optional_header + (read_u16(optional_header) == 0x20b ? 112 : 96);
+        auto rsrc = image_base + read_u32(directories + 2 * 8);
+
+        // binary search of the ID entries of a directory, which follow the named entries
+        auto find_entry = [&](uint32_t directory, uint16_t entry_id) -> const unsigned char* {
+            auto named = read_u16(rsrc + directory + 12);
+            auto entries = rsrc + directory + 16 + 8 * named;
+            size_t lo = 0, hi = read_u16(rsrc + directory + 14);
+            while (lo < hi) {
+                auto mid = (lo + hi) / 2;
+                auto mid_id = read_u32(entries + 8 * mid);
+                if (mid_id == entry_id) return entries + 8 * mid;
+                if (mid_id < entry_id) lo = mid + 1;
+                else hi = mid;
+            }
+            return nullptr;
+        };
+        auto type_entry = find_entry(0, type);
+        if (!type_entry) return nullptr;
+        auto name_entry = find_entry(read_u32(type_entry + 4) & 0x7fff'ffff, id);
+        if (!name_entry) return nullptr;
+        auto language_dir = read_u32(name_entry + 4) & 0x7fff'ffff;
+        if (read_u16(rsrc + language_dir + 12) + read_u16(rsrc + language_dir + 14) == 0) return nullptr;
+        auto data_entry = rsrc + read_u32(rsrc + language_dir + 16 + 4);
+        *size = read_u32(data_entry + 4);
+        return image_base + read_u32(data_entry);
+    }
+
+    class ShimImageBuilder {
+    public:
+        static constexpr uint32_t SIZE_OF_HEADERS = 0x400;
+        static constexpr uint32_t RESOURCE_RVA = 0x3000;
+        static constexpr uint16_t RT_ICON = 3;
+        static constexpr uint16_t RT_RCDATA = 10;
+
+        static void write_u16(std::vector<unsigned char>& out, size_t offset, uint16_t n) {
+            out[offset] = (unsigned char) n;
+            out[offset + 1] = (unsigned char) (n >> 8);
+        }
+
+        static void write_u32(std::vector<unsigned char>& out, size_t offset, uint32_t n) {
+            for (int i = 0; i < 4; i++) out[offset + i] = (unsigned char) (n >> (8 * i));
+        }
+
+        static ShimImage build(const ShimImageSpec& spec) {
+            auto rsrc = build_resource_section(spec);
+            auto shim_data_offset = rsrc.size() - align_up(spec.shim_data.size(), 8);
+
+            std::vector<unsigned char> image(RESOURCE_RVA + align_up(rsrc.size(), 0x1000), 0);
+            write_u16(image, 0, 0x5a4d);
+            write_u32(image, 0x3c, 0xf8);
+            write_u32(image, 0xf8, 0x0000'4550);
+            size_t coff = 0xfc, opt = coff + 20;
+            uint16_t opt_size = spec.pe32_plus ? 240 : 224;
+            // `.text`, `.rdata`, `.data`, `.pdata`, `.rsrc`, `.reloc`; only `.rsrc` is filled in
+            uint16_t section_count = 6;
+            write_u16(image, coff, spec.pe32_plus ? 0x8664 : 0x14c);
+            write_u16(image, coff + 2, section_count);
+            write_u16(image, coff + 16, opt_size);
+            write_u16(image, opt, spec.pe32_plus ? 0x20b : 0x10b);
+            write_u32(image, opt + 56, (uint32_t) image.size());
+            write_u32(image, opt + 60, SIZE_OF_HEADERS);
+            auto directories = opt + (spec.pe32_plus ? 112 : 96);
+            write_u32(image, directories - 4, 16);
+            write_u32(image, directories + 2 * 8, RESOURCE_RVA);
+            write_u32(image, directories + 2 * 8 + 4, (uint32_t) rsrc.size());
+
+            auto rsrc_header = opt + opt_size + 4 * 40;
+            memcpy(&image[rsrc_header], ".rsrc", 5);
+            write_u32(image, rsrc_header + 8, (uint32_t) rsrc.size());
+            write_u32(image, rsrc_header + 12, RESOURCE_RVA);
+            memcpy(&image[RESOURCE_RVA], rsrc.data(), rsrc.size());
+
+            ShimImage out{{}, RESOURCE_RVA, (uint32_t) rsrc.size(), RESOURCE_RVA + (uint32_t) shim_data_offset,
+                          shim_data_locator_offset(0xf8, opt_size, section_count)};
+            if (spec.write_locator) {
+                auto magic = SHIM_DATA_LOCATOR_MAGIC;
+                for (int i = 0; i < 8; i++) image[out.locator_offset + i] = (unsigned char) (magic >> (8 * i));
+                write_u32(image, out.locator_offset + 8, out.shim_data_rva);
+                write_u32(image, out.locator_offset + 12, (uint32_t) spec.shim_data.size());
+            }
+            out.image = std::move(image);
+            return out;
+        }
+
+    private:
+        static size_t align_up(size_t n, size_t alignment) {
+            return (n + alignment - 1) & ~(alignment - 1);
+        }
+
+        /// Resource directory with each resource in its own name and language directory, like the ones written
+        /// by `BeginUpdateResource`; the data follow the directory in the same order, the shim data are last.
+        static std::vector<unsigned char> build_resource_section(const ShimImageSpec& spec) {
+            struct Entry {
+                uint16_t type;
+                uint16_t id;
+                const std::vector<unsigned char>* data;
+            };
+            std::vector<unsigned char> icon(0x2e8, 0x42);
+            std::vector<Entry> entries;
+            for (size_t i = 0; i < spec.icon_count; i++) entries.push_back({RT_ICON, (uint16_t) (i + 1), &icon});
+            entries.push_back({RT_RCDATA, 1, &spec.shim_data});
+
+            std::vector<unsigned char> out;
+            auto alloc = [&](size_t size) {
+                auto offset = out.size();
+                out.resize(offset + size, 0);
+                return offset;
+            };
+            auto directory = [&](size_t entry_count) {
+                auto offset = alloc(16 + 8 * entry_count);
+                write_u16(out, offset + 14, (uint16_t) entry_count);
+                return offset;
+            };
+
+            // root -> type directories -> name directories -> language directories -> data entries
+            auto type_count = spec.icon_count > 0 ? 2 : 1;
+            auto root = directory(type_count);
+            std::vector<size_t> data_entries;
+            size_t entry_index = 0;
+            for (int t = 0; t < type_count; t++) {
+                auto type = entries[entry_index].type;
+                size_t name_count = 0;
+                while (entry_index + name_count < entries.size() && entries[entry_index + name_count].type == type) {
+                    name_count++;
+                }
+                auto type_dir = directory(name_count);
+                write_u32(out, root + 16 + 8 * t, type);
+                write_u32(out, root + 16 + 8 * t + 4, (uint32_t) type_dir | 0x8000'0000);
+                for (size_t n = 0; n < name_count; n++) {
+                    auto language_dir = directory(1);
+                    write_u32(out, type_dir + 16 + 8 * n, entries[entry_index + n].id);
+                    write_u32(out, type_dir + 16 + 8 * n + 4, (uint32_t) language_dir | 0x8000'0000);
+                    auto data_entry = alloc(16);
+                    write_u32(out, language_dir + 16, 1033);
+                    write_u32(out, language_dir + 16 + 4, (uint32_t) data_entry);
+                    data_entries.push_back(data_entry);
+                }
+                entry_index += name_count;
+            }
+
+            for (size_t i = 0; i < entries.size(); i++) {
+                auto& data = *entries[i].data;
+                out.resize(align_up(out.size(), 8), 0);
+                auto offset = alloc(align_up(data.size(), 8));
+                memcpy(&out[offset], data.data(), data.size());
+                write_u32(out, data_entries[i], RESOURCE_RVA + (uint32_t) offset);
+                write_u32(out, data_entries[i] + 4, (uint32_t) data.size());
+            }
+            return out;
+        }
+    };
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+// Minimal microbenchmark harness for the host build. We intentionally don't depend on Google Benchmark or similar,
+//  so that the benchmarks build anywhere CMake and a C++20 compiler are available.
+//
+// Each benchmark is run in several repetitions of `iterations` calls, and the fastest repetition is reported,
+//  which is the most stable metric for short, CPU-bound operations like the ones in the shim.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace bench {
+    /// Prevents the compiler from optimizing away the computation of `value`.
+    template<typename T>
+    inline void do_not_optimize(T const& value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    struct Options {
+        size_t iterations = 100'000;
+        size_t repetitions = 5;
+        bool csv = false;
+        const char* filter = nullptr;
+
+        static Options parse(int argc, char** argv) {
+            Options o;
+            for (int i = 1; i < argc; i++) {
+                if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+                    o.iterations = strtoull(argv[++i], nullptr, 10);
+                } else if (!strcmp(argv[i], "--repetitions") && i + 1 < argc) {
+                    o.repetitions = strtoull(argv[++i], nullptr, 10);
+                } else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+                    o.filter = argv[++i];
+                } else if (!strcmp(argv[i], "--csv")) {
+                    o.csv = true;
+                } else {
+                    fprintf(stderr, "usage: %s [--iterations N] [--repetitions N] [--filter SUBSTR] [--csv]\n", argv[0]);
+                    exit(2);
+                }
+            }
+            return o;
+        }
+    };
+
+    class Runner {
+    private:
+        Options options_;
+
+    public:
+        explicit Runner(Options options) : options_(options) {
+            if (options_.csv) {
+                printf("benchmark,ns_per_op,iterations,gb_per_s\n");
+            } else {
+                printf("%-48s %12s %12s %10s\n", "benchmark", "ns/op", "iterations", "GB/s");
+            }
+        }
+
+        [[nodiscard]] const Options& options() const {
+            return options_;
+        }
+
+        /// Runs `fn` `options.iterations` times per repetition, `scale` is the number of operations per call of `fn`.
+        void run(const std::string& name, auto&& fn, size_t scale = 1) {
+            if (skip(name)) return;
+            auto best_ns = measure(fn, options_.iterations, scale);
+            report(name, best_ns, options_.iterations * scale, 0);
+        }
+
+        /// Runs a benchmark where each call of `fn` performs `ops_per_call` operations (e.g. a scan of a whole table),
+        /// and reports the time per operation. `options.iterations` is the number of operations per repetition
+        /// (at least one call of `fn`).
+        void run_batch(const std::string& name, auto&& fn, size_t ops_per_call) {
+            if (skip(name)) return;
+            auto calls = std::max<size_t>(1, options_.iterations / ops_per_call);
+            auto best_ns = measure(fn, calls, ops_per_call);
+            report(name, best_ns, calls * ops_per_call, 0);
+        }
+
+        /// Runs a benchmark that processes `bytes_per_call` bytes in each call of `fn` and reports its throughput.
+        /// `options.iterations` is the number of 4 KiB blocks processed per repetition (at least one call of `fn`),
+        /// so that the run time does not grow with the buffer size.
+        void run_throughput(const std::string& name, auto&& fn, size_t bytes_per_call) {
+            if (skip(name)) return;
+            auto calls = std::max<size_t>(1, options_.iterations * 4096 / bytes_per_call);
+            auto best_ns = measure(fn, calls, 1);
+            report(name, best_ns, calls, (double) bytes_per_call / best_ns);
+        }
+
+    private:
+        [[nodiscard]] bool skip(const std::string& name) const {
+            return options_.filter && name.find(options_.filter) == std::string::npos;
+        }
+
+        /// Returns the time per operation of the fastest repetition, in nanoseconds.
+        double measure(auto&& fn, size_t iterations, size_t scale) {
+            // warm up caches and branch predictors
+            for (size_t i = 0; i < std::min<size_t>(iterations, 1000); i++) fn();
+
+            double best_ns = 1e300;
+            for (size_t r = 0; r < options_.repetitions; r++) {
+                auto start = std::chrono::steady_clock::now();
+                for (size_t i = 0; i < iterations; i++) fn();
+                auto end = std::chrono::steady_clock::now();
+                auto ns = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+                best_ns = std::min(best_ns, ns / (double) (iterations * scale));
+            }
+            return best_ns;
+        }
+
+        /// `gb_per_s` is 0 for benchmarks without a throughput (bytes per nanosecond is GB/s).
+        void report(const std::string& name, double ns_per_op, size_t iterations, double gb_per_s) {
+            if (options_.csv) {
+                if (gb_per_s > 0) printf("%s,%.2f,%zu,%.3f\n", name.c_str(), ns_per_op, iterations, gb_per_s);
+                else printf("%s,%.2f,%zu,\n", name.c_str(), ns_per_op, iterations);
+            } else {
+                if (gb_per_s > 0) printf("%-48s %12.2f %12zu %10.3f\n", name.c_str(), ns_per_op, iterations, gb_per_s);
+                else printf("%-48s %12.2f %12zu %10s\n", name.c_str(), ns_per_op, iterations, "");
+            }
+            fflush(stdout);
+        }
+    };
+}
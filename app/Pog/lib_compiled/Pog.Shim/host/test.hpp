@@ -0,0 +1,76 @@
+#pragma once
+
+// Minimal unit test harness for the host build, registered with CTest. Tests are defined using `TEST(name) {...}`,
+//  and failed `CHECK`s are reported but do not abort the test, so that a single run shows all failures.
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace test {
+    struct TestCase {
+        const char* name;
+        std::function<void()> fn;
+    };
+
+    inline std::vector<TestCase>& registry() {
+        static std::vector<TestCase> tests;
+        return tests;
+    }
+
+    inline int& failure_count() {
+        static int count = 0;
+        return count;
+    }
+
+    struct Registrar {
+        Registrar(const char* name, std::function<void()> fn) {
+            registry().push_back({name, std::move(fn)});
+        }
+    };
+
+    inline void fail(const char* file, int line, const char* expr) {
+        fprintf(stderr, "  %s:%d: CHECK failed: %s\n", file, line, expr);
+        failure_count()++;
+    }
+
+    inline std::string narrow(std::u16string_view str) {
+        std::string out;
+        for (auto c : str) out.push_back(c < 0x80 ? (char) c : '?');
+        return out;
+    }
+
+    /// Runs all registered tests, or only the ones whose name contains `argv[1]`.
+    inline int run_all(int argc, char** argv) {
+        int failed_tests = 0;
+        for (auto& t : registry()) {
+            if (argc > 1 && std::string(t.name).find(argv[1]) == std::string::npos) continue;
+            auto before = failure_count();
+            t.fn();
+            auto ok = failure_count() == before;
+            printf("[%s] %s\n", ok ? " OK " : "FAIL", t.name);
+            if (!ok) failed_tests++;
+        }
+        printf("%d test(s) failed\n", failed_tests);
+        return failed_tests == 0 ? 0 : 1;
+    }
+}
+
+#define TEST_CONCAT_(a, b) a##b
+#define TEST_CONCAT(a, b) TEST_CONCAT_(a, b)
+#define TEST(name) \
+    static void TEST_CONCAT(test_fn_, name)(); \
+    static test::Registrar TEST_CONCAT(test_reg_, name){#name, TEST_CONCAT(test_fn_, name)}; \
+    static void TEST_CONCAT(test_fn_, name)()
+
+#define CHECK(expr) do { if (!(expr)) test::fail(__FILE__, __LINE__, #expr); } while (0)
+#define CHECK_EQ_STR(actual, expected) do { \
+        std::u16string a_{actual}, e_{expected}; \
+        if (a_ != e_) { \
+            test::fail(__FILE__, __LINE__, #actual " == " #expected); \
+            fprintf(stderr, "    actual:   '%s'\n    expected: '%s'\n", test::narrow(a_).c_str(), test::narrow(e_).c_str()); \
+        } \
+    } while (0)
+
+#define TEST_MAIN() int main(int argc, char** argv) { return test::run_all(argc, argv); }
@@ -1,18 +1,31 @@
 #pragma once
 
+#include "stdlib.hpp"
+
 template<typename T>
 class Buffer {
     T* buffer_;
     size_t size_;
 
 public:
-    explicit Buffer(size_t size) : buffer_(new T[size]), size_(size) {}
+    explicit Buffer(size_t size) : buffer_(size ? new T[size] : nullptr), size_(size) {}
 
     Buffer(Buffer&& s) noexcept: buffer_(s.buffer_), size_(s.size_) {
         s.buffer_ = nullptr;
         s.size_ = 0;
     }
 
+    Buffer& operator=(Buffer&& s) noexcept {
+        if (this != &s) {
+            delete[] buffer_;
+            buffer_ = s.buffer_;
+            size_ = s.size_;
+            s.buffer_ = nullptr;
+            s.size_ = 0;
+        }
+        return *this;
+    }
+
     ~Buffer() {
         delete[] buffer_;
     }
@@ -41,10 +54,15 @@ public:
         return size_ * sizeof(T);
     }
 
-    bool append(T elem) {
-
+    /// Reallocates the buffer to `new_size` elements, preserving the existing contents (up to `new_size`).
+    void resize(size_t new_size) {
+        auto new_buffer = new T[new_size];
+        copy(buffer_, buffer_ + (size_ < new_size ? size_ : new_size), new_buffer);
+        delete[] buffer_;
+        buffer_ = new_buffer;
+        size_ = new_size;
     }
 };
 
 using CString = Buffer<char>;
-using CWString = Buffer<wchar_t>;
+using CWString = Buffer<wchar>;
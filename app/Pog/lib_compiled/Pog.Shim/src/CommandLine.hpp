@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cassert>
+#include "stdlib.hpp"
+#include "Buffer.hpp"
+#include "ShimData.hpp"
+
+inline const wchar* find_argv0_end(const wchar* cmd_line) {
+    // https://learn.microsoft.com/en-us/cpp/c-language/parsing-c-command-line-arguments?view=msvc-170
+    // The first argument (argv[0]) is treated specially. It represents the program name. Because it
+    // must be a valid pathname, parts surrounded by double quote marks (") are allowed. The double
+    // quote marks aren't included in the argv[0] output. The parts surrounded by double quote marks
+    // prevent interpretation of a space or tab character as the end of the argument.
+
+    // CommandLineToArgvW treats whitespace outside of quotation marks as argument delimiters.
+    // However, if lpCmdLine starts with any amount of whitespace, CommandLineToArgvW will consider
+    // the first argument to be an empty string. Excess whitespace at the end of lpCmdLine is ignored.
+
+    // find the end of argv[0]
+    auto inside_quotes = false;
+    auto it = cmd_line;
+    for (; *it != 0; it++) {
+        if (*it == '"') {
+            inside_quotes = !inside_quotes;
+            continue;
+        }
+        if (!inside_quotes && (*it == ' ' || *it == '\t')) {
+            // found the end
+            break;
+        }
+    }
+    return it;
+}
+
+/// Builds the command line for the target from the original command line of the shim `const_cmd_line`.
+/// If `target_override` is set, argv[0] is replaced with it, and if `prefixed_args` are set, they are inserted
+/// between argv[0] and the original arguments.
+inline CWString build_command_line(const wchar* const_cmd_line, optional<wstring_view> prefixed_args,
+                                   const wchar* target_override = nullptr) {
+    auto* const_argv0_end = find_argv0_end(const_cmd_line);
+    auto argv0_len = target_override ? wstr_size(target_override) : const_argv0_end - const_cmd_line;
+    auto args_len = wstr_size(const_argv0_end);
+
+    // allocate the cmd_line buffer
+    CWString cmd_line{argv0_len + (target_override ? 2 : 0) // +2 for quotes around `target_override`
+                      + (prefixed_args ? 1 + prefixed_args->size() : 0) + args_len + 1};
+
+    // build the command line
+    auto it_out = cmd_line.data();
+
+    // copy argv[0], or insert target_override
+    if (target_override) {
+        // quote `target_override`, in case it contains spaces; when .cmd files are invoked, cmd.exe looks at argv[0],
+        //  not on the lpApplicationName value, and spaces would throw it off without quotes
+        *it_out++ = '"';
+        it_out = copy(target_override, target_override + argv0_len, it_out);
+        *it_out++ = '"';
+    } else {
+        it_out = copy(const_cmd_line, const_argv0_end, it_out);
+    }
+
+    if (prefixed_args) {
+        // add space
+        *it_out++ = ' ';
+        // copy prefixed_args
+        it_out = copy(prefixed_args->begin(), prefixed_args->end(), it_out);
+    }
+    // copy remaining args, they're already prefixed with a whitespace and suffixed with null
+    it_out = copy(const_argv0_end, const_argv0_end + args_len + 1, it_out);
+
+    assert(cmd_line.data() + cmd_line.size() == it_out);
+    return cmd_line;
+}
+
+/// Builds the command line for the target from a precomputed `prefix` (shim data v5+). If `keep_argv0` is set,
+/// the prefix is inserted after the original argv[0], otherwise it replaces it. Unlike `build_command_line`,
+/// this is a single scan of the original command line and a single copy of each part.
+inline CWString build_command_line(const wchar* const_cmd_line, wstring_view prefix, bool keep_argv0) {
+    auto* const_argv0_end = find_argv0_end(const_cmd_line);
+    auto* const_args_end = const_argv0_end + wstr_size(const_argv0_end) + 1; // include the null terminator
+    auto* copy_start = keep_argv0 ? const_cmd_line : const_argv0_end;
+
+    CWString cmd_line{(size_t) (const_args_end - copy_start) + prefix.size()};
+    auto it_out = cmd_line.data();
+    if (keep_argv0) {
+        it_out = copy(const_cmd_line, const_argv0_end, it_out);
+    }
+    it_out = copy(prefix.begin(), prefix.end(), it_out);
+    it_out = copy(const_argv0_end, const_args_end, it_out);
+
+    assert(cmd_line.data() + cmd_line.size() == it_out);
+    return cmd_line;
+}
+
+/// Builds the command line for the target of the shim described by `shim_data` from the original command line.
+inline CWString build_target_command_line(const ShimData& shim_data, const wchar* const_cmd_line) {
+    auto replace_argv0 = HAS_FLAG(shim_data.flags(), REPLACE_ARGV0) || HAS_FLAG(shim_data.flags(), NULL_TARGET);
+    if (auto prefix = shim_data.get_command_line_prefix()) {
+        return build_command_line(const_cmd_line, *prefix, !replace_argv0);
+    }
+    // v4 shim data, assemble the command line from the parts
+    return build_command_line(const_cmd_line, shim_data.get_arguments(), replace_argv0 ? shim_data.get_target() : nullptr);
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <cstddef>
+#include "stdlib.hpp"
+#include "util.hpp"
+#include "Buffer.hpp"
+
+/// Compares environment variable names the way Windows orders them in an environment block (case-insensitive,
+/// by code unit, without regard to locale). Only ASCII letters are folded, which matches Windows for all names
+/// we are likely to encounter.
+inline int compare_env_var_names(const wchar* a, size_t a_size, const wchar* b, size_t b_size) {
+    auto size = a_size < b_size ? a_size : b_size;
+    for (size_t i = 0; i < size; i++) {
+        auto ca = a[i] >= 'a' && a[i] <= 'z' ? a[i] - ('a' - 'A') : a[i];
+        auto cb = b[i] >= 'a' && b[i] <= 'z' ? b[i] - ('a' - 'A') : b[i];
+        if (ca != cb) return ca < cb ? -1 : 1;
+    }
+    return a_size == b_size ? 0 : (a_size < b_size ? -1 : 1);
+}
+
+/// Builds the complete environment block for a child process in a single pass, instead of modifying the environment
+/// of the current process one variable at a time (each `SetEnvironmentVariable` call rewrites the whole block).
+///
+/// The inherited block (`GetEnvironmentStrings`, "NAME=VALUE\0...\0\0") is indexed once, then the overrides are
+/// collected with `set()` and merged with the inherited variables by `build()`, producing a block sorted by name,
+/// as required by `CreateProcess`. While the overrides are collected, `read_env_var()` sees the variables as if
+/// the overrides were already applied, so that values may reference previously set variables, same as when setting
+/// the variables on the current process.
+///
+/// The inherited block must outlive the builder.
+class EnvironmentBlockBuilder {
+private:
+    struct Entry {
+        const wchar* name;
+        size_t name_size;
+        /// Value for inherited entries, offset into `values_` for overrides.
+        const wchar* value;
+        size_t value_offset;
+        size_t value_size;
+    };
+
+    // typical environment blocks have ~50-100 variables
+    static constexpr size_t INITIAL_INHERITED_CAPACITY = 128;
+
+    Buffer<Entry> inherited_;
+    size_t inherited_count_ = 0;
+    Buffer<Entry> overrides_;
+    size_t override_count_ = 0;
+    /// Arena of override values, the interpolated values passed to `set` are only valid during the call.
+    CWString values_{0};
+    size_t values_size_ = 0;
+
+public:
+    /// `max_overrides` is the number of `set()` calls that will be made (the number of variables in the shim data).
+    EnvironmentBlockBuilder(const wchar* inherited_block, size_t max_overrides)
+            : inherited_{INITIAL_INHERITED_CAPACITY}, overrides_{max_overrides} {
+        // a single pass over the block, finding both the name separator and the end of each entry
+        for (auto it = inherited_block; *it != 0;) {
+            // hidden variables like `=C:` start with `=`, so the first character is never treated as the separator
+            auto name_end = it + 1;
+            while (*name_end != 0 && *name_end != '=') name_end++;
+            auto entry_end = name_end;
+            while (*entry_end != 0) entry_end++;
+
+            // skip malformed entries without a value
+            if (*name_end == '=') {
+                if (inherited_count_ == inherited_.size()) {
+                    inherited_.resize(inherited_.size() * 2);
+                }
+                inherited_.data()[inherited_count_++] = {
+                    .name = it, .name_size = (size_t) (name_end - it), .value = name_end + 1,
+                    .value_offset = 0, .value_size = (size_t) (entry_end - name_end - 1),
+                };
+            }
+            it = entry_end + 1;
+        }
+
+        // Windows keeps the block sorted, so this is normally a single linear pass
+        if (!is_sorted(inherited_.data(), inherited_count_)) {
+            sort(inherited_.data(), inherited_count_);
+        }
+    }
+
+    /// Same contract as `os::read_env_var`, but reads from the inherited block with all overrides applied.
+    size_t read_env_var(const wchar* name, wchar* buffer, size_t buffer_size) const {
+        auto name_size = wstr_size(name);
+        const wchar* value;
+        size_t value_size;
+
+        if (auto* o = find(overrides_.data(), override_count_, name, name_size, false)) {
+            value = values_.data() + o->value_offset;
+            value_size = o->value_size;
+        } else if (auto* e = find(inherited_.data(), inherited_count_, name, name_size, true)) {
+            value = e->value;
+            value_size = e->value_size;
+        } else {
+            return os::ENV_VAR_NOT_FOUND;
+        }
+
+        if (value_size < buffer_size) {
+            copy(value, value + value_size, buffer);
+            buffer[value_size] = 0;
+        }
+        return value_size;
+    }
+
+    /// Sets the variable `name` in the resulting block, the name must stay valid until `build()` is called.
+    void set(const wchar* name, const wchar* value) {
+        auto name_size = wstr_size(name);
+        auto value_size = wstr_size(value);
+
+        if (values_.size() < values_size_ + value_size) {
+            auto new_size = values_.size() * 2 > 1024 ? values_.size() * 2 : 1024;
+            values_.resize(new_size > values_size_ + value_size ? new_size : values_size_ + value_size);
+        }
+        copy(value, value + value_size, values_.data() + values_size_);
+
+        // `find` is const, but the entry lives in our own mutable buffer
+        auto* entry = (Entry*) find(overrides_.data(), override_count_, name, name_size, false);
+        if (!entry) {
+            if (override_count_ == overrides_.size()) {
+                panic(L"Too many environment variable overrides.");
+            }
+            entry = &overrides_.data()[override_count_++];
+        }
+        *entry = {.name = name, .name_size = name_size, .value = nullptr,
+                  .value_offset = values_size_, .value_size = value_size};
+        values_size_ += value_size;
+    }
+
+    /// Merges the inherited variables with the overrides into a new environment block.
+    [[nodiscard]] CWString build() {
+        sort(overrides_.data(), override_count_);
+
+        // first pass computes the size, second pass writes the block
+        size_t block_size = 0;
+        merge([&](const Entry& e, const wchar*) { block_size += e.name_size + 1 + e.value_size + 1; });
+        // the block is terminated by an extra null; an empty block still needs two nulls
+        block_size = block_size == 0 ? 2 : block_size + 1;
+
+        CWString block{block_size};
+        auto out = block.data();
+        merge([&](const Entry& e, const wchar* value) {
+            out = copy(e.name, e.name + e.name_size, out);
+            *out++ = '=';
+            out = copy(value, value + e.value_size, out);
+            *out++ = 0;
+        });
+        while (out != block.data() + block.size()) *out++ = 0;
+        return block;
+    }
+
+private:
+    /// Calls `cb(entry, value)` for each variable of the resulting block, in sorted order.
+    void merge(auto&& cb) const {
+        auto in = inherited_.data(), in_end = inherited_.data() + inherited_count_;
+        auto ov = overrides_.data(), ov_end = overrides_.data() + override_count_;
+        while (in != in_end || ov != ov_end) {
+            auto cmp = in == in_end ? 1 : ov == ov_end ? -1
+                                                       : compare_env_var_names(in->name, in->name_size, ov->name, ov->name_size);
+            if (cmp < 0) {
+                cb(*in, in->value);
+                in++;
+            } else {
+                cb(*ov, values_.data() + ov->value_offset);
+                ov++;
+                // overridden inherited variable, skip it
+                if (cmp == 0) in++;
+            }
+        }
+    }
+
+    static const Entry* find(const Entry* entries, size_t count, const wchar* name, size_t name_size, bool sorted) {
+        if (!sorted) {
+            for (size_t i = 0; i < count; i++) {
+                if (compare_env_var_names(entries[i].name, entries[i].name_size, name, name_size) == 0) {
+                    return &entries[i];
+                }
+            }
+            return nullptr;
+        }
+
+        size_t lo = 0, hi = count;
+        while (lo < hi) {
+            auto mid = lo + (hi - lo) / 2;
+            auto cmp = compare_env_var_names(entries[mid].name, entries[mid].name_size, name, name_size);
+            if (cmp == 0) return &entries[mid];
+            if (cmp < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return nullptr;
+    }
+
+    static bool less(const Entry& a, const Entry& b) {
+        return compare_env_var_names(a.name, a.name_size, b.name, b.name_size) < 0;
+    }
+
+    static bool is_sorted(const Entry* entries, size_t count) {
+        for (size_t i = 1; i < count; i++) {
+            if (less(entries[i], entries[i - 1])) return false;
+        }
+        return true;
+    }
+
+    /// Stable insertion sort; overrides are few, and the inherited block is almost always already sorted.
+    static void sort(Entry* entries, size_t count) {
+        for (size_t i = 1; i < count; i++) {
+            auto e = entries[i];
+            auto j = i;
+            for (; j > 0 && less(e, entries[j - 1]); j--) {
+                entries[j] = entries[j - 1];
+            }
+            entries[j] = e;
+        }
+    }
+};
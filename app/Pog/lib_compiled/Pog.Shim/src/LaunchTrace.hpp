@@ -0,0 +1,300 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "stdlib.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Opt-in tracing of the shim launch phases. When the `POG_SHIM_TRACE` environment variable is set to a file path,
+//  the shim timestamps each launch phase (`LaunchPhase`) with the cycle counter, and when it's done, appends a single
+//  fixed-size record to a ring buffer in that file, which is memory-mapped and shared by all shims (and their children,
+//  which inherit the variable). `tools/pog_shim_trace.cpp` reads the buffer and prints latency histograms per command.
+//  Tracing must never break a launch, so if the file cannot be opened or has an unexpected layout, it's disabled.
+//
+// All values are little-endian, the file consists of:
+//  - Header (`LaunchTraceHeader`), created by the first shim which finds an empty file
+//  - `capacity` records (`LaunchTraceRecord`)
+//
+// Writers claim a slot by incrementing `write_index`, and the record for slot `n` is stored at index `n % capacity`.
+//  Each record is protected by a sequence lock: the writer sets `sequence` to `2n + 1` while it writes the record,
+//  and to `2n + 2` when it's done; readers copy the record and only accept it if `sequence` was `2n + 2` both before
+//  and after the copy. A record is written at the end of the launch in one go, so a writer holds the slot for
+//  a few hundred cycles; a slot is only reused after `capacity` other launches, so two writers never race for
+//  the same slot in practice.
+//
+// The cycle counter frequency is not known, so each record also stores the reference clock (`QueryPerformanceCounter`
+//  on Windows) at the start and at the end of the launch, and the reader calibrates the cycle counter from the sum
+//  of those spans.
+
+constexpr uint32_t LAUNCH_TRACE_MAGIC = 0x544c'4750; // "PGLT"
+constexpr uint16_t LAUNCH_TRACE_VERSION = 1;
+constexpr uint32_t LAUNCH_TRACE_CAPACITY = 4096;
+/// Maximum length of the stored command name, longer names are truncated.
+constexpr size_t LAUNCH_TRACE_NAME_SIZE = 20;
+
+/// Launch phases in the order in which they are reached; the duration of a phase is the time since the previous one.
+enum class LaunchPhase : uint8_t {
+    /// Entry point of the shim (right after the trace file was mapped).
+    START = 0,
+    /// The shim data were found and validated.
+    SHIM_DATA_LOADED,
+    /// The command line of the target was built.
+    COMMAND_LINE_BUILT,
+    /// The environment variables were interpolated (the environment block was built).
+    ENVIRONMENT_BUILT,
+    /// `CreateProcess` returned.
+    PROCESS_CREATED,
+    /// The target exited (not reached for detached targets).
+    CHILD_EXITED,
+    COUNT,
+};
+constexpr size_t LAUNCH_PHASE_COUNT = (size_t) LaunchPhase::COUNT;
+
+struct LaunchTraceHeader {
+    /// `LAUNCH_TRACE_MAGIC`
+    uint32_t magic;
+    uint16_t version;
+    /// `sizeof(LaunchTraceRecord)`
+    uint16_t record_size;
+    /// Number of records, a power of 2.
+    uint32_t capacity;
+    /// 0 for a new file, 1 while the header is being initialized, 2 once it's ready.
+    uint32_t state;
+    /// Ticks per second of the reference clock.
+    uint64_t reference_frequency;
+    /// Number of claimed slots.
+    uint64_t write_index;
+    uint64_t reserved[4];
+};
+static_assert(sizeof(LaunchTraceHeader) == 64);
+
+struct LaunchTraceRecord {
+    /// Sequence lock of the record, see above; 0 if the record was never written.
+    uint64_t sequence;
+    uint32_t process_id;
+    /// Bit `i` is set if `LaunchPhase` `i` was reached.
+    uint8_t phase_mask;
+    uint8_t reserved;
+    /// Length of `name` in wchars.
+    uint16_t name_size;
+    /// Reference clock read right before `LaunchPhase::START`, and right after the last reached phase.
+    uint64_t reference_start;
+    uint64_t reference_end;
+    /// Cycle counter at each reached phase.
+    uint64_t cycles[LAUNCH_PHASE_COUNT];
+    /// Cycle counter read right before `reference_end`.
+    uint64_t cycles_end;
+    /// File name of the shim (the command name), not null-terminated.
+    wchar name[LAUNCH_TRACE_NAME_SIZE];
+};
+static_assert(sizeof(LaunchTraceRecord) == 128);
+
+constexpr size_t LAUNCH_TRACE_FILE_SIZE = sizeof(LaunchTraceHeader) + LAUNCH_TRACE_CAPACITY * sizeof(LaunchTraceRecord);
+
+// the buffer is shared between processes, so all synchronization is done with lock-free atomics on plain fields;
+//  the shim does not link the C++ runtime, so we use the compiler intrinsics instead of `std::atomic_ref`
+namespace launch_trace_detail {
+#ifdef _MSC_VER
+    // the shim is only built for x64, where `_ReadWriteBarrier` (a compiler barrier) is enough for acquire/release
+    //  ordering, since the CPU does not reorder loads with loads and stores with stores
+    inline void fence() {
+        _ReadWriteBarrier();
+    }
+
+    inline uint64_t load(const uint64_t* p) {
+        auto value = *(const volatile uint64_t*) p;
+        fence();
+        return value;
+    }
+
+    inline uint32_t load(const uint32_t* p) {
+        auto value = *(const volatile uint32_t*) p;
+        fence();
+        return value;
+    }
+
+    inline void store(uint64_t* p, uint64_t value) {
+        fence();
+        *(volatile uint64_t*) p = value;
+    }
+
+    inline void store(uint32_t* p, uint32_t value) {
+        fence();
+        *(volatile uint32_t*) p = value;
+    }
+
+    inline uint64_t fetch_add(uint64_t* p, uint64_t value) {
+        return (uint64_t) _InterlockedExchangeAdd64((volatile long long*) p, (long long) value);
+    }
+
+    inline bool compare_exchange(uint32_t* p, uint32_t expected, uint32_t desired) {
+        return (uint32_t) _InterlockedCompareExchange((volatile long*) p, (long) desired, (long) expected) == expected;
+    }
+#else
+    inline void fence() {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    template<typename T>
+    inline T load(const T* p) {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+
+    template<typename T>
+    inline void store(T* p, T value) {
+        __atomic_store_n(p, value, __ATOMIC_RELEASE);
+    }
+
+    inline uint64_t fetch_add(uint64_t* p, uint64_t value) {
+        return __atomic_fetch_add(p, value, __ATOMIC_ACQ_REL);
+    }
+
+    inline bool compare_exchange(uint32_t* p, uint32_t expected, uint32_t desired) {
+        return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+#endif
+}
+
+/// Ring buffer of launch records in a mapped view of the trace file.
+class LaunchTraceBuffer {
+private:
+    static constexpr uint32_t STATE_INITIALIZING = 1;
+    static constexpr uint32_t STATE_READY = 2;
+
+    LaunchTraceHeader* header_;
+    LaunchTraceRecord* records_;
+
+    explicit LaunchTraceBuffer(byte* view) : header_{(LaunchTraceHeader*) view},
+                                             records_{(LaunchTraceRecord*) (view + sizeof(LaunchTraceHeader))} {}
+
+    [[nodiscard]] bool has_valid_layout() const {
+        return header_->magic == LAUNCH_TRACE_MAGIC && header_->version == LAUNCH_TRACE_VERSION
+               && header_->record_size == sizeof(LaunchTraceRecord) && header_->capacity == LAUNCH_TRACE_CAPACITY;
+    }
+
+public:
+    /// Attaches to the buffer in `view` (a writable mapping of the whole trace file, 8-byte aligned); if the file
+    /// is new (all zeros), the header is initialized. Returns `nullopt` if the file has a different layout, or if
+    /// another process is just initializing it, in which case this launch is not traced.
+    static optional<LaunchTraceBuffer> attach(byte* view, size_t size, uint64_t reference_frequency) {
+        using namespace launch_trace_detail;
+        if (size != LAUNCH_TRACE_FILE_SIZE) return nullopt;
+        LaunchTraceBuffer buffer{view};
+        auto header = buffer.header_;
+        if (load(&header->state) != STATE_READY) {
+            if (!compare_exchange(&header->state, 0, STATE_INITIALIZING)) return nullopt;
+            header->magic = LAUNCH_TRACE_MAGIC;
+            header->version = LAUNCH_TRACE_VERSION;
+            header->record_size = sizeof(LaunchTraceRecord);
+            header->capacity = LAUNCH_TRACE_CAPACITY;
+            header->reference_frequency = reference_frequency;
+            store(&header->state, STATE_READY);
+        }
+        if (!buffer.has_valid_layout()) return nullopt;
+        return buffer;
+    }
+
+    /// Opens the buffer in `view` (a mapping of the whole trace file) for reading. Returns `nullopt` if the file
+    /// is not an initialized trace file.
+    static optional<LaunchTraceBuffer> open(const byte* view, size_t size) {
+        if (size != LAUNCH_TRACE_FILE_SIZE) return nullopt;
+        // the reader never writes through the view
+        LaunchTraceBuffer buffer{const_cast<byte*>(view)};
+        if (launch_trace_detail::load(&buffer.header_->state) != STATE_READY) return nullopt;
+        if (!buffer.has_valid_layout()) return nullopt;
+        return buffer;
+    }
+
+    [[nodiscard]] uint64_t reference_frequency() const {
+        return header_->reference_frequency;
+    }
+
+    /// Number of records appended so far, including the overwritten ones.
+    [[nodiscard]] uint64_t write_index() const {
+        return launch_trace_detail::load(&header_->write_index);
+    }
+
+    /// Appends a copy of `record` (its `sequence` is ignored).
+    void append(const LaunchTraceRecord& record) {
+        using namespace launch_trace_detail;
+        auto slot = fetch_add(&header_->write_index, 1);
+        auto& target = records_[slot % LAUNCH_TRACE_CAPACITY];
+        store(&target.sequence, 2 * slot + 1);
+        fence();
+        // the fields are copied one by one, copying the whole struct could emit a `memcpy` call, which the shim
+        //  does not have
+        target.process_id = record.process_id;
+        target.phase_mask = record.phase_mask;
+        target.reserved = 0;
+        target.name_size = record.name_size;
+        target.reference_start = record.reference_start;
+        target.reference_end = record.reference_end;
+        target.cycles_end = record.cycles_end;
+        copy(record.cycles, record.cycles + LAUNCH_PHASE_COUNT, target.cycles);
+        copy(record.name, record.name + LAUNCH_TRACE_NAME_SIZE, target.name);
+        store(&target.sequence, 2 * slot + 2);
+    }
+
+    /// Calls `callback(const LaunchTraceRecord&)` for each complete record which is still in the buffer, from the
+    /// oldest one. Records which are being written (or were abandoned by a killed writer) are skipped, and so are
+    /// records overwritten during the read.
+    template<typename Callback>
+    void read(Callback callback) const {
+        using namespace launch_trace_detail;
+        auto end = write_index();
+        auto start = end > LAUNCH_TRACE_CAPACITY ? end - LAUNCH_TRACE_CAPACITY : 0;
+        for (auto slot = start; slot < end; slot++) {
+            auto& source = records_[slot % LAUNCH_TRACE_CAPACITY];
+            auto expected = 2 * slot + 2;
+            if (load(&source.sequence) != expected) continue;
+            LaunchTraceRecord record = source;
+            fence();
+            if (load(&source.sequence) != expected) continue;
+            callback(record);
+        }
+    }
+};
+
+/// Collects the phase timestamps of a single launch; `read_cycles` and `read_reference` are the clocks (see
+/// `os::read_cycle_counter` and `os::read_reference_clock`). Marking a phase costs a single cycle counter read,
+/// and nothing at all when the tracer is disabled.
+template<uint64_t (*ReadCycles)(), uint64_t (*ReadReference)()>
+class LaunchTracer {
+private:
+    LaunchTraceRecord record_{};
+    bool enabled_ = false;
+
+public:
+    /// Starts the trace, reading the clocks for `LaunchPhase::START`.
+    void start() {
+        enabled_ = true;
+        record_.reference_start = ReadReference();
+        mark(LaunchPhase::START);
+    }
+
+    [[nodiscard]] bool enabled() const {
+        return enabled_;
+    }
+
+    void mark(LaunchPhase phase) {
+        if (!enabled_) return;
+        record_.cycles[(size_t) phase] = ReadCycles();
+        record_.phase_mask |= (uint8_t) (1u << (size_t) phase);
+    }
+
+    /// Appends the record of this launch to `buffer`. `name` is the command name, it's truncated if too long.
+    void commit(LaunchTraceBuffer& buffer, uint32_t process_id, wstring_view name) {
+        if (!enabled_) return;
+        // both clocks are read together, so that they span the same interval
+        record_.cycles_end = ReadCycles();
+        record_.reference_end = ReadReference();
+        record_.process_id = process_id;
+        record_.name_size = (uint16_t) (name.size() < LAUNCH_TRACE_NAME_SIZE ? name.size() : LAUNCH_TRACE_NAME_SIZE);
+        copy(name.begin(), name.begin() + record_.name_size, record_.name);
+        buffer.append(record_);
+        enabled_ = false;
+    }
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "stdlib.hpp"
+#include "ShimData.hpp"
+
+// Index of exported commands for the multicall mode of the shim. Instead of a separate copy of the shim with its own
+//  shim data for each exported command, all commands are hardlinks to a single dispatcher binary, and the shim data
+//  of all commands are stored in a single index file next to them. The dispatcher memory-maps the index and looks up
+//  its own file name in it, so only a single copy of the shim (and of the index) is stored on disk and in the page cache.
+//
+// The index is a hash table with linear probing, keyed by the command file name (e.g. `code.exe`, case-insensitive).
+// All values are little-endian, all offsets are relative to the start of the index:
+//  - Header (`MulticallIndexHeader`)
+//  - Bucket array, `bucket_count` (a power of 2) uint32 entry offsets, 0 for an empty bucket
+//  - Entries, each aligned to 4 bytes:
+//    - uint32 hash of the name (`multicall_name_hash`)
+//    - uint32 name length in wchars
+//    - uint32 shim data size in bytes
+//    - name (UTF-16, not null-terminated), padded to 4 bytes
+//    - shim data (see `ShimDataEncoder.cs`)
+//
+// The index is produced by `MulticallIndexFile.cs` (and by `host/MulticallIndexBuilder.hpp` for tests).
+
+struct MulticallIndexHeader {
+    /// `MULTICALL_INDEX_MAGIC`
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t bucket_count;
+    uint32_t entry_count;
+};
+static_assert(sizeof(MulticallIndexHeader) == 4 * 4);
+
+constexpr uint32_t MULTICALL_INDEX_MAGIC = 0x434d'4750; // "PGMC"
+constexpr uint16_t MULTICALL_INDEX_VERSION = 1;
+
+/// Folds ASCII letters to uppercase, Windows file names are case-insensitive.
+constexpr wchar multicall_fold_case(wchar c) {
+    return c >= 'a' && c <= 'z' ? (wchar) (c - ('a' - 'A')) : c;
+}
+
+/// 32-bit FNV-1a over the case-folded UTF-16 code units of the name.
+constexpr uint32_t multicall_name_hash(const wchar* name, size_t name_size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < name_size; i++) {
+        auto c = multicall_fold_case(name[i]);
+        hash = (hash ^ (c & 0xff)) * 16777619u;
+        hash = (hash ^ (c >> 8)) * 16777619u;
+    }
+    return hash;
+}
+
+/// Returns the file name of `path` (the part after the last path separator), which is the key of the command
+/// in the multicall index.
+inline wstring_view multicall_command_name(const wchar* path) {
+    auto name = path;
+    for (auto it = path; *it; it++) {
+        if (*it == '\\' || *it == '/') name = it + 1;
+    }
+    return {name, wstr_size(name)};
+}
+
+/// Read-only view of a multicall index. The index comes from a file that may be corrupted or concurrently rewritten
+/// by an older/newer Pog, so all reads are bounds-checked; the found shim data must still be checked
+/// with `validate_shim_data`.
+class MulticallIndex {
+private:
+    struct EntryHeader {
+        uint32_t hash;
+        uint32_t name_size;
+        uint32_t shim_data_size;
+    };
+
+    const byte* data_;
+    size_t size_;
+
+public:
+    /// `data` must be aligned to 4 bytes.
+    MulticallIndex(const byte* data, size_t size) : data_{data}, size_{size} {}
+
+    /// Checks the header and the bucket array, must be called (and succeed) before `find`.
+    /// Returns nullptr if the index is valid, otherwise an error message.
+    [[nodiscard]] const wchar_t* validate() const {
+        if (size_ < sizeof(MulticallIndexHeader)) return L"Invalid Pog multicall index: truncated header.";
+        auto& h = header();
+        if (h.magic != MULTICALL_INDEX_MAGIC) return L"Invalid Pog multicall index: not an index file.";
+        if (h.version != MULTICALL_INDEX_VERSION) return L"Incorrect Pog multicall index version, re-export the commands.";
+        if (h.bucket_count == 0 || (h.bucket_count & (h.bucket_count - 1)) != 0) {
+            return L"Invalid Pog multicall index: bucket count is not a power of 2.";
+        }
+        if ((uint64_t) h.bucket_count * sizeof(uint32_t) > size_ - sizeof(MulticallIndexHeader)) {
+            return L"Invalid Pog multicall index: truncated bucket array.";
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] uint32_t entry_count() const {
+        return header().entry_count;
+    }
+
+    /// Returns the shim data of the command `name`, or `nullopt` if the command is not in the index.
+    /// Entries with invalid offsets or sizes are treated as missing.
+    [[nodiscard]] optional<ShimDataBuffer> find(wstring_view name) const {
+        auto name_size = name.size();
+        auto hash = multicall_name_hash(name.data(), name_size);
+        auto mask = header().bucket_count - 1;
+        auto buckets = (const uint32_t*) (data_ + sizeof(MulticallIndexHeader));
+
+        // the index is never full, but limit the probe count in case it's corrupted
+        for (uint32_t i = 0, bucket = hash & mask; i <= mask; i++, bucket = (bucket + 1) & mask) {
+            auto offset = buckets[bucket];
+            if (offset == 0) {
+                return nullopt; // empty bucket, the name is not in the index
+            }
+            if (offset % alignof(EntryHeader) != 0 || offset > size_ || size_ - offset < sizeof(EntryHeader)) {
+                return nullopt;
+            }
+            auto& entry = *(const EntryHeader*) (data_ + offset);
+            if (entry.hash != hash || entry.name_size != name_size) {
+                continue;
+            }
+
+            auto name_offset = offset + sizeof(EntryHeader);
+            auto data_offset = align_up(name_offset + (uint64_t) name_size * sizeof(wchar), sizeof(uint32_t));
+            if (data_offset > size_ || entry.shim_data_size > size_ - data_offset) {
+                return nullopt;
+            }
+            if (names_equal((const wchar*) (data_ + name_offset), name.data(), name_size)) {
+                return ShimDataBuffer{data_ + data_offset, entry.shim_data_size};
+            }
+        }
+        return nullopt;
+    }
+
+private:
+    [[nodiscard]] const MulticallIndexHeader& header() const {
+        return *(const MulticallIndexHeader*) data_;
+    }
+
+    static constexpr uint64_t align_up(uint64_t n, uint64_t alignment) {
+        return (n + alignment - 1) & ~(alignment - 1);
+    }
+
+    static bool names_equal(const wchar* a, const wchar* b, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            if (multicall_fold_case(a[i]) != multicall_fold_case(b[i])) return false;
+        }
+        return true;
+    }
+};
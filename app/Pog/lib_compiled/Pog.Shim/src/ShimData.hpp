@@ -1,36 +1,55 @@
 #pragma once
 
-#include <Windows.h>
 #include <cstddef>
 #include <cstdint>
 #include "stdlib.hpp"
 #include "util.hpp"
+#include "os.hpp"
+#include "Buffer.hpp"
+
+// This file is the platform-independent part of the shim, all OS interaction goes through `os.hpp`.
 
 // https://learn.microsoft.com/en-us/windows/win32/procthread/environment-variables, including null terminator
 constexpr size_t MAX_ENV_VAR_SIZE = 32'768;
 using ShimDataBuffer = span<const byte>;
 
-inline ShimDataBuffer load_shim_data() {
-    auto resource_handle = FindResource(nullptr, MAKEINTRESOURCE(1), RT_RCDATA);
-    if (resource_handle == nullptr) {
-        panic(L"Pog shim not configured yet.");
-    }
-    auto loaded_resource = CHECK_ERROR(LoadResource(nullptr, resource_handle));
-    auto resource_ptr = CHECK_ERROR(LockResource(loaded_resource));
-    auto resource_size = CHECK_ERROR_V(0, SizeofResource(nullptr, resource_handle));
-
-    return {(const byte*) resource_ptr, resource_size};
-}
-
 template<typename Callback>
-concept WcharPtrCallback = requires(Callback cb, const wchar_t* str) { cb(str); };
+concept WcharPtrCallback = requires(Callback cb, const wchar* str) { cb(str); };
 template<typename Callback>
-concept EnvironmentVariableCallback = requires(Callback cb, const wchar_t* str) { cb(str, str); };
+concept EnvironmentVariableCallback = requires(Callback cb, const wchar* str) { cb(str, str); };
+/// Source of environment variables used for interpolation, with the same contract as `os::read_env_var`.
+template<typename T>
+concept EnvVarReader = requires(const T& reader, const wchar* name, wchar* buffer, size_t size) {
+    reader.read_env_var(name, buffer, size);
+};
+
+/// Reads environment variables of the current process.
+struct ProcessEnvironment {
+    size_t read_env_var(const wchar* name, wchar* buffer, size_t buffer_size) const {
+        return os::read_env_var(name, buffer, buffer_size);
+    }
+};
 
 // for documentation of these enums, see `ShimDataEncoder.cs`
-enum class ShimFlag : uint16_t { REPLACE_ARGV0 = 1, NULL_TARGET = 2, };
+enum class ShimFlag : uint16_t { REPLACE_ARGV0 = 1, NULL_TARGET = 2, ENVIRONMENT_BLOCK = 4, DETACHED = 8, };
 enum class EnvVarTokenFlag : uint16_t { ENV_VAR_NAME = 1, NEW_LIST_ITEM = 2, LAST_SEGMENT = 4, RECESSIVE = 8, };
 
+/// Optional parts of the launcher. Each shim template is built with a subset of these features, and `ShimExecutable`
+/// picks the smallest template that supports all features required by the shim data (see `ShimFeatures` in C#).
+enum class ShimFeature : uint16_t {
+    NONE = 0,
+    /// Environment variables are set for the target.
+    ENVIRONMENT = 1,
+    /// The command line is modified (argv[0] is replaced, or arguments are prepended).
+    ARGUMENTS = 2,
+    ALL = ENVIRONMENT | ARGUMENTS,
+};
+
+/// Oldest shim data version the shim can read. v4 shims are still around, since shim data is only rewritten
+/// when the shim is re-exported.
+constexpr uint16_t MIN_SHIM_DATA_VERSION = 4;
+constexpr uint16_t CURRENT_SHIM_DATA_VERSION = 5;
+
 struct ShimHeader {
     uint16_t version;
     ShimFlag flags;
@@ -38,10 +57,69 @@ struct ShimHeader {
     uint32_t working_directory_offset;
     uint32_t argument_offset;
     uint32_t environment_offset;
+    // fields below are only present since v5, do not access them for older versions
+    uint32_t command_line_prefix_offset;
+    /// `shim_data_checksum` of the whole shim data, computed with this field set to 0.
+    uint32_t checksum;
 };
 // ensure that no padding is added
-static_assert(sizeof(ShimHeader) == 2 * 2 + 4 * 4);
+static_assert(sizeof(ShimHeader) == 2 * 2 + 4 * 6);
+constexpr size_t SHIM_HEADER_SIZE_V4 = 2 * 2 + 4 * 4;
+
+/// Checksum of the shim data, with the `ShimHeader::checksum` field treated as zero. This is only meant to detect
+/// truncated or corrupted shim data, not tampering.
+///
+/// The data is split into 32-bit little-endian words (the last word is padded with zeros), and word `i` is hashed
+/// into lane `i % 4` using 64-bit FNV-1a (with words instead of bytes). The lanes are independent, so that the hash
+/// is not bound by the latency of the multiplication. Finally, the lanes and the size are hashed together and folded
+/// to 32 bits. Keep this in sync with `ShimDataEncoder.cs`.
+///
+/// `data` must be aligned to 4 bytes and `size` must be at least `sizeof(ShimHeader)`.
+inline uint32_t shim_data_checksum(const byte* data, size_t size) {
+    constexpr size_t checksum_word = offsetof(ShimHeader, checksum) / sizeof(uint32_t);
+    constexpr uint64_t prime = 1099511628211u;
+    constexpr uint64_t basis = 14695981039346656037u;
+
+    auto words = (const uint32_t*) data;
+    auto word_count = size / sizeof(uint32_t);
+    uint64_t lanes[4] = {basis, basis, basis, basis};
+
+    // the header, with the checksum word zeroed
+    for (size_t i = 0; i < sizeof(ShimHeader) / sizeof(uint32_t); i++) {
+        lanes[i % 4] = (lanes[i % 4] ^ (i == checksum_word ? 0 : words[i])) * prime;
+    }
+    // the rest of the data
+    size_t i = sizeof(ShimHeader) / sizeof(uint32_t);
+    for (; i + 4 <= word_count; i += 4) {
+        for (size_t l = 0; l < 4; l++) {
+            lanes[(i + l) % 4] = (lanes[(i + l) % 4] ^ words[i + l]) * prime;
+        }
+    }
+    for (; i < word_count; i++) {
+        lanes[i % 4] = (lanes[i % 4] ^ words[i]) * prime;
+    }
+    if (auto tail_size = size % sizeof(uint32_t)) {
+        uint32_t tail = 0;
+        for (size_t b = 0; b < tail_size; b++) tail |= (uint32_t) data[word_count * sizeof(uint32_t) + b] << (8 * b);
+        lanes[i % 4] = (lanes[i % 4] ^ tail) * prime;
+    }
 
+    uint64_t hash = basis;
+    for (auto lane : lanes) {
+        hash = (hash ^ lane) * prime;
+    }
+    hash = (hash ^ size) * prime;
+    return (uint32_t) (hash ^ (hash >> 32));
+}
+
+/// Interpolates values of environment variables stored in the shim data. A single instance should be reused
+/// for all variables of a shim, so that the output buffer is only allocated once.
+///
+/// The value is expanded in two passes. The first pass only walks the segments to size the literal parts, the second
+/// one writes the literals and reads the referenced environment variables directly into the output buffer, which is
+/// grown if the variable values do not fit. Each variable referenced by a value is only read once; if it's referenced
+/// by multiple segments, the later occurrences are copied from the already expanded part of the output.
+template<EnvVarReader Reader>
 class ShimDataEnvironmentVariable {
 private:
     // do not make this struct packed, since then alignof() is 1, which breaks `.next()`
@@ -49,9 +127,9 @@ private:
         uint32_t size;
         EnvVarTokenFlag flags;
 
-        [[nodiscard]] const wchar_t* str() const {
+        [[nodiscard]] const wchar* str() const {
             // return pointer after the last member
-            return (const wchar_t*) (&flags + 1);
+            return (const wchar*) (&flags + 1);
         }
 
         [[nodiscard]] wstring_view str_view() const {
@@ -64,15 +142,37 @@ private:
         }
     };
 
+    /// Variable that was already read while expanding the current value.
+    struct ExpandedVar {
+        const wchar* name;
+        /// Position of the expanded value in `out_`, invalid if `size == os::ENV_VAR_NOT_FOUND`.
+        size_t offset;
+        size_t size;
+    };
+
+    // most values reference 1-2 variables; if there are more distinct variables, the rest is not deduplicated
+    static constexpr size_t MAX_EXPANDED_VARS = 16;
+    // enough for most values without a reallocation
+    static constexpr size_t INITIAL_BUFFER_SIZE = 4096;
+    // assumed size of a referenced variable when sizing the output buffer in the first pass
+    static constexpr size_t ESTIMATED_VAR_SIZE = 256;
+
+    static constexpr wchar EMPTY_STRING[] = {0};
+
+    // allocated on first use, most shims only have literal single-segment values, which do not need it
+    CWString out_{0};
+    const Reader& reader_;
+
 public:
-    static void get_value(const wchar_t* env_var_name, void* start_ptr, WcharPtrCallback auto value_cb) {
+    explicit ShimDataEnvironmentVariable(const Reader& reader) : reader_(reader) {}
+
+    void get_value(const wchar* env_var_name, const void* start_ptr, WcharPtrCallback auto value_cb) {
         auto first_segment = (const EnvSegmentHeader*) start_ptr;
 
         // this flag is only valid on the first segment
         if (HAS_FLAG(first_segment->flags, RECESSIVE)) {
-            // if the env var exists, use it instead of our value
-            if (read_env_var(env_var_name, [&](auto env_value) { value_cb(env_value.data()); })) {
-                // env var found and processed
+            // if the env var exists, keep it; we only need to know that it exists, not its value
+            if (reader_.read_env_var(env_var_name, nullptr, 0) != os::ENV_VAR_NOT_FOUND) {
                 return;
             }
         }
@@ -83,34 +183,24 @@ public:
             return;
         }
 
-        // output buffer
-        wchar_t out[MAX_ENV_VAR_SIZE];
-        wchar_t* out_end = out + MAX_ENV_VAR_SIZE;
-        wchar_t* out_it = out;
+        // first pass: size the literal segments and separators, and reserve some space for the referenced variables
+        size_t reserved_size = 1; // null terminator
+        for (auto it = first_segment;; it = it->next()) {
+            reserved_size += HAS_FLAG(it->flags, ENV_VAR_NAME) ? ESTIMATED_VAR_SIZE : it->size;
+            if (HAS_FLAG(it->flags, NEW_LIST_ITEM)) reserved_size++; // separator
+            if (HAS_FLAG(it->flags, LAST_SEGMENT)) break;
+        }
+        ensure_size(reserved_size);
+
+        // second pass: build the value in `out_`
+        ExpandedVar expanded_vars[MAX_EXPANDED_VARS];
+        size_t expanded_count = 0;
+        size_t out_size = 0;
 
         // these booleans track whether we need to add the PATH separator when we write something
         auto prev_empty = true;
         auto cur_empty = true;
 
-        auto append = [&](wstring_view str) {
-            if (str.size() == 0) {
-                return;
-            }
-
-            auto needs_separator = !prev_empty && cur_empty;
-            auto total_size = str.size() + (needs_separator ? 1 : 0);
-
-            if (out_end - out_it < (ptrdiff_t)total_size) {
-                panic(L"Interpolated environment variable too long.");
-            }
-
-            if (needs_separator) *out_it++ = L';';
-            out_it = copy(str.begin(), str.end(), out_it);
-
-            cur_empty = false;
-        };
-
-        // iterate over the segments and build the env var value
         for (auto it = first_segment;; it = it->next()) {
             DBG_LOG(L"- env segment: size=%u flags=%hu str=%ls\n", it->size, it->flags, it->str());
 
@@ -120,10 +210,34 @@ public:
                 cur_empty = true;
             }
 
-            if (HAS_FLAG(it->flags, ENV_VAR_NAME)) {
-                read_env_var(it->str(), append);
+            // the separator is only written if the appended string is not empty, but we need to know where
+            //  to place the string before reading the variable, so we always leave space for it
+            auto separator_size = !prev_empty && cur_empty ? 1 : 0;
+            auto str_offset = out_size + separator_size;
+            size_t str_size;
+
+            if (!HAS_FLAG(it->flags, ENV_VAR_NAME)) {
+                str_size = it->size;
+                ensure_size(str_offset + str_size + 1);
+                copy(it->str(), it->str() + str_size, out_.data() + str_offset);
+            } else if (auto* expanded = find_expanded_var(expanded_vars, expanded_count, it->str())) {
+                // already read, copy the value from the previous occurrence
+                str_size = expanded->size == os::ENV_VAR_NOT_FOUND ? 0 : expanded->size;
+                ensure_size(str_offset + str_size + 1);
+                copy(out_.data() + expanded->offset, out_.data() + expanded->offset + str_size,
+                     out_.data() + str_offset);
             } else {
-                append(it->str_view());
+                auto var_size = read_env_var_into(it->str(), str_offset);
+                if (expanded_count < MAX_EXPANDED_VARS) {
+                    expanded_vars[expanded_count++] = {it->str(), str_offset, var_size};
+                }
+                str_size = var_size == os::ENV_VAR_NOT_FOUND ? 0 : var_size;
+            }
+
+            if (str_size != 0) {
+                if (separator_size) out_.data()[out_size] = ';';
+                out_size = str_offset + str_size;
+                cur_empty = false;
             }
 
             if (HAS_FLAG(it->flags, LAST_SEGMENT)) {
@@ -131,48 +245,75 @@ public:
             }
         }
 
-        if (out_it == out_end) {
+        if (out_size >= MAX_ENV_VAR_SIZE) {
             panic(L"Interpolated environment variable too long.");
         }
-        *out_it++ = L'\0';
+        out_.data()[out_size] = 0;
 
         // call the callback with the composed value
-        value_cb(out);
+        value_cb(out_.data());
     }
 
 private:
-    static void get_single_segment_value(const EnvSegmentHeader* segment, auto value_cb) {
+    void get_single_segment_value(const EnvSegmentHeader* segment, auto value_cb) {
         if (HAS_FLAG(segment->flags, ENV_VAR_NAME)) {
-            if (!read_env_var(segment->str(), [&](auto env_value) { value_cb(env_value.data()); })) {
-                value_cb(L""); // env var does not exist
+            ensure_size(INITIAL_BUFFER_SIZE);
+            if (read_env_var_into(segment->str(), 0) == os::ENV_VAR_NOT_FOUND) {
+                value_cb(EMPTY_STRING); // env var does not exist
+            } else {
+                value_cb(out_.data());
             }
         } else {
+            // the segment is null-terminated, no need to copy it
             value_cb(segment->str());
         }
     }
 
-    static bool read_env_var(const wchar_t* var_name, auto callback) {
-        wchar_t env_var_buffer[MAX_ENV_VAR_SIZE];
-        auto ret = GetEnvironmentVariable(var_name, env_var_buffer, MAX_ENV_VAR_SIZE);
-        if (ret != 0 && ret <= MAX_ENV_VAR_SIZE) {
-            // ok
-            callback(wstring_view{env_var_buffer, ret});
-            return true;
-        } else if (ret > MAX_ENV_VAR_SIZE) {
-            // should not happen
-            panic(L"Env var value is too long.");
-        } else {
-            // error
-            if (GetLastError() == ERROR_ENVVAR_NOT_FOUND) {
-                return false;
-            } else {
-                panic(L"read_env_var");
+    /// Reads the env var directly into `out_` at `offset`, growing `out_` if necessary.
+    /// Returns the value size, or `os::ENV_VAR_NOT_FOUND`.
+    size_t read_env_var_into(const wchar* var_name, size_t offset) {
+        auto size = reader_.read_env_var(var_name, out_.data() + offset, out_.size() - offset);
+        if (size != os::ENV_VAR_NOT_FOUND && size >= out_.size() - offset) {
+            // did not fit, grow the buffer and read it again (only happens for unusually long variables)
+            ensure_size(offset + size + 1);
+            size = reader_.read_env_var(var_name, out_.data() + offset, out_.size() - offset);
+            if (size != os::ENV_VAR_NOT_FOUND && size >= out_.size() - offset) {
+                panic(L"Environment variable changed while it was being read.");
+            }
+        }
+        return size;
+    }
+
+    void ensure_size(size_t size) {
+        if (out_.size() < size) {
+            auto new_size = out_.size() * 2 > INITIAL_BUFFER_SIZE ? out_.size() * 2 : INITIAL_BUFFER_SIZE;
+            out_.resize(size > new_size ? size : new_size);
+        }
+    }
+
+    static const ExpandedVar* find_expanded_var(const ExpandedVar* vars, size_t count, const wchar* name) {
+        for (size_t i = 0; i < count; i++) {
+            if (env_var_name_equals(vars[i].name, name)) {
+                return &vars[i];
             }
         }
+        return nullptr;
+    }
+
+    /// Environment variable names are case-insensitive; to keep things simple, only ASCII letters are folded,
+    /// which is fine, since a false negative only means that the variable is read again.
+    static bool env_var_name_equals(const wchar* a, const wchar* b) {
+        for (;; a++, b++) {
+            auto ca = *a >= 'a' && *a <= 'z' ? *a - ('a' - 'A') : *a;
+            auto cb = *b >= 'a' && *b <= 'z' ? *b - ('a' - 'A') : *b;
+            if (ca != cb) return false;
+            if (ca == 0) return true;
+        }
     }
 };
 
-// We intentionally don't do any bound checking. The worst that can happen is that the shim will crash...
+/// Accessors for the shim data. There is no bound checking here, the shim data must be checked with
+/// `validate_shim_data` (`ShimDataValidator.hpp`) before it is used.
 class ShimData {
 private:
     const ShimDataBuffer buffer;
@@ -188,11 +329,11 @@ public:
         return header().flags;
     }
 
-    [[nodiscard]] const wchar_t* get_target() const {
+    [[nodiscard]] const wchar* get_target() const {
         return read_wstring(header().target_offset);
     }
 
-    [[nodiscard]] const wchar_t* get_working_directory() const {
+    [[nodiscard]] const wchar* get_working_directory() const {
         if (header().working_directory_offset == 0) return nullptr;
         return read_wstring(header().working_directory_offset);
     }
@@ -204,16 +345,59 @@ public:
                             read_uint(header().argument_offset)};
     }
 
+    /// Precomputed part of the target command line that is inserted before the original arguments (v5+), see
+    /// `ShimDataEncoder.cs`. Returns `nullopt` for v4 shim data, where the command line must be assembled from
+    /// the target and the arguments.
+    [[nodiscard]] optional<wstring_view> get_command_line_prefix() const {
+        if (header().version < 5) return nullopt;
+        if (header().command_line_prefix_offset == 0) return wstring_view{nullptr, 0};
+        return wstring_view{read_wstring(header().command_line_prefix_offset + sizeof(uint32_t)),
+                            read_uint(header().command_line_prefix_offset)};
+    }
+
+    /// Returns the launcher features needed to run this shim, see `ShimFeature`.
+    [[nodiscard]] ShimFeature required_features() const {
+        auto features = (uint16_t) ShimFeature::NONE;
+        if (environment_variable_count() != 0) {
+            features |= (uint16_t) ShimFeature::ENVIRONMENT;
+        }
+        bool modifies_cmd_line;
+        if (auto prefix = get_command_line_prefix()) {
+            modifies_cmd_line = prefix->size() != 0;
+        } else {
+            // v4 shim data
+            modifies_cmd_line = header().argument_offset != 0 || HAS_FLAG(flags(), REPLACE_ARGV0)
+                                || HAS_FLAG(flags(), NULL_TARGET);
+        }
+        if (modifies_cmd_line) {
+            features |= (uint16_t) ShimFeature::ARGUMENTS;
+        }
+        return (ShimFeature) features;
+    }
+
+    [[nodiscard]] uint32_t environment_variable_count() const {
+        if (header().environment_offset == 0) return 0;
+        return read_uint(header().environment_offset);
+    }
+
     void enumerate_environment_variables(EnvironmentVariableCallback auto callback) const {
+        enumerate_environment_variables(ProcessEnvironment{}, callback);
+    }
+
+    /// Interpolates the environment variables, reading the referenced variables from `reader`.
+    void enumerate_environment_variables(const EnvVarReader auto& reader, EnvironmentVariableCallback auto callback) const {
         if (header().environment_offset == 0) return;
         auto count = read_uint(header().environment_offset);
 
+        // reused for all variables
+        ShimDataEnvironmentVariable interpolator{reader};
+
         auto it = (const uint32_t*) &buffer[header().environment_offset + sizeof(uint32_t)];
         auto end = it + count * 2;
         while (it != end) {
             auto* name = read_wstring(*it++);
             auto value_offset = *it++;
-            ShimDataEnvironmentVariable::get_value(name, (void*) &buffer[value_offset], [&](auto value) {
+            interpolator.get_value(name, &buffer[value_offset], [&](auto value) {
                 callback(name, value);
             });
         }
@@ -224,8 +408,8 @@ private:
         return *(const ShimHeader*) buffer.data();
     }
 
-    [[nodiscard]] const wchar_t* read_wstring(size_t offset) const {
-        return (const wchar_t*) &buffer[offset];
+    [[nodiscard]] const wchar* read_wstring(size_t offset) const {
+        return (const wchar*) &buffer[offset];
     }
 
     [[nodiscard]] uint32_t read_uint(size_t offset) const {
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "stdlib.hpp"
+#include "ShimData.hpp"
+
+// Direct lookup of the shim data in the loaded shim image. The shim data are stored as RCDATA #1, and finding them
+//  with `FindResource`, `LoadResource`, `LockResource` and `SizeofResource` walks the resource directory on every
+//  launch. Instead, after writing the resources of a shim, Pog records where the shim data ended up in a locator
+//  stored in the unused space of the PE headers, right after the section table (aligned to 8 bytes):
+//  - uint64 `SHIM_DATA_LOCATOR_MAGIC`
+//  - uint32 RVA of the shim data
+//  - uint32 size of the shim data
+// The headers are always mapped at the image base, so the lookup is a few reads from the first page of the image.
+//
+// The locator is written by `write_shim_data_locator` in Pog.Native (`ShimUpdate.hpp`), keep the layout in sync.
+//  It may be missing (shims written by an older Pog, or without `pog_native.dll`) or stale (resources rewritten
+//  with `BeginUpdateResource` after it was written), so it's only used if it points inside the resource directory,
+//  and the shim data must still be checked with `validate_shim_data` (which checks their checksum), with the resource
+//  lookup as the fallback.
+
+constexpr uint64_t SHIM_DATA_LOCATOR_MAGIC = 0x6174'6144'6d69'6853; // "ShimData"
+constexpr size_t SHIM_DATA_LOCATOR_SIZE = 16;
+
+namespace shim_data_locator_detail {
+    inline uint16_t read_u16(const byte* p) {
+        return (uint16_t) (p[0] | p[1] << 8);
+    }
+
+    inline uint32_t read_u32(const byte* p) {
+        return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+    }
+
+    inline uint64_t read_u64(const byte* p) {
+        return (uint64_t) read_u32(p) | (uint64_t) read_u32(p + 4) << 32;
+    }
+}
+
+/// Offset of the shim data locator from the start of the image with the given headers, see above; `pe_offset`
+/// is `e_lfanew`. Must match `shim_data_locator_offset` in Pog.Native.
+constexpr size_t shim_data_locator_offset(size_t pe_offset, uint16_t size_of_optional_header, uint16_t section_count) {
+    auto section_table_end = pe_offset + 24 + size_of_optional_header + (size_t) section_count * 40;
+    return (section_table_end + 7) & ~(size_t) 7;
+}
+
+/// Returns the shim data recorded in the locator of the image loaded at `image_base`, or `nullopt` if the image
+/// has no locator, or if it does not point inside the resource directory. The headers of the image are trusted
+/// (they were checked by the loader), the locator is not.
+inline optional<ShimDataBuffer> locate_shim_data(const byte* image_base) {
+    using namespace shim_data_locator_detail;
+    if (read_u16(image_base) != 0x5a4d) return nullopt; // "MZ"
+    auto pe_offset = read_u32(image_base + 0x3c);
+    auto coff = image_base + pe_offset + 4;
+    auto optional_header = coff + 20;
+    auto size_of_headers = read_u32(optional_header + 60);
+
+    auto offset = shim_data_locator_offset(pe_offset, read_u16(coff + 16), read_u16(coff + 2));
+    if (offset + SHIM_DATA_LOCATOR_SIZE > size_of_headers) return nullopt;
+    auto locator = image_base + offset;
+    if (read_u64(locator) != SHIM_DATA_LOCATOR_MAGIC) return nullopt;
+    auto rva = read_u32(locator + 8);
+    auto size = read_u32(locator + 12);
+
+    // data directories of PE32 and PE32+ images, preceded by their count
+    auto directories = optional_header + (read_u16(optional_header) == 0x20b ? 112 : 96);
+    if (read_u32(directories - 4) <= 2) return nullopt;
+    auto resource_rva = read_u32(directories + 2 * 8);
+    auto resource_size = read_u32(directories + 2 * 8 + 4);
+
+    // the shim data are read as arrays of uint32 and wchar, like in the multicall index
+    if (size == 0 || rva % sizeof(uint32_t) != 0) return nullopt;
+    if (rva < resource_rva || size > resource_size || rva - resource_rva > resource_size - size) return nullopt;
+    return ShimDataBuffer{image_base + rva, size};
+}
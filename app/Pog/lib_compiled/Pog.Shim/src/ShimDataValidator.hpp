@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "stdlib.hpp"
+#include "ShimData.hpp"
+
+/// Checks that the shim data is well-formed, so that `ShimData` can access it without any bound checking: the header
+/// and the checksum (v5+) are valid, all offsets point inside the buffer and are aligned, all strings are terminated,
+/// and all environment variable values are terminated by a `LAST_SEGMENT` segment.
+///
+/// This is a single pass over the shim data (each environment variable value is walked once per table entry
+/// referencing it), and it does not allocate. Returns nullptr if the shim data is valid, otherwise an error message.
+class ShimDataValidator {
+private:
+    // layout of `ShimDataEnvironmentVariable::EnvSegmentHeader`, the string starts right after the flags
+    static constexpr size_t SEGMENT_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint16_t);
+    static constexpr uint16_t KNOWN_SHIM_FLAGS = (uint16_t) ShimFlag::REPLACE_ARGV0 | (uint16_t) ShimFlag::NULL_TARGET
+                                                 | (uint16_t) ShimFlag::ENVIRONMENT_BLOCK
+                                                 | (uint16_t) ShimFlag::DETACHED;
+    static constexpr uint16_t KNOWN_SEGMENT_FLAGS = (uint16_t) EnvVarTokenFlag::ENV_VAR_NAME
+                                                    | (uint16_t) EnvVarTokenFlag::NEW_LIST_ITEM
+                                                    | (uint16_t) EnvVarTokenFlag::LAST_SEGMENT
+                                                    | (uint16_t) EnvVarTokenFlag::RECESSIVE;
+
+    const byte* data_;
+    size_t size_;
+
+public:
+    explicit ShimDataValidator(const ShimDataBuffer& buffer) : data_{buffer.data()}, size_{buffer.size()} {}
+
+    [[nodiscard]] const wchar_t* validate() const {
+        if (size_ < SHIM_HEADER_SIZE_V4) return L"Invalid Pog shim data: truncated header.";
+        auto& header = *(const ShimHeader*) data_;
+
+        if (header.version < MIN_SHIM_DATA_VERSION || header.version > CURRENT_SHIM_DATA_VERSION) {
+            return L"Incorrect Pog shim data version, this shim expects v4 or v5.";
+        }
+        if (header.version >= 5) {
+            if (size_ < sizeof(ShimHeader)) return L"Invalid Pog shim data: truncated header.";
+            if (shim_data_checksum(data_, size_) != header.checksum) {
+                return L"Invalid Pog shim data: checksum mismatch, the shim data is corrupted.";
+            }
+        }
+        if (((uint16_t) header.flags & ~KNOWN_SHIM_FLAGS) != 0) return L"Invalid Pog shim data: unknown flags.";
+
+        if (header.target_offset == 0) return L"Invalid Pog shim data: missing target path.";
+        if (!is_string(header.target_offset)) return L"Invalid Pog shim data: invalid target path.";
+        if (header.working_directory_offset != 0 && !is_string(header.working_directory_offset)) {
+            return L"Invalid Pog shim data: invalid working directory.";
+        }
+        if (header.argument_offset != 0 && !is_length_prefixed_string(header.argument_offset)) {
+            return L"Invalid Pog shim data: invalid arguments.";
+        }
+        if (header.version >= 5 && header.command_line_prefix_offset != 0
+            && !is_length_prefixed_string(header.command_line_prefix_offset)) {
+            return L"Invalid Pog shim data: invalid command line prefix.";
+        }
+        if (header.environment_offset != 0) {
+            return validate_environment(header.environment_offset);
+        }
+        return nullptr;
+    }
+
+private:
+    [[nodiscard]] const wchar_t* validate_environment(size_t offset) const {
+        if (!is_aligned(offset, sizeof(uint32_t)) || !fits(offset, sizeof(uint32_t))) {
+            return L"Invalid Pog shim data: invalid environment variable table.";
+        }
+        auto count = read_uint(offset);
+        auto table_offset = offset + sizeof(uint32_t);
+        // compare sizes in 64 bits, `count` is not trusted
+        if ((uint64_t) count * 2 * sizeof(uint32_t) > size_ - table_offset) {
+            return L"Invalid Pog shim data: truncated environment variable table.";
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            auto entry_offset = table_offset + i * 2 * sizeof(uint32_t);
+            if (!is_string(read_uint(entry_offset))) {
+                return L"Invalid Pog shim data: invalid environment variable name.";
+            }
+            if (auto error = validate_env_var_value(read_uint(entry_offset + sizeof(uint32_t)))) {
+                return error;
+            }
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] const wchar_t* validate_env_var_value(size_t offset) const {
+        // the composed value must fit into an environment variable; the shim checks the interpolated value again,
+        //  this only catches values which could never be valid
+        size_t value_size = 0;
+        for (auto first = true;; first = false) {
+            if (!is_aligned(offset, sizeof(uint32_t)) || !fits(offset, SEGMENT_HEADER_SIZE)) {
+                return L"Invalid Pog shim data: invalid environment variable segment.";
+            }
+            auto str_size = read_uint(offset);
+            auto flags = *(const EnvVarTokenFlag*) &data_[offset + sizeof(uint32_t)];
+            auto str_offset = offset + SEGMENT_HEADER_SIZE;
+
+            // `RECESSIVE` is only valid on the first segment
+            if (((uint16_t) flags & ~KNOWN_SEGMENT_FLAGS) != 0 || (!first && HAS_FLAG(flags, RECESSIVE))) {
+                return L"Invalid Pog shim data: invalid environment variable segment flags.";
+            }
+            // the segment string must fit, including the null terminator
+            if ((uint64_t) str_size + 1 > (size_ - str_offset) / sizeof(wchar)
+                || read_wchar(str_offset + str_size * sizeof(wchar)) != 0) {
+                return L"Invalid Pog shim data: invalid environment variable segment.";
+            }
+
+            // +1 for the list separator
+            value_size += str_size + 1;
+            if (value_size >= MAX_ENV_VAR_SIZE) {
+                return L"Invalid Pog shim data: environment variable value too long.";
+            }
+
+            if (HAS_FLAG(flags, LAST_SEGMENT)) {
+                return nullptr;
+            }
+            // align the next segment, the same way `EnvSegmentHeader::next()` does
+            offset = (str_offset + (str_size + 1) * sizeof(wchar) + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+        }
+    }
+
+    /// Checks that a null-terminated string starts at `offset`.
+    [[nodiscard]] bool is_string(size_t offset) const {
+        if (!is_aligned(offset, sizeof(wchar)) || offset >= size_) return false;
+        auto end = (const wchar*) (data_ + size_ - (size_ - offset) % sizeof(wchar));
+        for (auto it = (const wchar*) (data_ + offset); it != end; it++) {
+            if (*it == 0) return true;
+        }
+        return false;
+    }
+
+    /// Checks that a string prefixed by its length in wchars (without a null terminator) starts at `offset`.
+    [[nodiscard]] bool is_length_prefixed_string(size_t offset) const {
+        if (!is_aligned(offset, sizeof(uint32_t)) || !fits(offset, sizeof(uint32_t))) return false;
+        return (uint64_t) read_uint(offset) * sizeof(wchar) <= size_ - offset - sizeof(uint32_t);
+    }
+
+    /// Checks that `size` bytes at `offset` are inside the buffer, without overflowing.
+    [[nodiscard]] bool fits(size_t offset, size_t size) const {
+        return offset <= size_ && size <= size_ - offset;
+    }
+
+    [[nodiscard]] static bool is_aligned(size_t offset, size_t alignment) {
+        return (offset & (alignment - 1)) == 0;
+    }
+
+    [[nodiscard]] uint32_t read_uint(size_t offset) const {
+        return *(const uint32_t*) &data_[offset];
+    }
+
+    [[nodiscard]] wchar read_wchar(size_t offset) const {
+        return *(const wchar*) &data_[offset];
+    }
+};
+
+/// Returns nullptr if `buffer` contains valid shim data, otherwise an error message. See `ShimDataValidator`.
+[[nodiscard]] inline const wchar_t* validate_shim_data(const ShimDataBuffer& buffer) {
+    return ShimDataValidator{buffer}.validate();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "stdlib.hpp"
+
+// Thin OS layer used by the portable shim core (`ShimData.hpp`, `CommandLine.hpp`). Everything the core needs from
+//  the OS goes through these functions, so that the core can also be built on other platforms than Windows.
+// The Windows implementation (used by the actual shim) is in `os_win32.cpp`, the POSIX implementation, which exists
+//  so that we can benchmark, test and fuzz the core on Linux, is in `os_posix.cpp`.
+namespace os {
+    /// Returned from `read_env_var` when the environment variable does not exist.
+    constexpr size_t ENV_VAR_NOT_FOUND = (size_t) -1;
+
+    /// Returns the unparsed command line of the current process, including argv[0].
+    const wchar* get_command_line();
+
+    /// Returns the length of the value of the environment variable `name` in wchars (excluding the null terminator),
+    /// or `ENV_VAR_NOT_FOUND`. If the value fits into `buffer` (including the null terminator), it is written there,
+    /// otherwise the buffer is left untouched and the caller may retry with a larger buffer. Pass an empty buffer
+    /// to only check if the variable exists.
+    size_t read_env_var(const wchar* name, wchar* buffer, size_t buffer_size);
+
+    /// Sets the environment variable `name` for the current process (and subsequently spawned child processes).
+    void set_env_var(const wchar* name, const wchar* value);
+
+    /// Shows an error message to the user. Must not fail, since it's used by `panic`.
+    void show_error(const wchar_t* error_message);
+
+    /// Reads the cycle counter used to timestamp the launch phases (`LaunchTrace.hpp`); the frequency is unknown.
+    uint64_t read_cycle_counter();
+    /// Reads the monotonic clock used to calibrate the cycle counter.
+    uint64_t read_reference_clock();
+    /// Returns the ticks per second of `read_reference_clock`.
+    uint64_t reference_clock_frequency();
+
+#ifndef _WIN32
+    // hooks for the host build; on Windows, the process state is provided by the OS
+    namespace host {
+        /// Overrides the command line returned by `get_command_line`. The string must outlive all calls.
+        void set_command_line(const wchar* command_line);
+        /// Removes all environment variables from the emulated environment.
+        void clear_environment();
+        /// Returns the number of `read_env_var` calls since the start of the process.
+        size_t env_var_read_count();
+    }
+#endif
+}
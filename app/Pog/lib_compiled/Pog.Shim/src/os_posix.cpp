@@ -0,0 +1,167 @@
+// POSIX implementation of the shim OS layer (see `os.hpp`), used for the host build of the shim core.
+//
+// The shim core works with UTF-16 strings and Windows semantics (case-insensitive environment variable names),
+//  so instead of using `getenv`/`setenv` directly, we keep an emulated UTF-16 environment, initialized from `environ`
+//  on first use. This also makes benchmarks independent of the environment of the benchmarking process.
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "os.hpp"
+#include "util.hpp"
+
+extern char** environ;
+
+namespace {
+    // both functors are transparent, so that we can look up variables without allocating a string for the key
+    struct CaseInsensitiveHash {
+        using is_transparent = void;
+
+        size_t operator()(std::u16string_view str) const {
+            // FNV-1a over ASCII-uppercased code units
+            size_t hash = 14695981039346656037ull;
+            for (auto c : str) {
+                hash = (hash ^ (c >= u'a' && c <= u'z' ? c - 32 : c)) * 1099511628211ull;
+            }
+            return hash;
+        }
+    };
+
+    struct CaseInsensitiveEqual {
+        using is_transparent = void;
+
+        bool operator()(std::u16string_view a, std::u16string_view b) const {
+            if (a.size() != b.size()) return false;
+            for (size_t i = 0; i < a.size(); i++) {
+                auto ca = a[i] >= u'a' && a[i] <= u'z' ? a[i] - 32 : a[i];
+                auto cb = b[i] >= u'a' && b[i] <= u'z' ? b[i] - 32 : b[i];
+                if (ca != cb) return false;
+            }
+            return true;
+        }
+    };
+
+    using Environment = std::unordered_map<std::u16string, std::u16string, CaseInsensitiveHash, CaseInsensitiveEqual>;
+
+    // only handles ASCII and 2-3 byte UTF-8 sequences, which is enough for the host build
+    std::u16string utf16_from_utf8(const char* str, size_t size) {
+        std::u16string out;
+        out.reserve(size);
+        for (size_t i = 0; i < size;) {
+            auto c = (unsigned char) str[i];
+            if (c < 0x80) {
+                out.push_back(c);
+                i += 1;
+            } else if ((c & 0xE0) == 0xC0 && i + 1 < size) {
+                out.push_back((char16_t) (((c & 0x1F) << 6) | (str[i + 1] & 0x3F)));
+                i += 2;
+            } else if ((c & 0xF0) == 0xE0 && i + 2 < size) {
+                out.push_back((char16_t) (((c & 0x0F) << 12) | ((str[i + 1] & 0x3F) << 6) | (str[i + 2] & 0x3F)));
+                i += 3;
+            } else {
+                out.push_back(u'\uFFFD');
+                i += 1;
+            }
+        }
+        return out;
+    }
+
+    Environment& environment() {
+        static Environment env = [] {
+            Environment e;
+            for (auto it = environ; it && *it; it++) {
+                auto eq = strchr(*it, '=');
+                if (eq == nullptr) continue;
+                e.insert_or_assign(utf16_from_utf8(*it, eq - *it), utf16_from_utf8(eq + 1, strlen(eq + 1)));
+            }
+            return e;
+        }();
+        return env;
+    }
+
+    std::u16string& default_command_line() {
+        static std::u16string cmd_line = [] {
+            // reconstruct a Windows-style command line from the real argv, quoting arguments with whitespace
+            std::ifstream f{"/proc/self/cmdline", std::ios::binary};
+            std::string raw{std::istreambuf_iterator<char>{f}, {}};
+            std::u16string out;
+            for (size_t start = 0; start < raw.size();) {
+                auto end = raw.find('\0', start);
+                if (end == std::string::npos) end = raw.size();
+                auto arg = utf16_from_utf8(raw.data() + start, end - start);
+                if (!out.empty()) out.push_back(u' ');
+                auto quote = arg.empty() || arg.find_first_of(u" \t") != std::u16string::npos;
+                if (quote) out.push_back(u'"');
+                out += arg;
+                if (quote) out.push_back(u'"');
+                start = end + 1;
+            }
+            return out;
+        }();
+        return cmd_line;
+    }
+
+    const wchar* command_line_override = nullptr;
+    size_t env_var_reads = 0;
+}
+
+const wchar* os::get_command_line() {
+    return command_line_override ? command_line_override : default_command_line().c_str();
+}
+
+size_t os::read_env_var(const wchar* name, wchar* buffer, size_t buffer_size) {
+    env_var_reads++;
+    auto& env = environment();
+    auto it = env.find(std::u16string_view{name});
+    if (it == env.end()) {
+        return ENV_VAR_NOT_FOUND;
+    }
+    auto& value = it->second;
+    if (value.size() < buffer_size) {
+        copy(value.c_str(), value.c_str() + value.size() + 1, buffer);
+    }
+    return value.size();
+}
+
+void os::set_env_var(const wchar* name, const wchar* value) {
+    environment().insert_or_assign(std::u16string{name}, std::u16string{value});
+}
+
+void os::show_error(const wchar_t* error_message) {
+    fprintf(stderr, "POG ERROR: %ls\n", error_message);
+}
+
+uint64_t os::read_cycle_counter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return read_reference_clock();
+#endif
+}
+
+uint64_t os::read_reference_clock() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1'000'000'000 + (uint64_t) ts.tv_nsec;
+}
+
+uint64_t os::reference_clock_frequency() {
+    return 1'000'000'000;
+}
+
+void os::host::set_command_line(const wchar* command_line) {
+    command_line_override = command_line;
+}
+
+void os::host::clear_environment() {
+    environment().clear();
+}
+
+size_t os::host::env_var_read_count() {
+    return env_var_reads;
+}
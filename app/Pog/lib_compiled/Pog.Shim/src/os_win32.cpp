@@ -0,0 +1,98 @@
+// Windows implementation of the shim OS layer (see `os.hpp`).
+
+#include <Windows.h>
+#include <intrin.h>
+#include "os.hpp"
+#include "util.hpp"
+#include "Buffer.hpp"
+
+static CString utf8_from_wstring(const wchar_t* in) {
+    int out_size = WideCharToMultiByte(CP_UTF8, 0, in, -1, nullptr, 0, nullptr, nullptr);
+    if (out_size == 0) {
+        abort();
+    }
+    CString out((size_t) out_size);
+    WideCharToMultiByte(CP_UTF8, 0, in, -1, out.data(), (int) out.size(), nullptr, nullptr);
+    return out;
+}
+
+static void write_file_all(HANDLE handle, const void* buffer, size_t size) {
+    do {
+        DWORD bytes_written;
+        if (!WriteFile(handle, buffer, (DWORD) size, &bytes_written, nullptr)) {
+            abort(); // cannot show error message, writing to output failed
+        }
+        buffer = (const char*) buffer + bytes_written;
+        size -= bytes_written;
+    } while (size != 0);
+}
+
+static void write_file_all(HANDLE handle, const wchar_t* str) {
+    auto utf8_str = utf8_from_wstring(str);
+    write_file_all(handle, utf8_str.data(), utf8_str.size_bytes());
+}
+
+const wchar* os::get_command_line() {
+    return GetCommandLine();
+}
+
+size_t os::read_env_var(const wchar* name, wchar* buffer, size_t buffer_size) {
+    // for variables with an empty value, 0 is returned without setting the last error, so we must reset it
+    SetLastError(ERROR_SUCCESS);
+    auto ret = GetEnvironmentVariable(name, buffer, (DWORD) buffer_size);
+    if (ret == 0) {
+        switch (GetLastError()) {
+            case ERROR_SUCCESS: return 0;
+            case ERROR_ENVVAR_NOT_FOUND: return ENV_VAR_NOT_FOUND;
+            default: panic(L"read_env_var");
+        }
+    }
+    // if the value does not fit, `ret` is the required buffer size, including the null terminator
+    return ret < buffer_size ? ret : ret - 1;
+}
+
+void os::set_env_var(const wchar* name, const wchar* value) {
+    CHECK_ERROR_B(SetEnvironmentVariable(name, value));
+}
+
+void os::show_error(const wchar_t* error_message) {
+    auto stderr_handle = GetStdHandle(STD_ERROR_HANDLE);
+    if (stderr_handle == INVALID_HANDLE_VALUE || stderr_handle == nullptr) {
+        // stderr not connected or opening failed, show a message box; user32.dll is only loaded here, since importing
+        //  it would load it (together with gdi32.dll and win32u.dll) on every launch, and `/DELAYLOAD` needs the CRT
+        //  helper, which we do not link in release builds; if loading fails, there's no other way to report the error
+        using MessageBoxW_t = int (WINAPI*)(HWND, LPCWSTR, LPCWSTR, UINT);
+        auto user32 = LoadLibraryEx(L"user32.dll", nullptr, LOAD_LIBRARY_SEARCH_SYSTEM32);
+        auto message_box = user32 ? (MessageBoxW_t) (void*) GetProcAddress(user32, "MessageBoxW") : nullptr;
+        if (message_box) {
+            message_box(nullptr, error_message, L"Pog error", MB_OK | MB_ICONERROR);
+        }
+    } else {
+        // stderr is attached to something, either a file/pipe or a console
+
+        // UTF8 is a more natural encoding, since we do not have to change console mode for it,
+        //  and it works well even when redirected or over SSH
+        // set output mode to UTF8, ignore failures
+        (void) SetConsoleOutputCP(CP_UTF8);
+        write_file_all(stderr_handle, "POG ERROR: ", 11);
+        write_file_all(stderr_handle, error_message);
+        write_file_all(stderr_handle, "\n", 1);
+    }
+}
+
+uint64_t os::read_cycle_counter() {
+    return __rdtsc();
+}
+
+uint64_t os::read_reference_clock() {
+    LARGE_INTEGER counter;
+    // cannot fail since Windows XP
+    QueryPerformanceCounter(&counter);
+    return (uint64_t) counter.QuadPart;
+}
+
+uint64_t os::reference_clock_frequency() {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t) frequency.QuadPart;
+}
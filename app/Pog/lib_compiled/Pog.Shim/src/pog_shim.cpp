@@ -3,10 +3,24 @@
 #include <Windows.h>
 #include <cassert>
 #include "ShimData.hpp"
+#include "ShimDataValidator.hpp"
+#include "ShimDataLocator.hpp"
+#include "CommandLine.hpp"
+#include "EnvironmentBlock.hpp"
+#include "MulticallIndex.hpp"
+#include "LaunchTrace.hpp"
 #include "Buffer.hpp"
 #include "stdlib.hpp"
 #include "util.hpp"
 
+// features of this shim template (`ShimFeature`), set by CMake for each template variant
+#ifndef POG_SHIM_FEATURES
+#define POG_SHIM_FEATURES 3 // ShimFeature::ALL
+#endif
+
+// provided by the linker, the DOS header of this image is at the image base
+extern "C" IMAGE_DOS_HEADER __ImageBase;
+
 // disable argv and envp parsing, we don't need it
 // https://learn.microsoft.com/en-us/previous-versions/zay8tzh6(v=vs.85)
 // https://github.com/icidicf/library/blob/267ca3c87b44ccbf4eaa6b8e7416f3e38b269332/microsoft/CRT/SRC/INTERNAL.H#L499
@@ -29,70 +43,200 @@ BOOL WINAPI ctrl_handler(DWORD ctrl_type) {
     }
 }
 
-static const wchar_t* find_argv0_end(const wchar_t* cmd_line) {
-    // https://learn.microsoft.com/en-us/cpp/c-language/parsing-c-command-line-arguments?view=msvc-170
-    // The first argument (argv[0]) is treated specially. It represents the program name. Because it
-    // must be a valid pathname, parts surrounded by double quote marks (") are allowed. The double
-    // quote marks aren't included in the argv[0] output. The parts surrounded by double quote marks
-    // prevent interpretation of a space or tab character as the end of the argument.
-
-    // CommandLineToArgvW treats whitespace outside of quotation marks as argument delimiters.
-    // However, if lpCmdLine starts with any amount of whitespace, CommandLineToArgvW will consider
-    // the first argument to be an empty string. Excess whitespace at the end of lpCmdLine is ignored.
-
-    // find the end of argv[0]
-    auto inside_quotes = false;
-    auto it = cmd_line;
-    for (; *it != 0; it++) {
-        if (*it == L'"') {
-            inside_quotes = !inside_quotes;
-            continue;
+/// Returns the path of the invoked executable; for a hardlink to the dispatcher, this is the path of the hardlink.
+static CWString get_module_path() {
+    CWString path{MAX_PATH};
+    while (true) {
+        auto size = CHECK_ERROR_V(0, GetModuleFileName(nullptr, path.data(), (DWORD) path.size()));
+        if (size < path.size()) {
+            return path;
         }
-        if (!inside_quotes && (*it == L' ' || *it == L'\t')) {
-            // found the end
+        // truncated, retry with a larger buffer
+        path = CWString{path.size() * 2};
+    }
+}
+
+// only the full template can serve as the multicall dispatcher, since the dispatched commands may need any feature
+#define POG_SHIM_MULTICALL (POG_SHIM_FEATURES == 3)
+
+#if POG_SHIM_MULTICALL
+/// File name of the multicall index, which is stored in the same directory as the commands (see `MulticallIndex`).
+static constexpr wchar_t MULTICALL_INDEX_FILE_NAME[] = L"pog_multicall.idx";
+
+/// Opens the multicall index in the directory of `command_path`, returns `INVALID_HANDLE_VALUE` if there is none.
+static HANDLE open_multicall_index(const wchar_t* command_path) {
+    auto name = multicall_command_name(command_path);
+    // replace the command name with the index file name
+    auto dir_size = (size_t) (name.data() - command_path);
+    constexpr auto index_name_size = sizeof(MULTICALL_INDEX_FILE_NAME) / sizeof(wchar_t);
+    CWString index_path{dir_size + index_name_size};
+    copy(command_path, command_path + dir_size, index_path.data());
+    copy(MULTICALL_INDEX_FILE_NAME, MULTICALL_INDEX_FILE_NAME + index_name_size, index_path.data() + dir_size);
+
+    return CreateFile(index_path.data(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+}
+
+/// Returns the path of `path` with all symlinks resolved.
+static CWString get_final_path(const wchar_t* path) {
+    auto file = CreateFile(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        panic(L"Pog shim not configured yet.");
+    }
+    CWString final_path{MAX_PATH};
+    while (true) {
+        auto size = CHECK_ERROR_V(0, GetFinalPathNameByHandle(file, final_path.data(), (DWORD) final_path.size(),
+                                                              FILE_NAME_NORMALIZED));
+        if (size < final_path.size()) {
             break;
         }
+        // too small, `size` is the required size including the null terminator
+        final_path = CWString{size};
     }
-    return it;
+    CHECK_ERROR_B(CloseHandle(file));
+    return final_path;
 }
 
-static CWString build_command_line(optional<wstring_view> prefixed_args, const wchar_t* target_override = nullptr) {
-    const wchar_t* const_cmd_line = GetCommandLine();
-    auto* const_argv0_end = find_argv0_end(const_cmd_line);
-    auto argv0_len = target_override ? wstr_size(target_override) : const_argv0_end - const_cmd_line;
-    auto args_len = wstr_size(const_argv0_end);
-
-    // allocate the cmd_line buffer
-    CWString cmd_line{argv0_len + (target_override ? 2 : 0) // +2 for quotes around `target_override`
-                      + (prefixed_args ? 1 + prefixed_args->size() : 0) + args_len + 1};
-
-    // build the command line
-    auto it_out = cmd_line.data();
-
-    // copy argv[0], or insert target_override
-    if (target_override) {
-        // quote `target_override`, in case it contains spaces; when .cmd files are invoked, cmd.exe looks at argv[0],
-        //  not on the lpApplicationName value, and spaces would throw it off without quotes
-        *it_out++ = L'"';
-        it_out = copy(target_override, target_override + argv0_len, it_out);
-        *it_out++ = L'"';
-    } else {
-        it_out = copy(const_cmd_line, const_argv0_end, it_out);
+/// Memory-maps the multicall index next to the invoked executable and copies out the shim data of the command.
+/// The view is unmapped right after the lookup, so that a running shim does not prevent Pog from replacing the index.
+static ShimDataBuffer load_multicall_shim_data() {
+    auto command_path = get_module_path();
+    auto file = open_multicall_index(command_path.data());
+    if (file == INVALID_HANDLE_VALUE) {
+        // invoked through a symlink (e.g. a globally exported command), which is not resolved in the module path;
+        //  the index is next to the hardlink the symlink points to, and the command is indexed under its name
+        command_path = get_final_path(command_path.data());
+        file = open_multicall_index(command_path.data());
+        if (file == INVALID_HANDLE_VALUE) {
+            panic(L"Pog shim not configured yet.");
+        }
+    }
+    auto name = multicall_command_name(command_path.data());
+
+    LARGE_INTEGER file_size;
+    CHECK_ERROR_B(GetFileSizeEx(file, &file_size));
+    if (file_size.QuadPart == 0 || (uint64_t) file_size.QuadPart > (size_t) -1) {
+        panic(L"Invalid Pog multicall index: invalid file size.");
+    }
+    auto mapping = CHECK_ERROR(CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr));
+    auto view = CHECK_ERROR(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    // the view keeps the mapping alive
+    CHECK_ERROR_B(CloseHandle(mapping));
+    CHECK_ERROR_B(CloseHandle(file));
+
+    MulticallIndex index{(const byte*) view, (size_t) file_size.QuadPart};
+    if (auto error = index.validate()) {
+        panic(error);
+    }
+    auto shim_data = index.find(name);
+    if (!shim_data) {
+        panic(L"Command not found in the Pog multicall index, re-export the commands.");
+    }
+
+    // the copy is intentionally never freed, the shim data is used until the shim exits; `new` is 8-byte aligned
+    auto shim_data_copy = new byte[shim_data->size()];
+    copy(shim_data->begin(), shim_data->end(), shim_data_copy);
+    CHECK_ERROR_B(UnmapViewOfFile(view));
+    return {shim_data_copy, shim_data->size()};
+}
+#endif
+
+static ShimDataBuffer load_resource_shim_data() {
+    auto resource_handle = FindResource(nullptr, MAKEINTRESOURCE(1), RT_RCDATA);
+    if (resource_handle == nullptr) {
+#if POG_SHIM_MULTICALL
+        // no embedded shim data, this is the multicall dispatcher
+        return load_multicall_shim_data();
+#else
+        panic(L"Pog shim not configured yet.");
+#endif
     }
+    auto loaded_resource = CHECK_ERROR(LoadResource(nullptr, resource_handle));
+    auto resource_ptr = CHECK_ERROR(LockResource(loaded_resource));
+    auto resource_size = CHECK_ERROR_V(0, SizeofResource(nullptr, resource_handle));
 
-    if (prefixed_args) {
-        // add space
-        *it_out++ = L' ';
-        // copy prefixed_args
-        it_out = copy(prefixed_args->begin(), prefixed_args->end(), it_out);
+    return {(const byte*) resource_ptr, resource_size};
+}
+
+/// Returns the validated shim data of this shim.
+static ShimDataBuffer load_shim_data() {
+    // try the location recorded in the PE headers first (see `ShimDataLocator.hpp`); a missing or stale locator
+    //  is not an error, the shim data are looked up in the resource directory instead
+    auto located = locate_shim_data((const byte*) &__ImageBase);
+    if (located && !validate_shim_data(*located)) {
+        return *located;
     }
-    // copy remaining args, they're already prefixed with a whitespace and suffixed with null
-    it_out = copy(const_argv0_end, const_argv0_end + args_len + 1, it_out);
 
-    assert(cmd_line.data() + cmd_line.size() == it_out);
-    return cmd_line;
+    auto shim_data = load_resource_shim_data();
+    // check the shim data before touching it, so that corrupted shim data results in an error message, not a crash
+    if (auto error = validate_shim_data(shim_data)) {
+        panic(error);
+    }
+    return shim_data;
 }
 
+/// Name of the environment variable with the path of the launch trace file, see `LaunchTrace.hpp`.
+static constexpr wchar_t LAUNCH_TRACE_ENV_VAR[] = L"POG_SHIM_TRACE";
+
+/// Maps the launch trace file if tracing is enabled. Any failure just disables tracing, it must not break the launch.
+static optional<LaunchTraceBuffer> open_launch_trace() {
+    wchar_t path[MAX_PATH];
+    auto path_size = os::read_env_var(LAUNCH_TRACE_ENV_VAR, path, MAX_PATH);
+    if (path_size == os::ENV_VAR_NOT_FOUND || path_size == 0 || path_size >= MAX_PATH) {
+        return nullopt;
+    }
+
+    auto file = CreateFile(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullopt;
+    }
+    void* view = nullptr;
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file, &file_size)) {
+        if (file_size.QuadPart == 0) {
+            // a new file, extend it with zeros; shims racing to create it all set the same size
+            LARGE_INTEGER new_size{.QuadPart = (LONGLONG) LAUNCH_TRACE_FILE_SIZE};
+            if (SetFilePointerEx(file, new_size, nullptr, FILE_BEGIN) && SetEndOfFile(file)) {
+                file_size = new_size;
+            }
+        }
+        if (file_size.QuadPart == (LONGLONG) LAUNCH_TRACE_FILE_SIZE) {
+            if (auto mapping = CreateFileMapping(file, nullptr, PAGE_READWRITE, 0, 0, nullptr)) {
+                view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+                CloseHandle(mapping);
+            }
+        }
+    }
+    CloseHandle(file);
+    if (view == nullptr) {
+        return nullopt;
+    }
+    // the view is never unmapped, the record is appended right before the shim exits
+    return LaunchTraceBuffer::attach((byte*) view, LAUNCH_TRACE_FILE_SIZE, os::reference_clock_frequency());
+}
+
+/// Launch phase tracing of this shim, a no-op unless `POG_SHIM_TRACE` is set.
+struct ShimLaunchTrace {
+    optional<LaunchTraceBuffer> buffer = open_launch_trace();
+    LaunchTracer<os::read_cycle_counter, os::read_reference_clock> tracer{};
+
+    ShimLaunchTrace() {
+        if (buffer) tracer.start();
+    }
+
+    void mark(LaunchPhase phase) {
+        tracer.mark(phase);
+    }
+
+    void commit() {
+        if (!tracer.enabled()) return;
+        auto module_path = get_module_path();
+        tracer.commit(*buffer, GetCurrentProcessId(), multicall_command_name(module_path.data()));
+    }
+};
+
 static HANDLE create_child_job() {
     // extended limit info must be used to set the LimitFlags
     JOBOBJECT_EXTENDED_LIMIT_INFORMATION job_info{
@@ -145,7 +289,8 @@ struct ChildHandles {
     }
 };
 
-static ChildHandles run_target(const wchar_t* target, wchar_t* command_line, const wchar_t* working_directory) {
+static ChildHandles run_target(const wchar_t* target, wchar_t* command_line, const wchar_t* working_directory,
+                               wchar_t* environment) {
     // create a job object to wrap the child in
     auto job_handle = create_child_job();
 
@@ -156,10 +301,11 @@ static ChildHandles run_target(const wchar_t* target, wchar_t* command_line, con
     STARTUPINFOEX startup_info{.StartupInfo = {.cb = sizeof(startup_info)}, .lpAttributeList = attr_list};
     PROCESS_INFORMATION process_info;
 
-    // spawn the process
+    // spawn the process; if `environment` is null, the child inherits our environment
     CHECK_ERROR_B(CreateProcess(
-        target, command_line, nullptr, nullptr, true, INHERIT_PARENT_AFFINITY | EXTENDED_STARTUPINFO_PRESENT,
-        nullptr, working_directory, &startup_info.StartupInfo, &process_info));
+        target, command_line, nullptr, nullptr, true,
+        INHERIT_PARENT_AFFINITY | EXTENDED_STARTUPINFO_PRESENT | (environment ? CREATE_UNICODE_ENVIRONMENT : 0),
+        environment, working_directory, &startup_info.StartupInfo, &process_info));
 
     // we don't need the thread handle, close it
     CHECK_ERROR_B(CloseHandle(process_info.hThread));
@@ -167,29 +313,73 @@ static ChildHandles run_target(const wchar_t* target, wchar_t* command_line, con
     return {.job = job_handle, .process = process_info.hProcess};
 }
 
-int wmain() {
-    ShimDataBuffer shim_data_buffer = load_shim_data();
-    ShimData shim_data{shim_data_buffer};
+/// Spawns the target without a job object and without keeping a handle to it, for shims that exit right away.
+static void run_target_detached(const wchar_t* target, wchar_t* command_line, const wchar_t* working_directory,
+                                wchar_t* environment) {
+    STARTUPINFO startup_info{.cb = sizeof(startup_info)};
+    PROCESS_INFORMATION process_info;
+
+    CHECK_ERROR_B(CreateProcess(
+        target, command_line, nullptr, nullptr, true,
+        INHERIT_PARENT_AFFINITY | (environment ? CREATE_UNICODE_ENVIRONMENT : 0),
+        environment, working_directory, &startup_info, &process_info));
 
-    if (shim_data.version() != 4) {
-        panic(L"Incorrect Pog shim data version, this shim expects v4.");
+    CHECK_ERROR_B(CloseHandle(process_info.hThread));
+    CHECK_ERROR_B(CloseHandle(process_info.hProcess));
+}
+
+/// Builds the whole environment block for the child in a single pass, see `EnvironmentBlockBuilder`.
+static CWString build_environment_block(const ShimData& shim_data) {
+    auto inherited = CHECK_ERROR(GetEnvironmentStrings());
+    EnvironmentBlockBuilder builder{inherited, shim_data.environment_variable_count()};
+    shim_data.enumerate_environment_variables(builder, [&](auto name, auto value) {
+        DBG_LOG(L"env var '%ls': %ls\n", name, value);
+        builder.set(name, value);
+    });
+    auto block = builder.build();
+    CHECK_ERROR_B(FreeEnvironmentStrings(inherited));
+    return block;
+}
+
+/// Copies the command line of the shim, used when the shim does not modify it (`CreateProcess` may write to it).
+static CWString copy_command_line(const wchar* cmd_line) {
+    auto size = wstr_size(cmd_line) + 1;
+    CWString copy_buffer{size};
+    copy(cmd_line, cmd_line + size, copy_buffer.data());
+    return copy_buffer;
+}
+
+/// The launcher, specialized for the set of features compiled into the shim template, so that the templates without
+/// environment or command line support do not contain the code for it.
+template<ShimFeature Features>
+static int launch(const ShimData& shim_data, ShimLaunchTrace& trace) {
+    constexpr auto support_environment = has_flag(Features, ShimFeature::ENVIRONMENT);
+    constexpr auto support_arguments = has_flag(Features, ShimFeature::ARGUMENTS);
+
+    auto required_features = (uint16_t) shim_data.required_features();
+    if ((required_features & ~(uint16_t) Features) != 0) {
+        panic(L"This Pog shim template does not support the configured shim features, re-export the shim.");
     }
 
     auto flags = shim_data.flags();
     auto null_target = HAS_FLAG(flags, NULL_TARGET);
-    auto replace_argv0 = HAS_FLAG(flags, REPLACE_ARGV0) || null_target;
 
     auto target = shim_data.get_target();
     auto working_dir = shim_data.get_working_directory();
-    auto extra_args = shim_data.get_arguments();
-    auto cmd_line = build_command_line(extra_args, replace_argv0 ? target : nullptr);
+    CWString cmd_line{0};
+    if constexpr (support_arguments) {
+        cmd_line = build_target_command_line(shim_data, os::get_command_line());
+    } else {
+        cmd_line = copy_command_line(os::get_command_line());
+    }
+
+    trace.mark(LaunchPhase::COMMAND_LINE_BUILT);
 
     if (null_target) {
         // null target makes CreateProcess parse lpCommandLine (`cmd_line`) and use argv[0] as target
         target = nullptr;
     }
 
-    DBG_LOG(L"override argv[0]: %ls\n", replace_argv0 ? L"yes" : L"no");
     DBG_LOG(L"null target: %ls\n", null_target ? L"yes" : L"no");
     DBG_LOG(L"target: %ls\n", target);
     DBG_LOG(L"command line: %ls\n", cmd_line.data());
@@ -197,27 +387,57 @@ int wmain() {
         DBG_LOG(L"working directory: %ls\n", working_dir);
     }
 
-    // write extracted environment variables to our environment
-    shim_data.enumerate_environment_variables([](auto name, auto value) {
-        DBG_LOG(L"env var '%ls': %ls\n", name, value);
-        CHECK_ERROR_B(SetEnvironmentVariable(name, value));
-    });
+    CWString env_block{0};
+    if constexpr (support_environment) {
+        if (HAS_FLAG(flags, ENVIRONMENT_BLOCK)) {
+            // build the environment block for the child and pass it to `CreateProcess`
+            env_block = build_environment_block(shim_data);
+        } else {
+            // write extracted environment variables to our environment
+            shim_data.enumerate_environment_variables([](auto name, auto value) {
+                DBG_LOG(L"env var '%ls': %ls\n", name, value);
+                os::set_env_var(name, value);
+            });
+        }
+    }
+
+    trace.mark(LaunchPhase::ENVIRONMENT_BUILT);
+
+    if (HAS_FLAG(flags, DETACHED)) {
+        // exported with `-Detached`, nothing waits for the shim to get the exit code, so don't stay around for
+        //  the lifetime of the child; this also skips the job object, which only exists to kill the child together
+        //  with the shim
+        run_target_detached(target, cmd_line.data(), working_dir, env_block.data());
+        trace.mark(LaunchPhase::PROCESS_CREATED);
+        trace.commit();
+        return 0;
+    }
 
     // ignore signals, let the child handle them
     CHECK_ERROR_B(SetConsoleCtrlHandler(ctrl_handler, TRUE));
 
     // run the target
-    auto handles = run_target(target, cmd_line.data(), working_dir);
+    auto handles = run_target(target, cmd_line.data(), working_dir, env_block.data());
+    trace.mark(LaunchPhase::PROCESS_CREATED);
 
     // wait until the child stops
     CHECK_ERROR_V((DWORD) -1, WaitForSingleObject(handles.process, INFINITE));
+    trace.mark(LaunchPhase::CHILD_EXITED);
     // retrieve the exit code
     DWORD exit_code;
     CHECK_ERROR_B(GetExitCodeProcess(handles.process, &exit_code));
 
     // clean up handles
     handles.close_all();
+    trace.commit();
 
     // forward the exit code
     return (int) exit_code;
 }
+
+int wmain() {
+    ShimLaunchTrace trace{};
+    ShimDataBuffer shim_data_buffer = load_shim_data();
+    trace.mark(LaunchPhase::SHIM_DATA_LOADED);
+    return launch<(ShimFeature) POG_SHIM_FEATURES>(ShimData{shim_data_buffer}, trace);
+}
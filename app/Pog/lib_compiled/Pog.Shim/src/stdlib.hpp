@@ -4,7 +4,19 @@
 
 using byte = unsigned char;
 
+// UTF-16 code unit, used for all strings stored in the shim data; on Windows, this is `wchar_t`, so that the strings
+//  can be passed to Win32 directly, but on other platforms (host build of the shim core), `wchar_t` is 32-bit
+#ifdef _WIN32
+using wchar = wchar_t;
+#else
+using wchar = char16_t;
+#endif
+
+#ifdef _WIN32
 extern "C" __declspec(noreturn) void abort();
+#else
+#include <cstdlib>
+#endif
 
 // clang-format off
 template<class T> struct remove_pointer { using type = T; };
@@ -56,7 +68,7 @@ public:
 
 template<typename T>
 using span = span_impl<T*>;
-using wstring_view = span_impl<const wchar_t*>;
+using wstring_view = span_impl<const wchar*>;
 
 
 struct nullopt_t {};
@@ -97,6 +109,10 @@ public:
     T* operator->() {
         return &value_;
     }
+
+    T& operator*() {
+        return value_;
+    }
 };
 
 
@@ -109,7 +125,7 @@ inline OutputIt copy(InputIt first, InputIt last, OutputIt d_first) {
 }
 
 // implementation for `wcslen`, which is an intrinsic on some versions of MSVC, so we cannot redefine it
-inline size_t wstr_size(const wchar_t* str) {
+inline size_t wstr_size(const wchar* str) {
     size_t size = 0;
     for (; str[size] != 0; size++) {}
     return size;
@@ -1,11 +1,12 @@
 #pragma once
 
-#include <Windows.h>
+#include <cstdint>
 #include "stdlib.hpp"
-#include "Buffer.hpp"
+#include "os.hpp"
 
 // clang-format off
-#ifndef NDEBUG
+// the host build of the shim core uses UTF-16 `char16_t` strings, which cannot be printed with `%ls`
+#if !defined(NDEBUG) && defined(_WIN32)
 #include <cstdio>
 #include <cwchar>
 #define DBG_LOG(...) fwprintf(stderr, L"[LOG] " __VA_ARGS__)
@@ -27,8 +28,8 @@ using dont_deduce = typename dont_deduce_t<T>::type;
 
 /// Checks if enum f1 used as a bitfield contains some of the flags in f2.
 template<typename EnumT>
-inline bool has_flag(EnumT f1, EnumT f2) {
-    using T = __underlying_type (EnumT); // MSVC-specific
+constexpr bool has_flag(EnumT f1, EnumT f2) {
+    using T = __underlying_type (EnumT); // MSVC/GCC/Clang builtin
     return (static_cast<T>(f1) & static_cast<T>(f2)) != 0;
 }
 
@@ -38,53 +39,8 @@ inline bool has_flag(EnumT f1, EnumT f2) {
 #define ALIGN_UP(type, ptr_) ((type*)((((uintptr_t)(ptr_)) + (alignof(type) - 1)) & (~(alignof(type) - 1))))
 
 
-inline CString utf8_from_wstring(const wchar_t* in) {
-    int out_size = WideCharToMultiByte(CP_UTF8, 0, in, -1, nullptr, 0, nullptr, nullptr);
-    if (out_size == 0) {
-        abort();
-    }
-    CString out((size_t) out_size);
-    WideCharToMultiByte(CP_UTF8, 0, in, -1, out.data(), (int) out.size(), nullptr, nullptr);
-    return out;
-}
-
-inline void write_file_all(HANDLE handle, const void* buffer, size_t size) {
-    do {
-        DWORD bytes_written;
-        if (!WriteFile(handle, buffer, (DWORD) size, &bytes_written, nullptr)) {
-            abort(); // cannot show error message, writing to output failed
-        }
-        buffer = (const char*) buffer + bytes_written;
-        size -= bytes_written;
-    } while (size != 0);
-}
-
-inline void write_file_all(HANDLE handle, const wchar_t* str) {
-    auto utf8_str = utf8_from_wstring(str);
-    write_file_all(handle, utf8_str.data(), utf8_str.size_bytes());
-}
-
-
-inline void show_error(const wchar_t* error_message) {
-    auto stderr_handle = GetStdHandle(STD_ERROR_HANDLE);
-    if (stderr_handle == INVALID_HANDLE_VALUE || stderr_handle == nullptr) {
-        // stderr not connected or opening failed, show a message box
-        MessageBox(nullptr, error_message, L"Pog error", MB_OK | MB_ICONERROR);
-    } else {
-        // stderr is attached to something, either a file/pipe or a console
-
-        // UTF8 is a more natural encoding, since we do not have to change console mode for it,
-        //  and it works well even when redirected or over SSH
-        // set output mode to UTF8, ignore failures
-        (void) SetConsoleOutputCP(CP_UTF8);
-        write_file_all(stderr_handle, "POG ERROR: ", 11);
-        write_file_all(stderr_handle, error_message);
-        write_file_all(stderr_handle, "\n", 1);
-    }
-}
-
 [[noreturn]] inline void panic(const wchar_t* error_message) {
-    show_error(error_message);
+    os::show_error(error_message);
     abort();
 }
 
@@ -0,0 +1,125 @@
+// Tests of `EnvironmentBlockBuilder` against synthetic environment blocks.
+
+#include <string>
+#include <vector>
+#include "EnvironmentBlock.hpp"
+#include "ShimData.hpp"
+#include "../host/ShimDataBuilder.hpp"
+#include "../host/test.hpp"
+
+using host::EnvVarTemplate;
+using host::ShimDataBuilder;
+
+namespace {
+    /// Creates a block from a list of "NAME=VALUE" entries, in the given order.
+    std::u16string make_block(const std::vector<std::u16string>& entries) {
+        std::u16string block;
+        for (auto& e : entries) {
+            block += e;
+            block.push_back(0);
+        }
+        block.push_back(0);
+        return block;
+    }
+
+    /// Splits a block back into the list of entries.
+    std::vector<std::u16string> parse_block(const CWString& block) {
+        std::vector<std::u16string> entries;
+        for (auto it = block.data(); *it != 0; it += wstr_size(it) + 1) {
+            entries.emplace_back(it);
+        }
+        // the block must end with exactly one extra null
+        CHECK(block.size() >= 2 && block.data()[block.size() - 1] == 0 && block.data()[block.size() - 2] == 0);
+        return entries;
+    }
+
+    std::u16string read(const EnvironmentBlockBuilder& builder, const char16_t* name) {
+        wchar buffer[256];
+        auto size = builder.read_env_var(name, buffer, 256);
+        return size == os::ENV_VAR_NOT_FOUND ? u"<not found>" : std::u16string{buffer, size};
+    }
+}
+
+TEST(env_block_merge) {
+    auto inherited = make_block({u"=C:=C:\\x", u"APPDATA=a", u"Path=C:\\a", u"TEMP=t"});
+    EnvironmentBlockBuilder builder{inherited.c_str(), 4};
+    builder.set(u"ZZZ", u"last");
+    builder.set(u"PATH", u"C:\\pkg;C:\\a");
+    builder.set(u"BBB", u"");
+    builder.set(u"AAA", u"first");
+
+    auto entries = parse_block(builder.build());
+    std::vector<std::u16string> expected{
+        u"=C:=C:\\x", u"AAA=first", u"APPDATA=a", u"BBB=", u"PATH=C:\\pkg;C:\\a", u"TEMP=t", u"ZZZ=last"};
+    CHECK(entries == expected);
+}
+
+TEST(env_block_empty) {
+    auto inherited = make_block({});
+    EnvironmentBlockBuilder builder{inherited.c_str(), 0};
+    auto block = builder.build();
+    CHECK(block.size() == 2);
+    CHECK(parse_block(block).empty());
+}
+
+TEST(env_block_unsorted_inherited) {
+    auto inherited = make_block({u"c=3", u"B=2", u"a=1"});
+    EnvironmentBlockBuilder builder{inherited.c_str(), 1};
+    builder.set(u"b", u"new");
+    CHECK_EQ_STR(read(builder, u"A"), u"1");
+
+    auto entries = parse_block(builder.build());
+    std::vector<std::u16string> expected{u"a=1", u"b=new", u"c=3"};
+    CHECK(entries == expected);
+}
+
+TEST(env_block_read_with_overrides) {
+    auto inherited = make_block({u"HOME=C:\\Users\\user", u"PATH=C:\\a"});
+    EnvironmentBlockBuilder builder{inherited.c_str(), 2};
+    CHECK_EQ_STR(read(builder, u"path"), u"C:\\a");
+    CHECK_EQ_STR(read(builder, u"MISSING"), u"<not found>");
+
+    builder.set(u"PATH", u"C:\\b");
+    builder.set(u"PATH", u"C:\\c");
+    CHECK_EQ_STR(read(builder, u"Path"), u"C:\\c");
+
+    // too small buffer only reports the size
+    wchar small[2] = {'x', 'x'};
+    CHECK(builder.read_env_var(u"HOME", small, 2) == 13);
+    CHECK(small[0] == 'x');
+}
+
+TEST(env_block_from_shim_data) {
+    // later variables see the values of previously set variables, same as with `SetEnvironmentVariable`
+    auto encoded = ShimDataBuilder::encode({
+        .target = u"C:\\x.exe",
+        .environment = {{
+            {u"PKG", EnvVarTemplate::parse({u"%ROOT%\\pkg"})},
+            {u"PATH", EnvVarTemplate::parse({u"%PKG%\\bin", u"%PATH%"})},
+        }},
+    });
+    ShimData shim_data{{encoded.data(), encoded.size()}};
+    // too few variables for the shim to use the merged block, but the result must be the same
+    CHECK(!HAS_FLAG(shim_data.flags(), ENVIRONMENT_BLOCK));
+
+    auto inherited = make_block({u"PATH=C:\\a", u"ROOT=C:\\root"});
+    EnvironmentBlockBuilder builder{inherited.c_str(), shim_data.environment_variable_count()};
+    shim_data.enumerate_environment_variables(builder, [&](auto name, auto value) { builder.set(name, value); });
+
+    auto entries = parse_block(builder.build());
+    std::vector<std::u16string> expected{u"PATH=C:\\root\\pkg\\bin;C:\\a", u"PKG=C:\\root\\pkg", u"ROOT=C:\\root"};
+    CHECK(entries == expected);
+}
+
+TEST(env_block_flag_threshold) {
+    // shims with a few variables set them one by one, see `ShimDataEncoder.EnvironmentBlockMinVariables`
+    constexpr auto min_variables = ShimDataBuilder::ENVIRONMENT_BLOCK_MIN_VARIABLES;
+    std::vector<std::pair<std::u16string, EnvVarTemplate>> env;
+    for (size_t i = 0; i < min_variables; i++) {
+        auto n = std::to_string(i);
+        env.emplace_back(u"VAR_" + std::u16string(n.begin(), n.end()), EnvVarTemplate::parse({u"x"}));
+        auto encoded = ShimDataBuilder::encode({.target = u"C:\\x.exe", .environment = env});
+        ShimData shim_data{{encoded.data(), encoded.size()}};
+        CHECK(HAS_FLAG(shim_data.flags(), ENVIRONMENT_BLOCK) == (env.size() >= min_variables));
+    }
+}
@@ -0,0 +1,111 @@
+// Tests of the import allowlist check of the shim templates (`cmake/ShimImportCheck.cmake`), run on synthetic PE
+//  images with the import directory in a `.rdata` section, like in the images produced by MSVC.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../host/test.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+    using Bytes = std::vector<uint8_t>;
+
+    constexpr uint32_t RDATA_RVA = 0x2000;
+    constexpr uint32_t RDATA_OFFSET = 0x400;
+
+    void write_u16(Bytes& out, size_t offset, uint16_t n) {
+        out[offset] = (uint8_t) n;
+        out[offset + 1] = (uint8_t) (n >> 8);
+    }
+
+    void write_u32(Bytes& out, size_t offset, uint32_t n) {
+        for (int i = 0; i < 4; i++) out[offset + i] = (uint8_t) (n >> (8 * i));
+    }
+
+    constexpr uint32_t IMPORT_OFFSET = 0x10;
+    /// File offset of the import directory entry in the PE32+ optional header.
+    constexpr size_t IMPORT_DIRECTORY_ENTRY = 0x84 + 20 + 112 + 8;
+
+    /// Builds an image importing `dlls`; the import descriptors are at `IMPORT_OFFSET` in `.rdata`, followed by
+    /// the DLL names. The thunk arrays are not needed by the check, so they are left out.
+    Bytes build_image(const std::vector<std::string>& dlls, bool pe32_plus = true) {
+        Bytes rdata(0x200, 0);
+        auto name_offset = IMPORT_OFFSET + 20 * ((uint32_t) dlls.size() + 1);
+        for (size_t i = 0; i < dlls.size(); i++) {
+            write_u32(rdata, IMPORT_OFFSET + 20 * i + 12, RDATA_RVA + name_offset);
+            std::copy(dlls[i].begin(), dlls[i].end(), rdata.begin() + name_offset);
+            name_offset += (uint32_t) dlls[i].size() + 1;
+        }
+
+        Bytes out(RDATA_OFFSET, 0);
+        write_u16(out, 0, 0x5a4d);
+        write_u32(out, 0x3c, 0x80);
+        write_u32(out, 0x80, 0x0000'4550);
+        auto coff = 0x84, opt = coff + 20;
+        auto opt_size = pe32_plus ? 240 : 224;
+        write_u16(out, coff, pe32_plus ? 0x8664 : 0x14c);
+        write_u16(out, coff + 2, 1);
+        write_u16(out, coff + 16, (uint16_t) opt_size);
+        write_u16(out, opt, pe32_plus ? 0x20b : 0x10b);
+        auto directories = opt + (pe32_plus ? 112 : 96);
+        write_u32(out, directories - 4, 16);
+        if (!dlls.empty()) {
+            write_u32(out, directories + 8, RDATA_RVA + IMPORT_OFFSET);
+            write_u32(out, directories + 12, 20 * ((uint32_t) dlls.size() + 1));
+        }
+
+        auto section = (size_t) opt + opt_size;
+        std::copy_n(".rdata", 6, out.begin() + (ptrdiff_t) section);
+        write_u32(out, section + 8, (uint32_t) rdata.size());
+        write_u32(out, section + 12, RDATA_RVA);
+        write_u32(out, section + 16, (uint32_t) rdata.size());
+        write_u32(out, section + 20, RDATA_OFFSET);
+
+        out.insert(out.end(), rdata.begin(), rdata.end());
+        return out;
+    }
+
+    /// Runs the check on `image`, returns true if it passed.
+    bool check(const Bytes& image, const std::string& allowed) {
+        auto path = fs::temp_directory_path() / "pog_shim_import_check_test.exe";
+        std::ofstream(path, std::ios::binary).write((const char*) image.data(), (std::streamsize) image.size());
+        auto command = std::string("\"") + POG_CMAKE_COMMAND + "\" -DBINARY=\"" + path.string() + "\" -DALLOWED=" +
+                       allowed + " -P \"" + POG_SHIM_IMPORT_CHECK + "\" > /dev/null 2>&1";
+        auto result = std::system(command.c_str());
+        fs::remove(path);
+        return result == 0;
+    }
+}
+
+TEST(import_check_allowed) {
+    CHECK(check(build_image({"KERNEL32.dll"}), "kernel32.dll"));
+    CHECK(check(build_image({"KERNEL32.dll"}, false), "kernel32.dll"));
+    CHECK(check(build_image({"kernel32.dll", "ntdll.dll"}), "ntdll.dll,KERNEL32.DLL"));
+    // no import directory at all
+    CHECK(check(build_image({}), "kernel32.dll"));
+}
+
+TEST(import_check_disallowed) {
+    CHECK(!check(build_image({"KERNEL32.dll", "USER32.dll"}), "kernel32.dll"));
+    CHECK(!check(build_image({"USER32.dll", "KERNEL32.dll"}, false), "kernel32.dll"));
+    CHECK(!check(build_image({"kernel32.dll.bak"}), "kernel32.dll"));
+}
+
+TEST(import_check_malformed) {
+    auto image = build_image({"KERNEL32.dll"});
+    // import directory outside of any section
+    auto outside = image;
+    write_u32(outside, IMPORT_DIRECTORY_ENTRY, 0x9000);
+    CHECK(!check(outside, "kernel32.dll"));
+    // truncated file
+    CHECK(!check(Bytes(image.begin(), image.begin() + 0x100), "kernel32.dll"));
+    // not a PE image
+    auto not_pe = image;
+    not_pe[0x80] = 'X';
+    CHECK(!check(not_pe, "kernel32.dll"));
+}
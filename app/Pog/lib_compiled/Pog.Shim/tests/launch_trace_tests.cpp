@@ -0,0 +1,374 @@
+// Tests of the shim launch trace ring buffer (`LaunchTrace.hpp`), including concurrent writers in threads and
+//  processes sharing a mapped file, and of the aggregation in `tools/LaunchTraceAggregator.hpp`.
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "LaunchTrace.hpp"
+#include "../tools/LaunchTraceAggregator.hpp"
+#include "../host/test.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+    /// Zero-initialized, 8-byte aligned memory for a trace file.
+    struct MemoryFile {
+        std::vector<uint64_t> words = std::vector<uint64_t>(LAUNCH_TRACE_FILE_SIZE / sizeof(uint64_t), 0);
+
+        byte* data() { return (byte*) words.data(); }
+
+        LaunchTraceHeader& header() { return *(LaunchTraceHeader*) data(); }
+
+        LaunchTraceRecord& record(size_t index) {
+            return ((LaunchTraceRecord*) (data() + sizeof(LaunchTraceHeader)))[index];
+        }
+    };
+
+    /// Record with a recognizable content derived from `writer` and `n`, see `is_consistent`.
+    LaunchTraceRecord make_record(uint32_t writer, uint64_t n) {
+        LaunchTraceRecord r{};
+        r.process_id = writer;
+        r.phase_mask = 0x1f;
+        r.reference_start = n;
+        r.reference_end = n + 1000;
+        for (size_t i = 0; i < LAUNCH_PHASE_COUNT; i++) r.cycles[i] = n * 100 + i * 10;
+        r.cycles_end = n * 100 + 1000;
+        auto name = "writer-" + std::to_string(writer);
+        r.name_size = (uint16_t) name.size();
+        for (size_t i = 0; i < name.size(); i++) r.name[i] = (wchar) name[i];
+        return r;
+    }
+
+    /// Checks that the record was not torn, i.e. all fields come from the same `make_record` call.
+    bool is_consistent(const LaunchTraceRecord& r) {
+        auto n = r.reference_start;
+        auto expected = make_record(r.process_id, n);
+        if (r.reference_end != expected.reference_end || r.cycles_end != expected.cycles_end) return false;
+        if (r.phase_mask != expected.phase_mask || r.name_size != expected.name_size) return false;
+        for (size_t i = 0; i < LAUNCH_PHASE_COUNT; i++) if (r.cycles[i] != expected.cycles[i]) return false;
+        for (size_t i = 0; i < r.name_size; i++) if (r.name[i] != expected.name[i]) return false;
+        return true;
+    }
+
+    std::vector<LaunchTraceRecord> read_all(const LaunchTraceBuffer& buffer) {
+        std::vector<LaunchTraceRecord> records;
+        buffer.read([&](const LaunchTraceRecord& r) { records.push_back(r); });
+        return records;
+    }
+
+    /// Shared mapping of a trace file, like the one created by each shim.
+    class MappedTraceFile {
+    private:
+        byte* view_ = nullptr;
+
+    public:
+        explicit MappedTraceFile(const fs::path& path) {
+            auto fd = open(path.c_str(), O_RDWR);
+            if (fd < 0) return;
+            auto view = mmap(nullptr, LAUNCH_TRACE_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (view != MAP_FAILED) view_ = (byte*) view;
+        }
+
+        ~MappedTraceFile() {
+            if (view_) munmap(view_, LAUNCH_TRACE_FILE_SIZE);
+        }
+
+        MappedTraceFile(const MappedTraceFile&) = delete;
+
+        /// Attaches like a shim would, retrying while another writer initializes the header.
+        LaunchTraceBuffer attach() {
+            while (true) {
+                auto buffer = LaunchTraceBuffer::attach(view_, LAUNCH_TRACE_FILE_SIZE, 1'000'000'000);
+                if (buffer) return *buffer;
+                std::this_thread::yield();
+            }
+        }
+
+        [[nodiscard]] bool ok() const { return view_ != nullptr; }
+    };
+
+    fs::path create_trace_file(const char* name) {
+        auto path = fs::temp_directory_path() / name;
+        fs::remove(path);
+        // like a new trace file in the shim, extended to the full size with zeros
+        fclose(fopen(path.c_str(), "wb"));
+        fs::resize_file(path, LAUNCH_TRACE_FILE_SIZE);
+        return path;
+    }
+
+    uint64_t fake_cycles = 0;
+    uint64_t fake_reference = 0;
+
+    uint64_t read_fake_cycles() { return fake_cycles += 100; }
+    uint64_t read_fake_reference() { return fake_reference += 1; }
+}
+
+TEST(launch_trace_attach) {
+    MemoryFile file;
+    CHECK(!LaunchTraceBuffer::open(file.data(), LAUNCH_TRACE_FILE_SIZE));
+    CHECK(!LaunchTraceBuffer::attach(file.data(), LAUNCH_TRACE_FILE_SIZE - 1, 1000));
+
+    auto buffer = LaunchTraceBuffer::attach(file.data(), LAUNCH_TRACE_FILE_SIZE, 1000);
+    CHECK(buffer);
+    CHECK(file.header().magic == LAUNCH_TRACE_MAGIC && file.header().capacity == LAUNCH_TRACE_CAPACITY);
+    CHECK(buffer->reference_frequency() == 1000 && buffer->write_index() == 0);
+
+    // a second writer keeps the existing header
+    auto second = LaunchTraceBuffer::attach(file.data(), LAUNCH_TRACE_FILE_SIZE, 2000);
+    CHECK(second && second->reference_frequency() == 1000);
+    CHECK(LaunchTraceBuffer::open(file.data(), LAUNCH_TRACE_FILE_SIZE));
+
+    // another version of the file
+    auto other_version = file;
+    other_version.header().version++;
+    CHECK(!LaunchTraceBuffer::attach(other_version.data(), LAUNCH_TRACE_FILE_SIZE, 1000));
+    CHECK(!LaunchTraceBuffer::open(other_version.data(), LAUNCH_TRACE_FILE_SIZE));
+
+    // another process is just initializing the header, this launch is not traced
+    MemoryFile initializing;
+    initializing.header().state = 1;
+    CHECK(!LaunchTraceBuffer::attach(initializing.data(), LAUNCH_TRACE_FILE_SIZE, 1000));
+}
+
+TEST(launch_trace_append_read) {
+    MemoryFile file;
+    auto buffer = *LaunchTraceBuffer::attach(file.data(), LAUNCH_TRACE_FILE_SIZE, 1000);
+    CHECK(read_all(buffer).empty());
+    for (uint64_t n = 0; n < 3; n++) buffer.append(make_record(1, n));
+
+    auto records = read_all(buffer);
+    CHECK(records.size() == 3);
+    for (uint64_t n = 0; n < records.size(); n++) {
+        CHECK(records[n].sequence == 2 * n + 2);
+        CHECK(records[n].reference_start == n && is_consistent(records[n]));
+    }
+
+    // a record which is still being written (or whose writer was killed) is skipped
+    file.record(1).sequence = 3;
+    records = read_all(buffer);
+    CHECK(records.size() == 2 && records[0].reference_start == 0 && records[1].reference_start == 2);
+}
+
+TEST(launch_trace_wraparound) {
+    MemoryFile file;
+    auto buffer = *LaunchTraceBuffer::attach(file.data(), LAUNCH_TRACE_FILE_SIZE, 1000);
+    for (uint64_t n = 0; n < LAUNCH_TRACE_CAPACITY + 10; n++) buffer.append(make_record(1, n));
+
+    auto records = read_all(buffer);
+    CHECK(records.size() == LAUNCH_TRACE_CAPACITY);
+    CHECK(records.front().reference_start == 10);
+    CHECK(records.back().reference_start == LAUNCH_TRACE_CAPACITY + 9);
+
+    // a slot overwritten by a newer lap is not returned as the old record
+    file.record(0).sequence = 2 * (2 * LAUNCH_TRACE_CAPACITY) + 2;
+    CHECK(read_all(buffer).size() == LAUNCH_TRACE_CAPACITY - 1);
+}
+
+TEST(launch_trace_concurrent_threads) {
+    constexpr uint32_t writers = 8;
+    constexpr uint64_t records_per_writer = 400;
+    auto path = create_trace_file("pog_shim_trace_threads.bin");
+
+    std::atomic<bool> done{false};
+    std::atomic<size_t> torn_records{0}, read_records{0};
+    // a reader checking the records while they are being written
+    std::thread reader([&] {
+        MappedTraceFile file{path};
+        auto buffer = file.attach();
+        // the last pass runs after all writers finished, so that it always sees some records
+        bool last_pass;
+        do {
+            last_pass = done;
+            buffer.read([&](const LaunchTraceRecord& r) {
+                read_records++;
+                if (!is_consistent(r)) torn_records++;
+            });
+        } while (!last_pass);
+    });
+
+    std::vector<std::thread> threads;
+    for (uint32_t w = 0; w < writers; w++) {
+        threads.emplace_back([&, w] {
+            // each writer has its own mapping, like a separate shim process, and they all race to initialize it
+            MappedTraceFile file{path};
+            auto buffer = file.attach();
+            for (uint64_t n = 0; n < records_per_writer; n++) buffer.append(make_record(w, n));
+        });
+    }
+    for (auto& t : threads) t.join();
+    done = true;
+    reader.join();
+    CHECK(torn_records == 0);
+    CHECK(read_records > 0);
+
+    MappedTraceFile file{path};
+    CHECK(file.ok());
+    auto records = read_all(file.attach());
+    CHECK(records.size() == writers * records_per_writer);
+    std::map<uint32_t, std::vector<bool>> seen;
+    for (auto& r : records) {
+        CHECK(is_consistent(r));
+        auto& writer_seen = seen[r.process_id];
+        writer_seen.resize(records_per_writer);
+        if (r.reference_start < records_per_writer) writer_seen[r.reference_start] = true;
+    }
+    CHECK(seen.size() == writers);
+    for (auto& [writer, writer_seen] : seen) {
+        for (auto s : writer_seen) CHECK(s);
+    }
+    fs::remove(path);
+}
+
+TEST(launch_trace_concurrent_processes) {
+    constexpr uint32_t writers = 4;
+    constexpr uint64_t records_per_writer = 1500;
+    auto path = create_trace_file("pog_shim_trace_processes.bin");
+
+    std::vector<pid_t> children;
+    for (uint32_t w = 0; w < writers; w++) {
+        auto pid = fork();
+        if (pid == 0) {
+            MappedTraceFile file{path};
+            auto buffer = file.attach();
+            for (uint64_t n = 0; n < records_per_writer; n++) buffer.append(make_record(w, n));
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    for (auto pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    MappedTraceFile file{path};
+    auto buffer = file.attach();
+    CHECK(buffer.write_index() == writers * records_per_writer);
+    // more records than the capacity were written, only the last `capacity` remain
+    auto records = read_all(buffer);
+    CHECK(records.size() == LAUNCH_TRACE_CAPACITY);
+    for (auto& r : records) CHECK(is_consistent(r));
+    fs::remove(path);
+}
+
+TEST(launch_tracer) {
+    MemoryFile file;
+    auto buffer = *LaunchTraceBuffer::attach(file.data(), LAUNCH_TRACE_FILE_SIZE, 1000);
+    std::u16string name = u"some-very-long-command-name.exe";
+
+    // not started, nothing is recorded
+    LaunchTracer<read_fake_cycles, read_fake_reference> disabled;
+    disabled.mark(LaunchPhase::SHIM_DATA_LOADED);
+    disabled.commit(buffer, 1, {name.data(), name.size()});
+    CHECK(buffer.write_index() == 0 && fake_cycles == 0);
+
+    LaunchTracer<read_fake_cycles, read_fake_reference> tracer;
+    tracer.start();
+    tracer.mark(LaunchPhase::SHIM_DATA_LOADED);
+    tracer.mark(LaunchPhase::PROCESS_CREATED);
+    tracer.commit(buffer, 42, {name.data(), name.size()});
+    // only committed once
+    tracer.commit(buffer, 42, {name.data(), name.size()});
+
+    auto records = read_all(buffer);
+    CHECK(records.size() == 1);
+    auto& r = records[0];
+    CHECK(r.process_id == 42);
+    CHECK(r.phase_mask == 0b10011);
+    CHECK(r.cycles[0] == 100 && r.cycles[1] == 200 && r.cycles[4] == 300 && r.cycles_end == 400);
+    CHECK(r.cycles[2] == 0 && r.cycles[5] == 0);
+    CHECK(r.reference_start == 1 && r.reference_end == 2);
+    CHECK(r.name_size == LAUNCH_TRACE_NAME_SIZE);
+    CHECK(std::u16string(r.name, r.name + r.name_size) == name.substr(0, LAUNCH_TRACE_NAME_SIZE));
+}
+
+TEST(launch_trace_histogram) {
+    using launch_trace::LatencyHistogram;
+    // bucket boundaries are contiguous
+    for (uint64_t v = 1; v < 100'000; v++) {
+        auto index = LatencyHistogram::bucket_index(v);
+        auto first_in_bucket = LatencyHistogram::bucket_index(v - 1) != index;
+        if (first_in_bucket && LatencyHistogram::bucket_upper_bound(index - 1) != v - 1) {
+            test::fail(__FILE__, __LINE__, ("bucket boundary at " + std::to_string(v)).c_str());
+            break;
+        }
+        if (LatencyHistogram::bucket_upper_bound(index) < v) {
+            test::fail(__FILE__, __LINE__, ("bucket upper bound of " + std::to_string(v)).c_str());
+            break;
+        }
+    }
+    CHECK(LatencyHistogram::bucket_upper_bound(LatencyHistogram::bucket_index(UINT64_MAX)) == UINT64_MAX);
+
+    LatencyHistogram h;
+    CHECK(h.value_at_percentile(50) == 0 && h.count() == 0);
+    for (uint64_t v = 1; v <= 100'000; v++) h.record(v * 1000);
+    CHECK(h.count() == 100'000 && h.min() == 1000 && h.max() == 100'000'000);
+    for (double p : {1.0, 50.0, 90.0, 99.0, 99.9}) {
+        auto expected = p * 1'000'000;
+        auto error = std::abs((double) h.value_at_percentile(p) - expected) / expected;
+        CHECK(error < 1.0 / LatencyHistogram::SUB_BUCKET_COUNT);
+    }
+    CHECK(h.value_at_percentile(100) == h.max());
+    CHECK(std::abs(h.mean() - 50'000'500.0) < 1);
+
+    LatencyHistogram other;
+    other.record(5);
+    other.merge(h);
+    CHECK(other.count() == 100'001 && other.min() == 5 && other.max() == 100'000'000);
+}
+
+TEST(launch_trace_aggregate) {
+    // a 3 GHz cycle counter with a 10 MHz reference clock
+    auto record = [](const char16_t* name, uint8_t phase_mask, std::vector<uint64_t> phase_us) {
+        LaunchTraceRecord r{};
+        r.phase_mask = phase_mask;
+        uint64_t cycles = 1'000'000;
+        for (size_t i = 0; i < LAUNCH_PHASE_COUNT; i++) {
+            if (!(phase_mask & (1u << i))) continue;
+            cycles += phase_us[i] * 3000;
+            r.cycles[i] = cycles;
+        }
+        r.cycles_end = cycles;
+        r.reference_start = 5'000;
+        r.reference_end = 5'000 + (cycles - r.cycles[0]) / 300;
+        std::u16string str = name;
+        r.name_size = (uint16_t) str.size();
+        std::copy(str.begin(), str.end(), r.name);
+        return r;
+    };
+    std::vector<LaunchTraceRecord> records;
+    for (int i = 0; i < 10; i++) records.push_back(record(u"code.exe", 0b11111, {0, 100, 10, 20, 1000, 0}));
+    records.push_back(record(u"git.exe", 0b111111, {0, 50, 5, 5, 800, 30'000}));
+    // a record without the start phase is ignored
+    records.push_back(record(u"broken.exe", 0b11110, {0, 1, 1, 1, 1, 0}));
+
+    auto report = launch_trace::aggregate(records, 10'000'000);
+    CHECK(std::abs(report.cycles_per_second - 3e9) < 1e6);
+    CHECK(report.commands.size() == 2);
+
+    auto& code = report.commands[u"code.exe"];
+    CHECK(code.launches == 10);
+    CHECK(code.phases[(size_t) LaunchPhase::SHIM_DATA_LOADED].value_at_percentile(50) / 1000 == 100);
+    CHECK(code.phases[(size_t) LaunchPhase::PROCESS_CREATED].value_at_percentile(50) / 1000 == 1000);
+    CHECK(code.phases[(size_t) LaunchPhase::CHILD_EXITED].count() == 0);
+    CHECK(code.overhead.value_at_percentile(50) / 1000 == 1130);
+
+    auto& git = report.commands[u"git.exe"];
+    CHECK(git.launches == 1);
+    CHECK(git.phases[(size_t) LaunchPhase::CHILD_EXITED].max() / 1000 == 30'000);
+
+    auto text = launch_trace::format(report);
+    CHECK(text.find("code.exe (10 launches)") != std::string::npos);
+    CHECK(text.find("shim overhead") != std::string::npos);
+    CHECK(text.find("broken.exe") == std::string::npos);
+}
@@ -0,0 +1,3 @@
+#include "../host/test.hpp"
+
+TEST_MAIN()
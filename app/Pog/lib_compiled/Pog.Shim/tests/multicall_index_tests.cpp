@@ -0,0 +1,124 @@
+// Tests of the multicall command index against indices produced by the C++ port of `MulticallIndexFile`.
+
+#include <string>
+#include <vector>
+#include "MulticallIndex.hpp"
+#include "ShimDataValidator.hpp"
+#include "../host/MulticallIndexBuilder.hpp"
+#include "../host/ShimDataBuilder.hpp"
+#include "../host/test.hpp"
+
+using host::MulticallEntry;
+using host::MulticallIndexBuilder;
+using host::ShimDataBuilder;
+
+namespace {
+    using Bytes = std::vector<unsigned char>;
+
+    std::vector<MulticallEntry> make_entries(size_t count) {
+        std::vector<MulticallEntry> entries;
+        for (size_t i = 0; i < count; i++) {
+            auto n = std::to_string(i);
+            std::u16string name = u"command-" + std::u16string(n.begin(), n.end()) + u".exe";
+            entries.push_back({name, ShimDataBuilder::encode({.target = u"C:\\pkg\\" + name})});
+        }
+        return entries;
+    }
+
+    /// Returns the target of the shim data found for `name`, or an empty string if the lookup failed.
+    std::u16string find_target(const Bytes& index_data, std::u16string_view name) {
+        MulticallIndex index{index_data.data(), index_data.size()};
+        if (index.validate()) return u"<invalid index>";
+        auto shim_data = index.find({name.data(), name.size()});
+        if (!shim_data) return u"";
+        if (validate_shim_data(*shim_data)) return u"<invalid shim data>";
+        return ShimData{*shim_data}.get_target();
+    }
+}
+
+TEST(multicall_find) {
+    auto index_data = MulticallIndexBuilder::encode(make_entries(1000));
+    CHECK(MulticallIndex(index_data.data(), index_data.size()).entry_count() == 1000);
+    CHECK(find_target(index_data, u"command-0.exe") == u"C:\\pkg\\command-0.exe");
+    CHECK(find_target(index_data, u"command-999.exe") == u"C:\\pkg\\command-999.exe");
+    // names are case-insensitive, but the original casing is kept in the shim data
+    CHECK(find_target(index_data, u"COMMAND-42.EXE") == u"C:\\pkg\\command-42.exe");
+
+    CHECK(find_target(index_data, u"command-1000.exe").empty());
+    CHECK(find_target(index_data, u"command-42").empty());
+    CHECK(find_target(index_data, u"").empty());
+
+    for (auto& entry : make_entries(1000)) {
+        if (find_target(index_data, entry.name) != u"C:\\pkg\\" + entry.name) {
+            test::fail(__FILE__, __LINE__, ("lookup of " + test::narrow(entry.name)).c_str());
+        }
+    }
+}
+
+TEST(multicall_empty_index) {
+    auto index_data = MulticallIndexBuilder::encode({});
+    CHECK(find_target(index_data, u"x.exe").empty());
+}
+
+TEST(multicall_command_name) {
+    auto name = [](const wchar* path) {
+        auto n = multicall_command_name(path);
+        return std::u16string{n.data(), n.size()};
+    };
+    CHECK(name(u"C:\\Users\\user\\Pog\\data\\package_bin\\code.exe") == u"code.exe");
+    CHECK(name(u"\\\\?\\C:\\bin/7z.exe") == u"7z.exe");
+    CHECK(name(u"code.exe") == u"code.exe");
+    CHECK(name(u"C:\\bin\\").empty());
+}
+
+TEST(multicall_invalid_header) {
+    auto index_data = MulticallIndexBuilder::encode(make_entries(4));
+    auto validate = [](const Bytes& d) { return MulticallIndex{d.data(), d.size()}.validate(); };
+    CHECK(validate(index_data) == nullptr);
+
+    auto bad_magic = index_data;
+    bad_magic[0] ^= 1;
+    CHECK(validate(bad_magic) != nullptr);
+
+    auto bad_version = index_data;
+    bad_version[offsetof(MulticallIndexHeader, version)] = 2;
+    CHECK(validate(bad_version) != nullptr);
+
+    auto bad_buckets = index_data;
+    bad_buckets[offsetof(MulticallIndexHeader, bucket_count)] = 3;
+    CHECK(validate(bad_buckets) != nullptr);
+
+    for (size_t size = 0; size < sizeof(MulticallIndexHeader) + 8 * sizeof(uint32_t); size++) {
+        if (!validate({index_data.begin(), index_data.begin() + (ptrdiff_t) size})) {
+            test::fail(__FILE__, __LINE__, ("truncated to " + std::to_string(size) + " bytes").c_str());
+        }
+    }
+}
+
+TEST(multicall_corrupted_entries) {
+    // lookups in a truncated or corrupted index must either fail, or return shim data inside the index
+    auto entries = make_entries(16);
+    auto index_data = MulticallIndexBuilder::encode(entries);
+    auto check_lookups = [&](const Bytes& d, const std::string& what) {
+        MulticallIndex index{d.data(), d.size()};
+        if (index.validate()) return;
+        for (auto& entry : entries) {
+            auto found = index.find({entry.name.data(), entry.name.size()});
+            if (found && (found->data() < d.data() || found->data() + found->size() > d.data() + d.size())) {
+                test::fail(__FILE__, __LINE__, ("out of bounds lookup after " + what).c_str());
+            }
+        }
+    };
+
+    for (size_t size = 0; size < index_data.size(); size++) {
+        check_lookups({index_data.begin(), index_data.begin() + (ptrdiff_t) size},
+                      "truncation to " + std::to_string(size));
+    }
+    for (size_t i = 0; i < index_data.size(); i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            auto corrupted = index_data;
+            corrupted[i] ^= 1 << bit;
+            check_lookups(corrupted, "bit flip at " + std::to_string(i));
+        }
+    }
+}
@@ -0,0 +1,184 @@
+// Tests of the portable shim core against payloads produced by the C++ port of `ShimDataEncoder`.
+
+#include <string>
+#include "ShimData.hpp"
+#include "CommandLine.hpp"
+#include "os.hpp"
+#include "../host/ShimDataBuilder.hpp"
+#include "../host/test.hpp"
+
+using host::EnvVarTemplate;
+using host::ShimDataBuilder;
+using host::ShimSpec;
+
+namespace {
+    std::u16string cmd_line(const wchar* orig, const ShimSpec& spec, uint16_t version) {
+        auto encoded = ShimDataBuilder::encode(spec, version);
+        ShimData shim_data{{encoded.data(), encoded.size()}};
+        auto out = build_target_command_line(shim_data, orig);
+        return {out.data(), out.size() - 1};
+    }
+
+    /// Builds the command line from both v4 and v5 shim data, and checks that the results are identical.
+    std::u16string cmd_line(const wchar* orig, const ShimSpec& spec) {
+        auto v4 = cmd_line(orig, spec, 4);
+        auto v5 = cmd_line(orig, spec, 5);
+        return v4 == v5 ? v5 : u"<v4/v5 mismatch: " + v4 + u" vs. " + v5 + u">";
+    }
+
+    std::u16string env_value(const ShimSpec& spec, const char16_t* name) {
+        auto encoded = ShimDataBuilder::encode(spec);
+        ShimData shim_data{{encoded.data(), encoded.size()}};
+        std::u16string result = u"<not set>";
+        shim_data.enumerate_environment_variables([&](auto n, auto v) {
+            if (std::u16string_view{n} == name) result = v;
+        });
+        return result;
+    }
+
+    ShimSpec env_spec(const char16_t* name, EnvVarTemplate value) {
+        return {.target = u"C:\\x.exe", .environment = {{{name, std::move(value)}}}};
+    }
+}
+
+TEST(argv0_end) {
+    CHECK_EQ_STR(find_argv0_end(u"prog a b"), u" a b");
+    CHECK_EQ_STR(find_argv0_end(u"\"C:\\Program Files\\prog\" a"), u" a");
+    CHECK_EQ_STR(find_argv0_end(u"C:\\a\" b\"c\td"), u"\td");
+    CHECK_EQ_STR(find_argv0_end(u"prog"), u"");
+    CHECK_EQ_STR(find_argv0_end(u" prog"), u" prog");
+}
+
+TEST(decode_fields) {
+    auto encoded = ShimDataBuilder::encode({
+        .target = u"C:\\target.exe", .working_directory = u"C:\\wd", .arguments = u"--a \"b c\"",
+        .replace_argv0 = true,
+    });
+    ShimData shim_data{{encoded.data(), encoded.size()}};
+    CHECK(shim_data.version() == 5);
+    CHECK(HAS_FLAG(shim_data.flags(), REPLACE_ARGV0));
+    CHECK(!HAS_FLAG(shim_data.flags(), NULL_TARGET));
+    CHECK_EQ_STR(shim_data.get_target(), u"C:\\target.exe");
+    CHECK_EQ_STR(shim_data.get_working_directory(), u"C:\\wd");
+    auto args = shim_data.get_arguments();
+    CHECK(args);
+    CHECK_EQ_STR(std::u16string_view(args->data(), args->size()), u"--a \"b c\"");
+}
+
+TEST(decode_v4) {
+    auto encoded = ShimDataBuilder::encode({.target = u"C:\\target.exe", .arguments = u"--a", .replace_argv0 = true}, 4);
+    ShimData shim_data{{encoded.data(), encoded.size()}};
+    CHECK(shim_data.version() == 4);
+    CHECK(!shim_data.get_command_line_prefix());
+    CHECK_EQ_STR(shim_data.get_target(), u"C:\\target.exe");
+}
+
+TEST(decode_command_line_prefix) {
+    auto encoded = ShimDataBuilder::encode({.target = u"C:\\target.exe", .arguments = u"--a", .replace_argv0 = true});
+    auto prefix = ShimData{{encoded.data(), encoded.size()}}.get_command_line_prefix();
+    CHECK(prefix);
+    CHECK_EQ_STR(std::u16string_view(prefix->data(), prefix->size()), u"\"C:\\target.exe\" --a");
+
+    // nothing to insert, the prefix is empty
+    encoded = ShimDataBuilder::encode({.target = u"C:\\target.exe"});
+    prefix = ShimData{{encoded.data(), encoded.size()}}.get_command_line_prefix();
+    CHECK(prefix);
+    CHECK(prefix->size() == 0);
+}
+
+TEST(decode_optional_fields) {
+    auto encoded = ShimDataBuilder::encode({.target = u"C:\\target.exe"});
+    ShimData shim_data{{encoded.data(), encoded.size()}};
+    CHECK(shim_data.get_working_directory() == nullptr);
+    CHECK(!shim_data.get_arguments());
+    auto count = 0;
+    shim_data.enumerate_environment_variables([&](auto, auto) { count++; });
+    CHECK(count == 0);
+}
+
+TEST(required_features) {
+    auto features = [](const ShimSpec& spec, uint16_t version) {
+        auto encoded = ShimDataBuilder::encode(spec, version);
+        return ShimData{{encoded.data(), encoded.size()}}.required_features();
+    };
+    auto env = std::vector<std::pair<std::u16string, EnvVarTemplate>>{{u"X", EnvVarTemplate::parse({u"1"})}};
+
+    for (uint16_t version : {4, 5}) {
+        CHECK(features({.target = u"C:\\x.exe"}, version) == ShimFeature::NONE);
+        CHECK(features({.target = u"C:\\x.exe", .working_directory = u"C:\\"}, version) == ShimFeature::NONE);
+        CHECK(features({.target = u"C:\\x.exe", .environment = {{}}}, version) == ShimFeature::NONE);
+        CHECK(features({.target = u"C:\\x.exe", .environment = env}, version) == ShimFeature::ENVIRONMENT);
+        CHECK(features({.target = u"C:\\x.exe", .arguments = u""}, version) == ShimFeature::ARGUMENTS);
+        CHECK(features({.target = u"C:\\x.exe", .replace_argv0 = true}, version) == ShimFeature::ARGUMENTS);
+        CHECK(features({.target = u"C:\\x.cmd", .replace_argv0 = true, .null_target = true}, version)
+              == ShimFeature::ARGUMENTS);
+        CHECK(features({.target = u"C:\\x.exe", .arguments = u"a", .environment = env}, version) == ShimFeature::ALL);
+    }
+}
+
+TEST(cmdline_keep_argv0) {
+    CHECK_EQ_STR(cmd_line(u"shim.exe a b", {.target = u"C:\\t.exe"}), u"shim.exe a b");
+    CHECK_EQ_STR(cmd_line(u"shim.exe", {.target = u"C:\\t.exe"}), u"shim.exe");
+    CHECK_EQ_STR(cmd_line(u"shim.exe a", {.target = u"C:\\t.exe", .arguments = u"--x"}), u"shim.exe --x a");
+}
+
+TEST(cmdline_replace_argv0) {
+    CHECK_EQ_STR(cmd_line(u"\"my shim\" a", {.target = u"C:\\my target.exe", .replace_argv0 = true}),
+                 u"\"C:\\my target.exe\" a");
+    CHECK_EQ_STR(cmd_line(u"shim", {.target = u"C:\\t.cmd", .arguments = u"/c x", .null_target = true}),
+                 u"\"C:\\t.cmd\" /c x");
+    CHECK_EQ_STR(cmd_line(u"shim.exe \"a b\"\tc", {.target = u"C:\\t.exe", .arguments = u"--x", .replace_argv0 = true}),
+                 u"\"C:\\t.exe\" --x \"a b\"\tc");
+}
+
+TEST(env_literal) {
+    CHECK_EQ_STR(env_value(env_spec(u"X", EnvVarTemplate::parse({u"value"})), u"X"), u"value");
+    CHECK_EQ_STR(env_value(env_spec(u"X", EnvVarTemplate::parse({})), u"X"), u"");
+    CHECK_EQ_STR(env_value(env_spec(u"X", EnvVarTemplate::parse({u"100%%"})), u"X"), u"100%");
+}
+
+TEST(env_interpolation) {
+    os::host::clear_environment();
+    os::set_env_var(u"HOME", u"C:\\Users\\user");
+    os::set_env_var(u"PATH", u"C:\\a;C:\\b");
+
+    CHECK_EQ_STR(env_value(env_spec(u"X", EnvVarTemplate::parse({u"%HOME%"})), u"X"), u"C:\\Users\\user");
+    CHECK_EQ_STR(env_value(env_spec(u"X", EnvVarTemplate::parse({u"%home%\\data"})), u"X"), u"C:\\Users\\user\\data");
+    CHECK_EQ_STR(env_value(env_spec(u"X", EnvVarTemplate::parse({u"%MISSING%"})), u"X"), u"");
+    CHECK_EQ_STR(env_value(env_spec(u"PATH", EnvVarTemplate::parse({u"C:\\pkg", u"%PATH%", u"%HOME%\\bin"})), u"PATH"),
+                 u"C:\\pkg;C:\\a;C:\\b;C:\\Users\\user\\bin");
+    // missing variables do not produce empty list items
+    CHECK_EQ_STR(env_value(env_spec(u"PATH", EnvVarTemplate::parse({u"%MISSING%", u"C:\\x", u"%MISSING%"})), u"PATH"),
+                 u"C:\\x");
+}
+
+TEST(env_each_variable_read_once) {
+    os::host::clear_environment();
+    os::set_env_var(u"HOME", u"C:\\Users\\user");
+
+    auto reads_before = os::host::env_var_read_count();
+    CHECK_EQ_STR(env_value(env_spec(u"X", EnvVarTemplate::parse({u"%HOME%\\a", u"%MISSING%", u"%home%\\b",
+                                                                    u"%MISSING%\\c", u"%HOME%"})), u"X"),
+                 u"C:\\Users\\user\\a;C:\\Users\\user\\b;\\c;C:\\Users\\user");
+    CHECK(os::host::env_var_read_count() - reads_before == 2);
+}
+
+TEST(env_long_values) {
+    os::host::clear_environment();
+    std::u16string long_value(20'000, u'x');
+    os::set_env_var(u"LONG", long_value.c_str());
+
+    // larger than the initial buffer, must grow it
+    CHECK_EQ_STR(env_value(env_spec(u"X", EnvVarTemplate::parse({u"%LONG%"})), u"X"), long_value);
+    CHECK_EQ_STR(env_value(env_spec(u"X", EnvVarTemplate::parse({u"a", u"%LONG%", u"b"})), u"X"),
+                 u"a;" + long_value + u";b");
+}
+
+TEST(env_recessive) {
+    os::host::clear_environment();
+    os::set_env_var(u"EXISTING", u"original");
+
+    // the existing value is kept, so the variable is not set at all
+    CHECK_EQ_STR(env_value(env_spec(u"EXISTING", EnvVarTemplate::parse({u"new"}, true)), u"EXISTING"), u"<not set>");
+    CHECK_EQ_STR(env_value(env_spec(u"NEW", EnvVarTemplate::parse({u"new", u"x"}, true)), u"NEW"), u"new;x");
+}
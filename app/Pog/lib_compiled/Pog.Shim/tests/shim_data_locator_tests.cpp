@@ -0,0 +1,102 @@
+// Tests of the direct shim data lookup (`ShimDataLocator.hpp`) on synthetic loaded shim images.
+
+#include "ShimDataLocator.hpp"
+#include "ShimDataValidator.hpp"
+#include "../host/ShimDataBuilder.hpp"
+#include "../host/ShimImageBuilder.hpp"
+#include "../host/test.hpp"
+
+using host::ShimImageBuilder;
+
+namespace {
+    std::vector<unsigned char> sample_shim_data() {
+        return host::ShimDataBuilder::encode({.target = u"C:\\pkg\\app\\code.exe", .arguments = u"--portable"});
+    }
+
+    optional<ShimDataBuffer> locate(const host::ShimImage& image) {
+        return locate_shim_data(image.image.data());
+    }
+}
+
+TEST(shim_data_locator_found) {
+    auto shim_data = sample_shim_data();
+    for (auto pe32_plus : {true, false}) {
+        for (size_t icon_count : {0, 3}) {
+            auto image = ShimImageBuilder::build({
+                .shim_data = shim_data, .icon_count = icon_count, .pe32_plus = pe32_plus});
+            auto located = locate(image);
+            CHECK(located);
+            if (!located) continue;
+            CHECK(located->data() == image.image.data() + image.shim_data_rva);
+            CHECK(located->size() == shim_data.size());
+            CHECK(!validate_shim_data(*located));
+
+            // the same data as found through the resource directory
+            uint32_t size = 0;
+            auto found = host::find_resource_data(image.image.data(), ShimImageBuilder::RT_RCDATA, 1, &size);
+            CHECK(found == located->data() && size == located->size());
+        }
+    }
+}
+
+TEST(shim_data_locator_missing) {
+    auto image = ShimImageBuilder::build({.shim_data = sample_shim_data(), .write_locator = false});
+    CHECK(!locate(image));
+    // the resource lookup still works
+    uint32_t size;
+    CHECK(host::find_resource_data(image.image.data(), ShimImageBuilder::RT_RCDATA, 1, &size) != nullptr);
+
+    // not a PE image
+    auto not_pe = ShimImageBuilder::build({.shim_data = sample_shim_data()});
+    not_pe.image[0] = 0;
+    CHECK(!locate(not_pe));
+}
+
+TEST(shim_data_locator_invalid) {
+    auto base = ShimImageBuilder::build({.shim_data = sample_shim_data(), .icon_count = 2});
+    auto with_locator = [&](uint32_t rva, uint32_t size) {
+        auto image = base;
+        ShimImageBuilder::write_u32(image.image, image.locator_offset + 8, rva);
+        ShimImageBuilder::write_u32(image.image, image.locator_offset + 12, size);
+        return locate(image);
+    };
+    CHECK(with_locator(base.shim_data_rva, 16));
+
+    // outside of the resource directory, or crossing its end
+    CHECK(!with_locator(0x1000, 16));
+    CHECK(!with_locator(base.resource_rva + base.resource_size, 8));
+    CHECK(!with_locator(base.resource_rva + base.resource_size - 8, 16));
+    CHECK(!with_locator(base.resource_rva, base.resource_size + 1));
+    CHECK(!with_locator(0xffff'fff0, 0x20));
+    // empty or misaligned
+    CHECK(!with_locator(base.shim_data_rva, 0));
+    CHECK(!with_locator(base.shim_data_rva + 2, 16));
+
+    // a wrong magic
+    auto image = base;
+    image.image[image.locator_offset] ^= 1;
+    CHECK(!locate(image));
+
+    // no space for the locator in the headers
+    image = base;
+    ShimImageBuilder::write_u32(image.image, 0xfc + 20 + 60, (uint32_t) image.locator_offset + 8);
+    CHECK(!locate(image));
+}
+
+TEST(shim_data_locator_stale) {
+    // the resources were rewritten after the locator was written (e.g. by `BeginUpdateResource`), and the locator
+    //  now points at other resource data; the shim must notice and fall back to the resource lookup
+    auto image = ShimImageBuilder::build({.shim_data = sample_shim_data(), .icon_count = 2});
+    auto stale = image;
+    ShimImageBuilder::write_u32(stale.image, stale.locator_offset + 8, image.shim_data_rva - 0x2e8);
+    auto located = locate(stale);
+    CHECK(located && validate_shim_data(*located));
+
+    // same location, but different shim data with the old size
+    auto other = host::ShimDataBuilder::encode({
+        .target = u"C:\\pkg\\app\\other.exe", .arguments = u"--other-and-longer-arguments"});
+    auto moved = ShimImageBuilder::build({.shim_data = other, .icon_count = 2});
+    ShimImageBuilder::write_u32(moved.image, moved.locator_offset + 12, (uint32_t) sample_shim_data().size());
+    located = locate(moved);
+    CHECK(located && validate_shim_data(*located));
+}
@@ -0,0 +1,180 @@
+// Tests of `ShimDataValidator` against valid payloads and payloads corrupted in specific ways.
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ShimDataValidator.hpp"
+#include "../host/ShimDataBuilder.hpp"
+#include "../host/test.hpp"
+
+using host::EnvVarTemplate;
+using host::ShimDataBuilder;
+using host::ShimSpec;
+
+namespace {
+    using Bytes = std::vector<unsigned char>;
+
+    const ShimSpec FULL_SPEC{
+        .target = u"C:\\pkg\\app\\x.exe",
+        .working_directory = u"C:\\pkg\\app",
+        .arguments = u"--data \"C:\\pkg\\data\"",
+        .environment = {{
+            {u"PATH", EnvVarTemplate::parse({u"C:\\pkg\\bin", u"%PATH%"})},
+            {u"HOME", EnvVarTemplate::parse({u"C:\\pkg\\home"}, true)},
+        }},
+        .replace_argv0 = true,
+    };
+
+    const wchar_t* validate(const Bytes& data) {
+        return validate_shim_data({data.data(), data.size()});
+    }
+
+    uint32_t read_u32(const Bytes& data, size_t offset) {
+        uint32_t n;
+        memcpy(&n, &data[offset], sizeof(n));
+        return n;
+    }
+
+    void write_u32(Bytes& data, size_t offset, uint32_t n) {
+        memcpy(&data[offset], &n, sizeof(n));
+    }
+
+    /// Recomputes the checksum after the v5 payload was modified, so that the bounds checks are exercised.
+    Bytes with_checksum(Bytes data) {
+        write_u32(data, offsetof(ShimHeader, checksum), 0);
+        write_u32(data, offsetof(ShimHeader, checksum), shim_data_checksum(data.data(), data.size()));
+        return data;
+    }
+
+    bool is_error(const wchar_t* error, const wchar_t* expected) {
+        return error && std::wstring_view{error} == expected;
+    }
+}
+
+TEST(validator_accepts_valid_data) {
+    CHECK(validate(ShimDataBuilder::encode(FULL_SPEC)) == nullptr);
+    CHECK(validate(ShimDataBuilder::encode(FULL_SPEC, 4)) == nullptr);
+    CHECK(validate(ShimDataBuilder::encode({.target = u"C:\\x.exe"})) == nullptr);
+    CHECK(validate(ShimDataBuilder::encode({.target = u"C:\\x.exe"}, 4)) == nullptr);
+    CHECK(validate(ShimDataBuilder::encode({.target = u"C:\\x.exe", .detached = true})) == nullptr);
+}
+
+TEST(validator_rejects_truncated_data) {
+    auto data = ShimDataBuilder::encode(FULL_SPEC);
+    for (size_t size = 0; size < data.size(); size++) {
+        if (!validate({data.begin(), data.begin() + (ptrdiff_t) size})) {
+            test::fail(__FILE__, __LINE__, ("truncated to " + std::to_string(size) + " bytes").c_str());
+        }
+    }
+}
+
+TEST(validator_rejects_corrupted_bytes) {
+    auto data = ShimDataBuilder::encode(FULL_SPEC);
+    for (size_t i = 0; i < data.size(); i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            // changes the version from 5 to 4, which is valid v4 data with an unused tail
+            if (i == 0 && bit == 0) continue;
+            auto corrupted = data;
+            corrupted[i] ^= 1 << bit;
+            if (!validate(corrupted)) {
+                test::fail(__FILE__, __LINE__, ("bit flip at " + std::to_string(i)).c_str());
+            }
+        }
+    }
+}
+
+TEST(validator_header) {
+    auto data = ShimDataBuilder::encode(FULL_SPEC);
+
+    auto bad_version = data;
+    bad_version[0] = 3;
+    CHECK(is_error(validate(with_checksum(bad_version)), L"Incorrect Pog shim data version, this shim expects v4 or v5."));
+
+    auto bad_flags = data;
+    bad_flags[3] = 0x80;
+    CHECK(is_error(validate(with_checksum(bad_flags)), L"Invalid Pog shim data: unknown flags."));
+
+    auto no_target = data;
+    write_u32(no_target, offsetof(ShimHeader, target_offset), 0);
+    CHECK(is_error(validate(with_checksum(no_target)), L"Invalid Pog shim data: missing target path."));
+}
+
+TEST(validator_offsets_out_of_bounds) {
+    for (uint16_t version : {4, 5}) {
+        auto data = ShimDataBuilder::encode(FULL_SPEC, version);
+        auto fix = [&](Bytes d) { return version >= 5 ? with_checksum(std::move(d)) : d; };
+
+        for (auto offset : {(uint32_t) data.size(), (uint32_t) -2, (uint32_t) 1}) {
+            auto d = data;
+            write_u32(d, offsetof(ShimHeader, target_offset), offset);
+            CHECK(is_error(validate(fix(d)), L"Invalid Pog shim data: invalid target path."));
+
+            d = data;
+            write_u32(d, offsetof(ShimHeader, argument_offset), offset);
+            CHECK(is_error(validate(fix(d)), L"Invalid Pog shim data: invalid arguments."));
+
+            d = data;
+            write_u32(d, offsetof(ShimHeader, environment_offset), offset);
+            CHECK(is_error(validate(fix(d)), L"Invalid Pog shim data: invalid environment variable table."));
+        }
+
+        // argument length pointing past the end of the buffer
+        auto d = data;
+        auto args_offset = read_u32(d, offsetof(ShimHeader, argument_offset));
+        write_u32(d, args_offset, (uint32_t) d.size());
+        CHECK(is_error(validate(fix(d)), L"Invalid Pog shim data: invalid arguments."));
+
+        // huge env var count, must not overflow
+        d = data;
+        auto env_offset = read_u32(d, offsetof(ShimHeader, environment_offset));
+        write_u32(d, env_offset, 0x8000'0000);
+        CHECK(is_error(validate(fix(d)), L"Invalid Pog shim data: truncated environment variable table."));
+    }
+}
+
+TEST(validator_env_segments) {
+    // a single env var with a single segment, placed at the end of the shim data
+    auto data = ShimDataBuilder::encode({.target = u"C:\\x.exe", .environment = {{{u"X", EnvVarTemplate::parse({u"abc"})}}}});
+    auto env_offset = read_u32(data, offsetof(ShimHeader, environment_offset));
+    auto segment_offset = read_u32(data, env_offset + 2 * sizeof(uint32_t));
+    auto flags_offset = segment_offset + sizeof(uint32_t);
+    CHECK(validate(data) == nullptr);
+
+    // missing LAST_SEGMENT, the walk would continue past the end
+    auto d = data;
+    d[flags_offset] &= ~4;
+    CHECK(is_error(validate(with_checksum(d)), L"Invalid Pog shim data: invalid environment variable segment."));
+
+    // missing null terminator
+    d = data;
+    write_u32(d, segment_offset, 2);
+    CHECK(is_error(validate(with_checksum(d)), L"Invalid Pog shim data: invalid environment variable segment."));
+
+    // segment size larger than the shim data
+    d = data;
+    write_u32(d, segment_offset, 0xffff'ffff);
+    CHECK(is_error(validate(with_checksum(d)), L"Invalid Pog shim data: invalid environment variable segment."));
+
+    // misaligned segment
+    d = data;
+    write_u32(d, env_offset + 2 * sizeof(uint32_t), segment_offset + 2);
+    CHECK(is_error(validate(with_checksum(d)), L"Invalid Pog shim data: invalid environment variable segment."));
+
+    // unknown flag
+    d = data;
+    d[flags_offset] |= 0x40;
+    CHECK(is_error(validate(with_checksum(d)), L"Invalid Pog shim data: invalid environment variable segment flags."));
+
+    // RECESSIVE on a later segment
+    auto multi = ShimDataBuilder::encode({.target = u"C:\\x.exe", .environment = {{{u"X", EnvVarTemplate::parse({u"a", u"b"})}}}});
+    auto multi_env_offset = read_u32(multi, offsetof(ShimHeader, environment_offset));
+    auto second_segment = read_u32(multi, multi_env_offset + 2 * sizeof(uint32_t)) + 12; // header, "a\0", padding
+    multi[second_segment + sizeof(uint32_t)] |= 8;
+    CHECK(is_error(validate(with_checksum(multi)), L"Invalid Pog shim data: invalid environment variable segment flags."));
+}
+
+TEST(validator_env_value_too_long) {
+    std::u16string long_value(MAX_ENV_VAR_SIZE, u'x');
+    auto data = ShimDataBuilder::encode({.target = u"C:\\x.exe", .environment = {{{u"X", EnvVarTemplate::parse({long_value})}}}});
+    CHECK(is_error(validate(data), L"Invalid Pog shim data: environment variable value too long."));
+}
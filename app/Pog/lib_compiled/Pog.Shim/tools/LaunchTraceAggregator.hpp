@@ -0,0 +1,199 @@
+#pragma once
+
+// Aggregation of the shim launch trace (`LaunchTrace.hpp`) into latency histograms per command, used by
+//  `pog_shim_trace.cpp`. Unlike the trace buffer itself, this is never compiled into the shim, so it uses the standard
+//  library freely.
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "LaunchTrace.hpp"
+
+namespace launch_trace {
+    /// Log-linear histogram of latencies in nanoseconds, in the style of HdrHistogram: values below
+    /// `2^SUB_BUCKET_BITS` are stored exactly, larger values in `2^SUB_BUCKET_BITS` linear sub-buckets per power of 2,
+    /// so the relative error of a reported value is below `2^-SUB_BUCKET_BITS` (~3%), at any magnitude.
+    class LatencyHistogram {
+    public:
+        static constexpr unsigned SUB_BUCKET_BITS = 5;
+        static constexpr uint64_t SUB_BUCKET_COUNT = 1u << SUB_BUCKET_BITS;
+
+    private:
+        std::vector<uint64_t> buckets_;
+        uint64_t count_ = 0;
+        uint64_t min_ = UINT64_MAX;
+        uint64_t max_ = 0;
+        long double sum_ = 0;
+
+        static unsigned shift_of(uint64_t value) {
+            auto width = (unsigned) std::bit_width(value);
+            return width <= SUB_BUCKET_BITS ? 0 : width - SUB_BUCKET_BITS - 1;
+        }
+
+    public:
+        static size_t bucket_index(uint64_t value) {
+            auto shift = shift_of(value);
+            return shift * SUB_BUCKET_COUNT + (size_t) (value >> shift);
+        }
+
+        /// Largest value stored in the bucket `index`.
+        static uint64_t bucket_upper_bound(size_t index) {
+            if (index < 2 * SUB_BUCKET_COUNT) return index;
+            auto shift = index / SUB_BUCKET_COUNT - 1;
+            auto sub_bucket = index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+            return ((sub_bucket + 1) << shift) - 1;
+        }
+
+        void record(uint64_t value) {
+            auto index = bucket_index(value);
+            if (index >= buckets_.size()) buckets_.resize(index + 1, 0);
+            buckets_[index]++;
+            count_++;
+            min_ = std::min(min_, value);
+            max_ = std::max(max_, value);
+            sum_ += value;
+        }
+
+        void merge(const LatencyHistogram& other) {
+            if (other.buckets_.size() > buckets_.size()) buckets_.resize(other.buckets_.size(), 0);
+            for (size_t i = 0; i < other.buckets_.size(); i++) buckets_[i] += other.buckets_[i];
+            count_ += other.count_;
+            min_ = std::min(min_, other.min_);
+            max_ = std::max(max_, other.max_);
+            sum_ += other.sum_;
+        }
+
+        [[nodiscard]] uint64_t count() const { return count_; }
+        [[nodiscard]] uint64_t min() const { return count_ ? min_ : 0; }
+        [[nodiscard]] uint64_t max() const { return max_; }
+        [[nodiscard]] double mean() const { return count_ ? (double) (sum_ / count_) : 0; }
+
+        /// Returns the value below which `percentile` % of the recorded values are (the upper bound of the bucket
+        /// containing it, but at most the maximum recorded value).
+        [[nodiscard]] uint64_t value_at_percentile(double percentile) const {
+            if (count_ == 0) return 0;
+            auto rank = (uint64_t) (percentile / 100.0 * (double) count_ + 0.5);
+            rank = std::clamp<uint64_t>(rank, 1, count_);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < buckets_.size(); i++) {
+                seen += buckets_[i];
+                if (seen >= rank) return std::min(bucket_upper_bound(i), max_);
+            }
+            return max_;
+        }
+    };
+
+    struct CommandStats {
+        uint64_t launches = 0;
+        /// Duration of each phase (the time since the previous reached phase), `START` is unused.
+        LatencyHistogram phases[LAUNCH_PHASE_COUNT];
+        /// Time from the start of the shim until the target was created, i.e. the overhead of the shim.
+        LatencyHistogram overhead;
+    };
+
+    struct Report {
+        /// Estimated frequency of the cycle counter, 0 if there are no records.
+        double cycles_per_second = 0;
+        uint64_t record_count = 0;
+        std::map<std::u16string, CommandStats> commands;
+    };
+
+    /// Estimates the cycle counter frequency from the reference clock spans of all records.
+    inline double calibrate(const std::vector<LaunchTraceRecord>& records, uint64_t reference_frequency) {
+        long double cycles = 0, reference_ticks = 0;
+        for (auto& r : records) {
+            if (!(r.phase_mask & 1) || r.reference_end <= r.reference_start || r.cycles_end <= r.cycles[0]) continue;
+            cycles += r.cycles_end - r.cycles[0];
+            reference_ticks += r.reference_end - r.reference_start;
+        }
+        if (reference_ticks == 0 || reference_frequency == 0) return 0;
+        return (double) (cycles / (reference_ticks / reference_frequency));
+    }
+
+    inline Report aggregate(const std::vector<LaunchTraceRecord>& records, uint64_t reference_frequency) {
+        Report report{};
+        report.cycles_per_second = calibrate(records, reference_frequency);
+        report.record_count = records.size();
+        if (report.cycles_per_second == 0) return report;
+        auto to_ns = [&](uint64_t cycles) {
+            return (uint64_t) ((long double) cycles * 1e9 / report.cycles_per_second);
+        };
+
+        for (auto& r : records) {
+            if (!(r.phase_mask & 1)) continue;
+            auto name_size = std::min<size_t>(r.name_size, LAUNCH_TRACE_NAME_SIZE);
+            auto& stats = report.commands[std::u16string(r.name, r.name + name_size)];
+            stats.launches++;
+            auto previous = r.cycles[0];
+            for (size_t phase = 1; phase < LAUNCH_PHASE_COUNT; phase++) {
+                if (!(r.phase_mask & (1u << phase))) continue;
+                // the cycle counter of each core is synchronized, but guard against a broken one anyway
+                stats.phases[phase].record(to_ns(r.cycles[phase] >= previous ? r.cycles[phase] - previous : 0));
+                previous = r.cycles[phase];
+            }
+            auto process_created = (size_t) LaunchPhase::PROCESS_CREATED;
+            if (r.phase_mask & (1u << process_created) && r.cycles[process_created] >= r.cycles[0]) {
+                stats.overhead.record(to_ns(r.cycles[process_created] - r.cycles[0]));
+            }
+        }
+        return report;
+    }
+
+    inline const char* phase_name(size_t phase) {
+        static const char* names[] = {"start", "shim data", "command line", "environment", "CreateProcess", "child"};
+        static_assert(std::size(names) == LAUNCH_PHASE_COUNT);
+        return names[phase];
+    }
+
+    inline std::string utf8(std::u16string_view str) {
+        std::string out;
+        for (auto c : str) {
+            if (c < 0x80) {
+                out.push_back((char) c);
+            } else if (c < 0x800) {
+                out.push_back((char) (0xc0 | c >> 6));
+                out.push_back((char) (0x80 | (c & 0x3f)));
+            } else {
+                // surrogates are encoded one by one, the names are only printed
+                out.push_back((char) (0xe0 | c >> 12));
+                out.push_back((char) (0x80 | (c >> 6 & 0x3f)));
+                out.push_back((char) (0x80 | (c & 0x3f)));
+            }
+        }
+        return out;
+    }
+
+    /// Formats the report as a table for each command, with latencies in microseconds.
+    inline std::string format(const Report& report) {
+        std::string out;
+        char line[160];
+        snprintf(line, sizeof(line), "%llu launches, cycle counter at %.3f GHz\n",
+                 (unsigned long long) report.record_count, report.cycles_per_second / 1e9);
+        out += line;
+
+        auto format_row = [&](const char* name, const LatencyHistogram& h) {
+            if (h.count() == 0) return;
+            snprintf(line, sizeof(line), "  %-14s %8llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", name,
+                     (unsigned long long) h.count(), h.value_at_percentile(50) / 1e3, h.value_at_percentile(90) / 1e3,
+                     h.value_at_percentile(99) / 1e3, h.max() / 1e3, h.mean() / 1e3);
+            out += line;
+        };
+        for (auto& [name, stats] : report.commands) {
+            out += '\n';
+            out += utf8(name);
+            out += " (" + std::to_string(stats.launches) + " launches)\n";
+            snprintf(line, sizeof(line), "  %-14s %8s %10s %10s %10s %10s %10s\n", "phase [us]", "count", "p50", "p90",
+                     "p99", "max", "mean");
+            out += line;
+            for (size_t phase = 1; phase < LAUNCH_PHASE_COUNT; phase++) {
+                format_row(phase_name(phase), stats.phases[phase]);
+            }
+            format_row("shim overhead", stats.overhead);
+        }
+        return out;
+    }
+}
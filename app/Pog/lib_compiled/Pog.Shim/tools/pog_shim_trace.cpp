@@ -0,0 +1,98 @@
+// Reads the shim launch trace (`LaunchTrace.hpp`) written by shims started with `POG_SHIM_TRACE=<trace file>`,
+//  and prints latency histograms of each launch phase per command:
+//  PogShimTrace <trace file>
+//
+// The trace file is mapped read-only, so it can be read while shims are appending to it.
+
+#include <cstdio>
+#include <vector>
+#include "LaunchTrace.hpp"
+#include "LaunchTraceAggregator.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    /// Read-only mapping of the whole trace file.
+    class FileView {
+    private:
+        const byte* data_ = nullptr;
+        size_t size_ = 0;
+
+    public:
+        explicit FileView(const char* path) {
+#ifdef _WIN32
+            auto file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return;
+            LARGE_INTEGER size;
+            if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+                if (auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)) {
+                    data_ = (const byte*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    size_ = data_ ? (size_t) size.QuadPart : 0;
+                    CloseHandle(mapping);
+                }
+            }
+            CloseHandle(file);
+#else
+            auto fd = ::open(path, O_RDONLY);
+            if (fd < 0) return;
+            struct stat st{};
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                auto view = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                if (view != MAP_FAILED) {
+                    data_ = (const byte*) view;
+                    size_ = (size_t) st.st_size;
+                }
+            }
+            close(fd);
+#endif
+        }
+
+        ~FileView() {
+            if (!data_) return;
+#ifdef _WIN32
+            UnmapViewOfFile(data_);
+#else
+            munmap((void*) data_, size_);
+#endif
+        }
+
+        FileView(const FileView&) = delete;
+        FileView& operator=(const FileView&) = delete;
+
+        [[nodiscard]] const byte* data() const { return data_; }
+        [[nodiscard]] size_t size() const { return size_; }
+    };
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+        return 2;
+    }
+
+    FileView view{argv[1]};
+    if (!view.data()) {
+        fprintf(stderr, "Cannot open the trace file '%s'.\n", argv[1]);
+        return 1;
+    }
+    auto buffer = LaunchTraceBuffer::open(view.data(), view.size());
+    if (!buffer) {
+        fprintf(stderr, "'%s' is not a Pog shim trace file, or it was written by a different version of the shim.\n",
+                argv[1]);
+        return 1;
+    }
+
+    std::vector<LaunchTraceRecord> records;
+    buffer->read([&](const LaunchTraceRecord& record) { records.push_back(record); });
+    auto report = launch_trace::aggregate(records, buffer->reference_frequency());
+    fputs(launch_trace::format(report).c_str(), stdout);
+    return 0;
+}
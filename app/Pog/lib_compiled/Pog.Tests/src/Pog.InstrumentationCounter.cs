@@ -0,0 +1,53 @@
+﻿using System.Text;
+using System.Text.Json;
+using Xunit;
+
+namespace Pog.Tests;
+
+public class InstrumentationCounterTests {
+    [Fact]
+    public void TestOpenMetricsExport() {
+        InstrumentationCounter.HashTime.Record(3_000_000);
+
+        using var stream = new MemoryStream();
+        InstrumentationCounter.WriteOpenMetrics(stream);
+        var lines = Encoding.UTF8.GetString(stream.ToArray()).Split('\n');
+
+        Assert.Equal("# EOF", lines[^2]);
+        Assert.Equal("", lines[^1]);
+        Assert.Contains("# TYPE pog_manifest_loads counter", lines);
+        Assert.Contains(lines, l => l.StartsWith("pog_manifest_loads_total "));
+        Assert.Contains("# TYPE pog_hash_seconds histogram", lines);
+        Assert.Contains("# UNIT pog_hash_seconds seconds", lines);
+
+        // the buckets are cumulative and end with +Inf, which equals the count
+        var buckets = lines.Where(l => l.StartsWith("pog_hash_seconds_bucket{")).ToList();
+        Assert.EndsWith("{le=\"+Inf\"}", buckets[^1].Split(' ')[0]);
+        var counts = buckets.Select(l => long.Parse(l.Split(' ')[1])).ToList();
+        Assert.Equal(counts.OrderBy(c => c), counts);
+        Assert.True(counts[^1] >= 1);
+        Assert.Contains($"pog_hash_seconds_count {counts[^1]}", lines);
+        // 3 ms is below 2^22 ns (~4.2 ms), but not below 2^21 ns
+        var bucket4Ms = buckets.Single(l => l.StartsWith("pog_hash_seconds_bucket{le=\"0.004194304\"}"));
+        var bucket2Ms = buckets.Single(l => l.StartsWith("pog_hash_seconds_bucket{le=\"0.002097152\"}"));
+        Assert.True(long.Parse(bucket4Ms.Split(' ')[1]) > long.Parse(bucket2Ms.Split(' ')[1]));
+    }
+
+    [Fact]
+    public void TestJsonExport() {
+        InstrumentationCounter.ExtractionTime.Record(5_000);
+
+        using var stream = new MemoryStream();
+        InstrumentationCounter.WriteJson(stream);
+        using var json = JsonDocument.Parse(stream.ToArray());
+        var root = json.RootElement;
+
+        Assert.True(root.GetProperty("counters").GetProperty("manifest_loads").GetInt64() >= 0);
+        var extraction = root.GetProperty("latencies_ns").GetProperty("extraction");
+        var count = extraction.GetProperty("count").GetInt64();
+        Assert.True(count >= 1);
+        Assert.True(extraction.GetProperty("min").GetInt64() <= 5_000);
+        var buckets = extraction.GetProperty("buckets").EnumerateArray();
+        Assert.Equal(count, buckets.Sum(b => b.GetProperty("count").GetInt64()));
+    }
+}
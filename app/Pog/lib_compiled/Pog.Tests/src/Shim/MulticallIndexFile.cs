@@ -0,0 +1,58 @@
+﻿using System;
+using System.IO;
+using Pog.Shim;
+using Xunit;
+
+namespace Pog.Tests.Shim;
+
+public class MulticallIndexFileTests : IDisposable {
+    private readonly string _tmpDir = Path.Combine(Path.GetTempPath(), $"pog-multicall-{Guid.NewGuid()}");
+
+    public MulticallIndexFileTests() {
+        Directory.CreateDirectory(_tmpDir);
+    }
+
+    public void Dispose() {
+        Directory.Delete(_tmpDir, true);
+    }
+
+    [Fact]
+    public void TestRoundTrip() {
+        var indexPath = Path.Combine(_tmpDir, MulticallIndexFile.IndexFileName);
+        (string, byte[])[] commands = [("code.exe", [1, 2, 3, 4, 5]), ("git.exe", []), ("Ünïcode.exe", [6])];
+        MulticallIndexFile.Write(indexPath, commands);
+
+        var read = MulticallIndexFile.Read(indexPath);
+        Assert.Equal(commands.Length, read.Count);
+        for (var i = 0; i < commands.Length; i++) {
+            Assert.Equal(commands[i].Item1, read[i].CommandName);
+            Assert.Equal(commands[i].Item2, read[i].ShimData);
+        }
+        Assert.True(File.GetAttributes(indexPath).HasFlag(FileAttributes.Hidden));
+
+        // overwrite the existing index
+        MulticallIndexFile.Write(indexPath, [("git.exe", [7])]);
+        Assert.Single(MulticallIndexFile.Read(indexPath));
+    }
+
+    [Fact]
+    public void TestInvalidIndex() {
+        var indexPath = Path.Combine(_tmpDir, MulticallIndexFile.IndexFileName);
+        Assert.Empty(MulticallIndexFile.Read(indexPath));
+
+        var data = MulticallIndexFile.Encode([("code.exe", [1, 2, 3, 4])]);
+        // truncated index is rebuilt from scratch
+        File.WriteAllBytes(indexPath, data.AsSpan(0, data.Length - 4).ToArray());
+        Assert.Empty(MulticallIndexFile.Read(indexPath));
+        // so is an index of a different version
+        data[4] = 2;
+        File.WriteAllBytes(indexPath, data);
+        Assert.Empty(MulticallIndexFile.Read(indexPath));
+    }
+
+    [Fact]
+    public void TestNameHashIgnoresCase() {
+        Assert.Equal(MulticallIndexFile.NameHash("code.exe"), MulticallIndexFile.NameHash("CODE.EXE"));
+        Assert.NotEqual(MulticallIndexFile.NameHash("code.exe"), MulticallIndexFile.NameHash("node.exe"));
+    }
+}
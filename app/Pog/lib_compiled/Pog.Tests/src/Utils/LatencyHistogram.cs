@@ -0,0 +1,112 @@
+﻿using Pog.Utils;
+using Xunit;
+
+namespace Pog.Tests.Utils;
+
+public class LatencyHistogramTests {
+    [Fact]
+    public void TestBucketBoundaries() {
+        for (long v = 1; v < 100_000; v++) {
+            var index = LatencyHistogram.BucketIndex(v);
+            Assert.True(LatencyHistogram.BucketUpperBound(index) >= v);
+            if (LatencyHistogram.BucketIndex(v - 1) != index) {
+                // the buckets are contiguous
+                Assert.Equal(v - 1, LatencyHistogram.BucketUpperBound(index - 1));
+            }
+        }
+        Assert.Equal(LatencyHistogram.MaxTrackableValue,
+                LatencyHistogram.BucketUpperBound(LatencyHistogram.BucketCount - 1));
+    }
+
+    [Fact]
+    public void TestPercentiles() {
+        var histogram = new LatencyHistogram();
+        Assert.Equal(0, histogram.TakeSnapshot().ValueAtPercentile(50));
+
+        for (long v = 1; v <= 100_000; v++) {
+            histogram.Record(v * 1000);
+        }
+        var snapshot = histogram.TakeSnapshot();
+        Assert.Equal(100_000, snapshot.Count);
+        Assert.Equal(1000, snapshot.Min);
+        Assert.Equal(100_000_000, snapshot.Max);
+        Assert.Equal(50_000_500.0, snapshot.Mean, 1);
+        foreach (var p in new[] {1.0, 50.0, 90.0, 99.0, 99.9}) {
+            var expected = p * 1_000_000;
+            var error = Math.Abs(snapshot.ValueAtPercentile(p) - expected) / expected;
+            Assert.True(error < 1.0 / (1 << LatencyHistogram.SubBucketBits), $"p{p}: {snapshot.ValueAtPercentile(p)}");
+        }
+        Assert.Equal(snapshot.Max, snapshot.ValueAtPercentile(100));
+
+        // all values are below 2^27 ns, ~half of them below 2^26 ns
+        Assert.Equal(100_000, snapshot.CountBelowPowerOf2(27));
+        Assert.Equal((1 << 26) / 1000, snapshot.CountBelowPowerOf2(26));
+        Assert.Equal(0, snapshot.CountBelowPowerOf2(9));
+    }
+
+    [Fact]
+    public void TestOutOfRangeValues() {
+        var histogram = new LatencyHistogram();
+        histogram.Record(-5);
+        histogram.Record(long.MaxValue / 2);
+        var snapshot = histogram.TakeSnapshot();
+        Assert.Equal(2, snapshot.Count);
+        Assert.Equal(0, snapshot.Min);
+        Assert.Equal(long.MaxValue / 2, snapshot.Max);
+        Assert.Equal(new[] {(0L, 1L), (LatencyHistogram.MaxTrackableValue, 1L)}, snapshot.EnumerateBuckets());
+    }
+
+    [Fact]
+    public void TestConcurrentRecording() {
+        const int threadCount = 8;
+        const int valuesPerThread = 50_000;
+        var histogram = new LatencyHistogram();
+
+        using var done = new ManualResetEventSlim();
+        // snapshots taken during recording must never see more values than were recorded
+        var inconsistentSnapshots = 0;
+        var reader = new Thread(() => {
+            while (!done.IsSet) {
+                var snapshot = histogram.TakeSnapshot();
+                if (snapshot.Count > threadCount * valuesPerThread || snapshot.Max > threadCount * 1_000_000) {
+                    inconsistentSnapshots++;
+                }
+            }
+        });
+        reader.Start();
+
+        // the threads exit before the final snapshot, their values must be kept
+        var threads = Enumerable.Range(0, threadCount).Select(t => new Thread(() => {
+            for (var i = 1; i <= valuesPerThread; i++) {
+                histogram.Record(t * 1_000_000 + i);
+            }
+        })).ToList();
+        threads.ForEach(t => t.Start());
+        threads.ForEach(t => t.Join());
+        done.Set();
+        reader.Join();
+
+        Assert.Equal(0, inconsistentSnapshots);
+
+        var snapshot = histogram.TakeSnapshot();
+        Assert.Equal(threadCount * valuesPerThread, snapshot.Count);
+        Assert.Equal(1, snapshot.Min);
+        Assert.Equal((threadCount - 1) * 1_000_000 + valuesPerThread, snapshot.Max);
+        long expectedSum = 0;
+        for (var t = 0; t < threadCount; t++) {
+            expectedSum += (long) t * 1_000_000 * valuesPerThread + (long) valuesPerThread * (valuesPerThread + 1) / 2;
+        }
+        Assert.Equal(expectedSum, snapshot.Sum);
+    }
+
+    [Fact]
+    public void TestTimer() {
+        var histogram = new LatencyHistogram();
+        using (histogram.Time()) {
+            Thread.Sleep(20);
+        }
+        var snapshot = histogram.TakeSnapshot();
+        Assert.Equal(1, snapshot.Count);
+        Assert.InRange(snapshot.Max, 15_000_000, 10_000_000_000);
+    }
+}
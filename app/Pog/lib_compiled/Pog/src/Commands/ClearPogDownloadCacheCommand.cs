@@ -10,7 +10,8 @@ namespace Pog.Commands;
 /// <para>
 /// The `Clear-PogDownloadCache` cmdlet lists all package archives stored in the local download cache that are older than
 /// the specified date. After confirmation, the archives are deleted. If a deleted archive is currently in use (the package is
-/// currently being installed), a non-terminating error is raised and the entry is left intact.
+/// currently being installed), a non-terminating error is raised and the entry is left intact. If the download cache
+/// is deduplicated, the stored chunks that are no longer used by any archive are deleted afterwards.
 /// </para>
 [PublicAPI]
 [Cmdlet(VerbsCommon.Clear, "PogDownloadCache", DefaultParameterSetName = DaysPS)]
@@ -56,6 +57,7 @@ public sealed class ClearPogDownloadCacheCommand : PogCmdlet {
             }
             WriteInformation($"Removed {deletedCount} package archive{(deletedCount == 1 ? "" : "s")}, " +
                              $"freeing ~{totalSize / Gigabyte:F2} GB of space.");
+            CollectChunks();
         } else {
             var totalSize = 0ul;
             foreach (var entry in entries.OrderByDescending(e => e.Size)) {
@@ -71,6 +73,7 @@ public sealed class ClearPogDownloadCacheCommand : PogCmdlet {
                 foreach (var entry in entries) {
                     DeleteEntry(entry);
                 }
+                CollectChunks();
             } else {
                 WriteHost("No package archives were removed.");
             }
@@ -93,6 +96,15 @@ public sealed class ClearPogDownloadCacheCommand : PogCmdlet {
         }
     }
 
+    /// With deduplication, the listed sizes are the sizes of the archives, and the space is only freed once the chunks
+    /// unique to the deleted archives are collected.
+    private void CollectChunks() {
+        var freed = _cache.CollectChunks();
+        if (freed > 0) {
+            WriteVerbose($"Deleted unused deduplicated chunks, freeing {freed / Megabyte:F2} MB of space.");
+        }
+    }
+
     private static string GetEntryOwnerStr(SharedFileCache.CacheEntryInfo entry) {
         return string.Join(", ", entry.SourcePackages.Select(s =>
                 s.PackageName + (s.ManifestVersion == null ? "" : $" v{s.ManifestVersion}")));
@@ -106,6 +106,8 @@ public class PogCmdlet : PSCmdlet, IDisposable {
         Debug.Assert(_currentlyExecutingCommands is not {Count: not 0});
 
         _stopping?.Dispose();
+
+        InstrumentationCounter.ExportIfEnabled();
     }
 
     private readonly struct CommandStopContext : IDisposable {
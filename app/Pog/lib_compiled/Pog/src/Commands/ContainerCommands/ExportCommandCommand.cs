@@ -26,6 +26,12 @@ public sealed class ExportCommandCommand : ExportEntryPointCommandBase {
     /// This switch is typically not necessary, but sometimes having a different `argv[0]` breaks the target.
     [Parameter(ParameterSetName = ShimPS)] public SwitchParameter ReplaceArgv0;
 
+    /// If set, the command is exported as a hardlink to a dispatcher shared by all commands of the package exported
+    /// with this switch, and its configuration is stored in a shared index, instead of a separate shim executable
+    /// for each command. This saves disk space and page cache for packages with many commands, but the exported command
+    /// does not have the icon and version information of the target, and -MetadataSource is ignored.
+    [Parameter(ParameterSetName = ShimPS)] public SwitchParameter Multicall;
+
     protected override void BeginProcessing() {
         base.BeginProcessing();
 
@@ -37,6 +43,11 @@ public sealed class ExportCommandCommand : ExportEntryPointCommandBase {
         var useSymlink = ParameterSetName == SymlinkPS;
         var linkExtension = useSymlink ? Path.GetExtension(TargetPath) : ".exe";
 
+        if (Multicall && MetadataSource != null) {
+            WriteWarning("-MetadataSource is ignored for commands exported with -Multicall, since they share a single " +
+                         "binary without any icons or version information.");
+        }
+
         foreach (var name in Name) {
             var exportPath = ctx.Package.GetExportedCommandPath(name, linkExtension);
             if (useSymlink) {
@@ -46,10 +57,11 @@ public sealed class ExportCommandCommand : ExportEntryPointCommandBase {
                     WriteVerbose($"Command {name} is already exported as a symlink.");
                 }
             } else {
-                if (CreateExportShim(exportPath, TargetPath, ReplaceArgv0)) {
-                    WriteInformation($"Exported command '{name}' using a shim executable.");
+                var kind = Multicall ? "a multicall shim" : "a shim executable";
+                if (CreateExportShim(exportPath, TargetPath, ReplaceArgv0, Multicall)) {
+                    WriteInformation($"Exported command '{name}' using {kind}.");
                 } else {
-                    WriteVerbose($"Command {name} is already exported as a shim executable.");
+                    WriteVerbose($"Command {name} is already exported as {kind}.");
                 }
             }
 
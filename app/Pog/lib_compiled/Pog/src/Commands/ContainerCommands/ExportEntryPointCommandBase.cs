@@ -54,8 +54,14 @@ public class ExportEntryPointCommandBase : PogCmdlet {
     /// (vcruntime140.dll and similar) is added to PATH. The redistributable libraries are shipped with Pog.
     [Parameter(ParameterSetName = ShimPS)] public SwitchParameter VcRedist;
 
+    /// If set, the shim starts the target and exits right away, instead of waiting for the target to exit and forwarding
+    /// its exit code. This avoids keeping an idle shim process around for long-running GUI applications, but anything
+    /// that waits for the exported command (e.g. `Start-Process -Wait`, `GIT_EDITOR`, installers checking the exit code)
+    /// returns immediately, so only use it for GUI applications that are never waited on.
+    [Parameter(ParameterSetName = ShimPS)] public SwitchParameter Detached;
+
     // TODO: argument and env resolution tags
-    protected bool CreateExportShim(string exportPath, string targetPath, bool replaceArgv0) {
+    protected bool CreateExportShim(string exportPath, string targetPath, bool replaceArgv0, bool multicall = false) {
         var args = ResolveArguments(ArgumentList);
         var envVars = ResolveEnvironmentVariables(EnvironmentVariables);
 
@@ -72,10 +78,15 @@ public class ExportEntryPointCommandBase : PogCmdlet {
             }
         }
 
-        var shim = new ShimExecutable(targetPath, WorkingDirectory, args, envVars, MetadataSource, replaceArgv0);
-        var (updated, targetInfo) = new ExportedShimCommand(shim).UpdateCommand(exportPath, WriteDebug);
+        var shim = new ShimExecutable(targetPath, WorkingDirectory, args, envVars, MetadataSource, replaceArgv0,
+                Detached);
+        var updated = multicall
+                ? new ExportedMulticallCommand(shim).UpdateCommand(exportPath, WriteDebug)
+                : new ExportedShimCommand(shim).UpdateCommand(exportPath, WriteDebug);
 
-        if (VcRedist && targetInfo?.Architecture == PeBinary.Architecture.I386) {
+        // only read the target headers when needed, the shim update itself does not read them if the shim is up to date
+        if (VcRedist && ShimExecutable.IsPeBinary(targetPath)
+            && PeBinary.GetInfo(targetPath).Architecture == PeBinary.Architecture.I386) {
             // currently, Pog only provides x64 VC redistributable libraries, so a 32bit program will fail
             // TODO: better handling for this
             WriteWarning($"Exported binary '{targetPath}' is a 32-bit binary, -VcRedist is not supported yet.");
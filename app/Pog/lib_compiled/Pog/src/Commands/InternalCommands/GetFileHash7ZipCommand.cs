@@ -13,7 +13,7 @@ public enum HashAlgorithm7Zip {
     SHA256 = 0, SHA512, SHA1, CRC32, CRC64,
 }
 
-/// <summary>Calculates a checksum of the specified file using 7zip.</summary>
+/// <summary>Calculates a checksum of the specified file using 7zip. SHA256 is calculated in-process by `pog_native.dll`.</summary>
 [PublicAPI]
 [Cmdlet(VerbsCommon.Get, "FileHash7Zip")]
 [OutputType(typeof(string))]
@@ -0,0 +1,121 @@
+﻿using System;
+using System.IO;
+using System.Linq;
+using Pog.Native;
+using Pog.Shim;
+using Pog.Utils;
+
+namespace Pog;
+
+/// Exports a command as a hardlink to a shared multicall dispatcher, with the shim data stored in the multicall index
+/// in the export directory (see <see cref="MulticallIndexFile"/>). Unlike <see cref="ExportedShimCommand"/>, the command
+/// does not have the icons and version resources of the target (`MetadataSource` is ignored), since all commands share
+/// a single binary.
+internal class ExportedMulticallCommand(ShimExecutable shim) {
+    /// Subdirectory of the export directory with the dispatchers, so that they're not listed as exported commands.
+    private const string DispatcherDirName = "multicall";
+
+    public bool UpdateCommand(string exportPath, Action<string> debugLogFn) {
+        var exportDirPath = Path.GetDirectoryName(exportPath)!;
+        // ensure the parent directory exists
+        Directory.CreateDirectory(exportDirPath);
+
+        var dispatcherPath = UpdateDispatcher(exportDirPath, debugLogFn);
+        // write the index first, so that the command is never invoked without its shim data
+        var indexChanged = UpdateIndex(exportDirPath, Path.GetFileName(exportPath));
+        var linkChanged = UpdateLink(exportPath, dispatcherPath, debugLogFn);
+        return indexChanged || linkChanged;
+    }
+
+    /// Ensures that the dispatcher for the subsystem of the target is a copy of the current full shim template,
+    /// returns its path. The dispatcher copy keeps the timestamp of the template, which is used to detect updates.
+    private string UpdateDispatcher(string exportDirPath, Action<string> debugLogFn) {
+        // the subsystem is a property of the binary, so GUI targets need a separate dispatcher
+        var subsystem = shim.GetTargetSubsystem();
+        var isGui = subsystem == PeBinary.Subsystem.WindowsGui;
+        var dispatcherDirPath = $"{exportDirPath}\\{DispatcherDirName}";
+        var dispatcherPath = $"{dispatcherDirPath}\\{(isGui ? "dispatcher_gui.exe" : "dispatcher.exe")}";
+
+        // only the full template can dispatch commands, since each command may need any shim feature
+        var template = new FileInfo($"{InternalState.PathConfig.ShimTemplateDir}\\" +
+                                    $"{ShimExecutable.GetTemplateFileName(ShimExecutable.ShimFeatures.All)}");
+        var dispatcher = new FileInfo(dispatcherPath);
+        if (dispatcher.Exists && dispatcher.Length == template.Length
+                              && dispatcher.LastWriteTimeUtc == template.LastWriteTimeUtc) {
+            return dispatcherPath;
+        }
+
+        Directory.CreateDirectory(dispatcherDirPath);
+        DeleteOldDispatchers(dispatcherDirPath);
+        if (dispatcher.Exists) {
+            debugLogFn("Replacing an outdated multicall dispatcher...");
+            // a running command prevents the dispatcher from being deleted, but not from being moved; commands linked
+            //  to the old dispatcher keep working, and they are relinked to the new one when exported again
+            var oldPath = $"{dispatcherDirPath}\\{Guid.NewGuid()}.old";
+            File.Move(dispatcherPath, oldPath);
+            DeleteOldDispatchers(dispatcherDirPath);
+        }
+
+        File.Copy(template.FullName, dispatcherPath);
+        try {
+            PeBinary.SetSubsystem(dispatcherPath, isGui ? PeBinary.Subsystem.WindowsGui : PeBinary.Subsystem.WindowsCui);
+            File.SetLastWriteTimeUtc(dispatcherPath, template.LastWriteTimeUtc);
+        } catch {
+            FsUtils.EnsureDeleteFile(dispatcherPath);
+            throw;
+        }
+        return dispatcherPath;
+    }
+
+    private static void DeleteOldDispatchers(string dispatcherDirPath) {
+        foreach (var oldPath in Directory.EnumerateFiles(dispatcherDirPath, "*.old")) {
+            try {
+                File.Delete(oldPath);
+            } catch (UnauthorizedAccessException) {
+                // still in use by a running command, retry next time
+            }
+        }
+    }
+
+    private bool UpdateIndex(string exportDirPath, string commandName) {
+        var indexPath = $"{exportDirPath}\\{MulticallIndexFile.IndexFileName}";
+        var shimData = ShimDataEncoder.EncodeShim(shim).ToArray();
+        var entries = MulticallIndexFile.Read(indexPath);
+
+        // drop commands that were removed since the last export (e.g. stale commands deleted by `Enable-Pog`)
+        var changed = entries.RemoveAll(e => !File.Exists($"{exportDirPath}\\{e.CommandName}")) > 0;
+
+        // file names are case-insensitive, and so is the lookup in the dispatcher
+        var i = entries.FindIndex(e => string.Equals(e.CommandName, commandName, StringComparison.OrdinalIgnoreCase));
+        if (i == -1) {
+            entries.Add((commandName, shimData));
+            changed = true;
+        } else if (entries[i].CommandName != commandName || !entries[i].ShimData.SequenceEqual(shimData)) {
+            entries[i] = (commandName, shimData);
+            changed = true;
+        }
+
+        if (changed) {
+            MulticallIndexFile.Write(indexPath, entries);
+        }
+        return changed;
+    }
+
+    private static bool UpdateLink(string exportPath, string dispatcherPath, Action<string> debugLogFn) {
+        if (File.Exists(exportPath)) {
+            if ((new FileInfo(exportPath).Attributes & FileAttributes.ReparsePoint) != 0) {
+                debugLogFn("Overwriting symlink with a multicall command...");
+            } else if (!FsUtils.FileExistsCaseSensitive(exportPath)) {
+                debugLogFn("Updating casing of an exported command...");
+            } else if (!FsUtils.IsSameFile(exportPath, dispatcherPath)) {
+                debugLogFn("Replacing exported command with a link to the multicall dispatcher...");
+            } else {
+                return false;
+            }
+            File.Delete(exportPath);
+        }
+
+        FsUtils.CreateHardLink(exportPath, dispatcherPath);
+        return true;
+    }
+}
@@ -1,13 +1,12 @@
 ﻿using System;
 using System.IO;
-using Pog.Native;
 using Pog.Shim;
 using Pog.Utils;
 
 namespace Pog;
 
 internal class ExportedShimCommand(ShimExecutable shim) {
-    public (bool, PeBinary.PeInfo?) UpdateCommand(string exportPath, Action<string> debugLogFn) {
+    public bool UpdateCommand(string exportPath, Action<string> debugLogFn) {
         if (File.Exists(exportPath)) {
             if ((new FileInfo(exportPath).Attributes & FileAttributes.ReparsePoint) != 0) {
                 debugLogFn("Overwriting symlink with a shim executable...");
@@ -16,6 +15,10 @@ internal class ExportedShimCommand(ShimExecutable shim) {
             } else if (!FsUtils.FileExistsCaseSensitive(exportPath)) {
                 debugLogFn("Updating casing of an exported command...");
                 File.Delete(exportPath);
+            } else if (FsUtils.GetHardLinkCount(exportPath) > 1) {
+                // exported with `-Multicall`, updating it in place would overwrite the shared dispatcher
+                debugLogFn("Replacing a multicall command with a shim executable...");
+                File.Delete(exportPath);
             } else {
                 try {
                     return shim.UpdateShim(exportPath);
@@ -29,10 +32,12 @@ internal class ExportedShimCommand(ShimExecutable shim) {
             Directory.CreateDirectory(Path.GetDirectoryName(exportPath)!);
         }
 
-        // copy empty shim to rLinkPath
-        File.Copy(InternalState.PathConfig.ShimPath, exportPath);
+        // copy the smallest empty shim template supporting the shim configuration to exportPath
+        var templatePath = $"{InternalState.PathConfig.ShimTemplateDir}\\{ShimExecutable.GetTemplateFileName(shim.RequiredFeatures)}";
+        File.Copy(templatePath, exportPath);
         try {
-            return (true, shim.WriteNewShim(exportPath));
+            shim.WriteNewShim(exportPath);
+            return true;
         } catch {
             // clean up the empty shim
             FsUtils.EnsureDeleteFile(exportPath);
@@ -17,6 +17,8 @@ internal sealed class ExpandArchive7Zip(PogCmdlet cmdlet) : VoidCommand(cmdlet)
     [Parameter] public required string ArchivePath;
     [Parameter] public required string TargetPath;
     [Parameter] public string? RawTargetPath;
+    /// If set, `ArchivePath` is the chunk list of a deduplicated download cache entry, stored in this chunk store.
+    [Parameter] public string? ChunkStorePath = null;
     /// If passed, only paths inside the archive matching at least one of the filters are extracted.
     [Parameter] public string[]? Filter = null;
     [Parameter] public ProgressActivity ProgressActivity = new();
@@ -26,6 +28,7 @@ internal sealed class ExpandArchive7Zip(PogCmdlet cmdlet) : VoidCommand(cmdlet)
     private static readonly Regex ProgressPrintRegex = new(@"^\s*(\d{1,3})%\s+\S+.*$", RegexOptions.Compiled);
 
     public override void Invoke() {
+        using var _ = InstrumentationCounter.ExtractionTime.Time();
         RawTargetPath ??= TargetPath;
         var filterPatterns = Filter switch {
             null => null,
@@ -44,12 +47,22 @@ internal sealed class ExpandArchive7Zip(PogCmdlet cmdlet) : VoidCommand(cmdlet)
             }
         }
 
-        WriteDebug($"Extracting archive using 7zip... (source: '{ArchivePath}', target: '{TargetPath}')");
-        ProgressActivity.Activity ??= "Extracting archive with 7zip";
-        ProgressActivity.Description ??= $"Extracting archive '{Path.GetFileName(ArchivePath)}'...";
+        WriteDebug($"Extracting archive... (source: '{ArchivePath}', target: '{TargetPath}')");
+        ProgressActivity.Activity ??= "Extracting archive";
+        var archiveName = Path.GetFileName(ArchivePath);
+        if (ChunkStorePath != null) {
+            archiveName = archiveName.Substring(0, archiveName.Length - SharedFileCache.ChunkListExtension.Length);
+        }
+        ProgressActivity.Description ??= $"Extracting archive '{archiveName}'...";
 
         try {
-            Invoke7Zip(filterPatterns);
+            if (!ExtractNative(filterPatterns)) {
+                if (ChunkStorePath == null) {
+                    Invoke7Zip(ArchivePath, filterPatterns);
+                } else {
+                    Invoke7ZipOnRestoredArchive(archiveName, filterPatterns);
+                }
+            }
 
             // ensure the target directory exists (if the archive was empty or the filter pattern excluded everything,
             //  7zip won't create the target directory)
@@ -62,10 +75,59 @@ internal sealed class ExpandArchive7Zip(PogCmdlet cmdlet) : VoidCommand(cmdlet)
         }
     }
 
-    private void Invoke7Zip(string[]? filterPatterns) {
+    /// Zip and (compressed) tar archives are extracted in-process by `pog_native.dll`, with zip entries extracted
+    /// in parallel. Returns false if 7zip should be used instead.
+    private bool ExtractNative(string[]? filterPatterns) {
+        using (var progressBar = new CmdletProgressBar(Cmdlet, ProgressActivity)) {
+            try {
+                Action<long, long> progress = (processed, total) => progressBar.ReportSize(processed, total);
+                var extracted = ChunkStorePath == null
+                        ? PogNative.ExtractArchive(ArchivePath, TargetPath, filterPatterns, progress, CancellationToken)
+                        : PogNative.ChunkStoreExtractArchive(ChunkStorePath, ArchivePath, TargetPath, filterPatterns,
+                                progress, CancellationToken);
+                if (extracted) {
+                    return true;
+                }
+                WriteDebug("Archive format is not supported by the native extractor, using 7zip.");
+            } catch (DllNotFoundException) {
+                // pog_native.dll is not built (development setup), use 7zip
+                return false;
+            } catch (InvalidDataException e) {
+                // 7zip is more lenient to some malformed archives, give it a chance before failing
+                WriteDebug($"Native archive extraction failed, retrying with 7zip: {e.Message}");
+            } catch (OperationCanceledException) {
+                // signal that we were stopped by the user
+                throw new PipelineStoppedException();
+            }
+        }
+
+        // the native extractor may have already extracted some entries
+        FsUtils.EnsureDeleteDirectory(TargetPath);
+        return false;
+    }
+
+    /// 7zip cannot read a deduplicated archive, reassemble it into a temporary file first; the original file name is kept,
+    /// since 7zip uses the extension to detect some archive types.
+    private void Invoke7ZipOnRestoredArchive(string archiveName, string[]? filterPatterns) {
+        var tmpDirPath = InternalState.TmpDownloadDirectory.GetTemporaryPath();
+        Directory.CreateDirectory(tmpDirPath);
+        try {
+            var archivePath = Path.Combine(tmpDirPath, archiveName);
+            try {
+                PogNative.ChunkStoreRestore(ChunkStorePath!, ArchivePath, archivePath, null, CancellationToken);
+            } catch (OperationCanceledException) {
+                throw new PipelineStoppedException();
+            }
+            Invoke7Zip(archivePath, filterPatterns);
+        } finally {
+            FsUtils.EnsureDeleteDirectory(tmpDirPath);
+        }
+    }
+
+    private void Invoke7Zip(string archivePath, string[]? filterPatterns) {
         using var progressBar = new CmdletProgressBar(Cmdlet, ProgressActivity);
         using var process = new Process();
-        process.StartInfo = SetupProcessStartInfo(ArchivePath, TargetPath, filterPatterns);
+        process.StartInfo = SetupProcessStartInfo(archivePath, TargetPath, filterPatterns);
         process.Start();
 
         // ideally, we should cancel the ReadLine() call below, but the StreamReader API doesn't support
@@ -5,6 +5,8 @@ using System.Text.RegularExpressions;
 using Pog.Commands.Common;
 using Pog.Commands.InternalCommands;
 using Pog.InnerCommands.Common;
+using Pog.Native;
+using Pog.Utils;
 
 namespace Pog.InnerCommands;
 
@@ -32,10 +34,19 @@ internal sealed class GetFileHash7Zip(PogCmdlet cmdlet) : ScalarCommand<string>(
     }
 
     public override string Invoke() {
+        using var _ = InstrumentationCounter.HashTime.Time();
         ProgressActivity.Activity ??= "Calculating file hash";
         ProgressActivity.Description ??= $"Calculating {Algorithm} hash for '{System.IO.Path.GetFileName(Path)}'...";
         using var progressBar = new CmdletProgressBar(Cmdlet, ProgressActivity);
 
+        if (Algorithm == HashAlgorithm7Zip.SHA256) {
+            try {
+                return HashSha256Native(progressBar);
+            } catch (DllNotFoundException) {
+                // pog_native.dll is not built (development setup), fall back to 7zip
+            }
+        }
+
         using var process = new Process();
         process.StartInfo = SetupProcessStartInfo();
         process.Start();
@@ -87,6 +98,17 @@ internal sealed class GetFileHash7Zip(PogCmdlet cmdlet) : ScalarCommand<string>(
         return hash;
     }
 
+    /// SHA-256 is by far the most common algorithm (manifests use it for all downloads), hash it in-process
+    /// instead of starting 7zip; with SHA-NI, the native implementation runs at close to the disk read speed.
+    private string HashSha256Native(CmdletProgressBar progressBar) {
+        try {
+            return PogNative.Sha256File(Path, progressBar.Report, CancellationToken).ToHexString();
+        } catch (OperationCanceledException) {
+            // signal that we were stopped by the user
+            throw new PipelineStoppedException();
+        }
+    }
+
     private ProcessStartInfo SetupProcessStartInfo() {
         return new ProcessStartInfo {
             FileName = InternalState.PathConfig.Path7Zip,
@@ -7,6 +7,7 @@ using Microsoft.Win32.SafeHandles;
 using Pog.Commands;
 using Pog.Commands.Common;
 using Pog.InnerCommands.Common;
+using Pog.Native;
 using Pog.Utils;
 using PPaths = Pog.PathConfig.PackagePaths;
 
@@ -144,7 +145,16 @@ internal sealed class InstallPog(PogCmdlet cmdlet) : ImportedPackageInnerCommand
         Directory.CreateDirectory(Path.GetDirectoryName(targetPath)!);
         // copy the file directly to the target path
         // for NoArchive, Target contains even the file name, not just the directory name
-        File.Copy(downloadedFile.Path, targetPath, true);
+        if (downloadedFile is SharedFileCache.CacheEntryLock {ChunkStorePath: {} chunkStorePath}) {
+            // deduplicated cache entry, reassemble the file from its chunks
+            try {
+                PogNative.ChunkStoreRestore(chunkStorePath, downloadedFile.Path, targetPath, null, CancellationToken);
+            } catch (OperationCanceledException) {
+                throw new PipelineStoppedException();
+            }
+        } else {
+            File.Copy(downloadedFile.Path, targetPath, true);
+        }
     }
 
     private void InstallArchive(PackageSourceArchive param,
@@ -153,6 +163,7 @@ internal sealed class InstallPog(PogCmdlet cmdlet) : ImportedPackageInnerCommand
             // extract the archive to a temporary directory
             InvokePogCommand(new ExpandArchive7Zip(Cmdlet) {
                 ArchivePath = downloadedFile.Path,
+                ChunkStorePath = (downloadedFile as SharedFileCache.CacheEntryLock)?.ChunkStorePath,
                 TargetPath = _extractionDirPath,
                 Filter = param.Subdirectory == null ? null : [param.Subdirectory],
                 ProgressActivity = _progressActivity,
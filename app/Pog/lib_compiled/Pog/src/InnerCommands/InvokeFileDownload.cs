@@ -3,9 +3,12 @@ using System.Diagnostics;
 using System.IO;
 using System.Management.Automation;
 using System.Security.Cryptography;
+using System.Text;
 using Pog.Commands.Common;
 using Pog.InnerCommands.Common;
+using Pog.Native;
 using Pog.Utils;
+using Pog.Utils.Http;
 
 namespace Pog.InnerCommands;
 
@@ -20,6 +23,12 @@ internal sealed class InvokeFileDownload(PogCmdlet cmdlet) : ScalarCommand<Downl
     [Parameter] public string? DestinationDirPath = null;
     [Parameter] public bool ComputeHash = false;
 
+    /// Files at least this large are downloaded over multiple connections, if the server supports range requests. Per
+    /// the benchmarks mentioned below, parallel connections only help for large files, smaller ones are as fast with
+    /// a single stream.
+    private const long ParallelDownloadMinSize = 64L << 20;
+    private const uint ParallelDownloadConnections = 4;
+
     /// <summary>Downloads the file from `SourceUrl` to `DestinationDirPath`.</summary>
     /// <returns>Full path of the downloaded file.</returns>
     /// <remarks>
@@ -34,22 +43,146 @@ internal sealed class InvokeFileDownload(PogCmdlet cmdlet) : ScalarCommand<Downl
     /// After somewhat properly benchmarking a few reasonable options (BITS, curl, aria2, iwr, custom HttpClient impl)
     /// using the scripts in `app\Pog\_scripts\http_client_bench`, it seems that for typical download sizes, iwr, curl
     /// and the custom HttpClient impl were roughly equal and slightly faster than BITS and aria2 (for files over ~400 MB,
-    /// BITS and aria2 with parallel download tend to be competitive or slightly faster, but those are rare).
+    /// BITS and aria2 with parallel download tend to be competitive or slightly faster, but those are rare). Large files
+    /// are now downloaded over several connections by `pog_native.dll`, which has no process startup overhead.
     /// </remarks>
     public override DownloadedFile Invoke() {
         Debug.Assert(ComputeHash || DestinationDirPath != null);
+        using var _ = InstrumentationCounter.DownloadTime.Time();
 
         var description = ProgressActivity.Description;
         ProgressActivity.Activity ??= "HTTP Transfer";
         ProgressActivity.Description ??= $"Downloading '{SourceUrl}'...";
         using var progressBar = new CmdletProgressBar(Cmdlet, ProgressActivity);
 
-        var uri = new Uri(SourceUrl);
-        using var downloadStream = InternalState.HttpClient
-                .GetStreamAsync(uri, DownloadParameters.UserAgent, CancellationToken).GetAwaiter().GetResult();
-        var fileName = downloadStream.GenerateFileName();
+        var downloadStream = OpenStream(new Uri(SourceUrl));
+        try {
+            var fileName = downloadStream.GenerateFileName();
+            description ??= $"Downloading '{fileName}'...";
+
+            if (DestinationDirPath != null && downloadStream.AcceptsRanges
+                && downloadStream.ContentLength >= ParallelDownloadMinSize) {
+                var outPath = $"{DestinationDirPath}\\{fileName}";
+                WriteDebug($"Output path: {outPath}");
+                // the native downloader opens its own connections
+                downloadStream.Dispose();
+                try {
+                    return DownloadParallel(downloadStream.FinalUri, outPath, progressBar, description);
+                } catch (DllNotFoundException) {
+                    // pog_native.dll is not built (development setup), download in a single stream
+                    downloadStream = OpenStream(downloadStream.FinalUri);
+                }
+            }
+
+            return DownloadStream(downloadStream, fileName, progressBar, description);
+        } finally {
+            downloadStream.Dispose();
+        }
+    }
+
+    private PogHttpClient.HttpFileStream OpenStream(Uri uri) {
+        return InternalState.HttpClient.GetStreamAsync(uri, DownloadParameters.UserAgent, CancellationToken)
+                .GetAwaiter().GetResult();
+    }
+
+    private DownloadedFile DownloadParallel(Uri uri, string outPath, CmdletProgressBar progressBar, string description) {
+        var progress = new DebouncedProgress<(long, long)>(PogCmdlet.DefaultProgressInterval,
+                p => progressBar.ReportSize(p.Item1, p.Item2, description));
+
+        // `DestinationDirPath` is deleted when the installation fails, download to the staging directory instead,
+        //  so that the next attempt can resume the download; both the staging directory and the resume state are keyed
+        //  by `SourceUrl`, because redirect targets (e.g. signed GitHub release URLs) change with each request, while
+        //  the size and the validator checked by the native downloader ensure that the file is the same
+        using (var staging = ResumeStaging.TryOpen(SourceUrl)) {
+            var stagingPath = staging == null ? outPath : staging.GetFilePath(Path.GetFileName(outPath));
+            WriteDebug($"Staging path: {stagingPath}");
+            PogNative.DownloadFile(uri.AbsoluteUri, SourceUrl, stagingPath,
+                    DownloadParameters.UserAgent.GetHeaderString(), ParallelDownloadConnections,
+                    (processed, total) => progress.Report((processed, total)), CancellationToken);
+            if (staging != null) {
+                File.Move(stagingPath, outPath);
+                staging.Delete();
+            }
+        }
+
+        // the file is written out of order, so it can only be hashed afterwards
+        return new(outPath, ComputeHash ? PogNative.Sha256File(outPath, null, CancellationToken).ToHexString() : null);
+    }
+
+    /// Locked directory in `PathConfig.DownloadResumeDir` for each source URL, where a partial download and its `.pogdl`
+    /// resume state are kept after a failed installation.
+    private sealed class ResumeStaging : IDisposable {
+        private const string LockFileName = ".lock";
+        /// Staging directories not touched for this long are abandoned downloads, and they're deleted.
+        private static readonly TimeSpan MaxAge = TimeSpan.FromDays(7);
+
+        private readonly string _dirPath;
+        private readonly FileStream _lock;
+
+        private ResumeStaging(string dirPath, FileStream lockStream) {
+            _dirPath = dirPath;
+            _lock = lockStream;
+        }
 
-        description ??= $"Downloading '{fileName}'...";
+        /// Returns null if another process is downloading from the same source URL, in which case the caller should
+        /// download without resuming.
+        public static ResumeStaging? TryOpen(string url) {
+            var rootPath = InternalState.PathConfig.DownloadResumeDir;
+            Directory.CreateDirectory(rootPath);
+            DeleteAbandoned(rootPath);
+
+            using var sha = SHA256.Create();
+            var dirPath = $"{rootPath}\\{sha.ComputeHash(Encoding.UTF8.GetBytes(url)).ToHexString()}";
+            Directory.CreateDirectory(dirPath);
+            try {
+                // the lock file is deleted when closed, even if the process crashes
+                return new(dirPath, new FileStream($"{dirPath}\\{LockFileName}", FileMode.OpenOrCreate,
+                        FileAccess.ReadWrite, FileShare.None, 1, FileOptions.DeleteOnClose));
+            } catch (IOException) {
+                return null;
+            }
+        }
+
+        /// Returns the path to download `fileName` to, and deletes files of other downloads from the same URL
+        /// (e.g. if the server changed the file name), except for the resume state of `fileName`.
+        public string GetFilePath(string fileName) {
+            var filePath = $"{_dirPath}\\{fileName}";
+            foreach (var path in Directory.EnumerateFiles(_dirPath)) {
+                var name = Path.GetFileName(path);
+                if (name != LockFileName && name != fileName && name != fileName + ".pogdl") {
+                    FsUtils.EnsureDeleteFile(path);
+                }
+            }
+            return filePath;
+        }
+
+        /// Deletes the directory after the download is complete and moved out.
+        public void Delete() {
+            Dispose();
+            try {
+                Directory.Delete(_dirPath);
+            } catch (IOException) {
+                // another process created a new lock in the meantime
+            }
+        }
+
+        public void Dispose() {
+            _lock.Dispose();
+        }
+
+        private static void DeleteAbandoned(string rootPath) {
+            foreach (var dir in new DirectoryInfo(rootPath).EnumerateDirectories()) {
+                if (DateTime.UtcNow - dir.LastWriteTimeUtc < MaxAge) continue;
+                try {
+                    // fails on the lock file if the download is in progress
+                    FsUtils.EnsureDeleteDirectory(dir.FullName);
+                } catch (Exception e) when (e is IOException or UnauthorizedAccessException) {}
+            }
+        }
+    }
+
+    private DownloadedFile DownloadStream(PogHttpClient.HttpFileStream downloadStream, string fileName,
+            CmdletProgressBar progressBar, string description) {
         var stream = new ProgressStream(downloadStream.Stream, new DebouncedProgress<long>(PogCmdlet.DefaultProgressInterval,
                 position => progressBar.ReportSize(position, downloadStream.ContentLength, description)));
 
@@ -61,6 +194,17 @@ internal sealed class InvokeFileDownload(PogCmdlet cmdlet) : ScalarCommand<Downl
         var outPath = $"{DestinationDirPath}\\{fileName}";
         WriteDebug($"Output path: {outPath}");
 
+        if (ComputeHash) {
+            try {
+                // write and hash on background threads, so that the download is not slowed down by either
+                using var sink = new PogNative.DownloadSink(outPath);
+                stream.CopyTo(sink);
+                return new(outPath, sink.Finish().ToHexString());
+            } catch (DllNotFoundException) {
+                // pog_native.dll is not built (development setup), hash on this thread
+            }
+        }
+
         using var outStream = File.Create(outPath);
 
         if (ComputeHash) {
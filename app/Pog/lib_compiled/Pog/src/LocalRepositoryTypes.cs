@@ -146,7 +146,15 @@ public sealed class TemplatedLocalRepositoryPackage(LocalRepositoryVersionedPack
             throw new PackageNotFoundException($"Cannot read the package manifest of a non-existent package at '{Path}'.");
         }
 
+        var cachedManifestStr = CompiledManifestCache.TryGet(TemplatePath, ManifestPath, out var cacheKey);
+        if (cachedManifestStr != null) {
+            return new PackageManifest(cachedManifestStr, ManifestPath, owningPackage: this);
+        }
+
         var manifestStr = ManifestTemplateFile.Substitute(TemplatePath, ManifestPath);
-        return new PackageManifest(manifestStr, ManifestPath, owningPackage: this);
+        var manifest = new PackageManifest(manifestStr, ManifestPath, owningPackage: this);
+        // only cache manifests which passed validation
+        if (cacheKey != null) CompiledManifestCache.Add(cacheKey, TemplatePath, ManifestPath, manifestStr);
+        return manifest;
     }
 }
@@ -0,0 +1,809 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Net.Http;
+using System.Runtime.InteropServices;
+using System.Text;
+using System.Threading;
+using Pog.Shim;
+
+namespace Pog.Native;
+
+/// <summary>Bindings for `pog_native.dll` (`lib_compiled/Pog.Native`), see `include/pog_native.h` for documentation.</summary>
+internal static class PogNative {
+    private const string DllName = "pog_native.dll";
+    private const int ErrorMessageSize = 512;
+
+    // return codes
+    private const int Ok = 0;
+    private const int ErrorIo = -1;
+    private const int ErrorInvalidPe = -2;
+    private const int ErrorOutdatedShim = -3;
+    private const int ErrorShimInUse = -4;
+    private const int ErrorCancelled = -6;
+    private const int ErrorUnsupportedArchive = -7;
+    private const int ErrorInvalidArchive = -8;
+    private const int ErrorHttp = -9;
+    private const int VersionKeyExact = 1;
+    private const int ShimUpdated = 1;
+    // `pog_update_shim` flags
+    private const uint ShimNew = 1;
+    private const uint ShimSubsystemFromSource = 2;
+    /// Longer versions are not encoded, so that the buffers always fit on the stack.
+    private const int MaxVersionKeyInputLength = 256;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    private delegate int ProgressCallback(IntPtr context, ulong processed, ulong total);
+
+    // pog_native.dll is next to Pog.dll, not next to pwsh.exe
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern int pog_sha256_file(string path, byte[] digest, ProgressCallback? progress,
+            IntPtr progressContext, byte[] errorMessage, UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern int pog_download_sink_create(string path, out IntPtr sink, byte[] errorMessage,
+            UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern unsafe int pog_download_sink_write(IntPtr sink, byte* data, UIntPtr size,
+            byte[] errorMessage, UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern int pog_download_sink_finish(IntPtr sink, byte[] digest, byte[] errorMessage,
+            UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern void pog_download_sink_close(IntPtr sink);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern int pog_extract_archive(string archivePath, string targetDir,
+            [MarshalAs(UnmanagedType.LPArray, ArraySubType = UnmanagedType.LPUTF8Str)] string[]? filter,
+            UIntPtr filterCount, ProgressCallback? progress, IntPtr progressContext, byte[] errorMessage,
+            UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern int pog_download_file([MarshalAs(UnmanagedType.LPUTF8Str)] string url,
+            [MarshalAs(UnmanagedType.LPUTF8Str)] string? resumeKey, string targetPath,
+            [MarshalAs(UnmanagedType.LPUTF8Str)] string userAgent, uint connections, ProgressCallback? progress,
+            IntPtr progressContext, byte[] errorMessage, UIntPtr errorMessageSize);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    private unsafe delegate void CacheEntryCallback(IntPtr context, NativeCacheEntry* entry);
+
+    [StructLayout(LayoutKind.Sequential)]
+    private unsafe struct NativeCacheEntry {
+        public byte* Key;
+        public byte* FileName;
+        public ulong Size;
+        public ulong LastAccess;
+        public uint Readers;
+        public byte* Packages;
+    }
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern int pog_cache_index_open(string cacheDir, out IntPtr index, byte[] errorMessage,
+            UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern void pog_cache_index_close(IntPtr index);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern int pog_cache_index_acquire(IntPtr index, [MarshalAs(UnmanagedType.LPUTF8Str)] string key,
+            [MarshalAs(UnmanagedType.LPUTF8Str)] string? package, byte[] fileName, UIntPtr fileNameSize,
+            byte[] errorMessage, UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern int pog_cache_index_release(IntPtr index, [MarshalAs(UnmanagedType.LPUTF8Str)] string key,
+            byte[] errorMessage, UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern unsafe int pog_cache_index_add(IntPtr index, NativeCacheEntry* entry, byte[] errorMessage,
+            UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern int pog_cache_index_remove(IntPtr index, [MarshalAs(UnmanagedType.LPUTF8Str)] string key,
+            byte[] errorMessage, UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern int pog_cache_index_enumerate(IntPtr index, CacheEntryCallback callback, IntPtr context,
+            byte[] errorMessage, UIntPtr errorMessageSize);
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ChunkStoreStats {
+        /// Size of the stored file.
+        public ulong Size;
+        public ulong ChunkCount;
+        /// Chunks that were not in the store before, and their total size.
+        public ulong NewChunkCount;
+        public ulong NewChunkBytes;
+    }
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern int pog_chunk_store_add(string storeDir, string filePath, string chunkListPath,
+            out ChunkStoreStats stats, ProgressCallback? progress, IntPtr progressContext, byte[] errorMessage,
+            UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern int pog_chunk_store_restore(string storeDir, string chunkListPath, string targetPath,
+            ProgressCallback? progress, IntPtr progressContext, byte[] errorMessage, UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern int pog_chunk_store_extract_archive(string storeDir, string chunkListPath, string targetDir,
+            [MarshalAs(UnmanagedType.LPArray, ArraySubType = UnmanagedType.LPUTF8Str)] string[]? filter,
+            UIntPtr filterCount, ProgressCallback? progress, IntPtr progressContext, byte[] errorMessage,
+            UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern int pog_chunk_store_collect(string storeDir,
+            [MarshalAs(UnmanagedType.LPArray, ArraySubType = UnmanagedType.LPWStr)] string[] chunkListPaths,
+            UIntPtr chunkListCount, uint minAgeSeconds, out ulong freedBytes, byte[] errorMessage,
+            UIntPtr errorMessageSize);
+
+    [StructLayout(LayoutKind.Sequential)]
+    private unsafe struct NativeRepositoryIndexInfo {
+        public uint PackageCount;
+        public uint VersionCount;
+        public ulong Sequence;
+        public ulong LastWriteTime;
+        public byte* ETag;
+        public UIntPtr ETagSize;
+        public byte* LastModified;
+        public UIntPtr LastModifiedSize;
+    }
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern unsafe int pog_repo_index_write(string indexDir, byte* packages, UIntPtr packagesSize,
+            [MarshalAs(UnmanagedType.LPUTF8Str)] string? etag, [MarshalAs(UnmanagedType.LPUTF8Str)] string? lastModified,
+            ulong sequence, byte[] errorMessage, UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern int pog_repo_index_update(IntPtr index, [MarshalAs(UnmanagedType.LPUTF8Str)] string repositoryUrl,
+            [MarshalAs(UnmanagedType.LPUTF8Str)] string userAgent, out ulong sequence, byte[] errorMessage,
+            UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern int pog_repo_index_open(string indexDir, out IntPtr index, byte[] errorMessage,
+            UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern void pog_repo_index_close(IntPtr index);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern void pog_repo_index_get_info(IntPtr index, out NativeRepositoryIndexInfo info);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern int pog_repo_index_touch(IntPtr index, byte[] errorMessage, UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern unsafe int pog_repo_index_find(IntPtr index, byte* name, UIntPtr nameSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern unsafe UIntPtr pog_repo_index_get_name(IntPtr index, uint package, out byte* name);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern uint pog_repo_index_get_version_count(IntPtr index, uint package);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern unsafe UIntPtr pog_repo_index_get_version(IntPtr index, uint package, uint version,
+            out byte* str);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern int pog_manifest_cache_open(string cacheDir, out IntPtr cache, byte[] errorMessage,
+            UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern void pog_manifest_cache_close(IntPtr cache);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern unsafe int pog_manifest_cache_find(IntPtr cache, byte[] key, out byte* manifest,
+            out UIntPtr manifestSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern unsafe int pog_manifest_cache_add(IntPtr cache, byte[] key, byte* manifest,
+            UIntPtr manifestSize, byte[] errorMessage, UIntPtr errorMessageSize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    private static extern unsafe int pog_version_key(byte* version, UIntPtr versionSize, byte* key, out UIntPtr keySize);
+
+    [DefaultDllImportSearchPaths(DllImportSearchPath.AssemblyDirectory)]
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+    private static extern unsafe int pog_update_shim(string shimPath, string? metadataSourcePath, byte* shimData,
+            UIntPtr shimDataSize, ushort features, int subsystem, uint flags, byte[] errorMessage,
+            UIntPtr errorMessageSize);
+
+    /// Computes the SHA-256 hash of the file at `path`. `progress` is called with the processed fraction of the file.
+    /// <exception cref="OperationCanceledException">`cancellationToken` was cancelled.</exception>
+    public static byte[] Sha256File(string path, Action<double>? progress, CancellationToken cancellationToken) {
+        ProgressCallback callback = (_, processed, total) => {
+            if (cancellationToken.IsCancellationRequested) return 1;
+            if (total > 0) progress?.Invoke((double) processed / total);
+            return 0;
+        };
+
+        var digest = new byte[32];
+        var errorMessage = new byte[ErrorMessageSize];
+        var result = pog_sha256_file(path, digest, callback, IntPtr.Zero, errorMessage, (UIntPtr) errorMessage.Length);
+        // keep the delegate alive until the native call returns
+        GC.KeepAlive(callback);
+
+        if (result == ErrorCancelled) {
+            throw new OperationCanceledException(cancellationToken);
+        }
+        CheckResult(nameof(pog_sha256_file), result, errorMessage);
+        return digest;
+    }
+
+    /// Extracts the zip, tar or gzip-compressed tar archive at `archivePath` into `targetDir`, overwriting existing files.
+    /// If `filter` is not null, only the entries under one of the filter paths are extracted. `progress` is called with
+    /// the number of processed and total bytes. Returns false if the archive format is not supported; `targetDir` may
+    /// already contain some extracted entries in that case.
+    /// <exception cref="InvalidDataException">The archive is corrupted.</exception>
+    /// <exception cref="OperationCanceledException">`cancellationToken` was cancelled.</exception>
+    public static bool ExtractArchive(string archivePath, string targetDir, string[]? filter,
+            Action<long, long>? progress, CancellationToken cancellationToken) {
+        ProgressCallback callback = (_, processed, total) => {
+            if (cancellationToken.IsCancellationRequested) return 1;
+            progress?.Invoke((long) processed, (long) total);
+            return 0;
+        };
+
+        var errorMessage = new byte[ErrorMessageSize];
+        var result = pog_extract_archive(archivePath, targetDir, filter, (UIntPtr) (filter?.Length ?? 0), callback,
+                IntPtr.Zero, errorMessage, (UIntPtr) errorMessage.Length);
+        GC.KeepAlive(callback);
+
+        switch (result) {
+            case ErrorCancelled:
+                throw new OperationCanceledException(cancellationToken);
+            case ErrorUnsupportedArchive:
+                return false;
+            case ErrorInvalidArchive:
+                throw new InvalidDataException(DecodeErrorMessage(errorMessage));
+        }
+        CheckResult(nameof(pog_extract_archive), result, errorMessage);
+        return true;
+    }
+
+    /// Splits the file at `filePath` into chunks stored in the chunk store at `storeDir`, and writes the list of its chunks
+    /// to `chunkListPath`. The file itself is not modified.
+    public static ChunkStoreStats ChunkStoreAdd(string storeDir, string filePath, string chunkListPath) {
+        var errorMessage = new byte[ErrorMessageSize];
+        var result = pog_chunk_store_add(storeDir, filePath, chunkListPath, out var stats, null, IntPtr.Zero,
+                errorMessage, (UIntPtr) errorMessage.Length);
+        CheckResult(nameof(pog_chunk_store_add), result, errorMessage);
+        return stats;
+    }
+
+    /// Reassembles the file stored in the chunk store at `storeDir` and described by `chunkListPath` into `targetPath`.
+    /// <exception cref="OperationCanceledException">`cancellationToken` was cancelled.</exception>
+    public static void ChunkStoreRestore(string storeDir, string chunkListPath, string targetPath,
+            Action<long, long>? progress, CancellationToken cancellationToken) {
+        ProgressCallback callback = (_, processed, total) => {
+            if (cancellationToken.IsCancellationRequested) return 1;
+            progress?.Invoke((long) processed, (long) total);
+            return 0;
+        };
+
+        var errorMessage = new byte[ErrorMessageSize];
+        var result = pog_chunk_store_restore(storeDir, chunkListPath, targetPath, callback, IntPtr.Zero, errorMessage,
+                (UIntPtr) errorMessage.Length);
+        GC.KeepAlive(callback);
+
+        if (result == ErrorCancelled) {
+            throw new OperationCanceledException(cancellationToken);
+        }
+        CheckResult(nameof(pog_chunk_store_restore), result, errorMessage);
+    }
+
+    /// Same as `ExtractArchive`, but the archive is read directly from the chunk store at `storeDir`, without
+    /// reassembling it first.
+    /// <exception cref="InvalidDataException">The archive is corrupted.</exception>
+    /// <exception cref="OperationCanceledException">`cancellationToken` was cancelled.</exception>
+    public static bool ChunkStoreExtractArchive(string storeDir, string chunkListPath, string targetDir,
+            string[]? filter, Action<long, long>? progress, CancellationToken cancellationToken) {
+        ProgressCallback callback = (_, processed, total) => {
+            if (cancellationToken.IsCancellationRequested) return 1;
+            progress?.Invoke((long) processed, (long) total);
+            return 0;
+        };
+
+        var errorMessage = new byte[ErrorMessageSize];
+        var result = pog_chunk_store_extract_archive(storeDir, chunkListPath, targetDir, filter,
+                (UIntPtr) (filter?.Length ?? 0), callback, IntPtr.Zero, errorMessage, (UIntPtr) errorMessage.Length);
+        GC.KeepAlive(callback);
+
+        switch (result) {
+            case ErrorCancelled:
+                throw new OperationCanceledException(cancellationToken);
+            case ErrorUnsupportedArchive:
+                return false;
+            case ErrorInvalidArchive:
+                throw new InvalidDataException(DecodeErrorMessage(errorMessage));
+        }
+        CheckResult(nameof(pog_chunk_store_extract_archive), result, errorMessage);
+        return true;
+    }
+
+    /// Deletes the chunks in the chunk store at `storeDir` that are not referenced by any of `chunkListPaths` (which must
+    /// be all chunk lists using the store), unless they were used in the last `minAge`. Returns the number of freed bytes.
+    public static ulong ChunkStoreCollect(string storeDir, string[] chunkListPaths, TimeSpan minAge) {
+        var errorMessage = new byte[ErrorMessageSize];
+        var result = pog_chunk_store_collect(storeDir, chunkListPaths, (UIntPtr) chunkListPaths.Length,
+                (uint) minAge.TotalSeconds, out var freedBytes, errorMessage, (UIntPtr) errorMessage.Length);
+        CheckResult(nameof(pog_chunk_store_collect), result, errorMessage);
+        return freedBytes;
+    }
+
+    /// Downloads `url` to `targetPath` over up to `connections` parallel connections (if the server supports range
+    /// requests), continuing a previous interrupted download to the same path if possible. The previous download must
+    /// have had the same `resumeKey` (or the same URL, if null) and the file must not have changed on the server.
+    /// `progress` is called with the number of downloaded and total bytes. On failure, the partial file and its
+    /// `.pogdl` state file are kept, so that the download can be resumed later.
+    /// <exception cref="HttpRequestException">The server returned an error, or the connection failed repeatedly.</exception>
+    /// <exception cref="OperationCanceledException">`cancellationToken` was cancelled.</exception>
+    public static void DownloadFile(string url, string? resumeKey, string targetPath, string userAgent,
+            uint connections, Action<long, long>? progress, CancellationToken cancellationToken) {
+        ProgressCallback callback = (_, processed, total) => {
+            if (cancellationToken.IsCancellationRequested) return 1;
+            progress?.Invoke((long) processed, (long) total);
+            return 0;
+        };
+
+        var errorMessage = new byte[ErrorMessageSize];
+        var result = pog_download_file(url, resumeKey, targetPath, userAgent, connections, callback, IntPtr.Zero,
+                errorMessage, (UIntPtr) errorMessage.Length);
+        GC.KeepAlive(callback);
+
+        switch (result) {
+            case ErrorCancelled:
+                throw new OperationCanceledException(cancellationToken);
+            case ErrorHttp:
+                throw new HttpRequestException($"Could not download file at '{url}': {DecodeErrorMessage(errorMessage)}");
+        }
+        CheckResult(nameof(pog_download_file), result, errorMessage);
+    }
+
+    /// Returns the order-preserving binary sort key of a package version (`pog_version_key`), or null if the version
+    /// cannot be compared by its key (it has a text token, which `PackageVersion` compares with the current culture,
+    /// it's invalid, or too long).
+    /// <exception cref="DllNotFoundException">`pog_native.dll` is not available.</exception>
+    public static unsafe byte[]? GetVersionSortKey(string version) {
+        if (version.Length > MaxVersionKeyInputLength) return null;
+        var utf8 = stackalloc byte[MaxVersionKeyInputLength * 3];
+        int size;
+        fixed (char* chars = version) {
+            size = Encoding.UTF8.GetBytes(chars, version.Length, utf8, MaxVersionKeyInputLength * 3);
+        }
+
+        var key = stackalloc byte[5 * size + 2];
+        if (pog_version_key(utf8, (UIntPtr) size, key, out var keySize) != VersionKeyExact) return null;
+        var result = new byte[(int) keySize];
+        Marshal.Copy((IntPtr) key, result, 0, result.Length);
+        return result;
+    }
+
+    /// Updates the shim at `shimPath` in a single pass: sets the shim data, copies the icons and version info from
+    /// `metadataSourcePath` (or removes them, if null), sets the subsystem, and checks the template features (or
+    /// records them, if `newShim` is set). If `subsystem` is null, it is copied from `metadataSourcePath`. If the shim
+    /// manifest matches, neither the metadata source, nor the other resources of the shim are read. Returns true
+    /// if the shim was changed.
+    /// <exception cref="ShimExecutable.OutdatedShimException">The shim must be replaced with a fresh shim template.
+    /// </exception>
+    /// <exception cref="ShimExecutable.ShimInUseException"></exception>
+    /// <exception cref="DllNotFoundException">`pog_native.dll` is not available.</exception>
+    public static unsafe bool UpdateShim(string shimPath, string? metadataSourcePath, ReadOnlySpan<byte> shimData,
+            ushort features, PeBinary.Subsystem? subsystem, bool newShim) {
+        var flags = (newShim ? ShimNew : 0) | (subsystem == null ? ShimSubsystemFromSource : 0);
+        var errorMessage = new byte[ErrorMessageSize];
+        int result;
+        fixed (byte* shimDataPtr = shimData) {
+            result = pog_update_shim(shimPath, metadataSourcePath, shimDataPtr, (UIntPtr) shimData.Length, features,
+                    subsystem == null ? -1 : (int) subsystem, flags, errorMessage, (UIntPtr) errorMessage.Length);
+        }
+
+        switch (result) {
+            case ErrorOutdatedShim:
+                throw new ShimExecutable.OutdatedShimException(DecodeErrorMessage(errorMessage));
+            case ErrorShimInUse:
+                // TODO: catch this in Export-Command, print the locking processes and wait instead of aborting
+                throw new ShimExecutable.ShimInUseException(
+                        $"Cannot update shim at '{shimPath}', it is currently in use.",
+                        new IOException(DecodeErrorMessage(errorMessage)));
+            case ErrorInvalidPe:
+                throw new IOException($"Cannot update shim at '{shimPath}': {DecodeErrorMessage(errorMessage)}");
+        }
+        CheckResult(nameof(pog_update_shim), result, errorMessage);
+        return result == ShimUpdated;
+    }
+
+    private static void CheckResult(string function, int result, byte[] errorMessage) {
+        if (result >= 0) return;
+        throw result switch {
+            ErrorIo => new IOException(DecodeErrorMessage(errorMessage)),
+            _ => new InternalError($"{function} failed ({result}): {DecodeErrorMessage(errorMessage)}"),
+        };
+    }
+
+    private static string DecodeErrorMessage(byte[] message) {
+        var length = Array.IndexOf(message, (byte) 0);
+        return Encoding.UTF8.GetString(message, 0, length < 0 ? message.Length : length);
+    }
+
+    private static unsafe string DecodeString(byte* str) {
+        var length = 0;
+        while (str[length] != 0) length++;
+        return Encoding.UTF8.GetString(str, length);
+    }
+
+    private static byte[] EncodeString(string str) {
+        var encoded = new byte[Encoding.UTF8.GetByteCount(str) + 1];
+        Encoding.UTF8.GetBytes(str, 0, str.Length, encoded, 0);
+        return encoded;
+    }
+
+    /// <summary>
+    /// Index of the download cache entries (`pog_cache_index`), shared by all Pog processes through a memory-mapped
+    /// file in the cache directory. Packages are identified by their serialized `SourcePackageMetadata`.
+    /// </summary>
+    public sealed class CacheIndex : IDisposable {
+        // longer than the longest file name stored in the index
+        private const int FileNameSize = 256;
+
+        private IntPtr _index;
+
+        public enum AcquireResult { Miss = 0, Hit = 1, HitNewPackage = 2 }
+
+        public record struct Entry(string Key, string FileName, ulong Size, DateTime LastAccess, string[] Packages);
+
+        /// <exception cref="DllNotFoundException">`pog_native.dll` is not available.</exception>
+        public CacheIndex(string cacheDir) {
+            var errorMessage = new byte[ErrorMessageSize];
+            CheckResult(nameof(pog_cache_index_open),
+                    pog_cache_index_open(cacheDir, out _index, errorMessage, (UIntPtr) errorMessage.Length),
+                    errorMessage);
+        }
+
+        /// Looks up the entry and marks it as used by `package`; a hit must be paired with a call to `Release`.
+        /// `fileName` is empty if the entry file name was too long to be indexed.
+        public AcquireResult Acquire(string key, string? package, out string fileName) {
+            var fileNameBuffer = new byte[FileNameSize];
+            var errorMessage = new byte[ErrorMessageSize];
+            var result = pog_cache_index_acquire(_index, key, package, fileNameBuffer, (UIntPtr) fileNameBuffer.Length,
+                    errorMessage, (UIntPtr) errorMessage.Length);
+            CheckResult(nameof(pog_cache_index_acquire), result, errorMessage);
+            fileName = Encoding.UTF8.GetString(fileNameBuffer, 0, Array.IndexOf(fileNameBuffer, (byte) 0));
+            return (AcquireResult) result;
+        }
+
+        public void Release(string key) {
+            var errorMessage = new byte[ErrorMessageSize];
+            CheckResult(nameof(pog_cache_index_release), pog_cache_index_release(_index, key, errorMessage,
+                    (UIntPtr) errorMessage.Length), errorMessage);
+        }
+
+        /// Returns false if the entry is already indexed, or its key is too long to be indexed.
+        public unsafe bool Add(string key, string fileName, ulong size, DateTime lastAccess, IEnumerable<string> packages) {
+            var packageList = new StringBuilder();
+            foreach (var p in packages) packageList.Append(p).Append('\n');
+
+            var errorMessage = new byte[ErrorMessageSize];
+            fixed (byte* keyPtr = EncodeString(key), fileNamePtr = EncodeString(fileName),
+                   packagesPtr = EncodeString(packageList.ToString())) {
+                var entry = new NativeCacheEntry {
+                    Key = keyPtr, FileName = fileNamePtr, Size = size, LastAccess = (ulong) lastAccess.ToFileTime(),
+                    Packages = packagesPtr,
+                };
+                var result = pog_cache_index_add(_index, &entry, errorMessage, (UIntPtr) errorMessage.Length);
+                CheckResult(nameof(pog_cache_index_add), result, errorMessage);
+                return result == 1;
+            }
+        }
+
+        /// Returns false if the entry was not indexed.
+        public bool Remove(string key) {
+            var errorMessage = new byte[ErrorMessageSize];
+            var result = pog_cache_index_remove(_index, key, errorMessage, (UIntPtr) errorMessage.Length);
+            CheckResult(nameof(pog_cache_index_remove), result, errorMessage);
+            return result == 1;
+        }
+
+        public unsafe List<Entry> Enumerate() {
+            var entries = new List<Entry>();
+            CacheEntryCallback callback = (_, entry) => {
+                entries.Add(new Entry(DecodeString(entry->Key), DecodeString(entry->FileName), entry->Size,
+                        DateTime.FromFileTime((long) entry->LastAccess),
+                        DecodeString(entry->Packages).Split(['\n'], StringSplitOptions.RemoveEmptyEntries)));
+            };
+            var errorMessage = new byte[ErrorMessageSize];
+            var result = pog_cache_index_enumerate(_index, callback, IntPtr.Zero, errorMessage,
+                    (UIntPtr) errorMessage.Length);
+            GC.KeepAlive(callback);
+            CheckResult(nameof(pog_cache_index_enumerate), result, errorMessage);
+            return entries;
+        }
+
+        public void Dispose() {
+            if (_index != IntPtr.Zero) {
+                pog_cache_index_close(_index);
+                _index = IntPtr.Zero;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Local binary copy of the package index of a remote repository (`pog_repo_index`), memory-mapped from the newest
+    /// generation of the index file in the index directory. An opened index never changes, so it can be read from any
+    /// thread without locking; a refreshed index is written by `Write` and opened as a new instance.
+    /// </summary>
+    public sealed class RepositoryIndex : IDisposable {
+        public enum UpdateResult {
+            /// The repository does not publish delta patches, or the index is too old for them.
+            FullDownloadNeeded = 0,
+            UpToDate = 1,
+            /// Patches were appended to the stored index, reopen it to see them.
+            Patched = 2,
+        }
+
+        private IntPtr _index;
+
+        public readonly int PackageCount;
+        /// Sequence number of the remote index, 0 if the repository does not publish delta patches.
+        public readonly ulong Sequence;
+        public readonly string? ETag;
+        public readonly string? LastModified;
+
+        /// Time of the last refresh of the index, by any Pog process; updated by `Touch`.
+        public DateTime LastWriteTime {get; private set;}
+
+        private unsafe RepositoryIndex(IntPtr index) {
+            _index = index;
+            pog_repo_index_get_info(index, out var info);
+            PackageCount = (int) info.PackageCount;
+            Sequence = info.Sequence;
+            ETag = info.ETagSize == UIntPtr.Zero ? null : Encoding.UTF8.GetString(info.ETag, (int) info.ETagSize);
+            LastModified = info.LastModifiedSize == UIntPtr.Zero
+                    ? null
+                    : Encoding.UTF8.GetString(info.LastModified, (int) info.LastModifiedSize);
+            LastWriteTime = DateTime.FromFileTimeUtc((long) info.LastWriteTime);
+        }
+
+        // a replaced index may still be used by other threads, so it's not disposed explicitly, but left to the GC
+        ~RepositoryIndex() => Dispose();
+
+        /// Opens the newest index in `indexDir`, returns null if there's none.
+        /// <exception cref="DllNotFoundException">`pog_native.dll` is not available.</exception>
+        public static RepositoryIndex? Open(string indexDir) {
+            var errorMessage = new byte[ErrorMessageSize];
+            var result = pog_repo_index_open(indexDir, out var index, errorMessage, (UIntPtr) errorMessage.Length);
+            CheckResult(nameof(pog_repo_index_open), result, errorMessage);
+            return result == 0 ? null : new RepositoryIndex(index);
+        }
+
+        /// Writes a new index to `indexDir`. `packages` contains a line for each package, with the package name and its
+        /// versions (newest first) separated by tabs. `sequence` is the one returned by `Update`.
+        public static unsafe void Write(string indexDir, string packages, string? etag, string? lastModified,
+                ulong sequence) {
+            var errorMessage = new byte[ErrorMessageSize];
+            var encoded = Encoding.UTF8.GetBytes(packages);
+            fixed (byte* packagesPtr = encoded) {
+                CheckResult(nameof(pog_repo_index_write), pog_repo_index_write(indexDir, packagesPtr,
+                        (UIntPtr) encoded.Length, etag, lastModified, sequence, errorMessage,
+                        (UIntPtr) errorMessage.Length), errorMessage);
+            }
+        }
+
+        /// Brings `index` (may be null) up to date with the remote repository at `repositoryUrl` by downloading
+        /// and applying delta patches. `sequence` is set to the sequence number of the remote index.
+        /// <exception cref="HttpRequestException">The server returned an error, or the connection failed.</exception>
+        public static UpdateResult Update(RepositoryIndex? index, string repositoryUrl, string userAgent,
+                out ulong sequence) {
+            var errorMessage = new byte[ErrorMessageSize];
+            var result = pog_repo_index_update(index?._index ?? IntPtr.Zero, repositoryUrl, userAgent, out sequence,
+                    errorMessage, (UIntPtr) errorMessage.Length);
+            GC.KeepAlive(index);
+            if (result == ErrorHttp) {
+                throw new HttpRequestException($"Could not update the package index of '{repositoryUrl}': " +
+                                               DecodeErrorMessage(errorMessage));
+            }
+            CheckResult(nameof(pog_repo_index_update), result, errorMessage);
+            if (result == (int) UpdateResult.UpToDate && index != null) index.LastWriteTime = DateTime.UtcNow;
+            return (UpdateResult) result;
+        }
+
+        /// Marks the index as up to date with the remote index.
+        public void Touch() {
+            var errorMessage = new byte[ErrorMessageSize];
+            var result = pog_repo_index_touch(_index, errorMessage, (UIntPtr) errorMessage.Length);
+            GC.KeepAlive(this);
+            CheckResult(nameof(pog_repo_index_touch), result, errorMessage);
+            LastWriteTime = DateTime.UtcNow;
+        }
+
+        /// Returns the index of the package called `name` (case-insensitive), or -1.
+        public unsafe int Find(string name) {
+            var encoded = Encoding.UTF8.GetBytes(name);
+            fixed (byte* namePtr = encoded) {
+                var package = pog_repo_index_find(_index, namePtr, (UIntPtr) encoded.Length);
+                GC.KeepAlive(this);
+                return package;
+            }
+        }
+
+        public unsafe string GetName(int package) {
+            var size = pog_repo_index_get_name(_index, (uint) package, out var name);
+            var str = Encoding.UTF8.GetString(name, (int) size);
+            // `name` points into the mapped view, which the finalizer would unmap
+            GC.KeepAlive(this);
+            return str;
+        }
+
+        /// Returns the versions of the package, newest first.
+        public unsafe string[] GetVersions(int package) {
+            var versions = new string[pog_repo_index_get_version_count(_index, (uint) package)];
+            for (var i = 0; i < versions.Length; i++) {
+                var size = pog_repo_index_get_version(_index, (uint) package, (uint) i, out var str);
+                versions[i] = Encoding.UTF8.GetString(str, (int) size);
+            }
+            GC.KeepAlive(this);
+            return versions;
+        }
+
+        public void Dispose() {
+            if (_index != IntPtr.Zero) {
+                pog_repo_index_close(_index);
+                _index = IntPtr.Zero;
+            }
+            GC.SuppressFinalize(this);
+        }
+    }
+
+    /// <summary>
+    /// Cache of compiled templated manifests (`pog_manifest_cache`), memory-mapped from the newest generation of the cache
+    /// file in the cache directory. Keys are 32-byte hashes computed by the caller from the template and the data file.
+    /// May be used from multiple threads at once; entries added by other processes are only seen after reopening.
+    /// </summary>
+    public sealed class ManifestCache : IDisposable {
+        public const int KeySize = 32;
+
+        private IntPtr _cache;
+
+        private ManifestCache(IntPtr cache) {
+            _cache = cache;
+        }
+
+        ~ManifestCache() => Dispose();
+
+        /// Opens the cache in `cacheDir` (which must exist), or creates an empty one.
+        /// <exception cref="DllNotFoundException">`pog_native.dll` is not available.</exception>
+        public static ManifestCache Open(string cacheDir) {
+            var errorMessage = new byte[ErrorMessageSize];
+            CheckResult(nameof(pog_manifest_cache_open), pog_manifest_cache_open(cacheDir, out var cache, errorMessage,
+                    (UIntPtr) errorMessage.Length), errorMessage);
+            return new ManifestCache(cache);
+        }
+
+        public unsafe bool TryGet(byte[] key, out string manifest) {
+            CheckKey(key);
+            var found = pog_manifest_cache_find(_cache, key, out var str, out var size) != 0;
+            manifest = found ? Encoding.UTF8.GetString(str, (int) size) : "";
+            GC.KeepAlive(this);
+            return found;
+        }
+
+        public unsafe void Add(byte[] key, string manifest) {
+            CheckKey(key);
+            var errorMessage = new byte[ErrorMessageSize];
+            var encoded = Encoding.UTF8.GetBytes(manifest);
+            fixed (byte* manifestPtr = encoded) {
+                CheckResult(nameof(pog_manifest_cache_add), pog_manifest_cache_add(_cache, key, manifestPtr,
+                        (UIntPtr) encoded.Length, errorMessage, (UIntPtr) errorMessage.Length), errorMessage);
+            }
+            GC.KeepAlive(this);
+        }
+
+        private static void CheckKey(byte[] key) {
+            if (key.Length != KeySize) {
+                throw new ArgumentException($"Manifest cache key must have {KeySize} bytes.", nameof(key));
+            }
+        }
+
+        public void Dispose() {
+            if (_cache != IntPtr.Zero) {
+                pog_manifest_cache_close(_cache);
+                _cache = IntPtr.Zero;
+            }
+            GC.SuppressFinalize(this);
+        }
+    }
+
+    /// <summary>
+    /// Write-only stream that stores the written data to a file and computes its SHA-256 hash on background threads
+    /// (`pog_download_sink`), so that the downloading thread only copies the received data.
+    /// </summary>
+    public sealed class DownloadSink : Stream {
+        private IntPtr _sink;
+        private readonly byte[] _errorMessage = new byte[ErrorMessageSize];
+        private long _position;
+
+        /// <exception cref="DllNotFoundException">`pog_native.dll` is not available.</exception>
+        public DownloadSink(string path) {
+            CheckResult(nameof(pog_download_sink_create),
+                    pog_download_sink_create(path, out _sink, _errorMessage, (UIntPtr) _errorMessage.Length),
+                    _errorMessage);
+        }
+
+        public override unsafe void Write(byte[] buffer, int offset, int count) {
+            if (_sink == IntPtr.Zero) throw new ObjectDisposedException(nameof(DownloadSink));
+            fixed (byte* data = buffer) {
+                CheckResult(nameof(pog_download_sink_write), pog_download_sink_write(_sink, data + offset,
+                        (UIntPtr) count, _errorMessage, (UIntPtr) _errorMessage.Length), _errorMessage);
+            }
+            _position += count;
+        }
+
+        /// Waits until all data are written and returns the SHA-256 hash of the file.
+        public byte[] Finish() {
+            if (_sink == IntPtr.Zero) throw new ObjectDisposedException(nameof(DownloadSink));
+            var digest = new byte[32];
+            CheckResult(nameof(pog_download_sink_finish), pog_download_sink_finish(_sink, digest, _errorMessage,
+                    (UIntPtr) _errorMessage.Length), _errorMessage);
+            return digest;
+        }
+
+        protected override void Dispose(bool disposing) {
+            if (_sink != IntPtr.Zero) {
+                pog_download_sink_close(_sink);
+                _sink = IntPtr.Zero;
+            }
+            base.Dispose(disposing);
+        }
+
+        public override bool CanRead => false;
+        public override bool CanSeek => false;
+        public override bool CanWrite => true;
+        public override long Length => _position;
+
+        public override long Position {
+            get => _position;
+            set => throw new NotSupportedException();
+        }
+
+        public override void Flush() {}
+        public override int Read(byte[] buffer, int offset, int count) => throw new NotSupportedException();
+        public override long Seek(long offset, SeekOrigin origin) => throw new NotSupportedException();
+        public override void SetLength(long value) => throw new NotSupportedException();
+    }
+}
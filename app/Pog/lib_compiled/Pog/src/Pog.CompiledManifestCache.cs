@@ -0,0 +1,108 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.IO;
+using System.Linq;
+using System.Security.Cryptography;
+using System.Text;
+using Pog.Native;
+
+namespace Pog;
+
+/// <summary>
+/// On-disk cache of compiled manifests of templated repository packages, shared by all Pog processes. Compiling
+/// a manifest with <see cref="ManifestTemplateFile.Substitute"/> parses both the template and the data file; the cache
+/// stores the compiled manifest text under a key derived from the SHA-256 hashes of both files, so that a hit only
+/// reads the two files, and a changed template or data file never hits a stale entry. Manifests contain scriptblocks,
+/// which cannot be persisted, so the compiled manifest is still parsed once by <see cref="PackageManifest"/>.
+/// The cache itself is native (`pog_native.dll`) and memory-mapped; without it, all lookups miss.
+/// </summary>
+internal static class CompiledManifestCache {
+    /// Included in every key; change it whenever the output of <see cref="ManifestTemplateFile.Substitute"/> changes,
+    /// so that manifests compiled by an older version of Pog are not used.
+    private static readonly byte[] KeyVersion = Encoding.UTF8.GetBytes("pog-manifest-template-v1\0");
+
+    private static readonly object OpenLock = new();
+    private static PogNative.ManifestCache? _cache;
+    private static bool _unavailable;
+
+    private record TemplateHash(long Size, DateTime LastWriteTime, byte[] Hash);
+
+    /// Hashes of the templates, so that the template of each package is only read once, unless it changes.
+    private static readonly ConcurrentDictionary<string, TemplateHash> TemplateHashes =
+            new(StringComparer.OrdinalIgnoreCase);
+
+    private static PogNative.ManifestCache? GetCache() {
+        lock (OpenLock) {
+            if (_cache != null || _unavailable) return _cache;
+            try {
+                var cacheDir = InternalState.PathConfig.ManifestCacheDir;
+                Directory.CreateDirectory(cacheDir);
+                return _cache = PogNative.ManifestCache.Open(cacheDir);
+            } catch (Exception e) when (e is DllNotFoundException or IOException or UnauthorizedAccessException) {
+                // the cache is only an optimization, compile the manifests every time
+                _unavailable = true;
+                return null;
+            }
+        }
+    }
+
+    /// Returns the compiled manifest for the template at <paramref name="templatePath"/> and the data file
+    /// at <paramref name="dataPath"/>, if it's cached. Otherwise, returns null, and <paramref name="key"/> is set
+    /// to the key to pass to <see cref="Add"/> once the manifest is compiled and validated (null if the cache is
+    /// not available).
+    public static string? TryGet(string templatePath, string dataPath, out byte[]? key) {
+        key = null;
+        var cache = GetCache();
+        if (cache == null) return null;
+
+        try {
+            key = ComputeKey(templatePath, dataPath);
+        } catch (IOException) {
+            // let the compilation report the missing or unreadable file
+            return null;
+        }
+        if (!cache.TryGet(key, out var manifest)) return null;
+
+        InstrumentationCounter.ManifestCacheHits.Increment();
+        return manifest;
+    }
+
+    /// Stores the compiled <paramref name="manifest"/> under <paramref name="key"/> from <see cref="TryGet"/>, unless
+    /// the template or the data file changed since the key was computed, in which case the manifest may be compiled
+    /// from the changed files.
+    public static void Add(byte[] key, string templatePath, string dataPath, string manifest) {
+        try {
+            if (!ComputeKey(templatePath, dataPath).SequenceEqual(key)) return;
+            GetCache()?.Add(key, manifest);
+        } catch (IOException) {
+            // the entry is just not cached, e.g. if the cache directory is read-only
+        }
+    }
+
+    private static byte[] ComputeKey(string templatePath, string dataPath) {
+        var templateHash = GetTemplateHash(templatePath);
+        using var sha = SHA256.Create();
+        var dataHash = sha.ComputeHash(File.ReadAllBytes(dataPath));
+
+        var input = new byte[KeyVersion.Length + templateHash.Length + dataHash.Length];
+        KeyVersion.CopyTo(input, 0);
+        templateHash.CopyTo(input, KeyVersion.Length);
+        dataHash.CopyTo(input, KeyVersion.Length + templateHash.Length);
+        return sha.ComputeHash(input);
+    }
+
+    private static byte[] GetTemplateHash(string templatePath) {
+        var info = new FileInfo(templatePath);
+        var size = info.Length;
+        var lastWriteTime = info.LastWriteTimeUtc;
+        if (TemplateHashes.TryGetValue(templatePath, out var cached) && cached.Size == size &&
+            cached.LastWriteTime == lastWriteTime) {
+            return cached.Hash;
+        }
+
+        using var sha = SHA256.Create();
+        var hash = sha.ComputeHash(File.ReadAllBytes(templatePath));
+        TemplateHashes[templatePath] = new(size, lastWriteTime, hash);
+        return hash;
+    }
+}
@@ -1,5 +1,12 @@
-﻿using System.Threading;
+﻿using System;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using System.Text;
+using System.Text.Json;
+using System.Threading;
 using JetBrains.Annotations;
+using Pog.Utils;
 
 namespace Pog;
 
@@ -9,6 +16,148 @@ public static class InstrumentationCounter {
     public static Counter ManifestLoads = new();
     public static Counter PackageRootFileReads = new();
     public static Counter ManifestTemplateSubstitutions = new();
+    public static Counter ManifestCacheHits = new();
+
+    // latencies of the main phases of package operations, to see which one dominates e.g. `Install-Pog`
+    public static readonly LatencyHistogram ManifestLoadTime = new();
+    public static readonly LatencyHistogram ManifestTemplateSubstitutionTime = new();
+    public static readonly LatencyHistogram DownloadTime = new();
+    public static readonly LatencyHistogram HashTime = new();
+    public static readonly LatencyHistogram ExtractionTime = new();
+    public static readonly LatencyHistogram ShimUpdateTime = new();
+
+    /// If set, the counters and latencies are exported to the file at this path after each Pog cmdlet finishes,
+    /// see <see cref="Export"/>.
+    public const string ExportPathEnvVar = "POG_METRICS_FILE";
+
+    /// Powers of 2 in nanoseconds used as the histogram buckets in the OpenMetrics export, ~1 µs to ~9.8 hours. Fixed,
+    /// so that the buckets are the same in each export, as collectors expect.
+    private const int OpenMetricsMinBucketExponent = 10;
+    private const int OpenMetricsMaxBucketExponent = 45;
+
+    private static (string Name, string Help, long Value)[] ReadCounters() => [
+        ("user_manifest_loads", "Loaded user manifests.", (long) UserManifestLoads.Value),
+        ("manifest_loads", "Loaded package manifests.", (long) ManifestLoads.Value),
+        ("package_root_file_reads", "Reads of the package root configuration file.", (long) PackageRootFileReads.Value),
+        ("manifest_template_substitutions", "Substituted manifest templates.",
+            (long) ManifestTemplateSubstitutions.Value),
+        ("manifest_cache_hits", "Templated manifests loaded from the compiled manifest cache.",
+            (long) ManifestCacheHits.Value),
+    ];
+
+    private static (string Name, string Help, LatencyHistogram.Snapshot Snapshot)[] ReadHistograms() => [
+        ("manifest_load", "Time to load a package manifest.", ManifestLoadTime.TakeSnapshot()),
+        ("manifest_template_substitution", "Time to substitute a manifest template.",
+            ManifestTemplateSubstitutionTime.TakeSnapshot()),
+        ("download", "Time to download a package source.", DownloadTime.TakeSnapshot()),
+        ("hash", "Time to hash a file.", HashTime.TakeSnapshot()),
+        ("extraction", "Time to extract an archive.", ExtractionTime.TakeSnapshot()),
+        ("shim_update", "Time to write or update an exported shim.", ShimUpdateTime.TakeSnapshot()),
+    ];
+
+    /// Exports to the path in <see cref="ExportPathEnvVar"/>, if set. Failures are ignored, the metrics are
+    /// not important enough to break the invoked command.
+    internal static void ExportIfEnabled() {
+        var path = Environment.GetEnvironmentVariable(ExportPathEnvVar);
+        if (string.IsNullOrEmpty(path)) {
+            return;
+        }
+        try {
+            Export(path);
+        } catch (Exception e) when (e is IOException or UnauthorizedAccessException) {}
+    }
+
+    /// Writes all counters and latency histograms to `path`, as JSON if the path ends with `.json`, otherwise in
+    /// the OpenMetrics text format. The file is replaced atomically, so that a collector never reads a partial export.
+    [PublicAPI]
+    public static void Export(string path) {
+        var tmpPath = $"{path}.{Process.GetCurrentProcess().Id}.tmp";
+        try {
+            using (var stream = File.Create(tmpPath)) {
+                if (path.EndsWith(".json", StringComparison.OrdinalIgnoreCase)) {
+                    WriteJson(stream);
+                } else {
+                    WriteOpenMetrics(stream);
+                }
+            }
+            FsUtils.MoveAtomically(tmpPath, path, replaceExistingFile: true);
+        } finally {
+            FsUtils.EnsureDeleteFile(tmpPath);
+        }
+    }
+
+    /// Writes a JSON object with the counters, and the count, sum, min, max, percentiles and non-empty buckets
+    /// of each latency histogram, in nanoseconds.
+    public static void WriteJson(Stream stream) {
+        using var writer = new Utf8JsonWriter(stream, new JsonWriterOptions {Indented = true});
+        writer.WriteStartObject();
+        writer.WriteNumber("process_id", Process.GetCurrentProcess().Id);
+        writer.WriteString("timestamp", DateTime.UtcNow);
+
+        writer.WriteStartObject("counters");
+        foreach (var (name, _, value) in ReadCounters()) {
+            writer.WriteNumber(name, value);
+        }
+        writer.WriteEndObject();
+
+        writer.WriteStartObject("latencies_ns");
+        foreach (var (name, _, snapshot) in ReadHistograms()) {
+            writer.WriteStartObject(name);
+            writer.WriteNumber("count", snapshot.Count);
+            writer.WriteNumber("sum", snapshot.Sum);
+            writer.WriteNumber("min", snapshot.Min);
+            writer.WriteNumber("max", snapshot.Max);
+            writer.WriteNumber("mean", snapshot.Mean);
+            writer.WriteNumber("p50", snapshot.ValueAtPercentile(50));
+            writer.WriteNumber("p90", snapshot.ValueAtPercentile(90));
+            writer.WriteNumber("p99", snapshot.ValueAtPercentile(99));
+            writer.WriteNumber("p999", snapshot.ValueAtPercentile(99.9));
+            writer.WriteStartArray("buckets");
+            foreach (var (upperBound, count) in snapshot.EnumerateBuckets()) {
+                writer.WriteStartObject();
+                writer.WriteNumber("le", upperBound);
+                writer.WriteNumber("count", count);
+                writer.WriteEndObject();
+            }
+            writer.WriteEndArray();
+            writer.WriteEndObject();
+        }
+        writer.WriteEndObject();
+
+        writer.WriteEndObject();
+    }
+
+    /// Writes the counters and latency histograms in the OpenMetrics text format, with the metric names prefixed
+    /// with `pog_` and the latencies in seconds.
+    public static void WriteOpenMetrics(Stream stream) {
+        var sb = new StringBuilder();
+        foreach (var (name, help, value) in ReadCounters()) {
+            sb.Append($"# TYPE pog_{name} counter\n");
+            sb.Append($"# HELP pog_{name} {help}\n");
+            sb.Append($"pog_{name}_total {value}\n");
+        }
+        foreach (var (name, help, snapshot) in ReadHistograms()) {
+            var metric = $"pog_{name}_seconds";
+            sb.Append($"# TYPE {metric} histogram\n");
+            sb.Append($"# UNIT {metric} seconds\n");
+            sb.Append($"# HELP {metric} {help}\n");
+            for (var e = OpenMetricsMinBucketExponent; e <= OpenMetricsMaxBucketExponent; e++) {
+                var le = FormatSeconds(1L << e);
+                sb.Append($"{metric}_bucket{{le=\"{le}\"}} {snapshot.CountBelowPowerOf2(e)}\n");
+            }
+            sb.Append($"{metric}_bucket{{le=\"+Inf\"}} {snapshot.Count}\n");
+            sb.Append($"{metric}_count {snapshot.Count}\n");
+            sb.Append($"{metric}_sum {FormatSeconds(snapshot.Sum)}\n");
+        }
+        sb.Append("# EOF\n");
+
+        var bytes = new UTF8Encoding(false).GetBytes(sb.ToString());
+        stream.Write(bytes, 0, bytes.Length);
+    }
+
+    private static string FormatSeconds(long nanoseconds) {
+        return (nanoseconds / 1e9).ToString("R", CultureInfo.InvariantCulture);
+    }
 
     public struct Counter {
         private long _value = 0;
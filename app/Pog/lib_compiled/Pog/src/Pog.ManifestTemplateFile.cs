@@ -22,6 +22,7 @@ public static class ManifestTemplateFile {
 
     public static string Substitute(string templatePath, string templateDataPath) {
         InstrumentationCounter.ManifestTemplateSubstitutions.Increment();
+        using var _ = InstrumentationCounter.ManifestTemplateSubstitutionTime.Time();
 
         var substitutionTable = ParseSubstitutionFile(templateDataPath);
 
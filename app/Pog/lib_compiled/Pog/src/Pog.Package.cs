@@ -34,6 +34,7 @@ public abstract class Package {
 
     /// <inheritdoc cref="LoadManifest"/>
     public PackageManifest ReloadManifest() {
+        using var _ = InstrumentationCounter.ManifestLoadTime.Time();
         return _manifest = LoadManifest();
     }
 
@@ -41,6 +42,7 @@ public abstract class Package {
     //  on if and how to provide an async public API
     /// <inheritdoc cref="LoadManifest"/>
     internal async Task<PackageManifest> ReloadManifestAsync(CancellationToken token = default) {
+        using var _ = InstrumentationCounter.ManifestLoadTime.Time();
         return _manifest = await LoadManifestAsync(token).ConfigureAwait(false);
     }
 
@@ -3,6 +3,7 @@ using System.Collections.Generic;
 using System.Linq;
 using System.Text.RegularExpressions;
 using JetBrains.Annotations;
+using Pog.Native;
 using IOPath = System.IO.Path;
 
 namespace Pog;
@@ -22,6 +23,10 @@ public class PackageVersion : IComparable<PackageVersion>, IComparable, IEquatab
     public readonly string? BuildMetadata;
     /// The original unchanged version string.
     private readonly string _versionString;
+    /// Binary sort key from `pog_native.dll`, computed on the first comparison; empty if the version must be compared
+    /// by walking `Main` and `Dev` (it has a text token, or `pog_native.dll` is not available).
+    private byte[]? _sortKey;
+    private static bool _nativeSortKeyUnavailable = false;
 
     public enum DevVersionType {
         Nightly = 0, Preview = 1, Alpha = 2, Beta = 3, Rc = 4,
@@ -116,6 +121,11 @@ public class PackageVersion : IComparable<PackageVersion>, IComparable, IEquatab
             return 1;
         }
 
+        // the native sort keys order versions exactly like the comparison below, but compare with a single memcmp
+        if (GetSortKey() is {Length: > 0} key1 && v2.GetSortKey() is {Length: > 0} key2) {
+            return ((ReadOnlySpan<byte>) key1).SequenceCompareTo(key2);
+        }
+
         var v1 = this;
         // compare the main (semi-semver) part
         // if one of the versions is shorter than the other, treat the extra fields as zeros
@@ -164,6 +174,23 @@ public class PackageVersion : IComparable<PackageVersion>, IComparable, IEquatab
         return 0;
     }
 
+    private byte[] GetSortKey() {
+        // a concurrent computation results in an equal key, no need to lock
+        return _sortKey ??= ComputeSortKey();
+    }
+
+    private byte[] ComputeSortKey() {
+        if (!_nativeSortKeyUnavailable) {
+            try {
+                return PogNative.GetVersionSortKey(_versionString) ?? [];
+            } catch (DllNotFoundException) {
+                // pog_native.dll is not built (development setup)
+                _nativeSortKeyUnavailable = true;
+            }
+        }
+        return [];
+    }
+
     // we want a non-generic comparison, since that's what PowerShell likes to use
     public int CompareTo(object? obj) {
         if (obj is PackageVersion v) return CompareTo(v);
@@ -72,7 +72,8 @@ public class PathConfig {
     public readonly string MainModulePath;
 
     public readonly string ContainerDir;
-    public readonly string ShimPath;
+    /// Directory with the shim templates, see <see cref="Shim.ShimExecutable.GetTemplateFileName"/>.
+    public readonly string ShimTemplateDir;
     public readonly string VcRedistDir;
 
     /// Directory where exported shortcuts from packages are copied (per-user).
@@ -86,6 +87,13 @@ public class PathConfig {
     /// from this dir to download cache, and if the system directory was on a different partition,
     /// this move could be needlessly expensive.
     public readonly string DownloadTmpDir;
+    /// Directory where large downloads are staged in a subdirectory per URL, so that an interrupted download can be
+    /// resumed by a later installation, even though the temporary directory of the failed one is deleted.
+    public readonly string DownloadResumeDir;
+    /// Directory where the package indexes of remote repositories are stored, in a subdirectory for each repository.
+    public readonly string RepositoryIndexDir;
+    /// Directory where compiled manifests of templated repository packages are cached.
+    public readonly string ManifestCacheDir;
 
     /// Path to the exported 7-Zip binary, needed for package extraction during installation.
     public readonly string Path7Zip;
@@ -104,7 +112,7 @@ public class PathConfig {
         var appPath = $"{pogRootPath}\\app\\Pog";
         MainModulePath = appPath;
         ContainerDir = $"{appPath}\\container";
-        ShimPath = $"{appPath}\\lib_compiled\\PogShimTemplate.exe";
+        ShimTemplateDir = $"{appPath}\\lib_compiled";
         VcRedistDir = $"{appPath}\\lib_compiled\\vc_redist";
 
         var dataPath = $"{dataRootPath}\\data";
@@ -116,5 +124,8 @@ public class PathConfig {
         var cachePath = $"{dataRootPath}\\cache";
         DownloadCacheDir = $"{cachePath}\\download_cache";
         DownloadTmpDir = $"{cachePath}\\download_tmp";
+        DownloadResumeDir = $"{cachePath}\\download_resume";
+        RepositoryIndexDir = $"{cachePath}\\repository_index";
+        ManifestCacheDir = $"{cachePath}\\manifest_cache";
     }
 }
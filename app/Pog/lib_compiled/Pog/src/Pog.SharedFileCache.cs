@@ -6,6 +6,7 @@ using System.Text.Json;
 using System.Threading;
 using JetBrains.Annotations;
 using Microsoft.Win32.SafeHandles;
+using Pog.Native;
 using Pog.Utils;
 using IOPath = System.IO.Path;
 
@@ -53,17 +54,55 @@ public class CacheEntryInUseException : Exception {
 //     - one is called `referencingPackages.json-list`, it contains a list of packages that accessed this entry
 //     - second one has any other name, and is the actual cache entry; during insertion, if the entry file is also called
 //       `referencingPackages.json-list`, it is prefixed with `_`
+//  - `cache-index.<n>` is a shared index of the entries (`pog_cache_index` in `pog_native.dll`); the entry directories
+//    stay authoritative, but the index lets lookups and listings skip opening them; entries missing from the index
+//    (e.g. added by an older version of Pog) are read from their directory and indexed, stale index entries are removed
+//  - if the `.chunks` directory exists, new entry files are deduplicated: the file is split into content-defined chunks
+//    stored once in `.chunks` (`pog_chunk_store` in `pog_native.dll`), and replaced by `<file name>.pogchunks`, the list
+//    of its chunks; successive versions of a package typically share most of their chunks; chunks no longer referenced
+//    by any entry are deleted by `CollectChunks`
 [PublicAPI]
 public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
     private const string MetadataFileName = "referencingPackages.json-list";
+    private const string ChunkStoreDirName = ".chunks";
+    internal const string ChunkListExtension = ".pogchunks";
+    /// Chunks written in this interval may belong to an entry that's still being added, and are not collected.
+    private static readonly TimeSpan MinUnreferencedChunkAge = TimeSpan.FromDays(1);
 
     public readonly string Path = cacheDirPath;
     /// Directory for temporary files on the same volume as `.Path`, used for adding and removing entries.
     private readonly TmpDirectory _tmpDirectory = tmpDir;
 
+    private string ChunkStorePath => IOPath.Combine(Path, ChunkStoreDirName);
+    /// New entries are deduplicated if the chunk store directory exists; existing entries are not converted.
+    public bool Deduplicate => Directory.Exists(ChunkStorePath);
+
+    private readonly object _indexLock = new();
+    private PogNative.CacheIndex? _index;
+    private bool _indexUnavailable;
+
+    /// The shared entry index, or null if `pog_native.dll` is not available (development setup), or the cache
+    /// directory does not exist yet. The index is kept open for the lifetime of the process.
+    private PogNative.CacheIndex? Index {
+        get {
+            lock (_indexLock) {
+                if (_index != null || _indexUnavailable || !Directory.Exists(Path)) return _index;
+                try {
+                    _index = new PogNative.CacheIndex(Path);
+                } catch (DllNotFoundException) {
+                    _indexUnavailable = true;
+                }
+                return _index;
+            }
+        }
+    }
+
     public delegate void InvalidCacheEntryCb(InvalidCacheEntryException exception);
 
     public IEnumerable<CacheEntryInfo> EnumerateEntries(InvalidCacheEntryCb? invalidEntryCb = null) {
+        if (Index is {} index) {
+            return EnumerateIndexedEntries(index, invalidEntryCb);
+        }
         // .SelectOptional is also necessary to avoid race conditions (cache entry exists when entries are enumerated,
         //  but is deleted before `GetEntryInfoInner(...)` finishes)
         return FsUtils.EnumerateNonHiddenDirectoryNames(Path).SelectOptional(entryKey => {
@@ -76,6 +115,40 @@ public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
         });
     }
 
+    /// Lists the entry directories (which is cheap, compared to opening each of them), and reads the entry info
+    /// from the index, falling back to the entry directory for entries that are not indexed.
+    private IEnumerable<CacheEntryInfo> EnumerateIndexedEntries(PogNative.CacheIndex index,
+            InvalidCacheEntryCb? invalidEntryCb) {
+        var indexed = index.Enumerate().ToDictionary(e => e.Key);
+        foreach (var entryKey in FsUtils.EnumerateNonHiddenDirectoryNames(Path)) {
+            if (indexed.TryGetValue(entryKey, out var e) && e.FileName != "") {
+                indexed.Remove(entryKey);
+                yield return new CacheEntryInfo(entryKey, IOPath.Combine(Path, entryKey, e.FileName), e.Size,
+                        e.LastAccess, e.Packages.SelectOptional(p => SourcePackageMetadata.ParseFromJson(p)).ToArray());
+                continue;
+            }
+            indexed.Remove(entryKey);
+
+            CacheEntryInfo? info;
+            try {
+                info = GetEntryInfoInner(entryKey);
+            } catch (InvalidCacheEntryException ex) {
+                invalidEntryCb?.Invoke(ex);
+                continue;
+            }
+            if (info != null) {
+                index.Add(entryKey, IOPath.GetFileName(info.Path), info.Size, info.LastUseTime,
+                        info.SourcePackages.Select(p => JsonSerializer.Serialize(p)));
+                yield return info;
+            }
+        }
+
+        // the remaining entries were deleted without updating the index
+        foreach (var entryKey in indexed.Keys) {
+            index.Remove(entryKey);
+        }
+    }
+
     // NOTE: this enumerable must never be publicly returned, we need to hold the read lock during the whole read
     private static IEnumerable<SourcePackageMetadata> EnumerateMetadataFileStream(FileStream stream) {
         var reader = new StreamReader(stream);
@@ -177,6 +250,29 @@ public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
         throw new InvalidCacheEntryException(entryKey, "metadata file is missing");
     }
 
+    private static bool IsChunkList(string entryFileName) => entryFileName.EndsWith(ChunkListExtension);
+
+    /// Returns the size of the stored file; for deduplicated entries, it's read from the chunk list header.
+    private static ulong GetEntrySize(string entryFileName, FileStream stream) {
+        if (!IsChunkList(entryFileName)) {
+            return (ulong) stream.Length;
+        }
+        // the chunk list starts with an 8 byte magic, followed by the file size (see `dedup/ChunkStore.cpp`)
+        var header = new byte[16];
+        stream.Seek(0, SeekOrigin.Begin);
+        var read = stream.Read(header, 0, header.Length);
+        stream.Seek(0, SeekOrigin.Begin);
+        return read == header.Length ? BitConverter.ToUInt64(header, 8) : 0;
+    }
+
+    private static ulong GetEntrySize(FileInfo entryInfo) {
+        if (!IsChunkList(entryInfo.Name)) {
+            return (ulong) entryInfo.Length;
+        }
+        using var stream = File.Open(entryInfo.FullName, FileMode.Open, FileAccess.Read, FileShare.ReadWrite);
+        return GetEntrySize(entryInfo.Name, stream);
+    }
+
     /// <exception cref="InvalidCacheEntryException"></exception>
     private CacheEntryInfo? GetEntryInfoInner(string entryKey) {
         var entryDirPath = IOPath.Combine(Path, entryKey);
@@ -195,8 +291,13 @@ public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
             throw new InvalidCacheEntryException(entryKey, "metadata file has gone missing");
         }
 
-        return new CacheEntryInfo(entryKey, entryInfo.FullName,
-                (ulong) entryInfo.Length, metadataInfo.LastWriteTime, metadata);
+        ulong size;
+        try {
+            size = GetEntrySize(entryInfo);
+        } catch (FileNotFoundException) {
+            throw new InvalidCacheEntryException(entryKey, "entry file has gone missing");
+        }
+        return new CacheEntryInfo(entryKey, entryInfo.FullName, size, metadataInfo.LastWriteTime, metadata);
     }
 
     /// <summary>
@@ -207,6 +308,25 @@ public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
     /// <exception cref="InvalidCacheEntryException"></exception>
     public CacheEntryLock? GetEntryLocked(string entryKey, Package package) {
         Verify.FileName(entryKey);
+        var packageMetadata = SourcePackageMetadata.CreateFromPackage(package);
+
+        if (Index is {} index) {
+            var result = index.Acquire(entryKey, JsonSerializer.Serialize(packageMetadata), out var fileName);
+            if (result != PogNative.CacheIndex.AcquireResult.Miss) {
+                CacheEntryLock? entryLock = null;
+                try {
+                    var newPackage = result == PogNative.CacheIndex.AcquireResult.HitNewPackage;
+                    entryLock = GetIndexedEntryLocked(entryKey, fileName, newPackage ? packageMetadata : null, index);
+                } finally {
+                    if (entryLock == null) index.Release(entryKey);
+                }
+                if (entryLock != null) {
+                    return entryLock;
+                }
+                // the index is out of date, look into the entry directory
+                index.Remove(entryKey);
+            }
+        }
 
         var entryDirPath = IOPath.Combine(Path, entryKey);
         // lock the entry; we can release this on return, because we'll have an open handle
@@ -228,8 +348,10 @@ public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
         }
 
         try {
-            AddPackageMetadata(metadataInfo.FullName, SourcePackageMetadata.CreateFromPackage(package));
-            return new CacheEntryLock(entryKey, entryInfo.FullName, readStream);
+            AddPackageMetadata(metadataInfo.FullName, packageMetadata);
+            return new CacheEntryLock(entryKey, entryInfo.FullName, GetChunkStorePath(entryInfo.Name), readStream,
+                    IndexEntry(entryKey, entryInfo.Name, GetEntrySize(entryInfo.Name, readStream),
+                            metadataInfo.FullName));
         } catch (FileNotFoundException) {
             readStream.Dispose();
             // the metadata file has gone missing, invalid entry
@@ -240,6 +362,62 @@ public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
         }
     }
 
+    /// Locks an entry found in the index, without listing the entry directory. The metadata file is only updated if
+    /// the package did not use the entry before (`newPackage` is not null), since the index already records the last
+    /// use time.
+    /// <returns>`null` if the entry directory or the entry file does not exist anymore.</returns>
+    private CacheEntryLock? GetIndexedEntryLocked(string entryKey, string fileName, SourcePackageMetadata? newPackage,
+            PogNative.CacheIndex index) {
+        if (fileName == "") {
+            // too long to be indexed
+            return null;
+        }
+
+        var entryDirPath = IOPath.Combine(Path, entryKey);
+        using var directoryHandle = LockEntryDirectory(entryDirPath);
+        if (directoryHandle == null) {
+            return null;
+        }
+
+        var entryFilePath = IOPath.Combine(entryDirPath, fileName);
+        FileStream readStream;
+        try {
+            readStream = File.Open(entryFilePath, FileMode.Open, FileAccess.Read, FileShare.Read);
+        } catch (FileNotFoundException) {
+            return null;
+        }
+
+        try {
+            if (newPackage != null) {
+                AddPackageMetadata(IOPath.Combine(entryDirPath, MetadataFileName), newPackage);
+            }
+            return new CacheEntryLock(entryKey, entryFilePath, GetChunkStorePath(fileName), readStream,
+                    () => index.Release(entryKey));
+        } catch (FileNotFoundException) {
+            readStream.Dispose();
+            throw new InvalidCacheEntryException(entryKey, "metadata file has gone missing");
+        } catch {
+            readStream.Dispose();
+            throw;
+        }
+    }
+
+    private string? GetChunkStorePath(string entryFileName) => IsChunkList(entryFileName) ? ChunkStorePath : null;
+
+    /// Adds a locked entry to the index (if it's not indexed yet) and marks it as used.
+    /// <returns>The callback releasing the entry in the index, or null if there's no index.</returns>
+    private Action? IndexEntry(string entryKey, string fileName, ulong size, string metadataPath) {
+        if (Index is not {} index) {
+            return null;
+        }
+        var packages = ReadMetadataFile(metadataPath) ?? [];
+        index.Add(entryKey, fileName, size, DateTime.Now, packages.Select(p => JsonSerializer.Serialize(p)));
+        if (index.Acquire(entryKey, null, out _) == PogNative.CacheIndex.AcquireResult.Miss) {
+            return null;
+        }
+        return () => index.Release(entryKey);
+    }
+
     /// <exception cref="CacheEntryInUseException"></exception>
     public void DeleteEntry(CacheEntryInfo entry) {
         DeleteEntry(entry.EntryKey);
@@ -258,6 +436,7 @@ public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
             h = FsUtils.OpenForMove(srcPath);
         } catch (FileNotFoundException) {
             // entry does not exist
+            Index?.Remove(entryKey);
             return;
         } catch (FileLoadException) {
             // entry is currently in use
@@ -274,6 +453,7 @@ public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
                 throw new CacheEntryInUseException(entryKey);
             }
         }
+        Index?.Remove(entryKey);
         // there doesn't seem to be any way to delete a directory using a handle, so we'll close it and delete it separately
         Directory.Delete(destinationPath, true);
     }
@@ -310,6 +490,10 @@ public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
             File.Move(files[0], IOPath.Combine(entrySrcDir, entryFileName));
         }
 
+        if (Deduplicate) {
+            entryFileName = AddToChunkStore(entrySrcDir, entryFileName);
+        }
+
         // add a metadata file
         using var metadataStream = File.Open(IOPath.Combine(entrySrcDir, MetadataFileName), FileMode.CreateNew);
         // write the serialized metadata into the file
@@ -320,6 +504,43 @@ public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
         return new NewCacheEntry(entrySrcDir, entryFileName);
     }
 
+    /// Replaces the entry file with a chunk list, storing its chunks in the chunk store. If `pog_native.dll` is not
+    /// available, the file is kept as is. Returns the new entry file name.
+    private string AddToChunkStore(string entrySrcDir, string entryFileName) {
+        var filePath = IOPath.Combine(entrySrcDir, entryFileName);
+        var chunkListFileName = entryFileName + ChunkListExtension;
+        try {
+            PogNative.ChunkStoreAdd(ChunkStorePath, filePath, IOPath.Combine(entrySrcDir, chunkListFileName));
+        } catch (DllNotFoundException) {
+            return entryFileName;
+        }
+        File.Delete(filePath);
+        return chunkListFileName;
+    }
+
+    /// Deletes the chunks that are not used by any deduplicated entry, except for recently stored ones, which may belong
+    /// to an entry that is still being added. Returns the number of freed bytes.
+    public ulong CollectChunks() {
+        if (!Deduplicate) {
+            return 0;
+        }
+        // chunk lists of entries deleted after the listing are skipped by the native collector
+        var chunkLists = FsUtils.EnumerateNonHiddenDirectoryNames(Path)
+                .SelectMany(entryKey => {
+                    try {
+                        return Directory.EnumerateFiles(IOPath.Combine(Path, entryKey), "*" + ChunkListExtension);
+                    } catch (DirectoryNotFoundException) {
+                        return Enumerable.Empty<string>();
+                    }
+                })
+                .ToArray();
+        try {
+            return PogNative.ChunkStoreCollect(ChunkStorePath, chunkLists, MinUnreferencedChunkAge);
+        } catch (DllNotFoundException) {
+            return 0;
+        }
+    }
+
     /// Atomically add an entry to the cache and get a lock. The entry directory must be at the same partition as the cache.
     /// Expected usage: File is downloaded to a temporary directory, then moved into the cache using this method.
     /// <exception cref="CacheEntryAlreadyExistsException"></exception>
@@ -347,7 +568,15 @@ public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
             // the file has gone missing (wtf?), invalid entry
             throw new InvalidCacheEntryException(entryKey);
         }
-        return new CacheEntryLock(entryKey, entryFilePath, readStream);
+
+        try {
+            return new CacheEntryLock(entryKey, entryFilePath, GetChunkStorePath(newEntry.EntryFileName), readStream,
+                    IndexEntry(entryKey, newEntry.EntryFileName, GetEntrySize(newEntry.EntryFileName, readStream),
+                            IOPath.Combine(targetPath, MetadataFileName)));
+        } catch {
+            readStream.Dispose();
+            throw;
+        }
     }
 
     [PublicAPI]
@@ -383,24 +612,34 @@ public class SharedFileCache(string cacheDirPath, TmpDirectory tmpDir) {
     public sealed class CacheEntryLock : IFileLock {
         public readonly string EntryKey;
         public string Path {get;}
+        /// If not null, the entry is deduplicated, `Path` is its chunk list, and the content is stored in this chunk store
+        /// directory; use `PogNative.ChunkStoreRestore` or `PogNative.ChunkStoreExtractArchive` to read it.
+        public readonly string? ChunkStorePath;
         /// The file stream used to lock the cache entry for reading, and also available for use.
         /// Do NOT close this stream manually, it will be closed automatically on Dispose.
         public FileStream ReadStream {get;}
+        /// Releases the entry in the cache index, called once.
+        private Action? _release;
 
-        internal CacheEntryLock(string entryKey, string path, FileStream readStream) {
+        internal CacheEntryLock(string entryKey, string path, string? chunkStorePath, FileStream readStream,
+                Action? release = null) {
             Verify.Assert.FileName(entryKey);
             EntryKey = entryKey;
             Path = path;
+            ChunkStorePath = chunkStorePath;
             ReadStream = readStream;
+            _release = release;
         }
 
         public void Unlock() {
             ReadStream.Close();
+            Interlocked.Exchange(ref _release, null)?.Invoke();
         }
 
         public void Dispose() {
             // this closes the file handle
             ReadStream.Dispose();
+            Interlocked.Exchange(ref _release, null)?.Invoke();
         }
     }
 
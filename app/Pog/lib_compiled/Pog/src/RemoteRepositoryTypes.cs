@@ -6,11 +6,14 @@ using System.IO;
 using System.Linq;
 using System.Management.Automation;
 using System.Net.Http;
+using System.Security.Cryptography;
+using System.Text;
 using System.Text.Json;
 using System.Threading;
 using System.Threading.Tasks;
 using System.Web;
 using JetBrains.Annotations;
+using Pog.Native;
 using Pog.Utils;
 
 namespace Pog;
@@ -21,28 +24,36 @@ public class InvalidRemoteRepositoryException : Exception {
     public InvalidRemoteRepositoryException(string message, Exception innerException) : base(message, innerException) {}
 }
 
-internal class RemotePackageDictionary : IEnumerable<KeyValuePair<string, PackageVersion[]>> {
-    private readonly List<string> _packageNames = [];
-    // also store the key as part of a value, so that we can resolve casing
-    // (unfortunately, .NET does not give us access to the stored key inside the hashmap entry)
-    private readonly Dictionary<string, (string, PackageVersion[])> _packageVersions =
-            new(StringComparer.InvariantCultureIgnoreCase);
+/// List of packages in a remote repository and their versions, in the order of the remote package index (sorted
+/// by name, versions from the newest).
+internal abstract class RemotePackageDictionary : IEnumerable<KeyValuePair<string, PackageVersion[]>> {
+    public abstract PackageVersion[]? this[string key] {get;}
+    public abstract IEnumerable<string> Keys {get;}
+    public abstract bool ContainsKey(string key);
+    public abstract string ResolvePackageName(string packageName);
+    /// Returns true if the list was retrieved from the remote repository more than <paramref name="maxAge"/> ago.
+    public abstract bool IsOlderThan(TimeSpan maxAge);
+
+    IEnumerator IEnumerable.GetEnumerator() => GetEnumerator();
+
+    public IEnumerator<KeyValuePair<string, PackageVersion[]>> GetEnumerator() {
+        return Keys.Select(pn => new KeyValuePair<string, PackageVersion[]>(pn, this[pn]!)).GetEnumerator();
+    }
 
-    /// Assumes that <paramref name="packageJson"/> is pre-sorted, both in package names and in versions.
-    public RemotePackageDictionary(JsonElement packageJson, string url) {
+    /// Reads the package index JSON file of the repository at <paramref name="url"/>, which maps package names
+    /// to arrays of versions. Assumes that <paramref name="packageJson"/> is pre-sorted, both in package names
+    /// and in versions.
+    protected static List<(string Name, string[] Versions)> ParsePackageJson(JsonElement packageJson, string url) {
+        var packages = new List<(string, string[])>();
         try {
             foreach (var p in packageJson.EnumerateObject()) {
                 var versions = p.Value.EnumerateArray()
-                        .Select(e => new PackageVersion(e.GetString() ?? throw new InvalidDataException()))
+                        .Select(e => e.GetString() ?? throw new InvalidDataException())
                         .ToArray();
-                _packageNames.Add(p.Name);
-                _packageVersions.Add(p.Name, (p.Name, versions));
-
                 Verify.Assert.PackageName(p.Name);
-                // check that versions were sorted on server
-                Debug.Assert(versions.SequenceEqual(versions.OrderByDescending(v => v)));
+                packages.Add((p.Name, versions));
             }
-        } catch (InvalidDataException e) {
+        } catch (Exception e) when (e is InvalidDataException or InvalidOperationException) {
             throw new InvalidRemoteRepositoryException(
                     $"Remote repository at '{url}' is invalid, has incorrect structure of the package index JSON file. " +
                     $"This is likely the result of an incorrectly generated repository. Please, notify the maintainer of " +
@@ -50,34 +61,113 @@ internal class RemotePackageDictionary : IEnumerable<KeyValuePair<string, Packag
         }
 
         // check that package names were sorted on server
-        Debug.Assert(_packageNames.SequenceEqual(_packageNames.OrderBy(pn => pn, StringComparer.OrdinalIgnoreCase)));
+        Debug.Assert(packages.Select(p => p.Item1)
+                .SequenceEqual(packages.Select(p => p.Item1).OrderBy(pn => pn, StringComparer.OrdinalIgnoreCase)));
+        return packages;
     }
+}
 
-    public PackageVersion[]? this[string key] => _packageVersions.TryGetValue(key, out var val) ? val.Item2 : null;
-    public IEnumerable<string> Keys => _packageNames;
-    public bool ContainsKey(string key) => _packageVersions.ContainsKey(key);
-    IEnumerator IEnumerable.GetEnumerator() => GetEnumerator();
+/// Package list parsed from the JSON package index, used when `pog_native.dll` is not available.
+internal class JsonRemotePackageDictionary : RemotePackageDictionary {
+    private readonly List<string> _packageNames = [];
+    // also store the key as part of a value, so that we can resolve casing
+    // (unfortunately, .NET does not give us access to the stored key inside the hashmap entry)
+    private readonly Dictionary<string, (string, PackageVersion[])> _packageVersions =
+            new(StringComparer.InvariantCultureIgnoreCase);
+    private readonly DateTime _retrievedAt = DateTime.UtcNow;
 
-    public string ResolvePackageName(string packageName) {
+    public JsonRemotePackageDictionary(JsonElement packageJson, string url) {
+        foreach (var (name, versionStrs) in ParsePackageJson(packageJson, url)) {
+            var versions = versionStrs.Select(v => new PackageVersion(v)).ToArray();
+            _packageNames.Add(name);
+            _packageVersions.Add(name, (name, versions));
+
+            // check that versions were sorted on server
+            Debug.Assert(versions.SequenceEqual(versions.OrderByDescending(v => v)));
+        }
+    }
+
+    public override PackageVersion[]? this[string key] =>
+            _packageVersions.TryGetValue(key, out var val) ? val.Item2 : null;
+    public override IEnumerable<string> Keys => _packageNames;
+    public override bool ContainsKey(string key) => _packageVersions.ContainsKey(key);
+    public override bool IsOlderThan(TimeSpan maxAge) => DateTime.UtcNow - _retrievedAt >= maxAge;
+
+    public override string ResolvePackageName(string packageName) {
         return _packageVersions.TryGetValue(packageName, out var val) ? val.Item1 : packageName;
     }
+}
 
-    public IEnumerator<KeyValuePair<string, PackageVersion[]>> GetEnumerator() {
-        return _packageNames.Select(pn => new KeyValuePair<string, PackageVersion[]>(pn, this[pn]!))
-                .GetEnumerator();
+/// Package list backed by the local binary copy of the package index (`PogNative.RepositoryIndex`), which is shared
+/// between Pog processes, so that a new process does not have to download and parse the whole package index.
+internal class IndexedRemotePackageDictionary(PogNative.RepositoryIndex index) : RemotePackageDictionary {
+    public readonly PogNative.RepositoryIndex Index = index;
+    // parsed on first use, most packages are never looked up
+    private readonly PackageVersion[]?[] _versions = new PackageVersion[]?[index.PackageCount];
+
+    public override PackageVersion[]? this[string key] {
+        get {
+            var i = Index.Find(key);
+            if (i < 0) return null;
+            // a concurrent parse results in an equal array, no need to lock
+            return _versions[i] ??= Index.GetVersions(i).Select(v => new PackageVersion(v)).ToArray();
+        }
+    }
+
+    public override IEnumerable<string> Keys => Enumerable.Range(0, Index.PackageCount).Select(Index.GetName);
+    public override bool ContainsKey(string key) => Index.Find(key) >= 0;
+    public override bool IsOlderThan(TimeSpan maxAge) => DateTime.UtcNow - Index.LastWriteTime >= maxAge;
+
+    public override string ResolvePackageName(string packageName) {
+        var i = Index.Find(packageName);
+        return i < 0 ? packageName : Index.GetName(i);
+    }
+
+    /// Converts the package index JSON file to the input format of `PogNative.RepositoryIndex.Write`.
+    public static string SerializePackageJson(JsonElement packageJson, string url) {
+        var packages = ParsePackageJson(packageJson, url);
+        var sb = new StringBuilder();
+        foreach (var (name, versions) in packages) {
+            if (name.IndexOfAny(['\t', '\n']) >= 0 || versions.Any(v => v.IndexOfAny(['\t', '\n']) >= 0)) {
+                throw new InvalidRemoteRepositoryException(
+                        $"Remote repository at '{url}' is invalid, package '{name}' has an invalid name or version.");
+            }
+            sb.Append(name);
+            foreach (var v in versions) sb.Append('\t').Append(v);
+            sb.Append('\n');
+        }
+        return sb.ToString();
     }
 }
 
 [PublicAPI]
 public sealed class RemoteRepository : IRepository {
-    private readonly TimedLazy<RemotePackageDictionary> _packagesLazy;
-    internal RemotePackageDictionary Packages => _packagesLazy.Value;
-
-    // each client will be at most 10 minutes out-of-date with the repository; since the package index is less than 100 kB,
-    //  re-downloading it every 10 minutes of active usage shouldn't be much of an issue (especially since users typically
-    //  use package managers either for a single invocation or for multiple invocations in a quick succession when running
-    //  in a script)
+    // each client will be at most 10 minutes out-of-date with the repository; the local copy of the package index is
+    //  shared by all Pog processes, and refreshed with a conditional request, so that an unchanged index is not
+    //  downloaded again; once loaded, an outdated package list is refreshed in the background, and replaced atomically,
+    //  so that readers never wait for the network
     private static readonly TimeSpan PackageCacheExpiration = TimeSpan.FromMinutes(10);
+    /// Minimum time between background refresh attempts, so that an unreachable repository is not retried on every access.
+    private static readonly TimeSpan RefreshRetryInterval = TimeSpan.FromMinutes(1);
+
+    private RemotePackageDictionary? _packages;
+    private readonly object _loadLock = new();
+    private bool _forceRefresh = false;
+    private int _refreshRunning = 0;
+    private long _lastRefreshAttempt = 0;
+    /// Directory with the local copy of the package index, null if `pog_native.dll` is not available.
+    private string? _indexDir;
+    private bool _indexDirInitialized = false;
+
+    internal RemotePackageDictionary Packages {
+        get {
+            var packages = Volatile.Read(ref _packages) ?? LoadPackages();
+            if (packages.IsOlderThan(PackageCacheExpiration)) {
+                RefreshInBackground(packages);
+            }
+            return packages;
+        }
+    }
 
     /// Resolved URL of the remote repository, including the version.
     public readonly string Url;
@@ -111,9 +201,6 @@ public sealed class RemoteRepository : IRepository {
         }
 
         Url = url.ToString();
-        // FIXME: we're doing a network request while holding a mutex over the cache, other threads will be stuck waiting
-        //  until this one finishes the request
-        _packagesLazy = new(PackageCacheExpiration, DownloadRepositoryRoot);
     }
 
     private static int? ParseUrlVersionSegment(string? segment) {
@@ -127,14 +214,128 @@ public sealed class RemoteRepository : IRepository {
         }
     }
 
-    private RemotePackageDictionary DownloadRepositoryRoot() {
+    private RemotePackageDictionary LoadPackages() {
+        // only one thread loads the package list, the others have nothing to return until it's loaded
+        lock (_loadLock) {
+            if (_packages is {} packages) {
+                return packages;
+            }
+
+            var stored = OpenStoredIndex();
+            if (stored != null && !_forceRefresh && !stored.IsOlderThan(PackageCacheExpiration)) {
+                packages = stored;
+            } else {
+                try {
+                    packages = RetrievePackages(stored);
+                } catch (HttpRequestException) when (stored != null) {
+                    // the repository is not reachable, use the outdated copy
+                    packages = stored;
+                }
+            }
+
+            _forceRefresh = false;
+            Volatile.Write(ref _packages, packages);
+            return packages;
+        }
+    }
+
+    private void RefreshInBackground(RemotePackageDictionary current) {
+        var retryTicks = (long) (Stopwatch.Frequency * RefreshRetryInterval.TotalSeconds);
+        if (Stopwatch.GetTimestamp() - Interlocked.Read(ref _lastRefreshAttempt) < retryTicks) return;
+        if (Interlocked.CompareExchange(ref _refreshRunning, 1, 0) != 0) return;
+
+        Task.Run(() => {
+            try {
+                var refreshed = RetrievePackages(current as IndexedRemotePackageDictionary);
+                // if the cache was invalidated in the meantime, the next access loads the package list again
+                Interlocked.CompareExchange(ref _packages, refreshed, current);
+            } catch (Exception) {
+                // keep using the current package list, the refresh is retried on a later access
+            } finally {
+                Interlocked.Exchange(ref _lastRefreshAttempt, Stopwatch.GetTimestamp());
+                Volatile.Write(ref _refreshRunning, 0);
+            }
+        });
+    }
+
+    private string? GetIndexDir() {
+        lock (_loadLock) {
+            if (!_indexDirInitialized) {
+                // one directory per repository URL
+                using var sha = SHA256.Create();
+                var urlHash = sha.ComputeHash(Encoding.UTF8.GetBytes(Url)).ToHexString().Substring(0, 16);
+                _indexDir = $"{InternalState.PathConfig.RepositoryIndexDir}\\{urlHash}";
+                _indexDirInitialized = true;
+            }
+            return _indexDir;
+        }
+    }
+
+    private IndexedRemotePackageDictionary? OpenStoredIndex() {
+        var indexDir = GetIndexDir();
+        if (indexDir == null) return null;
+        try {
+            Directory.CreateDirectory(indexDir);
+            var index = PogNative.RepositoryIndex.Open(indexDir);
+            return index == null ? null : new(index);
+        } catch (DllNotFoundException) {
+            lock (_loadLock) {
+                _indexDir = null;
+            }
+            return null;
+        }
+    }
+
+    /// Retrieves the package index from the repository. If <paramref name="current"/> is set, it's updated using
+    /// the delta patches published by the repository, or the index is only downloaded if it changed since
+    /// <paramref name="current"/> was retrieved.
+    private RemotePackageDictionary RetrievePackages(IndexedRemotePackageDictionary? current) {
         try {
+            var indexDir = GetIndexDir();
+            if (indexDir == null) {
+                // FIXME: blocking without possible cancellation
+                var json = InternalState.HttpClient.RetrieveJsonAsync(new(Url)).GetAwaiter().GetResult();
+                if (json == null) {
+                    throw new RepositoryNotFoundException($"Package repository does not seem to exist: {Url}");
+                }
+                return new JsonRemotePackageDictionary(json.Value, Url);
+            }
+
+            // try to apply the delta patches published by the repository first, their size is proportional
+            //  to the number of changed packages, not to the size of the repository
+            switch (PogNative.RepositoryIndex.Update(current?.Index, Url, InternalState.HttpClient.UserAgent,
+                             out var sequence)) {
+                case PogNative.RepositoryIndex.UpdateResult.UpToDate:
+                    return current!;
+                case PogNative.RepositoryIndex.UpdateResult.Patched:
+                    return OpenStoredIndex() ?? current!;
+            }
+
+            // validators of a patched index are empty, and with delta patches, a changed sequence number means that
+            //  the index changed, so a conditional request only helps for repositories without patches
             // FIXME: blocking without possible cancellation
-            var result = InternalState.HttpClient.RetrieveJsonAsync(new(Url)).GetAwaiter().GetResult();
-            if (result == null) {
+            var response = InternalState.HttpClient.RetrieveJsonIfModifiedAsync(
+                    new(Url), sequence == 0 ? current?.Index.ETag : null,
+                    sequence == 0 ? current?.Index.LastModified : null).GetAwaiter().GetResult();
+            if (response == null) {
                 throw new RepositoryNotFoundException($"Package repository does not seem to exist: {Url}");
             }
-            return new(result.Value, Url);
+
+            if (response.Value.NotModified) {
+                // validators are only sent when there's a current index
+                try {
+                    current!.Index.Touch();
+                    return current;
+                } catch (IOException) {
+                    // the file was replaced by a newer generation from another Pog process
+                    return OpenStoredIndex() ?? current!;
+                }
+            }
+
+            var packages = IndexedRemotePackageDictionary.SerializePackageJson(response.Value.Json!.Value, Url);
+            PogNative.RepositoryIndex.Write(indexDir, packages, response.Value.ETag, response.Value.LastModified,
+                    sequence);
+            return OpenStoredIndex() ?? throw new IOException($"Repository index was deleted after writing: {indexDir}");
         } catch (HttpRequestException e) {
             throw new HttpRequestException($"Failed to fetch a remote package repository at '{Url}': {e.Message}", e);
         }
@@ -143,7 +344,10 @@ public sealed class RemoteRepository : IRepository {
     /// List of available packages and their versions is cached locally for a short duration.
     /// This method invalidates the cache, causing it to be retrieved again on the next access.
     public void InvalidateCache() {
-        _packagesLazy.Invalidate();
+        lock (_loadLock) {
+            Volatile.Write(ref _packages, null);
+            _forceRefresh = true;
+        }
     }
 
     public IEnumerable<string> EnumeratePackageNames(string searchPattern = "*") {
@@ -0,0 +1,158 @@
+﻿using System;
+using System.Buffers.Binary;
+using System.Collections.Generic;
+using System.IO;
+
+namespace Pog.Shim;
+
+/**
+ * Reads and writes the index for the multicall mode of the shim, where exported commands are hardlinks to a single
+ * dispatcher binary (the full shim template without any shim data resource), and the shim data of all commands are
+ * stored in a single `pog_multicall.idx` file next to them. The dispatcher memory-maps the index and looks up the file
+ * name under which it was invoked, so only a single copy of the shim is stored on disk and in the page cache, instead
+ * of each command carrying its own copy. Commands are exported this way by `Export-Command -Multicall`
+ * (see <see cref="ExportedMulticallCommand"/>), the default is still a separate shim executable for each command.
+ *
+ * ## Index format
+ * All values are little-endian, all offsets are relative to the start of the index and stored as uint32.
+ *  - Header:
+ *    - uint32 Magic (<see cref="Magic"/>)
+ *    - uint16 Version (<see cref="CurrentVersion"/>)
+ *    - uint16 Reserved (zero)
+ *    - Bucket count (a power of 2, at least twice the entry count)
+ *    - Entry count
+ *  - Buckets, an array of entry offsets (0 for an empty bucket) of a hash table with linear probing; the hash
+ *    is <see cref="NameHash"/>, the bucket is `hash &amp; (bucketCount - 1)`
+ *  - Entries, each aligned to `sizeof(uint)`:
+ *    - Name hash
+ *    - Name length in wchar
+ *    - Shim data size in bytes
+ *    - Name (UTF-16, without the null terminator), padded to `sizeof(uint)`
+ *    - Shim data (<see cref="ShimDataEncoder"/>), padded to `sizeof(uint)`
+ *
+ * Keep this in sync with `MulticallIndex.hpp` in the shim, and with `host/MulticallIndexBuilder.hpp`.
+ */
+internal static class MulticallIndexFile {
+    public const string IndexFileName = "pog_multicall.idx";
+    public const uint Magic = 0x434D4750; // "PGMC"
+    public const ushort CurrentVersion = 1;
+    private const int HeaderSize = 4 * 4;
+    private const int EntryHeaderSize = 3 * 4;
+
+    /// Reads the entries of the index at `indexPath`, in the order they were written. Returns an empty list if
+    /// the index does not exist, or if it's not a valid index of the current version, so that it's rebuilt from scratch.
+    public static List<(string CommandName, byte[] ShimData)> Read(string indexPath) {
+        byte[] data;
+        try {
+            data = File.ReadAllBytes(indexPath);
+        } catch (FileNotFoundException) {
+            return [];
+        } catch (DirectoryNotFoundException) {
+            return [];
+        }
+
+        var span = data.AsSpan();
+        if (span.Length < HeaderSize || BinaryPrimitives.ReadUInt32LittleEndian(span) != Magic
+                                     || BinaryPrimitives.ReadUInt16LittleEndian(span.Slice(4)) != CurrentVersion) {
+            return [];
+        }
+        var bucketCount = BinaryPrimitives.ReadUInt32LittleEndian(span.Slice(8));
+        var entryCount = BinaryPrimitives.ReadUInt32LittleEndian(span.Slice(12));
+
+        // entries are stored right after the bucket array, one after another
+        var entries = new List<(string, byte[])>();
+        var offset = HeaderSize + (long) bucketCount * 4;
+        for (var i = 0; i < entryCount; i++) {
+            if (offset + EntryHeaderSize > span.Length) return [];
+            var entry = span.Slice((int) offset);
+            var nameLength = BinaryPrimitives.ReadUInt32LittleEndian(entry.Slice(4));
+            var shimDataSize = BinaryPrimitives.ReadUInt32LittleEndian(entry.Slice(8));
+            var nameSize = AlignUp(nameLength * 2L);
+            var entrySize = EntryHeaderSize + nameSize + AlignUp(shimDataSize);
+            if (entrySize > entry.Length) return [];
+
+            var name = new char[nameLength];
+            for (var j = 0; j < name.Length; j++) {
+                name[j] = (char) BinaryPrimitives.ReadUInt16LittleEndian(entry.Slice(EntryHeaderSize + j * 2));
+            }
+            var shimData = entry.Slice(EntryHeaderSize + (int) nameSize, (int) shimDataSize).ToArray();
+            entries.Add((new string(name), shimData));
+            offset += entrySize;
+        }
+        return entries;
+    }
+
+    /// Writes the index to `indexPath`. The index is written to a temporary file first and then moved over the previous
+    /// index, so that shims starting concurrently never see a partially written index. The index is hidden, so that it's
+    /// not listed as an exported command.
+    public static void Write(string indexPath, IReadOnlyCollection<(string CommandName, byte[] ShimData)> commands) {
+        var tmpPath = indexPath + ".tmp";
+        File.WriteAllBytes(tmpPath, Encode(commands));
+        File.SetAttributes(tmpPath, FileAttributes.Hidden);
+        if (File.Exists(indexPath)) {
+            File.Replace(tmpPath, indexPath, null);
+        } else {
+            File.Move(tmpPath, indexPath);
+        }
+    }
+
+    /// Encodes the index, `CommandName` is the file name of the exported command (e.g. `code.exe`), `ShimData` is
+    /// the output of <see cref="ShimDataEncoder.EncodeShim"/>.
+    public static byte[] Encode(IReadOnlyCollection<(string CommandName, byte[] ShimData)> commands) {
+        // keep the load factor at most 0.5, so that the probe sequences stay short
+        uint bucketCount = 1;
+        while (bucketCount < commands.Count * 2) bucketCount *= 2;
+
+        var size = HeaderSize + (int) bucketCount * 4;
+        foreach (var (name, shimData) in commands) {
+            size += EntryHeaderSize + (int) AlignUp(name.Length * 2) + (int) AlignUp(shimData.Length);
+        }
+
+        var buffer = new byte[size];
+        var span = buffer.AsSpan();
+        BinaryPrimitives.WriteUInt32LittleEndian(span, Magic);
+        BinaryPrimitives.WriteUInt16LittleEndian(span.Slice(4), CurrentVersion);
+        BinaryPrimitives.WriteUInt16LittleEndian(span.Slice(6), 0);
+        BinaryPrimitives.WriteUInt32LittleEndian(span.Slice(8), bucketCount);
+        BinaryPrimitives.WriteUInt32LittleEndian(span.Slice(12), (uint) commands.Count);
+
+        var buckets = span.Slice(HeaderSize, (int) bucketCount * 4);
+        var offset = HeaderSize + (int) bucketCount * 4;
+        foreach (var (name, shimData) in commands) {
+            var hash = NameHash(name);
+            var entry = span.Slice(offset);
+            var nameSize = (int) AlignUp(name.Length * 2);
+            BinaryPrimitives.WriteUInt32LittleEndian(entry, hash);
+            BinaryPrimitives.WriteUInt32LittleEndian(entry.Slice(4), (uint) name.Length);
+            BinaryPrimitives.WriteUInt32LittleEndian(entry.Slice(8), (uint) shimData.Length);
+            for (var i = 0; i < name.Length; i++) {
+                BinaryPrimitives.WriteUInt16LittleEndian(entry.Slice(EntryHeaderSize + i * 2), name[i]);
+            }
+            shimData.CopyTo(entry.Slice(EntryHeaderSize + nameSize));
+
+            // find a free bucket with linear probing
+            var bucket = hash & (bucketCount - 1);
+            while (BinaryPrimitives.ReadUInt32LittleEndian(buckets.Slice((int) bucket * 4)) != 0) {
+                bucket = (bucket + 1) & (bucketCount - 1);
+            }
+            BinaryPrimitives.WriteUInt32LittleEndian(buckets.Slice((int) bucket * 4), (uint) offset);
+
+            offset += EntryHeaderSize + nameSize + (int) AlignUp(shimData.Length);
+        }
+        return buffer;
+    }
+
+    /// 32-bit FNV-1a over the UTF-16 code units of the name (low byte first), with ASCII letters folded to uppercase,
+    /// since file names are case-insensitive. Must match `multicall_name_hash` in the shim.
+    internal static uint NameHash(string name) {
+        var hash = 2166136261u;
+        foreach (var ch in name) {
+            var c = ch is >= 'a' and <= 'z' ? (char) (ch - ('a' - 'A')) : ch;
+            hash = (hash ^ (c & 0xffu)) * 16777619u;
+            hash = (hash ^ ((uint) c >> 8)) * 16777619u;
+        }
+        return hash;
+    }
+
+    private static long AlignUp(long n) => (n + 3) & ~3L;
+}
@@ -1,4 +1,5 @@
 ﻿using System;
+using System.Buffers.Binary;
 using System.Collections.Generic;
 using System.Diagnostics;
 using System.IO;
@@ -35,9 +36,15 @@ namespace Pog.Shim;
  * specified in the shim data, 3. rest of the original command line ("argv[0] shimArgs argv[1...]"). If `ReplaceArgv0`
  * is true, target path is used instead of the original argv[0]. It is passed to the `lpCommandLine` parameter of CreateProcessW.
  *
+ * Since v5, the quoted target path (if argv[0] is replaced) and the prepended command line are stored pre-concatenated
+ * in the precomputed command line prefix, so that the shim only has to append the rest of the original command line.
+ *
  * ### Environment
- * Since most of the environment is typically retained, the shim modifies its own environment and then passes NULL
- * to the `lpEnvironment` parameter of CreateProcessW. The shim supports interpolating existing environment variables
+ * If `EnvironmentBlock` flag is set (when the shim sets at least `EnvironmentBlockMinVariables` environment variables),
+ * the shim builds the complete environment block of the child in a single pass by merging its own environment with
+ * the configured variables, and passes it to the `lpEnvironment` parameter of CreateProcessW. Otherwise, the shim
+ * modifies its own environment and passes NULL to `lpEnvironment`, which is faster for a few variables (see the
+ * `env_block_*` benchmarks of `Pog.Shim`). The shim supports interpolating existing environment variables
  * into the value (e.g. "%APPDATA%/Path") and concatenating multiple segments of a list variable. The value string is parsed
  * in `ShimExecutable` into a format that's more efficient for the shim (essentially, a list of tokens, where each token
  * is either an environment variable name, or a literal string).
@@ -53,16 +60,25 @@ namespace Pog.Shim;
  *  - Working directory offset (may be zero)
  *  - Command line offset (may be zero)
  *  - Environment variable block offset (may be zero)
+ *  - Precomputed command line prefix offset (may be zero if the prefix is empty; since v5)
+ *  - Checksum of the whole shim data, computed with this field set to zero (since v5, see <see cref="Checksum"/>)
  *
  * Following the header are the fields referenced by offsets, in any order:
  *  - Target path is a single string.
  *  - Working directory is a single string.
  *  - Command line is prefixed by length in wchar, followed by the command line string, WITHOUT the null terminator.
+ *  - Precomputed command line prefix has the same format as the command line. If `ReplaceArgv0` or `NullTarget` is set,
+ *    it contains the quoted target path, followed by a space and the command line, if any, and it replaces the original
+ *    argv[0]. Otherwise, it contains a space followed by the command line, and it's inserted after the original argv[0].
+ *    The shim only supports reading v4 shim data without this field for backwards compatibility.
  *  - Environment variable block has the following format:
  *    - Entry count
  *    - (Entry name offset, Entry value offset), repeated "Entry count" times
  *    The name offset points to a string, placed anywhere in the shim. The value offset points to a structure described below.
  *
+ * The shim validates the whole shim data (checksum, offsets, string terminators, segment chains) before using it,
+ * so that corrupted shim data results in an error message instead of a crash.
+ *
  * ### Environment variable value format
  * The value is stored in a linked-list-like structure of string segments with the following format:
  *  - String length (in wchar), without the null terminator
@@ -71,10 +87,15 @@ namespace Pog.Shim;
  *  After each segment, padding is optionally inserted to align it to `sizeof(uint)`.
  */
 internal class ShimDataEncoder {
-    public const ushort CurrentShimDataVersion = 4;
+    public const ushort CurrentShimDataVersion = 5;
+    /// Shims with fewer environment variables set them one by one, merging them into a new block is only faster
+    /// for more variables. Measured by the `env_block_*` benchmarks of `Pog.Shim`, the crossover is between 6 and 8
+    /// variables, regardless of the size of the inherited environment.
+    private const int EnvironmentBlockMinVariables = 8;
     private static readonly Encoding Encoding = Encoding.Unicode;
     private const ushort NullTerminator = 0;
-    private const int HeaderSize = 2 * 2 + 4 * 4;
+    private const int HeaderSize = 2 * 2 + 4 * 6;
+    private const int ChecksumOffset = HeaderSize - 4;
 
     private readonly MemoryStream _stream;
     private readonly BinaryWriter _writer;
@@ -104,14 +125,20 @@ internal class ShimDataEncoder {
         // write working directory
         var wdOffset = shim.WorkingDirectory == null ? 0 : WriteNullTerminatedString(shim.WorkingDirectory);
         // write arguments
-        var argsOffset = shim.Arguments == null ? 0 : WriteLengthPrefixedString(Win32Args.EscapeArguments(shim.Arguments));
+        var escapedArgs = shim.Arguments == null ? null : Win32Args.EscapeArguments(shim.Arguments);
+        var argsOffset = escapedArgs == null ? 0 : WriteLengthPrefixedString(escapedArgs);
         // write environment variables
         var envOffset = shim.EnvironmentVariables == null ? 0 : WriteEnvironmentVariables(shim.EnvironmentVariables);
+        // write the precomputed command line prefix
+        var cmdLinePrefix = GetCommandLinePrefix(shim, escapedArgs);
+        var cmdLinePrefixOffset = cmdLinePrefix == "" ? 0 : WriteLengthPrefixedString(cmdLinePrefix);
         var endOffset = Position;
 
         var flags = (ShimFlags) 0;
         if (shim.ReplaceArgv0) flags |= ShimFlags.ReplaceArgv0;
         if (shim.Argv0AsTarget) flags |= ShimFlags.NullTarget;
+        if (shim.EnvironmentVariables?.Length >= EnvironmentBlockMinVariables) flags |= ShimFlags.EnvironmentBlock;
+        if (shim.Detached) flags |= ShimFlags.Detached;
 
         // go back and write the header
         SeekAbs(0);
@@ -121,11 +148,54 @@ internal class ShimDataEncoder {
         WriteUint(wdOffset);
         WriteUint(argsOffset);
         WriteUint(envOffset);
+        WriteUint(cmdLinePrefixOffset);
+        WriteUint(0); // checksum, computed below over the whole shim data
         Debug.Assert(Position == HeaderSize);
 
         // seek to the end, so that .GetBuffer() can find the end of the stream
         SeekAbs(endOffset);
-        return GetBuffer();
+        var buffer = GetBuffer();
+        BinaryPrimitives.WriteUInt32LittleEndian(buffer.Slice(ChecksumOffset), Checksum(buffer));
+        return buffer;
+    }
+
+    /// Checksum of the shim data, must match `shim_data_checksum` in the shim. The data is split into little-endian
+    /// uint32 words (the last one padded with zeros), word `i` is hashed into lane `i % 4` using 64-bit FNV-1a,
+    /// and then the lanes and the data size are hashed together and folded to 32 bits.
+    /// The checksum field must be zero when this is called.
+    internal static uint Checksum(ReadOnlySpan<byte> data) {
+        const ulong prime = 1099511628211;
+        const ulong basis = 14695981039346656037;
+
+        Span<ulong> lanes = stackalloc ulong[] {basis, basis, basis, basis};
+        for (var i = 0; i < data.Length; i += 4) {
+            uint word = 0;
+            for (var j = 0; j < 4 && i + j < data.Length; j++) {
+                word |= (uint) data[i + j] << (8 * j);
+            }
+            lanes[i / 4 % 4] = (lanes[i / 4 % 4] ^ word) * prime;
+        }
+
+        var hash = basis;
+        foreach (var lane in lanes) {
+            hash = (hash ^ lane) * prime;
+        }
+        hash = (hash ^ (ulong) data.Length) * prime;
+        return (uint) (hash ^ (hash >> 32));
+    }
+
+    /// Computes the part of the target command line which precedes the original arguments of the shim.
+    private static string GetCommandLinePrefix(ShimExecutable shim, string? escapedArgs) {
+        var prefix = "";
+        if (shim.ReplaceArgv0 || shim.Argv0AsTarget) {
+            // quote the target, in case it contains spaces; when .cmd files are invoked, cmd.exe looks at argv[0],
+            //  not on the lpApplicationName value, and spaces would throw it off without quotes
+            prefix = $"\"{shim.TargetPath}\"";
+        }
+        if (escapedArgs != null) {
+            prefix += " " + escapedArgs;
+        }
+        return prefix;
     }
 
     private Span<byte> GetBuffer() {
@@ -234,6 +304,16 @@ internal class ShimDataEncoder {
         ///    starting with "If /C or /K is specified"). When `lpApplicationName` is not null, this handling is suppressed
         ///    (I'd love to hear the history behind that design choice).
         NullTarget = 2,
+        /// Build the environment block of the child process in a single pass and pass it to `CreateProcess`,
+        /// instead of calling `SetEnvironmentVariable` for each variable, which rewrites the whole environment block
+        /// of the shim every time. Variables may still reference previously set variables of the same shim.
+        EnvironmentBlock = 4,
+        /// Spawn the target without a job object and exit right away, instead of waiting for the target to exit and
+        /// forwarding its exit code. Only set when the entry point is exported with `-Detached`, since callers that wait
+        /// for the shim (e.g. `Start-Process -Wait`, `GIT_EDITOR`, installers) would see it exit right away with
+        /// a zero exit code; for GUI applications that are never waited on, it avoids keeping an idle shim process
+        /// and a job object around. The child is no longer killed when the shim is killed.
+        Detached = 8,
     }
 
     [Flags]
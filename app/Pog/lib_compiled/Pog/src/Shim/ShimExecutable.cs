@@ -1,4 +1,5 @@
 ﻿using System;
+using System.Buffers.Binary;
 using System.Collections.Generic;
 using System.Diagnostics;
 using System.IO;
@@ -19,10 +20,18 @@ namespace Pog.Shim;
 // 2) TODO: get owning package of a shim
 // 3) check if the configuration of a shim matches an expected one
 //    - encode shim data and compare with stored shim data
-//    - read target PE resources, compare with already copied PE resources in the shim
+//    - if the shim manifest matches the shim data and the metadata source did not change (size, mtime), we're done
+//      (only checked by `pog_native.dll`, see `ShimManifest.hpp` in Pog.Native)
+//    - otherwise, read target PE resources, compare with already copied PE resources in the shim
 internal class ShimExecutable {
     // shim data are stored as an RCDATA resource at index 1
     private static readonly PeResources.ResourceId ShimDataResourceId = new(PeResources.ResourceType.RcData, 1);
+    // features of the shim template the shim was created from (uint16 `ShimFeatures`), stored as an RCDATA resource
+    //  at index 2; shims created before the templates were split do not have it, and support all features
+    private static readonly PeResources.ResourceId ShimFeaturesResourceId = new(PeResources.ResourceType.RcData, 2);
+    // hashes of the shim data and of the copied resources, and the identity of the metadata source, written
+    //  by `pog_update_shim` (see `ShimManifest.hpp` in Pog.Native)
+    private static readonly PeResources.ResourceId ShimManifestResourceId = new(PeResources.ResourceType.RcData, 3);
     // TODO: bring back ResourceType.Manifest, but it will require some amount of parsing
     //  e.g. Firefox declares required assemblies, which the shim doesn't see, so it fails
     //  also, some binaries (e.g. mmc.exe seem to have multiple manifests)
@@ -44,10 +53,14 @@ internal class ShimExecutable {
     public readonly string[]? Arguments;
     public readonly (string, EnvVarTemplate)[]? EnvironmentVariables;
     public readonly string? MetadataSource;
+    /// If true, the shim exits right after starting the target, see `ShimFlags.Detached` in <see cref="ShimDataEncoder"/>.
+    public readonly bool Detached;
+    /// Launcher features needed by this shim, which determine the shim template to use.
+    public readonly ShimFeatures RequiredFeatures;
 
     public ShimExecutable(string targetPath, string? workingDirectory = null, string[]? arguments = null,
             IEnumerable<KeyValuePair<string, string[]>>? environmentVariables = null, string? metadataSource = null,
-            bool replaceArgv0 = false) {
+            bool replaceArgv0 = false, bool detached = false) {
         Debug.Assert(Path.IsPathRooted(targetPath));
 
         if (!IsTargetSupported(targetPath)) {
@@ -65,6 +78,7 @@ internal class ShimExecutable {
         //  which results in an infinite process spawning loop when the original argv[0] is retained
         ReplaceArgv0 = replaceArgv0 || isBatchFile || Argv0AsTarget;
         MetadataSource = metadataSource;
+        Detached = detached;
 
         TargetPath = targetPath;
         WorkingDirectory = workingDirectory;
@@ -76,6 +90,22 @@ internal class ShimExecutable {
             }
             return (e.Key, new EnvVarTemplate(e.Value));
         }).ToArray();
+
+        // must match `ShimData::required_features()` in the shim
+        RequiredFeatures = ShimFeatures.None;
+        if (EnvironmentVariables is {Length: > 0}) RequiredFeatures |= ShimFeatures.Environment;
+        if (Arguments != null || ReplaceArgv0 || Argv0AsTarget) RequiredFeatures |= ShimFeatures.Arguments;
+    }
+
+    /// File name of the shim template built with exactly the given features, see `add_shim_template` in `Pog.Shim`.
+    public static string GetTemplateFileName(ShimFeatures features) {
+        return features switch {
+            ShimFeatures.All => "PogShimTemplate.exe",
+            ShimFeatures.Arguments => "PogShimTemplate-Args.exe",
+            ShimFeatures.Environment => "PogShimTemplate-Env.exe",
+            ShimFeatures.None => "PogShimTemplate-Minimal.exe",
+            _ => throw new ArgumentOutOfRangeException(nameof(features), features, null),
+        };
     }
 
     public static bool IsTargetSupported(string targetPath) {
@@ -83,10 +113,15 @@ internal class ShimExecutable {
         return File.Exists(targetPath) && (IsPeBinary(targetPath) || IsBatchFile(targetPath));
     }
 
-    private static bool IsPeBinary(string targetPath) {
+    public static bool IsPeBinary(string targetPath) {
         return HasExtension(targetPath, ".exe") || HasExtension(targetPath, ".com");
     }
 
+    /// Subsystem of the target binary, targets that are not PE binaries are assumed to be console programs.
+    public PeBinary.Subsystem GetTargetSubsystem() {
+        return IsPeBinary(TargetPath) ? PeBinary.GetInfo(TargetPath).Subsystem : PeBinary.Subsystem.WindowsCui;
+    }
+
     private static bool IsBatchFile(string targetPath) {
         return HasExtension(targetPath, ".cmd") || HasExtension(targetPath, ".bat");
     }
@@ -99,48 +134,61 @@ internal class ShimExecutable {
     /// <param name="shimPath">Path an existing initialized shim executable to update.</param>
     /// <returns>true if anything changed, false if shim is up-to-date</returns>
     /// <exception cref="OutdatedShimException"></exception>
-    public (bool, PeBinary.PeInfo?) UpdateShim(string shimPath) {
-        return IsPeBinary(TargetPath) ? UpdateShimExe(shimPath) : (UpdateShimOther(shimPath), null);
+    public bool UpdateShim(string shimPath) {
+        using var _ = InstrumentationCounter.ShimUpdateTime.Time();
+        return WriteShim(shimPath, false);
+    }
+
+    /// Configures a new shim. The shim binary at `shimPath` should already exist.
+    /// Assumes that the shim binary has no existing resources.
+    public void WriteNewShim(string shimPath) {
+        using var _ = InstrumentationCounter.ShimUpdateTime.Time();
+        WriteShim(shimPath, true);
     }
 
     /// <exception cref="OutdatedShimException"></exception>
-    private (bool, PeBinary.PeInfo?) UpdateShimExe(string shimPath) {
-        // copy subsystem from the target binary
-        var targetInfo = PeBinary.GetInfo(TargetPath);
+    private bool WriteShim(string shimPath, bool newShim) {
+        var shimData = ShimDataEncoder.EncodeShim(this);
+        // copy resources from either target, or a separate module; targets that are not PE binaries don't have
+        //  resources, either copy resources from a separate module, or delete any existing resources
+        var isPeTarget = IsPeBinary(TargetPath);
+        var resourceSrcPath = isPeTarget ? MetadataSource ?? TargetPath : MetadataSource;
+        // TODO: also handle arch mismatch once we support shims for different architectures
+
+        try {
+            // copy subsystem from the target binary, or assume a console subsystem for other targets; if the target
+            //  is also the metadata source, leave it to the native updater, which only reads the target if the shim
+            //  manifest does not match, so that checking an up-to-date shim does not read any PE headers
+            PeBinary.Subsystem? subsystem = !isPeTarget ? PeBinary.Subsystem.WindowsCui
+                    : MetadataSource == null ? null : PeBinary.GetInfo(TargetPath).Subsystem;
+            return PogNative.UpdateShim(shimPath, resourceSrcPath, shimData, (ushort) RequiredFeatures, subsystem,
+                    newShim);
+        } catch (DllNotFoundException) {
+            // pog_native.dll is not built (development setup), use the slower managed implementation below
+        }
+
+        var targetSubsystem = GetTargetSubsystem();
+        if (newShim) {
+            PeBinary.SetSubsystem(shimPath, targetSubsystem);
+            WriteNewShimResources(shimPath, resourceSrcPath, shimData);
+            return true;
+        }
+
         // first read the shim info, maybe we don't need to update it at all
         // it would be faster to read and update it in one step, but when the shim is in use,
         //  we cannot open it for writing
-        var shimInfo = PeBinary.GetInfo(shimPath);
-        var subsystemMatches = targetInfo.Subsystem == shimInfo.Subsystem;
+        var subsystemMatches = PeBinary.GetInfo(shimPath).Subsystem == targetSubsystem;
         if (!subsystemMatches) {
-            PeBinary.SetSubsystem(shimPath, targetInfo.Subsystem);
+            PeBinary.SetSubsystem(shimPath, targetSubsystem);
         }
-        // TODO: also handle arch mismatch once we support shims for different architectures
-
-        // copy resources from either target, or a separate module
-        var updatedResources = UpdateShimResources(shimPath, MetadataSource ?? TargetPath);
-
-        return (!subsystemMatches || updatedResources, targetInfo);
-    }
-
-    /// Updater method for targets that are not PE binaries, and don't have a subsystem and resources.
-    /// <exception cref="OutdatedShimException"></exception>
-    private bool UpdateShimOther(string shimPath) {
-        // assume a console subsystem
-        var originalSubsystem = PeBinary.SetSubsystem(shimPath, PeBinary.Subsystem.WindowsCui);
-        var subsystemChanged = originalSubsystem != PeBinary.Subsystem.WindowsCui;
-
-        // target does not have any resources, since it's not a PE binary; either copy resources
-        //  from a separate module, or delete any existing resources, if any
-        var updatedResources = UpdateShimResources(shimPath, MetadataSource);
-
-        return subsystemChanged || updatedResources;
+        var updatedResources = UpdateShimResources(shimPath, resourceSrcPath, shimData);
+        return !subsystemMatches || updatedResources;
     }
 
+    /// Managed fallback of <see cref="PogNative.UpdateShim"/>, used when `pog_native.dll` is not available. Does not
+    /// use the shim manifest, all resources are always compared.
     /// <exception cref="OutdatedShimException"></exception>
-    private bool UpdateShimResources(string shimPath, string? resourceSrcPath) {
-        var shimData = ShimDataEncoder.EncodeShim(this);
-
+    private bool UpdateShimResources(string shimPath, string? resourceSrcPath, Span<byte> shimData) {
         // updater is somewhat slow, only instantiate it if necessary
         using var shimUpdater = new LazyDisposable<PeResources.ResourceUpdater>(
                 () => new PeResources.ResourceUpdater(shimPath));
@@ -150,6 +198,13 @@ internal class ShimExecutable {
 
         // `shim` must be closed before `.CommitChanges()` is called
         using (var shimModule = new PeResources.Module(shimPath)) {
+            // ensure the shim was created from the right template; this also replaces shims created from a larger
+            //  template than necessary, so that all shims eventually use the smallest template
+            if (GetTemplateFeatures(shimModule) != RequiredFeatures) {
+                throw new OutdatedShimException("Shim executable was created from a different shim template, " +
+                                                "replace it with the template matching the shim configuration.");
+            }
+
             // ensure shim data is up to date
             switch (CompareShimData(shimModule, shimData)) {
                 case ShimDataStatus.Changed:
@@ -171,6 +226,11 @@ internal class ShimExecutable {
                     RemoveResources(shimUpdater, shimModule, resourceType);
                 }
             }
+
+            // the manifest written by `pog_native.dll` would no longer describe the shim
+            if (shimUpdater.IsValueCreated && shimModule.TryGetResource(ShimManifestResourceId, out _)) {
+                shimUpdater.Value.DeleteResource(ShimManifestResourceId);
+            }
         }
 
         // write the changes
@@ -187,6 +247,16 @@ internal class ShimExecutable {
         return shimUpdater.IsValueCreated;
     }
 
+    private static ShimFeatures GetTemplateFeatures(PeResources.Module shim) {
+        if (!shim.TryGetResource(ShimFeaturesResourceId, out var features)) {
+            // created from the original shim template, which supports everything
+            return ShimFeatures.All;
+        }
+        return features.Length == sizeof(ushort)
+                ? (ShimFeatures) BinaryPrimitives.ReadUInt16LittleEndian(features)
+                : ShimFeatures.All;
+    }
+
     private enum ShimDataStatus { Same, Changed, NoShimData, OldVersion }
 
     private static ShimDataStatus CompareShimData(PeResources.Module shim, Span<byte> newShimData) {
@@ -199,12 +269,14 @@ internal class ShimExecutable {
         return newShimData.SequenceEqual(currentShimData) ? ShimDataStatus.Same : ShimDataStatus.Changed;
     }
 
-    private void WriteNewShimResources(string shimPath, string? resourceSrcPath) {
-        var shimData = ShimDataEncoder.EncodeShim(this);
+    /// Managed fallback of <see cref="PogNative.UpdateShim"/> for new shims.
+    private void WriteNewShimResources(string shimPath, string? resourceSrcPath, Span<byte> shimData) {
         using var shimUpdater = new PeResources.ResourceUpdater(shimPath);
 
         // write shim data
         shimUpdater.SetResource(ShimDataResourceId, shimData);
+        // record which template the shim was created from
+        shimUpdater.SetResource(ShimFeaturesResourceId, BitConverter.GetBytes((ushort) RequiredFeatures));
 
         if (resourceSrcPath != null) {
             using var target = new PeResources.Module(resourceSrcPath);
@@ -218,24 +290,6 @@ internal class ShimExecutable {
         shimUpdater.CommitChanges();
     }
 
-    /// Configures a new shim. The shim binary at `shimPath` should already exist.
-    /// Assumes that the shim binary has no existing resources.
-    public PeBinary.PeInfo? WriteNewShim(string shimPath) {
-        if (IsPeBinary(TargetPath)) {
-            // copy subsystem from target binary
-            var targetInfo = PeBinary.GetInfo(TargetPath);
-            PeBinary.SetSubsystem(shimPath, targetInfo.Subsystem);
-
-            // write shim data and copy resources from either target, or a separate module
-            WriteNewShimResources(shimPath, MetadataSource ?? TargetPath);
-            return targetInfo;
-        } else {
-            // write shim data, copy resources from the passed module, if any
-            WriteNewShimResources(shimPath, MetadataSource);
-            return null;
-        }
-    }
-
     /// Copies resources of given `type`, assumes that the destination binary does not have any resources of type `type`.
     private static void CopyResources(PeResources.ResourceUpdater updater, PeResources.Module src,
             PeResources.ResourceType type) {
@@ -309,6 +363,18 @@ internal class ShimExecutable {
         }
     }
 
+    /// Optional parts of the shim launcher, must match `ShimFeature` in the shim. For each combination, there is a shim
+    /// template built only with the given features, see <see cref="GetTemplateFileName"/>.
+    [Flags]
+    public enum ShimFeatures : ushort {
+        None = 0,
+        /// The shim sets environment variables.
+        Environment = 1,
+        /// The shim modifies the command line (prepends arguments or replaces argv[0]).
+        Arguments = 2,
+        All = Environment | Arguments,
+    }
+
     public class ShimInUseException(string message, Exception innerException)
             : UnauthorizedAccessException(message, innerException);
 
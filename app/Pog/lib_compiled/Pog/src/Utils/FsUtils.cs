@@ -407,6 +407,35 @@ public static class FsUtils {
         return true;
     }
 
+    public static void CreateHardLink(string path, string existingFilePath) {
+        if (!Win32.CreateHardLink(path, existingFilePath)) {
+            Marshal.ThrowExceptionForHR(Marshal.GetHRForLastWin32Error());
+        }
+    }
+
+    private static Win32.BY_HANDLE_FILE_INFORMATION GetFileInformation(string filePath) {
+        // no access rights are needed to query the file information
+        using var handle = CreateFile(filePath, 0, FileShare.ReadWrite | FileShare.Delete,
+                FileMode.Open, Win32.FILE_FLAG.ATTRIBUTE_NORMAL);
+        if (!Win32.GetFileInformationByHandle(handle, out var info)) {
+            Marshal.ThrowExceptionForHR(Marshal.GetHRForLastWin32Error());
+        }
+        return info;
+    }
+
+    /// Returns the number of hardlinks to the file, which is 1 for a file without any other hardlinks.
+    public static uint GetHardLinkCount(string filePath) {
+        return GetFileInformation(filePath).NumberOfLinks;
+    }
+
+    /// Returns true if both paths point to the same file (e.g. they are hardlinks of each other).
+    public static bool IsSameFile(string path1, string path2) {
+        var i1 = GetFileInformation(path1);
+        var i2 = GetFileInformation(path2);
+        return i1.VolumeSerialNumber == i2.VolumeSerialNumber
+               && i1.FileIndexHigh == i2.FileIndexHigh && i1.FileIndexLow == i2.FileIndexLow;
+    }
+
     /// Returns true if any entry inside the directory or the directory is locked.
     public static bool IsDirectoryLocked(string directoryPath) {
         // move directory to itself; this returns false when the directory contains anything locked, and is a no-op otherwise
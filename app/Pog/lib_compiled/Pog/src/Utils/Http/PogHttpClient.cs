@@ -53,6 +53,28 @@ internal class PogHttpClient : HttpClient {
         return await response.Content.ReadFromJsonAsync<JsonElement>(token).ConfigureAwait(false);
     }
 
+    /// Retrieves the JSON document at `uri`, unless it did not change since the response with the validators `etag`
+    /// and `lastModified`. Returns null if the document does not exist.
+    public async Task<ConditionalJsonResponse?> RetrieveJsonIfModifiedAsync(Uri uri, string? etag, string? lastModified,
+            CancellationToken token = default) {
+        using var request = new HttpRequestMessage(HttpMethod.Get, uri);
+        // the validators are passed back to the server exactly as received, without parsing
+        if (etag != null) request.Headers.TryAddWithoutValidation("If-None-Match", etag);
+        if (lastModified != null) request.Headers.TryAddWithoutValidation("If-Modified-Since", lastModified);
+
+        var response = await SendAsync(request, token).ConfigureAwait(false);
+        if (response.StatusCode == HttpStatusCode.NotModified) {
+            response.Dispose();
+            return new ConditionalJsonResponse(null, etag, lastModified);
+        }
+        using var okResponse = EnsureSuccessOr404(response);
+        if (okResponse == null) return null;
+
+        var json = await okResponse.Content.ReadFromJsonAsync<JsonElement>(token).ConfigureAwait(false);
+        return new ConditionalJsonResponse(json, okResponse.Headers.ETag?.ToString(),
+                okResponse.Content.Headers.LastModified?.ToString("r"));
+    }
+
     public async Task<HttpFileStream> GetStreamAsync(Uri uri, UserAgentType userAgent, CancellationToken token = default) {
         using var request = new HttpRequestMessage(HttpMethod.Get, uri);
         request.Headers.Add("User-Agent", userAgent.GetHeaderString());
@@ -69,18 +91,29 @@ internal class PogHttpClient : HttpClient {
             //  that it should always be safe to just dispose the stream: https://github.com/dotnet/runtime/issues/28578
             var stream = await response.Content.ReadAsStreamAsync().ConfigureAwait(false);
             return new(stream, response.RequestMessage.RequestUri, response.Content.Headers.ContentLength,
-                    response.Content.Headers.ContentDisposition);
+                    response.Content.Headers.ContentDisposition, response.Headers.AcceptRanges.Contains("bytes"));
         } catch {
             response.Dispose();
             throw;
         }
     }
 
+    public readonly record struct ConditionalJsonResponse(
+            /// Null if the document was not modified.
+            JsonElement? Json,
+            string? ETag,
+            string? LastModified
+    ) {
+        public bool NotModified => Json == null;
+    }
+
     public readonly record struct HttpFileStream(
             Stream Stream,
             Uri FinalUri,
             long? ContentLength,
-            ContentDispositionHeaderValue? ContentDisposition
+            ContentDispositionHeaderValue? ContentDisposition,
+            /// The server supports range requests (`Accept-Ranges: bytes`).
+            bool AcceptsRanges
     ) : IDisposable {
         public string GenerateFileName() => HttpFileNameParser.GetDownloadedFileName(FinalUri, ContentDisposition);
 
@@ -0,0 +1,176 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading;
+
+namespace Pog.Utils;
+
+/// Log-linear histogram of latencies in nanoseconds, in the style of HdrHistogram: values below `2^SubBucketBits`
+/// are stored exactly, larger values in `2^SubBucketBits` linear sub-buckets per power of 2, so the relative error
+/// of a reported value is below ~3% at any magnitude. The bucket layout is the same as in the shim launch trace
+/// reader (`Pog.Shim/tools/LaunchTraceAggregator.hpp`).
+///
+/// Recording never takes a lock and threads do not contend with each other: each thread records into its own shard,
+/// which is only written by that thread. <see cref="TakeSnapshot"/> sums all shards, and may run concurrently
+/// with recording.
+public sealed class LatencyHistogram {
+    public const int SubBucketBits = 5;
+    private const int SubBucketCount = 1 << SubBucketBits;
+    /// Larger values (~9.8 hours) are counted in the last bucket; the exact maximum is still tracked.
+    public const long MaxTrackableValue = (1L << 45) - 1;
+    internal static readonly int BucketCount = BucketIndex(MaxTrackableValue) + 1;
+
+    private static readonly double NanosecondsPerTick = 1e9 / Stopwatch.Frequency;
+
+    private readonly ThreadLocal<Shard> _localShard;
+    /// Lock-free list of the shards of all threads that recorded a value. Shards are never removed, so that the values
+    /// recorded by threads which already exited are kept.
+    private Shard? _shards = null;
+
+    public LatencyHistogram() {
+        _localShard = new ThreadLocal<Shard>(AddShard);
+    }
+
+    /// Starts a timer which records the elapsed time when disposed: `using var _ = histogram.Time();`
+    public Timer Time() => new(this);
+
+    public void Record(TimeSpan duration) {
+        Record(duration.Ticks * 100);
+    }
+
+    /// Records the time elapsed since `startTimestamp`, which was returned by `Stopwatch.GetTimestamp()`.
+    public void RecordElapsedSince(long startTimestamp) {
+        Record((long) ((Stopwatch.GetTimestamp() - startTimestamp) * NanosecondsPerTick));
+    }
+
+    public void Record(long nanoseconds) {
+        if (nanoseconds < 0) nanoseconds = 0;
+        var shard = _localShard.Value!;
+        // the shard is only written by this thread, the interlocked operations are uncontended and only ensure that
+        //  `TakeSnapshot` does not read torn 64-bit values
+        Interlocked.Increment(ref shard.Buckets[BucketIndex(Math.Min(nanoseconds, MaxTrackableValue))]);
+        Interlocked.Add(ref shard.Sum, nanoseconds);
+        if (nanoseconds > shard.Max) Interlocked.Exchange(ref shard.Max, nanoseconds);
+        if (nanoseconds < shard.Min) Interlocked.Exchange(ref shard.Min, nanoseconds);
+    }
+
+    public Snapshot TakeSnapshot() {
+        var buckets = new long[BucketCount];
+        long sum = 0, min = long.MaxValue, max = 0;
+        for (var shard = Volatile.Read(ref _shards); shard != null; shard = shard.Next) {
+            for (var i = 0; i < buckets.Length; i++) {
+                buckets[i] += Interlocked.Read(ref shard.Buckets[i]);
+            }
+            sum += Interlocked.Read(ref shard.Sum);
+            min = Math.Min(min, Interlocked.Read(ref shard.Min));
+            max = Math.Max(max, Interlocked.Read(ref shard.Max));
+        }
+        return new Snapshot(buckets, sum, min, max);
+    }
+
+    private Shard AddShard() {
+        var shard = new Shard();
+        do {
+            shard.Next = Volatile.Read(ref _shards);
+        } while (Interlocked.CompareExchange(ref _shards, shard, shard.Next) != shard.Next);
+        return shard;
+    }
+
+    internal static int BucketIndex(long value) {
+        // shift the value into the sub-bucket range of its power of 2, `[SubBucketCount, 2 * SubBucketCount)`
+        var shift = Math.Max(BitWidth((ulong) value) - SubBucketBits - 1, 0);
+        return shift * SubBucketCount + (int) (value >> shift);
+    }
+
+    /// Largest value stored in the bucket `index`.
+    internal static long BucketUpperBound(int index) {
+        if (index < 2 * SubBucketCount) return index;
+        var shift = index / SubBucketCount - 1;
+        var subBucket = (long) (index % SubBucketCount + SubBucketCount);
+        return ((subBucket + 1) << shift) - 1;
+    }
+
+    // `BitOperations` are not available in .NET Standard 2.0
+    private static int BitWidth(ulong value) {
+        var width = 0;
+        for (var shift = 32; shift > 0; shift /= 2) {
+            if (value >= 1UL << shift) {
+                value >>= shift;
+                width += shift;
+            }
+        }
+        return width + (int) value;
+    }
+
+    private sealed class Shard {
+        public readonly long[] Buckets = new long[BucketCount];
+        public long Sum = 0;
+        public long Min = long.MaxValue;
+        public long Max = 0;
+        public Shard? Next;
+    }
+
+    public readonly struct Timer : IDisposable {
+        private readonly LatencyHistogram _histogram;
+        private readonly long _start;
+
+        internal Timer(LatencyHistogram histogram) {
+            _histogram = histogram;
+            _start = Stopwatch.GetTimestamp();
+        }
+
+        public void Dispose() {
+            _histogram.RecordElapsedSince(_start);
+        }
+    }
+
+    /// Merged content of all shards at some point in time.
+    public sealed class Snapshot {
+        private readonly long[] _buckets;
+        public readonly long Count;
+        public readonly long Sum;
+        public readonly long Min;
+        public readonly long Max;
+
+        public double Mean => Count == 0 ? 0 : (double) Sum / Count;
+
+        internal Snapshot(long[] buckets, long sum, long min, long max) {
+            _buckets = buckets;
+            foreach (var c in buckets) Count += c;
+            Sum = sum;
+            Min = Count == 0 ? 0 : min;
+            Max = max;
+        }
+
+        /// Returns the value below which `percentile` % of the recorded values are (the upper bound of the bucket
+        /// containing it, but at most the maximum recorded value).
+        public long ValueAtPercentile(double percentile) {
+            if (Count == 0) return 0;
+            var rank = (long) (percentile / 100.0 * Count + 0.5);
+            rank = Math.Min(Math.Max(rank, 1), Count);
+            long seen = 0;
+            for (var i = 0; i < _buckets.Length; i++) {
+                seen += _buckets[i];
+                if (seen >= rank) return Math.Min(BucketUpperBound(i), Max);
+            }
+            return Max;
+        }
+
+        /// Returns the number of recorded values smaller than `2^exponent` ns. This is exact, since powers of 2 are
+        /// bucket boundaries.
+        public long CountBelowPowerOf2(int exponent) {
+            long count = 0;
+            for (var i = 0; i < _buckets.Length && BucketUpperBound(i) < 1L << exponent; i++) {
+                count += _buckets[i];
+            }
+            return count;
+        }
+
+        /// Enumerates the non-empty buckets, as the largest value stored in the bucket and the number of values in it.
+        public IEnumerable<(long UpperBound, long Count)> EnumerateBuckets() {
+            for (var i = 0; i < _buckets.Length; i++) {
+                if (_buckets[i] != 0) yield return (BucketUpperBound(i), _buckets[i]);
+            }
+        }
+    }
+}
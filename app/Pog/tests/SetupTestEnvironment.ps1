@@ -26,7 +26,7 @@ if ($IsNonIteractive -and (Get-Variable PSStyle -ErrorAction Ignore)) {
     cd PogTests:\
 
     $null = mkdir .\data\repository, .\data\package_bin
-    $null = mkdir .\cache\download_cache, .\cache\download_tmp
+    $null = mkdir .\cache\download_cache, .\cache\download_tmp, .\cache\repository_index
 
     # import Pog.dll so that we can override the test path below
     Import-Module (Get-PogDll)
@@ -115,6 +115,12 @@ newdir "./data/package_bin"
 # downloaded package cache
 newdir "./cache/download_cache"
 newdir "./cache/download_tmp"
+# partial large downloads, resumed by the next installation
+newdir "./cache/download_resume"
+# local copies of the package indexes of remote repositories
+newdir "./cache/repository_index"
+# compiled manifests of templated packages
+newdir "./cache/manifest_cache"
 
 $ROOT_FILE_PATH = Join-Path $PSScriptRoot "./data/package_roots.txt"
 if (-not (Test-Path -PathType Leaf $ROOT_FILE_PATH)) {